@@ -0,0 +1,2082 @@
+/*
+ * This file was generated automatically by ExtUtils::ParseXS version 3.45 from the
+ * contents of Scan.xs. Do not edit this file, edit Scan.xs instead.
+ *
+ *    ANY CHANGES MADE HERE WILL BE LOST!
+ *
+ */
+
+#line 1 "Scan.xs"
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include "ppport.h"
+
+// If we are on MSVC, disable some stupid MSVC warnings
+#ifdef _MSC_VER
+# pragma warning( disable: 4996 )
+# pragma warning( disable: 4127 )
+# pragma warning( disable: 4711 )
+#endif
+
+// Headers for stat support
+#ifdef _MSC_VER
+# include <windows.h>
+#else
+# include <sys/stat.h>
+#endif
+
+#include "common.c"
+#include "ape.c"
+#include "id3.c"
+
+#include "aac.c"
+#include "asf.c"
+#include "mac.c"
+#include "mp3.c"
+#include "mp4.c"
+#include "mpc.c"
+#include "ogg.c"
+#include "wav.c"
+#include "flac.c"
+#include "wavpack.c"
+#include "dsf.c"
+#include "dsdiff.c"
+
+#include "md5.c"
+#include "jenkins_hash.c"
+#include "scanpool.c"
+#include "scancache.c"
+
+#define FILTER_TYPE_INFO 0x01
+#define FILTER_TYPE_TAGS 0x02
+
+#define MD5_BUFFER_SIZE 4096
+
+#define MAX_PATH_STR_LEN 1024
+
+struct _types {
+  char *type;
+  char *suffix[15];
+};
+
+typedef struct {
+  char*	type;
+  int (*get_tags)(ScanIO *infile, char *file, resval *info, resval *tags);
+  int (*get_fileinfo)(ScanIO *infile, char *file, resval *tags);
+  off_t (*find_frame)(ScanIO *infile, char *file, int offset);
+  int (*find_frame_return_info)(ScanIO *infile, char *file, int offset, resval *info);
+  void * (*seek_open)(ScanIO *infile, char *file);
+  off_t (*seek)(void *state, int offset, resval *info);
+  void (*seek_close)(void *state);
+  resval * (*seek_index)(void *state);
+  resval * (*clip_ranges)(void *state, int start_ms, int end_ms);
+  off_t (*seek_write)(void *state, int offset, resval *info, seekwriter *w);
+} taghandler;
+
+struct _types audio_types[] = {
+  {"mp4", {"mp4", "m4a", "m4b", "m4p", "m4v", "m4r", "k3g", "skm", "3gp", "3g2", "mov", 0}},
+  {"aac", {"aac", "adts", 0}},
+  {"mp3", {"mp3", "mp2", 0}},
+  {"ogg", {"ogg", "oga", 0}},
+  {"mpc", {"mpc", "mp+", "mpp", 0}},
+  {"ape", {"ape", "apl", 0}},
+  {"flc", {"flc", "flac", "fla", 0}},
+  {"asf", {"wma", "asf", "wmv", 0}},
+  {"wav", {"wav", "aif", "aiff", 0}},
+  {"wvp", {"wv", 0}},
+  {"dsf", {"dsf", 0}},
+  {"dff", {"dff", 0}},
+  {0, {0, 0}}
+};
+
+static taghandler taghandlers[] = {
+  { "mp4", get_mp4tags, 0, mp4_find_frame, mp4_find_frame_return_info, mp4_seek_open, mp4_seek, mp4_seek_close, 0, mp4_clip_ranges, mp4_seek_write },
+  { "aac", get_aacinfo, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "mp3", get_mp3tags, get_mp3fileinfo, mp3_find_frame, mp3_find_frame_return_info, mp3_seek_open, mp3_seek, mp3_seek_close, mp3_seek_index, mp3_clip_ranges, 0 },
+  { "ogg", get_ogg_metadata, 0, ogg_find_frame, 0, ogg_seek_open, ogg_seek, ogg_seek_close, 0, 0, 0 },
+  { "mpc", get_ape_metadata, get_mpcfileinfo, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "ape", get_ape_metadata, get_macfileinfo, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "flc", get_flac_metadata, 0, flac_find_frame, 0, flac_seek_open, flac_seek, flac_seek_close, 0, 0, 0 },
+  { "asf", get_asf_metadata, 0, asf_find_frame, 0, asf_seek_open, asf_seek, asf_seek_close, 0, 0, 0 },
+  { "wav", get_wav_metadata, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "wvp", get_ape_metadata, get_wavpack_info, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "dsf", get_dsf_metadata, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "dff", get_dsdiff_metadata, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { NULL, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+};
+
+// A file opened by Audio::Scan::File, parsed once for any number of seeks
+typedef struct {
+  taghandler *hdl;
+  SV *src;           // filehandle, or ref to a private copy of the data, for the ScanIO
+  char *file;
+  ScanIO io;
+  ScanResult result; // info built by seek_open, for the life of the file
+  void *state;       // from seek_open, NULL if the type can't seek
+} scanfile;
+
+static taghandler *
+_get_taghandler(char *suffix)
+{
+  int typeindex = -1;
+  int i, j;
+  taghandler *hdl = NULL;
+  
+  for (i=0; typeindex==-1 && audio_types[i].type; i++) {
+    for (j=0; typeindex==-1 && audio_types[i].suffix[j]; j++) {
+#ifdef _MSC_VER
+      if (!stricmp(audio_types[i].suffix[j], suffix)) {
+#else
+      if (!strcasecmp(audio_types[i].suffix[j], suffix)) {
+#endif
+        typeindex = i;
+        break;
+      }
+    }
+  }
+    
+  if (typeindex > -1) {
+    for (hdl = taghandlers; hdl->type; ++hdl)
+      if (!strcmp(hdl->type, audio_types[typeindex].type))
+        break;
+  }
+  
+  return hdl;
+}
+
+// The suffix after the last '.' of path, by the same rule as scan's
+// /\.(\w+)$/, so a dot in a directory name or a trailing dot gives NULL
+static const char *
+_path_suffix(const char *path)
+{
+  const char *suffix = strrchr(path, '.');
+  const char *p;
+  
+  if (suffix == NULL || suffix[1] == '\0')
+    return NULL;
+  
+  for (p = suffix + 1; *p; p++) {
+    if ( !isALNUM(*p) )
+      return NULL;
+  }
+  
+  return suffix + 1;
+}
+
+static void
+_generate_md5(ScanIO *infile, const char *file, int size, int start_offset, resval *info)
+{
+  md5_state_t md5;
+  md5_byte_t digest[16];
+  char hexdigest[33];
+  Buffer buf;
+  int audio_offset, audio_size, di;
+  
+  buffer_init(&buf, MD5_BUFFER_SIZE);
+  md5_init(&md5);
+  
+  audio_offset = res_iv(*(res_hv_fetch(info, "audio_offset")));
+  audio_size = res_iv(*(res_hv_fetch(info, "audio_size")));
+  
+  if (!start_offset) {
+    // Read bytes from middle of file to reduce chance of silence generating false matches
+    start_offset = audio_offset;
+    start_offset += (audio_size / 2) - (size / 2);
+    if (start_offset < audio_offset)
+      start_offset = audio_offset;
+  }
+  
+  if (size >= audio_size) {
+    size = audio_size;
+  }
+  
+  DEBUG_TRACE("Using %d bytes for audio MD5, starting at %d\n", size, start_offset);
+  
+  if (scanio_seek(infile, start_offset, SEEK_SET) < 0) {
+    LOG_WARN("Audio::Scan unable to determine MD5 for %s\n", file);
+    goto out;
+  }
+  
+  while (size > 0) {
+    if ( !_check_buf(infile, &buf, 1, MIN(size, MD5_BUFFER_SIZE)) ) {
+      LOG_WARN("Audio::Scan unable to determine MD5 for %s\n", file);
+      goto out;
+    }
+    
+    md5_append(&md5, buffer_ptr(&buf), buffer_len(&buf));
+    
+    size -= buffer_len(&buf);
+    buffer_consume(&buf, buffer_len(&buf));
+    DEBUG_TRACE("%d bytes left\n", size);
+  }
+  
+  md5_finish(&md5, digest);
+  
+  for (di = 0; di < 16; ++di)
+    sprintf(hexdigest + di * 2, "%02x", digest[di]);
+  
+  res_hv_store(info, "audio_md5", res_newpvn(hexdigest, 32));
+  
+out:
+  buffer_free(&buf);
+}
+
+static void
+_scanio_free(pTHX_ void *ptr)
+{
+  ScanIO *io = (ScanIO *)ptr;
+  
+  scanio_close(io);
+  Safefree(io);
+}
+
+static int
+_scanio_type(SV *io_type)
+{
+  int type = SCANIO_PERLIO;
+  
+  if ( io_type && SvOK(io_type) ) {
+    type = scanio_type( SvPV_nolen(io_type) );
+    if (type < 0) {
+      croak("Audio::Scan unknown io type: %s", SvPV_nolen(io_type));
+    }
+  }
+  
+  return type;
+}
+
+// The source is either a filehandle or a reference to a scalar holding the
+// file data, which is parsed in place without copying.  A string with the
+// UTF8 flag is parsed from a byte copy, leaving the caller's scalar as it is.
+static void
+_scanio_init(ScanIO *io, SV *src, int type)
+{
+  if ( SvROK(src) && SvTYPE(SvRV(src)) <= SVt_PVMG ) {
+    SV *sv = SvRV(src);
+    STRLEN len;
+    unsigned char *data;
+    
+    if ( SvUTF8(sv) ) {
+      sv = sv_2mortal( newSVsv(sv) );
+      
+      if ( !sv_utf8_downgrade(sv, TRUE) ) {
+        croak("Audio::Scan scan_data needs a byte string");
+      }
+    }
+    
+    data = (unsigned char *)SvPV(sv, len);
+    
+    scanio_init_memory(io, data, len);
+  }
+  else {
+    scanio_init_type(io, IoIFP(sv_2io(src)), type);
+  }
+}
+
+// Wrap the source in the requested I/O backend, the ScanIO is released
+// when the caller's scope is left, even if a parser croaks.
+static ScanIO *
+_scanio_new(SV *src, SV *io_type)
+{
+  ScanIO *io;
+  int type = _scanio_type(io_type);
+  
+  Newz(0, io, 1, ScanIO);
+  SAVEDESTRUCTOR_X(_scanio_free, io);
+  
+  _scanio_init(io, src, type);
+  
+  return io;
+}
+
+static void
+_scanpool_free(pTHX_ void *ptr)
+{
+  scanpool *pool = (scanpool *)ptr;
+  
+  scanpool_destroy(pool);
+  Safefree(pool);
+}
+
+static uint32_t
+_generate_hash(const char *file)
+{
+  char hashstr[MAX_PATH_STR_LEN];
+  int mtime = 0;
+  uint64_t size = 0;
+  uint32_t hash;
+
+#ifdef _MSC_VER
+  BOOL fOk;
+  WIN32_FILE_ATTRIBUTE_DATA fileInfo;
+
+  fOk = GetFileAttributesEx(file, GetFileExInfoStandard, (void *)&fileInfo);
+  mtime = fileInfo.ftLastWriteTime.dwLowDateTime;
+  size = (uint64_t)fileInfo.nFileSizeLow;
+#else
+  struct stat buf;
+
+  if (stat(file, &buf) != -1) {
+    mtime = (int)buf.st_mtime;
+    size = (uint64_t)buf.st_size;
+  }
+#endif
+
+  memset(hashstr, 0, sizeof(hashstr));
+  snprintf(hashstr, sizeof(hashstr) - 1, "%s%d%llu", file, mtime, size);
+  hash = hashlittle(hashstr, strlen(hashstr), 0);
+  
+  return hash;
+}
+
+static void
+_result_free(pTHX_ void *ptr)
+{
+  ScanResult *r = (ScanResult *)ptr;
+  
+  result_leave(r);
+  result_free(r);
+  Safefree(r);
+}
+
+static void
+_result_leave(pTHX_ void *ptr)
+{
+  result_leave((ScanResult *)ptr);
+}
+
+// Makes a new ScanResult current for the parsers, it is released when the
+// caller's scope is left, even if a parser croaks
+static ScanResult *
+_result_new(void)
+{
+  ScanResult *r;
+  
+  Newz(0, r, 1, ScanResult);
+  result_init(r);
+  SAVEDESTRUCTOR_X(_result_free, r);
+  result_enter(r);
+  
+  return r;
+}
+
+// Runs the format's parsers over an open source and returns a result hash
+// holding info and tags.  This only uses the current ScanResult, never the
+// interpreter, so it may run on a scan_many worker thread.
+static resval *
+_scan_parse(taghandler *hdl, ScanIO *infile, char *file, int filter, int md5_size, int md5_offset)
+{
+  resval *ret = res_newhv();
+  resval *info = res_newhv();
+  
+  // Options beyond the filter are read by the parsers
+  result_current()->flags = filter & ~(FILTER_TYPE_INFO | FILTER_TYPE_TAGS);
+
+  // Ignore filter if a file type has only one function (FLAC/Ogg)
+  if ( !hdl->get_fileinfo ) {
+    filter = FILTER_TYPE_INFO | FILTER_TYPE_TAGS;
+  }
+
+  if ( hdl->get_fileinfo && (filter & FILTER_TYPE_INFO) ) {
+    hdl->get_fileinfo(infile, file, info);
+  }
+
+  if ( hdl->get_tags && (filter & FILTER_TYPE_TAGS) ) {
+    resval *tags = res_newhv();
+    hdl->get_tags(infile, file, info, tags);
+    res_hv_store( ret, "tags", tags );
+  }
+  
+  // Generate audio MD5 value
+  if ( md5_size > 0
+    && res_hv_exists(info, "audio_offset")
+    && res_hv_exists(info, "audio_size")
+    && !res_hv_exists(info, "audio_md5")
+  ) {
+    _generate_md5(infile, file, md5_size, md5_offset, info);
+  }
+  
+  // Generate hash value
+  res_hv_store(info, "jenkins_hash", res_newuv( _generate_hash(file) ));
+
+  // Info may be used in tag function, i.e. to find tag version
+  res_hv_store( ret, "info", info );
+  
+  return ret;
+}
+
+// Parses an open source and returns the (mortal) result hash, which is
+// also stored in cache if one is given
+static HV *
+_scan_io(taghandler *hdl, ScanIO *infile, SV *path, int filter, int md5_size, int md5_offset, scancache *cache)
+{
+  HV *ret;
+  resval *result;
+  scancache_id id;
+  int have_id = 0;
+  
+  // The identity of the file actually opened, before it is read
+  if ( cache && infile->type != SCANIO_MEMORY ) {
+    int fd = infile->type == SCANIO_PERLIO ? PerlIO_fileno(infile->pio) : infile->fd;
+    have_id = scancache_identify(SvPVX(path), fd, &id);
+  }
+  
+  _result_new();
+  
+  result = _scan_parse(hdl, infile, SvPVX(path), filter, md5_size, md5_offset);
+  
+  if (have_id) {
+    if ( !scancache_store(cache, SvPVX(path), &id, filter, md5_size, md5_offset, result) )
+      warn("Audio::Scan unable to write to cache %s: %s\n", cache->path, strerror(errno));
+  }
+  
+  ret = res_to_hv(result);
+  
+  // don't leak
+  sv_2mortal( (SV*)ret );
+  
+  return ret;
+}
+
+typedef struct {
+  int offset;
+  int index;
+} frametarget;
+
+static int
+_frametarget_cmp(const void *a, const void *b)
+{
+  const frametarget *x = (const frametarget *)a;
+  const frametarget *y = (const frametarget *)b;
+  
+  if (x->offset != y->offset)
+    return x->offset < y->offset ? -1 : 1;
+  
+  return x->index - y->index;
+}
+
+// Seeks to each offset in the array ref, in increasing order so formats
+// that search can narrow the search using the previous frame found, and
+// returns a ref to an array of frame offsets in the original order
+#define CHECK_FRAME_TARGETS(offsets) \
+  if ( !SvROK(offsets) || SvTYPE(SvRV(offsets)) != SVt_PVAV ) \
+    croak("Audio::Scan find_frames needs an array reference of offsets")
+
+static SV *
+_find_frames_state(taghandler *hdl, void *state, SV *offsets)
+{
+  AV *in = (AV *)SvRV(offsets);
+  AV *out = newAV();
+  frametarget *targets;
+  int i, n;
+  
+  n = av_len(in) + 1;
+  
+  if (n <= 0) {
+    return newRV_noinc((SV *)out);
+  }
+  
+  New(0, targets, n, frametarget);
+  SAVEFREEPV(targets);
+  
+  for (i = 0; i < n; i++) {
+    SV **sv = av_fetch(in, i, 0);
+    targets[i].offset = sv ? SvIV(*sv) : 0;
+    targets[i].index  = i;
+  }
+  
+  qsort(targets, n, sizeof(frametarget), _frametarget_cmp);
+  
+  av_extend(out, n - 1);
+  
+  for (i = 0; i < n; i++) {
+    off_t frame_offset = state ? hdl->seek(state, targets[i].offset, NULL) : -1;
+    av_store( out, targets[i].index, newSViv(frame_offset) );
+  }
+  
+  return newRV_noinc((SV *)out);
+}
+
+// Where find_frame_write_info sends a seek header: printed to a filehandle,
+// or passed to a callback with the header length.  A callback that dies
+// stops the seek, its error is kept to be rethrown once the seek is done.
+typedef struct {
+  PerlIO *fh;
+  SV *callback;
+  SV *error;
+} seektarget;
+
+static void
+_seektarget_init(seektarget *t, SV *target)
+{
+  t->fh = NULL;
+  t->callback = NULL;
+  t->error = NULL;
+  
+  if ( SvROK(target) && SvTYPE(SvRV(target)) == SVt_PVCV ) {
+    t->callback = target;
+  }
+  else {
+    IO *io = sv_2io(target);
+    
+    if ( !io || !(t->fh = IoOFP(io)) )
+      croak("Audio::Scan find_frame_write_info needs a filehandle open for writing or a code reference");
+  }
+}
+
+static int
+_seektarget_write(seekwriter *w, const char *data, size_t len)
+{
+  dTHX;
+  seektarget *t = (seektarget *)w->ctx;
+  
+  if (t->fh) {
+    return PerlIO_write(t->fh, data, len) == (SSize_t)len;
+  }
+  else {
+    dSP;
+    int ok;
+    
+    ENTER;
+    SAVETMPS;
+    
+    PUSHMARK(SP);
+    XPUSHs( sv_2mortal( newSVpvn(data, len) ) );
+    XPUSHs( sv_2mortal( newSVuv(w->length) ) );
+    PUTBACK;
+    
+    call_sv(t->callback, G_VOID | G_DISCARD | G_EVAL);
+    
+    ok = !SvTRUE(ERRSV);
+    if (!ok)
+      t->error = newSVsv(ERRSV);
+    
+    FREETMPS;
+    LEAVE;
+    
+    return ok;
+  }
+}
+
+// Seeks with the header sent to target, returns the info hash
+static HV *
+_seek_write_info(taghandler *hdl, void *state, int offset, seektarget *t)
+{
+  resval *info = res_newhv();
+  seekwriter w;
+  
+  w.write  = _seektarget_write;
+  w.ctx    = t;
+  w.length = 0;
+  
+  if (state) {
+    hdl->seek_write(state, offset, info, &w);
+  }
+  else {
+    res_hv_store( info, "seek_offset", res_newiv(-1) );
+  }
+  
+  if (t->fh)
+    PerlIO_flush(t->fh);
+  
+  return res_to_hv(info);
+}
+
+// Rethrows the error of a callback, after the seek has cleaned up
+static void
+_seektarget_rethrow(seektarget *t)
+{
+  if (t->error) {
+    sv_setsv( ERRSV, sv_2mortal(t->error) );
+    croak(NULL);
+  }
+}
+
+static scanfile *
+_get_file(SV *sv)
+{
+  if ( !sv_derived_from(sv, "Audio::Scan::File") ) {
+    croak("Not an Audio::Scan::File object");
+  }
+  
+  return INT2PTR(scanfile *, SvIV(SvRV(sv)));
+}
+
+static scancache *
+_get_cache(SV *sv)
+{
+  if ( sv && SvROK(sv) && sv_derived_from(sv, "Audio::Scan::Cache") )
+    return INT2PTR(scancache *, SvIV(SvRV(sv)));
+  
+  return NULL;
+}
+
+typedef struct {
+  int filter;
+  int md5_size;
+  int md5_offset;
+} scanopts;
+
+// Parses a scan_many job into its own ScanResult, on a worker thread if
+// the file could be mapped.  A croak from a parser jumps back here and
+// becomes a warning, so one bad file doesn't stop the whole batch.
+static void
+_scanjob_parse(scanjob *job, void *arg)
+{
+  scanopts *opts = (scanopts *)arg;
+  const char *suffix = _path_suffix(job->path);
+  taghandler *hdl = suffix ? _get_taghandler((char *)suffix) : NULL;
+  jmp_buf jmp;
+  
+  job->result.jmp = &jmp;
+  result_enter(&job->result);
+  
+  if ( !setjmp(jmp) ) {
+    if (hdl) {
+      job->ret = _scan_parse(hdl, &job->io, (char *)job->path, opts->filter, opts->md5_size, opts->md5_offset);
+    }
+    else if (suffix) {
+      res_warn("Audio::Scan unsupported file type: %s (%s)\n", suffix, job->path);
+    }
+  }
+  
+  result_leave(&job->result);
+  job->result.jmp = NULL;
+  job->parsed = 1;
+}
+
+#line 651 "Scan.c"
+#ifndef PERL_UNUSED_VAR
+#  define PERL_UNUSED_VAR(var) if (0) var = var
+#endif
+
+#ifndef dVAR
+#  define dVAR		dNOOP
+#endif
+
+
+/* This stuff is not part of the API! You have been warned. */
+#ifndef PERL_VERSION_DECIMAL
+#  define PERL_VERSION_DECIMAL(r,v,s) (r*1000000 + v*1000 + s)
+#endif
+#ifndef PERL_DECIMAL_VERSION
+#  define PERL_DECIMAL_VERSION \
+	  PERL_VERSION_DECIMAL(PERL_REVISION,PERL_VERSION,PERL_SUBVERSION)
+#endif
+#ifndef PERL_VERSION_GE
+#  define PERL_VERSION_GE(r,v,s) \
+	  (PERL_DECIMAL_VERSION >= PERL_VERSION_DECIMAL(r,v,s))
+#endif
+#ifndef PERL_VERSION_LE
+#  define PERL_VERSION_LE(r,v,s) \
+	  (PERL_DECIMAL_VERSION <= PERL_VERSION_DECIMAL(r,v,s))
+#endif
+
+/* XS_INTERNAL is the explicit static-linkage variant of the default
+ * XS macro.
+ *
+ * XS_EXTERNAL is the same as XS_INTERNAL except it does not include
+ * "STATIC", ie. it exports XSUB symbols. You probably don't want that
+ * for anything but the BOOT XSUB.
+ *
+ * See XSUB.h in core!
+ */
+
+
+/* TODO: This might be compatible further back than 5.10.0. */
+#if PERL_VERSION_GE(5, 10, 0) && PERL_VERSION_LE(5, 15, 1)
+#  undef XS_EXTERNAL
+#  undef XS_INTERNAL
+#  if defined(__CYGWIN__) && defined(USE_DYNAMIC_LOADING)
+#    define XS_EXTERNAL(name) __declspec(dllexport) XSPROTO(name)
+#    define XS_INTERNAL(name) STATIC XSPROTO(name)
+#  endif
+#  if defined(__SYMBIAN32__)
+#    define XS_EXTERNAL(name) EXPORT_C XSPROTO(name)
+#    define XS_INTERNAL(name) EXPORT_C STATIC XSPROTO(name)
+#  endif
+#  ifndef XS_EXTERNAL
+#    if defined(HASATTRIBUTE_UNUSED) && !defined(__cplusplus)
+#      define XS_EXTERNAL(name) void name(pTHX_ CV* cv __attribute__unused__)
+#      define XS_INTERNAL(name) STATIC void name(pTHX_ CV* cv __attribute__unused__)
+#    else
+#      ifdef __cplusplus
+#        define XS_EXTERNAL(name) extern "C" XSPROTO(name)
+#        define XS_INTERNAL(name) static XSPROTO(name)
+#      else
+#        define XS_EXTERNAL(name) XSPROTO(name)
+#        define XS_INTERNAL(name) STATIC XSPROTO(name)
+#      endif
+#    endif
+#  endif
+#endif
+
+/* perl >= 5.10.0 && perl <= 5.15.1 */
+
+
+/* The XS_EXTERNAL macro is used for functions that must not be static
+ * like the boot XSUB of a module. If perl didn't have an XS_EXTERNAL
+ * macro defined, the best we can do is assume XS is the same.
+ * Dito for XS_INTERNAL.
+ */
+#ifndef XS_EXTERNAL
+#  define XS_EXTERNAL(name) XS(name)
+#endif
+#ifndef XS_INTERNAL
+#  define XS_INTERNAL(name) XS(name)
+#endif
+
+/* Now, finally, after all this mess, we want an ExtUtils::ParseXS
+ * internal macro that we're free to redefine for varying linkage due
+ * to the EXPORT_XSUB_SYMBOLS XS keyword. This is internal, use
+ * XS_EXTERNAL(name) or XS_INTERNAL(name) in your code if you need to!
+ */
+
+#undef XS_EUPXS
+#if defined(PERL_EUPXS_ALWAYS_EXPORT)
+#  define XS_EUPXS(name) XS_EXTERNAL(name)
+#else
+   /* default to internal */
+#  define XS_EUPXS(name) XS_INTERNAL(name)
+#endif
+
+#ifndef PERL_ARGS_ASSERT_CROAK_XS_USAGE
+#define PERL_ARGS_ASSERT_CROAK_XS_USAGE assert(cv); assert(params)
+
+/* prototype to pass -Wmissing-prototypes */
+STATIC void
+S_croak_xs_usage(const CV *const cv, const char *const params);
+
+STATIC void
+S_croak_xs_usage(const CV *const cv, const char *const params)
+{
+    const GV *const gv = CvGV(cv);
+
+    PERL_ARGS_ASSERT_CROAK_XS_USAGE;
+
+    if (gv) {
+        const char *const gvname = GvNAME(gv);
+        const HV *const stash = GvSTASH(gv);
+        const char *const hvname = stash ? HvNAME(stash) : NULL;
+
+        if (hvname)
+	    Perl_croak_nocontext("Usage: %s::%s(%s)", hvname, gvname, params);
+        else
+	    Perl_croak_nocontext("Usage: %s(%s)", gvname, params);
+    } else {
+        /* Pants. I don't think that it should be possible to get here. */
+	Perl_croak_nocontext("Usage: CODE(0x%" UVxf ")(%s)", PTR2UV(cv), params);
+    }
+}
+#undef  PERL_ARGS_ASSERT_CROAK_XS_USAGE
+
+#define croak_xs_usage        S_croak_xs_usage
+
+#endif
+
+/* NOTE: the prototype of newXSproto() is different in versions of perls,
+ * so we define a portable version of newXSproto()
+ */
+#ifdef newXS_flags
+#define newXSproto_portable(name, c_impl, file, proto) newXS_flags(name, c_impl, file, proto, 0)
+#else
+#define newXSproto_portable(name, c_impl, file, proto) (PL_Sv=(SV*)newXS(name, c_impl, file), sv_setpv(PL_Sv, proto), (CV*)PL_Sv)
+#endif /* !defined(newXS_flags) */
+
+#if PERL_VERSION_LE(5, 21, 5)
+#  define newXS_deffile(a,b) Perl_newXS(aTHX_ a,b,file)
+#else
+#  define newXS_deffile(a,b) Perl_newXS_deffile(aTHX_ a,b)
+#endif
+
+#line 795 "Scan.c"
+
+XS_EUPXS(XS_Audio__Scan__scan); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__scan)
+{
+    dVAR; dXSARGS;
+    if (items < 7 || items > 9)
+       croak_xs_usage(cv,  "char *, suffix, src, path, filter, md5_size, md5_offset, io_type= NULL, cache= NULL");
+    {
+	HV *	RETVAL;
+	char *	suffix = (char *)SvPV_nolen(ST(1))
+;
+	SV *	src = ST(2)
+;
+	SV *	path = ST(3)
+;
+	int	filter = (int)SvIV(ST(4))
+;
+	int	md5_size = (int)SvIV(ST(5))
+;
+	int	md5_offset = (int)SvIV(ST(6))
+;
+	SV *	io_type;
+	SV *	cache;
+
+	if (items < 8)
+	    io_type = NULL;
+	else {
+	    io_type = ST(7)
+;
+	}
+
+	if (items < 9)
+	    cache = NULL;
+	else {
+	    cache = ST(8)
+;
+	}
+#line 646 "Scan.xs"
+{
+  taghandler *hdl = _get_taghandler(suffix);
+
+  if (!hdl) {
+    croak("Audio::Scan unsupported file type: %s (%s)", suffix, SvPVX(path));
+  }
+
+  ENTER;
+  RETVAL = _scan_io(hdl, _scanio_new(src, io_type), path, filter, md5_size, md5_offset, _get_cache(cache));
+  LEAVE;
+}
+#line 845 "Scan.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = newRV((SV*)RETVAL);
+	    RETVALSV = sv_2mortal(RETVALSV);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__scan_many); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__scan_many)
+{
+    dVAR; dXSARGS;
+    if (items < 6 || items > 7)
+       croak_xs_usage(cv,  "char *, paths, threads, filter, md5_size, md5_offset, callback= NULL");
+    {
+	SV *	RETVAL;
+	AV *	paths;
+	int	threads = (int)SvIV(ST(2))
+;
+	int	filter = (int)SvIV(ST(3))
+;
+	int	md5_size = (int)SvIV(ST(4))
+;
+	int	md5_offset = (int)SvIV(ST(5))
+;
+	SV *	callback;
+
+	STMT_START {
+		SV* const xsub_tmp_sv = ST(1);
+		SvGETMAGIC(xsub_tmp_sv);
+		if (SvROK(xsub_tmp_sv) && SvTYPE(SvRV(xsub_tmp_sv)) == SVt_PVAV){
+		    paths = (AV*)SvRV(xsub_tmp_sv);
+		}
+		else{
+		    Perl_croak_nocontext("%s: %s is not an ARRAY reference",
+				"Audio::Scan::_scan_many",
+				"paths");
+		}
+	} STMT_END
+;
+
+	if (items < 7)
+	    callback = NULL;
+	else {
+	    callback = ST(6)
+;
+	}
+#line 663 "Scan.xs"
+{
+  scanpool *pool;
+  scanjob *job;
+  scanopts opts;
+  const char **names;
+  AV *results = NULL;
+  int count = av_len(paths) + 1;
+  int i, index;
+
+  if ( callback && !SvOK(callback) )
+    callback = NULL;
+
+  if (threads < 0)
+    threads = scanpool_ncpu();
+
+  opts.filter = filter;
+  opts.md5_size = md5_size;
+  opts.md5_offset = md5_offset;
+
+  Newz(0, names, count ? count : 1, const char *);
+  for (i = 0; i < count; i++) {
+    SV **sv = av_fetch(paths, i, 0);
+    names[i] = sv && SvOK(*sv) ? SvPV_nolen(*sv) : "";
+  }
+
+  ENTER;
+
+  // Stops the workers and closes any open files, even if a parser croaks
+  Newz(0, pool, 1, scanpool);
+  SAVEDESTRUCTOR_X(_scanpool_free, pool);
+  scanpool_init(pool, names, count, threads, _scanjob_parse, &opts);
+  Safefree(names);
+
+  if (!callback) {
+    results = newAV();
+    sv_2mortal((SV *)results);
+    // One slot per path, left undef for any file that can't be scanned
+    av_extend(results, count);
+    av_fill(results, count - 1);
+  }
+
+  for (i = 0; i < count; i++) {
+    HV *hv = NULL;
+    SV *path;
+
+    ENTER;
+    SAVETMPS;
+
+    job = callback ? scanpool_next_any(pool, &index) : scanpool_next(pool, (index = i));
+    path = newSVpv(job->path, 0);
+    sv_2mortal(path);
+
+    if (job->error) {
+      warn("Could not open %s for reading: %s\n", job->path, strerror(job->error));
+    }
+    else {
+      // Not already parsed by a worker
+      if (!job->parsed)
+        _scanjob_parse(job, &opts);
+
+      result_replay_warnings(&job->result);
+
+      if (job->ret) {
+        hv = res_to_hv(job->ret);
+        sv_2mortal( (SV*)hv );
+      }
+      else if (job->result.error[0]) {
+        warn("%s", job->result.error);
+      }
+    }
+
+    scanpool_release(pool, job);
+
+    if (callback) {
+      dSP;
+
+      PUSHMARK(SP);
+      XPUSHs(path);
+      XPUSHs( hv ? sv_2mortal( newRV_inc((SV *)hv) ) : &PL_sv_undef );
+      XPUSHs( sv_2mortal( newSViv(index) ) );
+      PUTBACK;
+
+      call_sv(callback, G_VOID | G_DISCARD);
+    }
+    else if (hv) {
+      av_store( results, index, newRV_inc((SV *)hv) );
+    }
+
+    FREETMPS;
+    LEAVE;
+  }
+
+  LEAVE;
+
+  RETVAL = callback ? newSViv(count) : newRV_inc((SV *)results);
+}
+#line 993 "Scan.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__find_frame); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__find_frame)
+{
+    dVAR; dXSARGS;
+    if (items < 5 || items > 6)
+       croak_xs_usage(cv,  "char *, suffix, src, path, offset, io_type= NULL");
+    {
+	IV	RETVAL;
+	dXSTARG;
+	char *	suffix = (char *)SvPV_nolen(ST(1))
+;
+	SV *	src = ST(2)
+;
+	SV *	path = ST(3)
+;
+	int	offset = (int)SvIV(ST(4))
+;
+	SV *	io_type;
+
+	if (items < 6)
+	    io_type = NULL;
+	else {
+	    io_type = ST(5)
+;
+	}
+#line 765 "Scan.xs"
+{
+  taghandler *hdl;
+
+  RETVAL = -1;
+  hdl = _get_taghandler(suffix);
+
+  if (hdl && hdl->find_frame) {
+    ENTER;
+    _result_new();
+    RETVAL = hdl->find_frame(_scanio_new(src, io_type), SvPVX(path), offset);
+    LEAVE;
+  }
+}
+#line 1040 "Scan.c"
+	XSprePUSH;
+	PUSHi((IV)RETVAL);
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__find_frames); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__find_frames)
+{
+    dVAR; dXSARGS;
+    if (items < 5 || items > 6)
+       croak_xs_usage(cv,  "char *, suffix, src, path, offsets, io_type= NULL");
+    {
+	SV *	RETVAL;
+	char *	suffix = (char *)SvPV_nolen(ST(1))
+;
+	SV *	src = ST(2)
+;
+	SV *	path = ST(3)
+;
+	SV *	offsets = ST(4)
+;
+	SV *	io_type;
+
+	if (items < 6)
+	    io_type = NULL;
+	else {
+	    io_type = ST(5)
+;
+	}
+#line 784 "Scan.xs"
+{
+  taghandler *hdl = _get_taghandler(suffix);
+  void *state = NULL;
+
+  CHECK_FRAME_TARGETS(offsets);
+
+  ENTER;
+  _result_new();
+
+  if (hdl && hdl->seek_open) {
+    state = hdl->seek_open(_scanio_new(src, io_type), SvPVX(path));
+  }
+
+  RETVAL = _find_frames_state(hdl, state, offsets);
+
+  if (state) {
+    hdl->seek_close(state);
+  }
+
+  LEAVE;
+}
+#line 1094 "Scan.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__find_frame_return_info); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__find_frame_return_info)
+{
+    dVAR; dXSARGS;
+    if (items < 5 || items > 6)
+       croak_xs_usage(cv,  "char *, suffix, src, path, offset, io_type= NULL");
+    {
+	HV *	RETVAL;
+	char *	suffix = (char *)SvPV_nolen(ST(1))
+;
+	SV *	src = ST(2)
+;
+	SV *	path = ST(3)
+;
+	int	offset = (int)SvIV(ST(4))
+;
+	SV *	io_type;
+
+	if (items < 6)
+	    io_type = NULL;
+	else {
+	    io_type = ST(5)
+;
+	}
+#line 811 "Scan.xs"
+{
+  taghandler *hdl = _get_taghandler(suffix);
+
+  if (hdl && hdl->find_frame_return_info) {
+    resval *info;
+
+    ENTER;
+    _result_new();
+    info = res_newhv();
+    hdl->find_frame_return_info(_scanio_new(src, io_type), SvPVX(path), offset, info);
+    RETVAL = res_to_hv(info);
+    LEAVE;
+  }
+  else {
+    RETVAL = newHV();
+  }
+
+  sv_2mortal((SV*)RETVAL);
+}
+#line 1146 "Scan.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = newRV((SV*)RETVAL);
+	    RETVALSV = sv_2mortal(RETVALSV);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__find_frame_write_info); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__find_frame_write_info)
+{
+    dVAR; dXSARGS;
+    if (items < 6 || items > 7)
+       croak_xs_usage(cv,  "char *, suffix, src, path, offset, target, io_type= NULL");
+    {
+	HV *	RETVAL;
+	char *	suffix = (char *)SvPV_nolen(ST(1))
+;
+	SV *	src = ST(2)
+;
+	SV *	path = ST(3)
+;
+	int	offset = (int)SvIV(ST(4))
+;
+	SV *	target = ST(5)
+;
+	SV *	io_type;
+
+	if (items < 7)
+	    io_type = NULL;
+	else {
+	    io_type = ST(6)
+;
+	}
+#line 836 "Scan.xs"
+{
+  taghandler *hdl = _get_taghandler(suffix);
+  seektarget t;
+
+  _seektarget_init(&t, target);
+
+  if (hdl && hdl->seek_write) {
+    void *state;
+
+    ENTER;
+    _result_new();
+    state = hdl->seek_open(_scanio_new(src, io_type), SvPVX(path));
+    RETVAL = _seek_write_info(hdl, state, offset, &t);
+    if (state) {
+      hdl->seek_close(state);
+    }
+    LEAVE;
+  }
+  else {
+    RETVAL = newHV();
+  }
+
+  sv_2mortal((SV*)RETVAL);
+
+  _seektarget_rethrow(&t);
+}
+#line 1211 "Scan.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = newRV((SV*)RETVAL);
+	    RETVALSV = sv_2mortal(RETVALSV);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan_has_flac); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan_has_flac)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "void");
+    {
+	int	RETVAL;
+	dXSTARG;
+#line 868 "Scan.xs"
+{
+  RETVAL = 1;
+}
+#line 1236 "Scan.c"
+	XSprePUSH;
+	PUSHi((IV)RETVAL);
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan_buffer_stats); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan_buffer_stats)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "char *");
+    {
+	HV *	RETVAL;
+#line 877 "Scan.xs"
+{
+  BufferStats *stats = buffer_stats();
+
+  RETVAL = newHV();
+  sv_2mortal((SV*)RETVAL);
+
+  my_hv_store( RETVAL, "allocs", newSVuv(stats->allocs) );
+  my_hv_store( RETVAL, "reallocs", newSVuv(stats->reallocs) );
+  my_hv_store( RETVAL, "frees", newSVuv(stats->frees) );
+  my_hv_store( RETVAL, "compactions", newSVuv(stats->compactions) );
+  my_hv_store( RETVAL, "bytes_moved", newSVuv(stats->bytes_moved) );
+  my_hv_store( RETVAL, "bytes_copied", newSVuv(stats->bytes_copied) );
+  my_hv_store( RETVAL, "refills", newSVuv(stats->refills) );
+  my_hv_store( RETVAL, "bytes_read", newSVuv(stats->bytes_read) );
+  my_hv_store( RETVAL, "views", newSVuv(stats->views) );
+  my_hv_store( RETVAL, "bytes_viewed", newSVuv(stats->bytes_viewed) );
+}
+#line 1270 "Scan.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = newRV((SV*)RETVAL);
+	    RETVALSV = sv_2mortal(RETVALSV);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan_reset_buffer_stats); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan_reset_buffer_stats)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "char *");
+    {
+#line 900 "Scan.xs"
+{
+  buffer_stats_reset();
+}
+#line 1293 "Scan.c"
+    }
+    XSRETURN_EMPTY;
+}
+
+
+XS_EUPXS(XS_Audio__Scan_is_supported); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan_is_supported)
+{
+    dVAR; dXSARGS;
+    if (items != 2)
+       croak_xs_usage(cv,  "char *, path");
+    {
+	int	RETVAL;
+	dXSTARG;
+	SV *	path = ST(1)
+;
+#line 907 "Scan.xs"
+{
+  const char *suffix = _path_suffix( SvPV_nolen(path) );
+
+  if (suffix != NULL && _get_taghandler((char *)suffix)) {
+    RETVAL = 1;
+  }
+  else {
+    RETVAL = 0;
+  }
+}
+#line 1321 "Scan.c"
+	XSprePUSH;
+	PUSHi((IV)RETVAL);
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__path_suffix); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__path_suffix)
+{
+    dVAR; dXSARGS;
+    if (items != 2)
+       croak_xs_usage(cv,  "char *, path");
+    {
+	SV *	RETVAL;
+	SV *	path = ST(1)
+;
+#line 923 "Scan.xs"
+{
+  const char *suffix = _path_suffix( SvPV_nolen(path) );
+
+  RETVAL = suffix ? newSVpv(suffix, 0) : newSV(0);
+}
+#line 1345 "Scan.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan_type_for); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan_type_for)
+{
+    dVAR; dXSARGS;
+    if (items != 2)
+       croak_xs_usage(cv,  "char *, suffix");
+    {
+	SV *	RETVAL;
+	SV *	suffix = ST(1)
+;
+#line 934 "Scan.xs"
+{
+  taghandler *hdl = NULL;
+  char *suff = SvPVX(suffix);
+
+  if (suff == NULL || *suff == '\0') {
+    RETVAL = newSV(0);
+  }
+  else {
+    hdl = _get_taghandler(suff);
+    if (hdl == NULL) {
+      RETVAL = newSV(0);
+    }
+    else {
+      RETVAL = newSVpv(hdl->type, 0);
+    }
+  }
+}
+#line 1381 "Scan.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan_get_types); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan_get_types)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "void");
+    {
+	AV *	RETVAL;
+#line 957 "Scan.xs"
+{
+  int i;
+
+  RETVAL = newAV();
+  sv_2mortal((SV*)RETVAL);
+  for (i = 0; audio_types[i].type; i++) {
+    av_push(RETVAL, newSVpv(audio_types[i].type, 0));
+  }
+}
+#line 1407 "Scan.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = newRV((SV*)RETVAL);
+	    RETVALSV = sv_2mortal(RETVALSV);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan_extensions_for); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan_extensions_for)
+{
+    dVAR; dXSARGS;
+    if (items != 2)
+       croak_xs_usage(cv,  "char *, type");
+    {
+	AV *	RETVAL;
+	SV *	type = ST(1)
+;
+#line 972 "Scan.xs"
+{
+  int i, j;
+  char *t = SvPVX(type);
+
+  RETVAL = newAV();
+  sv_2mortal((SV*)RETVAL);
+  for (i = 0; audio_types[i].type; i++) {
+#ifdef _MSC_VER
+    if (!stricmp(audio_types[i].type, t)) {
+#else
+    if (!strcasecmp(audio_types[i].type, t)) {
+#endif
+
+      for (j = 0; audio_types[i].suffix[j]; j++) {
+        av_push(RETVAL, newSVpv(audio_types[i].suffix[j], 0));
+      }
+      break;
+
+    }
+  }
+}
+#line 1451 "Scan.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = newRV((SV*)RETVAL);
+	    RETVALSV = sv_2mortal(RETVALSV);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__Cache__open); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__Cache__open)
+{
+    dVAR; dXSARGS;
+    if (items != 2)
+       croak_xs_usage(cv,  "class, path");
+    {
+	SV *	RETVAL;
+	char *	class = (char *)SvPV_nolen(ST(0))
+;
+	char *	path = (char *)SvPV_nolen(ST(1))
+;
+#line 1001 "Scan.xs"
+{
+  scancache *c;
+
+  Newz(0, c, 1, scancache);
+
+  if ( !scancache_open(c, path) ) {
+    int err = errno;
+    Safefree(c);
+    croak("Audio::Scan unable to open cache %s: %s\n", path, strerror(err));
+  }
+
+  RETVAL = sv_setref_pv( newSV(0), class, (void *)c );
+}
+#line 1489 "Scan.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__Cache_fetch); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__Cache_fetch)
+{
+    dVAR; dXSARGS;
+    if (items != 5)
+       croak_xs_usage(cv,  "self, path, filter, md5_size, md5_offset");
+    {
+	SV *	RETVAL;
+	SV *	self = ST(0)
+;
+	SV *	path = ST(1)
+;
+	int	filter = (int)SvIV(ST(2))
+;
+	int	md5_size = (int)SvIV(ST(3))
+;
+	int	md5_offset = (int)SvIV(ST(4))
+;
+#line 1020 "Scan.xs"
+{
+  scancache *c = _get_cache(self);
+  resval *v;
+
+  ENTER;
+  _result_new();
+  v = scancache_fetch(c, SvPV_nolen(path), filter, md5_size, md5_offset);
+  RETVAL = v ? res_to_sv(v) : newSV(0);
+  LEAVE;
+}
+#line 1526 "Scan.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__Cache_invalidate); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__Cache_invalidate)
+{
+    dVAR; dXSARGS;
+    if (items != 2)
+       croak_xs_usage(cv,  "self, path");
+    {
+	int	RETVAL;
+	dXSTARG;
+	SV *	self = ST(0)
+;
+	SV *	path = ST(1)
+;
+#line 1036 "Scan.xs"
+{
+  RETVAL = scancache_invalidate( _get_cache(self), SvPV_nolen(path) );
+}
+#line 1551 "Scan.c"
+	XSprePUSH;
+	PUSHi((IV)RETVAL);
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__Cache_compact); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__Cache_compact)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "self");
+    {
+	int	RETVAL;
+	dXSTARG;
+	SV *	self = ST(0)
+;
+#line 1045 "Scan.xs"
+{
+  scancache *c = _get_cache(self);
+
+  RETVAL = scancache_compact(c);
+
+  if (RETVAL < 0) {
+    croak("Audio::Scan unable to compact cache %s: %s\n", c->path ? c->path : "", strerror(errno));
+  }
+}
+#line 1580 "Scan.c"
+	XSprePUSH;
+	PUSHi((IV)RETVAL);
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__Cache_stats); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__Cache_stats)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "self");
+    {
+	HV *	RETVAL;
+	SV *	self = ST(0)
+;
+#line 1060 "Scan.xs"
+{
+  scancache *c = _get_cache(self);
+
+  RETVAL = newHV();
+  sv_2mortal((SV*)RETVAL);
+
+  my_hv_store( RETVAL, "entries", newSVuv( scancache_live(c) ) );
+  my_hv_store( RETVAL, "size", newSVuv(c->end) );
+  my_hv_store( RETVAL, "hits", newSVuv(c->hits) );
+  my_hv_store( RETVAL, "misses", newSVuv(c->misses) );
+  my_hv_store( RETVAL, "stores", newSVuv(c->stores) );
+}
+#line 1611 "Scan.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = newRV((SV*)RETVAL);
+	    RETVALSV = sv_2mortal(RETVALSV);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__Cache_CLONE_SKIP); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__Cache_CLONE_SKIP)
+{
+    dVAR; dXSARGS;
+    PERL_UNUSED_VAR(cv); /* -W */
+    PERL_UNUSED_VAR(items); /* -W */
+    {
+	int	RETVAL;
+	dXSTARG;
+#line 1078 "Scan.xs"
+{
+  RETVAL = 1;
+}
+#line 1636 "Scan.c"
+	XSprePUSH;
+	PUSHi((IV)RETVAL);
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__Cache_DESTROY); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__Cache_DESTROY)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "self");
+    {
+	SV *	self = ST(0)
+;
+#line 1087 "Scan.xs"
+{
+  scancache *c = _get_cache(self);
+
+  if (c) {
+    scancache_close(c);
+    Safefree(c);
+  }
+}
+#line 1662 "Scan.c"
+    }
+    XSRETURN_EMPTY;
+}
+
+
+XS_EUPXS(XS_Audio__Scan__File__new); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__File__new)
+{
+    dVAR; dXSARGS;
+    if (items < 4 || items > 5)
+       croak_xs_usage(cv,  "class, suffix, src, path, io_type= NULL");
+    {
+	SV *	RETVAL;
+	char *	class = (char *)SvPV_nolen(ST(0))
+;
+	char *	suffix = (char *)SvPV_nolen(ST(1))
+;
+	SV *	src = ST(2)
+;
+	SV *	path = ST(3)
+;
+	SV *	io_type;
+
+	if (items < 5)
+	    io_type = NULL;
+	else {
+	    io_type = ST(4)
+;
+	}
+#line 1101 "Scan.xs"
+{
+  scanfile *f;
+  SV *self;
+  int type = _scanio_type(io_type);
+
+  Newz(0, f, 1, scanfile);
+  f->hdl  = _get_taghandler(suffix);
+  f->file = savepv( SvPV_nolen(path) );
+  result_init(&f->result);
+
+  // The ScanIO points into data for the life of the object, so it must
+  // not be changed or freed by the caller
+  if ( SvROK(src) && SvTYPE(SvRV(src)) <= SVt_PVMG ) {
+    f->src = newRV_noinc( newSVsv( SvRV(src) ) );
+  }
+  else {
+    f->src = newSVsv(src);
+  }
+
+  // Blessed first, so DESTROY cleans up if the parser croaks
+  self = sv_2mortal( sv_setref_pv( newSV(0), class, (void *)f ) );
+
+  // A UTF8 copy is downgraded here, not copied again by _scanio_init
+  if ( SvROK(f->src) && SvUTF8( SvRV(f->src) ) && !sv_utf8_downgrade( SvRV(f->src), TRUE ) ) {
+    croak("Audio::Scan scan_data needs a byte string");
+  }
+
+  _scanio_init(&f->io, f->src, type);
+
+  if (f->hdl && f->hdl->seek_open) {
+    ENTER;
+    SAVEDESTRUCTOR_X(_result_leave, &f->result);
+    result_enter(&f->result);
+    f->state = f->hdl->seek_open(&f->io, f->file);
+    LEAVE;
+  }
+
+  RETVAL = SvREFCNT_inc(self);
+}
+#line 1732 "Scan.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__File_find_frame); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__File_find_frame)
+{
+    dVAR; dXSARGS;
+    if (items != 2)
+       croak_xs_usage(cv,  "self, offset");
+    {
+	IV	RETVAL;
+	dXSTARG;
+	SV *	self = ST(0)
+;
+	int	offset = (int)SvIV(ST(1))
+;
+#line 1146 "Scan.xs"
+{
+  scanfile *f = _get_file(self);
+
+  RETVAL = -1;
+
+  if (f->state) {
+    ENTER;
+    _result_new();
+    RETVAL = f->hdl->seek(f->state, offset, NULL);
+    LEAVE;
+  }
+}
+#line 1766 "Scan.c"
+	XSprePUSH;
+	PUSHi((IV)RETVAL);
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__File_frame_index); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__File_frame_index)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "self");
+    {
+	SV *	RETVAL;
+	SV *	self = ST(0)
+;
+#line 1164 "Scan.xs"
+{
+  scanfile *f = _get_file(self);
+  resval *index = NULL;
+
+  ENTER;
+  _result_new();
+
+  if (f->state && f->hdl->seek_index) {
+    index = f->hdl->seek_index(f->state);
+  }
+
+  RETVAL = index ? res_to_sv(index) : newSV(0);
+  LEAVE;
+}
+#line 1799 "Scan.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__File_clip_ranges); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__File_clip_ranges)
+{
+    dVAR; dXSARGS;
+    if (items != 3)
+       croak_xs_usage(cv,  "self, start_ms, end_ms");
+    {
+	SV *	RETVAL;
+	SV *	self = ST(0)
+;
+	int	start_ms = (int)SvIV(ST(1))
+;
+	int	end_ms = (int)SvIV(ST(2))
+;
+#line 1184 "Scan.xs"
+{
+  scanfile *f = _get_file(self);
+  resval *clip = NULL;
+
+  ENTER;
+  _result_new();
+
+  if (f->state && f->hdl->clip_ranges) {
+    clip = f->hdl->clip_ranges(f->state, start_ms, end_ms);
+  }
+
+  RETVAL = clip ? res_to_sv(clip) : newSV(0);
+  LEAVE;
+}
+#line 1836 "Scan.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__File_find_frames); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__File_find_frames)
+{
+    dVAR; dXSARGS;
+    if (items != 2)
+       croak_xs_usage(cv,  "self, offsets");
+    {
+	SV *	RETVAL;
+	SV *	self = ST(0)
+;
+	SV *	offsets = ST(1)
+;
+#line 1204 "Scan.xs"
+{
+  scanfile *f = _get_file(self);
+
+  CHECK_FRAME_TARGETS(offsets);
+
+  ENTER;
+  _result_new();
+  RETVAL = _find_frames_state(f->hdl, f->state, offsets);
+  LEAVE;
+}
+#line 1867 "Scan.c"
+	RETVAL = sv_2mortal(RETVAL);
+	ST(0) = RETVAL;
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__File_find_frame_return_info); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__File_find_frame_return_info)
+{
+    dVAR; dXSARGS;
+    if (items != 2)
+       croak_xs_usage(cv,  "self, offset");
+    {
+	HV *	RETVAL;
+	SV *	self = ST(0)
+;
+	int	offset = (int)SvIV(ST(1))
+;
+#line 1220 "Scan.xs"
+{
+  scanfile *f = _get_file(self);
+
+  if (f->state && f->hdl->find_frame_return_info) {
+    resval *info;
+
+    ENTER;
+    _result_new();
+    info = res_newhv();
+    f->hdl->seek(f->state, offset, info);
+    RETVAL = res_to_hv(info);
+    LEAVE;
+  }
+  else {
+    RETVAL = newHV();
+  }
+
+  sv_2mortal((SV*)RETVAL);
+}
+#line 1907 "Scan.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = newRV((SV*)RETVAL);
+	    RETVALSV = sv_2mortal(RETVALSV);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__File_find_frame_write_info); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__File_find_frame_write_info)
+{
+    dVAR; dXSARGS;
+    if (items != 3)
+       croak_xs_usage(cv,  "self, offset, target");
+    {
+	HV *	RETVAL;
+	SV *	self = ST(0)
+;
+	int	offset = (int)SvIV(ST(1))
+;
+	SV *	target = ST(2)
+;
+#line 1245 "Scan.xs"
+{
+  scanfile *f = _get_file(self);
+  seektarget t;
+
+  _seektarget_init(&t, target);
+
+  if (f->state && f->hdl->seek_write) {
+    ENTER;
+    _result_new();
+    RETVAL = _seek_write_info(f->hdl, f->state, offset, &t);
+    LEAVE;
+  }
+  else {
+    RETVAL = newHV();
+  }
+
+  sv_2mortal((SV*)RETVAL);
+
+  _seektarget_rethrow(&t);
+}
+#line 1954 "Scan.c"
+	{
+	    SV * RETVALSV;
+	    RETVALSV = newRV((SV*)RETVAL);
+	    RETVALSV = sv_2mortal(RETVALSV);
+	    ST(0) = RETVALSV;
+	}
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__File_CLONE_SKIP); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__File_CLONE_SKIP)
+{
+    dVAR; dXSARGS;
+    PERL_UNUSED_VAR(cv); /* -W */
+    PERL_UNUSED_VAR(items); /* -W */
+    {
+	int	RETVAL;
+	dXSTARG;
+#line 1271 "Scan.xs"
+{
+  RETVAL = 1;
+}
+#line 1979 "Scan.c"
+	XSprePUSH;
+	PUSHi((IV)RETVAL);
+    }
+    XSRETURN(1);
+}
+
+
+XS_EUPXS(XS_Audio__Scan__File_DESTROY); /* prototype to pass -Wmissing-prototypes */
+XS_EUPXS(XS_Audio__Scan__File_DESTROY)
+{
+    dVAR; dXSARGS;
+    if (items != 1)
+       croak_xs_usage(cv,  "self");
+    {
+	SV *	self = ST(0)
+;
+#line 1280 "Scan.xs"
+{
+  scanfile *f = _get_file(self);
+
+  if (f->state) {
+    f->hdl->seek_close(f->state);
+  }
+
+  scanio_close(&f->io);
+  result_free(&f->result);
+  SvREFCNT_dec(f->src);
+  Safefree(f->file);
+  Safefree(f);
+}
+#line 2010 "Scan.c"
+    }
+    XSRETURN_EMPTY;
+}
+
+#ifdef __cplusplus
+extern "C"
+#endif
+XS_EXTERNAL(boot_Audio__Scan); /* prototype to pass -Wmissing-prototypes */
+XS_EXTERNAL(boot_Audio__Scan)
+{
+#if PERL_VERSION_LE(5, 21, 5)
+    dVAR; dXSARGS;
+#else
+    dVAR; dXSBOOTARGSXSAPIVERCHK;
+#endif
+#if PERL_VERSION_LE(5, 8, 999) /* PERL_VERSION_LT is 5.33+ */
+    char* file = __FILE__;
+#else
+    const char* file = __FILE__;
+#endif
+
+    PERL_UNUSED_VAR(file);
+
+    PERL_UNUSED_VAR(cv); /* -W */
+    PERL_UNUSED_VAR(items); /* -W */
+#if PERL_VERSION_LE(5, 21, 5)
+    XS_VERSION_BOOTCHECK;
+#  ifdef XS_APIVERSION_BOOTCHECK
+    XS_APIVERSION_BOOTCHECK;
+#  endif
+#endif
+
+        newXS_deffile("Audio::Scan::_scan", XS_Audio__Scan__scan);
+        newXS_deffile("Audio::Scan::_scan_many", XS_Audio__Scan__scan_many);
+        newXS_deffile("Audio::Scan::_find_frame", XS_Audio__Scan__find_frame);
+        newXS_deffile("Audio::Scan::_find_frames", XS_Audio__Scan__find_frames);
+        newXS_deffile("Audio::Scan::_find_frame_return_info", XS_Audio__Scan__find_frame_return_info);
+        newXS_deffile("Audio::Scan::_find_frame_write_info", XS_Audio__Scan__find_frame_write_info);
+        newXS_deffile("Audio::Scan::has_flac", XS_Audio__Scan_has_flac);
+        newXS_deffile("Audio::Scan::buffer_stats", XS_Audio__Scan_buffer_stats);
+        newXS_deffile("Audio::Scan::reset_buffer_stats", XS_Audio__Scan_reset_buffer_stats);
+        newXS_deffile("Audio::Scan::is_supported", XS_Audio__Scan_is_supported);
+        newXS_deffile("Audio::Scan::_path_suffix", XS_Audio__Scan__path_suffix);
+        newXS_deffile("Audio::Scan::type_for", XS_Audio__Scan_type_for);
+        newXS_deffile("Audio::Scan::get_types", XS_Audio__Scan_get_types);
+        newXS_deffile("Audio::Scan::extensions_for", XS_Audio__Scan_extensions_for);
+        newXS_deffile("Audio::Scan::Cache::_open", XS_Audio__Scan__Cache__open);
+        newXS_deffile("Audio::Scan::Cache::fetch", XS_Audio__Scan__Cache_fetch);
+        newXS_deffile("Audio::Scan::Cache::invalidate", XS_Audio__Scan__Cache_invalidate);
+        newXS_deffile("Audio::Scan::Cache::compact", XS_Audio__Scan__Cache_compact);
+        newXS_deffile("Audio::Scan::Cache::stats", XS_Audio__Scan__Cache_stats);
+        newXS_deffile("Audio::Scan::Cache::CLONE_SKIP", XS_Audio__Scan__Cache_CLONE_SKIP);
+        newXS_deffile("Audio::Scan::Cache::DESTROY", XS_Audio__Scan__Cache_DESTROY);
+        newXS_deffile("Audio::Scan::File::_new", XS_Audio__Scan__File__new);
+        newXS_deffile("Audio::Scan::File::find_frame", XS_Audio__Scan__File_find_frame);
+        newXS_deffile("Audio::Scan::File::frame_index", XS_Audio__Scan__File_frame_index);
+        newXS_deffile("Audio::Scan::File::clip_ranges", XS_Audio__Scan__File_clip_ranges);
+        newXS_deffile("Audio::Scan::File::find_frames", XS_Audio__Scan__File_find_frames);
+        newXS_deffile("Audio::Scan::File::find_frame_return_info", XS_Audio__Scan__File_find_frame_return_info);
+        newXS_deffile("Audio::Scan::File::find_frame_write_info", XS_Audio__Scan__File_find_frame_write_info);
+        newXS_deffile("Audio::Scan::File::CLONE_SKIP", XS_Audio__Scan__File_CLONE_SKIP);
+        newXS_deffile("Audio::Scan::File::DESTROY", XS_Audio__Scan__File_DESTROY);
+#if PERL_VERSION_LE(5, 21, 5)
+#  if PERL_VERSION_GE(5, 9, 0)
+    if (PL_unitcheckav)
+        call_list(PL_scopestack_ix, PL_unitcheckav);
+#  endif
+    XSRETURN_YES;
+#else
+    Perl_xs_boot_epilog(aTHX_ ax);
+#endif
+}
+
@@ -37,6 +37,8 @@
 
 #include "md5.c"
 #include "jenkins_hash.c"
+#include "scanpool.c"
+#include "scancache.c"
 
 #define FILTER_TYPE_INFO 0x01
 #define FILTER_TYPE_TAGS 0x02
@@ -52,10 +54,16 @@ struct _types {
 
 typedef struct {
   char*	type;
-  int (*get_tags)(PerlIO *infile, char *file, HV *info, HV *tags);
-  int (*get_fileinfo)(PerlIO *infile, char *file, HV *tags);
-  int (*find_frame)(PerlIO *infile, char *file, int offset);
-  int (*find_frame_return_info)(PerlIO *infile, char *file, int offset, HV *info);
+  int (*get_tags)(ScanIO *infile, char *file, resval *info, resval *tags);
+  int (*get_fileinfo)(ScanIO *infile, char *file, resval *tags);
+  off_t (*find_frame)(ScanIO *infile, char *file, int offset);
+  int (*find_frame_return_info)(ScanIO *infile, char *file, int offset, resval *info);
+  void * (*seek_open)(ScanIO *infile, char *file);
+  off_t (*seek)(void *state, int offset, resval *info);
+  void (*seek_close)(void *state);
+  resval * (*seek_index)(void *state);
+  resval * (*clip_ranges)(void *state, int start_ms, int end_ms);
+  off_t (*seek_write)(void *state, int offset, resval *info, seekwriter *w);
 } taghandler;
 
 struct _types audio_types[] = {
@@ -75,21 +83,31 @@ struct _types audio_types[] = {
 };
 
 static taghandler taghandlers[] = {
-  { "mp4", get_mp4tags, 0, mp4_find_frame, mp4_find_frame_return_info },
-  { "aac", get_aacinfo, 0, 0, 0 },
-  { "mp3", get_mp3tags, get_mp3fileinfo, mp3_find_frame, 0 },
-  { "ogg", get_ogg_metadata, 0, ogg_find_frame, 0 },
-  { "mpc", get_ape_metadata, get_mpcfileinfo, 0, 0 },
-  { "ape", get_ape_metadata, get_macfileinfo, 0, 0 },
-  { "flc", get_flac_metadata, 0, flac_find_frame, 0 },
-  { "asf", get_asf_metadata, 0, asf_find_frame, 0 },
-  { "wav", get_wav_metadata, 0, 0, 0 },
-  { "wvp", get_ape_metadata, get_wavpack_info, 0 },
-  { "dsf", get_dsf_metadata, 0, 0, 0 },
-  { "dff", get_dsdiff_metadata, 0, 0, 0 },
-  { NULL, 0, 0, 0 }
+  { "mp4", get_mp4tags, 0, mp4_find_frame, mp4_find_frame_return_info, mp4_seek_open, mp4_seek, mp4_seek_close, 0, mp4_clip_ranges, mp4_seek_write },
+  { "aac", get_aacinfo, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "mp3", get_mp3tags, get_mp3fileinfo, mp3_find_frame, mp3_find_frame_return_info, mp3_seek_open, mp3_seek, mp3_seek_close, mp3_seek_index, mp3_clip_ranges, 0 },
+  { "ogg", get_ogg_metadata, 0, ogg_find_frame, 0, ogg_seek_open, ogg_seek, ogg_seek_close, 0, 0, 0 },
+  { "mpc", get_ape_metadata, get_mpcfileinfo, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "ape", get_ape_metadata, get_macfileinfo, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "flc", get_flac_metadata, 0, flac_find_frame, 0, flac_seek_open, flac_seek, flac_seek_close, 0, 0, 0 },
+  { "asf", get_asf_metadata, 0, asf_find_frame, 0, asf_seek_open, asf_seek, asf_seek_close, 0, 0, 0 },
+  { "wav", get_wav_metadata, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "wvp", get_ape_metadata, get_wavpack_info, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "dsf", get_dsf_metadata, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { "dff", get_dsdiff_metadata, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+  { NULL, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
 };
 
+// A file opened by Audio::Scan::File, parsed once for any number of seeks
+typedef struct {
+  taghandler *hdl;
+  SV *src;           // filehandle, or ref to a private copy of the data, for the ScanIO
+  char *file;
+  ScanIO io;
+  ScanResult result; // info built by seek_open, for the life of the file
+  void *state;       // from seek_open, NULL if the type can't seek
+} scanfile;
+
 static taghandler *
 _get_taghandler(char *suffix)
 {
@@ -119,8 +137,27 @@ _get_taghandler(char *suffix)
   return hdl;
 }
 
+// The suffix after the last '.' of path, by the same rule as scan's
+// /\.(\w+)$/, so a dot in a directory name or a trailing dot gives NULL
+static const char *
+_path_suffix(const char *path)
+{
+  const char *suffix = strrchr(path, '.');
+  const char *p;
+  
+  if (suffix == NULL || suffix[1] == '\0')
+    return NULL;
+  
+  for (p = suffix + 1; *p; p++) {
+    if ( !isALNUM(*p) )
+      return NULL;
+  }
+  
+  return suffix + 1;
+}
+
 static void
-_generate_md5(PerlIO *infile, const char *file, int size, int start_offset, HV *info)
+_generate_md5(ScanIO *infile, const char *file, int size, int start_offset, resval *info)
 {
   md5_state_t md5;
   md5_byte_t digest[16];
@@ -131,8 +168,8 @@ _generate_md5(PerlIO *infile, const char *file, int size, int start_offset, HV *
   buffer_init(&buf, MD5_BUFFER_SIZE);
   md5_init(&md5);
   
-  audio_offset = SvIV(*(my_hv_fetch(info, "audio_offset")));
-  audio_size = SvIV(*(my_hv_fetch(info, "audio_size")));
+  audio_offset = res_iv(*(res_hv_fetch(info, "audio_offset")));
+  audio_size = res_iv(*(res_hv_fetch(info, "audio_size")));
   
   if (!start_offset) {
     // Read bytes from middle of file to reduce chance of silence generating false matches
@@ -148,14 +185,14 @@ _generate_md5(PerlIO *infile, const char *file, int size, int start_offset, HV *
   
   DEBUG_TRACE("Using %d bytes for audio MD5, starting at %d\n", size, start_offset);
   
-  if (PerlIO_seek(infile, start_offset, SEEK_SET) < 0) {
-    warn("Audio::Scan unable to determine MD5 for %s\n", file);
+  if (scanio_seek(infile, start_offset, SEEK_SET) < 0) {
+    LOG_WARN("Audio::Scan unable to determine MD5 for %s\n", file);
     goto out;
   }
   
   while (size > 0) {
     if ( !_check_buf(infile, &buf, 1, MIN(size, MD5_BUFFER_SIZE)) ) {
-      warn("Audio::Scan unable to determine MD5 for %s\n", file);
+      LOG_WARN("Audio::Scan unable to determine MD5 for %s\n", file);
       goto out;
     }
     
@@ -171,12 +208,89 @@ _generate_md5(PerlIO *infile, const char *file, int size, int start_offset, HV *
   for (di = 0; di < 16; ++di)
     sprintf(hexdigest + di * 2, "%02x", digest[di]);
   
-  my_hv_store(info, "audio_md5", newSVpvn(hexdigest, 32));
+  res_hv_store(info, "audio_md5", res_newpvn(hexdigest, 32));
   
 out:
   buffer_free(&buf);
 }
 
+static void
+_scanio_free(pTHX_ void *ptr)
+{
+  ScanIO *io = (ScanIO *)ptr;
+  
+  scanio_close(io);
+  Safefree(io);
+}
+
+static int
+_scanio_type(SV *io_type)
+{
+  int type = SCANIO_PERLIO;
+  
+  if ( io_type && SvOK(io_type) ) {
+    type = scanio_type( SvPV_nolen(io_type) );
+    if (type < 0) {
+      croak("Audio::Scan unknown io type: %s", SvPV_nolen(io_type));
+    }
+  }
+  
+  return type;
+}
+
+// The source is either a filehandle or a reference to a scalar holding the
+// file data, which is parsed in place without copying.  A string with the
+// UTF8 flag is parsed from a byte copy, leaving the caller's scalar as it is.
+static void
+_scanio_init(ScanIO *io, SV *src, int type)
+{
+  if ( SvROK(src) && SvTYPE(SvRV(src)) <= SVt_PVMG ) {
+    SV *sv = SvRV(src);
+    STRLEN len;
+    unsigned char *data;
+    
+    if ( SvUTF8(sv) ) {
+      sv = sv_2mortal( newSVsv(sv) );
+      
+      if ( !sv_utf8_downgrade(sv, TRUE) ) {
+        croak("Audio::Scan scan_data needs a byte string");
+      }
+    }
+    
+    data = (unsigned char *)SvPV(sv, len);
+    
+    scanio_init_memory(io, data, len);
+  }
+  else {
+    scanio_init_type(io, IoIFP(sv_2io(src)), type);
+  }
+}
+
+// Wrap the source in the requested I/O backend, the ScanIO is released
+// when the caller's scope is left, even if a parser croaks.
+static ScanIO *
+_scanio_new(SV *src, SV *io_type)
+{
+  ScanIO *io;
+  int type = _scanio_type(io_type);
+  
+  Newz(0, io, 1, ScanIO);
+  SAVEDESTRUCTOR_X(_scanio_free, io);
+  
+  _scanio_init(io, src, type);
+  
+  return io;
+}
+
+static void
+_scanpool_free(pTHX_ void *ptr)
+{
+  scanpool *pool = (scanpool *)ptr;
+  
+  scanpool_destroy(pool);
+  Safefree(pool);
+}
+
 static uint32_t
 _generate_hash(const char *file)
 {
@@ -208,62 +322,445 @@ _generate_hash(const char *file)
   return hash;
 }
 
-MODULE = Audio::Scan		PACKAGE = Audio::Scan
+static void
+_result_free(pTHX_ void *ptr)
+{
+  ScanResult *r = (ScanResult *)ptr;
+  
+  result_leave(r);
+  result_free(r);
+  Safefree(r);
+}
 
-HV *
-_scan( char *, char *suffix, PerlIO *infile, SV *path, int filter, int md5_size, int md5_offset )
-CODE:
+static void
+_result_leave(pTHX_ void *ptr)
 {
-  taghandler *hdl;
-  RETVAL = newHV();
+  result_leave((ScanResult *)ptr);
+}
+
+// Makes a new ScanResult current for the parsers, it is released when the
+// caller's scope is left, even if a parser croaks
+static ScanResult *
+_result_new(void)
+{
+  ScanResult *r;
+  
+  Newz(0, r, 1, ScanResult);
+  result_init(r);
+  SAVEDESTRUCTOR_X(_result_free, r);
+  result_enter(r);
+  
+  return r;
+}
+
+// Runs the format's parsers over an open source and returns a result hash
+// holding info and tags.  This only uses the current ScanResult, never the
+// interpreter, so it may run on a scan_many worker thread.
+static resval *
+_scan_parse(taghandler *hdl, ScanIO *infile, char *file, int filter, int md5_size, int md5_offset)
+{
+  resval *ret = res_newhv();
+  resval *info = res_newhv();
+  
+  // Options beyond the filter are read by the parsers
+  result_current()->flags = filter & ~(FILTER_TYPE_INFO | FILTER_TYPE_TAGS);
+
+  // Ignore filter if a file type has only one function (FLAC/Ogg)
+  if ( !hdl->get_fileinfo ) {
+    filter = FILTER_TYPE_INFO | FILTER_TYPE_TAGS;
+  }
+
+  if ( hdl->get_fileinfo && (filter & FILTER_TYPE_INFO) ) {
+    hdl->get_fileinfo(infile, file, info);
+  }
+
+  if ( hdl->get_tags && (filter & FILTER_TYPE_TAGS) ) {
+    resval *tags = res_newhv();
+    hdl->get_tags(infile, file, info, tags);
+    res_hv_store( ret, "tags", tags );
+  }
+  
+  // Generate audio MD5 value
+  if ( md5_size > 0
+    && res_hv_exists(info, "audio_offset")
+    && res_hv_exists(info, "audio_size")
+    && !res_hv_exists(info, "audio_md5")
+  ) {
+    _generate_md5(infile, file, md5_size, md5_offset, info);
+  }
+  
+  // Generate hash value
+  res_hv_store(info, "jenkins_hash", res_newuv( _generate_hash(file) ));
+
+  // Info may be used in tag function, i.e. to find tag version
+  res_hv_store( ret, "info", info );
+  
+  return ret;
+}
+
+// Parses an open source and returns the (mortal) result hash, which is
+// also stored in cache if one is given
+static HV *
+_scan_io(taghandler *hdl, ScanIO *infile, SV *path, int filter, int md5_size, int md5_offset, scancache *cache)
+{
+  HV *ret;
+  resval *result;
+  scancache_id id;
+  int have_id = 0;
+  
+  // The identity of the file actually opened, before it is read
+  if ( cache && infile->type != SCANIO_MEMORY ) {
+    int fd = infile->type == SCANIO_PERLIO ? PerlIO_fileno(infile->pio) : infile->fd;
+    have_id = scancache_identify(SvPVX(path), fd, &id);
+  }
+  
+  _result_new();
+  
+  result = _scan_parse(hdl, infile, SvPVX(path), filter, md5_size, md5_offset);
+  
+  if (have_id) {
+    if ( !scancache_store(cache, SvPVX(path), &id, filter, md5_size, md5_offset, result) )
+      warn("Audio::Scan unable to write to cache %s: %s\n", cache->path, strerror(errno));
+  }
+  
+  ret = res_to_hv(result);
   
   // don't leak
-  sv_2mortal( (SV*)RETVAL );
+  sv_2mortal( (SV*)ret );
   
-  hdl = _get_taghandler(suffix);
+  return ret;
+}
+
+typedef struct {
+  int offset;
+  int index;
+} frametarget;
+
+static int
+_frametarget_cmp(const void *a, const void *b)
+{
+  const frametarget *x = (const frametarget *)a;
+  const frametarget *y = (const frametarget *)b;
+  
+  if (x->offset != y->offset)
+    return x->offset < y->offset ? -1 : 1;
   
-  if (hdl) {
-    HV *info = newHV();
+  return x->index - y->index;
+}
 
-    // Ignore filter if a file type has only one function (FLAC/Ogg)
-    if ( !hdl->get_fileinfo ) {
-      filter = FILTER_TYPE_INFO | FILTER_TYPE_TAGS;
-    }
+// Seeks to each offset in the array ref, in increasing order so formats
+// that search can narrow the search using the previous frame found, and
+// returns a ref to an array of frame offsets in the original order
+#define CHECK_FRAME_TARGETS(offsets) \
+  if ( !SvROK(offsets) || SvTYPE(SvRV(offsets)) != SVt_PVAV ) \
+    croak("Audio::Scan find_frames needs an array reference of offsets")
 
-    if ( hdl->get_fileinfo && (filter & FILTER_TYPE_INFO) ) {
-      hdl->get_fileinfo(infile, SvPVX(path), info);
-    }
+static SV *
+_find_frames_state(taghandler *hdl, void *state, SV *offsets)
+{
+  AV *in = (AV *)SvRV(offsets);
+  AV *out = newAV();
+  frametarget *targets;
+  int i, n;
+  
+  n = av_len(in) + 1;
+  
+  if (n <= 0) {
+    return newRV_noinc((SV *)out);
+  }
+  
+  New(0, targets, n, frametarget);
+  SAVEFREEPV(targets);
+  
+  for (i = 0; i < n; i++) {
+    SV **sv = av_fetch(in, i, 0);
+    targets[i].offset = sv ? SvIV(*sv) : 0;
+    targets[i].index  = i;
+  }
+  
+  qsort(targets, n, sizeof(frametarget), _frametarget_cmp);
+  
+  av_extend(out, n - 1);
+  
+  for (i = 0; i < n; i++) {
+    off_t frame_offset = state ? hdl->seek(state, targets[i].offset, NULL) : -1;
+    av_store( out, targets[i].index, newSViv(frame_offset) );
+  }
+  
+  return newRV_noinc((SV *)out);
+}
 
-    if ( hdl->get_tags && (filter & FILTER_TYPE_TAGS) ) {
-      HV *tags = newHV();
-      hdl->get_tags(infile, SvPVX(path), info, tags);
-      hv_store( RETVAL, "tags", 4, newRV_noinc( (SV *)tags ), 0 );
-    }
+// Where find_frame_write_info sends a seek header: printed to a filehandle,
+// or passed to a callback with the header length.  A callback that dies
+// stops the seek, its error is kept to be rethrown once the seek is done.
+typedef struct {
+  PerlIO *fh;
+  SV *callback;
+  SV *error;
+} seektarget;
+
+static void
+_seektarget_init(seektarget *t, SV *target)
+{
+  t->fh = NULL;
+  t->callback = NULL;
+  t->error = NULL;
+  
+  if ( SvROK(target) && SvTYPE(SvRV(target)) == SVt_PVCV ) {
+    t->callback = target;
+  }
+  else {
+    IO *io = sv_2io(target);
     
-    // Generate audio MD5 value
-    if ( md5_size > 0
-      && my_hv_exists(info, "audio_offset")
-      && my_hv_exists(info, "audio_size")
-      && !my_hv_exists(info, "audio_md5")
-    ) {
-      _generate_md5(infile, SvPVX(path), md5_size, md5_offset, info);
-    }
+    if ( !io || !(t->fh = IoOFP(io)) )
+      croak("Audio::Scan find_frame_write_info needs a filehandle open for writing or a code reference");
+  }
+}
+
+static int
+_seektarget_write(seekwriter *w, const char *data, size_t len)
+{
+  dTHX;
+  seektarget *t = (seektarget *)w->ctx;
+  
+  if (t->fh) {
+    return PerlIO_write(t->fh, data, len) == (SSize_t)len;
+  }
+  else {
+    dSP;
+    int ok;
     
-    // Generate hash value
-    my_hv_store(info, "jenkins_hash", newSVuv( _generate_hash(SvPVX(path)) ));
+    ENTER;
+    SAVETMPS;
+    
+    PUSHMARK(SP);
+    XPUSHs( sv_2mortal( newSVpvn(data, len) ) );
+    XPUSHs( sv_2mortal( newSVuv(w->length) ) );
+    PUTBACK;
+    
+    call_sv(t->callback, G_VOID | G_DISCARD | G_EVAL);
+    
+    ok = !SvTRUE(ERRSV);
+    if (!ok)
+      t->error = newSVsv(ERRSV);
+    
+    FREETMPS;
+    LEAVE;
+    
+    return ok;
+  }
+}
 
-    // Info may be used in tag function, i.e. to find tag version
-    hv_store( RETVAL, "info", 4, newRV_noinc( (SV *)info ), 0 );
+// Seeks with the header sent to target, returns the info hash
+static HV *
+_seek_write_info(taghandler *hdl, void *state, int offset, seektarget *t)
+{
+  resval *info = res_newhv();
+  seekwriter w;
+  
+  w.write  = _seektarget_write;
+  w.ctx    = t;
+  w.length = 0;
+  
+  if (state) {
+    hdl->seek_write(state, offset, info, &w);
   }
   else {
+    res_hv_store( info, "seek_offset", res_newiv(-1) );
+  }
+  
+  if (t->fh)
+    PerlIO_flush(t->fh);
+  
+  return res_to_hv(info);
+}
+
+// Rethrows the error of a callback, after the seek has cleaned up
+static void
+_seektarget_rethrow(seektarget *t)
+{
+  if (t->error) {
+    sv_setsv( ERRSV, sv_2mortal(t->error) );
+    croak(NULL);
+  }
+}
+
+static scanfile *
+_get_file(SV *sv)
+{
+  if ( !sv_derived_from(sv, "Audio::Scan::File") ) {
+    croak("Not an Audio::Scan::File object");
+  }
+  
+  return INT2PTR(scanfile *, SvIV(SvRV(sv)));
+}
+
+static scancache *
+_get_cache(SV *sv)
+{
+  if ( sv && SvROK(sv) && sv_derived_from(sv, "Audio::Scan::Cache") )
+    return INT2PTR(scancache *, SvIV(SvRV(sv)));
+  
+  return NULL;
+}
+
+typedef struct {
+  int filter;
+  int md5_size;
+  int md5_offset;
+} scanopts;
+
+// Parses a scan_many job into its own ScanResult, on a worker thread if
+// the file could be mapped.  A croak from a parser jumps back here and
+// becomes a warning, so one bad file doesn't stop the whole batch.
+static void
+_scanjob_parse(scanjob *job, void *arg)
+{
+  scanopts *opts = (scanopts *)arg;
+  const char *suffix = _path_suffix(job->path);
+  taghandler *hdl = suffix ? _get_taghandler((char *)suffix) : NULL;
+  jmp_buf jmp;
+  
+  job->result.jmp = &jmp;
+  result_enter(&job->result);
+  
+  if ( !setjmp(jmp) ) {
+    if (hdl) {
+      job->ret = _scan_parse(hdl, &job->io, (char *)job->path, opts->filter, opts->md5_size, opts->md5_offset);
+    }
+    else if (suffix) {
+      res_warn("Audio::Scan unsupported file type: %s (%s)\n", suffix, job->path);
+    }
+  }
+  
+  result_leave(&job->result);
+  job->result.jmp = NULL;
+  job->parsed = 1;
+}
+
+MODULE = Audio::Scan		PACKAGE = Audio::Scan
+
+HV *
+_scan( char *, char *suffix, SV *src, SV *path, int filter, int md5_size, int md5_offset, SV *io_type = NULL, SV *cache = NULL )
+CODE:
+{
+  taghandler *hdl = _get_taghandler(suffix);
+  
+  if (!hdl) {
     croak("Audio::Scan unsupported file type: %s (%s)", suffix, SvPVX(path));
   }
+  
+  ENTER;
+  RETVAL = _scan_io(hdl, _scanio_new(src, io_type), path, filter, md5_size, md5_offset, _get_cache(cache));
+  LEAVE;
 }
 OUTPUT:
   RETVAL
+
+SV *
+_scan_many( char *, AV *paths, int threads, int filter, int md5_size, int md5_offset, SV *callback = NULL )
+CODE:
+{
+  scanpool *pool;
+  scanjob *job;
+  scanopts opts;
+  const char **names;
+  AV *results = NULL;
+  int count = av_len(paths) + 1;
+  int i, index;
   
-int
-_find_frame( char *, char *suffix, PerlIO *infile, SV *path, int offset )
+  if ( callback && !SvOK(callback) )
+    callback = NULL;
+  
+  if (threads < 0)
+    threads = scanpool_ncpu();
+  
+  opts.filter = filter;
+  opts.md5_size = md5_size;
+  opts.md5_offset = md5_offset;
+  
+  Newz(0, names, count ? count : 1, const char *);
+  for (i = 0; i < count; i++) {
+    SV **sv = av_fetch(paths, i, 0);
+    names[i] = sv && SvOK(*sv) ? SvPV_nolen(*sv) : "";
+  }
+  
+  ENTER;
+  
+  // Stops the workers and closes any open files, even if a parser croaks
+  Newz(0, pool, 1, scanpool);
+  SAVEDESTRUCTOR_X(_scanpool_free, pool);
+  scanpool_init(pool, names, count, threads, _scanjob_parse, &opts);
+  Safefree(names);
+  
+  if (!callback) {
+    results = newAV();
+    sv_2mortal((SV *)results);
+    // One slot per path, left undef for any file that can't be scanned
+    av_extend(results, count);
+    av_fill(results, count - 1);
+  }
+  
+  for (i = 0; i < count; i++) {
+    HV *hv = NULL;
+    SV *path;
+    
+    ENTER;
+    SAVETMPS;
+    
+    job = callback ? scanpool_next_any(pool, &index) : scanpool_next(pool, (index = i));
+    path = newSVpv(job->path, 0);
+    sv_2mortal(path);
+    
+    if (job->error) {
+      warn("Could not open %s for reading: %s\n", job->path, strerror(job->error));
+    }
+    else {
+      // Not already parsed by a worker
+      if (!job->parsed)
+        _scanjob_parse(job, &opts);
+      
+      result_replay_warnings(&job->result);
+      
+      if (job->ret) {
+        hv = res_to_hv(job->ret);
+        sv_2mortal( (SV*)hv );
+      }
+      else if (job->result.error[0]) {
+        warn("%s", job->result.error);
+      }
+    }
+    
+    scanpool_release(pool, job);
+    
+    if (callback) {
+      dSP;
+      
+      PUSHMARK(SP);
+      XPUSHs(path);
+      XPUSHs( hv ? sv_2mortal( newRV_inc((SV *)hv) ) : &PL_sv_undef );
+      XPUSHs( sv_2mortal( newSViv(index) ) );
+      PUTBACK;
+      
+      call_sv(callback, G_VOID | G_DISCARD);
+    }
+    else if (hv) {
+      av_store( results, index, newRV_inc((SV *)hv) );
+    }
+    
+    FREETMPS;
+    LEAVE;
+  }
+  
+  LEAVE;
+  
+  RETVAL = callback ? newSViv(count) : newRV_inc((SV *)results);
+}
+OUTPUT:
+  RETVAL
+  
+IV
+_find_frame( char *, char *suffix, SV *src, SV *path, int offset, SV *io_type = NULL )
 CODE:
 {
   taghandler *hdl;
@@ -272,23 +769,95 @@ CODE:
   hdl = _get_taghandler(suffix);
   
   if (hdl && hdl->find_frame) {
-    RETVAL = hdl->find_frame(infile, SvPVX(path), offset);
+    ENTER;
+    _result_new();
+    RETVAL = hdl->find_frame(_scanio_new(src, io_type), SvPVX(path), offset);
+    LEAVE;
+  }
+}
+OUTPUT:
+  RETVAL
+
+SV *
+_find_frames( char *, char *suffix, SV *src, SV *path, SV *offsets, SV *io_type = NULL )
+CODE:
+{
+  taghandler *hdl = _get_taghandler(suffix);
+  void *state = NULL;
+  
+  CHECK_FRAME_TARGETS(offsets);
+  
+  ENTER;
+  _result_new();
+  
+  if (hdl && hdl->seek_open) {
+    state = hdl->seek_open(_scanio_new(src, io_type), SvPVX(path));
   }
+  
+  RETVAL = _find_frames_state(hdl, state, offsets);
+  
+  if (state) {
+    hdl->seek_close(state);
+  }
+  
+  LEAVE;
 }
 OUTPUT:
   RETVAL
 
 HV *
-_find_frame_return_info( char *, char *suffix, PerlIO *infile, SV *path, int offset )
+_find_frame_return_info( char *, char *suffix, SV *src, SV *path, int offset, SV *io_type = NULL )
 CODE:
 {
   taghandler *hdl = _get_taghandler(suffix);
-  RETVAL = newHV();
-  sv_2mortal((SV*)RETVAL);
   
   if (hdl && hdl->find_frame_return_info) {
-    hdl->find_frame_return_info(infile, SvPVX(path), offset, RETVAL);
+    resval *info;
+    
+    ENTER;
+    _result_new();
+    info = res_newhv();
+    hdl->find_frame_return_info(_scanio_new(src, io_type), SvPVX(path), offset, info);
+    RETVAL = res_to_hv(info);
+    LEAVE;
   }
+  else {
+    RETVAL = newHV();
+  }
+  
+  sv_2mortal((SV*)RETVAL);
+}
+OUTPUT:
+  RETVAL
+
+HV *
+_find_frame_write_info( char *, char *suffix, SV *src, SV *path, int offset, SV *target, SV *io_type = NULL )
+CODE:
+{
+  taghandler *hdl = _get_taghandler(suffix);
+  seektarget t;
+  
+  _seektarget_init(&t, target);
+  
+  if (hdl && hdl->seek_write) {
+    void *state;
+    
+    ENTER;
+    _result_new();
+    state = hdl->seek_open(_scanio_new(src, io_type), SvPVX(path));
+    RETVAL = _seek_write_info(hdl, state, offset, &t);
+    if (state) {
+      hdl->seek_close(state);
+    }
+    LEAVE;
+  }
+  else {
+    RETVAL = newHV();
+  }
+  
+  sv_2mortal((SV*)RETVAL);
+  
+  _seektarget_rethrow(&t);
 }
 OUTPUT:
   RETVAL
@@ -302,13 +871,43 @@ CODE:
 OUTPUT:
   RETVAL
 
+HV *
+buffer_stats(char *)
+CODE:
+{
+  BufferStats *stats = buffer_stats();
+  
+  RETVAL = newHV();
+  sv_2mortal((SV*)RETVAL);
+  
+  my_hv_store( RETVAL, "allocs", newSVuv(stats->allocs) );
+  my_hv_store( RETVAL, "reallocs", newSVuv(stats->reallocs) );
+  my_hv_store( RETVAL, "frees", newSVuv(stats->frees) );
+  my_hv_store( RETVAL, "compactions", newSVuv(stats->compactions) );
+  my_hv_store( RETVAL, "bytes_moved", newSVuv(stats->bytes_moved) );
+  my_hv_store( RETVAL, "bytes_copied", newSVuv(stats->bytes_copied) );
+  my_hv_store( RETVAL, "refills", newSVuv(stats->refills) );
+  my_hv_store( RETVAL, "bytes_read", newSVuv(stats->bytes_read) );
+  my_hv_store( RETVAL, "views", newSVuv(stats->views) );
+  my_hv_store( RETVAL, "bytes_viewed", newSVuv(stats->bytes_viewed) );
+}
+OUTPUT:
+  RETVAL
+
+void
+reset_buffer_stats(char *)
+CODE:
+{
+  buffer_stats_reset();
+}
+
 int
 is_supported(char *, SV *path)
 CODE:
 {
-  char *suffix = strrchr( SvPVX(path), '.' );
+  const char *suffix = _path_suffix( SvPV_nolen(path) );
 
-  if (suffix != NULL && *suffix == '.' && _get_taghandler(suffix + 1)) {
+  if (suffix != NULL && _get_taghandler((char *)suffix)) {
     RETVAL = 1;
   }
   else {
@@ -318,6 +917,17 @@ CODE:
 OUTPUT:
   RETVAL
 
+SV *
+_path_suffix(char *, SV *path)
+CODE:
+{
+  const char *suffix = _path_suffix( SvPV_nolen(path) );
+  
+  RETVAL = suffix ? newSVpv(suffix, 0) : newSV(0);
+}
+OUTPUT:
+  RETVAL
+
 SV *
 type_for(char *, SV *suffix)
 CODE:
@@ -382,3 +992,301 @@ CODE:
 }
 OUTPUT:
   RETVAL
+
+MODULE = Audio::Scan		PACKAGE = Audio::Scan::Cache
+
+SV *
+_open( char *class, char *path )
+CODE:
+{
+  scancache *c;
+  
+  Newz(0, c, 1, scancache);
+  
+  if ( !scancache_open(c, path) ) {
+    int err = errno;
+    Safefree(c);
+    croak("Audio::Scan unable to open cache %s: %s\n", path, strerror(err));
+  }
+  
+  RETVAL = sv_setref_pv( newSV(0), class, (void *)c );
+}
+OUTPUT:
+  RETVAL
+
+SV *
+fetch( SV *self, SV *path, int filter, int md5_size, int md5_offset )
+CODE:
+{
+  scancache *c = _get_cache(self);
+  resval *v;
+  
+  ENTER;
+  _result_new();
+  v = scancache_fetch(c, SvPV_nolen(path), filter, md5_size, md5_offset);
+  RETVAL = v ? res_to_sv(v) : newSV(0);
+  LEAVE;
+}
+OUTPUT:
+  RETVAL
+
+int
+invalidate( SV *self, SV *path )
+CODE:
+{
+  RETVAL = scancache_invalidate( _get_cache(self), SvPV_nolen(path) );
+}
+OUTPUT:
+  RETVAL
+
+int
+compact( SV *self )
+CODE:
+{
+  scancache *c = _get_cache(self);
+  
+  RETVAL = scancache_compact(c);
+  
+  if (RETVAL < 0) {
+    croak("Audio::Scan unable to compact cache %s: %s\n", c->path ? c->path : "", strerror(errno));
+  }
+}
+OUTPUT:
+  RETVAL
+
+HV *
+stats( SV *self )
+CODE:
+{
+  scancache *c = _get_cache(self);
+  
+  RETVAL = newHV();
+  sv_2mortal((SV*)RETVAL);
+  
+  my_hv_store( RETVAL, "entries", newSVuv( scancache_live(c) ) );
+  my_hv_store( RETVAL, "size", newSVuv(c->end) );
+  my_hv_store( RETVAL, "hits", newSVuv(c->hits) );
+  my_hv_store( RETVAL, "misses", newSVuv(c->misses) );
+  my_hv_store( RETVAL, "stores", newSVuv(c->stores) );
+}
+OUTPUT:
+  RETVAL
+
+int
+CLONE_SKIP(...)
+CODE:
+{
+  RETVAL = 1;
+}
+OUTPUT:
+  RETVAL
+
+void
+DESTROY( SV *self )
+CODE:
+{
+  scancache *c = _get_cache(self);
+  
+  if (c) {
+    scancache_close(c);
+    Safefree(c);
+  }
+}
+
+MODULE = Audio::Scan		PACKAGE = Audio::Scan::File
+
+SV *
+_new( char *class, char *suffix, SV *src, SV *path, SV *io_type = NULL )
+CODE:
+{
+  scanfile *f;
+  SV *self;
+  int type = _scanio_type(io_type);
+  
+  Newz(0, f, 1, scanfile);
+  f->hdl  = _get_taghandler(suffix);
+  f->file = savepv( SvPV_nolen(path) );
+  result_init(&f->result);
+  
+  // The ScanIO points into data for the life of the object, so it must
+  // not be changed or freed by the caller
+  if ( SvROK(src) && SvTYPE(SvRV(src)) <= SVt_PVMG ) {
+    f->src = newRV_noinc( newSVsv( SvRV(src) ) );
+  }
+  else {
+    f->src = newSVsv(src);
+  }
+  
+  // Blessed first, so DESTROY cleans up if the parser croaks
+  self = sv_2mortal( sv_setref_pv( newSV(0), class, (void *)f ) );
+  
+  // A UTF8 copy is downgraded here, not copied again by _scanio_init
+  if ( SvROK(f->src) && SvUTF8( SvRV(f->src) ) && !sv_utf8_downgrade( SvRV(f->src), TRUE ) ) {
+    croak("Audio::Scan scan_data needs a byte string");
+  }
+  
+  _scanio_init(&f->io, f->src, type);
+  
+  if (f->hdl && f->hdl->seek_open) {
+    ENTER;
+    SAVEDESTRUCTOR_X(_result_leave, &f->result);
+    result_enter(&f->result);
+    f->state = f->hdl->seek_open(&f->io, f->file);
+    LEAVE;
+  }
+  
+  RETVAL = SvREFCNT_inc(self);
+}
+OUTPUT:
+  RETVAL
+
+IV
+find_frame( SV *self, int offset )
+CODE:
+{
+  scanfile *f = _get_file(self);
+  
+  RETVAL = -1;
+  
+  if (f->state) {
+    ENTER;
+    _result_new();
+    RETVAL = f->hdl->seek(f->state, offset, NULL);
+    LEAVE;
+  }
+}
+OUTPUT:
+  RETVAL
+
+SV *
+frame_index( SV *self )
+CODE:
+{
+  scanfile *f = _get_file(self);
+  resval *index = NULL;
+  
+  ENTER;
+  _result_new();
+  
+  if (f->state && f->hdl->seek_index) {
+    index = f->hdl->seek_index(f->state);
+  }
+  
+  RETVAL = index ? res_to_sv(index) : newSV(0);
+  LEAVE;
+}
+OUTPUT:
+  RETVAL
+
+SV *
+clip_ranges( SV *self, int start_ms, int end_ms )
+CODE:
+{
+  scanfile *f = _get_file(self);
+  resval *clip = NULL;
+  
+  ENTER;
+  _result_new();
+  
+  if (f->state && f->hdl->clip_ranges) {
+    clip = f->hdl->clip_ranges(f->state, start_ms, end_ms);
+  }
+  
+  RETVAL = clip ? res_to_sv(clip) : newSV(0);
+  LEAVE;
+}
+OUTPUT:
+  RETVAL
+
+SV *
+find_frames( SV *self, SV *offsets )
+CODE:
+{
+  scanfile *f = _get_file(self);
+  
+  CHECK_FRAME_TARGETS(offsets);
+  
+  ENTER;
+  _result_new();
+  RETVAL = _find_frames_state(f->hdl, f->state, offsets);
+  LEAVE;
+}
+OUTPUT:
+  RETVAL
+
+HV *
+find_frame_return_info( SV *self, int offset )
+CODE:
+{
+  scanfile *f = _get_file(self);
+  
+  if (f->state && f->hdl->find_frame_return_info) {
+    resval *info;
+    
+    ENTER;
+    _result_new();
+    info = res_newhv();
+    f->hdl->seek(f->state, offset, info);
+    RETVAL = res_to_hv(info);
+    LEAVE;
+  }
+  else {
+    RETVAL = newHV();
+  }
+  
+  sv_2mortal((SV*)RETVAL);
+}
+OUTPUT:
+  RETVAL
+
+HV *
+find_frame_write_info( SV *self, int offset, SV *target )
+CODE:
+{
+  scanfile *f = _get_file(self);
+  seektarget t;
+  
+  _seektarget_init(&t, target);
+  
+  if (f->state && f->hdl->seek_write) {
+    ENTER;
+    _result_new();
+    RETVAL = _seek_write_info(f->hdl, f->state, offset, &t);
+    LEAVE;
+  }
+  else {
+    RETVAL = newHV();
+  }
+  
+  sv_2mortal((SV*)RETVAL);
+  
+  _seektarget_rethrow(&t);
+}
+OUTPUT:
+  RETVAL
+
+int
+CLONE_SKIP(...)
+CODE:
+{
+  RETVAL = 1;
+}
+OUTPUT:
+  RETVAL
+
+void
+DESTROY( SV *self )
+CODE:
+{
+  scanfile *f = _get_file(self);
+  
+  if (f->state) {
+    f->hdl->seek_close(f->state);
+  }
+  
+  scanio_close(&f->io);
+  result_free(&f->result);
+  SvREFCNT_dec(f->src);
+  Safefree(f->file);
+  Safefree(f);
+}
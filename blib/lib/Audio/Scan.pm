@@ -0,0 +1,1411 @@
+package Audio::Scan;
+
+use strict;
+
+our $VERSION = '0.98';
+
+require XSLoader;
+XSLoader::load('Audio::Scan', $VERSION);
+
+use constant FILTER_INFO_ONLY => 1;
+use constant FILTER_TAGS_ONLY => 2;
+
+# Scan options passed to the parsers with the filter
+use constant SCAN_DURATION_SAMPLED => 0x100;
+
+sub scan_info {
+    my ( $class, $path, $opts ) = @_;
+    
+    $opts ||= {};
+    $opts->{filter} = FILTER_INFO_ONLY;
+    
+    $class->scan( $path, $opts );
+}
+
+sub scan_tags {
+    my ( $class, $path, $opts ) = @_;
+    
+    $opts ||= {};
+    $opts->{filter} = FILTER_TAGS_ONLY;
+    
+    $class->scan( $path, $opts );
+}
+
+sub scan {
+    my ( $class, $path, $opts ) = @_;
+    
+    my ($filter, $md5_size, $md5_offset, $io, $cache);
+    
+    if ( defined $opts ) {
+        if ( !ref $opts ) {
+            # Back-compat to support filter as normal argument
+            warn "The Audio::Scan::scan() filter passing method is deprecated, please pass a hashref instead.\n";
+            $filter = $opts;
+        }
+        else {
+            $filter     = $opts->{filter} || FILTER_INFO_ONLY | FILTER_TAGS_ONLY;
+            $md5_size   = $opts->{md5_size};
+            $md5_offset = $opts->{md5_offset};
+            $io         = $opts->{io};
+            $cache      = _cache( $opts->{cache} ) if defined $opts->{cache};
+        }
+    }
+    
+    if ( !defined $filter ) {
+        $filter = FILTER_INFO_ONLY | FILTER_TAGS_ONLY;
+    }
+    
+    $filter |= _scan_flags($opts);
+    
+    if ( $cache ) {
+        my $ret = $cache->fetch( $path, $filter, $md5_size || 0, $md5_offset || 0 );
+        return $ret if $ret;
+    }
+      
+    open my $fh, '<', $path or do {
+        warn "Could not open $path for reading: $!\n";
+        return;
+    };
+    
+    binmode $fh;
+    
+    my $suffix = $class->_path_suffix($path);
+    
+    return if !$suffix;
+    
+    my $ret = $class->_scan( $suffix, $fh, $path, $filter, $md5_size || 0, $md5_offset || 0, $io, $cache );
+    
+    close $fh;
+    
+    return $ret;
+}
+
+sub scan_fh {
+    my ( $class, $suffix, $fh, $opts ) = @_;
+    
+    my ($filter, $md5_size, $md5_offset, $io);
+    
+    binmode $fh;
+    
+    if ( defined $opts ) {
+        if ( !ref $opts ) {
+            # Back-compat to support filter as normal argument
+            warn "The Audio::Scan::scan_fh() filter passing method is deprecated, please pass a hashref instead.\n";
+            $filter = $opts;
+        }
+        else {
+            $filter     = $opts->{filter} || FILTER_INFO_ONLY | FILTER_TAGS_ONLY;
+            $md5_size   = $opts->{md5_size};
+            $md5_offset = $opts->{md5_offset};
+            $io         = $opts->{io};
+        }
+    }
+    
+    if ( !defined $filter ) {
+        $filter = FILTER_INFO_ONLY | FILTER_TAGS_ONLY;
+    }
+    
+    $filter |= _scan_flags($opts);
+    
+    return $class->_scan( $suffix, $fh, '(filehandle)', $filter, $md5_size || 0, $md5_offset || 0, $io );
+}
+
+sub scan_many {
+    my ( $class, $paths, $opts ) = @_;
+    
+    $opts ||= {};
+    
+    return $class->_scan_many(
+        $paths,
+        defined $opts->{threads} ? $opts->{threads} : -1,
+        ( $opts->{filter} || FILTER_INFO_ONLY | FILTER_TAGS_ONLY ) | _scan_flags($opts),
+        $opts->{md5_size} || 0, $opts->{md5_offset} || 0,
+        $opts->{callback},
+    );
+}
+
+sub scan_data {
+    my ( $class, $suffix, $data, $opts ) = @_;
+    
+    $opts ||= {};
+    
+    # Parse the caller's scalar in place, never a copy of it
+    $data = \$_[2] if !ref $data;
+    
+    return $class->_scan(
+        $suffix, $data, '(data)',
+        ( $opts->{filter} || FILTER_INFO_ONLY | FILTER_TAGS_ONLY ) | _scan_flags($opts),
+        $opts->{md5_size} || 0, $opts->{md5_offset} || 0,
+    );
+}
+
+sub _scan_flags {
+    my $opts = shift;
+    
+    return 0 if !ref $opts || !$opts->{duration_accuracy};
+    
+    my $accuracy = $opts->{duration_accuracy};
+    
+    return 0 if $accuracy eq 'exact';
+    return SCAN_DURATION_SAMPLED if $accuracy eq 'sampled';
+    
+    warn "Audio::Scan unknown duration_accuracy: $accuracy\n";
+    
+    return 0;
+}
+
+sub find_frame {
+    my ( $class, $path, $offset, $opts ) = @_;
+    
+    open my $fh, '<', $path or do {
+        warn "Could not open $path for reading: $!\n";
+        return;
+    };
+    
+    binmode $fh;
+    
+    my $suffix = $class->_path_suffix($path);
+    
+    return -1 if !$suffix;
+    
+    my $ret = $class->_find_frame( $suffix, $fh, $path, $offset, $opts ? $opts->{io} : undef );
+    
+    close $fh;
+    
+    return $ret;
+}
+
+sub find_frames {
+    my ( $class, $path, $offsets, $opts ) = @_;
+    
+    open my $fh, '<', $path or do {
+        warn "Could not open $path for reading: $!\n";
+        return;
+    };
+    
+    binmode $fh;
+    
+    my $suffix = $class->_path_suffix($path);
+    
+    return [ map { -1 } @{$offsets} ] if !$suffix;
+    
+    my $ret = $class->_find_frames( $suffix, $fh, $path, $offsets, $opts ? $opts->{io} : undef );
+    
+    close $fh;
+    
+    return $ret;
+}
+
+sub find_frame_fh {
+    my ( $class, $suffix, $fh, $offset, $opts ) = @_;
+    
+    binmode $fh;
+    
+    return $class->_find_frame( $suffix, $fh, '(filehandle)', $offset, $opts ? $opts->{io} : undef );
+}
+
+sub find_frame_return_info {
+    my ( $class, $path, $offset, $opts ) = @_;
+    
+    open my $fh, '<', $path or do {
+        warn "Could not open $path for reading: $!\n";
+        return;
+    };
+    
+    binmode $fh;
+    
+    my $suffix = $class->_path_suffix($path);
+    
+    return if !$suffix;
+    
+    my $ret = $class->_find_frame_return_info( $suffix, $fh, $path, $offset, $opts ? $opts->{io} : undef );
+    
+    close $fh;
+    
+    return $ret;
+}
+
+sub find_frame_write_info {
+    my ( $class, $path, $offset, $target, $opts ) = @_;
+    
+    open my $fh, '<', $path or do {
+        warn "Could not open $path for reading: $!\n";
+        return;
+    };
+    
+    binmode $fh;
+    
+    my $suffix = $class->_path_suffix($path);
+    
+    return if !$suffix;
+    
+    my $ret = $class->_find_frame_write_info( $suffix, $fh, $path, $offset, $target, $opts ? $opts->{io} : undef );
+    
+    close $fh;
+    
+    return $ret;
+}
+
+sub find_frame_fh_return_info {
+    my ( $class, $suffix, $fh, $offset, $opts ) = @_;
+    
+    binmode $fh;
+    
+    return $class->_find_frame_return_info( $suffix, $fh, '(filehandle)', $offset, $opts ? $opts->{io} : undef );
+}
+
+sub clip_ranges {
+    my ( $class, $path, $start_ms, $end_ms, $opts ) = @_;
+    
+    my $file = Audio::Scan::File->new( $path, $opts ) or return;
+    
+    return $file->clip_ranges( $start_ms, $end_ms );
+}
+
+sub find_frame_data {
+    my ( $class, $suffix, $data, $offset ) = @_;
+    
+    $data = \$_[2] if !ref $data;
+    
+    return $class->_find_frame( $suffix, $data, '(data)', $offset );
+}
+
+sub find_frame_data_return_info {
+    my ( $class, $suffix, $data, $offset ) = @_;
+    
+    $data = \$_[2] if !ref $data;
+    
+    return $class->_find_frame_return_info( $suffix, $data, '(data)', $offset );
+}
+
+# Open caches, by path, shared by all scans in this process
+my %CACHES;
+
+sub _cache {
+    my $path = shift;
+    
+    # Reopen after a fork or thread clone
+    if ( !$CACHES{$path} || $CACHES{$path}->{pid} != $$ || ref $CACHES{$path}->{cache} ne 'Audio::Scan::Cache' ) {
+        $CACHES{$path} = {
+            pid   => $$,
+            cache => Audio::Scan::Cache->_open($path),
+        };
+    }
+    
+    return $CACHES{$path}->{cache};
+}
+
+sub cache_invalidate {
+    my ( $class, $cache, @paths ) = @_;
+    
+    my $c = _cache($cache);
+    my $count = 0;
+    
+    for my $path ( @paths ) {
+        $count += $c->invalidate($path);
+    }
+    
+    return $count;
+}
+
+sub cache_compact {
+    my ( $class, $cache ) = @_;
+    
+    return _cache($cache)->compact;
+}
+
+sub cache_stats {
+    my ( $class, $cache ) = @_;
+    
+    return _cache($cache)->stats;
+}
+
+package Audio::Scan::File;
+
+sub new {
+    my ( $class, $path, $opts ) = @_;
+    
+    open my $fh, '<', $path or do {
+        warn "Could not open $path for reading: $!\n";
+        return;
+    };
+    
+    binmode $fh;
+    
+    my $suffix = Audio::Scan->_path_suffix($path);
+    
+    return if !$suffix;
+    
+    return $class->_new( $suffix, $fh, $path, $opts ? $opts->{io} : undef );
+}
+
+sub new_fh {
+    my ( $class, $suffix, $fh, $opts ) = @_;
+    
+    return $class->_new( $suffix, $fh, '(data)', $opts ? $opts->{io} : undef ) if ref $fh eq 'SCALAR';
+    
+    binmode $fh;
+    
+    return $class->_new( $suffix, $fh, '(filehandle)', $opts ? $opts->{io} : undef );
+}
+
+1;
+__END__
+
+=head1 NAME
+
+Audio::Scan - Fast C metadata and tag reader for all common audio file formats
+
+=head1 SYNOPSIS
+
+    use Audio::Scan;
+
+    my $data = Audio::Scan->scan('/path/to/file.mp3');
+
+    # Just file info
+    my $info = Audio::Scan->scan_info('/path/to/file.mp3');
+
+    # Just tags
+    my $tags = Audio::Scan->scan_tags('/path/to/file.mp3');
+    
+    # Scan without reading (possibly large) artwork into memory.
+    # Instead of binary artwork data, the size of the artwork will be returned instead.
+    {
+        local $ENV{AUDIO_SCAN_NO_ARTWORK} = 1;
+        my $data = Audio::Scan->scan('/path/to/file.mp3');
+    }
+    
+    # Scan a filehandle
+    open my $fh, '<', 'my.mp3';
+    my $data = Audio::Scan->scan_fh( mp3 => $fh );
+    close $fh;
+    
+    # Scan and compute an audio MD5 checksum
+    my $data = Audio::Scan->scan( '/path/to/file.mp3', { md5_size => 100 * 1024 } );
+    my $md5 = $data->{info}->{audio_md5};
+
+=head1 DESCRIPTION
+
+Audio::Scan is a C-based scanner for audio file metadata and tag information. It currently
+supports MP3, MP4, Ogg Vorbis, FLAC, ASF, WAV, AIFF, Musepack, Monkey's Audio, and WavPack.
+
+See below for specific details about each file format.
+
+=head1 METHODS
+
+=head2 scan( $path, [ \%OPTIONS ] )
+
+Scans $path for both metadata and tag information.  The type of scan performed is
+determined by the file's extension.  Supported extensions are:
+
+    MP3:  mp3, mp2
+    MP4:  mp4, m4a, m4b, m4p, m4v, m4r, k3g, skm, 3gp, 3g2, mov
+    AAC (ADTS): aac
+    Ogg:  ogg, oga
+    FLAC: flc, flac, fla
+    ASF:  wma, wmv, asf
+    Musepack:  mpc, mpp, mp+
+    Monkey's Audio:  ape, apl
+    WAV: wav
+    AIFF: aiff, aif
+    WavPack: wv
+
+This method returns a hashref containing two other hashrefs: info and tags.  The
+contents of the info and tag hashes vary depending on file format, see below for details.
+
+An optional hashref may be provided with the following values:
+
+    md5_size => $audio_bytes_to_checksum
+
+An MD5 will be computed of the first N audio bytes. Any tags in the file are automatically
+skipped, so this is a useful way of determining if a file's audio content is the same even
+if tags may have been changed.  The hex MD5 value is returned in the $info->{audio_md5}
+key.  This option will reduce performance, so choose a small enough size that works for you,
+you should probably avoid using more than 64K for example.
+
+For FLAC files that already contain an MD5 checksum, this value will be used instead
+of calculating a new one.
+
+    md5_offset => $offset
+
+Begin computing the audio_md5 value starting at $offset.  If this value is not specified,
+$offset defaults to a point in the middle of the file.
+
+    io => 'perlio' | 'pread' | 'mmap' | 'memory'
+
+Selects how the file is read.  The default, C<perlio>, reads through the Perl filehandle.
+C<pread> reads the underlying file descriptor directly with pread(2), bypassing PerlIO
+layers and the shared file position, which works well on network filesystems. C<mmap> maps
+the file into memory, which is usually fastest on local disks.  C<memory> reads the whole
+file with a single read before scanning it, useful for small files on high-latency storage.
+With C<mmap> and C<memory> the parsers read straight from the mapped data instead of
+copying it into their own buffers, so seeking is just a pointer change.
+Handles that have no real file behind them (such as in-memory filehandles) and platforms
+without pread/mmap always use C<perlio>.  The same option is accepted by the find_frame methods.
+
+    cache => $cache_file
+
+Keeps results in a persistent cache file, which is created if needed.  A file is
+only parsed again when its device, inode, size or modification time change, or after
+C<cache_invalidate>.  Results are cached separately for each combination of filter,
+md5 options, C<duration_accuracy> and C<AUDIO_SCAN_NO_ARTWORK>.  Parser warnings are not repeated on a cache
+hit.  Several processes may share a cache; new results are appended under an exclusive
+lock.  The file is written in the host's byte order and can't be moved to a machine of
+a different byte order.  Not supported on Windows.
+
+    duration_accuracy => 'exact' | 'sampled'
+
+MP3 files without a Xing, LAME or VBRI header have no frame count, so their
+length comes from the average bitrate.  By default (C<exact>) that means reading
+every frame of a VBR file.  With C<sampled>, VBR files over 4MB of audio are only
+read in 64 small windows spread across the audio, and the average bitrate is
+estimated from the frames in those.  This reads a small fraction of a large file,
+usually at the cost of a few tenths of a percent of error in C<song_length_ms>.
+Estimated lengths are flagged with C<estimated> set to 1, and
+C<song_length_ms_error> holds the 95% confidence bound of the error in
+milliseconds.  Other formats and files with a frame count ignore this option.
+
+=head2 scan_info( $path, [ \%OPTIONS ] )
+
+If you only need file metadata and don't care about tags, you can use this method.
+
+=head2 scan_tags( $path, [ \%OPTIONS ] )
+
+If you only need the tags and don't care about the metadata, use this method.
+
+=head2 scan_fh( $type => $fh, [ \%OPTIONS ] )
+
+Scans a filehandle. $type is the type of file to scan as, i.e. "mp3" or "ogg".
+Note that FLAC does not support reading from a filehandle.
+
+=head2 scan_many( \@paths, [ \%OPTIONS ] )
+
+Scans many files at once.  Worker threads open and parse the files in parallel,
+and reading ahead hides the latency of slow or network storage.  Returns an arrayref of results in the same order as
+@paths, with undef for any file that could not be opened or is not supported.
+
+In addition to C<filter>, C<md5_size>, C<md5_offset> and C<duration_accuracy>, the following options
+are supported:
+
+    threads => $n
+
+The number of worker threads, defaults to the number of CPUs.  0 scans every file
+on the calling thread.  More threads than CPUs can help on high-latency storage.
+
+    callback => sub { my ( $path, $result, $index ) = @_; ... }
+
+Calls the callback with each result as soon as it is available instead of
+collecting them, so results may arrive out of order.  $index is the position of
+$path in @paths.  scan_many then returns the number of files.
+
+The workers never call into Perl.  Parsers build each result in a plain C
+structure, which is converted to a hash on the calling thread, where the
+callback also runs.  Parser warnings are issued on the calling thread when that
+file's result is returned.  If a parser dies on a corrupt file, scan_many warns
+with the error and returns undef for that file instead of dying.
+
+Files that can't be memory mapped are parsed on the calling thread, as are all
+files on perls where New/Safefree need the interpreter (DEBUGGING,
+PERL_TRACK_MEMPOOL, PERL_IMPLICIT_SYS or perl's own malloc).
+
+=head2 scan_data( $type => \$data, [ \%OPTIONS ] )
+
+Scans a file that is already in memory, such as an upload.  $type is the type of
+file to scan as, like C<scan_fh>.  The data is parsed directly from the scalar
+without being copied, so there is no need to write it to a temporary file first.
+The C<io> option does not apply.  The data must be a byte string: a string with the
+UTF8 flag on is parsed from a downgraded copy, and one with characters over 255 dies.
+
+=head2 find_frame( $path, $timestamp_in_ms, [ \%OPTIONS ] )
+
+Returns the byte offset to the first audio frame starting from the given timestamp
+(in milliseconds).
+
+=over 4
+
+=item MP3, Ogg, FLAC, ASF, MP4
+
+The byte offset to the data packet containing this timestamp will be returned. For
+file formats that don't provide timestamp information such as MP3, the best estimate for
+the location of the timestamp will be returned.  This will be more accurate if the
+file has a Xing header or is CBR for example.
+
+=item WAV, AIFF, Musepack, Monkey's Audio, WavPack
+
+Not yet supported by find_frame.
+
+=back
+
+=head2 find_frames( $path, \@timestamps_in_ms, [ \%OPTIONS ] )
+
+Same as calling C<find_frame> for each timestamp, but the file is only parsed once.
+Returns an arrayref of offsets in the same order as the timestamps.  The timestamps
+are looked up in increasing order, and for Ogg and FLAC files each search starts
+from the frame found for the previous timestamp.  MP4 files skip rewriting the seek
+header that C<find_frame_return_info> needs.
+
+=head2 find_frame_return_info( $path, $timestamp_in_ms, [ \%OPTIONS ] )
+
+Supported for MP4 and MP3 files.
+
+The header of an MP4 file contains various metadata that refers to the structure of
+the audio data, making seeking more difficult to perform. This method will return
+the usual $info hash with 2 additional keys:
+
+    seek_offset - The seek offset in bytes
+    seek_header - A rewritten MP4 header that can be prepended to the audio data
+                  found at seek_offset to construct a valid bitstream. Specifically,
+                  the following boxes are rewritten: stts, stsc, stsz, stco
+
+In files with more than one track, the first audio track is seeked and the other
+tracks are left out of seek_header.
+
+For example, to seek 30 seconds into a file and write out a new MP4 file seeked to
+this point:
+
+    my $info = Audio::Scan->find_frame_return_info( $file, 30000 );
+    
+    open my $f, '<', $file;
+    sysseek $f, $info->{seek_offset}, 1;
+
+    open my $fh, '>', 'seeked.m4a';
+    print $fh $info->{seek_header};
+
+    while ( sysread( $f, my $buf, 65536 ) ) {
+        print $fh $buf;
+    }
+
+    close $f;
+    close $fh;
+
+Fragmented MP4 files are seeked to the start of the moof box found through their
+sidx or mfra index, and seek_header is the unchanged header up to the end of
+the moov box.  Files with neither index return -1.
+
+For MP3 files the frame is found exactly, by walking the frame headers (files
+without a frame index have one built, see C<frame_index>), and the returned
+hash tells a decoder how to start at the exact sample:
+
+    seek_offset        - Offset of the frame holding the requested sample
+    frame_first_sample - Number of decoded samples before that frame
+    skip_samples       - Samples to drop from the start of that frame's output
+    preroll_offset     - Offset to start decoding from.  Layer 3 frames overlap
+                         with the frame before, and that frame's data may start
+                         in earlier frames (the bit reservoir, main_data_begin)
+    preroll_samples    - Samples decoded from preroll_offset to seek_offset, to
+                         be dropped along with skip_samples
+
+Samples are counted from the first audio frame, after any Xing/Info frame.  If the
+file has a LAME header the timestamp is in the gapless stream, so the encoder delay
+(C<lame_encoder_delay>) and the 529 sample decoder delay are included in
+C<skip_samples>.  C<seek_offset> is -1 if the timestamp is past the end of the file.
+
+=head2 find_frame_write_info( $path, $timestamp_in_ms, $fh_or_callback, [ \%OPTIONS ] )
+
+Supported for MP4 files.
+
+Same as C<find_frame_return_info>, but the seek header is written as it is built
+instead of being returned, so it never has to be held in memory whole.  The rewritten
+stsz box of a long audiobook alone can be several megabytes.  The returned hash has
+C<seek_header_length> in place of C<seek_header>.
+
+The header is printed to a filehandle, which is flushed before returning, or passed
+to a code reference in pieces of up to 64K.  The callback gets each piece and the
+length of the whole header, so for example an HTTP response can be started on the
+first call:
+
+    my $info = Audio::Scan->find_frame_write_info( $file, 30000, sub {
+        my ( $data, $length ) = @_;
+        
+        $client->send_headers( 'Content-Length' => $length + $audio_length ) if !$sent++;
+        $client->write($data);
+    } );
+
+If the callback dies, no more of the header is written and the error is rethrown
+once the seek has been cleaned up.  A header that could not be written in full has
+a C<seek_offset> of -1.
+
+=head2 clip_ranges( $path, $start_ms, $end_ms, [ \%OPTIONS ] )
+
+Supported for MP3 and MP4 files.
+
+Returns the parts of a file that make up a clip from $start_ms to $end_ms, so it
+can be served as is instead of being transcoded.  For MP3 files:
+
+    ranges          - [ [ $offset, $length ] ], the frames holding the clip, starting
+                      with the frames the first one needs for its bit reservoir and
+                      overlap (see find_frame_return_info)
+    frames          - The number of frames in the ranges
+    skip_samples    - Samples to drop from the start of the decoded clip
+    padding_samples - Samples to drop from the end of the decoded clip
+    xing_frame      - A Xing frame (Info for CBR clips) with the frame count, byte
+                      count and TOC of the clip, to send before the ranges.  Layer 3
+                      files only.
+
+Times are handled as in find_frame_return_info, so with a LAME header they are in the
+gapless stream.  $end_ms past the end of the file is taken as the end.  Returns undef if
+the range isn't in the file or the file isn't an MP3 or MP4.
+
+    my $clip = Audio::Scan->clip_ranges( $file, 60000, 90000 );
+    
+    print $out $clip->{xing_frame};
+    for my $range ( @{ $clip->{ranges} } ) {
+        sysseek $in, $range->[0], 0;
+        sysread $in, my $buf, $range->[1];
+        print $out $buf;
+    }
+
+For MP4 files the clip is a seek header as from C<find_frame_return_info> followed by
+one range of the file, from the sample holding $start_ms to the end of the sample
+holding $end_ms:
+
+    ranges      - [ [ $seek_offset, $seek_length ] ]
+    seek_offset - The offset of the first sample
+    seek_length - The bytes from seek_offset to the end of the last sample
+    seek_header - The header with the stts, stsc, stsz and stco boxes cut down to
+                  the samples of the clip, the mvhd, tkhd and mdhd durations set
+                  to its length, no edit list, and an mdat box of seek_length
+
+The tracks other than the first audio track are left out, as with
+C<find_frame_return_info>, so their samples in the range are ignored.  The sample
+tables of a 30 second clip of a long audiobook come to a few kilobytes, where
+C<find_frame_return_info> rewrites them to the end of the file.  Fragmented files are
+not supported.
+
+=head2 Audio::Scan::File->new( $path, [ \%OPTIONS ] )
+
+The find_frame methods above parse the whole file every time they are called.  To
+seek in the same file many times, open it once instead:
+
+    my $file = Audio::Scan::File->new('/path/to/file.mp3');
+    my $offset = $file->find_frame(30000);
+    my $info = $file->find_frame_return_info(60000); # MP4 and MP3 only
+    my $sent = $file->find_frame_write_info( 60000, $fh ); # MP4 only
+    my $offsets = $file->find_frames( [ 10000, 20000, 30000 ] );
+    my $clip = $file->clip_ranges( 60000, 90000 ); # MP3 and MP4 only
+
+The file is parsed when it is opened, keeping only what is needed for seeking (the
+Xing TOC, FLAC seektable, MP4 sample tables, ASF index and so on), and each
+C<find_frame>, C<find_frames>, C<find_frame_return_info>, C<find_frame_write_info> or
+C<clip_ranges> call only
+searches for the frames.  These methods return the same values as the class methods of the same
+name.  The file stays open until the object is destroyed.  The C<io> option is
+supported.
+
+=head2 Audio::Scan::File->new_fh( $type => $fh, [ \%OPTIONS ] )
+
+Same as C<new>, but with a filehandle.  The filehandle is kept open by the object.
+$fh may also be a reference to a scalar holding the file data, as with C<scan_data>.
+The object keeps its own copy of the data, so the scalar can be changed afterwards.
+
+=head2 $file->frame_index()
+
+For a VBR MP3 file without a Xing or VBRI header, opening it walks every frame
+to work out the bitrate, and records the offset of every 16th frame along the way.
+C<find_frame> then seeks to the frame containing the requested time exactly instead
+of estimating it from the average bitrate.  This returns that index:
+
+    {
+        interval => 16,                 # frames between entries
+        offsets  => [ 0, 7044, ... ],   # byte offset of each entry's frame
+        samples  => [ 0, 18432, ... ],  # first sample of each entry's frame
+    }
+
+Files without a Xing or VBRI header but with an ID3v2 MLLT frame use its references
+as the index instead, so no frames are read to open them, and C<interval> is the MLLT
+frames between references.  Other MP3 files get an index the first time
+C<find_frame_return_info> is called on them, and C<find_frame> uses it from then on.  Returns undef for files without one.
+
+=head2 find_frame_fh( $type => $fh, $offset, [ \%OPTIONS ] )
+
+Same as C<find_frame>, but with a filehandle.
+
+=head2 find_frame_fh_return_info( $type => $fh, $offset, [ \%OPTIONS ] )
+
+Same as C<find_frame_return_info>, but with a filehandle.
+
+=head2 find_frame_data( $type => \$data, $offset )
+
+Same as C<find_frame>, but with file data in a scalar, see C<scan_data>.
+
+=head2 find_frame_data_return_info( $type => \$data, $offset )
+
+Same as C<find_frame_return_info>, but with file data in a scalar, see C<scan_data>.
+
+=head2 cache_invalidate( $cache_file, @paths )
+
+Drops any cached results for @paths from $cache_file, returns the number of paths
+that had results.
+
+=head2 cache_compact( $cache_file )
+
+Rewrites $cache_file keeping only the latest results for files that are unchanged
+since they were cached, returns the number of results kept.  Results appended by
+other processes while the cache is being compacted may be lost.
+
+=head2 cache_stats( $cache_file )
+
+Returns a hashref with the C<hits>, C<misses> and C<stores> made through
+$cache_file by this process, and the number of cached results (C<entries>) and
+C<size> of the file.
+
+=head2 has_flac()
+
+Deprecated.  Always returns 1 now that FLAC is always enabled.
+
+=head2 buffer_stats()
+
+Returns a hashref of counters describing the work done by the internal I/O buffers
+since the last call to C<reset_buffer_stats>: C<allocs>, C<reallocs>, C<frees>,
+C<compactions>, C<bytes_moved>, C<bytes_copied>, C<refills>, C<bytes_read>, C<views>
+and C<bytes_viewed>.  The last two count reads that were satisfied by pointing into
+mapped data (see the C<io> option) rather than copying.
+This is useful for checking how much allocation and copying a scan costs.
+
+The counters are kept per thread.  C<scan_many> worker threads count their own, and
+each file's counts are added to the calling thread's when its result is returned.
+
+=head2 reset_buffer_stats()
+
+Resets all C<buffer_stats> counters to 0.
+
+=head2 is_supported( $path )
+
+Returns 1 if the given path can be scanned by Audio::Scan, or 0 if not.
+
+=head2 get_types()
+
+Returns an array of strings of the file types supported by Audio::Scan.
+
+=head2 extensions_for( $type )
+
+Returns an array of strings of the file extensions that are considered to
+be the file type I<$type>.
+
+=head2 type_for( $extension )
+
+Returns file type for a given extension. Returns I<undef> for unsupported
+extensions.
+
+=head1 SKIPPING ARTWORK
+
+To save memory while reading tags, you can opt to skip potentially large 
+embedded artwork.  To do this, set the environment variable AUDIO_SCAN_NO_ARTWORK:
+
+    local $ENV{AUDIO_SCAN_NO_ARTWORK} = 1;
+    my $tags = Audio::Scan->scan_tags($file);
+
+This will return the length of the embedded artwork instead of the actual image data.
+In some cases it will also return a byte offset to the image data, which can be used
+to extract the image using more efficient means.  Note that the offset is not always
+returned so if you want to use this data make sure to check for offset.  If offset
+is not present, the only way to get the image data is to perform a normal tag scan
+without the environment variable set.
+
+One limitation that currently exists is that memory for embedded images is still
+allocated for ASF and Ogg Vorbis files.
+
+This information is returned in different ways depending on the format:
+
+ID3 (MP3, AAC, WAV, AIFF):
+
+    $tags->{APIC}->[3]: image length
+    $tags->{APIC}->[4]: image offset (unless APIC would need unsynchronization)
+
+MP4:
+
+    $tags->{COVR}: image length
+    $tags->{COVR_offset}: image offset (always available)
+
+Ogg Vorbis:
+
+    $tags->{ALLPICTURES}->[0]->{image_data}: image length
+    Image offset is not supported with Vorbis because the data is always base64-encoded.
+
+FLAC:
+
+    $tags->{ALLPICTURES}->[0]->{image_data}: image length
+    $tags->{ALLPICTURES}->[0]->{offset}: image offset (always available)
+
+ASF:
+
+    $tags->{'WM/Picture'}->{image}: image length
+    $tags->{'WM/Picture'}->{offset}: image offset (always available)
+
+APE, Musepack, WavPack, MP3 with APEv2:
+
+    $tags->{'COVER ART (FRONT)'}: image length
+    $tags->{'COVER ART (FRONT)_offset'}: image offset (always available)
+
+=head1 MP3
+
+=head2 INFO
+
+The following metadata about a file may be returned:
+
+    id3_version (i.e. "ID3v2.4.0")
+    song_length_ms (duration in milliseconds)
+    layer (i.e. 3)
+    stereo
+    samples_per_frame
+    padding
+    audio_size (size of all audio frames)
+    audio_offset (byte offset to first audio frame)
+    bitrate (in bps, determined using Xing/LAME/VBRI if possible, or average in the worst case)
+    samplerate (in kHz)
+    vbr (1 if file is VBR)
+    dlna_profile (if file is compliant)
+
+    With duration_accuracy => 'sampled', if the length was estimated:
+    estimated (1)
+    song_length_ms_error (95% confidence bound, in milliseconds)
+
+    If the file is VBR without a Xing/VBRI header and every frame was read:
+    synthetic_toc (Xing style seek table, 100 positions in units of audio_size / 256,
+                   one for each 1% of the length)
+
+    If the ID3v2 tag has an MLLT (MPEG location lookup table) frame:
+    mllt_frames (frames between references)
+    mllt_bytes  (byte offset of each reference from the first frame, starting with 0)
+    mllt_ms     (time of each reference in milliseconds, starting with 0)
+
+    If a Xing header is found:
+    xing_frames
+    xing_bytes
+    xing_quality
+
+    If a VBRI header is found:
+    vbri_delay
+    vbri_frames
+    vbri_bytes
+    vbri_quality
+
+    If a LAME header is found:
+    lame_encoder_version
+    lame_tag_revision
+    lame_vbr_method
+    lame_lowpass
+    lame_replay_gain_radio
+    lame_replay_gain_audiophile
+    lame_encoder_delay
+    lame_encoder_padding
+    lame_noise_shaping
+    lame_stereo_mode
+    lame_unwise_settings
+    lame_source_freq
+    lame_surround
+    lame_preset
+
+=head2 TAGS
+
+Raw tags are returned as found.  This means older tags such as ID3v1 and ID3v2.2/v2.3
+are converted to ID3v2.4 tag names.  Multiple instances of a tag in a file will be returned
+as arrays.  Complex tags such as APIC and COMM are returned as arrays.  All tag fields are
+converted to upper-case.  All text is converted to UTF-8.
+
+Sample tag data:
+
+    tags => {
+          ALBUMARTISTSORT => "Solar Fields",
+          APIC => [ "image/jpeg", 3, "", <binary data snipped> ],
+          CATALOGNUMBER => "INRE 017",
+          COMM => ["eng", "", "Amazon.com Song ID: 202981429"],
+          "MUSICBRAINZ ALBUM ARTIST ID" => "a2af1f31-c9eb-4fff-990c-c4f547a11b75",
+          "MUSICBRAINZ ALBUM ID" => "282143c9-6191-474d-a31a-1117b8c88cc0",
+          "MUSICBRAINZ ALBUM RELEASE COUNTRY" => "FR",
+          "MUSICBRAINZ ALBUM STATUS" => "official",
+          "MUSICBRAINZ ALBUM TYPE" => "album",
+          "MUSICBRAINZ ARTIST ID" => "a2af1f31-c9eb-4fff-990c-c4f547a11b75",
+          "REPLAYGAIN_ALBUM_GAIN" => "-2.96 dB",
+          "REPLAYGAIN_ALBUM_PEAK" => "1.045736",
+          "REPLAYGAIN_TRACK_GAIN" => "+3.60 dB",
+          "REPLAYGAIN_TRACK_PEAK" => "0.892606",
+          TALB => "Leaving Home",
+          TCOM => "Magnus Birgersson",
+          TCON => "Ambient",
+          TCOP => "2005 ULTIMAE RECORDS",
+          TDRC => "2004-10",
+          TIT2 => "Home",
+          TPE1 => "Solar Fields",
+          TPE2 => "Solar Fields",
+          TPOS => "1/1",
+          TPUB => "Ultimae Records",
+          TRCK => "1/11",
+          TSOP => "Solar Fields",
+          UFID => [
+                "http://musicbrainz.org",
+                "1084278a-2254-4613-a03c-9fed7a8937ca",
+          ],
+    },
+
+
+=head1 MP4
+
+=head2 INFO
+
+The following metadata about a file may be returned:
+
+    audio_offset (byte offset to start of mdat)
+    audio_size
+    compatible_brands
+    file_size
+    fragmented (if the audio is in moof fragments, audio_offset is the first moof)
+    leading_mdat (if file has mdat before moov)
+    major_brand
+    minor_version
+    song_length_ms
+    timescale
+    dlna_profile (if file is compliant)
+    tracks (array of tracks in the file)
+        Each track may contain:
+        
+        audio_type
+        avg_bitrate
+        bits_per_sample
+        channels
+        duration
+        encoding
+        handler_name
+        handler_type
+        id
+        max_bitrate
+        samplerate
+        
+=head2 TAGS
+
+Tags are returned in a hash with all keys converted to upper-case.  Keys starting with
+0xA9 (copyright symbol) will have this character stripped out.  Sample tag data:
+
+    tags => {
+       AART              => "Album Artist",
+       ALB               => "Album",
+       ART               => "Artist",
+       CMT               => "Comments",
+       COVR              => <binary data snipped>,
+       CPIL              => 1,
+       DAY               => 2009,
+       DESC              => "Video Description",
+       DISK              => "1/2",
+       "ENCODING PARAMS" => "vers\0\0\0\1acbf\0\0\0\2brat\0\1w\0cdcv\0\1\6\5",
+       GNRE              => "Jazz",
+       GRP               => "Grouping",
+       ITUNNORM          => " 00000000 00000000 00000000 00000000 00000000 00000000 00000000 00000000 00000000 00000000",
+       ITUNSMPB          => " 00000000 00000840 000001E4 00000000000001DC 00000000 00000000 00000000 00000000 00000000 00000000 00000000 00000000",
+       LYR               => "Lyrics",
+       NAM               => "Name",
+       PGAP              => 1,
+       SOAA              => "Sort Album Artist",
+       SOAL              => "Sort Album",
+       SOAR              => "Sort Artist",
+       SOCO              => "Sort Composer",
+       SONM              => "Sort Name",
+       SOSN              => "Sort Show",
+       TMPO              => 120,
+       TOO               => "iTunes 8.1.1, QuickTime 7.6",
+       TRKN              => "1/10",
+       TVEN              => "Episode ID",
+       TVES              => 12,
+       TVSH              => "Show",
+       TVSN              => 12,
+       WRT               => "Composer",
+    },
+
+=head1 AAC (ADTS)
+
+=head2 INFO
+
+The following metadata about a file is returned:
+
+    audio_offset
+    audio_size
+    bitrate (in bps)
+    channels
+    file_size
+    profile (Main, LC, or SSR)
+    samplerate (in kHz)
+    song_length_ms (duration in milliseconds)
+    dlna_profile (if file is compliant)
+
+=head1 OGG VORBIS
+
+=head2 INFO
+
+The following metadata about a file is returned:
+
+    version
+    channels
+    stereo
+    samplerate (in kHz)
+    bitrate_average (in bps)
+    bitrate_upper
+    bitrate_nominal
+    bitrate_lower
+    blocksize_0
+    blocksize_1
+    audio_offset (byte offset to audio)
+    audio_size
+    song_length_ms (duration in milliseconds)
+
+=head2 TAGS
+
+Raw Vorbis comments are returned.  All comment keys are capitalized.
+
+=head1 FLAC
+
+=head2 INFO
+
+The following metadata about a file is returned:
+
+    channels
+    samplerate (in kHz)
+    bitrate (in bps)
+    file_size
+    audio_offset (byte offset to first audio frame)
+    audio_size
+    song_length_ms (duration in milliseconds)
+    bits_per_sample
+    frames
+    minimum_blocksize
+    maximum_blocksize
+    minimum_framesize
+    maximum_framesize
+    audio_md5
+    total_samples
+
+=head2 TAGS
+
+Raw FLAC comments are returned.  All comment keys are capitalized.  Some data returned is special:
+
+APPLICATION
+
+    Each application block is returned in the APPLICATION tag keyed by application ID.
+
+CUESHEET_BLOCK
+
+    The CUESHEET_BLOCK tag is an array containing each line of the cue sheet.
+
+ALLPICTURES
+
+    Embedded pictures are returned in an ALLPICTURES array.  Each picture has the following metadata:
+    
+        mime_type
+        description
+        width
+        height
+        depth
+        color_index
+        image_data
+        picture_type
+
+=head1 ASF (Windows Media Audio/Video)
+
+=head2 INFO
+
+The following metadata about a file may be returned.  Reading the ASF spec is encouraged if you
+want to find out more about any of these values.
+
+    audio_offset (byte offset to first data packet)
+    audio_size
+    broadcast (boolean, whether the file is a live broadcast or not)
+    codec_list (array of information about codecs used in the file)
+    creation_date (UNIX timestamp when file was created)
+    data_packets
+    drm_key
+    drm_license_url
+    drm_protection_type
+    drm_data
+    file_id (unique file ID)
+    file_size
+    index_blocks
+    index_entry_interval (in milliseconds)
+    index_offsets (byte offsets for each second of audio, per stream. Useful for seeking)
+    index_specifiers (indicates which stream a given index_offset points to)
+    language_list (array of languages referenced by the file's metadata)
+    lossless (boolean)
+    max_bitrate
+    max_packet_size
+    min_packet_size
+    mutex_list (mutually exclusive stream information)
+    play_duration_ms
+    preroll
+    script_commands
+    script_types
+    seekable (boolean, whether the file is seekable or not)
+    send_duration_ms
+    song_length_ms (the actual length of the audio, in milliseconds)
+    dlna_profile (if file is compliant)
+
+STREAMS
+
+The streams array contains metadata related to an individul stream within the file.
+The following metadata may be returned:
+    
+    DeviceConformanceTemplate
+    IsVBR
+    alt_bitrate
+    alt_buffer_fullness
+    alt_buffer_size
+    avg_bitrate (most accurate bitrate for this stream)
+    avg_bytes_per_sec (audio only)
+    bitrate
+    bits_per_sample (audio only)
+    block_alignment (audio only)
+    bpp (video only)
+    buffer_fullness
+    buffer_size
+    channels (audio only)
+    codec_id (audio only)
+    compression_id (video only)
+    encode_options
+    encrypted (boolean)
+    error_correction_type
+    flag_seekable (boolean)
+    height (video only)
+    index_type
+    language_index (offset into language_list array)
+    max_object_size
+    samplerate (in kHz) (audio only)
+    samples_per_block
+    stream_number
+    stream_type
+    super_block_align
+    time_offset
+    width (video only)
+
+=head2 TAGS
+
+Raw tags are returned.  Tags that occur more than once are returned as arrays.
+In contrast to the other formats, tag keys are NOT capitalized. There is one special key:
+
+WM/Picture
+
+Pictures are returned as a hash with the following keys:
+
+    image_type (numeric type, same as ID3v2 APIC)
+    mime_type
+    description
+    image
+
+=head1 WAV
+
+=head2 INFO
+
+The following metadata about a file may be returned.
+
+    audio_offset
+    audio_size
+    bitrate (in bps)
+    bits_per_sample
+    block_align
+    channels
+    dlna_profile (if file is compliant)
+    file_size
+    format (WAV format code, 1 == PCM)
+    id3_version (if an ID3v2 tag is found)
+    samplerate (in kHz)
+    song_length_ms
+
+=head2 TAGS
+
+WAV files can contain several different types of tags.  "Native" WAV tags
+found in a LIST block may include these and others:
+
+    IARL - Archival Location
+    IART - Artist
+    ICMS - Commissioned
+    ICMT - Comment
+    ICOP - Copyright
+    ICRD - Creation Date
+    ICRP - Cropped
+    IENG - Engineer
+    IGNR - Genre
+    IKEY - Keywords
+    IMED - Medium
+    INAM - Name (Title)
+    IPRD - Product (Album)
+    ISBJ - Subject
+    ISFT - Software
+    ISRC - Source
+    ISRF - Source Form
+    TORG - Label
+    LOCA - Location
+    TVER - Version
+    TURL - URL
+    TLEN - Length
+    ITCH - Technician
+    TRCK - Track
+    ITRK - Track
+
+ID3v2 tags can also be embedded within WAV files.  These are returned exactly as for MP3 files.
+
+=head1 AIFF
+
+=head2 INFO
+
+The following metadata about a file may be returned.
+
+    audio_offset
+    audio_size
+    bitrate (in bps)
+    bits_per_sample
+    block_align
+    channels
+    compression_name (if AIFC)
+    compression_type (if AIFC)
+    dlna_profile (if file is compliant)
+    file_size
+    id3_version (if an ID3v2 tag is found)
+    samplerate (in kHz)
+    song_length_ms
+
+=head2 TAGS
+
+ID3v2 tags can be embedded within AIFF files.  These are returned exactly as for MP3 files.
+
+=head1 MONKEY'S AUDIO (APE)
+
+=head2 INFO
+
+The following metadata about a file may be returned.
+
+    audio_offset
+    audio_size
+    bitrate (in bps)
+    channels
+    compression
+    file_size
+    samplerate (in kHz)
+    song_length_ms
+    version
+
+=head2 TAGS
+
+APEv2 tags are returned as a hash of key/value pairs.
+
+=head1 MUSEPACK
+
+=head2 INFO
+
+The following metadata about a file may be returned.
+
+    audio_offset
+    audio_size
+    bitrate (in bps)
+    channels
+    encoder
+    file_size
+    profile
+    samplerate (in kHz)
+    song_length_ms
+
+=head2 TAGS
+
+Musepack uses APEv2 tags.  They are returned as a hash of key/value pairs.
+
+=head1 WAVPACK
+
+=head2 INFO
+
+The following metadata about a file may be returned.
+
+    audio_offset
+    audio_size
+    bitrate (in bps)
+    bits_per_sample
+    channels
+    encoder_version
+    file_size
+    hybrid (1 if file is lossy) (v4 only)
+    lossless (1 if file is lossless) (v4 only)
+    samplerate
+    song_length_ms
+    total_samples
+
+=head2 TAGS
+
+WavPack uses APEv2 tags.  They are returned as a hash of key/value pairs.
+
+=head1 DSF
+
+=head2 INFO
+
+The following metadata about a file may be returned.
+
+    audio_offset
+    audio_size
+    bits_per_sample
+    channels
+    song_length_ms
+    samplerate
+    block_size_per_channel
+
+=head2 TAGS
+
+ID3v2 tags can be embedded within DSF files.  These are returned exactly as for MP3 files.
+
+=head1 DSDIFF (DFF)
+
+=head2 INFO
+
+The following metadata about a file may be returned.
+
+    audio_offset
+    audio_size
+    bits_per_sample
+    channels
+    song_length_ms
+    samplerate
+    tag_diti_title
+    tag_diar_artist
+
+=head2 TAGS
+
+No separate tags are supported by the DSDIFF format.
+
+=head1
+
+=head1 THANKS
+
+Logitech & Slim Devices, for letting us release so much of our code to the world.
+Long live Squeezebox!
+
+Kimmo Taskinen, Adrian Smith, Clive Messer, and Jurgen Kramer for
+DSF/DSDIFF support and various other fixes.
+
+Some code from the Rockbox project was very helpful in implementing ASF and
+MP4 seeking.
+
+Some of the file format parsing code was derived from the mt-daapd project,
+and adapted by Netgear.  It has been heavily rewritten to fix bugs and add
+more features.
+
+The source to the original Netgear C scanner for SqueezeCenter is located
+at L<http://svn.slimdevices.com/repos/slim/7.3/trunk/platforms/readynas/contrib/scanner>
+
+The audio MD5 feature uses an MD5 implementation by L. Peter Deutsch,
+E<lt>ghost@aladdin.comE<gt>.
+
+=head1 SEE ALSO
+
+ASF Spec L<http://www.microsoft.com/windows/windowsmedia/forpros/format/asfspec.aspx>
+
+MP4 Info:
+L<http://standards.iso.org/ittf/PubliclyAvailableStandards/c051533_ISO_IEC_14496-12_2008.zip>
+L<http://www.geocities.com/xhelmboyx/quicktime/formats/mp4-layout.txt>
+
+=head1 AUTHORS
+
+Andy Grundman, E<lt>andy@hybridized.orgE<gt>
+
+Dan Sully, E<lt>daniel@cpan.orgE<gt>
+
+=head1 COPYRIGHT AND LICENSE
+
+Copyright (C) 2010-2011 Logitech, Inc.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+=cut
@@ -42,6 +42,6 @@ const char *aac_profiles[] = {
   "reserved"
 };
 
-static int get_aacinfo(PerlIO *infile, char *file, HV *info, HV *tags);
+static int get_aacinfo(ScanIO *infile, char *file, resval *info, resval *tags);
 
-int aac_parse_adts(PerlIO *infile, char *file, off_t audio_size, Buffer *buf, HV *info);
+int aac_parse_adts(ScanIO *infile, char *file, off_t audio_size, Buffer *buf, resval *info);
@@ -67,9 +67,9 @@ Refactored by Dan Sully
 #define APE_TAG_TYPE_BINARY     0x00000002
 
 typedef struct {
-    PerlIO* fd;           /* PerlIO handle */
-    HV* info;
-    HV* tags;             /* Perl Hash structure to append tags into */
+    ScanIO *fd;           /* I/O source */
+    resval *info;
+    resval *tags;             /* Perl Hash structure to append tags into */
     char* filename;       /* Name of the file being parsed */
     Buffer tag_header;    /* Tag Header data */
     Buffer tag_data;      /* Tag body data */
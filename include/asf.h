@@ -164,7 +164,7 @@ typedef struct asf_index_specs {
 } asf_index_specs;
 
 typedef struct asfinfo {
-  PerlIO *infile;
+  ScanIO *infile;
   char *file;
   Buffer *buf;
   Buffer *scratch;
@@ -172,8 +172,8 @@ typedef struct asfinfo {
   uint64_t audio_offset;
   uint64_t audio_size;
   uint32_t object_offset;
-  HV *info;
-  HV *tags;
+  resval *info;
+  resval *tags;
   
   uint8_t seeking;      // flag if we're seeking
   
@@ -195,14 +195,14 @@ enum types {
   TYPE_GUID
 };
 
-int get_asf_metadata(PerlIO *infile, char *file, HV *info, HV *tags);
-asfinfo * _asf_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking);
+int get_asf_metadata(ScanIO *infile, char *file, resval *info, resval *tags);
+asfinfo * _asf_parse(ScanIO *infile, char *file, resval *info, resval *tags, uint8_t seeking);
 void _parse_content_description(asfinfo *asf);
 void _parse_extended_content_description(asfinfo *asf);
 void _parse_file_properties(asfinfo *asf);
 void _parse_stream_properties(asfinfo *asf);
-void _store_stream_info(int stream_number, HV *info, SV *key, SV *value);
-void _store_tag(HV *tags, SV *key, SV *value);
+void _store_stream_info(int stream_number, resval *info, resval *key, resval *value);
+void _store_tag(resval *tags, resval *key, resval *value);
 int _parse_header_extension(asfinfo *asf, uint64_t len);
 void _parse_metadata(asfinfo *asf);
 void _parse_extended_stream_properties(asfinfo *asf, uint64_t len);
@@ -217,6 +217,9 @@ void _parse_index(asfinfo *asf, uint64_t size);
 void _parse_content_encryption(asfinfo *asf);
 void _parse_extended_content_encryption(asfinfo *asf);
 void _parse_script_command(asfinfo *asf);
-SV *_parse_picture(asfinfo *asf, uint32_t picture_offset);
-int asf_find_frame(PerlIO *infile, char *file, int offset);
+resval *_parse_picture(asfinfo *asf, uint32_t picture_offset);
+off_t asf_find_frame(ScanIO *infile, char *file, int offset);
+void * asf_seek_open(ScanIO *infile, char *file);
+off_t asf_seek(void *state, int offset, resval *info);
+void asf_seek_close(void *state);
 int _timestamp(asfinfo *asf, int offset, int *duration);
@@ -37,8 +37,24 @@ typedef struct {
   u_int  end;     /* Offset of last byte containing data. */
   u_int  cache;   /* bit cache for buffer_get_bits */
   u_int  ncached; /* Number of bits in cache */
+  u_char  *store; /* Our own storage while buf is a view, see buffer_view */
+  u_char  view;   /* buf points into memory we don't own, read-only */
 } Buffer;
 
+/* Allocation and copy counters of a thread, see Audio::Scan->buffer_stats */
+typedef struct {
+  uint64_t allocs;       /* buffer_init allocations */
+  uint64_t reallocs;     /* buffer growth */
+  uint64_t frees;        /* buffer_free */
+  uint64_t compactions;  /* data moved back to the start of a buffer */
+  uint64_t bytes_moved;  /* bytes moved by compaction */
+  uint64_t bytes_copied; /* bytes copied in by buffer_append */
+  uint64_t refills;      /* reads done by _check_buf */
+  uint64_t bytes_read;   /* bytes read by _check_buf */
+  uint64_t views;        /* refills satisfied by pointing into mapped memory */
+  uint64_t bytes_viewed; /* bytes made available without copying */
+} BufferStats;
+
 enum utf16_byteorder {
   UTF16_BYTEORDER_ANY,
   UTF16_BYTEORDER_BE,
@@ -58,9 +74,15 @@ void buffer_init_or_clear(Buffer *buffer, uint32_t len);
 void buffer_free(Buffer *buffer);
 void buffer_clear(Buffer *buffer);
 void buffer_append(Buffer *buffer, const void *data, uint32_t len);
-static int buffer_compact(Buffer *buffer);
+static int buffer_compact(Buffer *buffer, uint32_t len);
 void * buffer_append_space(Buffer *buffer, uint32_t len);
 int buffer_check_alloc(Buffer *buffer, uint32_t len);
+void buffer_view(Buffer *buffer, u_char *data, uint32_t len);
+void buffer_unview(Buffer *buffer);
+BufferStats * buffer_stats(void);
+void buffer_stats_reset(void);
+void buffer_stats_take(BufferStats *stats);
+void buffer_stats_add(BufferStats *stats);
 uint32_t buffer_len(Buffer *buffer);
 int buffer_get_ret(Buffer *buffer, void *buf, uint32_t len);
 void buffer_get(Buffer *buffer, void *buf, uint32_t len);
@@ -114,6 +136,8 @@ float get_f32(const void *vp);
 double buffer_get_ieee_float(Buffer *buffer);
 void put_u16(void *vp, uint16_t v);
 void put_u32(void *vp, uint32_t v);
+void put_u64(void *vp, uint64_t v);
+void buffer_put_int64(Buffer *buffer, uint64_t value);
 uint32_t buffer_get_bits(Buffer *buffer, uint32_t bits);
 uint32_t buffer_get_syncsafe(Buffer *buffer, uint8_t bytes);
 
@@ -23,7 +23,8 @@
 # define DEBUG_TRACE(...)
 #endif
 
-#define LOG_WARN(...) warn(__VA_ARGS__)
+#define LOG_WARN(...) res_warn(__VA_ARGS__)
+#define LOG_ERROR(...) res_errprintf(__VA_ARGS__)
 
 #if __GNUC__ > 2 || (__GNUC__ == 2 && __GNUC_MINOR__ > 4)
 # define _PACKED __attribute((packed))
@@ -33,6 +34,9 @@
 
 #define DEFAULT_BLOCK_SIZE 4096
 
+// Scan options passed with the info/tags filter, see ScanResult.flags
+#define SCAN_DURATION_SAMPLED 0x100
+
 #ifndef _MSC_VER
 // We use the built-in GUID type on Windows
 typedef struct _GUID {
@@ -50,8 +54,21 @@ typedef struct _GUID {
 #include <inttypes.h>
 #endif
 
+// Receives a seek header in pieces as it is written, instead of it being
+// returned whole in info.  length is the size of the whole header, set
+// before the first piece.  write returns 0 to stop the seek.
+typedef struct seekwriter seekwriter;
+struct seekwriter {
+  int (*write)(seekwriter *w, const char *data, size_t len);
+  void *ctx;
+  uint64_t length;
+};
+
 #define HAS_GUID
 #include "buffer.h"
+#include "result.h"
+#include "scanio.h"
+#include "syncscan.h"
 
 /* strlen the length automatically */
 #define my_hv_store(a,b,c)     hv_store(a,b,strlen(b),c,0)
@@ -70,11 +87,11 @@ typedef struct _GUID {
 #define CONVERT_INT32LE(b) \
 (i = (b[3] << 24) | (b[2] << 16) | b[1] << 8 | b[0], i)
 
-int _check_buf(PerlIO *infile, Buffer *buf, int size, int min_size);
-void _split_vorbis_comment(char* comment, HV* tags);
-int32_t skip_id3v2(PerlIO *infile);
+int _check_buf(ScanIO *infile, Buffer *buf, int size, int min_size);
+void _split_vorbis_comment(char* comment, resval *tags);
+int32_t skip_id3v2(ScanIO *infile);
 uint32_t _bitrate(uint32_t audio_size, uint32_t song_length_ms);
-off_t _file_size(PerlIO *infile);
+off_t _file_size(ScanIO *infile);
 int _env_true(const char *name);
 int _decode_base64(char *s);
-HV * _decode_flac_picture(PerlIO *infile, Buffer *buf, uint32_t *pic_length);
+resval * _decode_flac_picture(ScanIO *infile, Buffer *buf, uint32_t *pic_length);
@@ -16,4 +16,4 @@
 
 #define DSF_BLOCK_SIZE 4096
 
-int get_dsf_metadata(PerlIO *infile, char *file, HV *info, HV *tags);
+int get_dsf_metadata(ScanIO *infile, char *file, resval *info, resval *tags);
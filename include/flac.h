@@ -38,12 +38,12 @@ typedef struct seekpoint {
 } seekpoint;
 
 typedef struct flacinfo {
-  PerlIO *infile;
+  ScanIO *infile;
   char *file;
   Buffer *buf;
   Buffer *scratch;
-  HV *info;
-  HV *tags;
+  resval *info;
+  resval *tags;
   off_t file_size;
   off_t audio_offset;
   
@@ -60,10 +60,17 @@ typedef struct flacinfo {
   
   uint32_t num_seekpoints;
   struct seekpoint *seekpoints;
+  
+  // last frame found, a lower bound for later seeks
+  off_t hint_offset;
+  uint64_t hint_sample;
 } flacinfo;
 
-int get_flac_metadata(PerlIO *infile, char *file, HV *info, HV *tags);
-flacinfo * _flac_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking);
+int get_flac_metadata(ScanIO *infile, char *file, resval *info, resval *tags);
+static void * flac_seek_open(ScanIO *infile, char *file);
+static off_t flac_seek(void *state, int offset, resval *info);
+static void flac_seek_close(void *state);
+flacinfo * _flac_parse(ScanIO *infile, char *file, resval *info, resval *tags, uint8_t seeking);
 void _flac_parse_streaminfo(flacinfo *flac);
 void _flac_parse_application(flacinfo *flac, int len);
 void _flac_parse_seektable(flacinfo *flac, int len);
@@ -81,11 +81,11 @@ enum id3_field_textencoding {
 };
 
 typedef struct id3info {
-  PerlIO *infile;
+  ScanIO *infile;
   char *file;
   Buffer *buf;
-  HV *info;
-  HV *tags;
+  resval *info;
+  resval *tags;
 
   // scratch buffer used for UTF-8 decoding each frame
   Buffer *utf8;
@@ -117,19 +117,20 @@ extern struct id3_frametype const id3_frametype_experimental;
 extern struct id3_frametype const id3_frametype_unknown;
 extern struct id3_frametype const id3_frametype_obsolete;
 
-int parse_id3(PerlIO *infile, char *file, HV *info, HV *tags, uint32_t seek, off_t file_size);
+int parse_id3(ScanIO *infile, char *file, resval *info, resval *tags, uint32_t seek, off_t file_size);
+int id3_find_v2_frame(ScanIO *infile, char *file, uint32_t offset, char const *want, Buffer *data);
 int _id3_parse_v1(id3info *id3);
 int _id3_parse_v2(id3info *id3);
 int _id3_parse_v2_frame(id3info *id3);
 int _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_frametype const *frametype);
-void _id3_set_array_tag(id3info *id3, char const *id, AV *framedata);
-uint32_t _id3_get_v1_utf8_string(id3info *id3, SV **string, uint32_t len);
-uint32_t _id3_get_utf8_string(id3info *id3, SV **string, uint32_t len, uint8_t encoding);
+void _id3_set_array_tag(id3info *id3, char const *id, resval *framedata);
+uint32_t _id3_get_v1_utf8_string(id3info *id3, resval **string, uint32_t len);
+uint32_t _id3_get_utf8_string(id3info *id3, resval **string, uint32_t len, uint8_t encoding);
 uint32_t _id3_parse_rvad(id3info *id3, char const *id, uint32_t size);
 uint32_t _id3_parse_rgad(id3info *id3);
-uint32_t _id3_parse_rva2(id3info *id3, uint32_t len, AV *framedata);
-uint32_t _id3_parse_sylt(id3info *id3, uint8_t encoding, uint32_t len, AV *framedata);
-uint32_t _id3_parse_etco(id3info *id3, uint32_t len, AV *framedata);
+uint32_t _id3_parse_rva2(id3info *id3, uint32_t len, resval *framedata);
+uint32_t _id3_parse_sylt(id3info *id3, uint8_t encoding, uint32_t len, resval *framedata);
+uint32_t _id3_parse_etco(id3info *id3, uint32_t len, resval *framedata);
 void _id3_convert_tdrc(id3info *id3);
 uint32_t _id3_deunsync(unsigned char *data, uint32_t length);
 void _id3_skip(id3info *id3, uint32_t size);
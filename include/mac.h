@@ -30,6 +30,6 @@ typedef struct mac_streaminfo {
   uint32_t version;
 } mac_streaminfo;
 
-static int get_macfileinfo(PerlIO *infile, char *file, HV *info);
+static int get_macfileinfo(ScanIO *infile, char *file, resval *info);
 
 #endif
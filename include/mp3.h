@@ -21,6 +21,28 @@
 
 #define MP3_BLOCK_SIZE 4096
 
+// Frames between entries in the frame index of VBR files without a TOC
+#define MP3_INDEX_INTERVAL 16
+
+// duration_accuracy => 'sampled' reads 1/MP3_SAMPLE_RATIO of the audio of
+// VBR files without a TOC, in windows spread evenly across it, instead of
+// every frame.  Files too small for the minimum number of windows are read
+// in full.
+#define MP3_SAMPLE_WINDOW_SIZE 8192
+#define MP3_SAMPLE_RATIO       50
+#define MP3_SAMPLE_MIN_WINDOWS 64
+#define MP3_SAMPLE_MAX_WINDOWS 4096
+
+// The 11 sync bits of a frame header, which _decode_mp3_frame doesn't check
+#define MP3_FRAME_SYNC(header32) ( ((uint32_t)(header32) & 0xFFE00000) == 0xFFE00000 )
+
+// Samples of delay added by layer 3 decoders, on top of the LAME encoder delay
+#define MP3_DECODER_DELAY 529
+
+// Frames kept behind the current one while seeking, more than the 511 bytes
+// of bit reservoir span at the lowest bitrates
+#define MP3_PREROLL_FRAMES 16
+
 #define XING_FRAMES  0x01
 #define XING_BYTES   0x02
 #define XING_TOC     0x04
@@ -108,11 +130,30 @@ typedef struct xingframe {
   int lame_tag_ofs;
 } xingframe;
 
+typedef struct mp3indexentry {
+  uint32_t offset;  // file offset of the frame
+  uint32_t samples; // samples in all frames before it
+} mp3indexentry;
+
+// Where to start decoding for a sample, from find_frame_return_info
+typedef struct mp3seekframe {
+  off_t offset;              // the frame holding the sample
+  uint64_t first_sample;     // decoded samples before that frame
+  off_t preroll_offset;      // first frame holding bit reservoir data it needs
+  uint32_t preroll_samples;  // samples in the frames from preroll_offset to offset
+} mp3seekframe;
+
+// A reference point of an ID3v2 MLLT frame, counted from the first frame
+typedef struct mp3mlltref {
+  uint32_t bytes;
+  uint32_t ms;
+} mp3mlltref;
+
 typedef struct mp3info {
-  PerlIO *infile;
+  ScanIO *infile;
   char *file;
   Buffer *buf;
-  HV *info;
+  resval *info;
   
   off_t file_size;
   uint32_t id3_size;
@@ -127,6 +168,31 @@ typedef struct mp3info {
   
   mp3frame *first_frame;
   xingframe *xing_frame;
+  
+  uint8_t seeking;      // flag if we're seeking
+  uint8_t sampled;      // estimate the bitrate of VBR files from samples
+  double bitrate_estimate; // kbps from samples, 0 if every frame was read
+  double bitrate_error;    // 95% confidence bound of the estimate, kbps
+  
+  // Xing style TOC of a VBR file without one, from the frames read while
+  // averaging the bitrate: 100 points of audio_size / 256 for each 1% of
+  // the length
+  bool has_synthetic_toc;
+  uint8_t synthetic_toc[100];
+  
+  // Every mllt_frames'th frame from an ID3v2 MLLT (MPEG location lookup
+  // table) frame, starting with the first frame at (0, 0)
+  uint16_t mllt_frames;
+  uint32_t num_mllt_refs;
+  struct mp3mlltref *mllt;
+  
+  // Every MP3_INDEX_INTERVAL'th frame, built while averaging the bitrate of
+  // a VBR file and kept when seeking, or every index_interval'th frame from
+  // the MLLT references
+  uint16_t index_interval;
+  uint32_t num_index_entries;
+  uint32_t index_alloc;
+  struct mp3indexentry *index;
 } mp3info;
 
 // LAME lookup tables
@@ -199,36 +265,24 @@ const char *presets_old[] = {
   "medium/fast"
 };
 
-static int bitrate_map[4][4][16] = {
-  { { 0 }, //MPEG2.5
-    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
-    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
-    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 }
-  },
-  { { 0 } },
-  { { 0 }, // MPEG2
-    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
-    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
-    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 }
-  }, 
-  { { 0 }, // MPEG1
-    { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
-    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
-    { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 }
-  }
-};
-
-// sample_rate[samplingrate_index]
-static int sample_rate_tbl[ ] = {
-  44100, 48000, 32000, 0,
-};
+#include "mp3_frametbl.h"
 
-int get_mp3tags(PerlIO *infile, char *file, HV *info, HV *tags);
-int get_mp3fileinfo(PerlIO *infile, char *file, HV *info);
-int mp3_find_frame(PerlIO *infile, char *file, int offset);
+int get_mp3tags(ScanIO *infile, char *file, resval *info, resval *tags);
+int get_mp3fileinfo(ScanIO *infile, char *file, resval *info);
+off_t mp3_find_frame(ScanIO *infile, char *file, int offset);
+int mp3_find_frame_return_info(ScanIO *infile, char *file, int offset, resval *info);
+void * mp3_seek_open(ScanIO *infile, char *file);
+off_t mp3_seek(void *state, int offset, resval *info);
+void mp3_seek_close(void *state);
+resval * mp3_clip_ranges(void *state, int start_ms, int end_ms);
 
-mp3info * _mp3_parse(PerlIO *infile, char *file, HV *info);
+mp3info * _mp3_parse(ScanIO *infile, char *file, resval *info, uint8_t seeking);
+resval * mp3_seek_index(void *state);
+static void _mp3_parse_mllt(mp3info *mp3, unsigned char *bptr, uint32_t len);
+static int _mp3_index_seek(mp3info *mp3, uint64_t target_sample, mp3seekframe *seek);
+static short _mp3_get_average_bitrate(mp3info *mp3, uint32_t offset, uint32_t audio_size);
+static short _mp3_sample_bitrate(mp3info *mp3, uint32_t offset, uint32_t audio_size);
 int _decode_mp3_frame(unsigned char *bptr, struct mp3frame *frame);
 int _is_ape_header(char *bptr);
-int _has_ape(PerlIO *infile, off_t file_size, HV *info);
+int _has_ape(ScanIO *infile, off_t file_size, resval *info);
 void _mp3_skip(mp3info *mp3, uint32_t size);
@@ -0,0 +1,321 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Generated by tools/mp3_frametbl.pl, do not edit.
+//
+// The parameters of an MPEG audio frame only depend on the version, layer,
+// bitrate and samplerate bits of its header, so they are looked up here
+// rather than worked out for every possible sync.  Plain C only, so
+// tools/mp3bench.c can build it outside of Perl.
+
+#ifndef MP3_FRAMETBL_H
+#define MP3_FRAMETBL_H
+
+#ifdef _MSC_VER
+# include "pinttypes.h"
+#else
+# include <inttypes.h>
+#endif
+
+typedef struct {
+  uint16_t samplerate;        // 0 if the header is invalid
+  uint16_t bitrate_kbps;
+  uint16_t samples_per_frame;
+  uint16_t frame_size;        // without padding
+  uint16_t bytes_per_slot;    // added to frame_size if the padding bit is set
+} mp3frameinfo;
+
+// Bits 20-17 (version and layer) and 15-10 (bitrate and samplerate)
+// of a 32-bit header
+#define MP3_FRAME_KEY(header32) \
+  ( (((uint32_t)(header32) >> 11) & 0x3C0) | (((uint32_t)(header32) >> 10) & 0x3F) )
+
+static const mp3frameinfo mp3_frame_tbl[1024] = {
+  // MPEG2.5, reserved
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // MPEG2.5, layer 3
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 11025,   8,  576,   52, 1 }, { 12000,   8,  576,   48, 1 }, {  8000,   8,  576,   72, 1 }, { 0 },
+  { 11025,  16,  576,  104, 1 }, { 12000,  16,  576,   96, 1 }, {  8000,  16,  576,  144, 1 }, { 0 },
+  { 11025,  24,  576,  156, 1 }, { 12000,  24,  576,  144, 1 }, {  8000,  24,  576,  216, 1 }, { 0 },
+  { 11025,  32,  576,  208, 1 }, { 12000,  32,  576,  192, 1 }, {  8000,  32,  576,  288, 1 }, { 0 },
+  { 11025,  40,  576,  261, 1 }, { 12000,  40,  576,  240, 1 }, {  8000,  40,  576,  360, 1 }, { 0 },
+  { 11025,  48,  576,  313, 1 }, { 12000,  48,  576,  288, 1 }, {  8000,  48,  576,  432, 1 }, { 0 },
+  { 11025,  56,  576,  365, 1 }, { 12000,  56,  576,  336, 1 }, {  8000,  56,  576,  504, 1 }, { 0 },
+  { 11025,  64,  576,  417, 1 }, { 12000,  64,  576,  384, 1 }, {  8000,  64,  576,  576, 1 }, { 0 },
+  { 11025,  80,  576,  522, 1 }, { 12000,  80,  576,  480, 1 }, {  8000,  80,  576,  720, 1 }, { 0 },
+  { 11025,  96,  576,  626, 1 }, { 12000,  96,  576,  576, 1 }, {  8000,  96,  576,  864, 1 }, { 0 },
+  { 11025, 112,  576,  731, 1 }, { 12000, 112,  576,  672, 1 }, {  8000, 112,  576, 1008, 1 }, { 0 },
+  { 11025, 128,  576,  835, 1 }, { 12000, 128,  576,  768, 1 }, {  8000, 128,  576, 1152, 1 }, { 0 },
+  { 11025, 144,  576,  940, 1 }, { 12000, 144,  576,  864, 1 }, {  8000, 144,  576, 1296, 1 }, { 0 },
+  { 11025, 160,  576, 1044, 1 }, { 12000, 160,  576,  960, 1 }, {  8000, 160,  576, 1440, 1 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // MPEG2.5, layer 2
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 11025,   8, 1152,  104, 1 }, { 12000,   8, 1152,   96, 1 }, {  8000,   8, 1152,  144, 1 }, { 0 },
+  { 11025,  16, 1152,  208, 1 }, { 12000,  16, 1152,  192, 1 }, {  8000,  16, 1152,  288, 1 }, { 0 },
+  { 11025,  24, 1152,  313, 1 }, { 12000,  24, 1152,  288, 1 }, {  8000,  24, 1152,  432, 1 }, { 0 },
+  { 11025,  32, 1152,  417, 1 }, { 12000,  32, 1152,  384, 1 }, {  8000,  32, 1152,  576, 1 }, { 0 },
+  { 11025,  40, 1152,  522, 1 }, { 12000,  40, 1152,  480, 1 }, {  8000,  40, 1152,  720, 1 }, { 0 },
+  { 11025,  48, 1152,  626, 1 }, { 12000,  48, 1152,  576, 1 }, {  8000,  48, 1152,  864, 1 }, { 0 },
+  { 11025,  56, 1152,  731, 1 }, { 12000,  56, 1152,  672, 1 }, {  8000,  56, 1152, 1008, 1 }, { 0 },
+  { 11025,  64, 1152,  835, 1 }, { 12000,  64, 1152,  768, 1 }, {  8000,  64, 1152, 1152, 1 }, { 0 },
+  { 11025,  80, 1152, 1044, 1 }, { 12000,  80, 1152,  960, 1 }, {  8000,  80, 1152, 1440, 1 }, { 0 },
+  { 11025,  96, 1152, 1253, 1 }, { 12000,  96, 1152, 1152, 1 }, {  8000,  96, 1152, 1728, 1 }, { 0 },
+  { 11025, 112, 1152, 1462, 1 }, { 12000, 112, 1152, 1344, 1 }, {  8000, 112, 1152, 2016, 1 }, { 0 },
+  { 11025, 128, 1152, 1671, 1 }, { 12000, 128, 1152, 1536, 1 }, {  8000, 128, 1152, 2304, 1 }, { 0 },
+  { 11025, 144, 1152, 1880, 1 }, { 12000, 144, 1152, 1728, 1 }, {  8000, 144, 1152, 2592, 1 }, { 0 },
+  { 11025, 160, 1152, 2089, 1 }, { 12000, 160, 1152, 1920, 1 }, {  8000, 160, 1152, 2880, 1 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // MPEG2.5, layer 1
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 11025,  32,  384,  136, 4 }, { 12000,  32,  384,  128, 4 }, {  8000,  32,  384,  192, 4 }, { 0 },
+  { 11025,  48,  384,  208, 4 }, { 12000,  48,  384,  192, 4 }, {  8000,  48,  384,  288, 4 }, { 0 },
+  { 11025,  56,  384,  240, 4 }, { 12000,  56,  384,  224, 4 }, {  8000,  56,  384,  336, 4 }, { 0 },
+  { 11025,  64,  384,  276, 4 }, { 12000,  64,  384,  256, 4 }, {  8000,  64,  384,  384, 4 }, { 0 },
+  { 11025,  80,  384,  348, 4 }, { 12000,  80,  384,  320, 4 }, {  8000,  80,  384,  480, 4 }, { 0 },
+  { 11025,  96,  384,  416, 4 }, { 12000,  96,  384,  384, 4 }, {  8000,  96,  384,  576, 4 }, { 0 },
+  { 11025, 112,  384,  484, 4 }, { 12000, 112,  384,  448, 4 }, {  8000, 112,  384,  672, 4 }, { 0 },
+  { 11025, 128,  384,  556, 4 }, { 12000, 128,  384,  512, 4 }, {  8000, 128,  384,  768, 4 }, { 0 },
+  { 11025, 144,  384,  624, 4 }, { 12000, 144,  384,  576, 4 }, {  8000, 144,  384,  864, 4 }, { 0 },
+  { 11025, 160,  384,  696, 4 }, { 12000, 160,  384,  640, 4 }, {  8000, 160,  384,  960, 4 }, { 0 },
+  { 11025, 176,  384,  764, 4 }, { 12000, 176,  384,  704, 4 }, {  8000, 176,  384, 1056, 4 }, { 0 },
+  { 11025, 192,  384,  832, 4 }, { 12000, 192,  384,  768, 4 }, {  8000, 192,  384, 1152, 4 }, { 0 },
+  { 11025, 224,  384,  972, 4 }, { 12000, 224,  384,  896, 4 }, {  8000, 224,  384, 1344, 4 }, { 0 },
+  { 11025, 256,  384, 1112, 4 }, { 12000, 256,  384, 1024, 4 }, {  8000, 256,  384, 1536, 4 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // reserved, reserved
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // reserved, layer 3
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // reserved, layer 2
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // reserved, layer 1
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // MPEG2, reserved
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // MPEG2, layer 3
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 22050,   8,  576,   26, 1 }, { 24000,   8,  576,   24, 1 }, { 16000,   8,  576,   36, 1 }, { 0 },
+  { 22050,  16,  576,   52, 1 }, { 24000,  16,  576,   48, 1 }, { 16000,  16,  576,   72, 1 }, { 0 },
+  { 22050,  24,  576,   78, 1 }, { 24000,  24,  576,   72, 1 }, { 16000,  24,  576,  108, 1 }, { 0 },
+  { 22050,  32,  576,  104, 1 }, { 24000,  32,  576,   96, 1 }, { 16000,  32,  576,  144, 1 }, { 0 },
+  { 22050,  40,  576,  130, 1 }, { 24000,  40,  576,  120, 1 }, { 16000,  40,  576,  180, 1 }, { 0 },
+  { 22050,  48,  576,  156, 1 }, { 24000,  48,  576,  144, 1 }, { 16000,  48,  576,  216, 1 }, { 0 },
+  { 22050,  56,  576,  182, 1 }, { 24000,  56,  576,  168, 1 }, { 16000,  56,  576,  252, 1 }, { 0 },
+  { 22050,  64,  576,  208, 1 }, { 24000,  64,  576,  192, 1 }, { 16000,  64,  576,  288, 1 }, { 0 },
+  { 22050,  80,  576,  261, 1 }, { 24000,  80,  576,  240, 1 }, { 16000,  80,  576,  360, 1 }, { 0 },
+  { 22050,  96,  576,  313, 1 }, { 24000,  96,  576,  288, 1 }, { 16000,  96,  576,  432, 1 }, { 0 },
+  { 22050, 112,  576,  365, 1 }, { 24000, 112,  576,  336, 1 }, { 16000, 112,  576,  504, 1 }, { 0 },
+  { 22050, 128,  576,  417, 1 }, { 24000, 128,  576,  384, 1 }, { 16000, 128,  576,  576, 1 }, { 0 },
+  { 22050, 144,  576,  470, 1 }, { 24000, 144,  576,  432, 1 }, { 16000, 144,  576,  648, 1 }, { 0 },
+  { 22050, 160,  576,  522, 1 }, { 24000, 160,  576,  480, 1 }, { 16000, 160,  576,  720, 1 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // MPEG2, layer 2
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 22050,   8, 1152,   52, 1 }, { 24000,   8, 1152,   48, 1 }, { 16000,   8, 1152,   72, 1 }, { 0 },
+  { 22050,  16, 1152,  104, 1 }, { 24000,  16, 1152,   96, 1 }, { 16000,  16, 1152,  144, 1 }, { 0 },
+  { 22050,  24, 1152,  156, 1 }, { 24000,  24, 1152,  144, 1 }, { 16000,  24, 1152,  216, 1 }, { 0 },
+  { 22050,  32, 1152,  208, 1 }, { 24000,  32, 1152,  192, 1 }, { 16000,  32, 1152,  288, 1 }, { 0 },
+  { 22050,  40, 1152,  261, 1 }, { 24000,  40, 1152,  240, 1 }, { 16000,  40, 1152,  360, 1 }, { 0 },
+  { 22050,  48, 1152,  313, 1 }, { 24000,  48, 1152,  288, 1 }, { 16000,  48, 1152,  432, 1 }, { 0 },
+  { 22050,  56, 1152,  365, 1 }, { 24000,  56, 1152,  336, 1 }, { 16000,  56, 1152,  504, 1 }, { 0 },
+  { 22050,  64, 1152,  417, 1 }, { 24000,  64, 1152,  384, 1 }, { 16000,  64, 1152,  576, 1 }, { 0 },
+  { 22050,  80, 1152,  522, 1 }, { 24000,  80, 1152,  480, 1 }, { 16000,  80, 1152,  720, 1 }, { 0 },
+  { 22050,  96, 1152,  626, 1 }, { 24000,  96, 1152,  576, 1 }, { 16000,  96, 1152,  864, 1 }, { 0 },
+  { 22050, 112, 1152,  731, 1 }, { 24000, 112, 1152,  672, 1 }, { 16000, 112, 1152, 1008, 1 }, { 0 },
+  { 22050, 128, 1152,  835, 1 }, { 24000, 128, 1152,  768, 1 }, { 16000, 128, 1152, 1152, 1 }, { 0 },
+  { 22050, 144, 1152,  940, 1 }, { 24000, 144, 1152,  864, 1 }, { 16000, 144, 1152, 1296, 1 }, { 0 },
+  { 22050, 160, 1152, 1044, 1 }, { 24000, 160, 1152,  960, 1 }, { 16000, 160, 1152, 1440, 1 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // MPEG2, layer 1
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 22050,  32,  384,   68, 4 }, { 24000,  32,  384,   64, 4 }, { 16000,  32,  384,   96, 4 }, { 0 },
+  { 22050,  48,  384,  104, 4 }, { 24000,  48,  384,   96, 4 }, { 16000,  48,  384,  144, 4 }, { 0 },
+  { 22050,  56,  384,  120, 4 }, { 24000,  56,  384,  112, 4 }, { 16000,  56,  384,  168, 4 }, { 0 },
+  { 22050,  64,  384,  136, 4 }, { 24000,  64,  384,  128, 4 }, { 16000,  64,  384,  192, 4 }, { 0 },
+  { 22050,  80,  384,  172, 4 }, { 24000,  80,  384,  160, 4 }, { 16000,  80,  384,  240, 4 }, { 0 },
+  { 22050,  96,  384,  208, 4 }, { 24000,  96,  384,  192, 4 }, { 16000,  96,  384,  288, 4 }, { 0 },
+  { 22050, 112,  384,  240, 4 }, { 24000, 112,  384,  224, 4 }, { 16000, 112,  384,  336, 4 }, { 0 },
+  { 22050, 128,  384,  276, 4 }, { 24000, 128,  384,  256, 4 }, { 16000, 128,  384,  384, 4 }, { 0 },
+  { 22050, 144,  384,  312, 4 }, { 24000, 144,  384,  288, 4 }, { 16000, 144,  384,  432, 4 }, { 0 },
+  { 22050, 160,  384,  348, 4 }, { 24000, 160,  384,  320, 4 }, { 16000, 160,  384,  480, 4 }, { 0 },
+  { 22050, 176,  384,  380, 4 }, { 24000, 176,  384,  352, 4 }, { 16000, 176,  384,  528, 4 }, { 0 },
+  { 22050, 192,  384,  416, 4 }, { 24000, 192,  384,  384, 4 }, { 16000, 192,  384,  576, 4 }, { 0 },
+  { 22050, 224,  384,  484, 4 }, { 24000, 224,  384,  448, 4 }, { 16000, 224,  384,  672, 4 }, { 0 },
+  { 22050, 256,  384,  556, 4 }, { 24000, 256,  384,  512, 4 }, { 16000, 256,  384,  768, 4 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // MPEG1, reserved
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // MPEG1, layer 3
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 44100,  32, 1152,  104, 1 }, { 48000,  32, 1152,   96, 1 }, { 32000,  32, 1152,  144, 1 }, { 0 },
+  { 44100,  40, 1152,  130, 1 }, { 48000,  40, 1152,  120, 1 }, { 32000,  40, 1152,  180, 1 }, { 0 },
+  { 44100,  48, 1152,  156, 1 }, { 48000,  48, 1152,  144, 1 }, { 32000,  48, 1152,  216, 1 }, { 0 },
+  { 44100,  56, 1152,  182, 1 }, { 48000,  56, 1152,  168, 1 }, { 32000,  56, 1152,  252, 1 }, { 0 },
+  { 44100,  64, 1152,  208, 1 }, { 48000,  64, 1152,  192, 1 }, { 32000,  64, 1152,  288, 1 }, { 0 },
+  { 44100,  80, 1152,  261, 1 }, { 48000,  80, 1152,  240, 1 }, { 32000,  80, 1152,  360, 1 }, { 0 },
+  { 44100,  96, 1152,  313, 1 }, { 48000,  96, 1152,  288, 1 }, { 32000,  96, 1152,  432, 1 }, { 0 },
+  { 44100, 112, 1152,  365, 1 }, { 48000, 112, 1152,  336, 1 }, { 32000, 112, 1152,  504, 1 }, { 0 },
+  { 44100, 128, 1152,  417, 1 }, { 48000, 128, 1152,  384, 1 }, { 32000, 128, 1152,  576, 1 }, { 0 },
+  { 44100, 160, 1152,  522, 1 }, { 48000, 160, 1152,  480, 1 }, { 32000, 160, 1152,  720, 1 }, { 0 },
+  { 44100, 192, 1152,  626, 1 }, { 48000, 192, 1152,  576, 1 }, { 32000, 192, 1152,  864, 1 }, { 0 },
+  { 44100, 224, 1152,  731, 1 }, { 48000, 224, 1152,  672, 1 }, { 32000, 224, 1152, 1008, 1 }, { 0 },
+  { 44100, 256, 1152,  835, 1 }, { 48000, 256, 1152,  768, 1 }, { 32000, 256, 1152, 1152, 1 }, { 0 },
+  { 44100, 320, 1152, 1044, 1 }, { 48000, 320, 1152,  960, 1 }, { 32000, 320, 1152, 1440, 1 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // MPEG1, layer 2
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 44100,  32, 1152,  104, 1 }, { 48000,  32, 1152,   96, 1 }, { 32000,  32, 1152,  144, 1 }, { 0 },
+  { 44100,  48, 1152,  156, 1 }, { 48000,  48, 1152,  144, 1 }, { 32000,  48, 1152,  216, 1 }, { 0 },
+  { 44100,  56, 1152,  182, 1 }, { 48000,  56, 1152,  168, 1 }, { 32000,  56, 1152,  252, 1 }, { 0 },
+  { 44100,  64, 1152,  208, 1 }, { 48000,  64, 1152,  192, 1 }, { 32000,  64, 1152,  288, 1 }, { 0 },
+  { 44100,  80, 1152,  261, 1 }, { 48000,  80, 1152,  240, 1 }, { 32000,  80, 1152,  360, 1 }, { 0 },
+  { 44100,  96, 1152,  313, 1 }, { 48000,  96, 1152,  288, 1 }, { 32000,  96, 1152,  432, 1 }, { 0 },
+  { 44100, 112, 1152,  365, 1 }, { 48000, 112, 1152,  336, 1 }, { 32000, 112, 1152,  504, 1 }, { 0 },
+  { 44100, 128, 1152,  417, 1 }, { 48000, 128, 1152,  384, 1 }, { 32000, 128, 1152,  576, 1 }, { 0 },
+  { 44100, 160, 1152,  522, 1 }, { 48000, 160, 1152,  480, 1 }, { 32000, 160, 1152,  720, 1 }, { 0 },
+  { 44100, 192, 1152,  626, 1 }, { 48000, 192, 1152,  576, 1 }, { 32000, 192, 1152,  864, 1 }, { 0 },
+  { 44100, 224, 1152,  731, 1 }, { 48000, 224, 1152,  672, 1 }, { 32000, 224, 1152, 1008, 1 }, { 0 },
+  { 44100, 256, 1152,  835, 1 }, { 48000, 256, 1152,  768, 1 }, { 32000, 256, 1152, 1152, 1 }, { 0 },
+  { 44100, 320, 1152, 1044, 1 }, { 48000, 320, 1152,  960, 1 }, { 32000, 320, 1152, 1440, 1 }, { 0 },
+  { 44100, 384, 1152, 1253, 1 }, { 48000, 384, 1152, 1152, 1 }, { 32000, 384, 1152, 1728, 1 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+  // MPEG1, layer 1
+  { 0 }, { 0 }, { 0 }, { 0 },
+  { 44100,  32,  384,   32, 4 }, { 48000,  32,  384,   32, 4 }, { 32000,  32,  384,   48, 4 }, { 0 },
+  { 44100,  64,  384,   68, 4 }, { 48000,  64,  384,   64, 4 }, { 32000,  64,  384,   96, 4 }, { 0 },
+  { 44100,  96,  384,  104, 4 }, { 48000,  96,  384,   96, 4 }, { 32000,  96,  384,  144, 4 }, { 0 },
+  { 44100, 128,  384,  136, 4 }, { 48000, 128,  384,  128, 4 }, { 32000, 128,  384,  192, 4 }, { 0 },
+  { 44100, 160,  384,  172, 4 }, { 48000, 160,  384,  160, 4 }, { 32000, 160,  384,  240, 4 }, { 0 },
+  { 44100, 192,  384,  208, 4 }, { 48000, 192,  384,  192, 4 }, { 32000, 192,  384,  288, 4 }, { 0 },
+  { 44100, 224,  384,  240, 4 }, { 48000, 224,  384,  224, 4 }, { 32000, 224,  384,  336, 4 }, { 0 },
+  { 44100, 256,  384,  276, 4 }, { 48000, 256,  384,  256, 4 }, { 32000, 256,  384,  384, 4 }, { 0 },
+  { 44100, 288,  384,  312, 4 }, { 48000, 288,  384,  288, 4 }, { 32000, 288,  384,  432, 4 }, { 0 },
+  { 44100, 320,  384,  348, 4 }, { 48000, 320,  384,  320, 4 }, { 32000, 320,  384,  480, 4 }, { 0 },
+  { 44100, 352,  384,  380, 4 }, { 48000, 352,  384,  352, 4 }, { 32000, 352,  384,  528, 4 }, { 0 },
+  { 44100, 384,  384,  416, 4 }, { 48000, 384,  384,  384, 4 }, { 32000, 384,  384,  576, 4 }, { 0 },
+  { 44100, 416,  384,  452, 4 }, { 48000, 416,  384,  416, 4 }, { 32000, 416,  384,  624, 4 }, { 0 },
+  { 44100, 448,  384,  484, 4 }, { 48000, 448,  384,  448, 4 }, { 32000, 448,  384,  672, 4 }, { 0 },
+  { 0 }, { 0 }, { 0 }, { 0 },
+};
+
+#endif
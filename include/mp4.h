@@ -16,8 +16,14 @@
 
 #define MP4_BLOCK_SIZE 4096
 
+// Pieces of a seek header passed to a seekwriter
+#define MP4_WRITE_SIZE 65536
+
 #define FOURCC_EQ(a, b) ((a)[0] == (b)[0] && (a)[1] == (b)[1] && (a)[2] && (b)[2] && (a)[3] == (b)[3])
 
+// The sample table boxes rewritten by mp4_seek
+#define MP4_ST_BOX(t) ( FOURCC_EQ(t, "stts") || FOURCC_EQ(t, "stsc") || FOURCC_EQ(t, "stsz") || FOURCC_EQ(t, "stco") || FOURCC_EQ(t, "co64") )
+
 typedef enum {
   AAC_INVALID   =  0, 
   AAC_MAIN      =  1, /* AAC Main */
@@ -59,18 +65,57 @@ const uint8_t bps_table[4] = {
   8, 16, 20, 24
 };
 
+// The first_* fields are running totals of the entries before, so a sample,
+// time or chunk is found with a binary search instead of adding up the
+// entries every time
 typedef struct tts {
   uint32_t sample_count;
   uint32_t sample_duration;
+  uint32_t first_sample;
+  uint64_t first_time;
 } tts;
 
 typedef struct stc {
   uint32_t first_chunk;
   uint32_t samples_per_chunk;
+  uint32_t first_sample;
 } stc;
 
+// A point in the kept seek header where mp4_seek writes something new: the
+// adjusted size of a container of the st* boxes, a rewritten st* box, or
+// for a clip the mdat size, the durations in mvhd, tkhd and mdhd, and the
+// edts left out
+typedef struct mp4hdrmark {
+  uint32_t offset; // in the kept header
+  uint32_t size;   // original box size
+  uint32_t track;  // trak it is in, counting from 1, 0 for moov and mdat
+  char type[4];
+} mp4hdrmark;
+
+// Where a sample table box of the seeked track is, so it can be read when
+// a seek needs it instead of while parsing
+typedef struct mp4tblbox {
+  uint64_t offset; // of the box contents, after its header
+  uint64_t size;   // of the contents
+} mp4tblbox;
+
+// Where mp4_seek writes the seek header: gathered in a string for info, or
+// passed to a seekwriter, in pieces of up to MP4_WRITE_SIZE
+typedef struct mp4out {
+  Buffer buf;
+  resval *hdr;
+  seekwriter *w;
+  uint8_t error; // the writer failed, nothing more is written
+} mp4out;
+
+// A fragment of a fragmented file, where a seek can start
+typedef struct mp4frag {
+  uint64_t time;   // in frag_timescale, from the first fragment
+  uint64_t offset; // of the fragment
+} mp4frag;
+
 typedef struct mp4info {
-  PerlIO *infile;
+  ScanIO *infile;
   char *file;
   Buffer *buf;
   uint64_t file_size; // total file size
@@ -79,10 +124,14 @@ typedef struct mp4info {
   uint64_t rsize;     // remaining size
   uint64_t audio_offset;
   uint64_t audio_size;
-  HV *info;
-  HV *tags;
+  uint8_t  audio_hsize; // mdat header size
+  resval *info;
+  resval *tags;
   uint32_t current_track;
   uint32_t track_count;
+  uint32_t seek_track;      // trak seeked, the first audio one, counting from 1
+  uint32_t track_id;        // its track id
+  uint32_t track_timescale; // its mdhd timescale
   uint8_t seen_moov;
   uint8_t dlna_invalid;
   
@@ -98,36 +147,71 @@ typedef struct mp4info {
   uint8_t seeking;      // flag if we're seeking
   uint32_t old_st_size; // size of original st* boxes
   uint32_t new_st_size; // size of rewritten st* boxes
-  uint32_t meta_size;   // size of variable meta box
-  SV *seekhdr;          // rewritten header during second seek pass
+  
+  // Copy of the boxes read while seeking, without the st* boxes, so mp4_seek
+  // can write the seek header without reading the file again
+  Buffer *hdr;
+  struct mp4hdrmark *hdr_marks;
+  uint32_t num_hdr_marks;
+  uint32_t hdr_marks_alloc;
+  
+  // Sample table boxes, read by _mp4_load_tables on the first seek
+  struct mp4tblbox stts_box;
+  struct mp4tblbox stsc_box;
+  struct mp4tblbox stsz_box;
+  struct mp4tblbox stco_box;
+  int8_t tables_loaded; // 0 not yet, 1 loaded, -1 invalid
+  
+  // Fragmented files (moof boxes) are seeked with an index of fragments,
+  // from sidx, from mfra at the end of the file or from reading every moof
+  uint8_t fragmented;
+  uint8_t fragments_done;   // nothing more to read after the first moof
+  uint8_t frag_walk;        // index built from every moof
+  uint32_t trex_duration;   // default sample duration of seek_track
+  uint64_t init_size;       // ftyp and moov, the seek header
+  uint64_t first_moof;
+  uint64_t mfra_offset;
+  uint64_t frag_size;       // total size of the fragments in sidx
+  uint64_t frag_time;       // moof durations read so far, in track_timescale
+  uint32_t frag_length_ms;  // 0 until known
+  uint32_t frag_timescale;
+  struct mp4frag *frags;
+  uint32_t num_frags;
+  uint32_t frags_alloc;
   
   // stsc
   uint32_t num_sample_to_chunks;
   struct stc *sample_to_chunk;
-  SV *new_stsc;
   
-  // stco
-  uint32_t *chunk_offset;
+  // stco or co64
+  uint64_t *chunk_offset;
   uint32_t num_chunk_offsets;
-  SV *new_stco;
+  uint8_t co64;
   
   // stts
   struct tts *time_to_sample;
   uint32_t num_time_to_samples;
-  SV *new_stts;
+  uint32_t total_samples;
   
-  // stsz
-  uint16_t *sample_byte_size;
+  // stsz, sample_size_width bytes for each sample in as few as hold the
+  // largest, or none if every sample is sample_size
+  uint8_t *sample_byte_size;
+  uint8_t sample_size_width;
+  uint32_t sample_size;
   uint32_t num_sample_byte_sizes;
-  SV *new_stsz;
 } mp4info;
 
-static int get_mp4tags(PerlIO *infile, char *file, HV *info, HV *tags);
-int mp4_find_frame(PerlIO *infile, char *file, int offset);
-int mp4_find_frame_return_info(PerlIO *infile, char *file, int offset, HV *info);
+static int get_mp4tags(ScanIO *infile, char *file, resval *info, resval *tags);
+off_t mp4_find_frame(ScanIO *infile, char *file, int offset);
+int mp4_find_frame_return_info(ScanIO *infile, char *file, int offset, resval *info);
+void * mp4_seek_open(ScanIO *infile, char *file);
+off_t mp4_seek(void *state, int offset, resval *info);
+off_t mp4_seek_write(void *state, int offset, resval *info, seekwriter *w);
+resval * mp4_clip_ranges(void *state, int start_ms, int end_ms);
+void mp4_seek_close(void *state);
 
-mp4info * _mp4_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking);
-int _mp4_read_box(mp4info *mp4);
+mp4info * _mp4_parse(ScanIO *infile, char *file, resval *info, resval *tags, uint8_t seeking);
+uint64_t _mp4_read_box(mp4info *mp4);
 uint8_t _mp4_parse_ftyp(mp4info *mp4);
 uint8_t _mp4_parse_mvhd(mp4info *mp4);
 uint8_t _mp4_parse_tkhd(mp4info *mp4);
@@ -141,13 +225,43 @@ uint8_t _mp4_parse_stts(mp4info *mp4);
 uint8_t _mp4_parse_stsc(mp4info *mp4);
 uint8_t _mp4_parse_stsz(mp4info *mp4);
 uint8_t _mp4_parse_stco(mp4info *mp4);
+uint8_t _mp4_parse_mehd(mp4info *mp4);
+uint8_t _mp4_parse_trex(mp4info *mp4);
+uint8_t _mp4_parse_sidx(mp4info *mp4);
+uint8_t _mp4_parse_moof(mp4info *mp4, uint64_t *duration);
 uint8_t _mp4_parse_meta(mp4info *mp4);
 uint8_t _mp4_parse_ilst(mp4info *mp4);
-uint8_t _mp4_parse_ilst_data(mp4info *mp4, uint32_t size, SV *key);
+uint8_t _mp4_parse_ilst_data(mp4info *mp4, uint32_t size, resval *key);
 uint8_t _mp4_parse_ilst_custom(mp4info *mp4, uint32_t size);
-HV * _mp4_get_current_trackinfo(mp4info *mp4);
+resval * _mp4_get_current_trackinfo(mp4info *mp4);
 uint32_t _mp4_descr_length(Buffer *buf);
-void _mp4_skip(mp4info *mp4, uint32_t size);
+void _mp4_skip(mp4info *mp4, uint64_t size);
+static int _mp4_keep_box(mp4info *mp4, char *type, uint64_t size);
+static void _mp4_mark_box(mp4info *mp4, char *type, uint64_t size);
 uint32_t _mp4_samples_in_chunk(mp4info *mp4, uint32_t chunk);
 uint32_t _mp4_total_samples(mp4info *mp4);
 uint32_t _mp4_get_sample_duration(mp4info *mp4, uint32_t sample);
+uint32_t _mp4_get_sample_size(mp4info *mp4, uint32_t sample);
+static void _mp4_start_fragments(mp4info *mp4);
+static void _mp4_finish_fragments(mp4info *mp4);
+static int _mp4_parse_mfra(mp4info *mp4);
+static void _mp4_parse_tfra(mp4info *mp4, uint64_t size);
+static void _mp4_add_frag(mp4info *mp4, uint64_t time, uint64_t offset);
+static void _mp4_seek_info(mp4info *mp4, resval *info);
+static off_t _mp4_seek(mp4info *mp4, int offset, int end, resval *info, seekwriter *w);
+static int _mp4_seek_fragment(mp4info *mp4, int offset, resval *info, seekwriter *w, uint64_t *file_offset);
+static void _mp4_out(mp4out *out, const char *data, uint32_t len);
+static void _mp4_out_int(mp4out *out, uint32_t value);
+static void _mp4_out_int64(mp4out *out, uint64_t value);
+static void _mp4_out_box(mp4out *out, uint32_t size, char *type);
+static void _mp4_out_flush(mp4out *out);
+static void _mp4_out_write(mp4out *out, const char *data, uint32_t len);
+static uint32_t _mp4_table_entries(mp4info *mp4, uint32_t left, uint32_t width);
+static void _mp4_widen_sizes(mp4info *mp4, uint32_t count, uint8_t width);
+static int _mp4_load_tables(mp4info *mp4);
+static int _mp4_load_table(mp4info *mp4, struct mp4tblbox *box, uint8_t (*parse)(mp4info *), char *type);
+static void _mp4_add_stc(struct stc *stsc, uint32_t *entries, uint32_t first_chunk, uint32_t samples_per_chunk);
+static uint32_t _mp4_find_tts_time(mp4info *mp4, uint64_t time);
+static uint32_t _mp4_find_tts(mp4info *mp4, uint32_t sample);
+static uint32_t _mp4_find_stc(mp4info *mp4, uint32_t sample);
+static uint32_t _mp4_find_stc_chunk(mp4info *mp4, uint32_t chunk);
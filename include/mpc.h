@@ -74,7 +74,7 @@ typedef struct mpc_streaminfo {
   int32_t         total_file_length;   ///< total length of underlying file
   
   Buffer *buf;
-  PerlIO *infile;
+  ScanIO *infile;
 } mpc_streaminfo;
 
 #endif
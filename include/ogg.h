@@ -16,8 +16,20 @@
 
 #define OGG_BLOCK_SIZE 4500
 
-int get_ogg_metadata(PerlIO *infile, char *file, HV *info, HV *tags);
-int _ogg_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking);
-static int ogg_find_frame(PerlIO *infile, char *file, int offset);
-void _parse_vorbis_comments(PerlIO *infile, Buffer *vorbis_buf, HV *tags, int has_framing);
-int _ogg_binary_search_sample(PerlIO *infile, char *file, HV *info, uint64_t target_sample);
+// Kept between seeks in the same file
+typedef struct {
+  ScanIO *infile;
+  char *file;
+  resval *info; // NULL if the file could not be parsed
+  off_t hint_offset;    // where to start searching for samples >= hint_sample
+  uint64_t hint_sample;
+} oggseek;
+
+int get_ogg_metadata(ScanIO *infile, char *file, resval *info, resval *tags);
+int _ogg_parse(ScanIO *infile, char *file, resval *info, resval *tags, uint8_t seeking);
+static off_t ogg_find_frame(ScanIO *infile, char *file, int offset);
+static void * ogg_seek_open(ScanIO *infile, char *file);
+static off_t ogg_seek(void *state, int offset, resval *info);
+static void ogg_seek_close(void *state);
+void _parse_vorbis_comments(ScanIO *infile, Buffer *vorbis_buf, resval *tags, int has_framing);
+int _ogg_binary_search_sample(ScanIO *infile, char *file, resval *info, uint64_t target_sample, off_t *start);
@@ -0,0 +1,150 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef RESULT_H
+#define RESULT_H
+
+#include <setjmp.h>
+
+// Parser results (info and tags) are built as a tree of resvals allocated
+// from an arena owned by a ScanResult, without using the Perl interpreter,
+// so parsers can run on any thread.  res_to_sv() converts a finished tree
+// into the usual HV/AV/SV structures on the interpreter thread.
+//
+// The res_* functions mirror the Perl API they replace (res_newuv for
+// newSVuv, res_hv_store for my_hv_store, etc.) and allocate from the
+// ScanResult made current on the calling thread with result_enter().
+
+#define RES_UNDEF 0
+#define RES_IV    1 // signed integer
+#define RES_UV    2 // unsigned integer
+#define RES_NV    3 // double
+#define RES_PV    4 // string
+#define RES_BLOB  5 // binary data, i.e. artwork
+#define RES_ART   6 // artwork left in the file, offset and length
+#define RES_HASH  7
+#define RES_ARRAY 8
+
+#define RES_F_UTF8   0x01 // decode as UTF-8 if valid, see sv_utf8_decode
+#define RES_F_STDERR 0x02 // deferred message for stderr rather than warn
+
+typedef struct resval resval;
+typedef struct resent resent;
+
+struct resent {
+  resent *next;
+  resval *val;
+  char *key;      // hash entries only
+  uint32_t klen;
+  uint8_t kflags;
+};
+
+struct resval {
+  uint8_t type;
+  uint8_t flags;
+  uint32_t len;   // bytes in a string, entries in a hash or array
+  uint32_t cap;   // bytes allocated for a string
+  union {
+    int64_t iv;
+    uint64_t uv;
+    double nv;
+    char *pv;
+    struct {
+      resent *head;
+      resent *tail;
+    } list;
+    struct {
+      uint64_t offset;
+      uint64_t length;
+    } art;
+  } u;
+};
+
+typedef struct resblock resblock;
+typedef struct resbig resbig;
+
+typedef struct ScanResult ScanResult;
+
+struct ScanResult {
+  ScanResult *prev;  // result current before result_enter
+  resblock *blocks;
+  char *next;        // free space in the current block
+  size_t left;
+  resbig *bigs;      // large strings, allocated separately so they can grow
+  resval *warnings;  // deferred warnings, off the interpreter thread only
+  jmp_buf *jmp;      // where res_croak goes, off the interpreter thread only
+  char error[256];   // message from res_croak
+  uint32_t flags;    // scan options for the parsers, SCAN_* in common.h
+};
+
+void result_init(ScanResult *r);
+void result_free(ScanResult *r);
+void result_enter(ScanResult *r);
+void result_leave(ScanResult *r);
+ScanResult * result_current(void);
+
+resval * res_newundef(void);
+resval * res_newiv(int64_t iv);
+resval * res_newuv(uint64_t uv);
+resval * res_newnv(double nv);
+resval * res_newpv(const char *s, size_t len);
+resval * res_newpvn(const char *s, size_t len);
+resval * res_newpvf(const char *fmt, ...);
+resval * res_newblob(const void *data, size_t len);
+resval * res_newart(uint64_t offset, uint64_t length);
+resval * res_newsv(resval *v);
+resval * res_newhv(void);
+resval * res_newav(void);
+
+void res_hv_store(resval *hv, const char *key, resval *val);
+void res_hv_store_ent(resval *hv, resval *key, resval *val);
+resval ** res_hv_fetch(resval *hv, const char *key);
+int res_hv_exists(resval *hv, const char *key);
+resval * res_hv_delete(resval *hv, const char *key);
+
+void res_av_push(resval *av, resval *val);
+resval ** res_av_fetch(resval *av, int idx);
+resval * res_av_shift(resval *av);
+int res_av_len(resval *av);
+
+int64_t res_iv(resval *v);
+uint64_t res_uv(resval *v);
+double res_nv(resval *v);
+char * res_pv(resval *v);
+size_t res_len(resval *v);
+void res_catpvn(resval *v, const char *s, size_t len);
+void res_catpvf(resval *v, const char *fmt, ...);
+void res_catsv(resval *v, resval *w);
+void res_cur_set(resval *v, size_t len);
+void res_utf8_decode(resval *v);
+
+#define res_type(v)   ((v)->type)
+#define res_ispv(v)   ((v)->type == RES_PV || (v)->type == RES_BLOB)
+#define res_ishv(v)   ((v)->type == RES_HASH)
+#define res_isav(v)   ((v)->type == RES_ARRAY)
+
+void res_warn(const char *fmt, ...);
+void res_errprintf(const char *fmt, ...);
+void res_croak(const char *fmt, ...);
+
+void res_serialize(resval *v, Buffer *out);
+resval * res_deserialize(const unsigned char *data, uint32_t len);
+
+SV * res_to_sv(resval *v);
+HV * res_to_hv(resval *hv);
+void result_replay_warnings(ScanResult *r);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SCANCACHE_H
+#define SCANCACHE_H
+
+// Persistent cache of scan results.  The cache file is append-only: a
+// header followed by one record per stored result or invalidation.  Each
+// record holds the file's identity (device, inode, size, mtime in ns), a
+// 64-bit hash of its path, the path itself, the scan options and the
+// result as written by res_serialize.  Records are 8-byte aligned, in host
+// byte order, and read through a mapping of the file where possible.
+//
+// Opening a cache indexes the latest record for each path and set of
+// options.  Writers take an exclusive flock while appending, so several
+// processes can share one cache.
+
+#define SCANCACHE_MAGIC   "AUDSCANC"
+#define SCANCACHE_VERSION 1
+#define SCANCACHE_BOM     0x01020304 // caches from another byte order are rejected
+#define SCANCACHE_RECORD  0x52435341 // "ASCR"
+
+// Stored with the filter, results differ when artwork is skipped
+#define SCANCACHE_NO_ARTWORK 0x80000000
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t bom;
+} scancache_header;
+
+typedef struct {
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_ns;
+} scancache_id;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t length;      // whole record, including path, data and padding
+  uint64_t path_hash;
+  scancache_id id;
+  uint32_t filter;
+  uint32_t md5_size;
+  uint32_t md5_offset;
+  uint32_t path_len;
+  uint32_t data_len;    // 0 for an invalidation
+  uint32_t checksum;    // of the path and data
+} scancache_record;
+
+typedef struct {
+  uint64_t path_hash;
+  off_t offset;         // latest record, 0 once invalidated
+  uint32_t filter;
+  uint32_t md5_size;
+  uint32_t md5_offset;
+  uint32_t next;        // next entry in the same bucket, 1-based
+} scancache_entry;
+
+typedef struct {
+  char *path;
+  int fd;
+  uint64_t ino;         // of the cache file, to notice it being replaced
+  ScanIO io;            // mapping of the file as of the last sync
+  off_t end;            // end of the last valid record
+  scancache_entry *entries;
+  uint32_t nentries;
+  uint32_t alloc;
+  uint32_t *buckets;
+  uint32_t nbuckets;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t stores;
+} scancache;
+
+int scancache_open(scancache *c, const char *path);
+void scancache_close(scancache *c);
+int scancache_identify(const char *file, int fd, scancache_id *id);
+resval * scancache_fetch(scancache *c, const char *file, uint32_t filter, uint32_t md5_size, uint32_t md5_offset);
+int scancache_store(scancache *c, const char *file, scancache_id *id,
+  uint32_t filter, uint32_t md5_size, uint32_t md5_offset, resval *v);
+int scancache_invalidate(scancache *c, const char *file);
+int scancache_compact(scancache *c);
+uint32_t scancache_live(scancache *c);
+
+#endif
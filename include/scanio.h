@@ -0,0 +1,68 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SCANIO_H
+#define SCANIO_H
+
+// I/O source used by all parsers, so the same format code can read from
+// a PerlIO handle, a raw fd with pread(), an mmap'ed file or memory.
+
+#define SCANIO_PERLIO 0
+#define SCANIO_PREAD  1
+#define SCANIO_MMAP   2
+#define SCANIO_MEMORY 3
+
+typedef struct ScanIO ScanIO;
+
+typedef struct {
+  const char *name;
+  SSize_t (*read)(ScanIO *io, void *buf, size_t len);
+  int (*seek)(ScanIO *io, off_t offset, int whence);
+  off_t (*tell)(ScanIO *io);
+  off_t (*size)(ScanIO *io);
+} scanio_ops;
+
+struct ScanIO {
+  const scanio_ops *ops;
+  uint8_t type;
+  uint8_t error;
+  uint8_t owns_data; // data was allocated or mapped by us
+
+  PerlIO *pio;       // perlio
+  int fd;            // pread/mmap
+
+  unsigned char *data; // mmap/memory
+  off_t size;
+  off_t pos;
+};
+
+int scanio_type(const char *name);
+void scanio_init_perlio(ScanIO *io, PerlIO *pio);
+int scanio_init_pread(ScanIO *io, int fd, off_t pos);
+int scanio_init_mmap(ScanIO *io, int fd, off_t pos);
+void scanio_init_memory(ScanIO *io, unsigned char *data, off_t size);
+int scanio_init_slurp(ScanIO *io, PerlIO *pio);
+void scanio_init_type(ScanIO *io, PerlIO *pio, int type);
+void scanio_prefetch(ScanIO *io, off_t offset, off_t len);
+void scanio_close(ScanIO *io);
+
+#define scanio_read(io, buf, len)       ((io)->ops->read((io), (buf), (len)))
+#define scanio_seek(io, offset, whence) ((io)->ops->seek((io), (offset), (whence)))
+#define scanio_tell(io)                 ((io)->ops->tell((io)))
+#define scanio_size(io)                 ((io)->ops->size((io)))
+#define scanio_error(io)                ((io)->type == SCANIO_PERLIO ? PerlIO_error((io)->pio) : (io)->error)
+
+#endif
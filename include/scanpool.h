@@ -0,0 +1,95 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SCANPOOL_H
+#define SCANPOOL_H
+
+// Worker thread pool for scan_many.  Workers only use plain C and system
+// calls, never the Perl interpreter: they open and map files ahead of the
+// interpreter thread, which picks up finished jobs in order or as they
+// complete.  Where possible workers also run the parsers, which build
+// their results in the job's ScanResult.
+
+#ifndef _MSC_VER
+# include <pthread.h>
+# define SCANPOOL_THREADS
+#endif
+
+// Parsers allocate with New/Safefree, which only work without an
+// interpreter context when they are plain malloc/free
+#if defined(SCANPOOL_THREADS) && !defined(PERL_TRACK_MEMPOOL) \
+  && !defined(PERL_IMPLICIT_SYS) && !defined(MYMALLOC) && !defined(DEBUGGING)
+# define SCANPOOL_PARSE
+#endif
+
+// Bytes at each end of a file faulted in by the worker, where tags live
+#define SCANPOOL_PREFETCH 131072
+
+// Jobs each worker may have finished ahead of the consumer
+#define SCANPOOL_AHEAD 4
+
+#define SCANJOB_PENDING 0
+#define SCANJOB_RUNNING 1
+#define SCANJOB_READY   2
+#define SCANJOB_DONE    3
+
+typedef struct scanjob scanjob;
+
+typedef void (*scanpool_parse_fn)(scanjob *job, void *arg);
+
+struct scanjob {
+  const char *path;
+  uint8_t state;
+  uint8_t parsed;   // parse function has run
+  int error;        // errno if the file could not be opened
+  int fd;           // open only if it could not be mapped
+  ScanIO io;
+  ScanResult result;
+  resval *ret;      // parse result, NULL if the parser failed
+  BufferStats stats; // buffer counters of the worker for this job
+};
+
+typedef struct {
+  scanjob *jobs;
+  int njobs;
+  int nthreads;
+  int window;       // max jobs running or ready but not yet consumed
+  int next;         // next job to be claimed by a worker
+  int inflight;
+  int stop;
+  int *done;        // indexes of jobs in the order they became ready
+  int done_head;    // next of them for scanpool_next_any
+  int done_tail;
+  char *paths;      // storage for all job paths
+  scanpool_parse_fn parse;
+  void *parse_arg;
+#ifdef SCANPOOL_THREADS
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t ready;
+#endif
+} scanpool;
+
+void scanpool_init(scanpool *pool, const char **paths, int njobs, int nthreads,
+  scanpool_parse_fn parse, void *parse_arg);
+scanjob * scanpool_next(scanpool *pool, int index);
+scanjob * scanpool_next_any(scanpool *pool, int *index);
+void scanpool_release(scanpool *pool, scanjob *job);
+void scanpool_destroy(scanpool *pool);
+int scanpool_ncpu(void);
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SYNCSCAN_H
+#define SYNCSCAN_H
+
+// Search for frame and page sync patterns, 16 or 32 candidate positions at
+// a time where the CPU allows.  The implementation is picked on first use:
+// AVX2 if the CPU has it, else SSE2 on x86, NEON on ARM64, else plain C.
+// Plain C only, so tools/syncbench.c can build it outside of Perl.
+
+#include <stddef.h>
+
+#ifdef _MSC_VER
+# include "pinttypes.h"
+#else
+# include <inttypes.h>
+#endif
+
+// A pattern matches at p if (p[i] & mask[i]) == bytes[i] for every i < len.
+// mask[0] must be 0xFF.
+typedef struct {
+  const char *name;
+  uint8_t len;      // 2 to 4
+  uint8_t bytes[4];
+  uint8_t mask[4];
+} syncpattern;
+
+typedef const unsigned char * (*syncscan_fn)(const unsigned char *p, size_t len, const syncpattern *pat);
+
+typedef struct {
+  const char *name;
+  syncscan_fn find;
+  int (*supported)(void);
+} syncscan_impl;
+
+extern const syncpattern syncscan_mpeg;    // 0xFFE, MPEG audio frames
+extern const syncpattern syncscan_adts;    // 0xFFF, layer 0, AAC ADTS frames
+extern const syncpattern syncscan_ogg;     // "OggS"
+extern const syncpattern syncscan_flac;    // 0xFFF8/0xFFF9 with reserved bits clear
+extern const syncpattern syncscan_wavpack; // "wvpk"
+
+// NULL-terminated, best first
+extern const syncscan_impl syncscan_impls[];
+
+// Returns the first position in p[0 .. len) where the whole pattern
+// matches, or NULL.  Matches running past len are not reported, so callers
+// reading in blocks should keep the last pat->len - 1 bytes.
+const unsigned char * syncscan_find(const unsigned char *p, size_t len, const syncpattern *pat);
+
+// Forces the named implementation, returns 0 if it's unknown or unsupported
+int syncscan_use(const char *name);
+const char * syncscan_current(void);
+
+#endif
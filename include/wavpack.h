@@ -50,10 +50,10 @@ typedef struct {
 } WavpackHeader3;
 
 typedef struct wvpinfo {
-  PerlIO *infile;
+  ScanIO *infile;
   char *file;
   Buffer *buf;
-  HV *info;
+  resval *info;
   off_t file_size;
   off_t file_offset;
   off_t audio_offset;
@@ -95,8 +95,8 @@ const int wavpack_sample_rates[] = {
 #define ID_MD5_CHECKSUM         (ID_OPTIONAL_DATA | 0x6)
 #define ID_SAMPLE_RATE          (ID_OPTIONAL_DATA | 0x7)
 
-static int get_wavpack_info(PerlIO *infile, char *file, HV *info);
-wvpinfo * _wavpack_parse(PerlIO *infile, char *file, HV *info, uint8_t seeking);
+static int get_wavpack_info(ScanIO *infile, char *file, resval *info);
+wvpinfo * _wavpack_parse(ScanIO *infile, char *file, resval *info, uint8_t seeking);
 int _wavpack_parse_block(wvpinfo *wvp);
 int _wavpack_parse_sample_rate(wvpinfo *wvp, uint32_t size);
 int _wavpack_parse_channel_info(wvpinfo *wvp, uint32_t size);
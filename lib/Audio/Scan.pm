@@ -10,6 +10,9 @@ XSLoader::load('Audio::Scan', $VERSION);
 use constant FILTER_INFO_ONLY => 1;
 use constant FILTER_TAGS_ONLY => 2;
 
+# Scan options passed to the parsers with the filter
+use constant SCAN_DURATION_SAMPLED => 0x100;
+
 sub scan_info {
     my ( $class, $path, $opts ) = @_;
     
@@ -31,18 +34,7 @@ sub scan_tags {
 sub scan {
     my ( $class, $path, $opts ) = @_;
     
-    my ($filter, $md5_size, $md5_offset);
-      
-    open my $fh, '<', $path or do {
-        warn "Could not open $path for reading: $!\n";
-        return;
-    };
-    
-    binmode $fh;
-    
-    my ($suffix) = $path =~ /\.(\w+)$/;
-    
-    return if !$suffix;
+    my ($filter, $md5_size, $md5_offset, $io, $cache);
     
     if ( defined $opts ) {
         if ( !ref $opts ) {
@@ -54,6 +46,8 @@ sub scan {
             $filter     = $opts->{filter} || FILTER_INFO_ONLY | FILTER_TAGS_ONLY;
             $md5_size   = $opts->{md5_size};
             $md5_offset = $opts->{md5_offset};
+            $io         = $opts->{io};
+            $cache      = _cache( $opts->{cache} ) if defined $opts->{cache};
         }
     }
     
@@ -61,7 +55,25 @@ sub scan {
         $filter = FILTER_INFO_ONLY | FILTER_TAGS_ONLY;
     }
     
-    my $ret = $class->_scan( $suffix, $fh, $path, $filter, $md5_size || 0, $md5_offset || 0 );
+    $filter |= _scan_flags($opts);
+    
+    if ( $cache ) {
+        my $ret = $cache->fetch( $path, $filter, $md5_size || 0, $md5_offset || 0 );
+        return $ret if $ret;
+    }
+      
+    open my $fh, '<', $path or do {
+        warn "Could not open $path for reading: $!\n";
+        return;
+    };
+    
+    binmode $fh;
+    
+    my $suffix = $class->_path_suffix($path);
+    
+    return if !$suffix;
+    
+    my $ret = $class->_scan( $suffix, $fh, $path, $filter, $md5_size || 0, $md5_offset || 0, $io, $cache );
     
     close $fh;
     
@@ -71,7 +83,7 @@ sub scan {
 sub scan_fh {
     my ( $class, $suffix, $fh, $opts ) = @_;
     
-    my ($filter, $md5_size, $md5_offset);
+    my ($filter, $md5_size, $md5_offset, $io);
     
     binmode $fh;
     
@@ -85,6 +97,7 @@ sub scan_fh {
             $filter     = $opts->{filter} || FILTER_INFO_ONLY | FILTER_TAGS_ONLY;
             $md5_size   = $opts->{md5_size};
             $md5_offset = $opts->{md5_offset};
+            $io         = $opts->{io};
         }
     }
     
@@ -92,11 +105,57 @@ sub scan_fh {
         $filter = FILTER_INFO_ONLY | FILTER_TAGS_ONLY;
     }
     
-    return $class->_scan( $suffix, $fh, '(filehandle)', $filter, $md5_size || 0, $md5_offset || 0 );
+    $filter |= _scan_flags($opts);
+    
+    return $class->_scan( $suffix, $fh, '(filehandle)', $filter, $md5_size || 0, $md5_offset || 0, $io );
+}
+
+sub scan_many {
+    my ( $class, $paths, $opts ) = @_;
+    
+    $opts ||= {};
+    
+    return $class->_scan_many(
+        $paths,
+        defined $opts->{threads} ? $opts->{threads} : -1,
+        ( $opts->{filter} || FILTER_INFO_ONLY | FILTER_TAGS_ONLY ) | _scan_flags($opts),
+        $opts->{md5_size} || 0, $opts->{md5_offset} || 0,
+        $opts->{callback},
+    );
+}
+
+sub scan_data {
+    my ( $class, $suffix, $data, $opts ) = @_;
+    
+    $opts ||= {};
+    
+    # Parse the caller's scalar in place, never a copy of it
+    $data = \$_[2] if !ref $data;
+    
+    return $class->_scan(
+        $suffix, $data, '(data)',
+        ( $opts->{filter} || FILTER_INFO_ONLY | FILTER_TAGS_ONLY ) | _scan_flags($opts),
+        $opts->{md5_size} || 0, $opts->{md5_offset} || 0,
+    );
+}
+
+sub _scan_flags {
+    my $opts = shift;
+    
+    return 0 if !ref $opts || !$opts->{duration_accuracy};
+    
+    my $accuracy = $opts->{duration_accuracy};
+    
+    return 0 if $accuracy eq 'exact';
+    return SCAN_DURATION_SAMPLED if $accuracy eq 'sampled';
+    
+    warn "Audio::Scan unknown duration_accuracy: $accuracy\n";
+    
+    return 0;
 }
 
 sub find_frame {
-    my ( $class, $path, $offset ) = @_;
+    my ( $class, $path, $offset, $opts ) = @_;
     
     open my $fh, '<', $path or do {
         warn "Could not open $path for reading: $!\n";
@@ -105,11 +164,32 @@ sub find_frame {
     
     binmode $fh;
     
-    my ($suffix) = $path =~ /\.(\w+)$/;
+    my $suffix = $class->_path_suffix($path);
     
     return -1 if !$suffix;
     
-    my $ret = $class->_find_frame( $suffix, $fh, $path, $offset );
+    my $ret = $class->_find_frame( $suffix, $fh, $path, $offset, $opts ? $opts->{io} : undef );
+    
+    close $fh;
+    
+    return $ret;
+}
+
+sub find_frames {
+    my ( $class, $path, $offsets, $opts ) = @_;
+    
+    open my $fh, '<', $path or do {
+        warn "Could not open $path for reading: $!\n";
+        return;
+    };
+    
+    binmode $fh;
+    
+    my $suffix = $class->_path_suffix($path);
+    
+    return [ map { -1 } @{$offsets} ] if !$suffix;
+    
+    my $ret = $class->_find_frames( $suffix, $fh, $path, $offsets, $opts ? $opts->{io} : undef );
     
     close $fh;
     
@@ -117,15 +197,15 @@ sub find_frame {
 }
 
 sub find_frame_fh {
-    my ( $class, $suffix, $fh, $offset ) = @_;
+    my ( $class, $suffix, $fh, $offset, $opts ) = @_;
     
     binmode $fh;
     
-    return $class->_find_frame( $suffix, $fh, '(filehandle)', $offset );
+    return $class->_find_frame( $suffix, $fh, '(filehandle)', $offset, $opts ? $opts->{io} : undef );
 }
 
 sub find_frame_return_info {
-    my ( $class, $path, $offset ) = @_;
+    my ( $class, $path, $offset, $opts ) = @_;
     
     open my $fh, '<', $path or do {
         warn "Could not open $path for reading: $!\n";
@@ -134,11 +214,32 @@ sub find_frame_return_info {
     
     binmode $fh;
     
-    my ($suffix) = $path =~ /\.(\w+)$/;
+    my $suffix = $class->_path_suffix($path);
     
     return if !$suffix;
     
-    my $ret = $class->_find_frame_return_info( $suffix, $fh, $path, $offset );
+    my $ret = $class->_find_frame_return_info( $suffix, $fh, $path, $offset, $opts ? $opts->{io} : undef );
+    
+    close $fh;
+    
+    return $ret;
+}
+
+sub find_frame_write_info {
+    my ( $class, $path, $offset, $target, $opts ) = @_;
+    
+    open my $fh, '<', $path or do {
+        warn "Could not open $path for reading: $!\n";
+        return;
+    };
+    
+    binmode $fh;
+    
+    my $suffix = $class->_path_suffix($path);
+    
+    return if !$suffix;
+    
+    my $ret = $class->_find_frame_write_info( $suffix, $fh, $path, $offset, $target, $opts ? $opts->{io} : undef );
     
     close $fh;
     
@@ -146,11 +247,106 @@ sub find_frame_return_info {
 }
 
 sub find_frame_fh_return_info {
-    my ( $class, $suffix, $fh, $offset ) = @_;
+    my ( $class, $suffix, $fh, $offset, $opts ) = @_;
+    
+    binmode $fh;
+    
+    return $class->_find_frame_return_info( $suffix, $fh, '(filehandle)', $offset, $opts ? $opts->{io} : undef );
+}
+
+sub clip_ranges {
+    my ( $class, $path, $start_ms, $end_ms, $opts ) = @_;
+    
+    my $file = Audio::Scan::File->new( $path, $opts ) or return;
+    
+    return $file->clip_ranges( $start_ms, $end_ms );
+}
+
+sub find_frame_data {
+    my ( $class, $suffix, $data, $offset ) = @_;
+    
+    $data = \$_[2] if !ref $data;
+    
+    return $class->_find_frame( $suffix, $data, '(data)', $offset );
+}
+
+sub find_frame_data_return_info {
+    my ( $class, $suffix, $data, $offset ) = @_;
+    
+    $data = \$_[2] if !ref $data;
+    
+    return $class->_find_frame_return_info( $suffix, $data, '(data)', $offset );
+}
+
+# Open caches, by path, shared by all scans in this process
+my %CACHES;
+
+sub _cache {
+    my $path = shift;
+    
+    # Reopen after a fork or thread clone
+    if ( !$CACHES{$path} || $CACHES{$path}->{pid} != $$ || ref $CACHES{$path}->{cache} ne 'Audio::Scan::Cache' ) {
+        $CACHES{$path} = {
+            pid   => $$,
+            cache => Audio::Scan::Cache->_open($path),
+        };
+    }
+    
+    return $CACHES{$path}->{cache};
+}
+
+sub cache_invalidate {
+    my ( $class, $cache, @paths ) = @_;
+    
+    my $c = _cache($cache);
+    my $count = 0;
+    
+    for my $path ( @paths ) {
+        $count += $c->invalidate($path);
+    }
+    
+    return $count;
+}
+
+sub cache_compact {
+    my ( $class, $cache ) = @_;
+    
+    return _cache($cache)->compact;
+}
+
+sub cache_stats {
+    my ( $class, $cache ) = @_;
+    
+    return _cache($cache)->stats;
+}
+
+package Audio::Scan::File;
+
+sub new {
+    my ( $class, $path, $opts ) = @_;
+    
+    open my $fh, '<', $path or do {
+        warn "Could not open $path for reading: $!\n";
+        return;
+    };
     
     binmode $fh;
     
-    return $class->_find_frame_return_info( $suffix, $fh, '(filehandle)', $offset );
+    my $suffix = Audio::Scan->_path_suffix($path);
+    
+    return if !$suffix;
+    
+    return $class->_new( $suffix, $fh, $path, $opts ? $opts->{io} : undef );
+}
+
+sub new_fh {
+    my ( $class, $suffix, $fh, $opts ) = @_;
+    
+    return $class->_new( $suffix, $fh, '(data)', $opts ? $opts->{io} : undef ) if ref $fh eq 'SCALAR';
+    
+    binmode $fh;
+    
+    return $class->_new( $suffix, $fh, '(filehandle)', $opts ? $opts->{io} : undef );
 }
 
 1;
@@ -235,6 +431,40 @@ of calculating a new one.
 Begin computing the audio_md5 value starting at $offset.  If this value is not specified,
 $offset defaults to a point in the middle of the file.
 
+    io => 'perlio' | 'pread' | 'mmap' | 'memory'
+
+Selects how the file is read.  The default, C<perlio>, reads through the Perl filehandle.
+C<pread> reads the underlying file descriptor directly with pread(2), bypassing PerlIO
+layers and the shared file position, which works well on network filesystems. C<mmap> maps
+the file into memory, which is usually fastest on local disks.  C<memory> reads the whole
+file with a single read before scanning it, useful for small files on high-latency storage.
+With C<mmap> and C<memory> the parsers read straight from the mapped data instead of
+copying it into their own buffers, so seeking is just a pointer change.
+Handles that have no real file behind them (such as in-memory filehandles) and platforms
+without pread/mmap always use C<perlio>.  The same option is accepted by the find_frame methods.
+
+    cache => $cache_file
+
+Keeps results in a persistent cache file, which is created if needed.  A file is
+only parsed again when its device, inode, size or modification time change, or after
+C<cache_invalidate>.  Results are cached separately for each combination of filter,
+md5 options, C<duration_accuracy> and C<AUDIO_SCAN_NO_ARTWORK>.  Parser warnings are not repeated on a cache
+hit.  Several processes may share a cache; new results are appended under an exclusive
+lock.  The file is written in the host's byte order and can't be moved to a machine of
+a different byte order.  Not supported on Windows.
+
+    duration_accuracy => 'exact' | 'sampled'
+
+MP3 files without a Xing, LAME or VBRI header have no frame count, so their
+length comes from the average bitrate.  By default (C<exact>) that means reading
+every frame of a VBR file.  With C<sampled>, VBR files over 4MB of audio are only
+read in 64 small windows spread across the audio, and the average bitrate is
+estimated from the frames in those.  This reads a small fraction of a large file,
+usually at the cost of a few tenths of a percent of error in C<song_length_ms>.
+Estimated lengths are flagged with C<estimated> set to 1, and
+C<song_length_ms_error> holds the 95% confidence bound of the error in
+milliseconds.  Other formats and files with a frame count ignore this option.
+
 =head2 scan_info( $path, [ \%OPTIONS ] )
 
 If you only need file metadata and don't care about tags, you can use this method.
@@ -248,7 +478,45 @@ If you only need the tags and don't care about the metadata, use this method.
 Scans a filehandle. $type is the type of file to scan as, i.e. "mp3" or "ogg".
 Note that FLAC does not support reading from a filehandle.
 
-=head2 find_frame( $path, $timestamp_in_ms )
+=head2 scan_many( \@paths, [ \%OPTIONS ] )
+
+Scans many files at once.  Worker threads open and parse the files in parallel,
+and reading ahead hides the latency of slow or network storage.  Returns an arrayref of results in the same order as
+@paths, with undef for any file that could not be opened or is not supported.
+
+In addition to C<filter>, C<md5_size>, C<md5_offset> and C<duration_accuracy>, the following options
+are supported:
+
+    threads => $n
+
+The number of worker threads, defaults to the number of CPUs.  0 scans every file
+on the calling thread.  More threads than CPUs can help on high-latency storage.
+
+    callback => sub { my ( $path, $result, $index ) = @_; ... }
+
+Calls the callback with each result as soon as it is available instead of
+collecting them, so results may arrive out of order.  $index is the position of
+$path in @paths.  scan_many then returns the number of files.
+
+The workers never call into Perl.  Parsers build each result in a plain C
+structure, which is converted to a hash on the calling thread, where the
+callback also runs.  Parser warnings are issued on the calling thread when that
+file's result is returned.  If a parser dies on a corrupt file, scan_many warns
+with the error and returns undef for that file instead of dying.
+
+Files that can't be memory mapped are parsed on the calling thread, as are all
+files on perls where New/Safefree need the interpreter (DEBUGGING,
+PERL_TRACK_MEMPOOL, PERL_IMPLICIT_SYS or perl's own malloc).
+
+=head2 scan_data( $type => \$data, [ \%OPTIONS ] )
+
+Scans a file that is already in memory, such as an upload.  $type is the type of
+file to scan as, like C<scan_fh>.  The data is parsed directly from the scalar
+without being copied, so there is no need to write it to a temporary file first.
+The C<io> option does not apply.  The data must be a byte string: a string with the
+UTF8 flag on is parsed from a downgraded copy, and one with characters over 255 dies.
+
+=head2 find_frame( $path, $timestamp_in_ms, [ \%OPTIONS ] )
 
 Returns the byte offset to the first audio frame starting from the given timestamp
 (in milliseconds).
@@ -268,7 +536,17 @@ Not yet supported by find_frame.
 
 =back
 
-=head2 find_frame_return_info( $mp4_path, $timestamp_in_ms )
+=head2 find_frames( $path, \@timestamps_in_ms, [ \%OPTIONS ] )
+
+Same as calling C<find_frame> for each timestamp, but the file is only parsed once.
+Returns an arrayref of offsets in the same order as the timestamps.  The timestamps
+are looked up in increasing order, and for Ogg and FLAC files each search starts
+from the frame found for the previous timestamp.  MP4 files skip rewriting the seek
+header that C<find_frame_return_info> needs.
+
+=head2 find_frame_return_info( $path, $timestamp_in_ms, [ \%OPTIONS ] )
+
+Supported for MP4 and MP3 files.
 
 The header of an MP4 file contains various metadata that refers to the structure of
 the audio data, making seeking more difficult to perform. This method will return
@@ -279,6 +557,9 @@ the usual $info hash with 2 additional keys:
                   found at seek_offset to construct a valid bitstream. Specifically,
                   the following boxes are rewritten: stts, stsc, stsz, stco
 
+In files with more than one track, the first audio track is seeked and the other
+tracks are left out of seek_header.
+
 For example, to seek 30 seconds into a file and write out a new MP4 file seeked to
 this point:
 
@@ -297,18 +578,197 @@ this point:
     close $f;
     close $fh;
 
-=head2 find_frame_fh( $type => $fh, $offset )
+Fragmented MP4 files are seeked to the start of the moof box found through their
+sidx or mfra index, and seek_header is the unchanged header up to the end of
+the moov box.  Files with neither index return -1.
+
+For MP3 files the frame is found exactly, by walking the frame headers (files
+without a frame index have one built, see C<frame_index>), and the returned
+hash tells a decoder how to start at the exact sample:
+
+    seek_offset        - Offset of the frame holding the requested sample
+    frame_first_sample - Number of decoded samples before that frame
+    skip_samples       - Samples to drop from the start of that frame's output
+    preroll_offset     - Offset to start decoding from.  Layer 3 frames overlap
+                         with the frame before, and that frame's data may start
+                         in earlier frames (the bit reservoir, main_data_begin)
+    preroll_samples    - Samples decoded from preroll_offset to seek_offset, to
+                         be dropped along with skip_samples
+
+Samples are counted from the first audio frame, after any Xing/Info frame.  If the
+file has a LAME header the timestamp is in the gapless stream, so the encoder delay
+(C<lame_encoder_delay>) and the 529 sample decoder delay are included in
+C<skip_samples>.  C<seek_offset> is -1 if the timestamp is past the end of the file.
+
+=head2 find_frame_write_info( $path, $timestamp_in_ms, $fh_or_callback, [ \%OPTIONS ] )
+
+Supported for MP4 files.
+
+Same as C<find_frame_return_info>, but the seek header is written as it is built
+instead of being returned, so it never has to be held in memory whole.  The rewritten
+stsz box of a long audiobook alone can be several megabytes.  The returned hash has
+C<seek_header_length> in place of C<seek_header>.
+
+The header is printed to a filehandle, which is flushed before returning, or passed
+to a code reference in pieces of up to 64K.  The callback gets each piece and the
+length of the whole header, so for example an HTTP response can be started on the
+first call:
+
+    my $info = Audio::Scan->find_frame_write_info( $file, 30000, sub {
+        my ( $data, $length ) = @_;
+        
+        $client->send_headers( 'Content-Length' => $length + $audio_length ) if !$sent++;
+        $client->write($data);
+    } );
+
+If the callback dies, no more of the header is written and the error is rethrown
+once the seek has been cleaned up.  A header that could not be written in full has
+a C<seek_offset> of -1.
+
+=head2 clip_ranges( $path, $start_ms, $end_ms, [ \%OPTIONS ] )
+
+Supported for MP3 and MP4 files.
+
+Returns the parts of a file that make up a clip from $start_ms to $end_ms, so it
+can be served as is instead of being transcoded.  For MP3 files:
+
+    ranges          - [ [ $offset, $length ] ], the frames holding the clip, starting
+                      with the frames the first one needs for its bit reservoir and
+                      overlap (see find_frame_return_info)
+    frames          - The number of frames in the ranges
+    skip_samples    - Samples to drop from the start of the decoded clip
+    padding_samples - Samples to drop from the end of the decoded clip
+    xing_frame      - A Xing frame (Info for CBR clips) with the frame count, byte
+                      count and TOC of the clip, to send before the ranges.  Layer 3
+                      files only.
+
+Times are handled as in find_frame_return_info, so with a LAME header they are in the
+gapless stream.  $end_ms past the end of the file is taken as the end.  Returns undef if
+the range isn't in the file or the file isn't an MP3 or MP4.
+
+    my $clip = Audio::Scan->clip_ranges( $file, 60000, 90000 );
+    
+    print $out $clip->{xing_frame};
+    for my $range ( @{ $clip->{ranges} } ) {
+        sysseek $in, $range->[0], 0;
+        sysread $in, my $buf, $range->[1];
+        print $out $buf;
+    }
+
+For MP4 files the clip is a seek header as from C<find_frame_return_info> followed by
+one range of the file, from the sample holding $start_ms to the end of the sample
+holding $end_ms:
+
+    ranges      - [ [ $seek_offset, $seek_length ] ]
+    seek_offset - The offset of the first sample
+    seek_length - The bytes from seek_offset to the end of the last sample
+    seek_header - The header with the stts, stsc, stsz and stco boxes cut down to
+                  the samples of the clip, the mvhd, tkhd and mdhd durations set
+                  to its length, no edit list, and an mdat box of seek_length
+
+The tracks other than the first audio track are left out, as with
+C<find_frame_return_info>, so their samples in the range are ignored.  The sample
+tables of a 30 second clip of a long audiobook come to a few kilobytes, where
+C<find_frame_return_info> rewrites them to the end of the file.  Fragmented files are
+not supported.
+
+=head2 Audio::Scan::File->new( $path, [ \%OPTIONS ] )
+
+The find_frame methods above parse the whole file every time they are called.  To
+seek in the same file many times, open it once instead:
+
+    my $file = Audio::Scan::File->new('/path/to/file.mp3');
+    my $offset = $file->find_frame(30000);
+    my $info = $file->find_frame_return_info(60000); # MP4 and MP3 only
+    my $sent = $file->find_frame_write_info( 60000, $fh ); # MP4 only
+    my $offsets = $file->find_frames( [ 10000, 20000, 30000 ] );
+    my $clip = $file->clip_ranges( 60000, 90000 ); # MP3 and MP4 only
+
+The file is parsed when it is opened, keeping only what is needed for seeking (the
+Xing TOC, FLAC seektable, MP4 sample tables, ASF index and so on), and each
+C<find_frame>, C<find_frames>, C<find_frame_return_info>, C<find_frame_write_info> or
+C<clip_ranges> call only
+searches for the frames.  These methods return the same values as the class methods of the same
+name.  The file stays open until the object is destroyed.  The C<io> option is
+supported.
+
+=head2 Audio::Scan::File->new_fh( $type => $fh, [ \%OPTIONS ] )
+
+Same as C<new>, but with a filehandle.  The filehandle is kept open by the object.
+$fh may also be a reference to a scalar holding the file data, as with C<scan_data>.
+The object keeps its own copy of the data, so the scalar can be changed afterwards.
+
+=head2 $file->frame_index()
+
+For a VBR MP3 file without a Xing or VBRI header, opening it walks every frame
+to work out the bitrate, and records the offset of every 16th frame along the way.
+C<find_frame> then seeks to the frame containing the requested time exactly instead
+of estimating it from the average bitrate.  This returns that index:
+
+    {
+        interval => 16,                 # frames between entries
+        offsets  => [ 0, 7044, ... ],   # byte offset of each entry's frame
+        samples  => [ 0, 18432, ... ],  # first sample of each entry's frame
+    }
+
+Files without a Xing or VBRI header but with an ID3v2 MLLT frame use its references
+as the index instead, so no frames are read to open them, and C<interval> is the MLLT
+frames between references.  Other MP3 files get an index the first time
+C<find_frame_return_info> is called on them, and C<find_frame> uses it from then on.  Returns undef for files without one.
+
+=head2 find_frame_fh( $type => $fh, $offset, [ \%OPTIONS ] )
 
 Same as C<find_frame>, but with a filehandle.
 
-=head2 find_frame_fh_return_info( $type => $fh, $offset )
+=head2 find_frame_fh_return_info( $type => $fh, $offset, [ \%OPTIONS ] )
 
 Same as C<find_frame_return_info>, but with a filehandle.
 
+=head2 find_frame_data( $type => \$data, $offset )
+
+Same as C<find_frame>, but with file data in a scalar, see C<scan_data>.
+
+=head2 find_frame_data_return_info( $type => \$data, $offset )
+
+Same as C<find_frame_return_info>, but with file data in a scalar, see C<scan_data>.
+
+=head2 cache_invalidate( $cache_file, @paths )
+
+Drops any cached results for @paths from $cache_file, returns the number of paths
+that had results.
+
+=head2 cache_compact( $cache_file )
+
+Rewrites $cache_file keeping only the latest results for files that are unchanged
+since they were cached, returns the number of results kept.  Results appended by
+other processes while the cache is being compacted may be lost.
+
+=head2 cache_stats( $cache_file )
+
+Returns a hashref with the C<hits>, C<misses> and C<stores> made through
+$cache_file by this process, and the number of cached results (C<entries>) and
+C<size> of the file.
+
 =head2 has_flac()
 
 Deprecated.  Always returns 1 now that FLAC is always enabled.
 
+=head2 buffer_stats()
+
+Returns a hashref of counters describing the work done by the internal I/O buffers
+since the last call to C<reset_buffer_stats>: C<allocs>, C<reallocs>, C<frees>,
+C<compactions>, C<bytes_moved>, C<bytes_copied>, C<refills>, C<bytes_read>, C<views>
+and C<bytes_viewed>.  The last two count reads that were satisfied by pointing into
+mapped data (see the C<io> option) rather than copying.
+This is useful for checking how much allocation and copying a scan costs.
+
+The counters are kept per thread.  C<scan_many> worker threads count their own, and
+each file's counts are added to the calling thread's when its result is returned.
+
+=head2 reset_buffer_stats()
+
+Resets all C<buffer_stats> counters to 0.
+
 =head2 is_supported( $path )
 
 Returns 1 if the given path can be scanned by Audio::Scan, or 0 if not.
@@ -396,6 +856,19 @@ The following metadata about a file may be returned:
     vbr (1 if file is VBR)
     dlna_profile (if file is compliant)
 
+    With duration_accuracy => 'sampled', if the length was estimated:
+    estimated (1)
+    song_length_ms_error (95% confidence bound, in milliseconds)
+
+    If the file is VBR without a Xing/VBRI header and every frame was read:
+    synthetic_toc (Xing style seek table, 100 positions in units of audio_size / 256,
+                   one for each 1% of the length)
+
+    If the ID3v2 tag has an MLLT (MPEG location lookup table) frame:
+    mllt_frames (frames between references)
+    mllt_bytes  (byte offset of each reference from the first frame, starting with 0)
+    mllt_ms     (time of each reference in milliseconds, starting with 0)
+
     If a Xing header is found:
     xing_frames
     xing_bytes
@@ -476,6 +949,7 @@ The following metadata about a file may be returned:
     audio_size
     compatible_brands
     file_size
+    fragmented (if the audio is in moof fragments, audio_offset is the first moof)
     leading_mdat (if file has mdat before moov)
     major_brand
     minor_version
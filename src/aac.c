@@ -17,7 +17,7 @@
 #include "aac.h"
 
 static int
-get_aacinfo(PerlIO *infile, char *file, HV *info, HV *tags)
+get_aacinfo(ScanIO *infile, char *file, resval *info, resval *tags)
 {
   off_t file_size;
   Buffer buf;
@@ -30,7 +30,7 @@ get_aacinfo(PerlIO *infile, char *file, HV *info, HV *tags)
   
   file_size = _file_size(infile);
   
-  my_hv_store( info, "file_size", newSVuv(file_size) );
+  res_hv_store( info, "file_size", res_newuv(file_size) );
   
   if ( !_check_buf(infile, &buf, 10, AAC_BLOCK_SIZE) ) {
     err = -1;
@@ -59,7 +59,7 @@ get_aacinfo(PerlIO *infile, char *file, HV *info, HV *tags)
     
     // Seek past ID3 and clear buffer
     buffer_clear(&buf);
-    PerlIO_seek(infile, id3_size, SEEK_SET);
+    scanio_seek(infile, id3_size, SEEK_SET);
       
     // Read start of AAC data
     if ( !_check_buf(infile, &buf, 10, AAC_BLOCK_SIZE) ) {
@@ -70,11 +70,21 @@ get_aacinfo(PerlIO *infile, char *file, HV *info, HV *tags)
   
   // Find 0xFF sync
   while ( buffer_len(&buf) >= 6 ) {
+    const unsigned char *sync;
+    
     bptr = buffer_ptr(&buf);
+    sync = syncscan_find(bptr, buffer_len(&buf) - 4, &syncscan_adts);
+    
+    if ( !sync ) {
+      audio_offset += buffer_len(&buf) - 5;
+      buffer_consume(&buf, buffer_len(&buf) - 5);
+      break;
+    }
+    
+    buffer_consume(&buf, sync - bptr);
+    audio_offset += sync - bptr;
     
-    if ( (bptr[0] == 0xFF) && ((bptr[1] & 0xF6) == 0xF0)
-      && aac_parse_adts(infile, file, file_size - audio_offset, &buf, info))
-    {
+    if ( aac_parse_adts(infile, file, file_size - audio_offset, &buf, info) ) {
       break;
     }
     else {    
@@ -90,8 +100,8 @@ get_aacinfo(PerlIO *infile, char *file, HV *info, HV *tags)
   }
 */
   
-  my_hv_store( info, "audio_offset", newSVuv(audio_offset) );
-  my_hv_store( info, "audio_size", newSVuv(file_size - audio_offset) );
+  res_hv_store( info, "audio_offset", res_newuv(audio_offset) );
+  res_hv_store( info, "audio_size", res_newuv(file_size - audio_offset) );
   
   // Parse ID3 at end
   if (id3_size) {
@@ -109,7 +119,7 @@ out:
 // ADTS parser adapted from faad
 
 int
-aac_parse_adts(PerlIO *infile, char *file, off_t audio_size, Buffer *buf, HV *info)
+aac_parse_adts(ScanIO *infile, char *file, off_t audio_size, Buffer *buf, resval *info)
 {
   int frames, frame_length;
   int t_framelength = 0;
@@ -211,28 +221,28 @@ aac_parse_adts(PerlIO *infile, char *file, off_t audio_size, Buffer *buf, HV *in
       if (channels <= 2) {
         if (bitrate <= 192) {
           if (samplerate <= 24000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAAC_L2_ADTS_320", 0) ); // XXX shouldn't really use samplerate for AAC vs AACplus
+            res_hv_store( info, "dlna_profile", res_newpv("HEAAC_L2_ADTS_320", 0) ); // XXX shouldn't really use samplerate for AAC vs AACplus
           else
-            my_hv_store( info, "dlna_profile", newSVpv("AAC_ADTS_192", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("AAC_ADTS_192", 0) );
         }
         else if (bitrate <= 320) {
           if (samplerate <= 24000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAAC_L2_ADTS_320", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAAC_L2_ADTS_320", 0) );
           else
-            my_hv_store( info, "dlna_profile", newSVpv("AAC_ADTS_320", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("AAC_ADTS_320", 0) );
         }
         else {
           if (samplerate <= 24000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAAC_L2_ADTS", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAAC_L2_ADTS", 0) );
           else
-            my_hv_store( info, "dlna_profile", newSVpv("AAC_ADTS", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("AAC_ADTS", 0) );
         }
       }
       else if (channels <= 6) {
         if (samplerate <= 24000)
-          my_hv_store( info, "dlna_profile", newSVpv("HEAAC_MULT5_ADTS", 0) );
+          res_hv_store( info, "dlna_profile", res_newpv("HEAAC_MULT5_ADTS", 0) );
         else
-          my_hv_store( info, "dlna_profile", newSVpv("AAC_MULT5_ADTS", 0) );
+          res_hv_store( info, "dlna_profile", res_newpv("AAC_MULT5_ADTS", 0) );
       }
     }
   }
@@ -241,11 +251,11 @@ aac_parse_adts(PerlIO *infile, char *file, off_t audio_size, Buffer *buf, HV *in
   if (samplerate <= 24000)
     samplerate *= 2;
   
-  my_hv_store( info, "bitrate", newSVuv(bitrate * 1000) );
-  my_hv_store( info, "song_length_ms", newSVuv(length * 1000) );
-  my_hv_store( info, "samplerate", newSVuv(samplerate) );
-  my_hv_store( info, "profile", newSVpv( aac_profiles[profile], 0 ) );
-  my_hv_store( info, "channels", newSVuv(channels) );
+  res_hv_store( info, "bitrate", res_newuv(bitrate * 1000) );
+  res_hv_store( info, "song_length_ms", res_newuv(length * 1000) );
+  res_hv_store( info, "samplerate", res_newuv(samplerate) );
+  res_hv_store( info, "profile", res_newpv( aac_profiles[profile], 0 ) );
+  res_hv_store( info, "channels", res_newuv(channels) );
 
   return 1;
 }
@@ -80,11 +80,11 @@ int _ape_get_tag_info(ApeTag* tag) {
       char id3[APE_ID3_MIN_TAG_SIZE];
 
       /* Check for id3 tag. We need to seek past it if it exists. */
-      if ((PerlIO_seek(tag->fd, file_size - APE_ID3_MIN_TAG_SIZE, SEEK_SET)) == -1) {
+      if ((scanio_seek(tag->fd, file_size - APE_ID3_MIN_TAG_SIZE, SEEK_SET)) == -1) {
         return _ape_error(tag, "Couldn't seek (id3 offset)", -1);
       }
 
-      if (PerlIO_read(tag->fd, &id3, APE_ID3_MIN_TAG_SIZE) < APE_ID3_MIN_TAG_SIZE) {
+      if (scanio_read(tag->fd, &id3, APE_ID3_MIN_TAG_SIZE) < APE_ID3_MIN_TAG_SIZE) {
         return _ape_error(tag, "Couldn't read (id3 offset)", -2);
       }
 
@@ -105,7 +105,7 @@ int _ape_get_tag_info(ApeTag* tag) {
   }
   
   /* Check for existance of ape tag footer */
-  if (PerlIO_seek(tag->fd, file_size - APE_TAG_FOOTER_LEN - id3_length, SEEK_SET) == -1) {
+  if (scanio_seek(tag->fd, file_size - APE_TAG_FOOTER_LEN - id3_length, SEEK_SET) == -1) {
     return _ape_error(tag, "Couldn't seek (tag footer)", -1);
   }
 
@@ -133,7 +133,7 @@ int _ape_get_tag_info(ApeTag* tag) {
       bptr -= 6;
       lyrics_size = atoi(bptr);
       
-      if ( (PerlIO_seek(tag->fd, file_size - (160 + lyrics_size + 15), SEEK_SET)) == -1 ) {
+      if ( (scanio_seek(tag->fd, file_size - (160 + lyrics_size + 15), SEEK_SET)) == -1 ) {
         return _ape_error(tag, "Couldn't seek (tag footer)", -1);
       }
       
@@ -166,7 +166,7 @@ int _ape_get_tag_info(ApeTag* tag) {
   
   DEBUG_TRACE("Found APEv%d tag, size %d with %d items\n", tag->version, tag->size, tag->item_count);
   
-  my_hv_store( tag->info, "ape_version", newSVpvf( "APEv%d", tag->version ) );
+  res_hv_store( tag->info, "ape_version", res_newpvf( "APEv%d", tag->version ) );
 
   /* Check tag footer for validity */
   if (tag->size < APE_MINIMUM_TAG_SIZE) {
@@ -189,7 +189,7 @@ int _ape_get_tag_info(ApeTag* tag) {
     return _ape_error(tag, "Tag item count larger than possible", -3);
   }
 
-  if (PerlIO_seek(tag->fd, (file_size -(long)tag->size - id3_length - (lyrics_size ? (lyrics_size + 15) : 0)), SEEK_SET) == -1) {
+  if (scanio_seek(tag->fd, (file_size -(long)tag->size - id3_length - (lyrics_size ? (lyrics_size + 15) : 0)), SEEK_SET) == -1) {
     return _ape_error(tag, "Couldn't seek to tag offset", -1);
   }
   
@@ -225,7 +225,7 @@ int _ape_get_tag_info(ApeTag* tag) {
   }
   else {
     // Skip junk where header should be, APE format is really stupid...
-    if (PerlIO_seek(tag->fd, APE_TAG_HEADER_LEN, SEEK_CUR) == -1) {
+    if (scanio_seek(tag->fd, APE_TAG_HEADER_LEN, SEEK_CUR) == -1) {
       return _ape_error(tag, "Couldn't seek to tag offset", -1);
     }
   }
@@ -239,12 +239,12 @@ int _ape_get_tag_info(ApeTag* tag) {
   tag->flags |= APE_CHECKED_APE | APE_HAS_APE;
   
   // Reduce the size of the audio_size value
-  if (my_hv_exists(tag->info, "audio_size")) {
-    int audio_size = SvIV(*(my_hv_fetch(tag->info, "audio_size")));
+  if (res_hv_exists(tag->info, "audio_size")) {
+    int audio_size = res_iv(*(res_hv_fetch(tag->info, "audio_size")));
     if (lyrics_size > 0)
       lyrics_size += 15;
     
-    my_hv_store(tag->info, "audio_size", newSVuv(audio_size - tag->size - lyrics_size));
+    res_hv_store(tag->info, "audio_size", res_newuv(audio_size - tag->size - lyrics_size));
     DEBUG_TRACE("Reduced audio_size value by APE/Lyrics2 tag size %d\n", tag->size + lyrics_size);
   }
 
@@ -287,8 +287,8 @@ int _ape_parse_field(ApeTag* tag) {
   uint32_t data_size = tag->size - APE_MINIMUM_TAG_SIZE;
   uint32_t size, flags, key_length = 0, val_length = 0;
   unsigned char *tmp_ptr;
-  SV *key = NULL;
-  SV *value = NULL;
+  resval *key = NULL;
+  resval *value = NULL;
   
   if (buffer_len(&tag->tag_data) < 8)
     return _ape_error(tag, "Ran out of tag data before number of items was reached", -3);
@@ -302,7 +302,7 @@ int _ape_parse_field(ApeTag* tag) {
     tmp_ptr    += 1;
   }
 
-  key = newSVpvn( buffer_ptr(&tag->tag_data), key_length );
+  key = res_newpvn( buffer_ptr(&tag->tag_data), key_length );
   buffer_consume(&tag->tag_data, key_length + 1);
   
   // Bug 9942, APE tags can contain multiple items with a null separator
@@ -321,12 +321,12 @@ int _ape_parse_field(ApeTag* tag) {
     
     // Special handling if the tag is cover art, strip the filename from the front of
     // the cover art data
-    if ( sv_len(key) == 17 && !memcmp( upcase(SvPVX(key)), "COVER ART (FRONT)", 17 ) ) {
+    if ( res_len(key) == 17 && !memcmp( upcase(res_pv(key)), "COVER ART (FRONT)", 17 ) ) {
       if ( _env_true("AUDIO_SCAN_NO_ARTWORK") ) {
         // Don't read artwork, just return the size
-        value = newSVuv(size - (val_length + 1) );
+        value = res_newart( tag->offset + val_length + 1, size - (val_length + 1) );
         
-        my_hv_store( tag->tags, "COVER ART (FRONT)_offset", newSVuv(tag->offset + val_length + 1) );
+        res_hv_store( tag->tags, "COVER ART (FRONT)_offset", res_newuv(tag->offset + val_length + 1) );
         
         buffer_consume(&tag->tag_data, size);
       }
@@ -337,7 +337,7 @@ int _ape_parse_field(ApeTag* tag) {
     }
     
     if ( value == NULL ) {
-      value = newSVpvn( buffer_ptr(&tag->tag_data), size );
+      value = res_newblob( buffer_ptr(&tag->tag_data), size );
       buffer_consume(&tag->tag_data, size);
     }
     
@@ -345,26 +345,26 @@ int _ape_parse_field(ApeTag* tag) {
   }
   else if (val_length >= size - 1) {
     // Single item
-    value = newSVpvn( buffer_ptr(&tag->tag_data), val_length < size ? val_length : size );
+    value = res_newpvn( buffer_ptr(&tag->tag_data), val_length < size ? val_length : size );
     
     buffer_consume(&tag->tag_data, size);
     
     // Don't add invalid items
-    if (_ape_check_validity(tag, flags, SvPVX(key), SvPVX(value)) != 0) {
+    if (_ape_check_validity(tag, flags, res_pv(key), res_pv(value)) != 0) {
       // skip this item
       return 0;
     }
     else {
-      sv_utf8_decode(value);
-      DEBUG_TRACE("  %s = %s\n", SvPVX(key), SvPVX(value));
+      res_utf8_decode(value);
+      DEBUG_TRACE("  %s = %s\n", res_pv(key), res_pv(value));
     }
     
     tag->offset += val_length < size ? val_length : size;
   }
   else {
     // Multiple items
-    AV *av = newAV();
-    SV *tmp_val;
+    resval *av = res_newav();
+    resval *tmp_val;
     uint32_t done = 0;
     
     while ( done < size ) {
@@ -376,24 +376,24 @@ int _ape_parse_field(ApeTag* tag) {
         done++;
       }
       
-      tmp_val = newSVpvn( buffer_ptr(&tag->tag_data), val_length );
+      tmp_val = res_newpvn( buffer_ptr(&tag->tag_data), val_length );
       buffer_consume(&tag->tag_data, val_length);
       
       tag->offset += val_length;
     
       // Don't add invalid items
-      if (_ape_check_validity(tag, flags, SvPVX(key), SvPVX(tmp_val)) != 0) {
+      if (_ape_check_validity(tag, flags, res_pv(key), res_pv(tmp_val)) != 0) {
         // skip this item
         buffer_consume(&tag->tag_data, size - done);
         return 0;
       }
       else {
-        sv_utf8_decode(tmp_val);
+        res_utf8_decode(tmp_val);
       }
       
-      DEBUG_TRACE("  %s = %s\n", SvPVX(key), SvPVX(tmp_val));
+      DEBUG_TRACE("  %s = %s\n", res_pv(key), res_pv(tmp_val));
     
-      av_push(av, tmp_val);
+      res_av_push(av, tmp_val);
       
       if ( done < size ) {
         // Still more to read, consume the null separator
@@ -403,7 +403,7 @@ int _ape_parse_field(ApeTag* tag) {
       }
     }
     
-    value = newRV_noinc( (SV *)av );
+    value = av;
   }
 
   /* Find and check start of value */
@@ -411,9 +411,8 @@ int _ape_parse_field(ApeTag* tag) {
     return _ape_error(tag, "Impossible item length (greater than remaining space)", -3);
   }
   
-  my_hv_store(tag->tags, upcase(SvPVX(key)), value);
+  res_hv_store(tag->tags, upcase(res_pv(key)), value);
   
-  SvREFCNT_dec(key);
 
   tag->num_fields++;
 
@@ -481,7 +480,7 @@ int _ape_check_validity(ApeTag* tag, uint32_t flags, char* key, char* value) {
 }
 
 static int
-get_ape_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
+get_ape_metadata(ScanIO *infile, char *file, resval *info, resval *tags)
 {
   int status = -1;
   ApeTag* tag;
@@ -489,7 +488,7 @@ get_ape_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
   Newz(0, tag, sizeof(ApeTag), ApeTag);
 
   if (tag == NULL) {
-    PerlIO_printf(PerlIO_stderr(), "APE: [Couldn't allocate memory (ApeTag)] %s\n", file);
+    LOG_ERROR("APE: [Couldn't allocate memory (ApeTag)] %s\n", file);
     return status;
   }
 
@@ -44,7 +44,7 @@
 static void
 print_guid(GUID guid)
 {
-  PerlIO_printf(PerlIO_stderr(),
+  LOG_ERROR(
     "%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x ",
     guid.Data1, guid.Data2, guid.Data3,
     guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
@@ -53,7 +53,7 @@ print_guid(GUID guid)
 }
 
 int
-get_asf_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
+get_asf_metadata(ScanIO *infile, char *file, resval *info, resval *tags)
 {
   asfinfo *asf = _asf_parse(infile, file, info, tags, 0);
 
@@ -63,7 +63,7 @@ get_asf_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
 }
 
 asfinfo *
-_asf_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
+_asf_parse(ScanIO *infile, char *file, resval *info, resval *tags, uint8_t seeking)
 {
   ASF_Object hdr;
   ASF_Object data;
@@ -92,12 +92,12 @@ _asf_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
   buffer_get_guid(asf->buf, &hdr.ID);
 
   if ( !IsEqualGUID(&hdr.ID, &ASF_Header_Object) ) {
-    PerlIO_printf(PerlIO_stderr(), "Invalid ASF header: %s\n", file);
-    PerlIO_printf(PerlIO_stderr(), "  Expecting: ");
+    LOG_ERROR("Invalid ASF header: %s\n", file);
+    LOG_ERROR("  Expecting: ");
       print_guid(ASF_Header_Object);
-    PerlIO_printf(PerlIO_stderr(), "\n        Got: ");
+    LOG_ERROR("\n        Got: ");
       print_guid(hdr.ID);
-    PerlIO_printf(PerlIO_stderr(), "\n");
+    LOG_ERROR("\n");
     goto out;
   }
 
@@ -107,7 +107,7 @@ _asf_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
   hdr.reserved2   = buffer_get_char(asf->buf);
 
   if ( hdr.reserved2 != 0x02 ) {
-    PerlIO_printf(PerlIO_stderr(), "Invalid ASF header: %s\n", file);
+    LOG_ERROR("Invalid ASF header: %s\n", file);
     goto out;
   }
 
@@ -172,7 +172,7 @@ _asf_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
     else if ( IsEqualGUID(&tmp.ID, &ASF_Header_Extension) ) {
       DEBUG_TRACE("Header_Extension\n");
       if ( !_parse_header_extension(asf, tmp.size) ) {
-        PerlIO_printf(PerlIO_stderr(), "Invalid ASF file: %s (invalid header extension object)\n", file);
+        LOG_ERROR("Invalid ASF file: %s (invalid header extension object)\n", file);
         goto out;
       }
     }
@@ -182,9 +182,9 @@ _asf_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
     }
     else {
       // Unhandled GUID
-      PerlIO_printf(PerlIO_stderr(), "** Unhandled GUID: ");
+      LOG_ERROR("** Unhandled GUID: ");
       print_guid(tmp.ID);
-      PerlIO_printf(PerlIO_stderr(), "size: %llu\n", tmp.size);
+      LOG_ERROR("size: %llu\n", tmp.size);
 
       buffer_consume(asf->buf, tmp.size - 24);
     }
@@ -201,15 +201,15 @@ _asf_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
   buffer_get_guid(asf->buf, &data.ID);
 
   if ( !IsEqualGUID(&data.ID, &ASF_Data) ) {
-    PerlIO_printf(PerlIO_stderr(), "Invalid ASF file: %s (no Data object after Header)\n", file);
+    LOG_ERROR("Invalid ASF file: %s (no Data object after Header)\n", file);
     goto out;
   }
 
   // Store offset to beginning of data (50 goes past the top-level data packet)
   asf->audio_offset = hdr.size + 50;
-  my_hv_store( info, "audio_offset", newSVuv(asf->audio_offset) );
+  res_hv_store( info, "audio_offset", res_newuv(asf->audio_offset) );
 
-  my_hv_store( info, "file_size", newSVuv(asf->file_size) );
+  res_hv_store( info, "file_size", res_newuv(asf->file_size) );
 
   data.size = buffer_get_int64_le(asf->buf);
   asf->audio_size = data.size;
@@ -219,21 +219,21 @@ _asf_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
     asf->audio_size = asf->file_size - asf->audio_offset;
     DEBUG_TRACE("audio_size too large, fixed to %lld\n", asf->audio_size);
   }
-  my_hv_store( info, "audio_size", newSVuv(asf->audio_size) );
+  res_hv_store( info, "audio_size", res_newuv(asf->audio_size) );
 
   if (seeking) {
     if ( hdr.size + data.size < asf->file_size ) {
       DEBUG_TRACE("Seeking past data: %llu\n", hdr.size + data.size);
 
-      if ( PerlIO_seek(infile, hdr.size + data.size, SEEK_SET) != 0 ) {
-        PerlIO_printf(PerlIO_stderr(), "Invalid ASF file: %s (Invalid Data object size)\n", file);
+      if ( scanio_seek(infile, hdr.size + data.size, SEEK_SET) != 0 ) {
+        LOG_ERROR("Invalid ASF file: %s (Invalid Data object size)\n", file);
         goto out;
       }
 
       buffer_clear(asf->buf);
 
       if ( !_parse_index_objects(asf, asf->file_size - hdr.size - data.size) ) {
-        PerlIO_printf(PerlIO_stderr(), "Invalid ASF file: %s (Invalid Index object)\n", file);
+        LOG_ERROR("Invalid ASF file: %s (Invalid Index object)\n", file);
         goto out;
       }
     }
@@ -270,17 +270,17 @@ _parse_content_description(asfinfo *asf)
   buffer_init_or_clear(asf->scratch, len[0]);
 
   for (i = 0; i < 5; i++) {
-    SV *value;
+    resval *value;
 
     if ( len[i] ) {
       buffer_clear(asf->scratch);
       buffer_get_utf16_as_utf8(asf->buf, asf->scratch, len[i], UTF16_BYTEORDER_LE);
-      value = newSVpv( buffer_ptr(asf->scratch), 0 );
-      sv_utf8_decode(value);
+      value = res_newpv( buffer_ptr(asf->scratch), 0 );
+      res_utf8_decode(value);
 
-      DEBUG_TRACE("  %s / %s\n", fields[i], SvPVX(value));
+      DEBUG_TRACE("  %s / %s\n", fields[i], res_pv(value));
 
-      _store_tag( asf->tags, newSVpv(fields[i], 0), value );
+      _store_tag( asf->tags, res_newpv(fields[i], 0), value );
     }
   }
 }
@@ -297,15 +297,15 @@ _parse_extended_content_description(asfinfo *asf)
     uint16_t name_len;
     uint16_t data_type;
     uint16_t value_len;
-    SV *key = NULL;
-    SV *value = NULL;
+    resval *key = NULL;
+    resval *value = NULL;
 
     name_len = buffer_get_short_le(asf->buf);
 
     buffer_clear(asf->scratch);
     buffer_get_utf16_as_utf8(asf->buf, asf->scratch, name_len, UTF16_BYTEORDER_LE);
-    key = newSVpv( buffer_ptr(asf->scratch), 0 );
-    sv_utf8_decode(key);
+    key = res_newpv( buffer_ptr(asf->scratch), 0 );
+    res_utf8_decode(key);
 
     data_type = buffer_get_short_le(asf->buf);
     value_len = buffer_get_short_le(asf->buf);
@@ -315,33 +315,33 @@ _parse_extended_content_description(asfinfo *asf)
     if (data_type == TYPE_UNICODE) {
       buffer_clear(asf->scratch);
       buffer_get_utf16_as_utf8(asf->buf, asf->scratch, value_len, UTF16_BYTEORDER_LE);
-      value = newSVpv( buffer_ptr(asf->scratch), 0 );
-      sv_utf8_decode(value);
+      value = res_newpv( buffer_ptr(asf->scratch), 0 );
+      res_utf8_decode(value);
     }
     else if (data_type == TYPE_BYTE) {
       // handle picture data, interestingly it is compatible with the ID3v2 APIC frame
-      if ( !strcmp( SvPVX(key), "WM/Picture" ) ) {
+      if ( !strcmp( res_pv(key), "WM/Picture" ) ) {
         value = _parse_picture(asf, picture_offset);
       }
       else {
-        value = newSVpvn( buffer_ptr(asf->buf), value_len );
+        value = res_newpvn( buffer_ptr(asf->buf), value_len );
         buffer_consume(asf->buf, value_len);
       }
     }
     else if (data_type == TYPE_BOOL) {
-      value = newSViv( buffer_get_int_le(asf->buf) );
+      value = res_newiv( buffer_get_int_le(asf->buf) );
     }
     else if (data_type == TYPE_DWORD) {
-      value = newSViv( buffer_get_int_le(asf->buf) );
+      value = res_newiv( buffer_get_int_le(asf->buf) );
     }
     else if (data_type == TYPE_QWORD) {
-      value = newSViv( buffer_get_int64_le(asf->buf) );
+      value = res_newiv( buffer_get_int64_le(asf->buf) );
     }
     else if (data_type == TYPE_WORD) {
-      value = newSViv( buffer_get_short_le(asf->buf) );
+      value = res_newiv( buffer_get_short_le(asf->buf) );
     }
     else {
-      PerlIO_printf(PerlIO_stderr(), "Unknown extended content description data type %d\n", data_type);
+      LOG_ERROR("Unknown extended content description data type %d\n", data_type);
       buffer_consume(asf->buf, value_len);
     }
 
@@ -350,13 +350,13 @@ _parse_extended_content_description(asfinfo *asf)
     if (value != NULL) {
 #ifdef AUDIO_SCAN_DEBUG
       if ( data_type == 0 ) {
-        DEBUG_TRACE("  %s / type %d / %s\n", SvPVX(key), data_type, SvPVX(value));
+        DEBUG_TRACE("  %s / type %d / %s\n", res_pv(key), data_type, res_pv(value));
       }
       else if ( data_type > 1 ) {
-        DEBUG_TRACE("  %s / type %d / %d\n", SvPVX(key), data_type, (int)SvIV(value));
+        DEBUG_TRACE("  %s / type %d / %d\n", res_pv(key), data_type, (int)res_iv(value));
       }
       else {
-        DEBUG_TRACE("  %s / type %d / <binary>\n", SvPVX(key), data_type);
+        DEBUG_TRACE("  %s / type %d / <binary>\n", res_pv(key), data_type);
       }
 #endif
 
@@ -383,8 +383,8 @@ _parse_file_properties(asfinfo *asf)
   uint8_t seekable;
 
   buffer_get_guid(asf->buf, &file_id);
-  my_hv_store(
-    asf->info, "file_id", newSVpvf( "%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+  res_hv_store(
+    asf->info, "file_id", res_newpvf( "%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
       file_id.Data1, file_id.Data2, file_id.Data3,
       file_id.Data4[0], file_id.Data4[1], file_id.Data4[2], file_id.Data4[3],
       file_id.Data4[4], file_id.Data4[5], file_id.Data4[6], file_id.Data4[7]
@@ -411,23 +411,23 @@ _parse_file_properties(asfinfo *asf)
     send_duration /= 10000;
 
     // Don't overwrite the actual file size we found from stat
-    //my_hv_store( info, "file_size", newSViv(file_size) );
+    //res_hv_store( info, "file_size", res_newiv(file_size) );
 
-    my_hv_store( asf->info, "creation_date", newSViv(creation_date) );
-    my_hv_store( asf->info, "data_packets", newSViv(data_packets) );
-    my_hv_store( asf->info, "play_duration_ms", newSViv(play_duration) );
-    my_hv_store( asf->info, "send_duration_ms", newSViv(send_duration) );
+    res_hv_store( asf->info, "creation_date", res_newiv(creation_date) );
+    res_hv_store( asf->info, "data_packets", res_newiv(data_packets) );
+    res_hv_store( asf->info, "play_duration_ms", res_newiv(play_duration) );
+    res_hv_store( asf->info, "send_duration_ms", res_newiv(send_duration) );
 
     // Calculate actual song duration
-    my_hv_store( asf->info, "song_length_ms", newSViv( play_duration - preroll ) );
+    res_hv_store( asf->info, "song_length_ms", res_newiv( play_duration - preroll ) );
   }
 
-  my_hv_store( asf->info, "preroll", newSViv(preroll) );
-  my_hv_store( asf->info, "broadcast", newSViv(broadcast) );
-  my_hv_store( asf->info, "seekable", newSViv(seekable) );
-  my_hv_store( asf->info, "min_packet_size", newSViv(min_packet_size) );
-  my_hv_store( asf->info, "max_packet_size", newSViv(max_packet_size) );
-  my_hv_store( asf->info, "max_bitrate", newSViv(max_bitrate) );
+  res_hv_store( asf->info, "preroll", res_newiv(preroll) );
+  res_hv_store( asf->info, "broadcast", res_newiv(broadcast) );
+  res_hv_store( asf->info, "seekable", res_newiv(seekable) );
+  res_hv_store( asf->info, "min_packet_size", res_newiv(min_packet_size) );
+  res_hv_store( asf->info, "max_packet_size", res_newiv(max_packet_size) );
+  res_hv_store( asf->info, "max_bitrate", res_newiv(max_bitrate) );
 
   // DLNA, need to store max_bitrate for later
   asf->max_bitrate = max_bitrate;
@@ -469,7 +469,7 @@ _parse_stream_properties(asfinfo *asf)
     uint16_t codec_id, channels;
     uint32_t samplerate;
 
-    _store_stream_info( stream_number, asf->info, newSVpv("stream_type", 0), newSVpv("ASF_Audio_Media", 0) );
+    _store_stream_info( stream_number, asf->info, res_newpv("stream_type", 0), res_newpv("ASF_Audio_Media", 0) );
 
     // Parse WAVEFORMATEX data
     codec_id = buffer_get_short_le(&type_data_buf);
@@ -494,13 +494,13 @@ _parse_stream_properties(asfinfo *asf)
         break;
     }
 
-    _store_stream_info( stream_number, asf->info, newSVpv("codec_id", 0), newSViv(codec_id) );
+    _store_stream_info( stream_number, asf->info, res_newpv("codec_id", 0), res_newiv(codec_id) );
 
     channels = buffer_get_short_le(&type_data_buf);
-    _store_stream_info( stream_number, asf->info, newSVpv("channels", 0), newSViv(channels) );
+    _store_stream_info( stream_number, asf->info, res_newpv("channels", 0), res_newiv(channels) );
 
     samplerate = buffer_get_int_le(&type_data_buf);
-    _store_stream_info( stream_number, asf->info, newSVpv("samplerate", 0), newSViv(samplerate) );
+    _store_stream_info( stream_number, asf->info, res_newpv("samplerate", 0), res_newiv(samplerate) );
 
     // Determine DLNA profile
     if (channels > 2) {
@@ -539,81 +539,81 @@ _parse_stream_properties(asfinfo *asf)
     }
 
     if (asf->valid_profiles & IS_VALID_WMA_BASE)
-      my_hv_store( asf->info, "dlna_profile", newSVpvn("WMABASE", 7) );
+      res_hv_store( asf->info, "dlna_profile", res_newpvn("WMABASE", 7) );
     else if (asf->valid_profiles & IS_VALID_WMA_FULL)
-      my_hv_store( asf->info, "dlna_profile", newSVpvn("WMAFULL", 7) );
+      res_hv_store( asf->info, "dlna_profile", res_newpvn("WMAFULL", 7) );
     else if (asf->valid_profiles & IS_VALID_WMA_PRO)
-      my_hv_store( asf->info, "dlna_profile", newSVpvn("WMAPRO", 6) );
+      res_hv_store( asf->info, "dlna_profile", res_newpvn("WMAPRO", 6) );
     else if (asf->valid_profiles & IS_VALID_WMA_LSL)
-      my_hv_store( asf->info, "dlna_profile", newSVpvn("WMALSL", 6) );
+      res_hv_store( asf->info, "dlna_profile", res_newpvn("WMALSL", 6) );
     else if (asf->valid_profiles & IS_VALID_WMA_LSL_MULT5)
-      my_hv_store( asf->info, "dlna_profile", newSVpvn("WMALSL_MULT5", 12) );
+      res_hv_store( asf->info, "dlna_profile", res_newpvn("WMALSL_MULT5", 12) );
 
-    _store_stream_info( stream_number, asf->info, newSVpv("avg_bytes_per_sec", 0), newSViv( buffer_get_int_le(&type_data_buf) ) );
-    _store_stream_info( stream_number, asf->info, newSVpv("block_alignment", 0), newSViv( buffer_get_short_le(&type_data_buf) ) );
-    _store_stream_info( stream_number, asf->info, newSVpv("bits_per_sample", 0), newSViv( buffer_get_short_le(&type_data_buf) ) );
+    _store_stream_info( stream_number, asf->info, res_newpv("avg_bytes_per_sec", 0), res_newiv( buffer_get_int_le(&type_data_buf) ) );
+    _store_stream_info( stream_number, asf->info, res_newpv("block_alignment", 0), res_newiv( buffer_get_short_le(&type_data_buf) ) );
+    _store_stream_info( stream_number, asf->info, res_newpv("bits_per_sample", 0), res_newiv( buffer_get_short_le(&type_data_buf) ) );
 
     // Read WMA-specific data
     if (is_wma) {
       buffer_consume(&type_data_buf, 2);
-      _store_stream_info( stream_number, asf->info, newSVpv("samples_per_block", 0), newSViv( buffer_get_int_le(&type_data_buf) ) );
-      _store_stream_info( stream_number, asf->info, newSVpv("encode_options", 0), newSViv( buffer_get_short_le(&type_data_buf) ) );
-      _store_stream_info( stream_number, asf->info, newSVpv("super_block_align", 0), newSViv( buffer_get_int_le(&type_data_buf) ) );
+      _store_stream_info( stream_number, asf->info, res_newpv("samples_per_block", 0), res_newiv( buffer_get_int_le(&type_data_buf) ) );
+      _store_stream_info( stream_number, asf->info, res_newpv("encode_options", 0), res_newiv( buffer_get_short_le(&type_data_buf) ) );
+      _store_stream_info( stream_number, asf->info, res_newpv("super_block_align", 0), res_newiv( buffer_get_int_le(&type_data_buf) ) );
     }
   }
   else if ( IsEqualGUID(&stream_type, &ASF_Video_Media) ) {
-    _store_stream_info( stream_number, asf->info, newSVpv("stream_type", 0), newSVpv("ASF_Video_Media", 0) );
+    _store_stream_info( stream_number, asf->info, res_newpv("stream_type", 0), res_newpv("ASF_Video_Media", 0) );
 
     DEBUG_TRACE("type_data_len: %d\n", type_data_len);
 
     // Read video-specific data
-    _store_stream_info( stream_number, asf->info, newSVpv("width", 0), newSVuv( buffer_get_int_le(&type_data_buf) ) );
-    _store_stream_info( stream_number, asf->info, newSVpv("height", 0), newSVuv( buffer_get_int_le(&type_data_buf) ) );
+    _store_stream_info( stream_number, asf->info, res_newpv("width", 0), res_newuv( buffer_get_int_le(&type_data_buf) ) );
+    _store_stream_info( stream_number, asf->info, res_newpv("height", 0), res_newuv( buffer_get_int_le(&type_data_buf) ) );
 
     // Skip format size, width, height, reserved
     buffer_consume(&type_data_buf, 17);
 
-    _store_stream_info( stream_number, asf->info, newSVpv("bpp", 0), newSVuv( buffer_get_short_le(&type_data_buf) ) );
+    _store_stream_info( stream_number, asf->info, res_newpv("bpp", 0), res_newuv( buffer_get_short_le(&type_data_buf) ) );
 
-    _store_stream_info( stream_number, asf->info, newSVpv("compression_id", 0), newSVpv( buffer_ptr(&type_data_buf), 4 ) );
+    _store_stream_info( stream_number, asf->info, res_newpv("compression_id", 0), res_newpv( buffer_ptr(&type_data_buf), 4 ) );
 
     // Rest of the data does not seem to apply to video
   }
   else if ( IsEqualGUID(&stream_type, &ASF_Command_Media) ) {
-    _store_stream_info( stream_number, asf->info, newSVpv("stream_type", 0), newSVpv("ASF_Command_Media", 0) );
+    _store_stream_info( stream_number, asf->info, res_newpv("stream_type", 0), res_newpv("ASF_Command_Media", 0) );
   }
   else if ( IsEqualGUID(&stream_type, &ASF_JFIF_Media) ) {
-    _store_stream_info( stream_number, asf->info, newSVpv("stream_type", 0), newSVpv("ASF_JFIF_Media", 0) );
+    _store_stream_info( stream_number, asf->info, res_newpv("stream_type", 0), res_newpv("ASF_JFIF_Media", 0) );
 
     // type-specific data
-    _store_stream_info( stream_number, asf->info, newSVpv("width", 0), newSVuv( buffer_get_int_le(&type_data_buf) ) );
-    _store_stream_info( stream_number, asf->info, newSVpv("height", 0), newSVuv( buffer_get_int_le(&type_data_buf) ) );
+    _store_stream_info( stream_number, asf->info, res_newpv("width", 0), res_newuv( buffer_get_int_le(&type_data_buf) ) );
+    _store_stream_info( stream_number, asf->info, res_newpv("height", 0), res_newuv( buffer_get_int_le(&type_data_buf) ) );
   }
   else if ( IsEqualGUID(&stream_type, &ASF_Degradable_JPEG_Media) ) {
-    _store_stream_info( stream_number, asf->info, newSVpv("stream_type", 0), newSVpv("ASF_Degradable_JPEG_Media", 0) );
+    _store_stream_info( stream_number, asf->info, res_newpv("stream_type", 0), res_newpv("ASF_Degradable_JPEG_Media", 0) );
 
     // XXX: type-specific data (section 9.4.2)
   }
   else if ( IsEqualGUID(&stream_type, &ASF_File_Transfer_Media) ) {
-    _store_stream_info( stream_number, asf->info, newSVpv("stream_type", 0), newSVpv("ASF_File_Transfer_Media", 0) );
+    _store_stream_info( stream_number, asf->info, res_newpv("stream_type", 0), res_newpv("ASF_File_Transfer_Media", 0) );
 
     // XXX: type-specific data (section 9.5)
   }
   else if ( IsEqualGUID(&stream_type, &ASF_Binary_Media) ) {
-    _store_stream_info( stream_number, asf->info, newSVpv("stream_type", 0), newSVpv("ASF_Binary_Media", 0) );
+    _store_stream_info( stream_number, asf->info, res_newpv("stream_type", 0), res_newpv("ASF_Binary_Media", 0) );
 
     // XXX: type-specific data (section 9.5)
   }
 
   if ( IsEqualGUID(&ec_type, &ASF_No_Error_Correction) ) {
-    _store_stream_info( stream_number, asf->info, newSVpv("error_correction_type", 0), newSVpv("ASF_No_Error_Correction", 0) );
+    _store_stream_info( stream_number, asf->info, res_newpv("error_correction_type", 0), res_newpv("ASF_No_Error_Correction", 0) );
   }
   else if ( IsEqualGUID(&ec_type, &ASF_Audio_Spread) ) {
-    _store_stream_info( stream_number, asf->info, newSVpv("error_correction_type", 0), newSVpv("ASF_Audio_Spread", 0) );
+    _store_stream_info( stream_number, asf->info, res_newpv("error_correction_type", 0), res_newpv("ASF_Audio_Spread", 0) );
   }
 
-  _store_stream_info( stream_number, asf->info, newSVpv("time_offset", 0), newSViv(time_offset) );
-  _store_stream_info( stream_number, asf->info, newSVpv("encrypted", 0), newSVuv( flags & 0x8000 ? 1 : 0 ) );
+  _store_stream_info( stream_number, asf->info, res_newpv("time_offset", 0), res_newiv(time_offset) );
+  _store_stream_info( stream_number, asf->info, res_newpv("encrypted", 0), res_newuv( flags & 0x8000 ? 1 : 0 ) );
 
   buffer_free(&type_data_buf);
 }
@@ -697,9 +697,9 @@ _parse_header_extension(asfinfo *asf, uint64_t len)
     }
     else {
       // Unhandled
-      PerlIO_printf(PerlIO_stderr(), "  ** Unhandled extended header: ");
+      LOG_ERROR("  ** Unhandled extended header: ");
       print_guid(hdr);
-      PerlIO_printf(PerlIO_stderr(), "size: %llu\n", hdr_size);
+      LOG_ERROR("size: %llu\n", hdr_size);
 
       buffer_consume(asf->buf, hdr_size - 24);
     }
@@ -725,8 +725,8 @@ _parse_metadata(asfinfo *asf)
     uint16_t name_len;
     uint16_t data_type;
     uint32_t data_len;
-    SV *key = NULL;
-    SV *value = NULL;
+    resval *key = NULL;
+    resval *value = NULL;
 
     // Skip reserved
     buffer_consume(asf->buf, 2);
@@ -738,27 +738,27 @@ _parse_metadata(asfinfo *asf)
 
     buffer_clear(asf->scratch);
     buffer_get_utf16_as_utf8(asf->buf, asf->scratch, name_len, UTF16_BYTEORDER_LE);
-    key = newSVpv( buffer_ptr(asf->scratch), 0 );
-    sv_utf8_decode(key);
+    key = res_newpv( buffer_ptr(asf->scratch), 0 );
+    res_utf8_decode(key);
 
     if (data_type == TYPE_UNICODE) {
       buffer_clear(asf->scratch);
       buffer_get_utf16_as_utf8(asf->buf, asf->scratch, data_len, UTF16_BYTEORDER_LE);
-      value = newSVpv( buffer_ptr(asf->scratch), 0 );
-      sv_utf8_decode(value);
+      value = res_newpv( buffer_ptr(asf->scratch), 0 );
+      res_utf8_decode(value);
     }
     else if (data_type == TYPE_BYTE) {
-      value = newSVpvn( buffer_ptr(asf->buf), data_len );
+      value = res_newpvn( buffer_ptr(asf->buf), data_len );
       buffer_consume(asf->buf, data_len);
     }
     else if (data_type == TYPE_BOOL || data_type == TYPE_WORD) {
-      value = newSViv( buffer_get_short_le(asf->buf) );
+      value = res_newiv( buffer_get_short_le(asf->buf) );
     }
     else if (data_type == TYPE_DWORD) {
-      value = newSViv( buffer_get_int_le(asf->buf) );
+      value = res_newiv( buffer_get_int_le(asf->buf) );
     }
     else if (data_type == TYPE_QWORD) {
-      value = newSViv( buffer_get_int64_le(asf->buf) );
+      value = res_newiv( buffer_get_int64_le(asf->buf) );
     }
     else {
       DEBUG_TRACE("Unknown metadata data type %d\n", data_type);
@@ -768,13 +768,13 @@ _parse_metadata(asfinfo *asf)
     if (value != NULL) {
 #ifdef AUDIO_SCAN_DEBUG
       if ( data_type == 0 ) {
-        DEBUG_TRACE("    %s / type %d / stream_number %d / %s\n", SvPVX(key), data_type, stream_number, SvPVX(value));
+        DEBUG_TRACE("    %s / type %d / stream_number %d / %s\n", res_pv(key), data_type, stream_number, res_pv(value));
       }
       else if ( data_type > 1 ) {
-        DEBUG_TRACE("    %s / type %d / stream_number %d / %d\n", SvPVX(key), data_type, stream_number, (int)SvIV(value));
+        DEBUG_TRACE("    %s / type %d / stream_number %d / %d\n", res_pv(key), data_type, stream_number, (int)res_iv(value));
       }
       else {
-        DEBUG_TRACE("    %s / type %d / stream_number %d / <binary>\n", SvPVX(key), stream_number, data_type);
+        DEBUG_TRACE("    %s / type %d / stream_number %d / <binary>\n", res_pv(key), stream_number, data_type);
       }
 #endif
 
@@ -783,8 +783,7 @@ _parse_metadata(asfinfo *asf)
         _store_stream_info( stream_number, asf->info, key, value );
       }
       else {
-        my_hv_store_ent( asf->info, key, value );
-        SvREFCNT_dec(key);
+        res_hv_store_ent( asf->info, key, value );
       }
     }
   }
@@ -812,39 +811,39 @@ _parse_extended_stream_properties(asfinfo *asf, uint64_t len)
   len -= 88;
 
   if (start_time > 0) {
-    _store_stream_info( stream_number, asf->info, newSVpv("start_time", 0), newSViv(start_time) );
+    _store_stream_info( stream_number, asf->info, res_newpv("start_time", 0), res_newiv(start_time) );
   }
 
   if (end_time > 0) {
-    _store_stream_info( stream_number, asf->info, newSVpv("end_time", 0), newSViv(end_time) );
+    _store_stream_info( stream_number, asf->info, res_newpv("end_time", 0), res_newiv(end_time) );
   }
 
-  _store_stream_info( stream_number, asf->info, newSVpv("bitrate", 0), newSViv(bitrate) );
-  _store_stream_info( stream_number, asf->info, newSVpv("buffer_size", 0), newSViv(buffer_size) );
-  _store_stream_info( stream_number, asf->info, newSVpv("buffer_fullness", 0), newSViv(buffer_fullness) );
-  _store_stream_info( stream_number, asf->info, newSVpv("alt_bitrate", 0), newSViv(alt_bitrate) );
-  _store_stream_info( stream_number, asf->info, newSVpv("alt_buffer_size", 0), newSViv(alt_buffer_size) );
-  _store_stream_info( stream_number, asf->info, newSVpv("alt_buffer_fullness", 0), newSViv(alt_buffer_fullness) );
-  _store_stream_info( stream_number, asf->info, newSVpv("alt_buffer_size", 0), newSViv(alt_buffer_size) );
-  _store_stream_info( stream_number, asf->info, newSVpv("max_object_size", 0), newSViv(max_object_size) );
+  _store_stream_info( stream_number, asf->info, res_newpv("bitrate", 0), res_newiv(bitrate) );
+  _store_stream_info( stream_number, asf->info, res_newpv("buffer_size", 0), res_newiv(buffer_size) );
+  _store_stream_info( stream_number, asf->info, res_newpv("buffer_fullness", 0), res_newiv(buffer_fullness) );
+  _store_stream_info( stream_number, asf->info, res_newpv("alt_bitrate", 0), res_newiv(alt_bitrate) );
+  _store_stream_info( stream_number, asf->info, res_newpv("alt_buffer_size", 0), res_newiv(alt_buffer_size) );
+  _store_stream_info( stream_number, asf->info, res_newpv("alt_buffer_fullness", 0), res_newiv(alt_buffer_fullness) );
+  _store_stream_info( stream_number, asf->info, res_newpv("alt_buffer_size", 0), res_newiv(alt_buffer_size) );
+  _store_stream_info( stream_number, asf->info, res_newpv("max_object_size", 0), res_newiv(max_object_size) );
 
   if ( flags & 0x01 )
-    _store_stream_info( stream_number, asf->info, newSVpv("flag_reliable", 0), newSViv(1) );
+    _store_stream_info( stream_number, asf->info, res_newpv("flag_reliable", 0), res_newiv(1) );
 
   if ( flags & 0x02 )
-    _store_stream_info( stream_number, asf->info, newSVpv("flag_seekable", 0), newSViv(1) );
+    _store_stream_info( stream_number, asf->info, res_newpv("flag_seekable", 0), res_newiv(1) );
 
   if ( flags & 0x04 )
-    _store_stream_info( stream_number, asf->info, newSVpv("flag_no_cleanpoint", 0), newSViv(1) );
+    _store_stream_info( stream_number, asf->info, res_newpv("flag_no_cleanpoint", 0), res_newiv(1) );
 
   if ( flags & 0x08 )
-    _store_stream_info( stream_number, asf->info, newSVpv("flag_resend_cleanpoints", 0), newSViv(1) );
+    _store_stream_info( stream_number, asf->info, res_newpv("flag_resend_cleanpoints", 0), res_newiv(1) );
 
-  _store_stream_info( stream_number, asf->info, newSVpv("language_index", 0), newSViv(lang_id) );
+  _store_stream_info( stream_number, asf->info, res_newpv("language_index", 0), res_newiv(lang_id) );
 
   if (avg_time_per_frame > 0) {
     // XXX: can't get this to divide properly (?!)
-    //_store_stream_info( stream_number, asf->info, newSVpv("avg_time_per_frame", 0), newSVuv(avg_time_per_frame / 10000) );
+    //_store_stream_info( stream_number, asf->info, res_newpv("avg_time_per_frame", 0), res_newuv(avg_time_per_frame / 10000) );
   }
 
   while ( stream_name_count-- ) {
@@ -884,24 +883,24 @@ _parse_extended_stream_properties(asfinfo *asf, uint64_t len)
 void
 _parse_language_list(asfinfo *asf)
 {
-  AV *list = newAV();
+  resval *list = res_newav();
   uint16_t count = buffer_get_short_le(asf->buf);
 
   buffer_init_or_clear(asf->scratch, 32);
 
   while ( count-- ) {
-    SV *value;
+    resval *value;
 
     uint8_t len = buffer_get_char(asf->buf);
     buffer_clear(asf->scratch);
     buffer_get_utf16_as_utf8(asf->buf, asf->scratch, len, UTF16_BYTEORDER_LE);
-    value = newSVpv( buffer_ptr(asf->scratch), 0 );
-    sv_utf8_decode(value);
+    value = res_newpv( buffer_ptr(asf->scratch), 0 );
+    res_utf8_decode(value);
 
-    av_push( list, value );
+    res_av_push( list, value );
   }
 
-  my_hv_store( asf->info, "language_list", newRV_noinc( (SV*)list ) );
+  res_hv_store( asf->info, "language_list", list );
 }
 
 void
@@ -909,46 +908,45 @@ _parse_advanced_mutual_exclusion(asfinfo *asf)
 {
   GUID mutex_type;
   uint16_t count;
-  AV *mutex_list;
-  HV *mutex_hv = newHV();
-  SV *mutex_type_sv;
-  AV *mutex_streams = newAV();
+  resval *mutex_list;
+  resval *mutex_hv = res_newhv();
+  resval *mutex_type_sv;
+  resval *mutex_streams = res_newav();
 
   buffer_get_guid(asf->buf, &mutex_type);
   count = buffer_get_short_le(asf->buf);
 
   if ( IsEqualGUID(&mutex_type, &ASF_Mutex_Language) ) {
-    mutex_type_sv = newSVpv( "ASF_Mutex_Language", 0 );
+    mutex_type_sv = res_newpv( "ASF_Mutex_Language", 0 );
   }
   else if ( IsEqualGUID(&mutex_type, &ASF_Mutex_Bitrate) ) {
-    mutex_type_sv = newSVpv( "ASF_Mutex_Bitrate", 0 );
+    mutex_type_sv = res_newpv( "ASF_Mutex_Bitrate", 0 );
   }
   else {
-    mutex_type_sv = newSVpv( "ASF_Mutex_Unknown", 0 );
+    mutex_type_sv = res_newpv( "ASF_Mutex_Unknown", 0 );
   }
 
   while ( count-- ) {
-    av_push( mutex_streams, newSViv( buffer_get_short_le(asf->buf) ) );
+    res_av_push( mutex_streams, res_newiv( buffer_get_short_le(asf->buf) ) );
   }
 
-  my_hv_store_ent( mutex_hv, mutex_type_sv, newRV_noinc( (SV *)mutex_streams ) );
-  SvREFCNT_dec(mutex_type_sv);
+  res_hv_store_ent( mutex_hv, mutex_type_sv, mutex_streams );
 
-  if ( !my_hv_exists( asf->info, "mutex_list" ) ) {
-    mutex_list = newAV();
-    av_push( mutex_list, newRV_noinc( (SV *)mutex_hv ) );
-    my_hv_store( asf->info, "mutex_list", newRV_noinc( (SV *)mutex_list ) );
+  if ( !res_hv_exists( asf->info, "mutex_list" ) ) {
+    mutex_list = res_newav();
+    res_av_push( mutex_list, mutex_hv );
+    res_hv_store( asf->info, "mutex_list", mutex_list );
   }
   else {
-    SV **entry = my_hv_fetch( asf->info, "mutex_list" );
+    resval **entry = res_hv_fetch( asf->info, "mutex_list" );
     if (entry != NULL) {
-      mutex_list = (AV *)SvRV(*entry);
+      mutex_list = *entry;
     }
     else {
       return;
     }
 
-    av_push( mutex_list, newRV_noinc( (SV *)mutex_hv ) );
+    res_av_push( mutex_list, mutex_hv );
   }
 }
 
@@ -956,7 +954,7 @@ void
 _parse_codec_list(asfinfo *asf)
 {
   uint32_t count;
-  AV *list = newAV();
+  resval *list = res_newav();
 
   buffer_init_or_clear(asf->scratch, 32);
 
@@ -966,23 +964,23 @@ _parse_codec_list(asfinfo *asf)
   count = buffer_get_int_le(asf->buf);
 
   while ( count-- ) {
-    HV *codec_info = newHV();
+    resval *codec_info = res_newhv();
     uint16_t name_len;
     uint16_t desc_len;
-    SV *name = NULL;
-    SV *desc = NULL;
+    resval *name = NULL;
+    resval *desc = NULL;
 
     uint16_t codec_type = buffer_get_short_le(asf->buf);
 
     switch (codec_type) {
       case 0x0001:
-        my_hv_store( codec_info, "type", newSVpv("Video", 0) );
+        res_hv_store( codec_info, "type", res_newpv("Video", 0) );
         break;
       case 0x0002:
-        my_hv_store( codec_info, "type", newSVpv("Audio", 0) );
+        res_hv_store( codec_info, "type", res_newpv("Audio", 0) );
         break;
       default:
-        my_hv_store( codec_info, "type", newSVpv("Unknown", 0) );
+        res_hv_store( codec_info, "type", res_newpv("Unknown", 0) );
     }
 
     // Unlike other objects, these lengths are the
@@ -990,29 +988,29 @@ _parse_codec_list(asfinfo *asf)
     name_len = buffer_get_short_le(asf->buf) * 2;
     buffer_clear(asf->scratch);
     buffer_get_utf16_as_utf8(asf->buf, asf->scratch, name_len, UTF16_BYTEORDER_LE);
-    name = newSVpv( buffer_ptr(asf->scratch), 0 );
-    sv_utf8_decode(name);
-    my_hv_store( codec_info, "name", name );
+    name = res_newpv( buffer_ptr(asf->scratch), 0 );
+    res_utf8_decode(name);
+    res_hv_store( codec_info, "name", name );
 
     // Set a 'lossless' flag in info if Lossless codec is used
     if ( strstr( buffer_ptr(asf->scratch), "Lossless" ) ) {
-      my_hv_store( asf->info, "lossless", newSVuv(1) );
+      res_hv_store( asf->info, "lossless", res_newuv(1) );
     }
 
     desc_len = buffer_get_short_le(asf->buf) * 2;
     buffer_clear(asf->scratch);
     buffer_get_utf16_as_utf8(asf->buf, asf->scratch, desc_len, UTF16_BYTEORDER_LE);
-    desc = newSVpv( buffer_ptr(asf->scratch), 0 );
-    sv_utf8_decode(desc);
-    my_hv_store( codec_info, "description", desc );
+    desc = res_newpv( buffer_ptr(asf->scratch), 0 );
+    res_utf8_decode(desc);
+    res_hv_store( codec_info, "description", desc );
 
     // Skip info
     buffer_consume(asf->buf, buffer_get_short_le(asf->buf));
 
-    av_push( list, newRV_noinc( (SV *)codec_info ) );
+    res_av_push( list, codec_info );
   }
 
-  my_hv_store( asf->info, "codec_list", newRV_noinc( (SV *)list ) );
+  res_hv_store( asf->info, "codec_list", list );
 }
 
 void
@@ -1023,7 +1021,7 @@ _parse_stream_bitrate_properties(asfinfo *asf)
   while ( count-- ) {
     uint16_t stream_number = buffer_get_short_le(asf->buf) & 0x007f;
 
-    _store_stream_info( stream_number, asf->info, newSVpv("avg_bitrate", 0), newSViv( buffer_get_int_le(asf->buf) ) );
+    _store_stream_info( stream_number, asf->info, res_newpv("avg_bitrate", 0), res_newiv( buffer_get_int_le(asf->buf) ) );
   }
 }
 
@@ -1036,8 +1034,8 @@ _parse_metadata_library(asfinfo *asf)
   buffer_init_or_clear(asf->scratch, 32);
 
   while ( count-- ) {
-    SV *key = NULL;
-    SV *value = NULL;
+    resval *key = NULL;
+    resval *value = NULL;
     uint16_t stream_number, name_len, data_type;
     uint32_t data_len;
 
@@ -1054,40 +1052,40 @@ _parse_metadata_library(asfinfo *asf)
 
     buffer_clear(asf->scratch);
     buffer_get_utf16_as_utf8(asf->buf, asf->scratch, name_len, UTF16_BYTEORDER_LE);
-    key = newSVpv( buffer_ptr(asf->scratch), 0 );
-    sv_utf8_decode(key);
+    key = res_newpv( buffer_ptr(asf->scratch), 0 );
+    res_utf8_decode(key);
 
     picture_offset += 12 + name_len;
 
     if (data_type == TYPE_UNICODE) {
       buffer_clear(asf->scratch);
       buffer_get_utf16_as_utf8(asf->buf, asf->scratch, data_len, UTF16_BYTEORDER_LE);
-      value = newSVpv( buffer_ptr(asf->scratch), 0 );
-      sv_utf8_decode(value);
+      value = res_newpv( buffer_ptr(asf->scratch), 0 );
+      res_utf8_decode(value);
     }
     else if (data_type == TYPE_BYTE) {
       // handle picture data
-      if ( !strcmp( SvPVX(key), "WM/Picture" ) ) {
+      if ( !strcmp( res_pv(key), "WM/Picture" ) ) {
         value = _parse_picture(asf, picture_offset);
       }
       else {
-        value = newSVpvn( buffer_ptr(asf->buf), data_len );
+        value = res_newpvn( buffer_ptr(asf->buf), data_len );
         buffer_consume(asf->buf, data_len);
       }
     }
     else if (data_type == TYPE_BOOL || data_type == TYPE_WORD) {
-      value = newSViv( buffer_get_short_le(asf->buf) );
+      value = res_newiv( buffer_get_short_le(asf->buf) );
     }
     else if (data_type == TYPE_DWORD) {
-      value = newSViv( buffer_get_int_le(asf->buf) );
+      value = res_newiv( buffer_get_int_le(asf->buf) );
     }
     else if (data_type == TYPE_QWORD) {
-      value = newSViv( buffer_get_int64_le(asf->buf) );
+      value = res_newiv( buffer_get_int64_le(asf->buf) );
     }
     else if (data_type == TYPE_GUID) {
       GUID g;
       buffer_get_guid(asf->buf, &g);
-      value = newSVpvf(
+      value = res_newpvf(
         "%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
         g.Data1, g.Data2, g.Data3,
         g.Data4[0], g.Data4[1], g.Data4[2], g.Data4[3],
@@ -1095,7 +1093,7 @@ _parse_metadata_library(asfinfo *asf)
       );
     }
     else {
-      PerlIO_printf(PerlIO_stderr(), "Unknown metadata library data type %d\n", data_type);
+      LOG_ERROR("Unknown metadata library data type %d\n", data_type);
       buffer_consume(asf->buf, data_len);
     }
 
@@ -1104,13 +1102,13 @@ _parse_metadata_library(asfinfo *asf)
     if (value != NULL) {
 #ifdef AUDIO_SCAN_DEBUG
       if ( data_type == 0 || data_type == 6 ) {
-        DEBUG_TRACE("    %s / type %d / lang_index %d / stream_number %d / %s\n", SvPVX(key), data_type, lang_index, stream_number, SvPVX(value));
+        DEBUG_TRACE("    %s / type %d / lang_index %d / stream_number %d / %s\n", res_pv(key), data_type, lang_index, stream_number, res_pv(value));
       }
       else if ( data_type > 1 ) {
-        DEBUG_TRACE("    %s / type %d / lang_index %d / stream_number %d / %d\n", SvPVX(key), data_type, lang_index, stream_number, (int)SvIV(value));
+        DEBUG_TRACE("    %s / type %d / lang_index %d / stream_number %d / %d\n", res_pv(key), data_type, lang_index, stream_number, (int)res_iv(value));
       }
       else {
-        DEBUG_TRACE("    %s / type %d / lang_index %d / stream_number %d / <binary>\n", SvPVX(key), lang_index, stream_number, data_type);
+        DEBUG_TRACE("    %s / type %d / lang_index %d / stream_number %d / <binary>\n", res_pv(key), lang_index, stream_number, data_type);
       }
 #endif
 
@@ -1131,7 +1129,7 @@ _parse_index_parameters(asfinfo *asf)
 {
   uint16_t count;
 
-  my_hv_store( asf->info, "index_entry_interval", newSViv( buffer_get_int_le(asf->buf) ) );
+  res_hv_store( asf->info, "index_entry_interval", res_newiv( buffer_get_int_le(asf->buf) ) );
 
   count = buffer_get_short_le(asf->buf);
 
@@ -1141,37 +1139,37 @@ _parse_index_parameters(asfinfo *asf)
 
     switch (index_type) {
       case 0x0001:
-        _store_stream_info( stream_number, asf->info, newSVpv("index_type", 0), newSVpv("Nearest Past Data Packet", 0) );
+        _store_stream_info( stream_number, asf->info, res_newpv("index_type", 0), res_newpv("Nearest Past Data Packet", 0) );
         break;
       case 0x0002:
-        _store_stream_info( stream_number, asf->info, newSVpv("index_type", 0), newSVpv("Nearest Past Media Object", 0) );
+        _store_stream_info( stream_number, asf->info, res_newpv("index_type", 0), res_newpv("Nearest Past Media Object", 0) );
         break;
       case 0x0003:
-        _store_stream_info( stream_number, asf->info, newSVpv("index_type", 0), newSVpv("Nearest Past Cleanpoint", 0) );
+        _store_stream_info( stream_number, asf->info, res_newpv("index_type", 0), res_newpv("Nearest Past Cleanpoint", 0) );
         break;
       default:
-        _store_stream_info( stream_number, asf->info, newSVpv("index_type", 0), newSViv(index_type) );
+        _store_stream_info( stream_number, asf->info, res_newpv("index_type", 0), res_newiv(index_type) );
     }
   }
 }
 
 void
-_store_stream_info(int stream_number, HV *info, SV *key, SV *value )
+_store_stream_info(int stream_number, resval *info, resval *key, resval *value )
 {
-  AV *streams;
-  HV *streaminfo;
+  resval *streams;
+  resval *streaminfo;
   uint8_t found = 0;
   int i = 0;
 
-  if ( !my_hv_exists( info, "streams" ) ) {
+  if ( !res_hv_exists( info, "streams" ) ) {
     // Create
-    streams = newAV();
-    my_hv_store( info, "streams", newRV_noinc( (SV*)streams ) );
+    streams = res_newav();
+    res_hv_store( info, "streams", streams );
   }
   else {
-    SV **entry = my_hv_fetch( info, "streams" );
+    resval **entry = res_hv_fetch( info, "streams" );
     if (entry != NULL) {
-      streams = (AV *)SvRV(*entry);
+      streams = *entry;
     }
     else {
       return;
@@ -1180,18 +1178,17 @@ _store_stream_info(int stream_number, HV *info, SV *key, SV *value )
 
   if (streams != NULL) {
     // Find entry for this stream number
-    for (i = 0; av_len(streams) >= 0 && i <= av_len(streams); i++) {
-      SV **stream = av_fetch(streams, i, 0);
+    for (i = 0; res_av_len(streams) >= 0 && i <= res_av_len(streams); i++) {
+      resval **stream = res_av_fetch(streams, i);
       if (stream != NULL) {
-        SV **sn;
+        resval **sn;
 
-        streaminfo = (HV *)SvRV(*stream);
-        sn = my_hv_fetch( streaminfo, "stream_number" );
+        streaminfo = *stream;
+        sn = res_hv_fetch( streaminfo, "stream_number" );
         if (sn != NULL) {
-          if ( SvIV(*sn) == stream_number ) {
+          if ( res_iv(*sn) == stream_number ) {
             // XXX: if item exists, create array
-            my_hv_store_ent( streaminfo, key, value );
-            SvREFCNT_dec(key);
+            res_hv_store_ent( streaminfo, key, value );
 
             found = 1;
             break;
@@ -1202,41 +1199,39 @@ _store_stream_info(int stream_number, HV *info, SV *key, SV *value )
 
     if ( !found ) {
       // New stream number
-      streaminfo = newHV();
+      streaminfo = res_newhv();
 
-      my_hv_store( streaminfo, "stream_number", newSViv(stream_number) );
-      my_hv_store_ent( streaminfo, key, value );
-      SvREFCNT_dec(key);
+      res_hv_store( streaminfo, "stream_number", res_newiv(stream_number) );
+      res_hv_store_ent( streaminfo, key, value );
 
-      av_push( streams, newRV_noinc( (SV *)streaminfo ) );
+      res_av_push( streams, streaminfo );
     }
   }
 }
 
 void
-_store_tag(HV *tags, SV *key, SV *value)
+_store_tag(resval *tags, resval *key, resval *value)
 {
   // if key exists, create array
-  if ( my_hv_exists_ent( tags, key ) ) {
-    SV **entry = my_hv_fetch( tags, SvPVX(key) );
+  if ( res_hv_exists( tags, res_pv(key) ) ) {
+    resval **entry = res_hv_fetch( tags, res_pv(key) );
     if (entry != NULL) {
-      if ( SvROK(*entry) && SvTYPE(SvRV(*entry)) == SVt_PVAV ) {
-        av_push( (AV *)SvRV(*entry), value );
+      if ( res_isav(*entry) ) {
+        res_av_push( *entry, value );
       }
       else {
       // A non-array entry, convert to array.
-        AV *ref = newAV();
-        av_push( ref, newSVsv(*entry) );
-        av_push( ref, value );
-        my_hv_store_ent( tags, key, newRV_noinc( (SV*)ref ) );
+        resval *ref = res_newav();
+        res_av_push( ref, res_newsv(*entry) );
+        res_av_push( ref, value );
+        res_hv_store_ent( tags, key, ref );
       }
     }
   }
   else {
-    my_hv_store_ent( tags, key, value );
+    res_hv_store_ent( tags, key, value );
   }
 
-  SvREFCNT_dec(key);
 }
 
 int
@@ -1269,9 +1264,9 @@ _parse_index_objects(asfinfo *asf, int index_size)
     }
     else {
       // Unhandled GUID
-      PerlIO_printf(PerlIO_stderr(), "** Unhandled Index GUID: ");
+      LOG_ERROR("** Unhandled Index GUID: ");
       print_guid(tmp);
-      PerlIO_printf(PerlIO_stderr(), "size: %llu\n", size);
+      LOG_ERROR("size: %llu\n", size);
 
       buffer_consume(asf->buf, size - 24);
     }
@@ -1350,15 +1345,15 @@ _parse_content_encryption(asfinfo *asf)
   buffer_consume(asf->buf, buffer_get_int_le(asf->buf));
 
   protection_type_len = buffer_get_int_le(asf->buf);
-  my_hv_store( asf->info, "drm_protection_type", newSVpvn( buffer_ptr(asf->buf), protection_type_len - 1 ) );
+  res_hv_store( asf->info, "drm_protection_type", res_newpvn( buffer_ptr(asf->buf), protection_type_len - 1 ) );
   buffer_consume(asf->buf, protection_type_len);
 
   key_len = buffer_get_int_le(asf->buf);
-  my_hv_store( asf->info, "drm_key", newSVpvn( buffer_ptr(asf->buf), key_len - 1 ) );
+  res_hv_store( asf->info, "drm_key", res_newpvn( buffer_ptr(asf->buf), key_len - 1 ) );
   buffer_consume(asf->buf, key_len);
 
   license_url_len = buffer_get_int_le(asf->buf);
-  my_hv_store( asf->info, "drm_license_url", newSVpvn( buffer_ptr(asf->buf), license_url_len - 1 ) );
+  res_hv_store( asf->info, "drm_license_url", res_newpvn( buffer_ptr(asf->buf), license_url_len - 1 ) );
   buffer_consume(asf->buf, license_url_len);
 }
 
@@ -1366,17 +1361,17 @@ void
 _parse_extended_content_encryption(asfinfo *asf)
 {
   uint32_t len = buffer_get_int_le(asf->buf);
-  SV *value;
+  resval *value;
   unsigned char *tmp_ptr = buffer_ptr(asf->buf);
 
   if ( tmp_ptr[0] == 0xFF && tmp_ptr[1] == 0xFE ) {
     buffer_consume(asf->buf, 2);
     buffer_init_or_clear(asf->scratch, len - 2);
     buffer_get_utf16_as_utf8(asf->buf, asf->scratch, len - 2, UTF16_BYTEORDER_LE);
-    value = newSVpv( buffer_ptr(asf->scratch), 0 );
-    sv_utf8_decode(value);
+    value = res_newpv( buffer_ptr(asf->scratch), 0 );
+    res_utf8_decode(value);
 
-    my_hv_store( asf->info, "drm_data", value );
+    res_hv_store( asf->info, "drm_data", value );
   }
   else {
     buffer_consume(asf->buf, len);
@@ -1388,8 +1383,8 @@ _parse_script_command(asfinfo *asf)
 {
   uint16_t command_count;
   uint16_t type_count;
-  AV *types = newAV();
-  AV *commands = newAV();
+  resval *types = res_newav();
+  resval *commands = res_newav();
 
   buffer_init_or_clear(asf->scratch, 32);
 
@@ -1400,20 +1395,20 @@ _parse_script_command(asfinfo *asf)
   type_count    = buffer_get_short_le(asf->buf);
 
   while ( type_count-- ) {
-    SV *value;
+    resval *value;
     uint16_t len = buffer_get_short_le(asf->buf);
 
     buffer_clear(asf->scratch);
     buffer_get_utf16_as_utf8(asf->buf, asf->scratch, len * 2, UTF16_BYTEORDER_LE);
-    value = newSVpv( buffer_ptr(asf->scratch), 0 );
-    sv_utf8_decode(value);
+    value = res_newpv( buffer_ptr(asf->scratch), 0 );
+    res_utf8_decode(value);
 
-    av_push( types, value );
+    res_av_push( types, value );
   }
 
   while ( command_count-- ) {
-    HV *command = newHV();
-    SV *value;
+    resval *command = res_newhv();
+    resval *value;
 
     uint32_t pres_time  = buffer_get_int_le(asf->buf);
     uint16_t type_index = buffer_get_short_le(asf->buf);
@@ -1422,35 +1417,35 @@ _parse_script_command(asfinfo *asf)
     if (name_len) {
       buffer_clear(asf->scratch);
       buffer_get_utf16_as_utf8(asf->buf, asf->scratch, name_len * 2, UTF16_BYTEORDER_LE);
-      value = newSVpv( buffer_ptr(asf->scratch), 0 );
-      sv_utf8_decode(value);
-      my_hv_store( command, "command", value );
+      value = res_newpv( buffer_ptr(asf->scratch), 0 );
+      res_utf8_decode(value);
+      res_hv_store( command, "command", value );
     }
 
-    my_hv_store( command, "time", newSVuv(pres_time) );
-    my_hv_store( command, "type", newSVuv(type_index) );
+    res_hv_store( command, "time", res_newuv(pres_time) );
+    res_hv_store( command, "type", res_newuv(type_index) );
 
-    av_push( commands, newRV_noinc( (SV *)command ) );
+    res_av_push( commands, command );
   }
 
-  my_hv_store( asf->info, "script_types", newRV_noinc( (SV *)types ) );
-  my_hv_store( asf->info, "script_commands", newRV_noinc( (SV *)commands ) );
+  res_hv_store( asf->info, "script_types", types );
+  res_hv_store( asf->info, "script_commands", commands );
 }
 
-SV *
+resval *
 _parse_picture(asfinfo *asf, uint32_t picture_offset)
 {
   char *tmp_ptr;
   uint16_t mime_len = 2; // to handle double-null
   uint16_t desc_len = 2;
   uint32_t image_len;
-  SV *mime;
-  SV *desc;
-  HV *picture = newHV();
+  resval *mime;
+  resval *desc;
+  resval *picture = res_newhv();
 
   buffer_init_or_clear(asf->scratch, 32);
 
-  my_hv_store( picture, "image_type", newSVuv( buffer_get_char(asf->buf) ) );
+  res_hv_store( picture, "image_type", res_newuv( buffer_get_char(asf->buf) ) );
 
   image_len = buffer_get_int_le(asf->buf);
 
@@ -1462,9 +1457,9 @@ _parse_picture(asfinfo *asf, uint32_t picture_offset)
   }
 
   buffer_get_utf16_as_utf8(asf->buf, asf->scratch, mime_len, UTF16_BYTEORDER_LE);
-  mime = newSVpv( buffer_ptr(asf->scratch), 0 );
-  sv_utf8_decode(mime);
-  my_hv_store( picture, "mime_type", mime );
+  mime = res_newpv( buffer_ptr(asf->scratch), 0 );
+  res_utf8_decode(mime);
+  res_hv_store( picture, "mime_type", mime );
 
   // Description is a double-null-terminated UTF-16 string
   tmp_ptr = buffer_ptr(asf->buf);
@@ -1475,51 +1470,94 @@ _parse_picture(asfinfo *asf, uint32_t picture_offset)
 
   buffer_clear(asf->scratch);
   buffer_get_utf16_as_utf8(asf->buf, asf->scratch, desc_len, UTF16_BYTEORDER_LE);
-  desc = newSVpv( buffer_ptr(asf->scratch), 0 );
-  sv_utf8_decode(desc);
-  my_hv_store( picture, "description", desc );
+  desc = res_newpv( buffer_ptr(asf->scratch), 0 );
+  res_utf8_decode(desc);
+  res_hv_store( picture, "description", desc );
 
   if ( _env_true("AUDIO_SCAN_NO_ARTWORK") ) {
-    my_hv_store( picture, "image", newSVuv(image_len) );
     picture_offset += 5 + mime_len + desc_len + 2;
-    my_hv_store( picture, "offset", newSVuv(asf->object_offset + picture_offset) );
+    res_hv_store( picture, "image", res_newart(asf->object_offset + picture_offset, image_len) );
+    res_hv_store( picture, "offset", res_newuv(asf->object_offset + picture_offset) );
   }
   else {
-    my_hv_store( picture, "image", newSVpvn( buffer_ptr(asf->buf), image_len ) );
+    res_hv_store( picture, "image", res_newblob( buffer_ptr(asf->buf), image_len ) );
   }
 
   buffer_consume(asf->buf, image_len);
 
-  return newRV_noinc( (SV *)picture );
+  return picture;
 }
 
 // offset is in ms
 // Based on some code from Rockbox
-int
-asf_find_frame(PerlIO *infile, char *file, int time_offset)
+off_t
+asf_find_frame(ScanIO *infile, char *file, int time_offset)
 {
-  int frame_offset = -1;
-  uint32_t song_length_ms;
-  int32_t offset_index = 0;
-  uint32_t min_packet_size, max_packet_size;
-  uint8_t found = 0;
+  void *asf = asf_seek_open(infile, file);
+  off_t frame_offset = asf_seek(asf, time_offset, NULL);
+
+  asf_seek_close(asf);
+
+  return frame_offset;
+}
 
+// Parses the header objects once, keeping the index specs and packet sizes
+void *
+asf_seek_open(ScanIO *infile, char *file)
+{
   // We need to read all info first to get some data we need to calculate
-  HV *info = newHV();
-  HV *tags = newHV();
+  resval *info = res_newhv();
+  resval *tags = res_newhv();
   asfinfo *asf = _asf_parse(infile, file, info, tags, 1);
 
   // We'll need to reuse the scratch buffer
   Newz(0, asf->scratch, sizeof(Buffer), Buffer);
 
+  return asf;
+}
+
+void
+asf_seek_close(void *state)
+{
+  asfinfo *asf = (asfinfo *)state;
+
+  if (asf->spec_count) {
+    int i;
+    for (i = 0; i < asf->spec_count; i++) {
+      DEBUG_TRACE("Freeing specs[%d] offsets\n", i);
+      Safefree(asf->specs[i].offsets);
+    }
+
+    DEBUG_TRACE("Freeing specs\n");
+    Safefree(asf->specs);
+  }
+
+  if (asf->scratch->alloc)
+    buffer_free(asf->scratch);
+  Safefree(asf->scratch);
+
+  Safefree(asf);
+}
+
+off_t
+asf_seek(void *state, int time_offset, resval *ret)
+{
+  asfinfo *asf = (asfinfo *)state;
+  resval *info = asf->info;
+  int frame_offset = -1;
+  uint32_t song_length_ms;
+  int32_t offset_index = 0;
+  uint32_t min_packet_size, max_packet_size;
+  uint8_t found = 0;
+
   // No seeking without at least 1 stream
-  if ( !my_hv_exists(info, "streams") ) {
+  if ( !res_hv_exists(info, "streams") ) {
     DEBUG_TRACE("No streams found in file, not seeking\n");
     goto out;
   }
 
-  min_packet_size = SvIV( *(my_hv_fetch(info, "min_packet_size")) );
-  max_packet_size = SvIV( *(my_hv_fetch(info, "max_packet_size")) );
+  min_packet_size = res_iv( *(res_hv_fetch(info, "min_packet_size")) );
+  max_packet_size = res_iv( *(res_hv_fetch(info, "max_packet_size")) );
 
   // No seeking if min != max, according to the ASF spec these must be the same
   // and without this value we can't find the data packets properly
@@ -1528,7 +1566,13 @@ asf_find_frame(PerlIO *infile, char *file, int time_offset)
     goto out;
   }
 
-  song_length_ms = SvIV( *(my_hv_fetch( info, "song_length_ms" )) );
+  // No seeking in live broadcasts, which have no duration
+  if ( !res_hv_exists(info, "song_length_ms") ) {
+    DEBUG_TRACE("No duration, cannot seek\n");
+    goto out;
+  }
+
+  song_length_ms = res_iv( *(res_hv_fetch( info, "song_length_ms" )) );
 
   if (time_offset > song_length_ms)
     time_offset = song_length_ms;
@@ -1624,26 +1668,6 @@ asf_find_frame(PerlIO *infile, char *file, int time_offset)
   }
 
 out:
-  // Don't leak
-  SvREFCNT_dec(info);
-  SvREFCNT_dec(tags);
-
-  if (asf->spec_count) {
-    int i;
-    for (i = 0; i < asf->spec_count; i++) {
-      DEBUG_TRACE("Freeing specs[%d] offsets\n", i);
-      Safefree(asf->specs[i].offsets);
-    }
-
-    DEBUG_TRACE("Freeing specs\n");
-    Safefree(asf->specs);
-  }
-
-  if (asf->scratch->alloc)
-    buffer_free(asf->scratch);
-  Safefree(asf->scratch);
-
-  Safefree(asf);
 
   return frame_offset;
 }
@@ -1655,7 +1679,7 @@ _timestamp(asfinfo *asf, int offset, int *duration)
   int timestamp = -1;
   uint8_t tmp;
 
-  if ((PerlIO_seek(asf->infile, offset, SEEK_SET)) != 0) {
+  if ((scanio_seek(asf->infile, offset, SEEK_SET)) != 0) {
     return -1;
   }
 
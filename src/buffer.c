@@ -23,6 +23,55 @@
 
 #define UnsignedToFloat(u) (((double)((long)(u - 2147483647L - 1))) + 2147483648.0)
 
+#ifdef _MSC_VER
+# define BUFFER_THREAD __declspec(thread)
+#else
+# define BUFFER_THREAD __thread
+#endif
+
+/* Counted per thread, scan_many workers hand theirs over with each job */
+static BUFFER_THREAD BufferStats buffer_stats_counters;
+
+/* Returns the allocation/copy counters of this thread. */
+
+BufferStats *
+buffer_stats(void)
+{
+  return &buffer_stats_counters;
+}
+
+void
+buffer_stats_reset(void)
+{
+  Zero(&buffer_stats_counters, 1, BufferStats);
+}
+
+/* Moves this thread's counters to stats, leaving them at 0. */
+
+void
+buffer_stats_take(BufferStats *stats)
+{
+  *stats = buffer_stats_counters;
+  Zero(&buffer_stats_counters, 1, BufferStats);
+}
+
+/* Adds counters taken from another thread to this thread's. */
+
+void
+buffer_stats_add(BufferStats *stats)
+{
+  buffer_stats_counters.allocs       += stats->allocs;
+  buffer_stats_counters.reallocs     += stats->reallocs;
+  buffer_stats_counters.frees        += stats->frees;
+  buffer_stats_counters.compactions  += stats->compactions;
+  buffer_stats_counters.bytes_moved  += stats->bytes_moved;
+  buffer_stats_counters.bytes_copied += stats->bytes_copied;
+  buffer_stats_counters.refills      += stats->refills;
+  buffer_stats_counters.bytes_read   += stats->bytes_read;
+  buffer_stats_counters.views        += stats->views;
+  buffer_stats_counters.bytes_viewed += stats->bytes_viewed;
+}
+
 /* Initializes the buffer structure. */
 
 void
@@ -37,6 +86,10 @@ buffer_init(Buffer *buffer, uint32_t len)
   buffer->end = 0;
   buffer->cache = 0;
   buffer->ncached = 0;
+  buffer->store = NULL;
+  buffer->view = 0;
+  
+  buffer_stats_counters.allocs++;
 
 #ifdef AUDIO_SCAN_DEBUG
   PerlIO_printf(PerlIO_stderr(), "Buffer allocated with %d bytes\n", len);
@@ -61,6 +114,12 @@ buffer_init_or_clear(Buffer *buffer, uint32_t len)
 void
 buffer_free(Buffer *buffer)
 {
+  if (buffer->view) {
+    buffer->buf = buffer->store;
+    buffer->store = NULL;
+    buffer->view = 0;
+  }
+
   if (buffer->alloc > 0) {
 #ifdef AUDIO_SCAN_DEBUG
     PerlIO_printf(PerlIO_stderr(), "Buffer high water mark: %d\n", buffer->alloc);
@@ -68,6 +127,7 @@ buffer_free(Buffer *buffer)
     memset(buffer->buf, 0, buffer->alloc);
     buffer->alloc = 0;
     Safefree(buffer->buf);
+    buffer_stats_counters.frees++;
   }
 }
 
@@ -79,6 +139,12 @@ buffer_free(Buffer *buffer)
 void
 buffer_clear(Buffer *buffer)
 {
+  if (buffer->view) {
+    buffer->buf = buffer->store;
+    buffer->store = NULL;
+    buffer->view = 0;
+  }
+
   buffer->offset = 0;
   buffer->end = 0;
   buffer->cache = 0;
@@ -93,20 +159,30 @@ buffer_append(Buffer *buffer, const void *data, uint32_t len)
   void *p;
   p = buffer_append_space(buffer, len);
   Copy(data, p, (int)len, u_char);
+  buffer_stats_counters.bytes_copied += len;
 }
 
 static int
-buffer_compact(Buffer *buffer)
+buffer_compact(Buffer *buffer, uint32_t len)
 {
   /*
-   * If the buffer is at least BUFFER_COMPACT_PERCENT empty, move the
-   * data to the beginning.
+   * Only called when there is no room for len more bytes at the end.
+   * Move the data to the beginning if that makes enough room for len,
+   * which is always cheaper than growing, or if the buffer is at least
+   * BUFFER_COMPACT_PERCENT empty.  Otherwise leave it for the caller to grow.
    */
-  if (buffer->offset * 1.0 / buffer->alloc >= BUFFER_COMPACT_PERCENT ) {
+  if ( !buffer->offset )
+    return (0);
+  
+  if ( buffer->end - buffer->offset + len <= buffer->alloc
+    || buffer->offset * 1.0 / buffer->alloc >= BUFFER_COMPACT_PERCENT
+  ) {
 #ifdef AUDIO_SCAN_DEBUG
     PerlIO_printf(PerlIO_stderr(), "Buffer compacting (%d -> %d)\n", buffer->offset + buffer_len(buffer), buffer_len(buffer));
 #endif
     Move(buffer->buf + buffer->offset, buffer->buf, (int)(buffer->end - buffer->offset), u_char);
+    buffer_stats_counters.compactions++;
+    buffer_stats_counters.bytes_moved += buffer->end - buffer->offset;
     buffer->end -= buffer->offset;
     buffer->offset = 0;
     return (1);
@@ -127,8 +203,11 @@ buffer_append_space(Buffer *buffer, uint32_t len)
   uint32_t newlen;
   void *p;
 
+  if (buffer->view)
+    buffer_unview(buffer);
+
   if (len > BUFFER_MAX_CHUNK)
-    croak("buffer_append_space: len %u too large (max %u)", len, BUFFER_MAX_CHUNK);
+    res_croak("buffer_append_space: len %u too large (max %u)", len, BUFFER_MAX_CHUNK);
 
   /* If the buffer is empty, start using it from the beginning. */
   if (buffer->offset == buffer->end) {
@@ -145,7 +224,7 @@ restart:
   }
 
   /* Compact data back to the start of the buffer if necessary */
-  if (buffer_compact(buffer))
+  if (buffer_compact(buffer, len))
     goto restart;
 
   /* Increase the size of the buffer and retry. */
@@ -155,13 +234,14 @@ restart:
     newlen = buffer->alloc + len + 4096;
   
   if (newlen > BUFFER_MAX_LEN)
-    croak("buffer_append_space: alloc %u too large (max %u)",
+    res_croak("buffer_append_space: alloc %u too large (max %u)",
         newlen, BUFFER_MAX_LEN);
 #ifdef AUDIO_SCAN_DEBUG
   PerlIO_printf(PerlIO_stderr(), "Buffer extended to %d\n", newlen);
 #endif
   Renew(buffer->buf, (int)newlen, u_char);
   buffer->alloc = newlen;
+  buffer_stats_counters.reallocs++;
   goto restart;
   /* NOTREACHED */
 }
@@ -173,6 +253,9 @@ restart:
 int
 buffer_check_alloc(Buffer *buffer, uint32_t len)
 {
+  if (buffer->view)
+    buffer_unview(buffer);
+
   if (buffer->offset == buffer->end) {
     buffer->offset = 0;
     buffer->end = 0;
@@ -180,13 +263,62 @@ buffer_check_alloc(Buffer *buffer, uint32_t len)
  restart:
   if (buffer->end + len < buffer->alloc)
     return (1);
-  if (buffer_compact(buffer))
+  if (buffer_compact(buffer, len))
     goto restart;
   if (roundup(buffer->alloc + len, BUFFER_ALLOCSZ) <= BUFFER_MAX_LEN)
     return (1);
   return (0);
 }
 
+/*
+ * Makes the buffer a read-only view of len bytes of external memory, such
+ * as an mmap'ed file, so it can be consumed without copying.  Any data still
+ * in the buffer must be the len bytes immediately before data.  The view
+ * lasts until the buffer is cleared, freed or appended to.
+ */
+
+void
+buffer_view(Buffer *buffer, u_char *data, uint32_t len)
+{
+  if (!buffer->view) {
+    buffer->store = buffer->buf;
+    buffer->view = 1;
+  }
+
+  buffer->buf = data;
+  buffer->offset = 0;
+  buffer->end = len;
+
+  buffer_stats_counters.views++;
+}
+
+/*
+ * Copies a view back into our own storage.  Must be called before
+ * modifying the buffer contents in place.
+ */
+
+void
+buffer_unview(Buffer *buffer)
+{
+  u_char *data;
+  uint32_t len;
+
+  if (!buffer->view)
+    return;
+
+  data = buffer->buf + buffer->offset;
+  len = buffer->end - buffer->offset;
+
+  buffer->buf = buffer->store;
+  buffer->store = NULL;
+  buffer->view = 0;
+  buffer->offset = 0;
+  buffer->end = 0;
+
+  if (len)
+    buffer_append(buffer, data, len);
+}
+
 /* Returns the number of bytes of data in the buffer. */
 
 uint32_t
@@ -201,7 +333,7 @@ int
 buffer_get_ret(Buffer *buffer, void *buf, uint32_t len)
 {
   if (len > buffer->end - buffer->offset) {
-    warn("buffer_get_ret: trying to get more bytes %d than in buffer %d", len, buffer->end - buffer->offset);
+    LOG_WARN("buffer_get_ret: trying to get more bytes %d than in buffer %d", len, buffer->end - buffer->offset);
     return (-1);
   }
 
@@ -214,7 +346,7 @@ void
 buffer_get(Buffer *buffer, void *buf, uint32_t len)
 {
   if (buffer_get_ret(buffer, buf, len) == -1)
-    croak("buffer_get: buffer error");
+    res_croak("buffer_get: buffer error");
 }
 
 /* Consumes the given number of bytes from the beginning of the buffer. */
@@ -223,7 +355,7 @@ int
 buffer_consume_ret(Buffer *buffer, uint32_t bytes)
 {
   if (bytes > buffer->end - buffer->offset) {
-    warn("buffer_consume_ret: trying to get more bytes %d than in buffer %d", bytes, buffer->end - buffer->offset);
+    LOG_WARN("buffer_consume_ret: trying to get more bytes %d than in buffer %d", bytes, buffer->end - buffer->offset);
     return (-1);
   }
 
@@ -235,7 +367,7 @@ void
 buffer_consume(Buffer *buffer, uint32_t bytes)
 {
   if (buffer_consume_ret(buffer, bytes) == -1)
-    croak("buffer_consume: buffer error");
+    res_croak("buffer_consume: buffer error");
 }
 
 /* Consumes the given number of bytes from the end of the buffer. */
@@ -254,7 +386,7 @@ void
 buffer_consume_end(Buffer *buffer, uint32_t bytes)
 {
   if (buffer_consume_end_ret(buffer, bytes) == -1)
-    croak("buffer_consume_end: trying to get more bytes %d than in buffer %d", bytes, buffer->end - buffer->offset);
+    res_croak("buffer_consume_end: trying to get more bytes %d than in buffer %d", bytes, buffer->end - buffer->offset);
 }
 
 /* Returns a pointer to the first used byte in the buffer. */
@@ -322,7 +454,7 @@ int
 buffer_get_char_ret(char *ret, Buffer *buffer)
 {
   if (buffer_get_ret(buffer, ret, 1) == -1) {
-    warn("buffer_get_char_ret: buffer_get_ret failed");
+    LOG_WARN("buffer_get_char_ret: buffer_get_ret failed");
     return (-1);
   }
 
@@ -335,7 +467,7 @@ buffer_get_char(Buffer *buffer)
   char ch;
 
   if (buffer_get_char_ret(&ch, buffer) == -1)
-    croak("buffer_get_char: buffer error");
+    res_croak("buffer_get_char: buffer error");
   return (u_char) ch;
 }
 
@@ -370,7 +502,7 @@ buffer_get_int_le(Buffer *buffer)
   uint32_t ret;
 
   if (buffer_get_int_le_ret(&ret, buffer) == -1)
-    croak("buffer_get_int_le: buffer error");
+    res_croak("buffer_get_int_le: buffer error");
 
   return (ret);
 }
@@ -406,7 +538,7 @@ buffer_get_int(Buffer *buffer)
   uint32_t ret;
 
   if (buffer_get_int_ret(&ret, buffer) == -1)
-    croak("buffer_get_int: buffer error");
+    res_croak("buffer_get_int: buffer error");
 
   return (ret);
 }
@@ -441,7 +573,7 @@ buffer_get_int24(Buffer *buffer)
   uint32_t ret;
 
   if (buffer_get_int24_ret(&ret, buffer) == -1)
-    croak("buffer_get_int24: buffer error");
+    res_croak("buffer_get_int24: buffer error");
 
   return (ret);
 }
@@ -476,7 +608,7 @@ buffer_get_int24_le(Buffer *buffer)
   uint32_t ret;
 
   if (buffer_get_int24_le_ret(&ret, buffer) == -1)
-    croak("buffer_get_int24_le: buffer error");
+    res_croak("buffer_get_int24_le: buffer error");
 
   return (ret);
 }
@@ -516,7 +648,7 @@ buffer_get_int64_le(Buffer *buffer)
   uint64_t ret;
 
   if (buffer_get_int64_le_ret(&ret, buffer) == -1)
-    croak("buffer_get_int64_le: buffer error");
+    res_croak("buffer_get_int64_le: buffer error");
 
   return (ret);
 }
@@ -556,7 +688,7 @@ buffer_get_int64(Buffer *buffer)
   uint64_t ret;
 
   if (buffer_get_int64_ret(&ret, buffer) == -1)
-    croak("buffer_get_int64_le: buffer error");
+    res_croak("buffer_get_int64_le: buffer error");
 
   return (ret);
 }
@@ -590,7 +722,7 @@ buffer_get_short_le(Buffer *buffer)
   uint16_t ret;
 
   if (buffer_get_short_le_ret(&ret, buffer) == -1)
-    croak("buffer_get_short_le: buffer error");
+    res_croak("buffer_get_short_le: buffer error");
 
   return (ret);
 }
@@ -624,7 +756,7 @@ buffer_get_short(Buffer *buffer)
   uint16_t ret;
 
   if (buffer_get_short_ret(&ret, buffer) == -1)
-    croak("buffer_get_short: buffer error");
+    res_croak("buffer_get_short: buffer error");
 
   return (ret);
 }
@@ -822,7 +954,7 @@ buffer_get_float32_le(Buffer *buffer)
   float ret;
 
   if (buffer_get_float32_le_ret(&ret, buffer) == -1)
-    croak("buffer_get_float32_le_ret: buffer error");
+    res_croak("buffer_get_float32_le_ret: buffer error");
 
   return (ret);
 }
@@ -879,7 +1011,7 @@ buffer_get_float32(Buffer *buffer)
   float ret;
 
   if (buffer_get_float32_ret(&ret, buffer) == -1)
-    croak("buffer_get_float32_ret: buffer error");
+    res_croak("buffer_get_float32_ret: buffer error");
 
   return (ret);
 }
@@ -991,6 +1123,22 @@ buffer_put_int(Buffer *buffer, u_int value)
 	buffer_append(buffer, buf, 4);
 }
 
+void
+put_u64(void *vp, uint64_t v)
+{
+  put_u32(vp, (uint32_t)(v >> 32));
+  put_u32((u_char *)vp + 4, (uint32_t)v);
+}
+
+void
+buffer_put_int64(Buffer *buffer, uint64_t value)
+{
+  char buf[8];
+  
+  put_u64(buf, value);
+  buffer_append(buffer, buf, 8);
+}
+
 // Warnings:
 // Do not request more than 32 bits at a time.
 // Be careful if using other buffer functions without reading a multiple of 8 bits.
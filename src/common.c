@@ -15,22 +15,25 @@
  */
 
 #include "common.h"
+#include "result.c"
 #include "buffer.c"
+#include "scanio.c"
+#include "syncscan.c"
 
 int
-_check_buf(PerlIO *infile, Buffer *buf, int min_wanted, int max_wanted)
+_check_buf(ScanIO *infile, Buffer *buf, int min_wanted, int max_wanted)
 {
   int ret = 1;
   
   // Do we have enough data?
   if ( buffer_len(buf) < min_wanted ) {
     // Read more data
-    uint32_t read;
+    int read;
     uint32_t actual_wanted;
     unsigned char *tmp;
 
 #ifdef _MSC_VER
-    uint32_t pos_check = PerlIO_tell(infile);
+    uint32_t pos_check = scanio_tell(infile);
 #endif
     
     if (min_wanted > max_wanted) {
@@ -40,56 +43,86 @@ _check_buf(PerlIO *infile, Buffer *buf, int min_wanted, int max_wanted)
     // Adjust actual amount to read by the amount we already have in the buffer
     actual_wanted = max_wanted - buffer_len(buf);
 
-    New(0, tmp, actual_wanted, unsigned char);
-    
     DEBUG_TRACE("Buffering from file @ %d (min_wanted %d, max_wanted %d, adjusted to %d)\n",
-      (int)PerlIO_tell(infile), min_wanted, max_wanted, actual_wanted
+      (int)scanio_tell(infile), min_wanted, max_wanted, actual_wanted
     );
 
-    if ( (read = PerlIO_read(infile, tmp, actual_wanted)) <= 0 ) {
-      if ( PerlIO_error(infile) ) {
+    // For mmap and memory sources, point the buffer at the data instead of
+    // copying it, as long as what's left in the buffer ends where we are reading
+    if ( infile->data
+      && ( !buffer_len(buf) || (buf->view && buf->buf + buf->end == infile->data + infile->pos) )
+    ) {
+      off_t avail = infile->size - infile->pos;
+
+      read = avail < (off_t)actual_wanted ? (int)avail : (int)actual_wanted;
+      if (read <= 0) {
+        LOG_WARN("Error: Unable to read at least %d bytes from file.\n", min_wanted);
+        ret = 0;
+        goto out;
+      }
+
+      buffer_view(buf, infile->data + infile->pos - buffer_len(buf), buffer_len(buf) + read);
+      infile->pos += read;
+
+      buffer_stats()->refills++;
+      buffer_stats()->bytes_read += read;
+      buffer_stats()->bytes_viewed += read;
+
+      goto check;
+    }
+
+    // Read directly into the end of the buffer, this will only move the
+    // unconsumed data if there isn't enough room after it
+    tmp = (unsigned char *)buffer_append_space(buf, actual_wanted);
+
+    if ( (read = scanio_read(infile, tmp, actual_wanted)) <= 0 ) {
+      if ( scanio_error(infile) ) {
 #ifdef _MSC_VER
         // Show windows specific error message as Win32 PerlIO_read does not set errno
         DWORD last_error = GetLastError();
         LPWSTR *errmsg = NULL;
         FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM, 0, last_error, 0, (LPWSTR)&errmsg, 0, NULL);
-        warn("Error reading: %d %s (read %d wanted %d)\n", last_error, errmsg, read, actual_wanted);
+        LOG_WARN("Error reading: %d %s (read %d wanted %d)\n", last_error, errmsg, read, actual_wanted);
         LocalFree(errmsg);
 #else
-        warn("Error reading: %s (wanted %d)\n", strerror(errno), actual_wanted);
+        LOG_WARN("Error reading: %s (wanted %d)\n", strerror(errno), actual_wanted);
 #endif
       }
       else {
-        warn("Error: Unable to read at least %d bytes from file.\n", min_wanted);
+        LOG_WARN("Error: Unable to read at least %d bytes from file.\n", min_wanted);
       }
 
+      buffer_consume_end(buf, actual_wanted);
       ret = 0;
       goto out;
     }
+    
+    // Give back the space we didn't fill
+    buffer_consume_end(buf, actual_wanted - read);
+    
+    buffer_stats()->refills++;
+    buffer_stats()->bytes_read += read;
 
-    buffer_append(buf, tmp, read);
-
+check:
     // Make sure we got enough
     if ( buffer_len(buf) < min_wanted ) {
-      warn("Error: Unable to read at least %d bytes from file (only read %d).\n", min_wanted, read);
+      LOG_WARN("Error: Unable to read at least %d bytes from file (only read %d).\n", min_wanted, read);
       ret = 0;
       goto out;
     }
 
 #ifdef _MSC_VER
     // Bug 16095, weird off-by-one bug seen only on Win32 and only when reading a filehandle
-    if (PerlIO_tell(infile) != pos_check + read) {
-      //PerlIO_printf(PerlIO_stderr(), "Win32 bug, pos should be %d, but was %d\n", pos_check + read, PerlIO_tell(infile));
-      PerlIO_seek(infile, pos_check + read, SEEK_SET);
+    if (scanio_tell(infile) != pos_check + read) {
+      //LOG_ERROR("Win32 bug, pos should be %d, but was %d\n", pos_check + read, scanio_tell(infile));
+      scanio_seek(infile, pos_check + read, SEEK_SET);
     }
 #endif
 
-    DEBUG_TRACE("Buffered %d bytes, new pos %d\n", read, (int)PerlIO_tell(infile));
-
-out:
-    Safefree(tmp);
+    DEBUG_TRACE("Buffered %d bytes, new pos %d\n", read, (int)scanio_tell(infile));
   }
 
+out:
   return ret;
 }
 
@@ -104,11 +137,11 @@ char* upcase(char *s) {
   return s;
 }
 
-void _split_vorbis_comment(char* comment, HV* tags) {
+void _split_vorbis_comment(char* comment, resval *tags) {
   char *half;
   char *key;
   int klen  = 0;
-  SV* value = NULL;
+  resval *value = NULL;
 
   if (!comment) {
     DEBUG_TRACE("Empty comment, skipping...\n");
@@ -124,8 +157,8 @@ void _split_vorbis_comment(char* comment, HV* tags) {
   }
 
   klen  = half - comment;
-  value = newSVpv(half + 1, 0);
-  sv_utf8_decode(value);
+  value = res_newpv(half + 1, 0);
+  res_utf8_decode(value);
 
   /* Is there a better way to do this? */
   New(0, key, klen + 1, char);
@@ -133,42 +166,42 @@ void _split_vorbis_comment(char* comment, HV* tags) {
   key[klen] = '\0';
   key = upcase(key);
 
-  if (hv_exists(tags, key, klen)) {
+  if (res_hv_exists(tags, key)) {
     /* fetch the existing key */
-    SV **entry = my_hv_fetch(tags, key);
+    resval **entry = res_hv_fetch(tags, key);
 
-    if (SvOK(*entry)) {
+    if (res_type(*entry) != RES_UNDEF) {
 
       // A normal string entry, convert to array.
-      if (SvTYPE(*entry) == SVt_PV) {
-        AV *ref = newAV();
-        av_push(ref, newSVsv(*entry));
-        av_push(ref, value);
-        my_hv_store(tags, key, newRV_noinc((SV*)ref));
-
-      } else if (SvTYPE(SvRV(*entry)) == SVt_PVAV) {
-        av_push((AV *)SvRV(*entry), value);
+      if (res_ispv(*entry)) {
+        resval *ref = res_newav();
+        res_av_push(ref, res_newsv(*entry));
+        res_av_push(ref, value);
+        res_hv_store(tags, key, ref);
+
+      } else if (res_isav(*entry)) {
+        res_av_push(*entry, value);
       }
     }
 
   } else {
-    my_hv_store(tags, key, value);
+    res_hv_store(tags, key, value);
   }
 
   Safefree(key);
 }
 
 int32_t
-skip_id3v2(PerlIO* infile) {
+skip_id3v2(ScanIO *infile) {
   unsigned char buf[10];
   uint32_t has_footer;
   int32_t  size;
 
   // seek to first byte of mpc data
-  if (PerlIO_seek(infile, 0, SEEK_SET) < 0)
+  if (scanio_seek(infile, 0, SEEK_SET) < 0)
     return 0;
 
-  PerlIO_read(infile, &buf, sizeof(buf));
+  scanio_read(infile, &buf, sizeof(buf));
 
   // check id3-tag
   if (memcmp(buf, "ID3", 3) != 0)
@@ -203,28 +236,9 @@ _bitrate(uint32_t audio_size, uint32_t song_length_ms)
 }
 
 off_t
-_file_size(PerlIO *infile)
+_file_size(ScanIO *infile)
 {
-#ifdef _MSC_VER
-  // Win32 doesn't work right with fstat
-  off_t file_size;
-  
-  PerlIO_seek(infile, 0, SEEK_END);
-  file_size = PerlIO_tell(infile);
-  PerlIO_seek(infile, 0, SEEK_SET);
-  
-  return file_size;
-#else
-  struct stat buf;
-  
-  if ( !fstat( PerlIO_fileno(infile), &buf ) ) {
-    return buf.st_size;
-  }
-  
-  warn("Unable to stat: %s\n", strerror(errno));
-  
-  return 0;
-#endif
+  return scanio_size(infile);
 }
 
 int
@@ -278,20 +292,20 @@ _decode_base64(char *s)
   return n;
 }
 
-HV *
-_decode_flac_picture(PerlIO *infile, Buffer *buf, uint32_t *pic_length)
+resval *
+_decode_flac_picture(ScanIO *infile, Buffer *buf, uint32_t *pic_length)
 {
   uint32_t mime_length;
   uint32_t desc_length;
-  SV *desc;
-  HV *picture = newHV();
+  resval *desc;
+  resval *picture = res_newhv();
   
   // Check we have enough for picture_type and mime_length
   if ( !_check_buf(infile, buf, 8, DEFAULT_BLOCK_SIZE) ) {
     return NULL;
   }
     
-  my_hv_store( picture, "picture_type", newSVuv( buffer_get_int(buf) ) );
+  res_hv_store( picture, "picture_type", res_newuv( buffer_get_int(buf) ) );
   
   mime_length = buffer_get_int(buf);
   DEBUG_TRACE("  mime_length: %d\n", mime_length);
@@ -301,7 +315,7 @@ _decode_flac_picture(PerlIO *infile, Buffer *buf, uint32_t *pic_length)
     return NULL;
   }
   
-  my_hv_store( picture, "mime_type", newSVpvn( buffer_ptr(buf), mime_length ) );
+  res_hv_store( picture, "mime_type", res_newpvn( buffer_ptr(buf), mime_length ) );
   buffer_consume(buf, mime_length);
   
   desc_length = buffer_get_int(buf);
@@ -312,28 +326,29 @@ _decode_flac_picture(PerlIO *infile, Buffer *buf, uint32_t *pic_length)
     return NULL;
   }
   
-  desc = newSVpvn( buffer_ptr(buf), desc_length );
-  sv_utf8_decode(desc); // XXX needs test with utf8 desc
-  my_hv_store( picture, "description", desc );
+  desc = res_newpvn( buffer_ptr(buf), desc_length );
+  res_utf8_decode(desc); // XXX needs test with utf8 desc
+  res_hv_store( picture, "description", desc );
   buffer_consume(buf, desc_length);
   
-  my_hv_store( picture, "width", newSVuv( buffer_get_int(buf) ) );
-  my_hv_store( picture, "height", newSVuv( buffer_get_int(buf) ) );
-  my_hv_store( picture, "depth", newSVuv( buffer_get_int(buf) ) );
-  my_hv_store( picture, "color_index", newSVuv( buffer_get_int(buf) ) );
+  res_hv_store( picture, "width", res_newuv( buffer_get_int(buf) ) );
+  res_hv_store( picture, "height", res_newuv( buffer_get_int(buf) ) );
+  res_hv_store( picture, "depth", res_newuv( buffer_get_int(buf) ) );
+  res_hv_store( picture, "color_index", res_newuv( buffer_get_int(buf) ) );
   
   *pic_length = buffer_get_int(buf);
   DEBUG_TRACE("  pic_length: %d\n", *pic_length);
   
   if ( _env_true("AUDIO_SCAN_NO_ARTWORK") ) {
-    my_hv_store( picture, "image_data", newSVuv(*pic_length) );
+    // The offset is set by the caller if the image is stored in the file as-is
+    res_hv_store( picture, "image_data", res_newart(0, *pic_length) );
   }
   else {
     if ( !_check_buf(infile, buf, *pic_length, *pic_length) ) {
       return NULL;
     }
     
-    my_hv_store( picture, "image_data", newSVpvn( buffer_ptr(buf), *pic_length ) );
+    res_hv_store( picture, "image_data", res_newblob( buffer_ptr(buf), *pic_length ) );
   }
   
   return picture;
@@ -21,11 +21,11 @@
 #include "dsdiff.h"
 
 typedef struct {
-  PerlIO *infile;
+  ScanIO *infile;
   Buffer *buf;
   char *file;
-  HV *info;
-  HV *tags;
+  resval *info;
+  resval *tags;
   uint32_t channel_num;
   uint32_t sampling_frequency;
   uint64_t metadata_offset; 
@@ -47,7 +47,7 @@ parse_diin_chunk(dsdiff_info *dsdiff, uint64_t size)
 		uint32_t count;
     
 		buffer_clear(dsdiff->buf);
-		PerlIO_seek(dsdiff->infile, dsdiff->offset + ck_offset, SEEK_SET);
+		scanio_seek(dsdiff->infile, dsdiff->offset + ck_offset, SEEK_SET);
 		
 		if ( !_check_buf(dsdiff->infile, dsdiff->buf, 12, DSDIFF_BLOCK_SIZE) ) return ERROR_CK;
 		strncpy(chunk_id, (char *)buffer_ptr(dsdiff->buf), 4);
@@ -92,7 +92,7 @@ parse_prop_chunk(dsdiff_info *dsdiff, uint64_t size)
 		uint64_t chunk_size;
     
 		buffer_clear(dsdiff->buf);
-		PerlIO_seek(dsdiff->infile, dsdiff->offset + ck_offset, SEEK_SET);
+		scanio_seek(dsdiff->infile, dsdiff->offset + ck_offset, SEEK_SET);
 		
 		if ( !_check_buf(dsdiff->infile, dsdiff->buf, 16, DSDIFF_BLOCK_SIZE) ) return ERROR_CK;
 		strncpy(chunk_id, (char *)buffer_ptr(dsdiff->buf), 4);
@@ -119,7 +119,7 @@ parse_prop_chunk(dsdiff_info *dsdiff, uint64_t size)
 }
 
 int
-get_dsdiff_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
+get_dsdiff_metadata(ScanIO *infile, char *file, resval *info, resval *tags)
 {
   Buffer buf;
   uint8_t flags = 0;
@@ -158,23 +158,23 @@ get_dsdiff_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
     dsdiff.offset += 12;
 		
     if (strncmp( (char *)buffer_ptr(&buf), "DSD ", 4 ) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid DSDIFF file header: %s\n", file);
+      LOG_ERROR("Invalid DSDIFF file header: %s\n", file);
       err = -1;
       goto out;
     }
     dsdiff.offset += 4;
 		
-    my_hv_store( info, "file_size", newSVuv(file_size) );
+    res_hv_store( info, "file_size", res_newuv(file_size) );
 		
     while (dsdiff.offset <= total_size - 12) {
       char chunk_id[5];
       uint64_t chunk_size;
 
       buffer_clear(&buf);
-      PerlIO_seek(infile, dsdiff.offset, SEEK_SET);
+      scanio_seek(infile, dsdiff.offset, SEEK_SET);
 			
       if ( !_check_buf(infile, &buf, 12, DSDIFF_BLOCK_SIZE) ) {
-				PerlIO_printf(PerlIO_stderr(), "DSDIFF file error: %s\n", file);
+				LOG_ERROR("DSDIFF file error: %s\n", file);
 				err = -1;
 				goto out;
       };
@@ -200,7 +200,7 @@ get_dsdiff_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
       }
 			
       if ( flags & ERROR_CK ) {
-				PerlIO_printf(PerlIO_stderr(), "DSDIFF chunk error: %s\n", file);
+				LOG_ERROR("DSDIFF chunk error: %s\n", file);
 				err = -1;
 				goto out;
       };
@@ -211,7 +211,7 @@ get_dsdiff_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
     DEBUG_TRACE("Finished parsing...\n");
 		
     if ((flags & DSD_CK) == 0 || (flags & PROP_CK) == 0) {
-      PerlIO_printf(PerlIO_stderr(), "DSDIFF file error: %s\n", file);
+      LOG_ERROR("DSDIFF file error: %s\n", file);
       err = -1;
       goto out;
     };
@@ -222,27 +222,27 @@ get_dsdiff_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
     DEBUG_TRACE("song_length_ms: %f\n", (dsdiff.sample_count * 1000.) / dsdiff.sampling_frequency);
     DEBUG_TRACE("channels: %" PRIu32 "\n", dsdiff.channel_num);
 		
-    my_hv_store( info, "audio_offset", newSVuv(dsdiff.audio_offset) );
-    my_hv_store( info, "audio_size", newSVuv(dsdiff.sample_count / 8 * dsdiff.channel_num) );
-    my_hv_store( info, "samplerate", newSVuv(dsdiff.sampling_frequency) );
-    my_hv_store( info, "song_length_ms", newSVuv( (dsdiff.sample_count * 1000.) / dsdiff.sampling_frequency ) );
-    my_hv_store( info, "channels", newSVuv(dsdiff.channel_num) );
-    my_hv_store( info, "bits_per_sample", newSVuv(1) );
+    res_hv_store( info, "audio_offset", res_newuv(dsdiff.audio_offset) );
+    res_hv_store( info, "audio_size", res_newuv(dsdiff.sample_count / 8 * dsdiff.channel_num) );
+    res_hv_store( info, "samplerate", res_newuv(dsdiff.sampling_frequency) );
+    res_hv_store( info, "song_length_ms", res_newuv( (dsdiff.sample_count * 1000.) / dsdiff.sampling_frequency ) );
+    res_hv_store( info, "channels", res_newuv(dsdiff.channel_num) );
+    res_hv_store( info, "bits_per_sample", res_newuv(1) );
 
     if (dsdiff.tag_diar_artist) {
-      my_hv_store( info, "tag_diar_artist", newSVpv(dsdiff.tag_diar_artist, 0) );
+      res_hv_store( info, "tag_diar_artist", res_newpv(dsdiff.tag_diar_artist, 0) );
       free(dsdiff.tag_diar_artist);
     }
 		
     if (dsdiff.tag_diti_title) {
-      my_hv_store( info, "tag_diti_title", newSVpv(dsdiff.tag_diti_title, 0) );
+      res_hv_store( info, "tag_diti_title", res_newpv(dsdiff.tag_diti_title, 0) );
       free(dsdiff.tag_diti_title);
     }
 		
     DEBUG_TRACE("Stored info values...\n");
 		
     if (dsdiff.metadata_offset) {
-      PerlIO_seek(infile, dsdiff.metadata_offset, SEEK_SET);
+      scanio_seek(infile, dsdiff.metadata_offset, SEEK_SET);
       buffer_clear(&buf);
       if ( !_check_buf(infile, &buf, 10, DSDIFF_BLOCK_SIZE) ) {
 				goto out;
@@ -258,7 +258,7 @@ get_dsdiff_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
       }
     }
   } else {
-    PerlIO_printf(PerlIO_stderr(), "Invalid DSF file: missing DSD header: %s\n", file);
+    LOG_ERROR("Invalid DSF file: missing DSD header: %s\n", file);
     err = -1;
     goto out;
   }
@@ -17,7 +17,7 @@
 #include "dsf.h"
 
 int
-get_dsf_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
+get_dsf_metadata(ScanIO *infile, char *file, resval *info, resval *tags)
 {
   Buffer buf;
   off_t file_size;
@@ -39,7 +39,7 @@ get_dsf_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
   if ( !strncmp( (char *)buffer_ptr(&buf), "DSD ", 4 ) ) {
     buffer_consume(&buf, 4);
   
-    my_hv_store( info, "file_size", newSVuv(file_size) );
+    res_hv_store( info, "file_size", res_newuv(file_size) );
 		
     chunk_size = buffer_get_int64_le(&buf);
     total_size = buffer_get_int64_le(&buf);
@@ -47,13 +47,13 @@ get_dsf_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
 		
     if ((chunk_size != 28) || 
 				metadata_offset > total_size) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid DSF file header: %s\n", file);
+      LOG_ERROR("Invalid DSF file header: %s\n", file);
       err = -1;
       goto out;
     }
 		
     if ( strncmp( (char *)buffer_ptr(&buf), "fmt ", 4 ) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid DSF file: missing fmt header: %s\n", file);
+      LOG_ERROR("Invalid DSF file: missing fmt header: %s\n", file);
       err = -1;
       goto out;
     }
@@ -76,7 +76,7 @@ get_dsf_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
 				 (channel_num != 2) ||
 				 (block_size_per_channel != 4096) ||
 				 strncmp( (char *)buffer_ptr(&buf), "\0\0\0\0", 4 ) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid DSF file: unsupported fmt header: %s\n", file);
+      LOG_ERROR("Invalid DSF file: unsupported fmt header: %s\n", file);
       err = -1;
       goto out;
     }
@@ -84,7 +84,7 @@ get_dsf_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
     buffer_consume(&buf, 4);
     
     if ( strncmp( (char *)buffer_ptr(&buf), "data", 4 ) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid DSF file: missing data header: %s\n", file);
+      LOG_ERROR("Invalid DSF file: missing data header: %s\n", file);
       err = -1;
       goto out;
     }
@@ -93,16 +93,16 @@ get_dsf_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
 		
     sample_bytes = buffer_get_int64_le(&buf) - 12;
 		
-    my_hv_store( info, "audio_offset", newSVuv( 28 + 52 + 12 ) );
-    my_hv_store( info, "audio_size", newSVuv(sample_bytes) );
-    my_hv_store( info, "samplerate", newSVuv(sampling_frequency) );
-    my_hv_store( info, "song_length_ms", newSVuv( (sample_count * 1000.) / sampling_frequency ) );
-    my_hv_store( info, "channels", newSVuv(channel_num) );
-    my_hv_store( info, "bits_per_sample", newSVuv(1) );
-    my_hv_store( info, "block_size_per_channel", newSVuv(block_size_per_channel) );
+    res_hv_store( info, "audio_offset", res_newuv( 28 + 52 + 12 ) );
+    res_hv_store( info, "audio_size", res_newuv(sample_bytes) );
+    res_hv_store( info, "samplerate", res_newuv(sampling_frequency) );
+    res_hv_store( info, "song_length_ms", res_newuv( (sample_count * 1000.) / sampling_frequency ) );
+    res_hv_store( info, "channels", res_newuv(channel_num) );
+    res_hv_store( info, "bits_per_sample", res_newuv(1) );
+    res_hv_store( info, "block_size_per_channel", res_newuv(block_size_per_channel) );
 		
     if (metadata_offset) {
-      PerlIO_seek(infile, metadata_offset, SEEK_SET);
+      scanio_seek(infile, metadata_offset, SEEK_SET);
       buffer_clear(&buf);
       if ( !_check_buf(infile, &buf, 10, WAV_BLOCK_SIZE) ) {
 				goto out;
@@ -119,7 +119,7 @@ get_dsf_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
     }
   }
   else {
-    PerlIO_printf(PerlIO_stderr(), "Invalid DSF file: missing DSD header: %s\n", file);
+    LOG_ERROR("Invalid DSF file: missing DSD header: %s\n", file);
     err = -1;
     goto out;
   }
@@ -17,7 +17,7 @@
 #include "flac.h"
 
 int
-get_flac_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
+get_flac_metadata(ScanIO *infile, char *file, resval *info, resval *tags)
 {
   flacinfo *flac = _flac_parse(infile, file, info, tags, 0);
   
@@ -27,7 +27,7 @@ get_flac_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
 }
 
 flacinfo *
-_flac_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
+_flac_parse(ScanIO *infile, char *file, resval *info, resval *tags, uint8_t seeking)
 {
   int err = 0;
   int done = 0;
@@ -82,7 +82,7 @@ _flac_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
     else {
        buffer_clear(flac->buf);
        
-      if (PerlIO_seek(infile, id3_size, SEEK_SET) < 0) {
+      if (scanio_seek(infile, id3_size, SEEK_SET) < 0) {
         err = -1;
         goto out;
       }
@@ -97,7 +97,7 @@ _flac_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
   // Verify fLaC magic
   bptr = buffer_ptr(flac->buf);
   if ( memcmp(bptr, "fLaC", 4) != 0 ) {
-    PerlIO_printf(PerlIO_stderr(), "Not a valid FLAC file: %s\n", file);
+    LOG_ERROR("Not a valid FLAC file: %s\n", file);
     err = -1;
     goto out;
   }
@@ -211,10 +211,10 @@ _flac_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
     } 
   }
   
-  song_length_ms = SvIV( *( my_hv_fetch(info, "song_length_ms") ) );
+  song_length_ms = res_iv( *( res_hv_fetch(info, "song_length_ms") ) );
   
   if (song_length_ms > 0) {
-    my_hv_store( info, "bitrate", newSVuv( _bitrate(flac->file_size - flac->audio_offset, song_length_ms) ) );
+    res_hv_store( info, "bitrate", res_newuv( _bitrate(flac->file_size - flac->audio_offset, song_length_ms) ) );
   }
   else {
     if (!seeking) {
@@ -237,9 +237,9 @@ _flac_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
         if ( _flac_first_last_sample(flac, flac->file_size - flac->max_framesize, &frame_offset, &tmp, &last_sample, 0) ) {
           if (flac->samplerate) {
             song_length_ms = (uint32_t)(( ((last_sample - first_sample) * 1.0) / flac->samplerate) * 1000);
-            my_hv_store( info, "song_length_ms", newSVuv(song_length_ms) );
-            my_hv_store( info, "bitrate", newSVuv( _bitrate(flac->file_size - flac->audio_offset, song_length_ms) ) );
-            my_hv_store( info, "total_samples", newSVuv( last_sample - first_sample ) );
+            res_hv_store( info, "song_length_ms", res_newuv(song_length_ms) );
+            res_hv_store( info, "bitrate", res_newuv( _bitrate(flac->file_size - flac->audio_offset, song_length_ms) ) );
+            res_hv_store( info, "total_samples", res_newuv( last_sample - first_sample ) );
           }
           
           DEBUG_TRACE("  Last sample: %llu (offset %llu)\n", last_sample, frame_offset);
@@ -251,9 +251,9 @@ _flac_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
     }
   }
   
-  my_hv_store( info, "file_size", newSVuv(flac->file_size) );
-  my_hv_store( info, "audio_offset", newSVuv(flac->audio_offset) );
-  my_hv_store( info, "audio_size", newSVuv(flac->file_size - flac->audio_offset) );
+  res_hv_store( info, "file_size", res_newuv(flac->file_size) );
+  res_hv_store( info, "audio_offset", res_newuv(flac->audio_offset) );
+  res_hv_store( info, "audio_size", res_newuv(flac->file_size - flac->audio_offset) );
   
   // Parse ID3 last, due to an issue with libid3tag screwing
   // up the filehandle
@@ -270,24 +270,61 @@ out:
 
 // offset is in ms, does sample-accurate seeking, using seektable if available
 // based on libFLAC seek_to_absolute_sample_
-static int
-flac_find_frame(PerlIO *infile, char *file, int offset)
+static off_t
+flac_find_frame(ScanIO *infile, char *file, int offset)
 {
-  off_t frame_offset = -1;
-  uint64_t target_sample;
-  uint32_t approx_bytes_per_frame;
-  uint64_t lower_bound, upper_bound, lower_bound_sample, upper_bound_sample;
-  int64_t pos = -1;
-  int8_t max_tries = 100;
+  void *flac = flac_seek_open(infile, file);
+  off_t frame_offset = flac_seek(flac, offset, NULL);
+  
+  flac_seek_close(flac);
   
+  return frame_offset;
+}
+
+// Parses the metadata blocks once, keeping streaminfo and the seektable
+static void *
+flac_seek_open(ScanIO *infile, char *file)
+{
   // We need to read all metadata first to get some data we need to calculate
-  HV *info = newHV();
-  HV *tags = newHV();
+  resval *info = res_newhv();
+  resval *tags = res_newhv();
   flacinfo *flac = _flac_parse(infile, file, info, tags, 1);
   
   // Allocate scratch buffer
   Newz(0, flac->scratch, sizeof(Buffer), Buffer);
   
+  return flac;
+}
+
+static void
+flac_seek_close(void *state)
+{
+  flacinfo *flac = (flacinfo *)state;
+  
+  // free seek struct
+  Safefree(flac->seekpoints);
+  
+  // free scratch buffer
+  if (flac->scratch->alloc)
+    buffer_free(flac->scratch);
+  Safefree(flac->scratch);
+  
+  Safefree(flac);
+}
+
+static off_t
+flac_seek(void *state, int offset, resval *info)
+{
+  flacinfo *flac = (flacinfo *)state;
+  off_t frame_offset = -1;
+  uint64_t target_sample;
+  uint32_t approx_bytes_per_frame;
+  uint64_t lower_bound, upper_bound, lower_bound_sample, upper_bound_sample;
+  int64_t pos = -1;
+  int8_t max_tries = 100;
+  uint8_t hinted = 0;
+  uint8_t found = 0;
+  
   if ( !flac->samplerate || !flac->total_samples ) {
     // Can't seek in file without samplerate
     goto out;
@@ -369,6 +406,21 @@ flac_find_frame(PerlIO *infile, char *file, int offset)
     }
   }
   
+  // The frame found by an earlier seek works like another seek point
+  if (
+       flac->hint_offset > lower_bound
+    && flac->hint_offset < upper_bound
+    && flac->hint_sample <= target_sample
+    && flac->hint_sample < upper_bound_sample
+  ) {
+    lower_bound        = flac->hint_offset;
+    lower_bound_sample = flac->hint_sample;
+    hinted             = 1;
+    
+    DEBUG_TRACE("  previous seek new_lower_bound %llu, new_lower_bound_sample %llu\n",
+      lower_bound, lower_bound_sample);
+  }
+  
   if (upper_bound_sample == lower_bound_sample)
     upper_bound_sample++;
   
@@ -431,6 +483,9 @@ flac_find_frame(PerlIO *infile, char *file, int offset)
     
     if (target_sample >= this_frame_sample && target_sample < last_sample) {
       DEBUG_TRACE("    Found target frame\n");
+      flac->hint_offset = frame_offset;
+      flac->hint_sample = this_frame_sample;
+      found = 1;
       break;
     }
     
@@ -456,19 +511,13 @@ flac_find_frame(PerlIO *infile, char *file, int offset)
   DEBUG_TRACE("max_tries: %d\n", max_tries);
   
 out:
-  // Don't leak
-  SvREFCNT_dec(info);
-  SvREFCNT_dec(tags);
   
-  // free seek struct
-  Safefree(flac->seekpoints);
-  
-  // free scratch buffer
-  if (flac->scratch->alloc)
-    buffer_free(flac->scratch);
-  Safefree(flac->scratch);
-  
-  Safefree(flac);
+  // Frame numbers in a damaged stream may not increase, search again from scratch
+  if (hinted && !found) {
+    DEBUG_TRACE("Not found after previous seek, retrying\n");
+    flac->hint_offset = 0;
+    return flac_seek(state, offset, info);
+  }
   
   return frame_offset;
 }
@@ -493,7 +542,7 @@ _flac_first_last_sample(flacinfo *flac, off_t seek_offset, off_t *frame_offset,
     goto out;
   }
   
-  if ( (PerlIO_seek(flac->infile, seek_offset, SEEK_SET)) == -1 ) {
+  if ( (scanio_seek(flac->infile, seek_offset, SEEK_SET)) == -1 ) {
     DEBUG_TRACE("  Error: seek failed\n");
     ret = -1;
     goto out;
@@ -509,15 +558,15 @@ _flac_first_last_sample(flacinfo *flac, off_t seek_offset, off_t *frame_offset,
   buf_size = buffer_len(flac->scratch);
 
   for (i = 0; i != buf_size - FLAC_HEADER_LEN; i++) {
-    // Verify sync and various reserved bits
-    if ( bptr[i] != 0xFF
-      || (bptr[i+1] >> 2) != 0x3E
-      || bptr[i+1] & 0x02
-      || bptr[i+3] & 0x01
-    ) {
-      continue;
+    // Find sync with the reserved bits clear
+    const unsigned char *sync = syncscan_find(&bptr[i], buf_size - FLAC_HEADER_LEN - i + 3, &syncscan_flac);
+    
+    if ( !sync ) {
+      break;
     }
     
+    i = sync - bptr;
+    
     DEBUG_TRACE("Checking frame header @ %d: %0x %0x %0x %0x\n", (int)seek_offset + i, bptr[i], bptr[i+1], bptr[i+2], bptr[i+3]);
     
     // Verify we have a valid FLAC frame header
@@ -672,22 +721,22 @@ void
 _flac_parse_streaminfo(flacinfo *flac)
 {
   uint64_t tmp;
-  SV *md5;
+  resval *md5;
   unsigned char *bptr;
   int i;
   uint32_t song_length_ms;
   
   flac->min_blocksize = buffer_get_short(flac->buf);
-  my_hv_store( flac->info, "minimum_blocksize", newSVuv(flac->min_blocksize) );
+  res_hv_store( flac->info, "minimum_blocksize", res_newuv(flac->min_blocksize) );
   
   flac->max_blocksize = buffer_get_short(flac->buf);
-  my_hv_store( flac->info, "maximum_blocksize", newSVuv(flac->max_blocksize) );
+  res_hv_store( flac->info, "maximum_blocksize", res_newuv(flac->max_blocksize) );
   
   flac->min_framesize = buffer_get_int24(flac->buf);
-  my_hv_store( flac->info, "minimum_framesize", newSVuv(flac->min_framesize) );
+  res_hv_store( flac->info, "minimum_framesize", res_newuv(flac->min_framesize) );
   
   flac->max_framesize = buffer_get_int24(flac->buf);
-  my_hv_store( flac->info, "maximum_framesize", newSVuv(flac->max_framesize) );
+  res_hv_store( flac->info, "maximum_framesize", res_newuv(flac->max_framesize) );
   
   if ( !flac->max_framesize ) {
     flac->max_framesize = FLAC_MAX_FRAMESIZE;
@@ -700,50 +749,49 @@ _flac_parse_streaminfo(flacinfo *flac)
   flac->channels        = (uint32_t)(((tmp >> 41) & 0x7) + 1);
   flac->bits_per_sample = (uint32_t)(((tmp >> 36) & 0x1F) + 1);
   
-  my_hv_store( flac->info, "samplerate", newSVuv(flac->samplerate) );
-  my_hv_store( flac->info, "channels", newSVuv(flac->channels) );
-  my_hv_store( flac->info, "bits_per_sample", newSVuv(flac->bits_per_sample) );
-  my_hv_store( flac->info, "total_samples", newSVnv(flac->total_samples) );
+  res_hv_store( flac->info, "samplerate", res_newuv(flac->samplerate) );
+  res_hv_store( flac->info, "channels", res_newuv(flac->channels) );
+  res_hv_store( flac->info, "bits_per_sample", res_newuv(flac->bits_per_sample) );
+  res_hv_store( flac->info, "total_samples", res_newnv(flac->total_samples) );
   
   bptr = buffer_ptr(flac->buf);
-  md5 = newSVpvf("%02x", bptr[0]);
+  md5 = res_newpvf("%02x", bptr[0]);
 
   for (i = 1; i < 16; i++) {
-    sv_catpvf(md5, "%02x", bptr[i]);
+    res_catpvf(md5, "%02x", bptr[i]);
   }
 
-  my_hv_store(flac->info, "audio_md5", md5);
+  res_hv_store(flac->info, "audio_md5", md5);
   buffer_consume(flac->buf, 16);
   
   song_length_ms = (uint32_t)(( (flac->total_samples * 1.0) / flac->samplerate) * 1000);
-  my_hv_store( flac->info, "song_length_ms", newSVuv(song_length_ms) );
+  res_hv_store( flac->info, "song_length_ms", res_newuv(song_length_ms) );
 }
 
 void
 _flac_parse_application(flacinfo *flac, int len)
 {
-  HV *app;
-  SV *id = newSVuv( buffer_get_int(flac->buf) );
-  SV *data = newSVpvn( buffer_ptr(flac->buf), len - 4 );
+  resval *app;
+  resval *id = res_newuv( buffer_get_int(flac->buf) );
+  resval *data = res_newpvn( buffer_ptr(flac->buf), len - 4 );
   buffer_consume(flac->buf, len - 4);
   
-  if ( my_hv_exists(flac->tags, "APPLICATION") ) {
+  if ( res_hv_exists(flac->tags, "APPLICATION") ) {
     // XXX needs test
-    SV **entry = my_hv_fetch(flac->tags, "APPLICATION");
+    resval **entry = res_hv_fetch(flac->tags, "APPLICATION");
     if (entry != NULL) {
-      app = (HV *)SvRV(*entry);
-      my_hv_store_ent(app, id, data);
+      app = *entry;
+      res_hv_store_ent(app, id, data);
     }
   }
   else {
-    app = newHV();
+    app = res_newhv();
     
-    my_hv_store_ent(app, id, data);
+    res_hv_store_ent(app, id, data);
 
-    my_hv_store( flac->tags, "APPLICATION", newRV_noinc( (SV *)app ) );
+    res_hv_store( flac->tags, "APPLICATION", app );
   }
   
-  SvREFCNT_dec(id);
 }
 
 void
@@ -777,7 +825,7 @@ _flac_parse_seektable(flacinfo *flac, int len)
 void
 _flac_parse_cuesheet(flacinfo *flac)
 {
-  AV *cue = newAV();
+  resval *cue = res_newav();
   unsigned char *bptr;
   uint64_t leadin;
   uint8_t is_cd;
@@ -787,7 +835,7 @@ _flac_parse_cuesheet(flacinfo *flac)
   // Catalog number, may be empty
   bptr = buffer_ptr(flac->buf);
   if (bptr[0]) {
-    av_push( cue, newSVpvf("CATALOG %s\n", bptr) );
+    res_av_push( cue, res_newpvf("CATALOG %s\n", bptr) );
   }
   buffer_consume(flac->buf, 128);
   
@@ -799,7 +847,7 @@ _flac_parse_cuesheet(flacinfo *flac)
   num_tracks = (uint8_t)buffer_get_char(flac->buf);
   DEBUG_TRACE("  number of cue tracks: %d\n", num_tracks);
   
-  av_push( cue, newSVpvf("FILE \"%s\" FLAC\n", flac->file) );
+  res_av_push( cue, res_newpvf("FILE \"%s\" FLAC\n", flac->file) );
   
   while (num_tracks--) {
     char isrc[13];
@@ -824,21 +872,21 @@ _flac_parse_cuesheet(flacinfo *flac)
     DEBUG_TRACE("    track %d: offset %llu, type %d, pre %d, num_index %d\n", tracknum, track_offset, type, pre, num_index);
     
     if (tracknum > 0 && tracknum < 100) {
-      av_push( cue, newSVpvf("  TRACK %02u %s\n",
+      res_av_push( cue, res_newpvf("  TRACK %02u %s\n",
         tracknum, type == 0 ? "AUDIO" : "DATA"
       ) );
       
       if (pre) {
-        av_push( cue, newSVpv("    FLAGS PRE\n", 0) );
+        res_av_push( cue, res_newpv("    FLAGS PRE\n", 0) );
       }
       
       if (isrc[0]) {
-        av_push( cue, newSVpvf("    ISRC %s\n", isrc) );
+        res_av_push( cue, res_newpvf("    ISRC %s\n", isrc) );
       }
     }
     
     while (num_index--) {
-      SV *index;
+      resval *index;
       
       uint64_t index_offset = buffer_get_int64(flac->buf);
       uint8_t index_num = (uint8_t)buffer_get_char(flac->buf);
@@ -846,7 +894,7 @@ _flac_parse_cuesheet(flacinfo *flac)
       
       DEBUG_TRACE("      index %d, offset %llu\n", index_num, index_offset);
       
-      index = newSVpvf("    INDEX %02u ", index_num);
+      index = res_newpvf("    INDEX %02u ", index_num);
       
       if (is_cd) {
         uint64_t frame = ((track_offset + index_offset) / (flac->samplerate / 75));
@@ -858,49 +906,51 @@ _flac_parse_cuesheet(flacinfo *flac)
         frame /= 60;
         m = (uint8_t)frame;
 
-        sv_catpvf(index, "%02u:%02u:%02u\n", m, s, f);
+        res_catpvf(index, "%02u:%02u:%02u\n", m, s, f);
       }
       else {
         // XXX need test
         sprintf(decimal, "%"PRIu64, track_offset + index_offset);
-        sv_catpvf(index, "%s\n", decimal);
+        res_catpvf(index, "%s\n", decimal);
       }
       
-      av_push( cue, index );
+      res_av_push( cue, index );
     }
     
     if (tracknum == 170) {
       // Add lead-in and lead-out
       sprintf(decimal, "%"PRIu64, leadin);
-      av_push( cue, newSVpvf("REM FLAC__lead-in %s\n", decimal) );
+      res_av_push( cue, res_newpvf("REM FLAC__lead-in %s\n", decimal) );
       
       // XXX is tracknum right here?
       sprintf(decimal, "%"PRIu64, track_offset);
-      av_push( cue, newSVpvf("REM FLAC__lead-out %u %s\n", tracknum, decimal) );
+      res_av_push( cue, res_newpvf("REM FLAC__lead-out %u %s\n", tracknum, decimal) );
     }
   }
   
-  my_hv_store( flac->tags, "CUESHEET_BLOCK", newRV_noinc( (SV *)cue ) );
+  res_hv_store( flac->tags, "CUESHEET_BLOCK", cue );
 }
 
 int
 _flac_parse_picture(flacinfo *flac)
 {
-  AV *pictures;
-  HV *picture;
+  resval *pictures;
+  resval *picture;
   int ret = 1;
   uint32_t pic_length;
   
   picture = _decode_flac_picture(flac->infile, flac->buf, &pic_length);
   if ( !picture ) {
-    PerlIO_printf(PerlIO_stderr(), "Invalid FLAC file: %s, bad picture block\n", flac->file);
+    LOG_ERROR("Invalid FLAC file: %s, bad picture block\n", flac->file);
     ret = 0;
     goto out;
   }
   
   // Skip past pic data if necessary
   if ( _env_true("AUDIO_SCAN_NO_ARTWORK") ) {
-    my_hv_store( picture, "offset", newSVuv(flac->audio_offset - pic_length) );
+    resval **image = res_hv_fetch(picture, "image_data");
+    (*image)->u.art.offset = flac->audio_offset - pic_length;
+    res_hv_store( picture, "offset", res_newuv((*image)->u.art.offset) );
     _flac_skip(flac, pic_length);
   }
   else {
@@ -909,19 +959,19 @@ _flac_parse_picture(flacinfo *flac)
   
   DEBUG_TRACE("  found picture of length %d\n", pic_length);
   
-  if ( my_hv_exists(flac->tags, "ALLPICTURES") ) {
-    SV **entry = my_hv_fetch(flac->tags, "ALLPICTURES");
+  if ( res_hv_exists(flac->tags, "ALLPICTURES") ) {
+    resval **entry = res_hv_fetch(flac->tags, "ALLPICTURES");
     if (entry != NULL) {
-      pictures = (AV *)SvRV(*entry);
-      av_push( pictures, newRV_noinc( (SV *)picture ) );
+      pictures = *entry;
+      res_av_push( pictures, picture );
     }
   }
   else {
-    pictures = newAV();
+    pictures = res_newav();
     
-    av_push( pictures, newRV_noinc( (SV *)picture ) );
+    res_av_push( pictures, picture );
 
-    my_hv_store( flac->tags, "ALLPICTURES", newRV_noinc( (SV *)pictures ) );
+    res_hv_store( flac->tags, "ALLPICTURES", pictures );
   }
 
 out:
@@ -1090,9 +1140,9 @@ _flac_skip(flacinfo *flac, uint32_t size)
     DEBUG_TRACE("  skipped buffer data size %d\n", size);
   }
   else {
-    PerlIO_seek(flac->infile, size - buffer_len(flac->buf), SEEK_CUR);
+    scanio_seek(flac->infile, size - buffer_len(flac->buf), SEEK_CUR);
     buffer_clear(flac->buf);
     
-    DEBUG_TRACE("  seeked past %d bytes to %d\n", size, (int)PerlIO_tell(flac->infile));
+    DEBUG_TRACE("  seeked past %d bytes to %d\n", size, (int)scanio_tell(flac->infile));
   }
 }
@@ -40,7 +40,7 @@ _varint(unsigned char *buf, int length)
 }
 
 int
-parse_id3(PerlIO *infile, char *file, HV *info, HV *tags, uint32_t seek, off_t file_size)
+parse_id3(ScanIO *infile, char *file, resval *info, resval *tags, uint32_t seek, off_t file_size)
 {
   int err = 0;
   unsigned char *bptr;
@@ -60,7 +60,7 @@ parse_id3(PerlIO *infile, char *file, HV *info, HV *tags, uint32_t seek, off_t f
 
   if ( !seek ) {
     // Check for ID3v1 tag first
-    PerlIO_seek(infile, file_size - 128, SEEK_SET);
+    scanio_seek(infile, file_size - 128, SEEK_SET);
     if ( !_check_buf(infile, id3->buf, 128, 128) ) {
       err = -1;
       goto out;
@@ -73,7 +73,7 @@ parse_id3(PerlIO *infile, char *file, HV *info, HV *tags, uint32_t seek, off_t f
   }
 
   // Check for ID3v2 tag
-  PerlIO_seek(infile, seek, SEEK_SET);
+  scanio_seek(infile, seek, SEEK_SET);
   buffer_clear(id3->buf);
 
   // Read enough for header (10) + extended header size (4)
@@ -100,10 +100,186 @@ out:
   return err;
 }
 
+// Copies the data of the first frame with the given v2.4 id in the ID3v2 tag
+// at offset into data, stepping over the other frames without parsing them.
+// Returns 0 if there is no such frame, or it is compressed or encrypted.
+int
+id3_find_v2_frame(ScanIO *infile, char *file, uint32_t offset, char const *want, Buffer *data)
+{
+  int found = 0;
+  unsigned char *bptr;
+  Buffer buf;
+  id3info id3;
+
+  Zero(&id3, 1, id3info);
+  id3.infile = infile;
+  id3.file   = file;
+  id3.buf    = &buf;
+  id3.offset = offset;
+
+  buffer_init(&buf, ID3_BLOCK_SIZE);
+
+  scanio_seek(infile, offset, SEEK_SET);
+
+  if ( !_check_buf(infile, &buf, 14, ID3_BLOCK_SIZE) ) {
+    goto out;
+  }
+
+  bptr = buffer_ptr(&buf);
+  if ( !(
+    bptr[0] == 'I' && bptr[1] == 'D' && bptr[2] == '3' &&
+    bptr[3] < 0xff && bptr[4] < 0xff &&
+    bptr[6] < 0x80 && bptr[7] < 0x80 && bptr[8] < 0x80 && bptr[9] < 0x80
+  ) ) {
+    goto out;
+  }
+
+  buffer_consume(&buf, 3); // ID3
+
+  id3.version_major = buffer_get_char(&buf);
+  id3.version_minor = buffer_get_char(&buf);
+  id3.flags         = buffer_get_char(&buf);
+  id3.size_remain   = buffer_get_syncsafe(&buf, 4);
+
+  if (id3.flags & ID3_TAG_FLAG_UNSYNCHRONISATION && id3.version_major < 4) {
+    // Frame sizes are after unsync, so the whole tag has to be decoded, as in _id3_parse_v2
+    if ( !_check_buf(infile, &buf, id3.size_remain, id3.size_remain) ) {
+      goto out;
+    }
+
+    buffer_unview(&buf);
+    id3.size_remain = _id3_deunsync( buffer_ptr(&buf), id3.size_remain );
+  }
+
+  if (id3.flags & ID3_TAG_FLAG_EXTENDEDHEADER) {
+    uint32_t ehsize;
+
+    // v2.2 compressed tag
+    if (id3.version_major == 2) {
+      goto out;
+    }
+
+    // v2.3 size excludes itself, v2.4 size is syncsafe and includes itself
+    if (id3.version_major == 3) {
+      ehsize = buffer_get_int(&buf);
+    }
+    else {
+      ehsize = buffer_get_syncsafe(&buf, 4);
+      ehsize = ehsize < 4 ? 0 : ehsize - 4;
+    }
+
+    if (ehsize > id3.size_remain - 4) {
+      goto out;
+    }
+
+    _id3_skip(&id3, ehsize);
+    id3.size_remain -= ehsize + 4;
+  }
+
+  while ( id3.size_remain >= (id3.version_major == 2 ? 6 : 10) ) {
+    char id[5];
+    uint16_t flags = 0;
+    uint32_t size;
+
+    if ( !_check_buf(infile, &buf, 10, ID3_BLOCK_SIZE) ) {
+      break;
+    }
+
+    if (id3.version_major == 2) {
+      id3_compat const *compat;
+
+      buffer_get(&buf, &id, 3);
+      id[3] = 0;
+      size = buffer_get_int24(&buf);
+      id3.size_remain -= 6;
+
+      compat = _id3_compat_lookup((char *)&id, 3);
+      if (compat && compat->equiv) {
+        strncpy(id, compat->equiv, 4);
+      }
+      id[4] = 0;
+    }
+    else {
+      buffer_get(&buf, &id, 4);
+      id[4] = 0;
+
+      // iTunes writes non-syncsafe sizes in v2.4 tags too
+      if ( id3.version_major == 3 || _varint(buffer_ptr(&buf), 4) & 0x80 ) {
+        size = buffer_get_int(&buf);
+      }
+      else {
+        size = buffer_get_syncsafe(&buf, 4);
+      }
+
+      flags = buffer_get_short(&buf);
+      id3.size_remain -= 10;
+    }
+
+    if (id[0] == 0 || size > id3.size_remain) {
+      // padding, or a bad frame
+      break;
+    }
+
+    if ( strcmp(id, want) ) {
+      _id3_skip(&id3, size);
+      id3.size_remain -= size;
+      continue;
+    }
+
+    DEBUG_TRACE("Found %s frame, flags %x, size %d\n", id, flags, size);
+
+    if (id3.version_major == 3) {
+      if (flags & (ID3_FRAME_FLAG_V23_COMPRESSION | ID3_FRAME_FLAG_V23_ENCRYPTION)) {
+        break;
+      }
+
+      if (flags & ID3_FRAME_FLAG_V23_GROUPINGIDENTITY && size) {
+        buffer_consume(&buf, 1);
+        size--;
+      }
+    }
+    else if (id3.version_major == 4) {
+      if (flags & (ID3_FRAME_FLAG_V24_COMPRESSION | ID3_FRAME_FLAG_V24_ENCRYPTION)) {
+        break;
+      }
+
+      if (flags & ID3_FRAME_FLAG_V24_GROUPINGIDENTITY && size) {
+        buffer_consume(&buf, 1);
+        size--;
+      }
+
+      if (flags & ID3_FRAME_FLAG_V24_DATALENGTHINDICATOR && size >= 4) {
+        buffer_consume(&buf, 4);
+        size -= 4;
+      }
+    }
+
+    if ( !_check_buf(infile, &buf, size, size) ) {
+      break;
+    }
+
+    if (id3.version_major == 4 && flags & ID3_FRAME_FLAG_V24_UNSYNCHRONISATION) {
+      buffer_unview(&buf);
+      buffer_append( data, buffer_ptr(&buf), _id3_deunsync( buffer_ptr(&buf), size ) );
+    }
+    else {
+      buffer_append( data, buffer_ptr(&buf), size );
+    }
+
+    found = 1;
+    break;
+  }
+
+out:
+  buffer_free(&buf);
+
+  return found;
+}
+
 int
 _id3_parse_v1(id3info *id3)
 {
-  SV *tmp = NULL;
+  resval *tmp = NULL;
   uint8_t read = 0;
   unsigned char *bptr;
   uint8_t comment_len;
@@ -112,12 +288,9 @@ _id3_parse_v1(id3info *id3)
   buffer_consume(id3->buf, 3); // TAG
 
   read = _id3_get_v1_utf8_string(id3, &tmp, 30);
-  if (tmp && SvPOK(tmp) && sv_len(tmp)) {
-    DEBUG_TRACE("ID3v1 title: %s\n", SvPVX(tmp));
-    my_hv_store( id3->tags, ID3_FRAME_TITLE, tmp );
-  }
-  else {
-    if (tmp) SvREFCNT_dec(tmp);
+  if (tmp && res_ispv(tmp) && res_len(tmp)) {
+    DEBUG_TRACE("ID3v1 title: %s\n", res_pv(tmp));
+    res_hv_store( id3->tags, ID3_FRAME_TITLE, tmp );
   }
   if (read < 30) {
     buffer_consume(id3->buf, 30 - read);
@@ -125,42 +298,33 @@ _id3_parse_v1(id3info *id3)
 
   tmp = NULL;
   read = _id3_get_v1_utf8_string(id3, &tmp, 30);
-  if (tmp && SvPOK(tmp) && sv_len(tmp)) {
-    DEBUG_TRACE("ID3v1 artist: %s\n", SvPVX(tmp));
-    my_hv_store( id3->tags, ID3_FRAME_ARTIST, tmp );
+  if (tmp && res_ispv(tmp) && res_len(tmp)) {
+    DEBUG_TRACE("ID3v1 artist: %s\n", res_pv(tmp));
+    res_hv_store( id3->tags, ID3_FRAME_ARTIST, tmp );
     tmp = NULL;
   }
-  else {
-    if (tmp) SvREFCNT_dec(tmp);
-  }
   if (read < 30) {
     buffer_consume(id3->buf, 30 - read);
   }
 
   tmp = NULL;
   read = _id3_get_v1_utf8_string(id3, &tmp, 30);
-  if (tmp && SvPOK(tmp) && sv_len(tmp)) {
-    DEBUG_TRACE("ID3v1 album: %s\n", SvPVX(tmp));
-    my_hv_store( id3->tags, ID3_FRAME_ALBUM, tmp );
+  if (tmp && res_ispv(tmp) && res_len(tmp)) {
+    DEBUG_TRACE("ID3v1 album: %s\n", res_pv(tmp));
+    res_hv_store( id3->tags, ID3_FRAME_ALBUM, tmp );
     tmp = NULL;
   }
-  else {
-    if (tmp) SvREFCNT_dec(tmp);
-  }
   if (read < 30) {
     buffer_consume(id3->buf, 30 - read);
   }
 
   tmp = NULL;
   read = _id3_get_v1_utf8_string(id3, &tmp, 4);
-  if (tmp && SvPOK(tmp) && sv_len(tmp)) {
-    DEBUG_TRACE("ID3v1 year: %s\n", SvPVX(tmp));
-    my_hv_store( id3->tags, ID3_FRAME_YEAR, tmp );
+  if (tmp && res_ispv(tmp) && res_len(tmp)) {
+    DEBUG_TRACE("ID3v1 year: %s\n", res_pv(tmp));
+    res_hv_store( id3->tags, ID3_FRAME_YEAR, tmp );
     tmp = NULL;
   }
-  else {
-    if (tmp) SvREFCNT_dec(tmp);
-  }
   if (read < 4) {
     buffer_consume(id3->buf, 4 - read);
   }
@@ -169,28 +333,25 @@ _id3_parse_v1(id3info *id3)
   if (bptr[28] == 0 && bptr[29] != 0) {
     // ID3v1.1 track number is present
     comment_len = 28;
-    my_hv_store( id3->tags, ID3_FRAME_TRACK, newSVuv(bptr[29]) );
-    my_hv_store( id3->info, "id3_version", newSVpv( "ID3v1.1", 0 ) );
+    res_hv_store( id3->tags, ID3_FRAME_TRACK, res_newuv(bptr[29]) );
+    res_hv_store( id3->info, "id3_version", res_newpv( "ID3v1.1", 0 ) );
   }
   else {
     comment_len = 30;
-    my_hv_store( id3->info, "id3_version", newSVpv( "ID3v1", 0 ) );
+    res_hv_store( id3->info, "id3_version", res_newpv( "ID3v1", 0 ) );
   }
 
   tmp = NULL;
   read = _id3_get_v1_utf8_string(id3, &tmp, comment_len);
-  if (tmp && SvPOK(tmp) && sv_len(tmp)) {
-    AV *comment_array = newAV();
-    av_push( comment_array, newSVpvn("XXX", 3) );
-    av_push( comment_array, newSVpvn("", 0) );
-    av_push( comment_array, tmp );
-    DEBUG_TRACE("ID3v1 comment: %s\n", SvPVX(tmp));
-    my_hv_store( id3->tags, ID3_FRAME_COMMENT, newRV_noinc( (SV *)comment_array ) );
+  if (tmp && res_ispv(tmp) && res_len(tmp)) {
+    resval *comment_array = res_newav();
+    res_av_push( comment_array, res_newpvn("XXX", 3) );
+    res_av_push( comment_array, res_newpvn("", 0) );
+    res_av_push( comment_array, tmp );
+    DEBUG_TRACE("ID3v1 comment: %s\n", res_pv(tmp));
+    res_hv_store( id3->tags, ID3_FRAME_COMMENT, comment_array );
     tmp = NULL;
   }
-  else {
-    if (tmp) SvREFCNT_dec(tmp);
-  }
   if (read < 30) {
     buffer_consume(id3->buf, 30 - read);
   }
@@ -198,10 +359,10 @@ _id3_parse_v1(id3info *id3)
   genre = buffer_get_char(id3->buf);
   if (genre < NGENRES) {
     char const *genre_string = _id3_genre_index(genre);
-    my_hv_store( id3->tags, ID3_FRAME_GENRE, newSVpv(genre_string, 0) );
+    res_hv_store( id3->tags, ID3_FRAME_GENRE, res_newpv(genre_string, 0) );
   }
   else if (genre < 255) {
-    my_hv_store( id3->tags, ID3_FRAME_GENRE, newSVpvf("Unknown/%d", genre) );
+    res_hv_store( id3->tags, ID3_FRAME_GENRE, res_newpvf("Unknown/%d", genre) );
   }
 
   return 1;
@@ -219,7 +380,7 @@ _id3_parse_v2(id3info *id3)
     bptr[3] < 0xff && bptr[4] < 0xff &&
     bptr[6] < 0x80 && bptr[7] < 0x80 && bptr[8] < 0x80 && bptr[9] < 0x80
   ) ) {
-    PerlIO_printf(PerlIO_stderr(), "Invalid ID3v2 tag in %s\n", id3->file);
+    LOG_ERROR("Invalid ID3v2 tag in %s\n", id3->file);
     return 0;
   }
 
@@ -252,6 +413,9 @@ _id3_parse_v2(id3info *id3)
         goto out;
       }
 
+      // Decoded in place, so make sure we aren't pointing at the file
+      buffer_unview(id3->buf);
+
       id3->size_remain = _id3_deunsync( buffer_ptr(id3->buf), id3->size );
 
       DEBUG_TRACE("    Un-synchronized tag, new_size %d\n", id3->size_remain);
@@ -277,7 +441,7 @@ _id3_parse_v2(id3info *id3)
 
     // ehsize may be invalid, tested with v2.3-ext-header-invalid.mp3
     if (ehsize > id3->size_remain - 4) {
-      warn("Error: Invalid ID3 extended header size (%s)\n", id3->file);
+      LOG_WARN("Error: Invalid ID3 extended header size (%s)\n", id3->file);
       ret = 0;
       goto out;
     }
@@ -309,17 +473,17 @@ _id3_parse_v2(id3info *id3)
 
   // Set id3_version info element, which contains all tag versions found
   {
-    SV *version = newSVpvf( "ID3v2.%d.%d", id3->version_major, id3->version_minor );
+    resval *version = res_newpvf( "ID3v2.%d.%d", id3->version_major, id3->version_minor );
 
-    if ( my_hv_exists(id3->info, "id3_version") ) {
-      SV **entry = my_hv_fetch(id3->info, "id3_version");
+    if ( res_hv_exists(id3->info, "id3_version") ) {
+      resval **entry = res_hv_fetch(id3->info, "id3_version");
       if (entry != NULL) {
-        sv_catpv( version, ", " );
-        sv_catsv( version, *entry );
+        res_catpvn( version, ", ", 2 );
+        res_catsv( version, *entry );
       }
     }
 
-    my_hv_store( id3->info, "id3_version", version );
+    res_hv_store( id3->info, "id3_version", version );
   }
 
 out:
@@ -602,6 +766,7 @@ _id3_parse_v2_frame(id3info *id3)
             goto out;
           }
 
+          buffer_unview(id3->buf);
           decoded_size = _id3_deunsync( buffer_ptr(id3->buf), size );
 
           unsync_extra = size - decoded_size;
@@ -779,13 +944,13 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
   // Special handling for TXXX/WXXX frames
   if ( !strcmp(id, "TXXX") || !strcmp(id, "WXXX") ) {
     // Read key and uppercase it
-    SV *key   = NULL;
-    SV *value = NULL;
+    resval *key   = NULL;
+    resval *value = NULL;
 
     read += _id3_get_utf8_string(id3, &key, size - read, encoding);
 
-    if (key != NULL && SvPOK(key) && sv_len(key)) {
-      upcase(SvPVX(key));
+    if (key != NULL && res_ispv(key) && res_len(key)) {
+      upcase(res_pv(key));
 
       // Read value
       if (frametype->fields[2] == ID3_FIELD_TYPE_LATIN1) {
@@ -798,46 +963,41 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
       // (T|W)XXX frames don't support multiple strings separated by nulls, even in v2.4
 
       // Only one tag per unique key value is allowed, that's why there is no array support here
-      if (value != NULL && SvPOK(value) && sv_len(value)) {
-        my_hv_store_ent( id3->tags, key, value );
+      if (value != NULL && res_ispv(value) && res_len(value)) {
+        res_hv_store_ent( id3->tags, key, value );
       }
       else {
-        my_hv_store_ent( id3->tags, key, &PL_sv_undef );
-        if (value) SvREFCNT_dec(value);
+        res_hv_store_ent( id3->tags, key, res_newundef() );
       }
     }
     else {
       DEBUG_TRACE("    invalid/empty (T|W)XXX key, skipping frame\n");
     }
 
-    if (key) SvREFCNT_dec(key);
   }
 
   // Special handling for TCON genre frame
   else if ( !strcmp(id, "TCON") ) {
-    AV *genres = newAV();
+    resval *genres = res_newav();
     char *sptr, *end, *tmp;
 
     while (read < size) {
-      SV *value  = NULL;
+      resval *value  = NULL;
 
       // v2.4 handles multiple genres using null char separators (or $00 $00 in UTF-16),
       // this is handled by _id3_get_utf8_string
       read += _id3_get_utf8_string(id3, &value, size - read, encoding);
-      if (value != NULL && SvPOK(value)) {
-        sptr = SvPVX(value);
+      if (value != NULL && res_ispv(value)) {
+        sptr = res_pv(value);
 
         // Test if the string contains only a number,
         // strtol will set tmp to end in this case
-        end = sptr + sv_len(value);
+        end = sptr + res_len(value);
         strtol(sptr, &tmp, 0);
 
         if ( tmp == end ) {
           // Convert raw number to genre string
-          av_push( genres, newSVpv( _id3_genre_name((char *)sptr), 0 ) );
-
-          // value as an SV won't be used, must drop refcnt
-          SvREFCNT_dec(value);
+          res_av_push( genres, res_newpv( _id3_genre_name((char *)sptr), 0 ) );
         }
         else if ( *sptr == '(' ) {
           // Handle (26), (26)Ambient, etc, only the number portion will be read
@@ -845,7 +1005,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
           if (id3->version_major < 4) {
             // v2.2/v2.3 handle multiple genres using parens for some reason, i.e. (51)(39) or (55)(Text)
             char *ptr = sptr;
-            char *end = sptr + sv_len(value);
+            char *end = sptr + res_len(value);
 
             while (end - ptr > 0) {
               if ( *ptr++ == '(' ) {
@@ -854,11 +1014,11 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
                   paren = end;
 
                 if ( isdigit(*ptr) || !strncmp((char *)ptr, "RX", 2) || !strncmp((char *)ptr, "CR", 2) ) {
-                  av_push( genres, newSVpv( _id3_genre_name((char *)ptr), 0 ) );
+                  res_av_push( genres, res_newpv( _id3_genre_name((char *)ptr), 0 ) );
                 }
                 else {
                   // Handle text within parens
-                  av_push( genres, newSVpvn(ptr,  paren - ptr) );
+                  res_av_push( genres, res_newpvn(ptr,  paren - ptr) );
                 }
                 ptr = paren;
               }
@@ -868,41 +1028,31 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
             // v2.4, the (51) method is no longer valid but we will support it anyway
             sptr++;
             if ( isdigit(*sptr) || !strncmp(sptr, "RX", 2) || !strncmp(sptr, "CR", 2) ) {
-              av_push( genres, newSVpv( _id3_genre_name((char *)sptr), 0 ) );
+              res_av_push( genres, res_newpv( _id3_genre_name((char *)sptr), 0 ) );
             }
             else {
-              av_push( genres, newSVpv( (char *)sptr, 0 ) );
+              res_av_push( genres, res_newpv( (char *)sptr, 0 ) );
             }
           }
-
-          // value as an SV won't be used, must drop refcnt
-          SvREFCNT_dec(value);
         }
         else {
           // Support raw RX/CR value
           if ( !strncmp(sptr, "RX", 2) || !strncmp(sptr, "CR", 2) ) {
-            av_push( genres, newSVpv( _id3_genre_name((char *)sptr), 0 ) );
-
-            // value as an SV won't be used, must drop refcnt
-            SvREFCNT_dec(value);
+            res_av_push( genres, res_newpv( _id3_genre_name((char *)sptr), 0 ) );
           }
           else {
             // Store plain text genre
-            av_push( genres, value );
+            res_av_push( genres, value );
           }
         }
       }
     }
 
-    if (av_len(genres) > 0) {
-      my_hv_store( id3->tags, id, newRV_noinc( (SV *)genres ) );
-    }
-    else if (av_len(genres) == 0) {
-      my_hv_store( id3->tags, id, av_shift(genres) );
-      SvREFCNT_dec(genres);
+    if (res_av_len(genres) > 0) {
+      res_hv_store( id3->tags, id, genres );
     }
-    else {
-      SvREFCNT_dec(genres);
+    else if (res_av_len(genres) == 0) {
+      res_hv_store( id3->tags, id, res_av_shift(genres) );
     }
   }
 
@@ -914,15 +1064,15 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
     (frametype->nfields == 2 && frametype->fields[0] == ID3_FIELD_TYPE_TEXTENCODING)
   ) {
     int i = frametype->nfields - 1;
-    AV *array = NULL;
-    SV *value = NULL;
+    resval *array = NULL;
+    resval *value = NULL;
     int count = 0;
 
     switch ( frametype->fields[i] ) {
       case ID3_FIELD_TYPE_LATIN1: // W* frames
         read += _id3_get_utf8_string(id3, &value, size - read, ISO_8859_1);
-        if (value != NULL && SvPOK(value))
-          my_hv_store( id3->tags, id, value );
+        if (value != NULL && res_ispv(value))
+          res_hv_store( id3->tags, id, value );
         break;
 
       case ID3_FIELD_TYPE_STRINGLIST: // T* frames
@@ -931,43 +1081,42 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
         while (read < size) {
           if (count++ == 1 && value != NULL) {
             // we're reading the second string in the list, move first value to new array
-            array = newAV();
-            av_push(array, value);
+            array = res_newav();
+            res_av_push(array, value);
           }
           value = NULL;
 
           read += _id3_get_utf8_string(id3, &value, size - read, encoding);
 
-          if (array != NULL && value != NULL && SvPOK(value)) {
+          if (array != NULL && value != NULL && res_ispv(value)) {
             // second+ string, add to array
             // Bug 16452, do not add a null string
-            if (sv_len(value) > 0)
-              av_push(array, value);
+            if (res_len(value) > 0)
+              res_av_push(array, value);
           }
         }
 
         if (array != NULL) {
-          if (av_len(array) == 0) {
+          if (res_av_len(array) == 0) {
             // Handle the case where we have multiple empty strings leaving an array of 1
-            my_hv_store( id3->tags, id, av_shift(array) );
-            SvREFCNT_dec(array);
+            res_hv_store( id3->tags, id, res_av_shift(array) );
           }
           else {
-            my_hv_store( id3->tags, id, newRV_noinc( (SV *)array ) );
+            res_hv_store( id3->tags, id, array );
           }
         }
-        else if (value != NULL && SvPOK(value)) {
-          my_hv_store( id3->tags, id, value );
+        else if (value != NULL && res_ispv(value)) {
+          res_hv_store( id3->tags, id, value );
         }
         break;
 
       case ID3_FIELD_TYPE_INT32: // SEEK (unsupported, XXX need test)
-        my_hv_store( id3->tags, id, newSViv( buffer_get_int(id3->buf) ) );
+        res_hv_store( id3->tags, id, res_newiv( buffer_get_int(id3->buf) ) );
         read += 4;
         break;
 
       case ID3_FIELD_TYPE_INT32PLUS: // PCNT
-        my_hv_store( id3->tags, id, newSViv( _varint( buffer_ptr(id3->buf), size - read ) ) );
+        res_hv_store( id3->tags, id, res_newiv( _varint( buffer_ptr(id3->buf), size - read ) ) );
         buffer_consume(id3->buf, size - read);
         read = size;
         break;
@@ -987,7 +1136,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
         // Other unknown binary data
         else {
           // Y* obsolete frames
-          my_hv_store( id3->tags, id, newSVpvn( buffer_ptr(id3->buf), size - read ) );
+          res_hv_store( id3->tags, id, res_newpvn( buffer_ptr(id3->buf), size - read ) );
           buffer_consume(id3->buf, size - read);
           read = size;
         }
@@ -995,7 +1144,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
 
       default:
         // XXX
-        warn("   !!! unhandled field type %d\n", frametype->fields[i]);
+        LOG_WARN("   !!! unhandled field type %d\n", frametype->fields[i]);
         buffer_consume(id3->buf, size - read);
         read += size - read;
         break;
@@ -1011,29 +1160,29 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
   // COMR, ENCR, GRID, SIGN, ASPI, LINK (v2.4)
   else {
     int i = 0;
-    AV *framedata = newAV();
+    resval *framedata = res_newav();
 
     // If we read an initial encoding byte, start at field 2
     if (encoding >= 0)
       i = 1;
 
     for (; i < frametype->nfields; i++) {
-      SV *value = NULL;
+      resval *value = NULL;
 
       switch ( frametype->fields[i] ) {
         case ID3_FIELD_TYPE_LATIN1:
           // Special case, fix v2.2 PIC frame fields as they don't match APIC
           // This is a rather hackish place to put this, but there's not really any other place
           if ( id3->version_major == 2 && !strcmp(id, "APIC") ) {
-            av_push( framedata, newSVpvn( buffer_ptr(id3->buf), 3 ) );
+            res_av_push( framedata, res_newpvn( buffer_ptr(id3->buf), 3 ) );
             buffer_consume(id3->buf, 3);
             read += 3;
             DEBUG_TRACE("    PIC image format, read %d\n", read);
           }
           else {
             read += _id3_get_utf8_string(id3, &value, size - read, ISO_8859_1);
-            if (value != NULL && SvPOK(value))
-              av_push( framedata, value );
+            if (value != NULL && res_ispv(value))
+              res_av_push( framedata, value );
           }
           break;
 
@@ -1042,8 +1191,8 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
         case ID3_FIELD_TYPE_LATIN1LIST: // LINK
           while (read < size) {
             read += _id3_get_utf8_string(id3, &value, size - read, ISO_8859_1);
-            if (value != NULL && SvPOK(value))
-              av_push( framedata, value );
+            if (value != NULL && res_ispv(value))
+              res_av_push( framedata, value );
             value = NULL;
             DEBUG_TRACE("    latin1list, read %d\n", read);
           }
@@ -1051,29 +1200,27 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
 
         case ID3_FIELD_TYPE_STRING:
           read += _id3_get_utf8_string(id3, &value, size - read, encoding);
-          if (value != NULL && SvPOK(value)) {
-            av_push( framedata, value );
-            DEBUG_TRACE("    string, read %d: %s\n", read, SvPVX(value));
+          if (value != NULL && res_ispv(value)) {
+            res_av_push( framedata, value );
+            DEBUG_TRACE("    string, read %d: %s\n", read, res_pv(value));
           }
           else {
-            av_push( framedata, &PL_sv_undef );
-            if (value) SvREFCNT_dec(value);
+            res_av_push( framedata, res_newundef() );
           }
           break;
 
         case ID3_FIELD_TYPE_STRINGFULL: // USLT, COMM, read entire string until end of frame
         {
-          SV *tmp = newSVpvn( "", 0 );
+          resval *tmp = res_newpvn( "", 0 );
           while (read < size) {
             read += _id3_get_utf8_string(id3, &value, size - read, encoding);
-            if (value != NULL && SvPOK(value)) {
-              sv_catsv( tmp, value );
-              SvREFCNT_dec(value);
+            if (value != NULL && res_ispv(value)) {
+              res_catsv( tmp, value );
             }
             value = NULL;
           }
-          av_push( framedata, tmp );
-          DEBUG_TRACE("    stringfull, read %d: %s\n", read, SvPVX(tmp));
+          res_av_push( framedata, tmp );
+          DEBUG_TRACE("    stringfull, read %d: %s\n", read, res_pv(tmp));
           break;
         }
 
@@ -1081,7 +1228,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
 
         case ID3_FIELD_TYPE_LANGUAGE: // USLT, SYLT, COMM, USER, 3-byte language code
           if (size - read >= 3) {
-            av_push( framedata, newSVpvn( buffer_ptr(id3->buf), 3 ) );
+            res_av_push( framedata, res_newpvn( buffer_ptr(id3->buf), 3 ) );
             buffer_consume(id3->buf, 3);
             read += 3;
             DEBUG_TRACE("    language, read %d\n", read);
@@ -1093,7 +1240,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
         {
           uint8_t len = (id3->version_major == 3) ? 3 : 4;
           if (size - read >= len) {
-            av_push( framedata, newSVpvn( buffer_ptr(id3->buf), len ) );
+            res_av_push( framedata, res_newpvn( buffer_ptr(id3->buf), len ) );
             buffer_consume(id3->buf, len);
             read += len;
             DEBUG_TRACE("    frameid, read %d\n", read);
@@ -1103,7 +1250,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
 
         case ID3_FIELD_TYPE_DATE: // OWNE, COMR, XXX need test, YYYYMMDD
           if (size - read >= 8) {
-            av_push( framedata, newSVpvn( buffer_ptr(id3->buf), 8 ) );
+            res_av_push( framedata, res_newpvn( buffer_ptr(id3->buf), 8 ) );
             buffer_consume(id3->buf, 8);
             read += 8;
             DEBUG_TRACE("    date, read %d\n", read);
@@ -1113,7 +1260,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
         case ID3_FIELD_TYPE_INT8: // ETCO, MLLT, SYTC, SYLT, EQU2, RVRB, APIC,
                                   // POPM, RBUF, POSS, COMR, ENCR, GRID, SIGN, ASPI
           if (size - read >= 1) {
-            av_push( framedata, newSViv( buffer_get_char(id3->buf) ) );
+            res_av_push( framedata, res_newiv( buffer_get_char(id3->buf) ) );
             read += 1;
             DEBUG_TRACE("    int8, read %d\n", read);
           }
@@ -1121,7 +1268,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
 
         case ID3_FIELD_TYPE_INT16: // MLLT, RVRB, AENC, ASPI
           if (size - read >= 2) {
-            av_push( framedata, newSViv( buffer_get_short(id3->buf) ) );
+            res_av_push( framedata, res_newiv( buffer_get_short(id3->buf) ) );
             read += 2;
             DEBUG_TRACE("    int16, read %d\n", read);
           }
@@ -1129,7 +1276,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
 
         case ID3_FIELD_TYPE_INT24: // MLLT, RBUF
           if (size - read >= 3) {
-            av_push( framedata, newSViv( buffer_get_int24(id3->buf) ) );
+            res_av_push( framedata, res_newiv( buffer_get_int24(id3->buf) ) );
             read += 3;
             DEBUG_TRACE("    int24, read %d\n", read);
           }
@@ -1137,7 +1284,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
 
         case ID3_FIELD_TYPE_INT32: // RBUF, SEEK, ASPI
           if (size - read >= 4) {
-            av_push( framedata, newSViv( buffer_get_int(id3->buf) ) );
+            res_av_push( framedata, res_newiv( buffer_get_int(id3->buf) ) );
             read += 4;
             DEBUG_TRACE("    int32, read %d\n", read);
           }
@@ -1145,7 +1292,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
 
         case ID3_FIELD_TYPE_INT32PLUS: // POPM
           if (size - read >= 4) {
-            av_push( framedata, newSViv( _varint( buffer_ptr(id3->buf), size - read ) ) );
+            res_av_push( framedata, res_newiv( _varint( buffer_ptr(id3->buf), size - read ) ) );
             buffer_consume(id3->buf, size - read);
             read = size;
             DEBUG_TRACE("    int32plus, read %d\n", read);
@@ -1156,11 +1303,16 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
                                         // GEOB, AENC, POSS, COMR, ENCR, GRID, PRIV, SIGN, ASPI
           // Special handling for APIC tags when in skip_art mode
           if (skip_art) {
-            av_push( framedata, newSVuv(size - read) );
+            uint32_t art_offset = id3->offset + (id3->size - id3->size_remain) + read;
 
             // Record offset of APIC image data too, unless the data needs to be unsynchronized or is empty
-            if (id3->tag_data_safe && (size - read) > 0)
-              av_push( framedata, newSVuv(id3->offset + (id3->size - id3->size_remain) + read) );
+            if (id3->tag_data_safe && (size - read) > 0) {
+              res_av_push( framedata, res_newart(art_offset, size - read) );
+              res_av_push( framedata, res_newuv(art_offset) );
+            }
+            else {
+              res_av_push( framedata, res_newart(0, size - read) );
+            }
 
             _id3_skip(id3, size - read);
             read = size;
@@ -1170,7 +1322,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
           else if (buffer_art) {
             uint32_t remain = size - read;
             uint32_t chunk_size;
-            SV *artwork = newSVpv("", 0);
+            resval *artwork = res_newblob("", 0);
 
             while (read < size) {
               if ( !_check_buf(id3->infile, id3->buf, 1, ID3_BLOCK_SIZE) ) {
@@ -1182,13 +1334,13 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
               read += chunk_size;
               remain -= chunk_size;
 
-              sv_catpvn( artwork, buffer_ptr(id3->buf), chunk_size );
+              res_catpvn( artwork, buffer_ptr(id3->buf), chunk_size );
               buffer_consume(id3->buf, chunk_size);
 
               DEBUG_TRACE("    buffered %d bytes of APIC data (remaining %d)\n", chunk_size, remain);
             }
 
-            av_push( framedata, artwork );
+            res_av_push( framedata, artwork );
           }
 
           // Special handling for RVA2 tags
@@ -1209,7 +1361,7 @@ _id3_parse_v2_frame_data(id3info *id3, char const *id, uint32_t size, id3_framet
           // All other binary frames, copy as-is
           else {
             if (size - read > 1) {
-              av_push( framedata, newSVpvn( buffer_ptr(id3->buf), size - read ) );
+              res_av_push( framedata, res_newpvn( buffer_ptr(id3->buf), size - read ) );
               buffer_consume(id3->buf, size - read);
               read = size;
               DEBUG_TRACE("    binarydata, read %d\n", read);
@@ -1235,52 +1387,49 @@ out:
 }
 
 void
-_id3_set_array_tag(id3info *id3, char const *id, AV *framedata)
+_id3_set_array_tag(id3info *id3, char const *id, resval *framedata)
 {
-  if ( av_len(framedata) != -1 ) {
-    if ( my_hv_exists( id3->tags, id ) ) {
+  if ( res_av_len(framedata) != -1 ) {
+    if ( res_hv_exists( id3->tags, id ) ) {
       // If tag already exists, move it to an arrayref
-      SV **entry = my_hv_fetch( id3->tags, id );
+      resval **entry = res_hv_fetch( id3->tags, id );
       if (entry != NULL) {
-        if ( SvTYPE( SvRV(*entry) ) == SVt_PV ) {
+        if ( !res_isav(*entry) ) {
           // A normal string entry, convert to array
-	  AV *ref = newAV();
+	  resval *ref = res_newav();
 
           // XXX need test, this may be illegal because you can't have multiple duplicate frames?
           DEBUG_TRACE("   !!! converting normal string tag to array\n");
 
-          av_push( ref, *entry );
-          av_push( ref, newRV_noinc( (SV *)framedata ) );
-          my_hv_store( id3->tags, id, newRV_noinc( (SV *)ref ) );
+          res_av_push( ref, *entry );
+          res_av_push( ref, framedata );
+          res_hv_store( id3->tags, id, ref );
         }
-        else if ( SvTYPE( SvRV(*entry) ) == SVt_PVAV ) {
+        else {
           // If type of first item is array, add new item to entry
-          SV **first = av_fetch( (AV *)SvRV(*entry), 0, 0 );
-          if ( first == NULL || ( SvROK(*first) && SvTYPE( SvRV(*first) ) == SVt_PVAV ) ) {
-            av_push( (AV *)SvRV(*entry), newRV_noinc( (SV *)framedata ) );
+          resval **first = res_av_fetch( *entry, 0 );
+          if ( first == NULL || res_isav(*first) ) {
+            res_av_push( *entry, framedata );
           }
           else {
-            AV *ref = newAV();
-            av_push( ref, SvREFCNT_inc(*entry) );
-            av_push( ref, newRV_noinc( (SV *)framedata) );
-            my_hv_store( id3->tags, id, newRV_noinc( (SV *)ref ) );
+            resval *ref = res_newav();
+            res_av_push( ref, *entry );
+            res_av_push( ref, framedata );
+            res_hv_store( id3->tags, id, ref );
           }
         }
       }
     }
     else {
-      my_hv_store( id3->tags, id, newRV_noinc( (SV *)framedata ) );
+      res_hv_store( id3->tags, id, framedata );
     }
   }
-  else {
-    SvREFCNT_dec(framedata);
-  }
 }
 
 // Read a latin1 or UTF-8 string from an ID3v1 tag
 // This function handles trimming spaces off the end
 uint32_t
-_id3_get_v1_utf8_string(id3info *id3, SV **string, uint32_t len)
+_id3_get_v1_utf8_string(id3info *id3, resval **string, uint32_t len)
 {
   uint32_t read = 0;
   char *ptr;
@@ -1291,14 +1440,14 @@ _id3_get_v1_utf8_string(id3info *id3, SV **string, uint32_t len)
   if (read) {
     // Trim spaces from end
     if (*string != NULL) {
-      str = SvPVX(*string);
-      ptr = str + sv_len(*string);
+      str = res_pv(*string);
+      ptr = str + res_len(*string);
 
       while (ptr > str && ptr[-1] == ' ')
         --ptr;
 
       *ptr = 0;
-      SvCUR_set(*string, ptr - str);
+      res_cur_set(*string, ptr - str);
     }
   }
 
@@ -1306,7 +1455,7 @@ _id3_get_v1_utf8_string(id3info *id3, SV **string, uint32_t len)
 }
 
 uint32_t
-_id3_get_utf8_string(id3info *id3, SV **string, uint32_t len, uint8_t encoding)
+_id3_get_utf8_string(id3info *id3, resval **string, uint32_t len, uint8_t encoding)
 {
   uint8_t byteorder = UTF16_BYTEORDER_ANY;
   uint32_t read = 0;
@@ -1324,7 +1473,7 @@ _id3_get_utf8_string(id3info *id3, SV **string, uint32_t len, uint8_t encoding)
   }
 
   if ( *string != NULL ) {
-    warn("    !!! string SV is not null: %s\n", SvPVX(*string));
+    LOG_WARN("    !!! string SV is not null: %s\n", res_pv(*string));
   }
 
   switch (encoding) {
@@ -1375,9 +1524,9 @@ _id3_get_utf8_string(id3info *id3, SV **string, uint32_t len, uint8_t encoding)
 
   if (read) {
     if ( buffer_len(id3->utf8) ) {
-      *string = newSVpv( buffer_ptr(id3->utf8), 0 );
-      sv_utf8_decode(*string);
-      DEBUG_TRACE("    read utf8 string of %d bytes: %s\n", buffer_len(id3->utf8), SvPVX(*string));
+      *string = res_newpv( buffer_ptr(id3->utf8), 0 );
+      res_utf8_decode(*string);
+      DEBUG_TRACE("    read utf8 string of %d bytes: %s\n", buffer_len(id3->utf8), res_pv(*string));
     }
     else {
       DEBUG_TRACE("    empty string\n");
@@ -1397,7 +1546,7 @@ _id3_parse_rvad(id3info *id3, char const *id, uint32_t size)
   float vol[2];
   float peak[2];
   int i;
-  AV *framedata = newAV();
+  resval *framedata = res_newav();
 
   // Sanity check, first byte must be either 0 or 1, second byte > 0
   if (rva[0] & 0xFE || rva[1] == 0) {
@@ -1427,11 +1576,11 @@ _id3_parse_rvad(id3info *id3, char const *id, uint32_t size)
       vol[i] = 20.0 * log( ( vol[i] + 255 ) / 255 ) / log(10);
     }
 
-    av_push( framedata, newSVpvf( "%f dB", vol[i] ) );
-    av_push( framedata, newSVpvf( "%f", peak[i] ) );
+    res_av_push( framedata, res_newpvf( "%f dB", vol[i] ) );
+    res_av_push( framedata, res_newpvf( "%f", peak[i] ) );
   }
 
-  my_hv_store( id3->tags, id, newRV_noinc( (SV *)framedata ) );
+  res_hv_store( id3->tags, id, framedata );
 
   buffer_consume(id3->buf, 2 + (bytes * 4));
 
@@ -1444,11 +1593,11 @@ _id3_parse_rgad(id3info *id3)
   float radio = 0.0;
   float audiophile = 0.0;
   uint8_t sign = 0;
-  HV *framedata = newHV();
+  resval *framedata = res_newhv();
   uint32_t read = 0;
 
   // Peak (32-bit float)
-  my_hv_store( framedata, "peak", newSVpvf( "%f", (float)buffer_get_float32(id3->buf) ) );
+  res_hv_store( framedata, "peak", res_newpvf( "%f", (float)buffer_get_float32(id3->buf) ) );
   read += 4;
 
   // Radio (16 bits)
@@ -1456,7 +1605,7 @@ _id3_parse_rgad(id3info *id3)
   // Radio Name code (3 bits, should always be 1)
   buffer_get_bits(id3->buf, 3);
 
-  my_hv_store( framedata, "track_originator", newSVuv( buffer_get_bits(id3->buf, 3) ) );
+  res_hv_store( framedata, "track_originator", res_newuv( buffer_get_bits(id3->buf, 3) ) );
 
   // Sign bit (1 bit)
   sign = buffer_get_bits(id3->buf, 1);
@@ -1465,7 +1614,7 @@ _id3_parse_rgad(id3info *id3)
   radio = (float)buffer_get_bits(id3->buf, 9);
   radio /= 10.0;
   if (sign == 1) radio *= -1.0;
-  my_hv_store( framedata, "track_gain", newSVpvf( "%f dB", radio ) );
+  res_hv_store( framedata, "track_gain", res_newpvf( "%f dB", radio ) );
 
   read += 2;
 
@@ -1475,7 +1624,7 @@ _id3_parse_rgad(id3info *id3)
   buffer_get_bits(id3->buf, 3);
 
   // Audiophile Originator code (3 bits)
-  my_hv_store( framedata, "album_originator", newSVuv( buffer_get_bits(id3->buf, 3) ) );
+  res_hv_store( framedata, "album_originator", res_newuv( buffer_get_bits(id3->buf, 3) ) );
 
   // Sign bit (1 bit)
   sign = buffer_get_bits(id3->buf, 1);
@@ -1484,17 +1633,17 @@ _id3_parse_rgad(id3info *id3)
   audiophile = (float)buffer_get_bits(id3->buf, 9);
   audiophile /= 10.0;
   if (sign == 1) audiophile *= -1.0;
-  my_hv_store( framedata, "album_gain", newSVpvf( "%f dB", audiophile ) );
+  res_hv_store( framedata, "album_gain", res_newpvf( "%f dB", audiophile ) );
 
   read += 2;
 
-  my_hv_store( id3->tags, "RGAD", newRV_noinc( (SV *)framedata ) );
+  res_hv_store( id3->tags, "RGAD", framedata );
 
   return read;
 }
 
 uint32_t
-_id3_parse_rva2(id3info *id3, uint32_t len, AV *framedata)
+_id3_parse_rva2(id3info *id3, uint32_t len, resval *framedata)
 {
   float adj = 0.0;
   int adj_fp;
@@ -1504,14 +1653,14 @@ _id3_parse_rva2(id3info *id3, uint32_t len, AV *framedata)
   unsigned char *bptr;
 
   // Channel
-  av_push( framedata, newSViv( buffer_get_char(id3->buf) ) );
+  res_av_push( framedata, res_newiv( buffer_get_char(id3->buf) ) );
 
   // Adjustment
   bptr = buffer_ptr(id3->buf);
   adj_fp = *(signed char *)(bptr) << 8;
   adj_fp |= *(unsigned char *)(bptr+1);
   adj = adj_fp / 512.0;
-  av_push( framedata, newSVpvf( "%f dB", adj ) );
+  res_av_push( framedata, res_newpvf( "%f dB", adj ) );
   buffer_consume(id3->buf, 2);
 
   // Peak
@@ -1539,32 +1688,31 @@ _id3_parse_rva2(id3info *id3, uint32_t len, AV *framedata)
       peak /= (float)(1 << ((peakbits - 1) & 7));
   }
 
-  av_push( framedata, newSVpvf( "%f dB", peak ) );
+  res_av_push( framedata, res_newpvf( "%f dB", peak ) );
 
   return read;
 }
 
 uint32_t
-_id3_parse_sylt(id3info *id3, uint8_t encoding, uint32_t len, AV *framedata)
+_id3_parse_sylt(id3info *id3, uint8_t encoding, uint32_t len, resval *framedata)
 {
   uint32_t read = 0;
-  AV *content = newAV();
+  resval *content = res_newav();
   unsigned char *bptr;
 
   while (read < len) {
-    SV *value = NULL;
-    HV *lyric = newHV();
+    resval *value = NULL;
+    resval *lyric = res_newhv();
 
     read += _id3_get_utf8_string(id3, &value, len - read, encoding);
-    if (value != NULL && SvPOK(value) && sv_len(value)) {
-      my_hv_store( lyric, "text", value );
+    if (value != NULL && res_ispv(value) && res_len(value)) {
+      res_hv_store( lyric, "text", value );
     }
     else {
-      my_hv_store( lyric, "text", &PL_sv_undef );
-      if (value) SvREFCNT(value);
+      res_hv_store( lyric, "text", res_newundef() );
     }
 
-    my_hv_store( lyric, "timestamp", newSVuv( buffer_get_int(id3->buf) ) );
+    res_hv_store( lyric, "timestamp", res_newuv( buffer_get_int(id3->buf) ) );
     read += 4;
 
     // A $0A newline byte may follow, for some odd reason
@@ -1574,31 +1722,31 @@ _id3_parse_sylt(id3info *id3, uint8_t encoding, uint32_t len, AV *framedata)
       read++;
     }
 
-    av_push( content, newRV_noinc( (SV *)lyric ) );
+    res_av_push( content, lyric );
   }
 
-  av_push( framedata, newRV_noinc( (SV *)content ) );
+  res_av_push( framedata, content );
 
   return read;
 }
 
 uint32_t
-_id3_parse_etco(id3info *id3, uint32_t len, AV *framedata)
+_id3_parse_etco(id3info *id3, uint32_t len, resval *framedata)
 {
   uint32_t read = 0;
-  AV *content = newAV();
+  resval *content = res_newav();
 
   while (read < len) {
-    HV *event = newHV();
+    resval *event = res_newhv();
 
-    my_hv_store( event, "type", newSVuv( buffer_get_char(id3->buf) ) );
-    my_hv_store( event, "timestamp", newSVuv( buffer_get_int(id3->buf) ) );
+    res_hv_store( event, "type", res_newuv( buffer_get_char(id3->buf) ) );
+    res_hv_store( event, "timestamp", res_newuv( buffer_get_int(id3->buf) ) );
     read += 5;
 
-    av_push( content, newRV_noinc( (SV *)event ) );
+    res_av_push( content, event );
   }
 
-  av_push( framedata, newRV_noinc( (SV *)content ) );
+  res_av_push( framedata, content );
 
   return read;
 }
@@ -1608,48 +1756,48 @@ _id3_convert_tdrc(id3info *id3)
 {
   char timestamp[17] = { 0 };
 
-  if ( my_hv_exists(id3->tags, "TYER") ) {
-    SV *tyer = my_hv_delete(id3->tags, "TYER");
-    if (SvPOK(tyer) && sv_len(tyer) == 4) {
-      char *ptr = SvPVX(tyer);
+  if ( res_hv_exists(id3->tags, "TYER") ) {
+    resval *tyer = res_hv_delete(id3->tags, "TYER");
+    if (res_ispv(tyer) && res_len(tyer) == 4) {
+      char *ptr = res_pv(tyer);
       timestamp[0] = ptr[0];
       timestamp[1] = ptr[1];
       timestamp[2] = ptr[2];
       timestamp[3] = ptr[3];
-      DEBUG_TRACE("  Converted TYER (%s) to TDRC (%s)\n", SvPVX(tyer), timestamp);
+      DEBUG_TRACE("  Converted TYER (%s) to TDRC (%s)\n", res_pv(tyer), timestamp);
     }
   }
 
-  if ( my_hv_exists(id3->tags, "TDAT") ) {
-    SV *tdat = my_hv_delete(id3->tags, "TDAT");
-    if (SvPOK(tdat) && sv_len(tdat) == 4) {
-      char *ptr = SvPVX(tdat);
+  if ( res_hv_exists(id3->tags, "TDAT") ) {
+    resval *tdat = res_hv_delete(id3->tags, "TDAT");
+    if (res_ispv(tdat) && res_len(tdat) == 4) {
+      char *ptr = res_pv(tdat);
       timestamp[4] = '-';
       timestamp[5] = ptr[2];
       timestamp[6] = ptr[3];
       timestamp[7] = '-';
       timestamp[8] = ptr[0];
       timestamp[9] = ptr[1];
-      DEBUG_TRACE("  Converted TDAT (%s) to TDRC (%s)\n", SvPVX(tdat), timestamp);
+      DEBUG_TRACE("  Converted TDAT (%s) to TDRC (%s)\n", res_pv(tdat), timestamp);
     }
   }
 
-  if ( my_hv_exists(id3->tags, "TIME") ) {
-    SV *time = my_hv_delete(id3->tags, "TIME");
-    if (SvPOK(time) && sv_len(time) == 4) {
-      char *ptr = SvPVX(time);
+  if ( res_hv_exists(id3->tags, "TIME") ) {
+    resval *time = res_hv_delete(id3->tags, "TIME");
+    if (res_ispv(time) && res_len(time) == 4) {
+      char *ptr = res_pv(time);
       timestamp[10] = 'T';
       timestamp[11] = ptr[0];
       timestamp[12] = ptr[1];
       timestamp[13] = ':';
       timestamp[14] = ptr[2];
       timestamp[15] = ptr[3];
-      DEBUG_TRACE("  Converted TIME (%s) to TDRC (%s)\n", SvPVX(time), timestamp);
+      DEBUG_TRACE("  Converted TIME (%s) to TDRC (%s)\n", res_pv(time), timestamp);
     }
   }
 
   if (timestamp[0]) {
-    my_hv_store( id3->tags, "TDRC", newSVpv(timestamp, 0) );
+    res_hv_store( id3->tags, "TDRC", res_newpv(timestamp, 0) );
   }
 }
 
@@ -1684,10 +1832,10 @@ _id3_skip(id3info *id3, uint32_t size)
     DEBUG_TRACE("  skipped buffer data size %d\n", size);
   }
   else {
-    PerlIO_seek(id3->infile, size - buffer_len(id3->buf), SEEK_CUR);
+    scanio_seek(id3->infile, size - buffer_len(id3->buf), SEEK_CUR);
     buffer_clear(id3->buf);
 
-    DEBUG_TRACE("  seeked past %d bytes to %d\n", size, (int)PerlIO_tell(id3->infile));
+    DEBUG_TRACE("  seeked past %d bytes to %d\n", size, (int)scanio_tell(id3->infile));
   }
 }
 
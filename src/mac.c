@@ -1,7 +1,7 @@
 #include "mac.h"
 
 static int
-get_macfileinfo(PerlIO *infile, char *file, HV *info)
+get_macfileinfo(ScanIO *infile, char *file, resval *info)
 {
   Buffer header;
   char *bptr;
@@ -20,26 +20,26 @@ get_macfileinfo(PerlIO *infile, char *file, HV *info)
     looking for the MPC header
   */
   if ((header_end = skip_id3v2(infile)) < 0) {
-    PerlIO_printf(PerlIO_stderr(), "MAC: [Couldn't skip ID3v2]: %s\n", file);
+    LOG_ERROR("MAC: [Couldn't skip ID3v2]: %s\n", file);
     Safefree(si);
     return -1;
   }
 
   // seek to first byte of MAC data
-  if (PerlIO_seek(infile, header_end, SEEK_SET) < 0) {
-    PerlIO_printf(PerlIO_stderr(), "MAC: [Couldn't seek to offset %d]: %s\n", header_end, file);
+  if (scanio_seek(infile, header_end, SEEK_SET) < 0) {
+    LOG_ERROR("MAC: [Couldn't seek to offset %d]: %s\n", header_end, file);
     Safefree(si);
     return -1;
   }
 
   // Offset + MAC. Does this need the space as well, to be +4 ?
-  si->audio_start_offset = PerlIO_tell(infile) + 3;
+  si->audio_start_offset = scanio_tell(infile) + 3;
 
   // Skip the APETAGEX if it exists.
   buffer_init(&header, APE_HEADER_LEN);
 
   if (!_check_buf(infile, &header, APE_HEADER_LEN, APE_HEADER_LEN)) {
-    PerlIO_printf(PerlIO_stderr(), "MAC: [Couldn't read tag header]: %s\n", file);
+    LOG_ERROR("MAC: [Couldn't read tag header]: %s\n", file);
     goto out;
   }
 
@@ -49,24 +49,24 @@ get_macfileinfo(PerlIO *infile, char *file, HV *info)
     // Skip the ape tag structure
     // XXXX - need to test this code path.
     buffer_get_int_le(&header);
-    PerlIO_seek(infile, buffer_get_int_le(&header), SEEK_CUR);
+    scanio_seek(infile, buffer_get_int_le(&header), SEEK_CUR);
 
   } else {
     // set the pointer back to original location
-    PerlIO_seek(infile, -APE_HEADER_LEN, SEEK_CUR);
+    scanio_seek(infile, -APE_HEADER_LEN, SEEK_CUR);
   }
 
   buffer_clear(&header);
 
   if (!_check_buf(infile, &header, 32, 32)) {
-    PerlIO_printf(PerlIO_stderr(), "MAC: [Couldn't read stream header]: %s\n", file);
+    LOG_ERROR("MAC: [Couldn't read stream header]: %s\n", file);
     goto out;
   }
 
   bptr = buffer_ptr(&header);
 
   if (memcmp(bptr, "MAC ", 4) != 0) {
-    PerlIO_printf(PerlIO_stderr(), "MAC: [Couldn't couldn't find stream header]: %s\n", file);
+    LOG_ERROR("MAC: [Couldn't couldn't find stream header]: %s\n", file);
     goto out;
   }
 
@@ -83,7 +83,7 @@ get_macfileinfo(PerlIO *infile, char *file, HV *info)
     }
 
     if (!_check_buf(infile, &header, MAC_397_HEADER_LEN, MAC_397_HEADER_LEN)) {
-      PerlIO_printf(PerlIO_stderr(), "MAC: [Couldn't read < 3.98 stream header]: %s\n", file);
+      LOG_ERROR("MAC: [Couldn't read < 3.98 stream header]: %s\n", file);
       goto out;
     }
 
@@ -105,7 +105,7 @@ get_macfileinfo(PerlIO *infile, char *file, HV *info)
     uint16_t profile;
 
     if (!_check_buf(infile, &header, MAC_398_HEADER_LEN, MAC_398_HEADER_LEN)) {
-      PerlIO_printf(PerlIO_stderr(), "MAC: [Couldn't read > 3.98 stream header]: %s\n", file);
+      LOG_ERROR("MAC: [Couldn't read > 3.98 stream header]: %s\n", file);
       goto out;
     }
 
@@ -146,16 +146,16 @@ get_macfileinfo(PerlIO *infile, char *file, HV *info)
     double total_samples = (double)(((si->blocks_per_frame * (si->total_frames - 1)) + si->final_frame));
     uint32_t total_ms = (total_samples * 1000) / si->sample_rate;
 
-    my_hv_store(info, "samplerate", newSViv(si->sample_rate));
-    my_hv_store(info, "channels", newSViv(si->channels));
-    my_hv_store(info, "song_length_ms", newSVuv(total_ms));
-    my_hv_store(info, "bitrate", newSVuv( _bitrate(si->file_size - si->audio_start_offset, total_ms) ));
+    res_hv_store(info, "samplerate", res_newiv(si->sample_rate));
+    res_hv_store(info, "channels", res_newiv(si->channels));
+    res_hv_store(info, "song_length_ms", res_newuv(total_ms));
+    res_hv_store(info, "bitrate", res_newuv( _bitrate(si->file_size - si->audio_start_offset, total_ms) ));
 
-    my_hv_store(info, "file_size", newSVnv(si->file_size));
-    my_hv_store(info, "audio_offset", newSVuv(si->audio_start_offset));
-    my_hv_store(info, "audio_size", newSVuv(si->file_size - si->audio_start_offset));
-    my_hv_store(info, "compression", newSVpv(si->compression, 0));
-    my_hv_store(info, "version", newSVpvf( "%0.2f", si->version * 1.0 / 1000 ) );
+    res_hv_store(info, "file_size", res_newnv(si->file_size));
+    res_hv_store(info, "audio_offset", res_newuv(si->audio_start_offset));
+    res_hv_store(info, "audio_size", res_newuv(si->file_size - si->audio_start_offset));
+    res_hv_store(info, "compression", res_newpv(si->compression, 0));
+    res_hv_store(info, "version", res_newpvf( "%0.2f", si->version * 1.0 / 1000 ) );
   }
 
 out:
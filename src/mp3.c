@@ -21,9 +21,12 @@
 #include "mp3.h"
 
 int
-get_mp3fileinfo(PerlIO *infile, char *file, HV *info)
+get_mp3fileinfo(ScanIO *infile, char *file, resval *info)
 {
- mp3info *mp3 = _mp3_parse(infile, file, info);
+ mp3info *mp3 = _mp3_parse(infile, file, info, 0);
+
+ if (mp3->mllt)
+   Safefree(mp3->mllt);
 
  buffer_free(mp3->buf);
  Safefree(mp3->buf);
@@ -35,7 +38,7 @@ get_mp3fileinfo(PerlIO *infile, char *file, HV *info)
 }
 
 int
-get_mp3tags(PerlIO *infile, char *file, HV *info, HV *tags)
+get_mp3tags(ScanIO *infile, char *file, resval *info, resval *tags)
 {
   int ret;
   
@@ -66,17 +69,17 @@ _is_ape_header(char *bptr)
 }
 
 int
-_has_ape(PerlIO *infile, off_t file_size, HV *info)
+_has_ape(ScanIO *infile, off_t file_size, resval *info)
 {
   Buffer buf;
   uint8_t ret = 0;
   char *bptr;
   
-  if ( (PerlIO_seek(infile, file_size - 160, SEEK_SET)) == -1 ) {
+  if ( (scanio_seek(infile, file_size - 160, SEEK_SET)) == -1 ) {
     return 0;
   }
   
-  DEBUG_TRACE("Seeked to %d looking for APE tag\n", (int)PerlIO_tell(infile));
+  DEBUG_TRACE("Seeked to %d looking for APE tag\n", (int)scanio_tell(infile));
   
   // Bug 9942, read 136 bytes so we can check at -32 bytes in case file
   // does not have an ID3v1 tag
@@ -108,11 +111,11 @@ _has_ape(PerlIO *infile, off_t file_size, HV *info)
       
       DEBUG_TRACE("LYRICS200 tag found (size %d), adjusting APE offset (%d)\n", lyrics_size, -(160 + lyrics_size + 15));
       
-      if ( (PerlIO_seek(infile, file_size - (160 + lyrics_size + 15), SEEK_SET)) == -1 ) {
+      if ( (scanio_seek(infile, file_size - (160 + lyrics_size + 15), SEEK_SET)) == -1 ) {
         goto out;
       }
       
-      DEBUG_TRACE("Seeked before Lyrics tag to %d\n", (int)PerlIO_tell(infile));
+      DEBUG_TRACE("Seeked before Lyrics tag to %d\n", (int)scanio_tell(infile));
       
       buffer_clear(&buf);
       if ( !_check_buf(infile, &buf, 136, 136) ) {
@@ -126,9 +129,9 @@ _has_ape(PerlIO *infile, off_t file_size, HV *info)
       }
       
       // APE code will remove the lyrics_size from audio_size, but if no APE tag do it here
-      if (my_hv_exists(info, "audio_size")) {
-        int audio_size = SvIV(*(my_hv_fetch(info, "audio_size")));
-        my_hv_store(info, "audio_size", newSVuv(audio_size - lyrics_size - 15));
+      if (res_hv_exists(info, "audio_size")) {
+        int audio_size = res_iv(*(res_hv_fetch(info, "audio_size")));
+        res_hv_store(info, "audio_size", res_newuv(audio_size - lyrics_size - 15));
         DEBUG_TRACE("Reduced audio_size value by Lyrics2 tag size %d\n", lyrics_size + 15);
       }
     }
@@ -151,13 +154,24 @@ out:
 }
 
 // _decode_mp3_frame, based on pcutmp3 FrameHeader.decode()
+// Everything but the padding and channels comes from mp3_frame_tbl, so stray
+// 0xFF bytes are ruled out with one lookup.
 int
 _decode_mp3_frame(unsigned char *bptr, struct mp3frame *frame)
 {
+  const mp3frameinfo *info;
   int i;
   
   frame->header32 = GET_INT32BE(bptr);
   
+  info = &mp3_frame_tbl[ MP3_FRAME_KEY(frame->header32) ];
+  
+  frame->valid = info->samplerate != 0;
+  
+  if (!frame->valid) {
+    return -1;
+  }
+  
   frame->mpegID             = (frame->header32 >> 19) & 3;
   frame->layerID            = (frame->header32 >> 17) & 3;
   frame->crc16_used         = (frame->header32 & 0x00010000) == 0;
@@ -171,44 +185,12 @@ _decode_mp3_frame(unsigned char *bptr, struct mp3frame *frame)
   frame->original           = (frame->header32 & 0x00000004) == 0; // bit set -> copy
   frame->emphasis           = frame->header32 & 3;
   
-  frame->valid = (frame->mpegID != ILLEGAL_MPEG_ID) 
-    && (frame->layerID != ILLEGAL_LAYER_ID)
-    && (frame->bitrate_index != 0)
-    && (frame->bitrate_index != 15)
-    && (frame->samplingrate_index != ILLEGAL_SR);
-  
-  if (!frame->valid) {
-    return -1;
-  }
-  
-  frame->samplerate = sample_rate_tbl[ frame->samplingrate_index ];
-  
-  if (frame->mpegID == MPEG2_ID)
-    frame->samplerate >>= 1; // 16,22,48 kHz
-  
-  if (frame->mpegID == MPEG25_ID)
-    frame->samplerate >>= 2; // 8,11,24 kHz
-  
-  frame->channels = (frame->mode == MODE_MONO) ? 1 : 2;
-  
-  frame->bitrate_kbps = bitrate_map[ frame->mpegID ][ frame->layerID ][ frame->bitrate_index ];
-  
-  if (frame->layerID == LAYER1_ID) {
-    // layer 1: always 384 samples/frame and 4byte-slots
-    frame->samples_per_frame = 384;
-    frame->bytes_per_slot = 4;
-  }
-  else {
-    // layer 2: always 1152 samples/frame
-    // layer 3: MPEG1: 1152 samples/frame, MPEG2/2.5: 576 samples/frame
-    frame->samples_per_frame = ((frame->mpegID == MPEG1_ID) || (frame->layerID == LAYER2_ID)) ? 1152 : 576;
-    frame->bytes_per_slot = 1;
-  }
-  
-  frame->frame_size = ((frame->bitrate_kbps * 125) * frame->samples_per_frame) / frame->samplerate;
-  
-  if (frame->bytes_per_slot > 1)
-    frame->frame_size -= frame->frame_size % frame->bytes_per_slot;
+  frame->samplerate        = info->samplerate;
+  frame->channels          = (frame->mode == MODE_MONO) ? 1 : 2;
+  frame->bitrate_kbps      = info->bitrate_kbps;
+  frame->samples_per_frame = info->samples_per_frame;
+  frame->bytes_per_slot    = info->bytes_per_slot;
+  frame->frame_size        = info->frame_size;
   
   if (frame->padding)
     frame->frame_size += frame->bytes_per_slot;
@@ -220,11 +202,130 @@ _decode_mp3_frame(unsigned char *bptr, struct mp3frame *frame)
   return 0;
 }
 
+static void
+_mp3_index_add(mp3info *mp3, off_t offset, uint32_t samples)
+{
+  if (mp3->num_index_entries == mp3->index_alloc) {
+    mp3->index_alloc = mp3->index_alloc ? mp3->index_alloc * 2 : 256;
+    Renew(mp3->index, mp3->index_alloc, mp3indexentry);
+  }
+  
+  mp3->index[mp3->num_index_entries].offset  = (uint32_t)offset;
+  mp3->index[mp3->num_index_entries].samples = samples;
+  mp3->num_index_entries++;
+}
+
+// Reads the next n bits, most significant first
+static uint32_t
+_mp3_get_bits(unsigned char *bptr, uint32_t *bitpos, uint8_t n)
+{
+  uint32_t value = 0;
+  
+  while (n--) {
+    value = (value << 1) | ((bptr[*bitpos >> 3] >> (7 - (*bitpos & 7))) & 1);
+    (*bitpos)++;
+  }
+  
+  return value;
+}
+
+// Decodes the data of an MLLT frame: frames, bytes and ms between
+// references, the bits of each deviation, then a packed (bytes, ms)
+// deviation pair for every reference.  The deviations are added to the
+// fixed distances to give the real ones.
+static void
+_mp3_parse_mllt(mp3info *mp3, unsigned char *bptr, uint32_t len)
+{
+  uint16_t frames;
+  uint32_t bytes_between;
+  uint32_t ms_between;
+  uint8_t bits_bytes;
+  uint8_t bits_ms;
+  uint32_t bitpos = 0;
+  uint32_t count;
+  uint32_t i;
+  
+  if (len < 10)
+    return;
+  
+  frames        = (bptr[0] << 8) | bptr[1];
+  bytes_between = (bptr[2] << 16) | (bptr[3] << 8) | bptr[4];
+  ms_between    = (bptr[5] << 16) | (bptr[6] << 8) | bptr[7];
+  bits_bytes    = bptr[8];
+  bits_ms       = bptr[9];
+  
+  if ( !frames || !(bits_bytes + bits_ms) || bits_bytes > 32 || bits_ms > 32 )
+    return;
+  
+  bptr += 10;
+  count = (len - 10) * 8 / (bits_bytes + bits_ms);
+  
+  DEBUG_TRACE("MLLT: %d references, every %d frames, %d bytes, %d ms\n", count, frames, bytes_between, ms_between);
+  
+  New(0, mp3->mllt, count + 1, mp3mlltref);
+  mp3->mllt[0].bytes = 0;
+  mp3->mllt[0].ms    = 0;
+  mp3->num_mllt_refs = 1;
+  mp3->mllt_frames   = frames;
+  
+  for (i = 1; i <= count; i++) {
+    uint64_t bytes = (uint64_t)mp3->mllt[i - 1].bytes + bytes_between + _mp3_get_bits(bptr, &bitpos, bits_bytes);
+    uint64_t ms    = (uint64_t)mp3->mllt[i - 1].ms + ms_between + _mp3_get_bits(bptr, &bitpos, bits_ms);
+    
+    // Padding, or a table for some other version of the file
+    if (bytes >= mp3->audio_size || ms > 0xFFFFFFFF)
+      break;
+    
+    mp3->mllt[i].bytes = (uint32_t)bytes;
+    mp3->mllt[i].ms    = (uint32_t)ms;
+    mp3->num_mllt_refs++;
+  }
+}
+
+// Builds the synthetic TOC from the frame index, interpolating between
+// entries, with the end of the last frame at end_offset
+static void
+_mp3_build_toc(mp3info *mp3, uint32_t offset, uint32_t audio_size, off_t end_offset, uint32_t total_samples)
+{
+  uint32_t lo = 0;
+  int i;
+  
+  for (i = 0; i < 100; i++) {
+    uint64_t target = (uint64_t)total_samples * i / 100;
+    double next_offset  = end_offset;
+    uint32_t next_samples = total_samples;
+    double pos;
+    
+    while ( lo + 1 < mp3->num_index_entries && mp3->index[lo + 1].samples <= target )
+      lo++;
+    
+    if ( lo + 1 < mp3->num_index_entries ) {
+      next_offset  = mp3->index[lo + 1].offset;
+      next_samples = mp3->index[lo + 1].samples;
+    }
+    
+    pos = mp3->index[lo].offset;
+    
+    if ( next_samples > mp3->index[lo].samples ) {
+      pos += (next_offset - pos) * (target - mp3->index[lo].samples) / (next_samples - mp3->index[lo].samples);
+    }
+    
+    pos = (pos - offset) * 256 / audio_size;
+    
+    mp3->synthetic_toc[i] = pos > 255 ? 255 : (uint8_t)pos;
+  }
+  
+  mp3->has_synthetic_toc = TRUE;
+}
+
 // _mp3_get_average_bitrate
 // average bitrate by averaging all the frames in the file.  This used
 // to seek to the middle of the file and take a 32K chunk but this was
 // found to have bugs if it seeked near invalid FF sync bytes that could
 // be detected as a real frame
+// The position of every MP3_INDEX_INTERVAL'th frame goes in the frame index,
+// which gives the synthetic TOC if the file turns out to be VBR, and is kept
+// for seeking.
 static short _mp3_get_average_bitrate(mp3info *mp3, uint32_t offset, uint32_t audio_size)
 {
   struct mp3frame frame;
@@ -235,13 +336,15 @@ static short _mp3_get_average_bitrate(mp3info *mp3, uint32_t offset, uint32_t au
   int wrap_skip = 0;
   int prev_bitrate = 0;
   bool vbr = FALSE;
+  off_t pos = offset;   // file offset of the buffer's start
+  uint32_t samples = 0; // samples before the current frame
 
   unsigned char *bptr;
   
   buffer_clear(mp3->buf);
 
   // Seek to offset
-  PerlIO_seek(mp3->infile, offset, SEEK_SET);
+  scanio_seek(mp3->infile, offset, SEEK_SET);
   
   while ( done < audio_size - 4 ) {
     // Buffer size is optimized for a possible common case: 20 frames of 192kbps CBR
@@ -256,26 +359,35 @@ static short _mp3_get_average_bitrate(mp3info *mp3, uint32_t offset, uint32_t au
       // Skip rest of frame from last buffer
       DEBUG_TRACE("Wrapped, consuming %d bytes from previous frame\n", wrap_skip);
       buffer_consume(mp3->buf, wrap_skip);
+      pos += wrap_skip;
       wrap_skip = 0;
     }
   
     while ( buffer_len(mp3->buf) >= 4 ) {
-      bptr = buffer_ptr(mp3->buf);
-      while ( *bptr != 0xFF ) {
-        buffer_consume(mp3->buf, 1);
+      const unsigned char *sync;
       
-        if ( buffer_len(mp3->buf) < 4 ) {
-          // ran out of data
-          goto out;
-        }
+      bptr = buffer_ptr(mp3->buf);
+      sync = syncscan_find(bptr, buffer_len(mp3->buf) - 2, &syncscan_mpeg);
       
-        bptr = buffer_ptr(mp3->buf);
+      if ( !sync ) {
+        // Keep the last 3 bytes, they may start a frame in the next read
+        pos += buffer_len(mp3->buf) - 3;
+        buffer_consume(mp3->buf, buffer_len(mp3->buf) - 3);
+        break;
       }
+      
+      buffer_consume(mp3->buf, sync - bptr);
+      pos += sync - bptr;
 
       if ( !_decode_mp3_frame( buffer_ptr(mp3->buf), &frame ) ) {
         // Found a valid frame
+        if ( !(frame_count % MP3_INDEX_INTERVAL) ) {
+          _mp3_index_add(mp3, pos, samples);
+        }
+        
         frame_count++;
         bitrate_total += frame.bitrate_kbps;
+        samples += frame.samples_per_frame;
         
         if ( !vbr ) {
           // If we see the bitrate changing, we have a VBR file, and read
@@ -284,6 +396,17 @@ static short _mp3_get_average_bitrate(mp3info *mp3, uint32_t offset, uint32_t au
           if (prev_bitrate > 0 && prev_bitrate != frame.bitrate_kbps) {
             DEBUG_TRACE("Bitrate changed, assuming file is VBR\n");
             vbr = TRUE;
+            
+            if ( mp3->sampled
+              && audio_size / MP3_SAMPLE_RATIO >= MP3_SAMPLE_MIN_WINDOWS * MP3_SAMPLE_WINDOW_SIZE
+            ) {
+              // Not reading every frame, so no TOC
+              Safefree(mp3->index);
+              mp3->index = NULL;
+              mp3->num_index_entries = mp3->index_alloc = 0;
+              
+              return _mp3_sample_bitrate(mp3, offset, audio_size);
+            }
           }
           else {
             if (frame_count > 20) {
@@ -300,20 +423,36 @@ static short _mp3_get_average_bitrate(mp3info *mp3, uint32_t offset, uint32_t au
         if (frame.frame_size > buffer_len(mp3->buf)) {
           // Partial frame in buffer
           wrap_skip = frame.frame_size - buffer_len(mp3->buf);
+          pos += buffer_len(mp3->buf);
           buffer_consume(mp3->buf, buffer_len(mp3->buf));
         }
         else {
           buffer_consume(mp3->buf, frame.frame_size);
+          pos += frame.frame_size;
         }
       }
       else {
         // Not a valid frame, stray 0xFF
         buffer_consume(mp3->buf, 1);
+        pos++;
       }
     }
   }
 
 out:
+  if (vbr && !err && mp3->num_index_entries) {
+    _mp3_build_toc(mp3, offset, audio_size, pos, samples);
+  }
+  
+  if ( (!vbr || !mp3->seeking) && mp3->index ) {
+    // Seeking by bitrate is exact enough for CBR
+    Safefree(mp3->index);
+    mp3->index = NULL;
+    mp3->num_index_entries = mp3->index_alloc = 0;
+  }
+  
+  DEBUG_TRACE("Frame index of %d entries\n", mp3->num_index_entries);
+  
   if (err) return err;
   
   if (!frame_count) return -1;
@@ -323,6 +462,135 @@ out:
   return bitrate_total / frame_count;
 }
 
+// _mp3_sample_bitrate
+// Estimates the average bitrate of a large VBR file from windows spread
+// evenly across the audio.  In each window the frames are followed from the
+// first good sync in its first quarter, which is longer than any frame, and
+// the frames starting in the rest of it are counted.  Counting by where
+// frames start, rather than whole frames read, doesn't favour small frames.
+// As the windows are evenly spaced rather than random, the 95% bound on the
+// mean uses the differences between neighbouring windows, so gradual
+// changes in bitrate through the file don't count as error.  Falls back to
+// reading every frame if too few windows can be followed.
+static short
+_mp3_sample_bitrate(mp3info *mp3, uint32_t offset, uint32_t audio_size)
+{
+  struct mp3frame frame, next;
+  mp3frame *first = mp3->first_frame;
+  uint32_t nwindows = audio_size / MP3_SAMPLE_RATIO / MP3_SAMPLE_WINDOW_SIZE;
+  uint32_t start = MP3_SAMPLE_WINDOW_SIZE / 4;
+  uint32_t end   = MP3_SAMPLE_WINDOW_SIZE - 4;
+  uint32_t stride;
+  uint32_t *counts;
+  uint32_t windows = 0;
+  uint32_t i;
+  double mean = 0, var = 0;
+  
+  if (nwindows > MP3_SAMPLE_MAX_WINDOWS)
+    nwindows = MP3_SAMPLE_MAX_WINDOWS;
+  
+  stride = audio_size / nwindows;
+  
+  New(0, counts, nwindows, uint32_t);
+  
+  for (i = 0; i < nwindows; i++) {
+    unsigned char *bptr;
+    const unsigned char *sync;
+    uint32_t len;
+    uint32_t pos = 0;
+    uint32_t count = 0;
+    
+    buffer_clear(mp3->buf);
+    scanio_seek(mp3->infile, offset + i * stride + (stride - MP3_SAMPLE_WINDOW_SIZE) / 2, SEEK_SET);
+    
+    if ( !_check_buf(mp3->infile, mp3->buf, MP3_SAMPLE_WINDOW_SIZE, MP3_SAMPLE_WINDOW_SIZE) ) {
+      break;
+    }
+    
+    bptr = buffer_ptr(mp3->buf);
+    len  = buffer_len(mp3->buf);
+    
+    // A good sync is like the first frame of the file and followed by
+    // another frame header like it, not a false sync inside a frame
+    while ( (sync = syncscan_find(bptr + pos, start - pos + 1, &syncscan_mpeg)) ) {
+      pos = sync - bptr;
+      
+      if ( !_decode_mp3_frame(bptr + pos, &frame)
+        && frame.samplerate == first->samplerate
+        && frame.channels == first->channels
+        && pos + frame.frame_size + 4 <= len
+        && !_decode_mp3_frame(bptr + pos + frame.frame_size, &next)
+        && MP3_FRAME_SYNC(next.header32)
+        && next.samplerate == frame.samplerate
+        && next.channels == frame.channels
+      ) {
+        break;
+      }
+      
+      pos++;
+    }
+    
+    if ( !sync ) {
+      continue;
+    }
+    
+    while (pos < end) {
+      if ( pos + 4 > len
+        || _decode_mp3_frame(bptr + pos, &frame)
+        || !MP3_FRAME_SYNC(frame.header32)
+        || frame.samplerate != first->samplerate
+        || frame.channels != first->channels
+      ) {
+        // Lost sync
+        break;
+      }
+      
+      if (pos >= start)
+        count++;
+      
+      pos += frame.frame_size;
+    }
+    
+    if (pos >= end) {
+      counts[windows++] = count;
+      mean += count;
+    }
+  }
+  
+  if ( windows < MP3_SAMPLE_MIN_WINDOWS / 2 ) {
+    DEBUG_TRACE("Only %d windows could be followed, reading every frame\n", windows);
+    Safefree(counts);
+    mp3->sampled = 0;
+    return _mp3_get_average_bitrate(mp3, offset, audio_size);
+  }
+  
+  // Variance of the mean frames per window from successive differences
+  mean /= windows;
+  
+  for (i = 1; i < windows; i++) {
+    double d = (double)counts[i] - counts[i - 1];
+    var += d * d;
+  }
+  
+  var /= 2. * (windows - 1) * windows;
+  
+  Safefree(counts);
+  
+  if (!mean) {
+    mp3->sampled = 0;
+    return _mp3_get_average_bitrate(mp3, offset, audio_size);
+  }
+  
+  // Average frame size gives the bitrate, the same way as for CBR
+  mp3->bitrate_estimate = (end - start) / mean * 8. * first->samplerate / first->samples_per_frame / 1000.;
+  mp3->bitrate_error    = mp3->bitrate_estimate * 1.96 * sqrt(var) / mean;
+  
+  DEBUG_TRACE("Sampled %d windows, %.2f frames each: %.2f +/- %.2f kbps\n",
+    windows, mean, mp3->bitrate_estimate, mp3->bitrate_error);
+  
+  return (short)(mp3->bitrate_estimate + 0.5);
+}
+
 static int
 _parse_xing(mp3info *mp3)
 {
@@ -570,7 +838,7 @@ _is_mp3_profile(mp3info *mp3)
 }
 
 mp3info *
-_mp3_parse(PerlIO *infile, char *file, HV *info)
+_mp3_parse(ScanIO *infile, char *file, resval *info, uint8_t seeking)
 {
   unsigned char *bptr;
   char id3v1taghdr[4];
@@ -590,16 +858,19 @@ _mp3_parse(PerlIO *infile, char *file, HV *info)
   mp3->infile       = infile;
   mp3->file         = file;
   mp3->info         = info;
+  mp3->seeking      = seeking ? 1 : 0;
+  mp3->sampled      = !seeking && (result_current()->flags & SCAN_DURATION_SAMPLED);
   
   mp3->file_size    = _file_size(infile);
   mp3->id3_size     = 0;
   mp3->audio_offset = 0;
   mp3->audio_size   = 0;
   mp3->bitrate      = 0;
+  mp3->index_interval = MP3_INDEX_INTERVAL;
   
   buffer_init(mp3->buf, MP3_BLOCK_SIZE);
   
-  my_hv_store( info, "file_size", newSVuv(mp3->file_size) );
+  res_hv_store( info, "file_size", res_newuv(mp3->file_size) );
   
   if ( !_check_buf(mp3->infile, mp3->buf, 10, MP3_BLOCK_SIZE) ) {
     goto out;
@@ -634,29 +905,35 @@ _mp3_parse(PerlIO *infile, char *file, HV *info)
 
   // Find an MP3 frame
   while ( !found_first_frame && buffer_len(mp3->buf) ) {
+    const unsigned char *sync;
+    uint32_t skip;
+    
     bptr = buffer_ptr(mp3->buf);
     
-    while ( *bptr != 0xFF ) {
-      buffer_consume(mp3->buf, 1);
-     
-      mp3->audio_offset++;
-
-      if ( !buffer_len(mp3->buf) ) {
-        if (mp3->audio_offset >= mp3->file_size - 4) {
-          // No audio frames in file
-          warn("Unable to find any MP3 frames in file: %s\n", file);
-          goto out;
-        }
-        
-        if ( !_check_buf(mp3->infile, mp3->buf, 4, MP3_BLOCK_SIZE) ) {
-          warn("Unable to find any MP3 frames in file: %s\n", file);
-          goto out;
-        }
+    while ( !(sync = syncscan_find(bptr, buffer_len(mp3->buf), &syncscan_mpeg)) ) {
+      // Keep the last byte, it may be the start of a sync
+      skip = buffer_len(mp3->buf) - 1;
+      buffer_consume(mp3->buf, skip);
+      
+      mp3->audio_offset += skip;
+      
+      if (mp3->audio_offset >= mp3->file_size - 4) {
+        // No audio frames in file
+        LOG_WARN("Unable to find any MP3 frames in file: %s\n", file);
+        goto out;
+      }
+      
+      if ( !_check_buf(mp3->infile, mp3->buf, 4, MP3_BLOCK_SIZE) ) {
+        LOG_WARN("Unable to find any MP3 frames in file: %s\n", file);
+        goto out;
       }
       
       bptr = buffer_ptr(mp3->buf);
     }
     
+    buffer_consume(mp3->buf, sync - bptr);
+    mp3->audio_offset += sync - bptr;
+    
     DEBUG_TRACE("Found FF sync at offset %d\n", (int)mp3->audio_offset);
     
     // Make sure we have 4 bytes
@@ -712,7 +989,7 @@ _mp3_parse(PerlIO *infile, char *file, HV *info)
   }
 
   if ( !found_first_frame ) {
-    warn("Unable to find any MP3 frames in file (checked 4K): %s\n", file);
+    LOG_WARN("Unable to find any MP3 frames in file (checked 4K): %s\n", file);
     goto out;
   }
 
@@ -725,6 +1002,19 @@ _mp3_parse(PerlIO *infile, char *file, HV *info)
     goto out;
   }
 
+  // An MLLT frame in the ID3v2 tag locates frames without reading them
+  if (mp3->id3_size) {
+    Buffer mllt;
+    
+    buffer_init(&mllt, 0);
+    
+    if ( id3_find_v2_frame(infile, file, 0, "MLLT", &mllt) ) {
+      _mp3_parse_mllt(mp3, buffer_ptr(&mllt), buffer_len(&mllt));
+    }
+    
+    buffer_free(&mllt);
+  }
+
   // use LAME CBR/ABR value for bitrate if available
   if ( (mp3->vbr == CBR || mp3->vbr == ABR) && mp3->xing_frame->lame_abr_rate ) {
     if (mp3->xing_frame->lame_abr_rate >= 255) {
@@ -754,9 +1044,34 @@ _mp3_parse(PerlIO *infile, char *file, HV *info)
     DEBUG_TRACE("bitrate from VBRI header: %d\n", mp3->bitrate);
   }
 
+  // Or the average of the MLLT references, rather than reading every frame
+  if (!mp3->bitrate && mp3->num_mllt_refs > 1) {
+    mp3mlltref *last = &mp3->mllt[mp3->num_mllt_refs - 1];
+    
+    if (last->ms) {
+      mp3->bitrate = (uint16_t)( ((uint64_t)last->bytes * 8 + last->ms / 2) / last->ms );
+      DEBUG_TRACE("bitrate from MLLT: %d\n", mp3->bitrate);
+    }
+  }
+
+  // Without a Xing/Info/VBRI frame, the first MLLT reference is the first
+  // audio frame and the references are a frame index like the one built
+  // while averaging the bitrate, without reading the frames
+  if ( seeking && mp3->num_mllt_refs > 1
+    && !(mp3->xing_frame->xing_tag || mp3->xing_frame->info_tag || mp3->xing_frame->vbri_tag)
+  ) {
+    uint32_t i;
+    
+    for (i = 0; i < mp3->num_mllt_refs; i++) {
+      _mp3_index_add(mp3, mp3->audio_offset + mp3->mllt[i].bytes, i * mp3->mllt_frames * frame.samples_per_frame);
+    }
+    
+    mp3->index_interval = mp3->mllt_frames;
+  }
+
   // check if last 128 bytes is ID3v1.0 or ID3v1.1 tag
-  PerlIO_seek(infile, mp3->file_size - 128, SEEK_SET);
-  if (PerlIO_read(infile, id3v1taghdr, 4) == 4) {
+  scanio_seek(infile, mp3->file_size - 128, SEEK_SET);
+  if (scanio_read(infile, id3v1taghdr, 4) == 4) {
     if (id3v1taghdr[0]=='T' && id3v1taghdr[1]=='A' && id3v1taghdr[2]=='G') {
       DEBUG_TRACE("ID3v1 tag found\n");
       mp3->audio_size -= 128;
@@ -791,6 +1106,9 @@ _mp3_parse(PerlIO *infile, char *file, HV *info)
 			(double) frame.samplerate);
     total_samples = mp3->xing_frame->vbri_frames * frame.samples_per_frame;
 	}
+  else if (mp3->bitrate_estimate) {
+    song_length_ms = (int) ((double)mp3->audio_size * 8. / mp3->bitrate_estimate);
+  }
   else {
     song_length_ms = (int) ((double)mp3->audio_size * 8. /
 			(double)mp3->bitrate);
@@ -798,122 +1116,633 @@ _mp3_parse(PerlIO *infile, char *file, HV *info)
   
   mp3->song_length_ms = song_length_ms;
   
-  my_hv_store( info, "song_length_ms", newSVuv(song_length_ms) );
-  my_hv_store( info, "layer", newSVuv(frame.layerID) );
-  my_hv_store( info, "stereo", newSVuv(frame.channels == 2 ? 1 : 0) );
-  my_hv_store( info, "samples_per_frame", newSVuv(frame.samples_per_frame) );
-  my_hv_store( info, "padding", newSVuv(frame.padding) );
-  my_hv_store( info, "audio_size", newSVuv(mp3->audio_size) );
-  my_hv_store( info, "audio_offset", newSVuv(mp3->audio_offset) );
-  my_hv_store( info, "bitrate", newSVuv( mp3->bitrate * 1000 ) );
-  my_hv_store( info, "samplerate", newSVuv( frame.samplerate ) );
+  res_hv_store( info, "song_length_ms", res_newuv(song_length_ms) );
+  
+  if (mp3->bitrate_estimate) {
+    // Length is inversely proportional to the bitrate
+    res_hv_store( info, "estimated", res_newuv(1) );
+    res_hv_store( info, "song_length_ms_error", res_newuv( (uint32_t)(
+      song_length_ms * mp3->bitrate_error / (mp3->bitrate_estimate - mp3->bitrate_error) + 0.5
+    ) ) );
+  }
+  res_hv_store( info, "layer", res_newuv(frame.layerID) );
+  res_hv_store( info, "stereo", res_newuv(frame.channels == 2 ? 1 : 0) );
+  res_hv_store( info, "samples_per_frame", res_newuv(frame.samples_per_frame) );
+  res_hv_store( info, "padding", res_newuv(frame.padding) );
+  res_hv_store( info, "audio_size", res_newuv(mp3->audio_size) );
+  res_hv_store( info, "audio_offset", res_newuv(mp3->audio_offset) );
+  res_hv_store( info, "bitrate", res_newuv( mp3->bitrate * 1000 ) );
+  res_hv_store( info, "samplerate", res_newuv( frame.samplerate ) );
 
   if (mp3->xing_frame->xing_tag || mp3->xing_frame->info_tag) {
     if (mp3->xing_frame->xing_frames) {
-      my_hv_store( info, "xing_frames", newSVuv(mp3->xing_frame->xing_frames) );
+      res_hv_store( info, "xing_frames", res_newuv(mp3->xing_frame->xing_frames) );
     }
 
     if (mp3->xing_frame->xing_bytes) {
-      my_hv_store( info, "xing_bytes", newSVuv(mp3->xing_frame->xing_bytes) );
+      res_hv_store( info, "xing_bytes", res_newuv(mp3->xing_frame->xing_bytes) );
     }
     
     if (mp3->xing_frame->has_toc) {
       uint8_t i;
-      AV *xing_toc = newAV();
+      resval *xing_toc = res_newav();
 
       for (i = 0; i < 100; i++) {
-        av_push( xing_toc, newSVuv(mp3->xing_frame->xing_toc[i]) );
+        res_av_push( xing_toc, res_newuv(mp3->xing_frame->xing_toc[i]) );
       }
 
-      my_hv_store( info, "xing_toc", newRV_noinc( (SV *)xing_toc ) );
+      res_hv_store( info, "xing_toc", xing_toc );
     }
 
     if (mp3->xing_frame->xing_quality) {
-      my_hv_store( info, "xing_quality", newSVuv(mp3->xing_frame->xing_quality) );
+      res_hv_store( info, "xing_quality", res_newuv(mp3->xing_frame->xing_quality) );
+    }
+  }
+
+  if (mp3->has_synthetic_toc) {
+    uint8_t i;
+    resval *synthetic_toc = res_newav();
+    
+    for (i = 0; i < 100; i++) {
+      res_av_push( synthetic_toc, res_newuv(mp3->synthetic_toc[i]) );
     }
+    
+    res_hv_store( info, "synthetic_toc", synthetic_toc );
+  }
+
+  if (mp3->num_mllt_refs > 1) {
+    uint32_t i;
+    resval *mllt_bytes = res_newav();
+    resval *mllt_ms = res_newav();
+    
+    for (i = 0; i < mp3->num_mllt_refs; i++) {
+      res_av_push( mllt_bytes, res_newuv(mp3->mllt[i].bytes) );
+      res_av_push( mllt_ms, res_newuv(mp3->mllt[i].ms) );
+    }
+    
+    res_hv_store( info, "mllt_frames", res_newuv(mp3->mllt_frames) );
+    res_hv_store( info, "mllt_bytes", mllt_bytes );
+    res_hv_store( info, "mllt_ms", mllt_ms );
   }
 
   if (mp3->xing_frame->vbri_tag) {
-    my_hv_store( info, "vbri_delay", newSVuv(mp3->xing_frame->vbri_delay) );
-    my_hv_store( info, "vbri_frames", newSVuv(mp3->xing_frame->vbri_frames) );
-    my_hv_store( info, "vbri_bytes", newSVuv(mp3->xing_frame->vbri_bytes) );
-    my_hv_store( info, "vbri_quality", newSVuv(mp3->xing_frame->vbri_quality) );
+    res_hv_store( info, "vbri_delay", res_newuv(mp3->xing_frame->vbri_delay) );
+    res_hv_store( info, "vbri_frames", res_newuv(mp3->xing_frame->vbri_frames) );
+    res_hv_store( info, "vbri_bytes", res_newuv(mp3->xing_frame->vbri_bytes) );
+    res_hv_store( info, "vbri_quality", res_newuv(mp3->xing_frame->vbri_quality) );
   }
 
   if (mp3->xing_frame->lame_tag) {
-    my_hv_store( info, "lame_encoder_version", newSVpvn(mp3->xing_frame->lame_encoder_version, 9) );
-    my_hv_store( info, "lame_tag_revision", newSViv(mp3->xing_frame->lame_tag_revision) );
-    my_hv_store( info, "lame_vbr_method", newSVpv( vbr_methods[mp3->xing_frame->lame_vbr_method], 0 ) );
-    my_hv_store( info, "lame_lowpass", newSViv(mp3->xing_frame->lame_lowpass) );
+    res_hv_store( info, "lame_encoder_version", res_newpvn(mp3->xing_frame->lame_encoder_version, 9) );
+    res_hv_store( info, "lame_tag_revision", res_newiv(mp3->xing_frame->lame_tag_revision) );
+    res_hv_store( info, "lame_vbr_method", res_newpv( vbr_methods[mp3->xing_frame->lame_vbr_method], 0 ) );
+    res_hv_store( info, "lame_lowpass", res_newiv(mp3->xing_frame->lame_lowpass) );
 
     if (mp3->xing_frame->lame_replay_gain[0]) {
-      my_hv_store( info, "lame_replay_gain_radio", newSVpvf( "%.1f dB", mp3->xing_frame->lame_replay_gain[0] ) );
+      res_hv_store( info, "lame_replay_gain_radio", res_newpvf( "%.1f dB", mp3->xing_frame->lame_replay_gain[0] ) );
     }
 
     if (mp3->xing_frame->lame_replay_gain[1]) {
-      my_hv_store( info, "lame_replay_gain_audiophile", newSVpvf( "%.1f dB", mp3->xing_frame->lame_replay_gain[1] ) );
+      res_hv_store( info, "lame_replay_gain_audiophile", res_newpvf( "%.1f dB", mp3->xing_frame->lame_replay_gain[1] ) );
     }
 
-    my_hv_store( info, "lame_encoder_delay", newSViv(mp3->xing_frame->lame_encoder_delay) );
-    my_hv_store( info, "lame_encoder_padding", newSViv(mp3->xing_frame->lame_encoder_padding) );
+    res_hv_store( info, "lame_encoder_delay", res_newiv(mp3->xing_frame->lame_encoder_delay) );
+    res_hv_store( info, "lame_encoder_padding", res_newiv(mp3->xing_frame->lame_encoder_padding) );
 
-    my_hv_store( info, "lame_noise_shaping", newSViv(mp3->xing_frame->lame_noise_shaping) );
-    my_hv_store( info, "lame_stereo_mode", newSVpv( stereo_modes[mp3->xing_frame->lame_stereo_mode], 0 ) );
-    my_hv_store( info, "lame_unwise_settings", newSViv(mp3->xing_frame->lame_unwise) );
-    my_hv_store( info, "lame_source_freq", newSVpv( source_freqs[mp3->xing_frame->lame_source_freq], 0 ) );
+    res_hv_store( info, "lame_noise_shaping", res_newiv(mp3->xing_frame->lame_noise_shaping) );
+    res_hv_store( info, "lame_stereo_mode", res_newpv( stereo_modes[mp3->xing_frame->lame_stereo_mode], 0 ) );
+    res_hv_store( info, "lame_unwise_settings", res_newiv(mp3->xing_frame->lame_unwise) );
+    res_hv_store( info, "lame_source_freq", res_newpv( source_freqs[mp3->xing_frame->lame_source_freq], 0 ) );
 
-//    my_hv_store( info, "lame_mp3gain", newSViv(mp3->xing_frame->lame_mp3gain) );
-//    my_hv_store( info, "lame_mp3gain_db", newSVnv(mp3->xing_frame->lame_mp3gain_db) );
+//    res_hv_store( info, "lame_mp3gain", res_newiv(mp3->xing_frame->lame_mp3gain) );
+//    res_hv_store( info, "lame_mp3gain_db", res_newnv(mp3->xing_frame->lame_mp3gain_db) );
 
-    my_hv_store( info, "lame_surround", newSVpv( surround[mp3->xing_frame->lame_surround], 0 ) );
+    res_hv_store( info, "lame_surround", res_newpv( surround[mp3->xing_frame->lame_surround], 0 ) );
 
     if (mp3->xing_frame->lame_preset < 8) {
-      my_hv_store( info, "lame_preset", newSVpvn( "Unknown", 7 ) );
+      res_hv_store( info, "lame_preset", res_newpvn( "Unknown", 7 ) );
     }
     else if (mp3->xing_frame->lame_preset <= 320) {
-      my_hv_store( info, "lame_preset", newSVpvf( "ABR %d", mp3->xing_frame->lame_preset ) );
+      res_hv_store( info, "lame_preset", res_newpvf( "ABR %d", mp3->xing_frame->lame_preset ) );
     }
     else if (mp3->xing_frame->lame_preset <= 500) {
       mp3->xing_frame->lame_preset /= 10;
       mp3->xing_frame->lame_preset -= 41;
       if ( presets_v[mp3->xing_frame->lame_preset] ) {
-        my_hv_store( info, "lame_preset", newSVpv( presets_v[mp3->xing_frame->lame_preset], 0 ) );
+        res_hv_store( info, "lame_preset", res_newpv( presets_v[mp3->xing_frame->lame_preset], 0 ) );
       }
     }
     else if (mp3->xing_frame->lame_preset >= 1000 && mp3->xing_frame->lame_preset <= 1007) {
       mp3->xing_frame->lame_preset -= 1000;
       if ( presets_old[mp3->xing_frame->lame_preset] ) {
-        my_hv_store( info, "lame_preset", newSVpv( presets_old[mp3->xing_frame->lame_preset], 0 ) );
+        res_hv_store( info, "lame_preset", res_newpv( presets_old[mp3->xing_frame->lame_preset], 0 ) );
       }
     }
   }
   
   if (mp3->vbr == ABR || mp3->vbr == VBR) {
-    my_hv_store( info, "vbr", newSViv(1) );
+    res_hv_store( info, "vbr", res_newiv(1) );
   }
   
   // DLNA profile detection
   if (_is_mp3x_profile(mp3))
-    my_hv_store( info, "dlna_profile", newSVpvn( "MP3X", 4 ) );
+    res_hv_store( info, "dlna_profile", res_newpvn( "MP3X", 4 ) );
   else if (_is_mp3_profile(mp3))
-    my_hv_store( info, "dlna_profile", newSVpvn( "MP3", 3 ) );
+    res_hv_store( info, "dlna_profile", res_newpvn( "MP3", 3 ) );
   
 out:
 
   return mp3;
 }
 
+off_t
+mp3_find_frame(ScanIO *infile, char *file, int offset)
+{
+  void *mp3 = mp3_seek_open(infile, file);
+  off_t frame_offset = mp3_seek(mp3, offset, NULL);
+  
+  mp3_seek_close(mp3);
+  
+  return frame_offset;
+}
+
 int
-mp3_find_frame(PerlIO *infile, char *file, int offset)
+mp3_find_frame_return_info(ScanIO *infile, char *file, int offset, resval *info)
+{
+  void *mp3 = mp3_seek_open(infile, file);
+  int ret = mp3_seek(mp3, offset, info) < 0 ? -1 : 1;
+  
+  mp3_seek_close(mp3);
+  
+  return ret;
+}
+
+// Parses the file once, keeping what mp3_seek needs (Xing TOC, bitrate, audio offset)
+void *
+mp3_seek_open(ScanIO *infile, char *file)
+{
+  resval *info = res_newhv();
+  
+  return _mp3_parse(infile, file, info, 1);
+}
+
+void
+mp3_seek_close(void *state)
+{
+  mp3info *mp3 = (mp3info *)state;
+  
+  if (mp3->index)
+    Safefree(mp3->index);
+  
+  if (mp3->mllt)
+    Safefree(mp3->mllt);
+  
+  buffer_free(mp3->buf);
+  Safefree(mp3->buf);
+  Safefree(mp3->first_frame);
+  Safefree(mp3->xing_frame);
+  Safefree(mp3);
+}
+
+// Returns the frame index as { interval, offsets, samples }, or NULL if the
+// file doesn't have one
+resval *
+mp3_seek_index(void *state)
+{
+  mp3info *mp3 = (mp3info *)state;
+  resval *index;
+  resval *offsets;
+  resval *samples;
+  uint32_t i;
+  
+  if ( !mp3->num_index_entries )
+    return NULL;
+  
+  index   = res_newhv();
+  offsets = res_newav();
+  samples = res_newav();
+  
+  for (i = 0; i < mp3->num_index_entries; i++) {
+    res_av_push( offsets, res_newuv(mp3->index[i].offset) );
+    res_av_push( samples, res_newuv(mp3->index[i].samples) );
+  }
+  
+  res_hv_store( index, "interval", res_newuv(mp3->index_interval) );
+  res_hv_store( index, "offsets", offsets );
+  res_hv_store( index, "samples", samples );
+  
+  return index;
+}
+
+// Finds the next frame at or after *pos, skipping stray bytes, with the
+// buffer at it.  Returns 0 at the end of the audio.
+static int
+_mp3_next_frame(mp3info *mp3, Buffer *buf, off_t *pos, struct mp3frame *frame)
+{
+  while ( *pos < mp3->audio_offset + mp3->audio_size
+    && _check_buf(mp3->infile, buf, 4, MP3_BLOCK_SIZE) ) {
+    unsigned char *bptr = buffer_ptr(buf);
+    const unsigned char *sync = syncscan_find(bptr, buffer_len(buf) - 2, &syncscan_mpeg);
+    
+    if ( sync != bptr ) {
+      // Stray bytes between frames, the index skipped these too
+      uint32_t skip = sync ? sync - bptr : buffer_len(buf) - 3;
+      
+      buffer_consume(buf, skip);
+      *pos += skip;
+      continue;
+    }
+    
+    if ( _decode_mp3_frame(bptr, frame) ) {
+      buffer_consume(buf, 1);
+      (*pos)++;
+      continue;
+    }
+    
+    return 1;
+  }
+  
+  return 0;
+}
+
+// Moves past the frame found by _mp3_next_frame
+static void
+_mp3_skip_frame(mp3info *mp3, Buffer *buf, off_t *pos, struct mp3frame *frame)
+{
+  *pos += frame->frame_size;
+  
+  if (frame->frame_size <= buffer_len(buf)) {
+    buffer_consume(buf, frame->frame_size);
+  }
+  else {
+    buffer_clear(buf);
+    scanio_seek(mp3->infile, *pos, SEEK_SET);
+  }
+}
+
+// Indexes the whole file, for files whose bitrate didn't need every frame
+// read while parsing
+static void
+_mp3_index_build(mp3info *mp3)
+{
+  Buffer buf;
+  struct mp3frame frame;
+  off_t pos = mp3->audio_offset;
+  uint32_t samples = 0;
+  int frame_count = 0;
+  
+  // The Xing/Info/VBRI frame isn't audio
+  if (mp3->xing_frame->xing_tag || mp3->xing_frame->info_tag || mp3->xing_frame->vbri_tag)
+    pos += mp3->first_frame->frame_size;
+  
+  buffer_init(&buf, MP3_BLOCK_SIZE);
+  scanio_seek(mp3->infile, pos, SEEK_SET);
+  
+  while ( _mp3_next_frame(mp3, &buf, &pos, &frame) ) {
+    if ( !(frame_count % MP3_INDEX_INTERVAL) ) {
+      _mp3_index_add(mp3, pos, samples);
+    }
+    
+    frame_count++;
+    samples += frame.samples_per_frame;
+    _mp3_skip_frame(mp3, &buf, &pos, &frame);
+  }
+  
+  buffer_free(&buf);
+  
+  DEBUG_TRACE("Built frame index of %d entries\n", mp3->num_index_entries);
+}
+
+// The size of the main data of a layer 3 frame, after its header, CRC and
+// side info, and main_data_begin, how many bytes of the main data of the
+// frames before it that its own data starts with
+static void
+_mp3_main_data(struct mp3frame *frame, unsigned char *bptr, uint16_t *size, uint16_t *begin)
+{
+  int side_info;
+  
+  *size = *begin = 0;
+  
+  if (frame->layerID != LAYER3_ID)
+    return;
+  
+  if (frame->mpegID == MPEG1_ID)
+    side_info = frame->channels == 2 ? 32 : 17;
+  else
+    side_info = frame->channels == 2 ? 17 : 9;
+  
+  bptr += frame->crc16_used ? 6 : 4;
+  
+  if (frame->frame_size > 4 + side_info)
+    *size = frame->frame_size - 4 - side_info - (frame->crc16_used ? 2 : 0);
+  
+  if (frame->mpegID == MPEG1_ID)
+    *begin = (bptr[0] << 1) | (bptr[1] >> 7);
+  else
+    *begin = bptr[0];
+}
+
+// Finds the frame holding target_sample by walking forward from the
+// nearest entry in the frame index.  If seek is given, also works out
+// where decoding has to start for that frame to come out right: layer 3
+// frames overlap with the frame before, which in turn needs the earlier
+// frames holding its bit reservoir data.
+static int
+_mp3_index_seek(mp3info *mp3, uint64_t target_sample, mp3seekframe *seek)
+{
+  Buffer buf;
+  struct mp3frame frame;
+  uint32_t lo = 0;
+  uint32_t hi = mp3->num_index_entries;
+  off_t pos;
+  uint64_t samples;
+  int frame_offset = -1;
+  
+  // The last MP3_PREROLL_FRAMES frames when seek is given
+  off_t prev_offset[MP3_PREROLL_FRAMES];
+  uint16_t prev_size[MP3_PREROLL_FRAMES];
+  uint16_t prev_begin[MP3_PREROLL_FRAMES];
+  uint32_t frames = 0;
+  
+  // Last entry at or before the target
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    
+    if (mp3->index[mid].samples <= target_sample)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  
+  // The frames before the target may be needed for the preroll
+  if (seek && lo > 0)
+    lo--;
+  
+  pos     = mp3->index[lo].offset;
+  samples = mp3->index[lo].samples;
+  
+  buffer_init(&buf, MP3_BLOCK_SIZE);
+  scanio_seek(mp3->infile, pos, SEEK_SET);
+  
+  // Past the end of the audio this returns the last frame
+  while ( _mp3_next_frame(mp3, &buf, &pos, &frame) ) {
+    frame_offset = pos;
+    
+    if (seek) {
+      uint32_t i = frames++ % MP3_PREROLL_FRAMES;
+      
+      prev_offset[i] = pos;
+      prev_size[i] = prev_begin[i] = 0;
+      
+      // The side info follows the header and CRC
+      if ( _check_buf(mp3->infile, &buf, 8, MP3_BLOCK_SIZE) ) {
+        _mp3_main_data(&frame, buffer_ptr(&buf), &prev_size[i], &prev_begin[i]);
+      }
+      
+      seek->offset = pos;
+      seek->first_sample = samples;
+    }
+    
+    if (samples + frame.samples_per_frame > target_sample)
+      break;
+    
+    samples += frame.samples_per_frame;
+    _mp3_skip_frame(mp3, &buf, &pos, &frame);
+  }
+  
+  buffer_free(&buf);
+  
+  if (seek && frames) {
+    // Frames are numbered as read, the target is the last one, t
+    uint32_t t = frames - 1;
+    uint32_t p = t;
+    
+    if (frame.layerID == LAYER3_ID && t > 0) {
+      int need = prev_begin[(t - 1) % MP3_PREROLL_FRAMES];
+      
+      p = t - 1;
+      
+      while ( need > 0 && p > 0 && t - p + 1 < MP3_PREROLL_FRAMES ) {
+        p--;
+        need -= prev_size[p % MP3_PREROLL_FRAMES];
+      }
+    }
+    
+    seek->preroll_offset  = prev_offset[p % MP3_PREROLL_FRAMES];
+    seek->preroll_samples = (t - p) * frame.samples_per_frame;
+  }
+  
+  return frame_offset;
+}
+
+// Samples before the gapless stream in the decoded audio of a file with a
+// LAME header, 0 otherwise
+static uint32_t
+_mp3_gapless_delay(mp3info *mp3)
 {
+  if (mp3->xing_frame->lame_tag && mp3->first_frame->layerID == LAYER3_ID)
+    return mp3->xing_frame->lame_encoder_delay + MP3_DECODER_DELAY;
+  
+  return 0;
+}
+
+// find_frame_return_info: the exact frame holding the requested time, using
+// the frame index (built here if the file didn't need one), and what has to
+// be decoded and dropped to start at it.  With a LAME header the time is in
+// the gapless stream, after the encoder and decoder delay.
+static int
+_mp3_seek_return_info(mp3info *mp3, int offset, resval *info)
+{
+  mp3seekframe seek;
+  uint64_t target_sample = (uint64_t)offset * mp3->first_frame->samplerate / 1000;
+  int frame_offset;
+  
+  if ( !mp3->num_index_entries )
+    _mp3_index_build(mp3);
+  
+  if ( !mp3->num_index_entries )
+    return -1;
+  
+  target_sample += _mp3_gapless_delay(mp3);
+  
+  frame_offset = _mp3_index_seek(mp3, target_sample, &seek);
+  
+  if (frame_offset < 0)
+    return -1;
+  
+  DEBUG_TRACE("find_frame_return_info: target sample %llu in frame @ %d from sample %llu, preroll @ %d\n",
+    target_sample, frame_offset, seek.first_sample, (int)seek.preroll_offset);
+  
+  res_hv_store( info, "seek_offset", res_newuv(seek.offset) );
+  res_hv_store( info, "frame_first_sample", res_newuv(seek.first_sample) );
+  res_hv_store( info, "skip_samples", res_newuv(target_sample - seek.first_sample) );
+  res_hv_store( info, "preroll_offset", res_newuv(seek.preroll_offset) );
+  res_hv_store( info, "preroll_samples", res_newuv(seek.preroll_samples) );
+  
+  return frame_offset;
+}
+
+// Builds a Xing frame in out for a clip of frames like first, at offsets
+// from clip_offset with clip_bytes in all.  Uses the smallest bitrate with
+// room for the tag, and returns its size, or 0 if none has room.
+static int
+_mp3_clip_xing(struct mp3frame *first, uint32_t frames, uint32_t *offsets, off_t clip_offset, uint32_t clip_bytes, bool vbr, unsigned char *out)
+{
+  int side_info = first->mpegID == MPEG1_ID
+    ? (first->channels == 2 ? 32 : 17)
+    : (first->channels == 2 ? 17 : 9);
+  uint32_t header = 0;
+  uint32_t bytes;
+  int size = 0;
+  int i;
+  
+  for (i = 1; i < 15; i++) {
+    // Same version, layer, samplerate and mode, without CRC or padding
+    header = ((uint32_t)first->header32 & 0xFFFE0CFF) | 0x00010000 | (i << 12);
+    size = mp3_frame_tbl[ MP3_FRAME_KEY(header) ].frame_size;
+    
+    if (size >= 4 + side_info + 120)
+      break;
+  }
+  
+  if (i == 15)
+    return 0;
+  
+  bytes = size + clip_bytes;
+  
+  memset(out, 0, size);
+  
+  out[0] = header >> 24;
+  out[1] = header >> 16;
+  out[2] = header >> 8;
+  out[3] = header;
+  
+  out += 4 + side_info;
+  memcpy(out, vbr ? "Xing" : "Info", 4);
+  out[7]  = XING_FRAMES | XING_BYTES | XING_TOC;
+  out[8]  = frames >> 24;
+  out[9]  = frames >> 16;
+  out[10] = frames >> 8;
+  out[11] = frames;
+  out[12] = bytes >> 24;
+  out[13] = bytes >> 16;
+  out[14] = bytes >> 8;
+  out[15] = bytes;
+  
+  // The TOC is by time, so entry i is frame i / frames of the way in
+  for (i = 0; i < 100; i++) {
+    double pos = size + offsets[ (uint64_t)frames * i / 100 ] - clip_offset;
+    
+    pos = pos * 256 / bytes;
+    out[16 + i] = pos > 255 ? 255 : (uint8_t)pos;
+  }
+  
+  return size;
+}
+
+// The bytes to serve for the audio from start_ms to end_ms: the frames
+// holding it, from the preroll of the first one, and a Xing frame for them.
+// Returns NULL if the range isn't in the file.
+resval *
+mp3_clip_ranges(void *state, int start_ms, int end_ms)
+{
+  mp3info *mp3 = (mp3info *)state;
+  mp3seekframe seek;
+  Buffer buf;
+  struct mp3frame frame;
+  uint64_t start_sample, end_sample, samples;
+  uint32_t *offsets = NULL;
+  uint32_t frames = 0;
+  uint32_t alloc = 0;
+  uint32_t bitrate = 0;
+  bool vbr = FALSE;
+  off_t pos;
+  resval *clip;
+  resval *ranges;
+  resval *range;
+  
+  if ( !mp3->song_length_ms || start_ms < 0 || start_ms >= end_ms || start_ms >= mp3->song_length_ms )
+    return NULL;
+  
+  if (end_ms > mp3->song_length_ms)
+    end_ms = mp3->song_length_ms;
+  
+  if ( !mp3->num_index_entries )
+    _mp3_index_build(mp3);
+  
+  if ( !mp3->num_index_entries )
+    return NULL;
+  
+  start_sample = (uint64_t)start_ms * mp3->first_frame->samplerate / 1000 + _mp3_gapless_delay(mp3);
+  end_sample   = (uint64_t)end_ms * mp3->first_frame->samplerate / 1000 + _mp3_gapless_delay(mp3);
+  
+  if ( _mp3_index_seek(mp3, start_sample, &seek) < 0 )
+    return NULL;
+  
+  // Every frame from the preroll to the one holding the last sample
+  pos = seek.preroll_offset;
+  samples = seek.first_sample - seek.preroll_samples;
+  
+  buffer_init(&buf, MP3_BLOCK_SIZE);
+  scanio_seek(mp3->infile, pos, SEEK_SET);
+  
+  while ( samples < end_sample && _mp3_next_frame(mp3, &buf, &pos, &frame) ) {
+    if (frames == alloc) {
+      alloc = alloc ? alloc * 2 : 256;
+      Renew(offsets, alloc, uint32_t);
+    }
+    
+    offsets[frames++] = pos;
+    
+    if (bitrate && bitrate != frame.bitrate_kbps)
+      vbr = TRUE;
+    bitrate = frame.bitrate_kbps;
+    
+    samples += frame.samples_per_frame;
+    _mp3_skip_frame(mp3, &buf, &pos, &frame);
+  }
+  
+  buffer_free(&buf);
+  
+  if (!frames)
+    return NULL;
+  
+  clip   = res_newhv();
+  ranges = res_newav();
+  range  = res_newav();
+  
+  res_av_push( range, res_newuv(seek.preroll_offset) );
+  res_av_push( range, res_newuv(pos - seek.preroll_offset) );
+  res_av_push( ranges, range );
+  
+  res_hv_store( clip, "ranges", ranges );
+  res_hv_store( clip, "frames", res_newuv(frames) );
+  res_hv_store( clip, "skip_samples", res_newuv(start_sample - (seek.first_sample - seek.preroll_samples)) );
+  res_hv_store( clip, "padding_samples", res_newuv(samples > end_sample ? samples - end_sample : 0) );
+  
+  if (mp3->first_frame->layerID == LAYER3_ID) {
+    unsigned char xing[MP3_BLOCK_SIZE];
+    int xing_size = _mp3_clip_xing(mp3->first_frame, frames, offsets, seek.preroll_offset, pos - seek.preroll_offset, vbr, xing);
+    
+    if (xing_size)
+      res_hv_store( clip, "xing_frame", res_newpvn((char *)xing, xing_size) );
+  }
+  
+  Safefree(offsets);
+  
+  return clip;
+}
+
+off_t
+mp3_seek(void *state, int offset, resval *info)
+{
+  mp3info *mp3 = (mp3info *)state;
+  ScanIO *infile = mp3->infile;
   Buffer mp3_buf;
   unsigned char *bptr;
   unsigned int buf_size;
   struct mp3frame frame;
   int frame_offset = -1;
-  HV *info = newHV();
-  
-  mp3info *mp3 = _mp3_parse(infile, file, info);
   
   buffer_init(&mp3_buf, MP3_BLOCK_SIZE);
   
@@ -935,8 +1764,24 @@ mp3_find_frame(PerlIO *infile, char *file, int offset)
       goto out;
     }
     
+    if (info) {
+      frame_offset = _mp3_seek_return_info(mp3, offset, info);
+      goto out;
+    }
+    
+    // Use the frame index of a VBR file, this is sample accurate
+    if ( mp3->num_index_entries ) {
+      uint64_t target_sample = (uint64_t)offset * mp3->first_frame->samplerate / 1000;
+      
+      frame_offset = _mp3_index_seek(mp3, target_sample, NULL);
+      
+      DEBUG_TRACE("find_frame: using frame index, target sample %llu, frame offset: %d\n", target_sample, frame_offset);
+      
+      goto out;
+    }
+    
     // Use Xing TOC if available
-    if ( mp3->xing_frame->has_toc ) {
+    else if ( mp3->xing_frame->has_toc ) {
       float percent;
       uint8_t ipercent;
       uint16_t tva;
@@ -996,7 +1841,7 @@ mp3_find_frame(PerlIO *infile, char *file, int offset)
     DEBUG_TRACE("find_frame: offset too close to end of file, adjusted to %d\n", frame_offset);
   }
   
-  PerlIO_seek(infile, frame_offset, SEEK_SET);
+  scanio_seek(infile, frame_offset, SEEK_SET);
 
   if ( !_check_buf(infile, &mp3_buf, 4, MP3_BLOCK_SIZE) ) {
     frame_offset = -1;
@@ -1007,12 +1852,18 @@ mp3_find_frame(PerlIO *infile, char *file, int offset)
   buf_size = buffer_len(&mp3_buf);
   
   // Find 0xFF sync and verify it's a valid mp3 frame header
-  while (1) {
-    if (
-      buf_size < 4
-      ||
-      ( bptr[0] == 0xFF && !_decode_mp3_frame( bptr, &frame ) )
-    ) {
+  while ( buf_size >= 4 ) {
+    unsigned char *sync = (unsigned char *)syncscan_find(bptr, buf_size - 2, &syncscan_mpeg);
+    
+    if ( !sync ) {
+      buf_size = 0;
+      break;
+    }
+    
+    buf_size -= sync - bptr;
+    bptr = sync;
+    
+    if ( !_decode_mp3_frame(bptr, &frame) ) {
       break;
     }
     
@@ -1032,13 +1883,9 @@ mp3_find_frame(PerlIO *infile, char *file, int offset)
 
 out:
   buffer_free(&mp3_buf);
-  SvREFCNT_dec(info);
   
-  buffer_free(mp3->buf);
-  Safefree(mp3->buf);
-  Safefree(mp3->first_frame);
-  Safefree(mp3->xing_frame);
-  Safefree(mp3);
+  if (info && frame_offset < 0)
+    res_hv_store( info, "seek_offset", res_newiv(-1) );
 
   return frame_offset;
 }
@@ -1052,9 +1899,9 @@ _mp3_skip(mp3info *mp3, uint32_t size)
     DEBUG_TRACE("  skipped buffer data size %d\n", size);
   }
   else {
-    PerlIO_seek(mp3->infile, size - buffer_len(mp3->buf), SEEK_CUR);
+    scanio_seek(mp3->infile, size - buffer_len(mp3->buf), SEEK_CUR);
     buffer_clear(mp3->buf);
     
-    DEBUG_TRACE("  seeked past %d bytes to %d\n", size, (int)PerlIO_tell(mp3->infile));
+    DEBUG_TRACE("  seeked past %d bytes to %d\n", size, (int)scanio_tell(mp3->infile));
   }
 }
@@ -17,86 +17,219 @@
 #include "mp4.h"
 
 static int
-get_mp4tags(PerlIO *infile, char *file, HV *info, HV *tags)
+get_mp4tags(ScanIO *infile, char *file, resval *info, resval *tags)
 {
   mp4info *mp4 = _mp4_parse(infile, file, info, tags, 0);
   
+  if (mp4->frags) Safefree(mp4->frags);
   Safefree(mp4);
 
   return 0;
 }
 
 // wrapper to return just the file offset
+off_t
+mp4_find_frame(ScanIO *infile, char *file, int offset)
+{
+  void *mp4 = mp4_seek_open(infile, file);
+  off_t frame_offset = mp4_seek(mp4, offset, NULL);
+  
+  mp4_seek_close(mp4);
+  
+  return frame_offset;
+}
+
 int
-mp4_find_frame(PerlIO *infile, char *file, int offset)
+mp4_find_frame_return_info(ScanIO *infile, char *file, int offset, resval *info)
 {
-  HV *info = newHV();
-  int frame_offset = -1;
+  void *mp4 = mp4_seek_open(infile, file);
+  int ret = mp4_seek(mp4, offset, info) < 0 ? -1 : 1;
   
-  mp4_find_frame_return_info(infile, file, offset, info);
+  mp4_seek_close(mp4);
   
-  if ( my_hv_exists(info, "seek_offset") ) {
-    frame_offset = SvIV( *(my_hv_fetch(info, "seek_offset") ) );
-  }
+  return ret;
+}
+
+// Parses the header once, keeping the sample tables of the first audio track
+void *
+mp4_seek_open(ScanIO *infile, char *file)
+{
+  // We need to read all info first to get some data we need to calculate
+  resval *info = res_newhv();
+  resval *tags = res_newhv();
   
-  SvREFCNT_dec(info);
+  return _mp4_parse(infile, file, info, tags, 1);
+}
+
+void
+mp4_seek_close(void *state)
+{
+  mp4info *mp4 = (mp4info *)state;
   
-  return frame_offset;
+  // free seek structs
+  if (mp4->time_to_sample) Safefree(mp4->time_to_sample);
+  if (mp4->sample_to_chunk) Safefree(mp4->sample_to_chunk);
+  if (mp4->sample_byte_size) Safefree(mp4->sample_byte_size);
+  if (mp4->chunk_offset) Safefree(mp4->chunk_offset);
+  if (mp4->frags) Safefree(mp4->frags);
+  
+  if (mp4->hdr_marks) Safefree(mp4->hdr_marks);
+  buffer_free(mp4->hdr);
+  Safefree(mp4->hdr);
+  
+  buffer_free(mp4->buf);
+  Safefree(mp4->buf);
+  
+  Safefree(mp4);
 }
 
-// offset is in ms
-// This is based on code from Rockbox
-int
-mp4_find_frame_return_info(PerlIO *infile, char *file, int offset, HV *info)
+// offset is in ms, returns the file offset of the frame and adds the seek
+// offset and rewritten header to info
+off_t
+mp4_seek(void *state, int offset, resval *info)
+{
+  _mp4_seek_info((mp4info *)state, info);
+  
+  return _mp4_seek((mp4info *)state, offset, -1, info, NULL);
+}
+
+// Same as mp4_seek, but the header is passed to w in pieces as it is
+// written, so it is never held whole
+off_t
+mp4_seek_write(void *state, int offset, resval *info, seekwriter *w)
+{
+  _mp4_seek_info((mp4info *)state, info);
+  
+  return _mp4_seek((mp4info *)state, offset, -1, info, w);
+}
+
+// The bytes to serve for the audio from start_ms to end_ms: one range from
+// the sample holding start_ms to the end of the one holding end_ms, and the
+// seek header to send before it, with the sample tables and mdat cut down
+// to that range.  Returns NULL if the range isn't in the file.
+resval *
+mp4_clip_ranges(void *state, int start_ms, int end_ms)
+{
+  mp4info *mp4 = (mp4info *)state;
+  resval *clip;
+  resval *ranges;
+  resval *range;
+  
+  // Fragments carry their own sample tables, so can't be cut short
+  if ( mp4->fragmented || start_ms < 0 || start_ms >= end_ms )
+    return NULL;
+  
+  clip = res_newhv();
+  
+  if ( _mp4_seek(mp4, start_ms, end_ms, clip, NULL) < 0 )
+    return NULL;
+  
+  ranges = res_newav();
+  range  = res_newav();
+  
+  res_av_push( range, res_newuv( res_iv( *( res_hv_fetch(clip, "seek_offset") ) ) ) );
+  res_av_push( range, res_newuv( res_iv( *( res_hv_fetch(clip, "seek_length") ) ) ) );
+  res_av_push( ranges, range );
+  
+  res_hv_store( clip, "ranges", ranges );
+  
+  return clip;
+}
+
+// Copies the file's info into info, to be returned along with the seek info
+static void
+_mp4_seek_info(mp4info *mp4, resval *info)
+{
+  resent *e;
+  
+  if (!info)
+    return;
+  
+  for (e = mp4->info->u.list.head; e; e = e->next) {
+    res_hv_store( info, e->key, e->val );
+  }
+}
+
+// This is based on code from Rockbox.  end is in ms too, the header and
+// seek_length then cover only the samples up to the one holding it, -1 for
+// the rest of the file
+static off_t
+_mp4_seek(mp4info *mp4, int offset, int end, resval *info, seekwriter *w)
 {
   int ret = 1;
-  uint16_t samplerate = 0;
-  uint32_t sound_sample_loc;
+  uint32_t samplerate = 0;
+  uint64_t sound_sample_loc;
   uint32_t i = 0;
   uint32_t j = 0;
   uint32_t new_sample = 0;
-  uint32_t new_sound_sample = 0;
   
   uint32_t chunk = 1;
-  uint32_t range_samples = 0;
   uint32_t total_samples = 0;
   uint32_t skipped_samples = 0;
   uint32_t chunk_sample;
   uint32_t prev_chunk;
   uint32_t prev_chunk_samples;
-  uint32_t file_offset;
-  uint32_t chunk_offset;
-  
-  uint32_t box_size = 0;
-  Buffer tmp_buf;
-  char tmp_size[4];
+  uint32_t stts_entries = 0;
+  uint32_t stsc_entries = 0;
+  uint32_t stco_entries;
+  uint32_t end_sample;
+  uint32_t end_chunk;
+  uint32_t end_chunk_sample = 0;
+  uint8_t co64;
+  uint64_t file_offset;
+  uint64_t end_offset = 0;
+  uint64_t audio_offset;
+  uint64_t chunk_offset;
+  uint64_t last_offset;
+  uint64_t hdr_length;
+  uint32_t dropped_size = 0;
+  uint32_t dropped_kept = 0;
+  uint32_t edts_size = 0;
+  uint64_t clip_duration = 0;
+  uint64_t movie_duration = 0;
+  
+  struct tts *stts = NULL;
+  struct stc *stsc = NULL;
+  mp4out out;
+  
+  // Only the first audio track is seeked, the others are left out of the
+  // seek header
+  if ( !mp4->seek_track ) {
+    LOG_ERROR("find_frame: No audio track: %s\n", mp4->file);
+    ret = -1;
+    goto out;
+  }
   
-  // We need to read all info first to get some data we need to calculate
-  HV *tags = newHV();
-  mp4info *mp4 = _mp4_parse(infile, file, info, tags, 1);
+  if ( !mp4->track_timescale ) {
+    LOG_ERROR("find_frame: unknown sample rate\n");
+    ret = -1;
+    goto out;
+  }
   
-  // Init seek buffer
-  //  Newz(0, &tmp_buf, sizeof(Buffer), Buffer);
-  buffer_init(&tmp_buf, MP4_BLOCK_SIZE);
+  // The samples are timed in the timescale of the track
+  samplerate = mp4->track_timescale;
   
-  // Seeking not yet supported for files with multiple tracks
-  if (mp4->track_count > 1) {
-    ret = -1;
+  // Fragmented files carry their sample tables in each fragment, so the
+  // seek is to the start of a fragment with the header left as it is
+  if (mp4->fragmented) {
+    if ( !_mp4_seek_fragment(mp4, offset, info, w, &file_offset) )
+      ret = -1;
+    
     goto out;
   }
   
-  if ( !my_hv_exists(info, "samplerate") ) {
-    PerlIO_printf(PerlIO_stderr(), "find_frame: unknown sample rate\n");
+  if ( !mp4->tables_loaded )
+    mp4->tables_loaded = _mp4_load_tables(mp4) ? 1 : -1;
+  
+  if ( mp4->tables_loaded < 0 ) {
     ret = -1;
     goto out;
   }
   
-  // Pull out the samplerate
-  samplerate = SvIV( *( my_hv_fetch( info, "samplerate" ) ) );
-  
-  // convert offset to sound_sample_loc
-  sound_sample_loc = (offset / 10) * (samplerate / 100);
-  DEBUG_TRACE("Looking for target sample %u\n", sound_sample_loc);
+  // convert offset to sound_sample_loc, in 64 bits so long files at high
+  // sample rates don't wrap
+  sound_sample_loc = (uint64_t)offset * samplerate / 1000;
+  DEBUG_TRACE("Looking for target sample %llu\n", sound_sample_loc);
   
   // Make sure we have the necessary metadata
   if ( 
@@ -105,113 +238,48 @@ mp4_find_frame_return_info(PerlIO *infile, char *file, int offset, HV *info)
     || !mp4->num_sample_to_chunks
     || !mp4->num_chunk_offsets
   ) {
-    PerlIO_printf(PerlIO_stderr(), "find_frame: File does not contain seek metadata: %s\n", file);
-    ret = -1;
-    goto out;
-  }
-  
-  // Find the destination block from time_to_sample array
-  while ( (i < mp4->num_time_to_samples) &&
-      (new_sound_sample < sound_sample_loc)
-  ) {
-      j = (sound_sample_loc - new_sound_sample) / mp4->time_to_sample[i].sample_duration;
-      
-      DEBUG_TRACE(
-        "i = %d / j = %d, sample_count[i]: %d, sample_duration[i]: %d\n",
-        i, j,
-        mp4->time_to_sample[i].sample_count,
-        mp4->time_to_sample[i].sample_duration
-      );
-  
-      if (j <= mp4->time_to_sample[i].sample_count) {
-        new_sample += j;
-        new_sound_sample += j * mp4->time_to_sample[i].sample_duration;
-        break;
-      } 
-      else {
-        // XXX need test for this bit of code (variable stts)
-        new_sound_sample += (mp4->time_to_sample[i].sample_duration
-            * mp4->time_to_sample[i].sample_count);
-        new_sample += mp4->time_to_sample[i].sample_count;
-        i++;
-      }
-  }
-  
-  if ( new_sample >= mp4->num_sample_byte_sizes ) {
-    PerlIO_printf(PerlIO_stderr(), "find_frame: Offset out of range (%d >= %d)\n", new_sample, mp4->num_sample_byte_sizes);
+    LOG_ERROR("find_frame: File does not contain seek metadata: %s\n", mp4->file);
     ret = -1;
     goto out;
   }
   
-  DEBUG_TRACE("new_sample: %d, new_sound_sample: %d\n", new_sample, new_sound_sample);
-  
-  // Write new stts box
+  // Find the destination sample, in the last stts entry starting at or
+  // before the target
   {
-    int i;
-    uint32_t total_sample_count = _mp4_total_samples(mp4);
-    uint32_t stts_entries = total_sample_count - new_sample;
-    uint32_t cur_duration = 0;
-    struct tts *stts;
-    int32_t stts_index = -1;
-    
-    Newz(0, stts, stts_entries * sizeof(*stts), struct tts);
-    
-    for (i = new_sample; i < total_sample_count; i++) {
-      uint32_t duration = _mp4_get_sample_duration(mp4, i);
-      
-      if (cur_duration && cur_duration == duration) {
-        // same as previous entry, combine together
-        stts_entries--;
-        stts[stts_index].sample_count++;
-      }
-      else {
-        stts_index++;
-        stts[stts_index].sample_count = 1;
-        stts[stts_index].sample_duration = duration;
-        cur_duration = duration;
-      }
-    }
+    uint32_t k = _mp4_find_tts_time(mp4, sound_sample_loc);
+    struct tts *entry = &mp4->time_to_sample[k];
+    uint64_t n = entry->sample_duration ? (sound_sample_loc - entry->first_time) / entry->sample_duration : 0;
     
-    DEBUG_TRACE("Writing new stts (entries: %d)\n", stts_entries);
-    buffer_put_int(&tmp_buf, stts_entries);
+    j = n > entry->sample_count ? entry->sample_count : (uint32_t)n;
     
-    for (i = 0; i < stts_entries; i++) {
-      DEBUG_TRACE("  sample_count %d, sample_duration %d\n", stts[i].sample_count, stts[i].sample_duration);
-      buffer_put_int(&tmp_buf, stts[i].sample_count);
-      buffer_put_int(&tmp_buf, stts[i].sample_duration);
-    }
+    DEBUG_TRACE(
+      "stts entry %d / j = %d, sample_count: %d, sample_duration: %d\n",
+      k, j, entry->sample_count, entry->sample_duration
+    );
     
-    mp4->new_stts = newSVpv("", 0);
-    put_u32( tmp_size, buffer_len(&tmp_buf) + 12 );
-    sv_catpvn( mp4->new_stts, tmp_size, 4 );
-    sv_catpvn( mp4->new_stts, "stts", 4 );
-    sv_catpvn( mp4->new_stts, "\0\0\0\0", 4 );
-    sv_catpvn( mp4->new_stts, (char *)buffer_ptr(&tmp_buf), buffer_len(&tmp_buf) );
-    //buffer_dump(&tmp_buf, 0);
-    buffer_clear(&tmp_buf);
+    new_sample = entry->first_sample + j;
     
-    Safefree(stts);
+    DEBUG_TRACE(
+      "new_sample: %d, new_sound_sample: %llu\n",
+      new_sample, entry->first_time + (uint64_t)j * entry->sample_duration
+    );
+  }
+  
+  if ( new_sample >= mp4->num_sample_byte_sizes ) {
+    LOG_ERROR("find_frame: Offset out of range (%d >= %d)\n", new_sample, mp4->num_sample_byte_sizes);
+    ret = -1;
+    goto out;
   }
   
   // We know the new block, now calculate the file position
   
   /* Locate the chunk containing the sample */
-  prev_chunk         = mp4->sample_to_chunk[0].first_chunk;
-  prev_chunk_samples = mp4->sample_to_chunk[0].samples_per_chunk;
-  
-  for (i = 1; i < mp4->num_sample_to_chunks; i++) {
-    chunk = mp4->sample_to_chunk[i].first_chunk;
-    range_samples = (chunk - prev_chunk) * prev_chunk_samples;
+  {
+    struct stc *entry = &mp4->sample_to_chunk[ _mp4_find_stc(mp4, new_sample) ];
     
-    DEBUG_TRACE("prev_chunk: %d, prev_chunk_samples: %d, chunk: %d, range_samples: %d\n",
-      prev_chunk, prev_chunk_samples, chunk, range_samples);
-
-    if (new_sample < total_samples + range_samples)
-      break;
-
-    total_samples += range_samples;
-    prev_chunk = mp4->sample_to_chunk[i].first_chunk;
-    prev_chunk_samples = mp4->sample_to_chunk[i].samples_per_chunk;
+    prev_chunk         = entry->first_chunk;
+    prev_chunk_samples = entry->samples_per_chunk;
+    total_samples      = entry->first_sample;
   }
   
   DEBUG_TRACE("prev_chunk: %d, prev_chunk_samples: %d, total_samples: %d\n", prev_chunk, prev_chunk_samples, total_samples);
@@ -239,233 +307,496 @@ mp4_find_frame_return_info(PerlIO *infile, char *file, int offset, HV *info)
     file_offset = mp4->chunk_offset[chunk - 1];
   }
   
-  DEBUG_TRACE("file_offset: %d\n", file_offset);
+  DEBUG_TRACE("file_offset: %llu\n", file_offset);
 
   if (chunk_sample > new_sample) {
-    PerlIO_printf(PerlIO_stderr(), "find_frame: sample out of range (%d > %d)\n", chunk_sample, new_sample);
+    LOG_ERROR("find_frame: sample out of range (%d > %d)\n", chunk_sample, new_sample);
     ret = -1;
     goto out;
   }
   
   // Move offset within the chunk to the correct sample range
   for (i = chunk_sample; i < new_sample; i++) { 
-    file_offset += mp4->sample_byte_size[i];
+    file_offset += _mp4_get_sample_size(mp4, i);
     skipped_samples++;
-    DEBUG_TRACE("  file_offset + %d: %d\n", mp4->sample_byte_size[i], file_offset);
+    DEBUG_TRACE("  file_offset + %d: %llu\n", _mp4_get_sample_size(mp4, i), file_offset);
   }
 
   if (file_offset > mp4->audio_offset + mp4->audio_size) {
-    PerlIO_printf(PerlIO_stderr(), "find_frame: file offset out of range (%d > %lld)\n", file_offset, mp4->audio_offset + mp4->audio_size);
+    LOG_ERROR("find_frame: file offset out of range (%llu > %llu)\n", file_offset, mp4->audio_offset + mp4->audio_size);
     ret = -1;
     goto out;
   }
   
-  // Write new stsc box
+  if (!info) {
+    goto out;
+  }
+  
+  audio_offset = res_iv( *( res_hv_fetch(mp4->info, "audio_offset") ) );
+  end_sample   = mp4->num_sample_byte_sizes;
+  end_chunk    = mp4->num_chunk_offsets;
+  
+  // The end of a clip: the sample holding the end time is the last one, and
+  // the data ends with it, part way into its chunk
+  if (end >= 0) {
+    uint64_t end_loc = (uint64_t)end * samplerate / 1000;
+    struct tts *tts_entry = &mp4->time_to_sample[ _mp4_find_tts_time(mp4, end_loc) ];
+    struct stc *stc_entry;
+    uint64_t n = tts_entry->sample_count;
+    
+    if (tts_entry->sample_duration) {
+      n = (end_loc - tts_entry->first_time + tts_entry->sample_duration - 1) / tts_entry->sample_duration;
+      if (n > tts_entry->sample_count)
+        n = tts_entry->sample_count;
+    }
+    
+    if (tts_entry->first_sample + n < end_sample)
+      end_sample = tts_entry->first_sample + n;
+    
+    if (end_sample <= new_sample)
+      end_sample = new_sample + 1;
+    
+    stc_entry = &mp4->sample_to_chunk[ _mp4_find_stc(mp4, end_sample - 1) ];
+    
+    if (stc_entry->samples_per_chunk) {
+      end_chunk = stc_entry->first_chunk + (end_sample - 1 - stc_entry->first_sample) / stc_entry->samples_per_chunk;
+      if (end_chunk > mp4->num_chunk_offsets)
+        end_chunk = mp4->num_chunk_offsets;
+    }
+    
+    end_chunk_sample = stc_entry->first_sample + (end_chunk - stc_entry->first_chunk) * stc_entry->samples_per_chunk;
+    
+    if ( end_chunk < chunk || end_chunk_sample >= end_sample ) {
+      LOG_ERROR("find_frame: end sample out of range (%d)\n", end_sample);
+      ret = -1;
+      goto out;
+    }
+    
+    end_offset = mp4->chunk_offset[end_chunk - 1];
+    for (i = end_chunk_sample; i < end_sample; i++) {
+      end_offset += _mp4_get_sample_size(mp4, i);
+    }
+    
+    DEBUG_TRACE("end_sample: %d, end_chunk: %d, end_offset: %llu\n", end_sample, end_chunk, end_offset);
+    
+    if (end_offset > mp4->audio_offset + mp4->audio_size) {
+      LOG_ERROR("find_frame: end offset out of range (%llu > %llu)\n", end_offset, mp4->audio_offset + mp4->audio_size);
+      ret = -1;
+      goto out;
+    }
+  }
+  
+  // New stts entries, from the new sample to the end sample
   {
-    int i;
-    uint32_t stsc_entries = mp4->num_chunk_offsets - chunk + 1;
-    uint32_t cur_samples_per_chunk = 0;
-    struct stc *stsc;
-    int32_t stsc_index = -1;
-    uint32_t chunk_delta = 1;
-    j = 1;
-    
-    Newz(0, stsc, stsc_entries * sizeof(*stsc), struct stc);
-    
-    for (i = chunk; i <= mp4->num_chunk_offsets; i++) {
-      // Find the number of samples in chunk i
-      uint32_t samples_in_chunk = _mp4_samples_in_chunk(mp4, i);
+    uint32_t k = _mp4_find_tts(mp4, new_sample);
+    uint32_t m = _mp4_find_tts(mp4, end_sample - 1);
+    
+    // At most one for each entry up to the one holding the end sample
+    Newz(0, stts, m >= k ? m - k + 1 : 1, struct tts);
+    
+    for (i = k; i <= m && mp4->time_to_sample[i].first_sample < end_sample; i++) {
+      struct tts *entry = &mp4->time_to_sample[i];
+      uint32_t count = entry->sample_count;
       
-      if (cur_samples_per_chunk && cur_samples_per_chunk == samples_in_chunk) {
+      // The last entry loses the samples after the end one
+      if (entry->first_sample + count > end_sample)
+        count = end_sample - entry->first_sample;
+      
+      // The first entry loses the samples before the new one
+      if (i == k)
+        count -= new_sample - entry->first_sample;
+      
+      if (!count)
+        continue;
+      
+      clip_duration += (uint64_t)count * entry->sample_duration;
+      
+      if (stts_entries && stts[stts_entries - 1].sample_duration == entry->sample_duration) {
         // same as previous entry, combine together
-        stsc_entries--;
+        stts[stts_entries - 1].sample_count += count;
       }
       else {
-        stsc_index++;
-        
-        stsc[stsc_index].first_chunk = chunk_delta;
-        
-        if (j == 1) {
-          // The first chunk may have less samples in it due to seeking within a chunk
-          stsc[stsc_index].samples_per_chunk = samples_in_chunk - skipped_samples;
-          cur_samples_per_chunk = samples_in_chunk - skipped_samples;
-          j++;
-        }
-        else {
-          stsc[stsc_index].samples_per_chunk = samples_in_chunk;
-          cur_samples_per_chunk = samples_in_chunk;
-        }
+        stts[stts_entries].sample_count = count;
+        stts[stts_entries].sample_duration = entry->sample_duration;
+        stts_entries++;
       }
+    }
+  }
+  
+  // New stsc entries, from the chunk of the new sample to the end chunk,
+  // so a clip only walks the entries it covers
+  {
+    uint32_t k = _mp4_find_stc_chunk(mp4, chunk);
+    uint32_t m = _mp4_find_stc_chunk(mp4, end_chunk);
+    
+    Newz(0, stsc, (m >= k ? m - k : 0) + 3, struct stc);
+    
+    for (i = k; i <= m; i++) {
+      struct stc *entry = &mp4->sample_to_chunk[i];
+      uint32_t first = i == k ? chunk : entry->first_chunk;
+      uint32_t last  = i + 1 < mp4->num_sample_to_chunks
+        ? mp4->sample_to_chunk[i + 1].first_chunk - 1
+        : mp4->num_chunk_offsets;
       
-      chunk_delta++;
-    }
-    
-    DEBUG_TRACE("Writing new stsc (entries: %d)\n", stsc_entries);
-    buffer_put_int(&tmp_buf, stsc_entries);
-    
-    for (i = 0; i < stsc_entries; i++) {
-      DEBUG_TRACE("  first_chunk %d, samples_per_chunk %d\n", stsc[i].first_chunk, stsc[i].samples_per_chunk);
-      buffer_put_int(&tmp_buf, stsc[i].first_chunk);
-      buffer_put_int(&tmp_buf, stsc[i].samples_per_chunk);
-      buffer_put_int(&tmp_buf, 1); // XXX sample description index, is this OK?
-    }
-    
-    mp4->new_stsc = newSVpv("", 0);
-    put_u32( tmp_size, buffer_len(&tmp_buf) + 12 );
-    sv_catpvn( mp4->new_stsc, tmp_size, 4 );
-    sv_catpvn( mp4->new_stsc, "stsc", 4 );
-    sv_catpvn( mp4->new_stsc, "\0\0\0\0", 4 );
-    sv_catpvn( mp4->new_stsc, (char *)buffer_ptr(&tmp_buf), buffer_len(&tmp_buf) );
-    DEBUG_TRACE("Created new stsc\n");
-    //buffer_dump(&tmp_buf, 0);
-    buffer_clear(&tmp_buf);
-    
-    Safefree(stsc);
-  }
-  
-  // Write new stsz box, num_sample_byte_sizes -= $new_sample, skip $new_sample items
-  buffer_put_int(&tmp_buf, 0);
-  buffer_put_int(&tmp_buf, mp4->num_sample_byte_sizes - new_sample);
-  DEBUG_TRACE("Writing new stsz: %d items\n", mp4->num_sample_byte_sizes - new_sample);
-  j = 1;
-  for (i = new_sample; i < mp4->num_sample_byte_sizes; i++) {
-    DEBUG_TRACE("  sample %d sample_byte_size %d\n", j++, mp4->sample_byte_size[i]);
-    buffer_put_int(&tmp_buf, mp4->sample_byte_size[i]);
-  }
-  
-  mp4->new_stsz = newSVpv("", 0);
-  put_u32( tmp_size, buffer_len(&tmp_buf) + 12 );
-  sv_catpvn( mp4->new_stsz, tmp_size, 4 );
-  sv_catpvn( mp4->new_stsz, "stsz", 4 );
-  sv_catpvn( mp4->new_stsz, "\0\0\0\0", 4 );
-  sv_catpvn( mp4->new_stsz, (char *)buffer_ptr(&tmp_buf), buffer_len(&tmp_buf) );
-  DEBUG_TRACE("Created new stsz\n");
-  //buffer_dump(&tmp_buf, 0);
-  buffer_clear(&tmp_buf);
-  
-  // Total up size of 4 new st* boxes
-  // stco is calculated directly since we can't write it without offsets
+      if (last > end_chunk)
+        last = end_chunk;
+      
+      if (first > last)
+        continue;
+      
+      if (first == chunk) {
+        // The first chunk may have less samples in it due to seeking within
+        // a chunk, and a clip may end in it too
+        _mp4_add_stc(
+          stsc, &stsc_entries, 1,
+          end >= 0 && chunk == end_chunk
+            ? end_sample - new_sample
+            : entry->samples_per_chunk - skipped_samples
+        );
+        first++;
+      }
+      
+      // The end chunk of a clip may have less samples in it too
+      if (end >= 0 && first <= last && last == end_chunk) {
+        if (first < last)
+          _mp4_add_stc(stsc, &stsc_entries, first - chunk + 1, entry->samples_per_chunk);
+        
+        _mp4_add_stc(stsc, &stsc_entries, last - chunk + 1, end_sample - end_chunk_sample);
+      }
+      else if (first <= last) {
+        _mp4_add_stc(stsc, &stsc_entries, first - chunk + 1, entry->samples_per_chunk);
+      }
+    }
+  }
+  
+  // The tracks left out of the seek header, and what was kept of them
+  // without their st* boxes.  A clip also leaves out the edit list of the
+  // seeked track, its times are for the whole file
+  for (i = 0; i < mp4->num_hdr_marks; i++) {
+    mp4hdrmark *mark = &mp4->hdr_marks[i];
+    
+    if ( mark->track == mp4->seek_track && end >= 0 && FOURCC_EQ(mark->type, "edts") )
+      edts_size += mark->size;
+    
+    if ( mark->track == mp4->seek_track || !mark->track )
+      continue;
+    
+    if ( FOURCC_EQ(mark->type, "trak") ) {
+      dropped_size += mark->size;
+      dropped_kept += mark->size;
+    }
+    else if ( MP4_ST_BOX(mark->type) ) {
+      dropped_kept -= mark->size;
+    }
+  }
+  
+  // The length of a clip, in the movie timescale for mvhd and tkhd
+  if (end >= 0) {
+    resval **timescale = res_hv_fetch(mp4->info, "mv_timescale");
+    
+    movie_duration = timescale
+      ? clip_duration * res_iv(*timescale) / samplerate
+      : clip_duration;
+    
+    DEBUG_TRACE("clip_duration: %llu, movie_duration: %llu\n", clip_duration, movie_duration);
+  }
+  
+  // Total up size of 4 new st* boxes, which with the kept header gives the
+  // size of the whole seek header before any of it is written.
+  // The stco is a co64 if the last offset doesn't fit in 32 bits, worked
+  // out with the larger co64 so the offsets can only come out smaller
+  stco_entries = end_chunk - chunk + 1;
+  last_offset = 0;
+  for (i = chunk - 1; i < end_chunk; i++) {
+    if (mp4->chunk_offset[i] > last_offset)
+      last_offset = mp4->chunk_offset[i];
+  }
+  
   mp4->new_st_size
-    = sv_len(mp4->new_stts)
-    + sv_len(mp4->new_stsc)
-    + sv_len(mp4->new_stsz)
-    + 12 + ( 4 * (mp4->num_chunk_offsets - chunk + 2) ); // stco size
+    = 16 + 8 * stts_entries
+    + 16 + 12 * stsc_entries
+    + 20 + (mp4->sample_size_width ? 4 * (end_sample - new_sample) : 0)
+    + 16;
   
-  DEBUG_TRACE("new_st_size: %d, old_st_size: %d\n", mp4->new_st_size, mp4->old_st_size);
+  chunk_offset = audio_offset + mp4->audio_hsize; // mdat size + fourcc
   
-  // Calculate offset for each chunk
-  chunk_offset = SvIV( *( my_hv_fetch(info, "audio_offset") ) );
-  chunk_offset -= ( mp4->old_st_size - mp4->new_st_size );
-  chunk_offset += 8; // mdat size + fourcc
+  co64 = (int64_t)(chunk_offset + mp4->new_st_size + 8 * stco_entries) - mp4->old_st_size - dropped_size - edts_size
+    + ((int64_t)last_offset - (int64_t)file_offset) > 0xFFFFFFFF;
   
-  DEBUG_TRACE("chunk_offset: %d\n", chunk_offset);
+  mp4->new_st_size += (co64 ? 8 : 4) * stco_entries;
   
-  // Write new stco box, num_chunk_offsets -= $chunk, skip $chunk items
-  buffer_put_int(&tmp_buf, mp4->num_chunk_offsets - chunk + 1);
-  DEBUG_TRACE("Writing new stco: %d items\n", mp4->num_chunk_offsets - chunk + 1);
-  for (i = chunk - 1; i < mp4->num_chunk_offsets; i++) {
-    if (i == chunk - 1) {
-      // The first chunk offset is the start of mdat (chunk_offset)
-      buffer_put_int( &tmp_buf, chunk_offset );
-      DEBUG_TRACE( "  offset %d (orig %d)\n", chunk_offset, mp4->chunk_offset[i] );
-    }
-    else {
-      buffer_put_int( &tmp_buf, mp4->chunk_offset[i] - file_offset + chunk_offset );
-      DEBUG_TRACE( "  offset %d (orig %d)\n", mp4->chunk_offset[i] - file_offset + chunk_offset, mp4->chunk_offset[i] );
-    }
-  }
-  
-  mp4->new_stco = newSVpv("", 0);
-  put_u32( tmp_size, buffer_len(&tmp_buf) + 12 );
-  sv_catpvn( mp4->new_stco, tmp_size, 4 );
-  sv_catpvn( mp4->new_stco, "stco", 4 );
-  sv_catpvn( mp4->new_stco, "\0\0\0\0", 4 );
-  sv_catpvn( mp4->new_stco, (char *)buffer_ptr(&tmp_buf), buffer_len(&tmp_buf) );
-  DEBUG_TRACE("Created new stco\n");
-  //buffer_dump(&tmp_buf, 0);
-  buffer_clear(&tmp_buf);
-  
-  DEBUG_TRACE("real st size: %ld\n",
-      sv_len(mp4->new_stts)
-    + sv_len(mp4->new_stsc)
-    + sv_len(mp4->new_stsz) 
-    + sv_len(mp4->new_stco)
-  );
-    
-  // Make second pass through header, reducing size of all parent boxes by st* size difference
-  // Copy all boxes, replacing st* boxes with new ones
-  mp4->seekhdr = newSVpv("", 0);
+  DEBUG_TRACE("new_st_size: %d, old_st_size: %d\n", mp4->new_st_size, mp4->old_st_size);
   
-  PerlIO_seek(mp4->infile, 0, SEEK_SET);
+  // Calculate offset for each chunk, from the start of mdat
+  chunk_offset = chunk_offset + mp4->new_st_size - mp4->old_st_size - dropped_size - edts_size;
   
-  // XXX this is ugly, because we are reading a second time we have to reset
-  // various things in the mp4 struct
-  Newz(0, mp4->buf, sizeof(Buffer), Buffer);
-  buffer_init(mp4->buf, MP4_BLOCK_SIZE);
+  DEBUG_TRACE("chunk_offset: %llu\n", chunk_offset);
   
-  mp4->audio_offset  = 0;
-  mp4->current_track = 0;
-  mp4->track_count   = 0;
+  hdr_length = buffer_len(mp4->hdr) - dropped_kept - edts_size + mp4->new_st_size;
   
-  // free seek structs because we will be reading them a second time
-  if (mp4->time_to_sample) Safefree(mp4->time_to_sample);
-  if (mp4->sample_to_chunk) Safefree(mp4->sample_to_chunk);
-  if (mp4->sample_byte_size) Safefree(mp4->sample_byte_size);
-  if (mp4->chunk_offset) Safefree(mp4->chunk_offset);
+  res_hv_store( info, "seek_offset", res_newuv(file_offset) );
   
-  mp4->time_to_sample   = NULL;
-  mp4->sample_to_chunk  = NULL;
-  mp4->sample_byte_size = NULL;
-  mp4->chunk_offset     = NULL;
+  if (end >= 0)
+    res_hv_store( info, "seek_length", res_newuv(end_offset - file_offset) );
   
-  while ( (box_size = _mp4_read_box(mp4)) > 0 ) {
-    mp4->audio_offset += box_size;
-    DEBUG_TRACE("seek pass 2: read box of size %d\n", box_size);
+  buffer_init(&out.buf, MP4_WRITE_SIZE);
+  out.w     = w;
+  out.error = 0;
+  
+  if (w) {
+    w->length = hdr_length;
+    out.hdr = NULL;
+    res_hv_store( info, "seek_header_length", res_newuv(hdr_length) );
+  }
+  else {
+    // Sized for the whole header up front
+    out.hdr = res_newpvn(NULL, hdr_length);
+    res_cur_set(out.hdr, 0);
+    res_hv_store( info, "seek_header", out.hdr );
+  }
+  
+  // Write the header kept while parsing, reducing the size of all parent
+  // boxes by the st* size difference and replacing the st* boxes with the
+  // new ones.  The other tracks are left out, their samples would be at
+  // the wrong offsets, and moov is reduced by their size as well.
+  {
+    char *hdr = (char *)buffer_ptr(mp4->hdr);
+    uint32_t pos = 0;
     
-    if (mp4->audio_offset >= mp4->file_size)
-      break;
+    for (i = 0; i < mp4->num_hdr_marks && !out.error; i++) {
+      mp4hdrmark *mark = &mp4->hdr_marks[i];
+      
+      // Boxes in a track left out, skipped with their trak
+      if ( mark->track && mark->track != mp4->seek_track && !FOURCC_EQ(mark->type, "trak") )
+        continue;
+      
+      _mp4_out( &out, hdr + pos, mark->offset - pos );
+      pos = mark->offset;
+      
+      if ( FOURCC_EQ(mark->type, "trak") && mark->track != mp4->seek_track ) {
+        // Its kept copy is the trak without its st* boxes
+        uint32_t kept = mark->size;
+        
+        for (j = i + 1; j < mp4->num_hdr_marks && mp4->hdr_marks[j].track == mark->track; j++) {
+          if ( MP4_ST_BOX(mp4->hdr_marks[j].type) ) {
+            kept -= mp4->hdr_marks[j].size;
+          }
+        }
+        
+        DEBUG_TRACE("Leaving out track %d (%d bytes)\n", mark->track, mark->size);
+        pos += kept;
+      }
+      else if ( FOURCC_EQ(mark->type, "stts") ) {
+        DEBUG_TRACE("Writing new stts (entries: %d)\n", stts_entries);
+        _mp4_out_box( &out, 16 + 8 * stts_entries, "stts" );
+        _mp4_out_int( &out, stts_entries );
+        
+        for (j = 0; j < stts_entries; j++) {
+          DEBUG_TRACE("  sample_count %d, sample_duration %d\n", stts[j].sample_count, stts[j].sample_duration);
+          _mp4_out_int( &out, stts[j].sample_count );
+          _mp4_out_int( &out, stts[j].sample_duration );
+        }
+      }
+      else if ( FOURCC_EQ(mark->type, "stsc") ) {
+        DEBUG_TRACE("Writing new stsc (entries: %d)\n", stsc_entries);
+        _mp4_out_box( &out, 16 + 12 * stsc_entries, "stsc" );
+        _mp4_out_int( &out, stsc_entries );
+        
+        for (j = 0; j < stsc_entries; j++) {
+          DEBUG_TRACE("  first_chunk %d, samples_per_chunk %d\n", stsc[j].first_chunk, stsc[j].samples_per_chunk);
+          _mp4_out_int( &out, stsc[j].first_chunk );
+          _mp4_out_int( &out, stsc[j].samples_per_chunk );
+          _mp4_out_int( &out, 1 ); // XXX sample description index, is this OK?
+        }
+      }
+      else if ( FOURCC_EQ(mark->type, "stsz") ) {
+        // The samples from $new_sample to $end_sample
+        DEBUG_TRACE("Writing new stsz: %d items\n", end_sample - new_sample);
+        _mp4_out_box( &out, 20 + (mp4->sample_size_width ? 4 * (end_sample - new_sample) : 0), "stsz" );
+        _mp4_out_int( &out, mp4->sample_size_width ? 0 : mp4->sample_size );
+        _mp4_out_int( &out, end_sample - new_sample );
+        
+        if (mp4->sample_size_width) {
+          for (j = new_sample; j < end_sample && !out.error; j++) {
+            _mp4_out_int( &out, _mp4_get_sample_size(mp4, j) );
+          }
+        }
+      }
+      else if ( FOURCC_EQ(mark->type, "stco") || FOURCC_EQ(mark->type, "co64") ) {
+        // num_chunk_offsets -= $chunk, skip $chunk items
+        DEBUG_TRACE("Writing new %s: %d items\n", co64 ? "co64" : "stco", stco_entries);
+        _mp4_out_box( &out, 16 + (co64 ? 8 : 4) * stco_entries, co64 ? "co64" : "stco" );
+        _mp4_out_int( &out, stco_entries );
+        
+        for (j = chunk - 1; j < end_chunk; j++) {
+          // The first chunk offset is the start of mdat (chunk_offset)
+          uint64_t offset = j == chunk - 1
+            ? chunk_offset
+            : mp4->chunk_offset[j] - file_offset + chunk_offset;
+          
+          if (co64)
+            _mp4_out_int64( &out, offset );
+          else
+            _mp4_out_int( &out, offset );
+        }
+      }
+      else if ( FOURCC_EQ(mark->type, "moov") ) {
+        _mp4_out_int( &out, mark->size - (mp4->old_st_size - mp4->new_st_size) - dropped_size - edts_size );
+        pos += 4;
+      }
+      else if ( FOURCC_EQ(mark->type, "trak") ) {
+        _mp4_out_int( &out, mark->size - (mp4->old_st_size - mp4->new_st_size) - edts_size );
+        pos += 4;
+      }
+      else if ( FOURCC_EQ(mark->type, "edts") ) {
+        // Left out of a clip, kept whole otherwise
+        if (end >= 0)
+          pos += mark->size;
+      }
+      else if ( FOURCC_EQ(mark->type, "mvhd") || FOURCC_EQ(mark->type, "tkhd") || FOURCC_EQ(mark->type, "mdhd") ) {
+        // A clip's duration, after the header, version/flags, times and the
+        // timescale or track id and reserved, 64 bits for version 1
+        if (end >= 0) {
+          uint8_t version = hdr[pos + 8];
+          uint32_t skip = (version == 1 ? 16 : 8) + 4;
+          uint64_t duration = FOURCC_EQ(mark->type, "mdhd") ? clip_duration : movie_duration;
+          
+          if ( FOURCC_EQ(mark->type, "tkhd") )
+            skip += 4;
+          
+          _mp4_out( &out, hdr + pos, 12 + skip );
+          pos += 12 + skip;
+          
+          if (version == 1) {
+            _mp4_out_int64( &out, duration );
+            pos += 8;
+          }
+          else {
+            _mp4_out_int( &out, duration > 0xFFFFFFFF ? 0xFFFFFFFF : duration );
+            pos += 4;
+          }
+        }
+      }
+      else if ( FOURCC_EQ(mark->type, "mdat") ) {
+        // A clip's mdat holds only its range, otherwise it is left as it is
+        if (end >= 0) {
+          if (mp4->audio_hsize == 16) {
+            _mp4_out_int( &out, 1 );
+            _mp4_out( &out, "mdat", 4 );
+            _mp4_out_int64( &out, 16 + end_offset - file_offset );
+          }
+          else {
+            _mp4_out_int( &out, 8 + end_offset - file_offset );
+            _mp4_out( &out, "mdat", 4 );
+          }
+          
+          pos += mp4->audio_hsize;
+        }
+      }
+      else {
+        // Container box, adjust size
+        _mp4_out_int( &out, mark->size - (mp4->old_st_size - mp4->new_st_size) );
+        pos += 4;
+      }
+    }
+    
+    _mp4_out( &out, hdr + pos, buffer_len(mp4->hdr) - pos );
+    _mp4_out_flush(&out);
   }
   
-  my_hv_store( info, "seek_offset", newSVuv(file_offset) );
-  my_hv_store( info, "seek_header", mp4->seekhdr );
+  buffer_free(&out.buf);
   
-  if (mp4->buf) {
-    buffer_free(mp4->buf);
-    Safefree(mp4->buf);
+  if (out.error) {
+    LOG_ERROR("find_frame: Unable to write seek header: %s\n", mp4->file);
+    ret = -1;
   }
 
 out:
-  // Don't leak
-  SvREFCNT_dec(tags);
   
-  if (mp4->new_stts) SvREFCNT_dec(mp4->new_stts);
-  if (mp4->new_stsc) SvREFCNT_dec(mp4->new_stsc);
-  if (mp4->new_stsz) SvREFCNT_dec(mp4->new_stsz);
-  if (mp4->new_stco) SvREFCNT_dec(mp4->new_stco);
+  if (stts) Safefree(stts);
+  if (stsc) Safefree(stsc);
   
-  // free seek structs
-  if (mp4->time_to_sample) Safefree(mp4->time_to_sample);
-  if (mp4->sample_to_chunk) Safefree(mp4->sample_to_chunk);
-  if (mp4->sample_byte_size) Safefree(mp4->sample_byte_size);
-  if (mp4->chunk_offset) Safefree(mp4->chunk_offset);
+  if (ret == -1) {
+    if (info) {
+      res_hv_store( info, "seek_offset", res_newiv(-1) );
+    }
+    return -1;
+  }
   
-  // free seek buffer
-  buffer_free(&tmp_buf);
+  return file_offset;
+}
+
+// Adds to the seek header, a piece at a time to a writer.  Large pieces of
+// the kept header, such as cover art, are passed on without a copy.
+static void
+_mp4_out(mp4out *out, const char *data, uint32_t len)
+{
+  if ( buffer_len(&out->buf) + len > MP4_WRITE_SIZE ) {
+    _mp4_out_flush(out);
+    
+    if (len >= MP4_WRITE_SIZE) {
+      _mp4_out_write(out, data, len);
+      return;
+    }
+  }
   
-  Safefree(mp4);
+  buffer_append(&out->buf, data, len);
+}
+
+static void
+_mp4_out_int(mp4out *out, uint32_t value)
+{
+  char tmp[4];
   
-  if (ret == -1) {
-    my_hv_store( info, "seek_offset", newSViv(-1) );
-  }
+  put_u32(tmp, value);
+  _mp4_out(out, tmp, 4);
+}
+
+static void
+_mp4_out_int64(mp4out *out, uint64_t value)
+{
+  char tmp[8];
   
-  return ret;
+  put_u64(tmp, value);
+  _mp4_out(out, tmp, 8);
+}
+
+// Header of a full box, with version and flags 0
+static void
+_mp4_out_box(mp4out *out, uint32_t size, char *type)
+{
+  _mp4_out_int(out, size);
+  _mp4_out(out, type, 4);
+  _mp4_out_int(out, 0);
+}
+
+static void
+_mp4_out_flush(mp4out *out)
+{
+  _mp4_out_write( out, (char *)buffer_ptr(&out->buf), buffer_len(&out->buf) );
+  buffer_clear(&out->buf);
+}
+
+static void
+_mp4_out_write(mp4out *out, const char *data, uint32_t len)
+{
+  if (!len || out->error)
+    return;
+  
+  if (out->w) {
+    if ( !out->w->write(out->w, data, len) )
+      out->error = 1;
+  }
+  else {
+    res_catpvn(out->hdr, data, len);
+  }
 }
 
 mp4info *
-_mp4_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
+_mp4_parse(ScanIO *infile, char *file, resval *info, resval *tags, uint8_t seeking)
 {
   off_t file_size;
-  uint32_t box_size = 0;
+  uint64_t box_size = 0;
   
   mp4info *mp4;
   Newz(0, mp4, sizeof(mp4info), mp4info);
@@ -488,34 +819,42 @@ _mp4_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
   
   buffer_init(mp4->buf, MP4_BLOCK_SIZE);
   
+  if (seeking) {
+    Newz(0, mp4->hdr, sizeof(Buffer), Buffer);
+    buffer_init(mp4->hdr, MP4_BLOCK_SIZE);
+  }
+  
   file_size = _file_size(infile);
   mp4->file_size = file_size;
   
-  my_hv_store( info, "file_size", newSVuv(file_size) );
+  res_hv_store( info, "file_size", res_newuv(file_size) );
   
   // Create empty tracks array
-  my_hv_store( info, "tracks", newRV_noinc( (SV *)newAV() ) );
+  res_hv_store( info, "tracks", res_newav() );
   
   while ( (box_size = _mp4_read_box(mp4)) > 0 ) {
     mp4->audio_offset += box_size;
-    DEBUG_TRACE("read box of size %d / audio_offset %llu\n", box_size, mp4->audio_offset);
+    DEBUG_TRACE("read box of size %llu / audio_offset %llu\n", box_size, mp4->audio_offset);
     
-    if (mp4->audio_offset >= file_size)
+    if (mp4->audio_offset >= file_size || mp4->fragments_done)
       break;
   }
   
+  if (mp4->fragmented)
+    _mp4_finish_fragments(mp4);
+  
   // XXX: if no ftyp was found, assume it is brand 'mp41'
   
   // if no bitrate was found (i.e. ALAC), calculate based on file_size/song_length_ms
-  if ( !my_hv_exists(info, "avg_bitrate") ) {
-    SV **entry = my_hv_fetch(info, "song_length_ms");
+  if ( !res_hv_exists(info, "avg_bitrate") ) {
+    resval **entry = res_hv_fetch(info, "song_length_ms");
     if (entry) {
-      SV **audio_offset = my_hv_fetch(info, "audio_offset");
+      resval **audio_offset = res_hv_fetch(info, "audio_offset");
       if (audio_offset) {
-        uint32_t song_length_ms = SvIV(*entry);
-        uint32_t bitrate = _bitrate(file_size - SvIV(*audio_offset), song_length_ms);
+        uint32_t song_length_ms = res_iv(*entry);
+        uint32_t bitrate = _bitrate(file_size - res_iv(*audio_offset), song_length_ms);
       
-        my_hv_store( info, "avg_bitrate", newSVuv(bitrate) );
+        res_hv_store( info, "avg_bitrate", res_newuv(bitrate) );
         mp4->bitrate = bitrate;
       }
     }
@@ -532,15 +871,15 @@ _mp4_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
         
         if (mp4->channels <= 2) {
           if (mp4->bitrate <= 192000)
-            my_hv_store( info, "dlna_profile", newSVpv("AAC_ISO_192", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("AAC_ISO_192", 0) );
           else if (mp4->bitrate <= 320000)
-            my_hv_store( info, "dlna_profile", newSVpv("AAC_ISO_320", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("AAC_ISO_320", 0) );
           else if (mp4->bitrate <= 576000)
-            my_hv_store( info, "dlna_profile", newSVpv("AAC_ISO", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("AAC_ISO", 0) );
         }
         else if (mp4->channels <= 6) {
           if (mp4->bitrate <= 1440000)
-            my_hv_store( info, "dlna_profile", newSVpv("AAC_MULT5_ISO", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("AAC_MULT5_ISO", 0) );
         }
         
         break;
@@ -554,13 +893,13 @@ _mp4_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
         
         if (mp4->samplerate <= 48000) {
           if (mp4->channels <= 2 && mp4->bitrate <= 576000)
-            my_hv_store( info, "dlna_profile", newSVpv("AAC_LTP_ISO", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("AAC_LTP_ISO", 0) );
         }
         else if (mp4->samplerate <= 96000) {
           if (mp4->channels <= 6 && mp4->bitrate <= 2880000)
-            my_hv_store( info, "dlna_profile", newSVpv("AAC_LTP_MULT5_ISO", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("AAC_LTP_MULT5_ISO", 0) );
           else if (mp4->channels <= 8 && mp4->bitrate <= 4032000)
-            my_hv_store( info, "dlna_profile", newSVpv("AAC_LTP_MULT7_ISO", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("AAC_LTP_MULT7_ISO", 0) );
         }
         
         break;
@@ -576,23 +915,23 @@ _mp4_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
             break;
           
           if (mp4->bitrate <= 128000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAAC_L2_ISO_128", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAAC_L2_ISO_128", 0) );
           else if (mp4->bitrate <= 320000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAAC_L2_ISO_320", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAAC_L2_ISO_320", 0) );
           else if (mp4->bitrate <= 576000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAAC_L2_ISO", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAAC_L2_ISO", 0) );
         }
         else if (mp4->samplerate <= 48000) {
           if (mp4->channels <= 2 && mp4->bitrate <= 576000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAAC_L3_ISO", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAAC_L3_ISO", 0) );
           else if (mp4->channels <= 6 && mp4->bitrate <= 1440000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAAC_MULT5_ISO", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAAC_MULT5_ISO", 0) );
           else if (mp4->channels <= 8 && mp4->bitrate <= 4032000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAAC_MULT7", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAAC_MULT7", 0) );
         }
         else if (mp4->samplerate <= 96000) {
           if (mp4->channels <= 8 && mp4->bitrate <= 4032000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAAC_MULT7", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAAC_MULT7", 0) );
         }
         
         break;
@@ -609,25 +948,25 @@ _mp4_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
             break;
           
           if (mp4->bitrate <= 128000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAACv2_L2_128", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAACv2_L2_128", 0) );
           else if (mp4->bitrate <= 320000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAACv2_L2_320", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAACv2_L2_320", 0) );
           else if (mp4->bitrate <= 576000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAACv2_L2", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAACv2_L2", 0) );
         }
         else if (mp4->samplerate <= 48000) {
           if (mp4->channels <= 2 && mp4->bitrate <= 576000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAACv2_L3", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAACv2_L3", 0) );
           else if (mp4->channels <= 6 && mp4->bitrate <= 1440000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAACv2_L4", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAACv2_L4", 0) );
           else if (mp4->channels <= 6 && mp4->bitrate <= 2880000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAACv2_MULT5", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAACv2_MULT5", 0) );
           else if (mp4->channels <= 8 && mp4->bitrate <= 4032000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAACv2_MULT7", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAACv2_MULT7", 0) );
         }
         else if (mp4->samplerate <= 96000) {
           if (mp4->channels <= 8 && mp4->bitrate <= 4032000)
-            my_hv_store( info, "dlna_profile", newSVpv("HEAACv2_MULT7", 0) );
+            res_hv_store( info, "dlna_profile", res_newpv("HEAACv2_MULT7", 0) );
         }
         
         break;
@@ -642,9 +981,9 @@ _mp4_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
           break;
 
         if (mp4->channels <= 2)
-          my_hv_store( info, "dlna_profile", newSVpv("BSAC_ISO", 0) );
+          res_hv_store( info, "dlna_profile", res_newpv("BSAC_ISO", 0) );
         else if (mp4->channels <= 6)
-          my_hv_store( info, "dlna_profile", newSVpv("BSAC_MULT5_ISO", 0) );
+          res_hv_store( info, "dlna_profile", res_newpv("BSAC_MULT5_ISO", 0) );
 
         break;
       }
@@ -654,13 +993,16 @@ _mp4_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
     }
   }
   
-  buffer_free(mp4->buf);
-  Safefree(mp4->buf);
+  // Seeking reads the sample tables with it later
+  if (!seeking) {
+    buffer_free(mp4->buf);
+    Safefree(mp4->buf);
+  }
   
   return mp4;
 }
 
-int
+uint64_t
 _mp4_read_box(mp4info *mp4)
 {
   uint64_t size;  // total size of box
@@ -699,87 +1041,16 @@ _mp4_read_box(mp4info *mp4)
   
   DEBUG_TRACE("%s size %llu\n", type, size);
   
-  if (mp4->seekhdr) {
-    // Copy and adjust header if seeking
-    char tmp_size[4];
-    
-    if (
-         FOURCC_EQ(type, "moov")
-      || FOURCC_EQ(type, "trak")
-      || FOURCC_EQ(type, "mdia")
-      || FOURCC_EQ(type, "minf")
-      || FOURCC_EQ(type, "stbl")
-    ) {
-      // Container box, adjust size
-      put_u32(tmp_size, size - (mp4->old_st_size - mp4->new_st_size));
-      DEBUG_TRACE("  Box is parent of st*, changed size to %llu\n", size - (mp4->old_st_size - mp4->new_st_size));
-      sv_catpvn( mp4->seekhdr, tmp_size, 4 );
-      sv_catpvn( mp4->seekhdr, type, 4 );
-    }
-    // Replace st* boxes with our new versions
-    else if ( FOURCC_EQ(type, "stts") ) {
-      DEBUG_TRACE("adding new stts of size %ld\n", sv_len(mp4->new_stts));
-      sv_catsv( mp4->seekhdr, mp4->new_stts );
-    }
-    else if ( FOURCC_EQ(type, "stsc") ) {
-      DEBUG_TRACE("adding new stsc of size %ld\n", sv_len(mp4->new_stsc));
-      sv_catsv( mp4->seekhdr, mp4->new_stsc );
-    }
-    else if ( FOURCC_EQ(type, "stsz") ) {
-      DEBUG_TRACE("adding new stsz of size %ld\n", sv_len(mp4->new_stsz));
-      sv_catsv( mp4->seekhdr, mp4->new_stsz );
-    }
-    else if ( FOURCC_EQ(type, "stco") ) {
-      DEBUG_TRACE("adding new stco of size %ld\n", sv_len(mp4->new_stco));
-      sv_catsv( mp4->seekhdr, mp4->new_stco );
-    }
-    else {
-      // Normal box, copy it
-      put_u32(tmp_size, size);
-      sv_catpvn( mp4->seekhdr, tmp_size, 4 );
-      sv_catpvn( mp4->seekhdr, type, 4 );
-      
-      // stsd is special and contains real bytes and is also a container
-      if ( FOURCC_EQ(type, "stsd") ) {
-        sv_catpvn( mp4->seekhdr, (char *)buffer_ptr(mp4->buf), 8 );
-      }
-      
-      // mp4a is special, ugh
-      else if ( FOURCC_EQ(type, "mp4a") ) {
-        sv_catpvn( mp4->seekhdr, (char *)buffer_ptr(mp4->buf), 28 );
-      }
-      
-      // and so is meta
-      else if ( FOURCC_EQ(type, "meta") ) {
-        sv_catpvn( mp4->seekhdr, (char *)buffer_ptr(mp4->buf), mp4->meta_size );
-      }
-      
-      // Copy contents unless it's a container
-      else if (
-           !FOURCC_EQ(type, "edts")
-        && !FOURCC_EQ(type, "dinf")
-        && !FOURCC_EQ(type, "udta")
-        && !FOURCC_EQ(type, "mdat")
-      ) {
-        if ( !_check_buf(mp4->infile, mp4->buf, size - 8, MP4_BLOCK_SIZE) ) {
-          return 0;
-        }
-        
-        // XXX find a way to skip udta completely when rewriting seek header
-        // to avoid useless copying of artwork.  Will require adjusting offsets
-        // differently.
-        
-        sv_catpvn( mp4->seekhdr, (char *)buffer_ptr(mp4->buf), size - 8 );
-      }
+  // Fragments are seeked as they are, nothing after the first is kept
+  if ( mp4->seeking && !mp4->fragmented && !FOURCC_EQ(type, "moof") ) {
+    if ( !_mp4_keep_box(mp4, type, size) ) {
+      return 0;
     }
-    
-    // XXX should probably return size here and avoid reading info a second time
-    // or move the header copying code to somewhere else
   }
   
   if ( FOURCC_EQ(type, "ftyp") ) {
     if ( !_mp4_parse_ftyp(mp4) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad ftyp box): %s\n", mp4->file);
+      LOG_ERROR("Invalid MP4 file (bad ftyp box): %s\n", mp4->file);
       return 0;
     }
   }
@@ -791,7 +1062,13 @@ _mp4_read_box(mp4info *mp4)
     || FOURCC_EQ(type, "dinf")
     || FOURCC_EQ(type, "stbl")
     || FOURCC_EQ(type, "udta")
+    || FOURCC_EQ(type, "mvex")
   ) {
+    // The seek header of a fragmented file is everything up to the end of moov
+    if ( FOURCC_EQ(type, "moov") ) {
+      mp4->init_size = mp4->audio_offset + size;
+    }
+    
     // These boxes are containers for nested boxes, return only the fact that
     // we read the header size of the container
     size = mp4->hsize;
@@ -809,31 +1086,31 @@ _mp4_read_box(mp4info *mp4)
     mp4->seen_moov = 1;
     
     if ( !_mp4_parse_mvhd(mp4) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad mvhd box): %s\n", mp4->file);
+      LOG_ERROR("Invalid MP4 file (bad mvhd box): %s\n", mp4->file);
       return 0;
     }
   }
   else if ( FOURCC_EQ(type, "tkhd") ) {
     if ( !_mp4_parse_tkhd(mp4) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad tkhd box): %s\n", mp4->file);
+      LOG_ERROR("Invalid MP4 file (bad tkhd box): %s\n", mp4->file);
       return 0;
     }
   }
   else if ( FOURCC_EQ(type, "mdhd") ) {
     if ( !_mp4_parse_mdhd(mp4) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad mdhd box): %s\n", mp4->file);
+      LOG_ERROR("Invalid MP4 file (bad mdhd box): %s\n", mp4->file);
       return 0;
     }
   }
   else if ( FOURCC_EQ(type, "hdlr") ) {
     if ( !_mp4_parse_hdlr(mp4) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad hdlr box): %s\n", mp4->file);
+      LOG_ERROR("Invalid MP4 file (bad hdlr box): %s\n", mp4->file);
       return 0;
     }
   }
   else if ( FOURCC_EQ(type, "stsd") ) {
     if ( !_mp4_parse_stsd(mp4) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad stsd box): %s\n", mp4->file);
+      LOG_ERROR("Invalid MP4 file (bad stsd box): %s\n", mp4->file);
       return 0;
     }
     
@@ -842,7 +1119,7 @@ _mp4_read_box(mp4info *mp4)
   }
   else if ( FOURCC_EQ(type, "mp4a") ) {
     if ( !_mp4_parse_mp4a(mp4) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad mp4a box): %s\n", mp4->file);
+      LOG_ERROR("Invalid MP4 file (bad mp4a box): %s\n", mp4->file);
       return 0;
     }
     
@@ -851,7 +1128,7 @@ _mp4_read_box(mp4info *mp4)
   }
   else if ( FOURCC_EQ(type, "alac") ) {
     if ( !_mp4_parse_alac(mp4) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad alac box): %s\n", mp4->file);
+      LOG_ERROR("Invalid MP4 file (bad alac box): %s\n", mp4->file);
       return 0;
     }
         
@@ -861,82 +1138,99 @@ _mp4_read_box(mp4info *mp4)
   }
   else if ( FOURCC_EQ(type, "drms") ) {
     // Mark encoding
-    HV *trackinfo = _mp4_get_current_trackinfo(mp4);
+    resval *trackinfo = _mp4_get_current_trackinfo(mp4);
+    
+    res_hv_store( trackinfo, "encoding", res_newpvn("drms", 4) );
     
-    my_hv_store( trackinfo, "encoding", newSVpvn("drms", 4) );
+    // Skip rest
+    skip = 1;
+  }
+  else if ( FOURCC_EQ(type, "esds") ) {
+    if ( !_mp4_parse_esds(mp4) ) {
+      LOG_ERROR("Invalid MP4 file (bad esds box): %s\n", mp4->file);
+      return 0;
+    }
+  }
+  else if (
+       FOURCC_EQ(type, "stts")
+    || FOURCC_EQ(type, "stsc")
+    || FOURCC_EQ(type, "stsz")
+    || FOURCC_EQ(type, "stco")
+    || FOURCC_EQ(type, "co64")
+  ) {
+    // Sample tables are only needed to seek, so just note where the seeked
+    // track's are and read them on the first mp4_seek
+    if ( mp4->track_count == mp4->seek_track ) {
+      struct mp4tblbox *box
+        = FOURCC_EQ(type, "stts") ? &mp4->stts_box
+        : FOURCC_EQ(type, "stsc") ? &mp4->stsc_box
+        : FOURCC_EQ(type, "stsz") ? &mp4->stsz_box
+        : &mp4->stco_box;
+      
+      if ( box == &mp4->stco_box )
+        mp4->co64 = FOURCC_EQ(type, "co64");
+      
+      box->offset = mp4->audio_offset + mp4->hsize;
+      box->size   = mp4->rsize;
+      
+      if (mp4->seeking)
+        mp4->old_st_size += size;
+    }
     
-    // Skip rest
     skip = 1;
   }
-  else if ( FOURCC_EQ(type, "esds") ) {
-    if ( !_mp4_parse_esds(mp4) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad esds box): %s\n", mp4->file);
+  else if ( FOURCC_EQ(type, "mehd") ) {
+    if ( !_mp4_parse_mehd(mp4) ) {
+      LOG_ERROR("Invalid MP4 file (bad mehd box): %s\n", mp4->file);
       return 0;
     }
   }
-  else if ( FOURCC_EQ(type, "stts") ) {
-    if ( mp4->seeking && mp4->track_count == 1 ) {
-      if ( !_mp4_parse_stts(mp4) ) {
-        PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad stts box): %s\n", mp4->file);
-        return 0;
-      }
-      mp4->old_st_size += size;
-    }
-    else {
-      skip = 1;
+  else if ( FOURCC_EQ(type, "trex") ) {
+    if ( !_mp4_parse_trex(mp4) ) {
+      LOG_ERROR("Invalid MP4 file (bad trex box): %s\n", mp4->file);
+      return 0;
     }
   }
-  else if ( FOURCC_EQ(type, "stsc") ) {
-    if ( mp4->seeking && mp4->track_count == 1 ) {
-      if ( !_mp4_parse_stsc(mp4) ) {
-        PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad stsc box): %s\n", mp4->file);
-        return 0;
-      }
-      mp4->old_st_size += size;
-    }
-    else {
-      skip = 1;
+  else if ( FOURCC_EQ(type, "sidx") ) {
+    if ( !_mp4_parse_sidx(mp4) ) {
+      LOG_ERROR("Invalid MP4 file (bad sidx box): %s\n", mp4->file);
+      return 0;
     }
   }
-  else if ( FOURCC_EQ(type, "stsz") ) {
-    if ( mp4->seeking && mp4->track_count == 1 ) {
-      if ( !_mp4_parse_stsz(mp4) ) {
-        PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad stsz box): %s\n", mp4->file);
-        return 0;
-      }
-      mp4->old_st_size += size;
-    }
-    else {
-      skip = 1;
+  else if ( FOURCC_EQ(type, "moof") ) {
+    if ( !mp4->fragmented ) {
+      _mp4_start_fragments(mp4);
     }
-  }
-  else if ( FOURCC_EQ(type, "stco") ) {
-    if ( mp4->seeking && mp4->track_count == 1 ) {
-      if ( !_mp4_parse_stco(mp4) ) {
-        PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad stco box): %s\n", mp4->file);
+    
+    // Otherwise every moof is read for the duration, and the index if
+    // there is no other
+    if ( !mp4->fragments_done ) {
+      uint64_t duration;
+      
+      if (mp4->frag_walk)
+        _mp4_add_frag(mp4, mp4->frag_time, mp4->audio_offset);
+      
+      if ( !_mp4_parse_moof(mp4, &duration) ) {
+        LOG_ERROR("Invalid MP4 file (bad moof box): %s\n", mp4->file);
         return 0;
       }
-      mp4->old_st_size += size;
-    }
-    else {
-      skip = 1;
+      
+      mp4->frag_time += duration;
     }
   }
   else if ( FOURCC_EQ(type, "meta") ) {
     uint8_t meta_size = _mp4_parse_meta(mp4);
     if ( !meta_size ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad meta box): %s\n", mp4->file);
+      LOG_ERROR("Invalid MP4 file (bad meta box): %s\n", mp4->file);
       return 0;
     }
     
-    mp4->meta_size = meta_size;
-    
     // meta is a special real box + container, count only the real bytes
     size = meta_size + mp4->hsize;
   }
   else if ( FOURCC_EQ(type, "ilst") ) {
     if ( !_mp4_parse_ilst(mp4) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid MP4 file (bad ilst box): %s\n", mp4->file);
+      LOG_ERROR("Invalid MP4 file (bad ilst box): %s\n", mp4->file);
       return 0;
     }
   }
@@ -947,14 +1241,18 @@ _mp4_read_box(mp4info *mp4)
     // If we haven't seen moov yet, set a flag so we can print a warning
     // or handle it some other way
     if ( !mp4->seen_moov ) {
-      my_hv_store( mp4->info, "leading_mdat", newSVuv(1) );
+      res_hv_store( mp4->info, "leading_mdat", res_newuv(1) );
       mp4->dlna_invalid = 1; // DLNA 8.6.34.8, moov must be before mdat
     }
     
-    // Record audio offset and length
-    my_hv_store( mp4->info, "audio_offset", newSVuv(mp4->audio_offset) );
-    my_hv_store( mp4->info, "audio_size", newSVuv(size) );
-    mp4->audio_size = size;
+    // Record audio offset and length, for fragmented files they cover all
+    // the fragments, see _mp4_finish_fragments
+    if ( !mp4->fragmented ) {
+      res_hv_store( mp4->info, "audio_offset", res_newuv(mp4->audio_offset) );
+      res_hv_store( mp4->info, "audio_size", res_newuv(size) );
+      mp4->audio_size = size;
+      mp4->audio_hsize = mp4->hsize;
+    }
   }
   else {
     DEBUG_TRACE("  Unhandled box, skipping\n");
@@ -968,19 +1266,144 @@ _mp4_read_box(mp4info *mp4)
   return size;
 }
 
+// Copies each box into mp4->hdr as it is read, the same way it will go in
+// the seek header: containers get only their header, stsd, mp4a and meta
+// only their own fields before the boxes they contain, and mdat only its
+// header.  The st* boxes are left out and marked, as are the container
+// sizes that change with them.
+static int
+_mp4_keep_box(mp4info *mp4, char *type, uint64_t size)
+{
+  char tmp_size[4];
+  uint32_t copy = 0;
+  
+  if (
+       FOURCC_EQ(type, "moov")
+    || FOURCC_EQ(type, "trak")
+    || FOURCC_EQ(type, "mdia")
+    || FOURCC_EQ(type, "minf")
+    || FOURCC_EQ(type, "stbl")
+  ) {
+    // Container box, size is adjusted when the header is written
+    _mp4_mark_box(mp4, type, size);
+  }
+  // Replaced by the rewritten st* boxes
+  else if (
+       FOURCC_EQ(type, "stts")
+    || FOURCC_EQ(type, "stsc")
+    || FOURCC_EQ(type, "stsz")
+    || FOURCC_EQ(type, "stco")
+    || FOURCC_EQ(type, "co64")
+  ) {
+    _mp4_mark_box(mp4, type, size);
+    return 1;
+  }
+  // Cut down to the range of a clip
+  else if ( FOURCC_EQ(type, "mdat") ) {
+    _mp4_mark_box(mp4, type, size);
+  }
+  // Given the clip's duration, or left out of it
+  else if (
+       FOURCC_EQ(type, "mvhd")
+    || FOURCC_EQ(type, "tkhd")
+    || FOURCC_EQ(type, "mdhd")
+    || FOURCC_EQ(type, "edts")
+  ) {
+    _mp4_mark_box(mp4, type, size);
+    
+    if ( !FOURCC_EQ(type, "edts") )
+      copy = mp4->rsize;
+  }
+  // stsd is special and contains real bytes and is also a container
+  else if ( FOURCC_EQ(type, "stsd") ) {
+    copy = 8;
+  }
+  // mp4a is special, ugh
+  else if ( FOURCC_EQ(type, "mp4a") ) {
+    copy = 28;
+  }
+  // and so is meta, its version/flags and hdlr
+  else if ( FOURCC_EQ(type, "meta") ) {
+    unsigned char *bptr;
+    
+    if ( !_check_buf(mp4->infile, mp4->buf, 8, MP4_BLOCK_SIZE) ) {
+      return 0;
+    }
+    
+    bptr = buffer_ptr(mp4->buf);
+    copy = 4 + ( (bptr[4] << 24) | (bptr[5] << 16) | (bptr[6] << 8) | bptr[7] );
+  }
+  // Copy contents unless it's a container
+  else if (
+       !FOURCC_EQ(type, "edts")
+    && !FOURCC_EQ(type, "dinf")
+    && !FOURCC_EQ(type, "udta")
+  ) {
+    // XXX find a way to skip udta completely when rewriting seek header
+    // to avoid useless copying of artwork.  Will require adjusting offsets
+    // differently.
+    copy = mp4->rsize;
+  }
+  
+  // Boxes over 4GB (mdat) keep their 64-bit size
+  if (mp4->hsize == 16) {
+    char tmp_size64[8];
+    
+    put_u32(tmp_size, 1);
+    put_u64(tmp_size64, size);
+    buffer_append(mp4->hdr, tmp_size, 4);
+    buffer_append(mp4->hdr, type, 4);
+    buffer_append(mp4->hdr, tmp_size64, 8);
+  }
+  else {
+    put_u32(tmp_size, size);
+    buffer_append(mp4->hdr, tmp_size, 4);
+    buffer_append(mp4->hdr, type, 4);
+  }
+  
+  if (copy) {
+    if ( !_check_buf(mp4->infile, mp4->buf, copy, MP4_BLOCK_SIZE) ) {
+      return 0;
+    }
+    
+    buffer_append(mp4->hdr, buffer_ptr(mp4->buf), copy);
+  }
+  
+  return 1;
+}
+
+static void
+_mp4_mark_box(mp4info *mp4, char *type, uint64_t size)
+{
+  mp4hdrmark *mark;
+  
+  if (mp4->num_hdr_marks == mp4->hdr_marks_alloc) {
+    mp4->hdr_marks_alloc = mp4->hdr_marks_alloc ? mp4->hdr_marks_alloc * 2 : 32;
+    Renew(mp4->hdr_marks, mp4->hdr_marks_alloc, mp4hdrmark);
+  }
+  
+  mark = &mp4->hdr_marks[mp4->num_hdr_marks++];
+  mark->offset = buffer_len(mp4->hdr);
+  mark->size   = (uint32_t)size;
+  mark->track  = FOURCC_EQ(type, "trak") ? mp4->track_count + 1
+               : FOURCC_EQ(type, "mdat") ? 0
+               : mp4->track_count;
+  memcpy(mark->type, type, 4);
+}
+
 uint8_t
 _mp4_parse_ftyp(mp4info *mp4)
 {
-  AV *compatible_brands = newAV();
+  resval *compatible_brands = res_newav();
   
   if ( !_check_buf(mp4->infile, mp4->buf, mp4->rsize, MP4_BLOCK_SIZE) ) {
     return 0;
   }
   
-  my_hv_store( mp4->info, "major_brand", newSVpvn( buffer_ptr(mp4->buf), 4 ) );
+  res_hv_store( mp4->info, "major_brand", res_newpvn( buffer_ptr(mp4->buf), 4 ) );
   buffer_consume(mp4->buf, 4);
   
-  my_hv_store( mp4->info, "minor_version", newSVuv( buffer_get_int(mp4->buf) ) );
+  res_hv_store( mp4->info, "minor_version", res_newuv( buffer_get_int(mp4->buf) ) );
   
   mp4->rsize -= 8;
   
@@ -990,12 +1413,12 @@ _mp4_parse_ftyp(mp4info *mp4)
   }
   
   while (mp4->rsize > 0) {
-    av_push( compatible_brands, newSVpvn( buffer_ptr(mp4->buf), 4 ) );
+    res_av_push( compatible_brands, res_newpvn( buffer_ptr(mp4->buf), 4 ) );
     buffer_consume(mp4->buf, 4);
     mp4->rsize -= 4;
   }
     
-  my_hv_store( mp4->info, "compatible_brands", newRV_noinc( (SV *)compatible_brands ) );
+  res_hv_store( mp4->info, "compatible_brands", compatible_brands );
   
   return 1;
 }
@@ -1018,18 +1441,18 @@ _mp4_parse_mvhd(mp4info *mp4)
     buffer_consume(mp4->buf, 8);
     
     timescale = buffer_get_int(mp4->buf);
-    my_hv_store( mp4->info, "mv_timescale", newSVuv(timescale) );
+    res_hv_store( mp4->info, "mv_timescale", res_newuv(timescale) );
     
-    my_hv_store( mp4->info, "song_length_ms", newSVuv( (buffer_get_int(mp4->buf) * 1.0 / timescale ) * 1000 ) );
+    res_hv_store( mp4->info, "song_length_ms", res_newuv( (buffer_get_int(mp4->buf) * 1.0 / timescale ) * 1000 ) );
   }
   else if (version == 1) { // 64-bit values
     // Skip ctime and mtime
     buffer_consume(mp4->buf, 16);
     
     timescale = buffer_get_int(mp4->buf);
-    my_hv_store( mp4->info, "mv_timescale", newSVuv(timescale) );
+    res_hv_store( mp4->info, "mv_timescale", res_newuv(timescale) );
     
-    my_hv_store( mp4->info, "song_length_ms", newSVuv( (buffer_get_int64(mp4->buf) * 1.0 / timescale ) * 1000 ) );
+    res_hv_store( mp4->info, "song_length_ms", res_newuv( (buffer_get_int64(mp4->buf) * 1.0 / timescale ) * 1000 ) );
   }
   else {
     return 0;
@@ -1044,14 +1467,14 @@ _mp4_parse_mvhd(mp4info *mp4)
 uint8_t
 _mp4_parse_tkhd(mp4info *mp4)
 {
-  AV *tracks = (AV *)SvRV( *(my_hv_fetch(mp4->info, "tracks")) );
-  HV *trackinfo = newHV();
+  resval *tracks = *(res_hv_fetch(mp4->info, "tracks"));
+  resval *trackinfo = res_newhv();
   uint32_t id;
   double width;
   double height;
   uint8_t version;
   
-  uint32_t timescale = SvIV( *(my_hv_fetch(mp4->info, "mv_timescale")) );
+  uint32_t timescale = res_iv( *(res_hv_fetch(mp4->info, "mv_timescale")) );
   
   if ( !_check_buf(mp4->infile, mp4->buf, mp4->rsize, MP4_BLOCK_SIZE) ) {
     return 0;
@@ -1069,12 +1492,12 @@ _mp4_parse_tkhd(mp4info *mp4)
     
     id = buffer_get_int(mp4->buf);
     
-    my_hv_store( trackinfo, "id", newSVuv(id) );
+    res_hv_store( trackinfo, "id", res_newuv(id) );
     
     // Skip reserved
     buffer_consume(mp4->buf, 4);
     
-    my_hv_store( trackinfo, "duration", newSVuv( (buffer_get_int(mp4->buf) * 1.0 / timescale ) * 1000 ) );
+    res_hv_store( trackinfo, "duration", res_newuv( (buffer_get_int(mp4->buf) * 1.0 / timescale ) * 1000 ) );
   }
   else if (version == 1) { // 64-bit values
     // Skip ctime and mtime
@@ -1082,12 +1505,12 @@ _mp4_parse_tkhd(mp4info *mp4)
     
     id = buffer_get_int(mp4->buf);
     
-    my_hv_store( trackinfo, "id", newSVuv(id) );
+    res_hv_store( trackinfo, "id", res_newuv(id) );
     
     // Skip reserved
     buffer_consume(mp4->buf, 4);
     
-    my_hv_store( trackinfo, "duration", newSVuv( (buffer_get_int64(mp4->buf) * 1.0 / timescale ) * 1000 ) );
+    res_hv_store( trackinfo, "duration", res_newuv( (buffer_get_int64(mp4->buf) * 1.0 / timescale ) * 1000 ) );
   }
   else {
     return 0;
@@ -1100,16 +1523,16 @@ _mp4_parse_tkhd(mp4info *mp4)
   width = buffer_get_short(mp4->buf);
   width += buffer_get_short(mp4->buf) / 65536.;
   if (width > 0) {
-    my_hv_store( trackinfo, "width", newSVnv(width) );
+    res_hv_store( trackinfo, "width", res_newnv(width) );
   }
   
   height = buffer_get_short(mp4->buf);
   height += buffer_get_short(mp4->buf) / 65536.;
   if (height > 0) {
-    my_hv_store( trackinfo, "height", newSVnv(height) );
+    res_hv_store( trackinfo, "height", res_newnv(height) );
   }
   
-  av_push( tracks, newRV_noinc( (SV *)trackinfo ) );
+  res_av_push( tracks, trackinfo );
   
   // Remember the current track we're dealing with
   mp4->current_track = id;
@@ -1135,14 +1558,14 @@ _mp4_parse_mdhd(mp4info *mp4)
     buffer_consume(mp4->buf, 8);
     
     timescale = buffer_get_int(mp4->buf);
-    my_hv_store( mp4->info, "samplerate", newSVuv(timescale) );
+    res_hv_store( mp4->info, "samplerate", res_newuv(timescale) );
     
     // Skip duration, if have song_length_ms from mvhd
-    if ( my_hv_exists( mp4->info, "song_length_ms" ) ) {
+    if ( res_hv_exists( mp4->info, "song_length_ms" ) ) {
       buffer_consume(mp4->buf, 4);
     }
     else {
-      my_hv_store( mp4->info, "song_length_ms", newSVuv( (buffer_get_int(mp4->buf) * 1.0 / timescale ) * 1000 ) );
+      res_hv_store( mp4->info, "song_length_ms", res_newuv( (buffer_get_int(mp4->buf) * 1.0 / timescale ) * 1000 ) );
     }
   }
   else if (version == 1) { // 64-bit values
@@ -1150,14 +1573,14 @@ _mp4_parse_mdhd(mp4info *mp4)
     buffer_consume(mp4->buf, 16);
     
     timescale = buffer_get_int(mp4->buf);
-    my_hv_store( mp4->info, "samplerate", newSVuv(timescale) );
+    res_hv_store( mp4->info, "samplerate", res_newuv(timescale) );
     
     // Skip duration, if have song_length_ms from mvhd
-    if ( my_hv_exists( mp4->info, "song_length_ms" ) ) {
+    if ( res_hv_exists( mp4->info, "song_length_ms" ) ) {
       buffer_consume(mp4->buf, 8);
     }
     else {
-      my_hv_store( mp4->info, "song_length_ms", newSVuv( (buffer_get_int64(mp4->buf) * 1.0 / timescale ) * 1000 ) );
+      res_hv_store( mp4->info, "song_length_ms", res_newuv( (buffer_get_int64(mp4->buf) * 1.0 / timescale ) * 1000 ) );
     }
   }
   else {
@@ -1175,8 +1598,8 @@ _mp4_parse_mdhd(mp4info *mp4)
 uint8_t
 _mp4_parse_hdlr(mp4info *mp4)
 {
-  HV *trackinfo = _mp4_get_current_trackinfo(mp4);
-  SV *handler_name;
+  resval *trackinfo = _mp4_get_current_trackinfo(mp4);
+  resval *handler_name;
   
   if (!trackinfo) {
     return 0;
@@ -1189,15 +1612,23 @@ _mp4_parse_hdlr(mp4info *mp4)
   // Skip version, flags, pre_defined
   buffer_consume(mp4->buf, 8);
   
-  my_hv_store( trackinfo, "handler_type", newSVpvn( buffer_ptr(mp4->buf), 4 ) );
+  res_hv_store( trackinfo, "handler_type", res_newpvn( buffer_ptr(mp4->buf), 4 ) );
+  
+  // Seek on the first audio track, mdhd before hdlr has its timescale
+  if ( !mp4->seek_track && FOURCC_EQ((char *)buffer_ptr(mp4->buf), "soun") ) {
+    mp4->seek_track      = mp4->track_count;
+    mp4->track_id        = mp4->current_track;
+    mp4->track_timescale = mp4->samplerate;
+  }
+  
   buffer_consume(mp4->buf, 4);
   
   // Skip reserved
   buffer_consume(mp4->buf, 12);
   
-  handler_name = newSVpv( buffer_ptr(mp4->buf), 0 );
-  sv_utf8_decode(handler_name);
-  my_hv_store( trackinfo, "handler_name", handler_name );
+  handler_name = res_newpv( buffer_ptr(mp4->buf), 0 );
+  res_utf8_decode(handler_name);
+  res_hv_store( trackinfo, "handler_name", handler_name );
   
   buffer_consume(mp4->buf, mp4->rsize - 24);
   
@@ -1224,20 +1655,20 @@ _mp4_parse_stsd(mp4info *mp4)
 uint8_t
 _mp4_parse_mp4a(mp4info *mp4)
 {
-  HV *trackinfo = _mp4_get_current_trackinfo(mp4);
+  resval *trackinfo = _mp4_get_current_trackinfo(mp4);
   
   if ( !_check_buf(mp4->infile, mp4->buf, 28, MP4_BLOCK_SIZE) ) {
     return 0;
   }
   
-  my_hv_store( trackinfo, "encoding", newSVpvn("mp4a", 4) );
+  res_hv_store( trackinfo, "encoding", res_newpvn("mp4a", 4) );
   
   // Skip reserved
   buffer_consume(mp4->buf, 16);
   
   mp4->channels = buffer_get_short(mp4->buf);
-  my_hv_store( trackinfo, "channels", newSVuv(mp4->channels) );
-  my_hv_store( trackinfo, "bits_per_sample", newSVuv( buffer_get_short(mp4->buf) ) );
+  res_hv_store( trackinfo, "channels", res_newuv(mp4->channels) );
+  res_hv_store( trackinfo, "bits_per_sample", res_newuv( buffer_get_short(mp4->buf) ) );
   
   // Skip reserved
   buffer_consume(mp4->buf, 4);
@@ -1254,7 +1685,7 @@ _mp4_parse_mp4a(mp4info *mp4)
 uint8_t
 _mp4_parse_esds(mp4info *mp4)
 {
-  HV *trackinfo = _mp4_get_current_trackinfo(mp4);
+  resval *trackinfo = _mp4_get_current_trackinfo(mp4);
   uint32_t len = 0;
   uint32_t avg_bitrate;
   
@@ -1294,19 +1725,19 @@ _mp4_parse_esds(mp4info *mp4)
   }
   
   // XXX: map to string
-  my_hv_store( trackinfo, "audio_type", newSVuv( buffer_get_char(mp4->buf) ) );
+  res_hv_store( trackinfo, "audio_type", res_newuv( buffer_get_char(mp4->buf) ) );
   
   buffer_consume(mp4->buf, 4);
   
-  my_hv_store( trackinfo, "max_bitrate", newSVuv( buffer_get_int(mp4->buf) ) );
+  res_hv_store( trackinfo, "max_bitrate", res_newuv( buffer_get_int(mp4->buf) ) );
   
   avg_bitrate = buffer_get_int(mp4->buf);
   if (avg_bitrate) {
-    if ( my_hv_exists(mp4->info, "avg_bitrate") ) {
+    if ( res_hv_exists(mp4->info, "avg_bitrate") ) {
       // If there are multiple tracks, just add up the bitrates
-      avg_bitrate += SvIV(*(my_hv_fetch(mp4->info, "avg_bitrate")));
+      avg_bitrate += res_iv(*(res_hv_fetch(mp4->info, "avg_bitrate")));
     }
-    my_hv_store( mp4->info, "avg_bitrate", newSVuv(avg_bitrate) );
+    res_hv_store( mp4->info, "avg_bitrate", res_newuv(avg_bitrate) );
     mp4->bitrate = avg_bitrate;
   }
   
@@ -1349,7 +1780,7 @@ _mp4_parse_esds(mp4info *mp4)
       // Channel configuration (4 bits)
       // XXX This is sometimes wrong (1 when it should be 2)
       mp4->channels = buffer_get_bits(mp4->buf, 4);
-      my_hv_store( trackinfo, "channels", newSVuv(mp4->channels) );
+      res_hv_store( trackinfo, "channels", res_newuv(mp4->channels) );
       len -= 4;
       
       if (aot == AAC_SLS) {
@@ -1358,7 +1789,7 @@ _mp4_parse_esds(mp4info *mp4)
         uint8_t bps = buffer_get_bits(mp4->buf, 3);
         len -= 3;
         
-        my_hv_store( trackinfo, "bits_per_sample", newSVuv( bps_table[bps] ) );
+        res_hv_store( trackinfo, "bits_per_sample", res_newuv( bps_table[bps] ) );
       }
       else if (aot == AAC_HE || aot == AAC_PS) {
         // Read extended samplerate info
@@ -1373,11 +1804,11 @@ _mp4_parse_esds(mp4info *mp4)
         }
       }
       
-      my_hv_store( trackinfo, "samplerate", newSVuv(samplerate) );
+      res_hv_store( trackinfo, "samplerate", res_newuv(samplerate) );
       mp4->samplerate = samplerate;
     }
     
-    my_hv_store( trackinfo, "audio_object_type", newSVuv(aot) );
+    res_hv_store( trackinfo, "audio_object_type", res_newuv(aot) );
     mp4->audio_object_type = aot;
     
     // Skip rest of box
@@ -1402,20 +1833,20 @@ _mp4_parse_esds(mp4info *mp4)
 uint8_t
 _mp4_parse_alac(mp4info *mp4)
 {
-  HV *trackinfo = _mp4_get_current_trackinfo(mp4);
+  resval *trackinfo = _mp4_get_current_trackinfo(mp4);
   
   if ( !_check_buf(mp4->infile, mp4->buf, 28, MP4_BLOCK_SIZE) ) {
     return 0;
   }
   
-  my_hv_store( trackinfo, "encoding", newSVpvn("alac", 4) );
+  res_hv_store( trackinfo, "encoding", res_newpvn("alac", 4) );
   
   // Skip reserved
   buffer_consume(mp4->buf, 16);
   
   mp4->channels = buffer_get_short(mp4->buf);
-  my_hv_store( trackinfo, "channels", newSVuv(mp4->channels) );
-  my_hv_store( trackinfo, "bits_per_sample", newSVuv( buffer_get_short(mp4->buf) ) );
+  res_hv_store( trackinfo, "channels", res_newuv(mp4->channels) );
+  res_hv_store( trackinfo, "bits_per_sample", res_newuv( buffer_get_short(mp4->buf) ) );
   
   // Skip reserved
   buffer_consume(mp4->buf, 4);
@@ -1429,12 +1860,31 @@ _mp4_parse_alac(mp4info *mp4)
   return 1;
 }
 
+// Buffers the next entries of a sample table, a block at a time so a table
+// bigger than the buffer cap is never read whole.  Returns how many of the
+// left entries of width bytes are buffered, 0 if the file ends first
+static uint32_t
+_mp4_table_entries(mp4info *mp4, uint32_t left, uint32_t width)
+{
+  uint32_t n;
+  
+  if ( !_check_buf(mp4->infile, mp4->buf, width, MP4_BLOCK_SIZE) ) {
+    return 0;
+  }
+  
+  n = buffer_len(mp4->buf) / width;
+  
+  return n < left ? n : left;
+}
+
 uint8_t
 _mp4_parse_stts(mp4info *mp4)
 {
-  int i;
+  uint32_t i = 0;
+  uint32_t n;
+  uint64_t time = 0;
   
-  if ( !_check_buf(mp4->infile, mp4->buf, mp4->rsize, MP4_BLOCK_SIZE) ) {
+  if ( mp4->rsize < 8 || !_check_buf(mp4->infile, mp4->buf, 8, MP4_BLOCK_SIZE) ) {
     return 0;
   }
   
@@ -1442,8 +1892,14 @@ _mp4_parse_stts(mp4info *mp4)
   buffer_consume(mp4->buf, 4);
   
   mp4->num_time_to_samples = buffer_get_int(mp4->buf);
+  mp4->total_samples = 0;
   DEBUG_TRACE("  num_time_to_samples %d\n", mp4->num_time_to_samples);
   
+  if ( mp4->num_time_to_samples > (mp4->rsize - 8) / 8 ) {
+    LOG_ERROR("Unable to parse stts: too large\n");
+    return 0;
+  }
+  
   New(0, 
     mp4->time_to_sample,
     mp4->num_time_to_samples * sizeof(*mp4->time_to_sample),
@@ -1451,19 +1907,30 @@ _mp4_parse_stts(mp4info *mp4)
   );
   
   if ( !mp4->time_to_sample ) {
-    PerlIO_printf(PerlIO_stderr(), "Unable to parse stts: too large\n");
+    LOG_ERROR("Unable to parse stts: too large\n");
     return 0;
   }
   
-  for (i = 0; i < mp4->num_time_to_samples; i++) {
-    mp4->time_to_sample[i].sample_count    = buffer_get_int(mp4->buf);
-    mp4->time_to_sample[i].sample_duration = buffer_get_int(mp4->buf);
+  while (i < mp4->num_time_to_samples) {
+    if ( !(n = _mp4_table_entries(mp4, mp4->num_time_to_samples - i, 8)) ) {
+      return 0;
+    }
     
-    DEBUG_TRACE(
-      "  sample_count %d sample_duration %d\n",
-      mp4->time_to_sample[i].sample_count,
-      mp4->time_to_sample[i].sample_duration
-    );
+    for ( ; n; n--, i++) {
+      mp4->time_to_sample[i].sample_count    = buffer_get_int(mp4->buf);
+      mp4->time_to_sample[i].sample_duration = buffer_get_int(mp4->buf);
+      mp4->time_to_sample[i].first_sample    = mp4->total_samples;
+      mp4->time_to_sample[i].first_time      = time;
+      
+      mp4->total_samples += mp4->time_to_sample[i].sample_count;
+      time += (uint64_t)mp4->time_to_sample[i].sample_count * mp4->time_to_sample[i].sample_duration;
+      
+      DEBUG_TRACE(
+        "  sample_count %d sample_duration %d\n",
+        mp4->time_to_sample[i].sample_count,
+        mp4->time_to_sample[i].sample_duration
+      );
+    }
   }
   
   return 1;
@@ -1472,9 +1939,10 @@ _mp4_parse_stts(mp4info *mp4)
 uint8_t
 _mp4_parse_stsc(mp4info *mp4)
 {
-  int i;
+  uint32_t i = 0;
+  uint32_t n;
   
-  if ( !_check_buf(mp4->infile, mp4->buf, mp4->rsize, MP4_BLOCK_SIZE) ) {
+  if ( mp4->rsize < 8 || !_check_buf(mp4->infile, mp4->buf, 8, MP4_BLOCK_SIZE) ) {
     return 0;
   }
   
@@ -1484,6 +1952,11 @@ _mp4_parse_stsc(mp4info *mp4)
   mp4->num_sample_to_chunks = buffer_get_int(mp4->buf);
   DEBUG_TRACE("  num_sample_to_chunks %d\n", mp4->num_sample_to_chunks);
   
+  if ( mp4->num_sample_to_chunks > (mp4->rsize - 8) / 12 ) {
+    LOG_ERROR("Unable to parse stsc: too large\n");
+    return 0;
+  }
+  
   New(0, 
     mp4->sample_to_chunk,
     mp4->num_sample_to_chunks * sizeof(*mp4->sample_to_chunk),
@@ -1491,82 +1964,146 @@ _mp4_parse_stsc(mp4info *mp4)
   );
   
   if ( !mp4->sample_to_chunk ) {
-    PerlIO_printf(PerlIO_stderr(), "Unable to parse stsc: too large\n");
+    LOG_ERROR("Unable to parse stsc: too large\n");
     return 0;
   }
   
-  for (i = 0; i < mp4->num_sample_to_chunks; i++) {
-    mp4->sample_to_chunk[i].first_chunk = buffer_get_int(mp4->buf);
-    mp4->sample_to_chunk[i].samples_per_chunk = buffer_get_int(mp4->buf);
-    
-    // Skip sample desc index
-    buffer_consume(mp4->buf, 4);
+  while (i < mp4->num_sample_to_chunks) {
+    if ( !(n = _mp4_table_entries(mp4, mp4->num_sample_to_chunks - i, 12)) ) {
+      return 0;
+    }
     
-    DEBUG_TRACE("  first_chunk %d samples_per_chunk %d\n",
-      mp4->sample_to_chunk[i].first_chunk,
-      mp4->sample_to_chunk[i].samples_per_chunk
-    );
+    for ( ; n; n--, i++) {
+      mp4->sample_to_chunk[i].first_chunk = buffer_get_int(mp4->buf);
+      mp4->sample_to_chunk[i].samples_per_chunk = buffer_get_int(mp4->buf);
+      
+      if (i == 0) {
+        mp4->sample_to_chunk[i].first_sample = 0;
+      }
+      else {
+        struct stc *prev = &mp4->sample_to_chunk[i - 1];
+        
+        mp4->sample_to_chunk[i].first_sample = prev->first_sample
+          + (mp4->sample_to_chunk[i].first_chunk - prev->first_chunk) * prev->samples_per_chunk;
+      }
+      
+      // Skip sample desc index
+      buffer_consume(mp4->buf, 4);
+      
+      DEBUG_TRACE("  first_chunk %d samples_per_chunk %d\n",
+        mp4->sample_to_chunk[i].first_chunk,
+        mp4->sample_to_chunk[i].samples_per_chunk
+      );
+    }
   }
   
   return 1;
 }
 
+// Widens the packed stsz sizes read so far, when a later sample needs more
+// bytes than the largest before it.  Moved from the end down so each size is
+// read before anything is written over it
+static void
+_mp4_widen_sizes(mp4info *mp4, uint32_t count, uint8_t width)
+{
+  uint32_t i = count;
+  
+  Renew(mp4->sample_byte_size, mp4->num_sample_byte_sizes * width, uint8_t);
+  
+  while (i--) {
+    uint8_t *from = mp4->sample_byte_size + i * mp4->sample_size_width;
+    uint8_t *to = mp4->sample_byte_size + i * width;
+    uint8_t size[4] = { 0, 0, 0, 0 };
+    
+    memcpy(size + 4 - mp4->sample_size_width, from, mp4->sample_size_width);
+    memcpy(to, size + 4 - width, width);
+  }
+  
+  mp4->sample_size_width = width;
+}
+
 uint8_t
 _mp4_parse_stsz(mp4info *mp4)
 {
-  int i;
+  uint32_t i = 0;
+  uint32_t n;
   
-  if ( !_check_buf(mp4->infile, mp4->buf, mp4->rsize, MP4_BLOCK_SIZE) ) {
+  if ( mp4->rsize < 12 || !_check_buf(mp4->infile, mp4->buf, 12, MP4_BLOCK_SIZE) ) {
     return 0;
   }
   
   // Skip version/flags
   buffer_consume(mp4->buf, 4);
   
-  // Check sample size is 0
-  if ( buffer_get_int(mp4->buf) != 0 ) {
-    DEBUG_TRACE("  stsz uses fixed sample size\n");
-    buffer_consume(mp4->buf, 4);
+  mp4->sample_size = buffer_get_int(mp4->buf);
+  mp4->num_sample_byte_sizes = buffer_get_int(mp4->buf);
+  
+  DEBUG_TRACE("  num_sample_byte_sizes %d\n", mp4->num_sample_byte_sizes);
+  
+  if (mp4->sample_size) {
+    DEBUG_TRACE("  stsz uses fixed sample size %d\n", mp4->sample_size);
     return 1;
   }
   
-  mp4->num_sample_byte_sizes = buffer_get_int(mp4->buf);
+  if (mp4->num_sample_byte_sizes > (mp4->rsize - 12) / 4) {
+    LOG_ERROR("Unable to parse stsz: too large\n");
+    return 0;
+  }
   
-  DEBUG_TRACE("  num_sample_byte_sizes %d\n", mp4->num_sample_byte_sizes);
+  // Store each size in as few bytes as hold the largest, starting at one
+  // and widening as bigger sizes arrive
+  mp4->sample_size_width = 1;
   
   New(0, 
     mp4->sample_byte_size,
-    mp4->num_sample_byte_sizes * sizeof(*mp4->sample_byte_size),
-    uint16_t
+    mp4->num_sample_byte_sizes ? mp4->num_sample_byte_sizes : 1,
+    uint8_t
   );
   
   if ( !mp4->sample_byte_size ) {
-    PerlIO_printf(PerlIO_stderr(), "Unable to parse stsz: too large\n");
+    LOG_ERROR("Unable to parse stsz: too large\n");
     return 0;
   }
   
-  for (i = 0; i < mp4->num_sample_byte_sizes; i++) {
-    uint32_t v = buffer_get_int(mp4->buf);
+  while (i < mp4->num_sample_byte_sizes) {
+    unsigned char *bptr;
+    uint32_t k;
     
-    if (v > 0x0000ffff) {
-      DEBUG_TRACE("stsz[%d] > 65 kB (%ld)\n", i, (long)v);
+    if ( !(n = _mp4_table_entries(mp4, mp4->num_sample_byte_sizes - i, 4)) ) {
       return 0;
     }
     
-    mp4->sample_byte_size[i] = v;
+    bptr = buffer_ptr(mp4->buf);
+    
+    for (k = 0; k < n; k++, i++, bptr += 4) {
+      uint8_t width = bptr[0] ? 4 : bptr[1] ? 3 : bptr[2] ? 2 : 1;
+      
+      if (width > mp4->sample_size_width)
+        _mp4_widen_sizes(mp4, i, width);
+      
+      // Big-endian like the box, so the low bytes of each size are the last ones
+      memcpy(
+        mp4->sample_byte_size + i * mp4->sample_size_width,
+        bptr + 4 - mp4->sample_size_width,
+        mp4->sample_size_width
+      );
+    }
     
-    //DEBUG_TRACE("  sample_byte_size %d\n", v);
+    buffer_consume(mp4->buf, n * 4);
   }
   
   return 1;
 }
 
+// Reads stco, or co64 with 64-bit offsets
 uint8_t
 _mp4_parse_stco(mp4info *mp4)
 {
-  int i;
+  uint32_t i = 0;
+  uint32_t n;
+  uint8_t width = mp4->co64 ? 8 : 4;
   
-  if ( !_check_buf(mp4->infile, mp4->buf, mp4->rsize, MP4_BLOCK_SIZE) ) {
+  if ( mp4->rsize < 8 || !_check_buf(mp4->infile, mp4->buf, 8, MP4_BLOCK_SIZE) ) {
     return 0;
   }
   
@@ -1575,24 +2112,308 @@ _mp4_parse_stco(mp4info *mp4)
   
   mp4->num_chunk_offsets = buffer_get_int(mp4->buf);
   DEBUG_TRACE("  num_chunk_offsets %d\n", mp4->num_chunk_offsets);
+  
+  if ( mp4->num_chunk_offsets > (mp4->rsize - 8) / width ) {
+    LOG_ERROR("Unable to parse %s: too large\n", mp4->co64 ? "co64" : "stco");
+    return 0;
+  }
       
   New(0, 
     mp4->chunk_offset,
     mp4->num_chunk_offsets * sizeof(*mp4->chunk_offset),
-    uint32_t
+    uint64_t
   );
   
-  if ( !mp4->chunk_offset ) {
-    PerlIO_printf(PerlIO_stderr(), "Unable to parse stco: too large\n");
+  if ( !mp4->chunk_offset ) {
+    LOG_ERROR("Unable to parse %s: too large\n", mp4->co64 ? "co64" : "stco");
+    return 0;
+  }
+  
+  while (i < mp4->num_chunk_offsets) {
+    if ( !(n = _mp4_table_entries(mp4, mp4->num_chunk_offsets - i, width)) ) {
+      return 0;
+    }
+    
+    for ( ; n; n--, i++) {
+      mp4->chunk_offset[i] = mp4->co64 ? buffer_get_int64(mp4->buf) : buffer_get_int(mp4->buf);
+      
+      //DEBUG_TRACE("  chunk_offset %llu\n", mp4->chunk_offset[i]);
+    }
+  }
+  
+  return 1;
+}
+
+// Duration of a fragmented file
+uint8_t
+_mp4_parse_mehd(mp4info *mp4)
+{
+  uint8_t version;
+  uint64_t duration;
+  resval **timescale = res_hv_fetch(mp4->info, "mv_timescale");
+  
+  if ( mp4->rsize < 8 || !_check_buf(mp4->infile, mp4->buf, mp4->rsize, MP4_BLOCK_SIZE) ) {
+    return 0;
+  }
+  
+  version = buffer_get_char(mp4->buf);
+  buffer_consume(mp4->buf, 3); // flags
+  
+  if (version == 1) {
+    if (mp4->rsize < 12) {
+      return 0;
+    }
+    
+    duration = buffer_get_int64(mp4->buf);
+    buffer_consume(mp4->buf, mp4->rsize - 12);
+  }
+  else {
+    duration = buffer_get_int(mp4->buf);
+    buffer_consume(mp4->buf, mp4->rsize - 8);
+  }
+  
+  DEBUG_TRACE("  fragment_duration %llu\n", duration);
+  
+  if ( timescale && res_iv(*timescale) ) {
+    mp4->frag_length_ms = (duration * 1.0 / res_iv(*timescale)) * 1000;
+  }
+  
+  return 1;
+}
+
+// Default sample duration for the fragments of a track
+uint8_t
+_mp4_parse_trex(mp4info *mp4)
+{
+  uint32_t track_id;
+  uint32_t duration;
+  
+  if ( mp4->rsize < 24 || !_check_buf(mp4->infile, mp4->buf, mp4->rsize, MP4_BLOCK_SIZE) ) {
+    return 0;
+  }
+  
+  // Skip version/flags
+  buffer_consume(mp4->buf, 4);
+  
+  track_id = buffer_get_int(mp4->buf);
+  
+  // Skip sample description index
+  buffer_consume(mp4->buf, 4);
+  
+  duration = buffer_get_int(mp4->buf);
+  
+  DEBUG_TRACE("  track %d default_sample_duration %d\n", track_id, duration);
+  
+  if ( track_id == mp4->track_id || !mp4->track_id ) {
+    mp4->trex_duration = duration;
+  }
+  
+  buffer_consume(mp4->buf, mp4->rsize - 16);
+  
+  return 1;
+}
+
+// Segment index, the size and duration of each fragment of a track.  It
+// gives the duration, bitrate and seek index without reading any moof.
+// Only the first sidx of the first track is used, and not one that points
+// to further sidx boxes
+uint8_t
+_mp4_parse_sidx(mp4info *mp4)
+{
+  uint8_t version;
+  uint32_t track_id;
+  uint32_t timescale;
+  uint64_t time;
+  uint64_t offset;
+  uint16_t count;
+  int i;
+  
+  if ( mp4->rsize < 24 || !_check_buf(mp4->infile, mp4->buf, mp4->rsize, MP4_BLOCK_SIZE) ) {
+    return 0;
+  }
+  
+  version = buffer_get_char(mp4->buf);
+  buffer_consume(mp4->buf, 3); // flags
+  
+  track_id  = buffer_get_int(mp4->buf);
+  timescale = buffer_get_int(mp4->buf);
+  
+  if (version == 1) {
+    if (mp4->rsize < 32) {
+      return 0;
+    }
+    
+    buffer_consume(mp4->buf, 8); // earliest_presentation_time
+    offset = buffer_get_int64(mp4->buf);
+  }
+  else {
+    buffer_consume(mp4->buf, 4); // earliest_presentation_time
+    offset = buffer_get_int(mp4->buf);
+  }
+  
+  buffer_consume(mp4->buf, 2); // reserved
+  count = buffer_get_short(mp4->buf);
+  
+  DEBUG_TRACE("  track %d timescale %d first_offset %llu reference_count %d\n", track_id, timescale, offset, count);
+  
+  if ( mp4->rsize - (version == 1 ? 32 : 24) < count * 12 ) {
+    return 0;
+  }
+  
+  if ( mp4->num_frags || !timescale || (mp4->track_id && track_id != mp4->track_id) ) {
+    buffer_consume(mp4->buf, mp4->rsize - (version == 1 ? 32 : 24));
+    return 1;
+  }
+  
+  // Offsets are from the end of the sidx box
+  offset += mp4->audio_offset + mp4->size;
+  time = 0;
+  
+  for (i = 0; i < count; i++) {
+    uint32_t size = buffer_get_int(mp4->buf);
+    uint32_t duration = buffer_get_int(mp4->buf);
+    
+    buffer_consume(mp4->buf, 4); // SAP
+    
+    if (size & 0x80000000) {
+      // A reference to another sidx
+      DEBUG_TRACE("  hierarchical sidx, not used\n");
+      mp4->num_frags = 0;
+      buffer_consume(mp4->buf, (count - i - 1) * 12);
+      return 1;
+    }
+    
+    _mp4_add_frag(mp4, time, offset);
+    
+    time   += duration;
+    offset += size;
+  }
+  
+  buffer_consume(mp4->buf, mp4->rsize - (version == 1 ? 32 : 24) - count * 12);
+  
+  mp4->frag_timescale = timescale;
+  mp4->frag_size = offset - mp4->frags[0].offset;
+  mp4->frag_length_ms = (time * 1.0 / timescale) * 1000;
+  
+  return 1;
+}
+
+// Adds up the sample durations of the first track in a moof
+uint8_t
+_mp4_parse_moof(mp4info *mp4, uint64_t *duration)
+{
+  uint64_t left = mp4->rsize;
+  
+  *duration = 0;
+  
+  if ( !_check_buf(mp4->infile, mp4->buf, mp4->rsize, MP4_BLOCK_SIZE) ) {
     return 0;
   }
   
-  for (i = 0; i < mp4->num_chunk_offsets; i++) {
-    mp4->chunk_offset[i] = buffer_get_int(mp4->buf);
+  while (left >= 8) {
+    uint32_t size = buffer_get_int(mp4->buf);
+    uint8_t traf = FOURCC_EQ((char *)buffer_ptr(mp4->buf), "traf");
+    uint32_t track_id = 0;
+    uint32_t default_duration = mp4->trex_duration;
+    uint32_t tleft;
+    
+    buffer_consume(mp4->buf, 4);
+    
+    if (size < 8 || size > left) {
+      return 0;
+    }
+    
+    left -= size;
+    tleft = size - 8;
+    
+    if (!traf) {
+      buffer_consume(mp4->buf, tleft);
+      continue;
+    }
+    
+    // tfhd comes first in traf, then any trun
+    while (tleft >= 8) {
+      uint32_t bsize = buffer_get_int(mp4->buf);
+      char *btype = (char *)buffer_ptr(mp4->buf);
+      uint32_t used = 8;
+      
+      if (bsize < 16 || bsize > tleft) {
+        return 0;
+      }
+      
+      tleft -= bsize;
+      
+      if ( FOURCC_EQ(btype, "tfhd") ) {
+        uint32_t flags;
+        
+        buffer_consume(mp4->buf, 4);
+        flags = buffer_get_int(mp4->buf) & 0xFFFFFF;
+        track_id = buffer_get_int(mp4->buf);
+        used = 16;
+        
+        if (flags & 0x08) { // default-sample-duration-present
+          uint32_t skip = (flags & 0x01 ? 8 : 0) + (flags & 0x02 ? 4 : 0);
+          
+          if (bsize < used + skip + 4) {
+            return 0;
+          }
+          
+          buffer_consume(mp4->buf, skip);
+          default_duration = buffer_get_int(mp4->buf);
+          used += skip + 4;
+        }
+      }
+      else if ( FOURCC_EQ(btype, "trun") && (track_id == mp4->track_id || !mp4->track_id) ) {
+        uint32_t flags;
+        uint32_t count;
+        uint32_t stride;
+        uint32_t i;
+        
+        buffer_consume(mp4->buf, 4);
+        flags = buffer_get_int(mp4->buf) & 0xFFFFFF;
+        count = buffer_get_int(mp4->buf);
+        used = 16;
+        
+        // Each sample has a duration, size, flags and composition offset if
+        // flagged, in that order
+        stride = (flags & 0x100 ? 4 : 0) + (flags & 0x200 ? 4 : 0) + (flags & 0x400 ? 4 : 0) + (flags & 0x800 ? 4 : 0);
+        
+        if (flags & 0x01) { // data-offset-present
+          buffer_consume(mp4->buf, 4);
+          used += 4;
+        }
+        if (flags & 0x04) { // first-sample-flags-present
+          buffer_consume(mp4->buf, 4);
+          used += 4;
+        }
+        
+        if ( bsize < used || (uint64_t)count * stride > bsize - used ) {
+          return 0;
+        }
+        
+        if (flags & 0x100) {
+          for (i = 0; i < count; i++) {
+            *duration += buffer_get_int(mp4->buf);
+            buffer_consume(mp4->buf, stride - 4);
+          }
+          used += count * stride;
+        }
+        else {
+          *duration += (uint64_t)count * default_duration;
+        }
+      }
+      else {
+        buffer_consume(mp4->buf, 4);
+      }
+      
+      buffer_consume(mp4->buf, bsize - used);
+    }
     
-    //DEBUG_TRACE("  chunk_offset %d\n", mp4->chunk_offset[i]);
+    buffer_consume(mp4->buf, tleft);
   }
   
+  buffer_consume(mp4->buf, left);
+  
   return 1;
 }
 
@@ -1676,7 +2497,7 @@ _mp4_parse_ilst(mp4info *mp4)
       
       // Sanity check for bad data size
       if ( bsize <= size - 8 ) {
-        SV *skey;
+        resval *skey;
         
         char *bptr = buffer_ptr(mp4->buf);
         if ( !FOURCC_EQ(bptr, "data") ) {
@@ -1685,14 +2506,12 @@ _mp4_parse_ilst(mp4info *mp4)
       
         buffer_consume(mp4->buf, 4);
         
-        skey = newSVpv(key, 0);
+        skey = res_newpv(key, 0);
       
         if ( !_mp4_parse_ilst_data(mp4, bsize - 8, skey) ) {
-          SvREFCNT_dec(skey);
           return 0;
         }
         
-        SvREFCNT_dec(skey);
         
         // XXX: bug 14476, files with multiple COVR images aren't handled here, just skipped for now
         if ( bsize < size - 8 ) {
@@ -1713,18 +2532,18 @@ _mp4_parse_ilst(mp4info *mp4)
 }
 
 uint8_t
-_mp4_parse_ilst_data(mp4info *mp4, uint32_t size, SV *key)
+_mp4_parse_ilst_data(mp4info *mp4, uint32_t size, resval *key)
 {
   uint32_t flags;
   unsigned char *ckey;
-  SV *value;
+  resval *value;
   
-  ckey = (unsigned char *)SvPVX(key);
+  ckey = (unsigned char *)res_pv(key);
   if ( FOURCC_EQ(ckey, "COVR") && _env_true("AUDIO_SCAN_NO_ARTWORK") ) {
     // Skip artwork if requested and avoid the memory cost
-    value = newSVuv(size - 8);
+    value = res_newart( mp4->audio_offset + (mp4->size - mp4->rsize) + 24, size - 8 );
     
-    my_hv_store( mp4->tags, "COVR_offset", newSVuv(mp4->audio_offset + (mp4->size - mp4->rsize) + 24) );
+    res_hv_store( mp4->tags, "COVR_offset", res_newuv(value->u.art.offset) );
     
     _mp4_skip(mp4, size);
   }
@@ -1743,7 +2562,7 @@ _mp4_parse_ilst_data(mp4info *mp4, uint32_t size, SV *key)
     DEBUG_TRACE("      flags %d\n", flags);
     
     if ( !flags || flags == 21 ) {
-      if ( FOURCC_EQ( SvPVX(key), "TRKN" ) || FOURCC_EQ( SvPVX(key), "DISK" ) ) {
+      if ( FOURCC_EQ( res_pv(key), "TRKN" ) || FOURCC_EQ( res_pv(key), "DISK" ) ) {
         // Special case trkn, disk (pair of 16-bit ints)
         uint16_t num = 0;
         uint16_t total = 0;
@@ -1761,22 +2580,22 @@ _mp4_parse_ilst_data(mp4info *mp4, uint32_t size, SV *key)
         DEBUG_TRACE("      %d/%d\n", num, total);
     
         if (total) {
-          my_hv_store_ent( mp4->tags, key, newSVpvf( "%d/%d", num, total ) );
+          res_hv_store_ent( mp4->tags, key, res_newpvf( "%d/%d", num, total ) );
         }
         else if (num) {
-          my_hv_store_ent( mp4->tags, key, newSVuv(num) );
+          res_hv_store_ent( mp4->tags, key, res_newuv(num) );
         }
         
         return 1;
       }
-      else if ( FOURCC_EQ( SvPVX(key), "GNRE" ) ) {
+      else if ( FOURCC_EQ( res_pv(key), "GNRE" ) ) {
         // Special case genre, 16-bit int as id3 genre code
         char const *genre_string;
         uint16_t genre_num = buffer_get_short(mp4->buf);
     
         if (genre_num > 0 && genre_num < NGENRES + 1) {
           genre_string = _id3_genre_index(genre_num - 1);
-          my_hv_store_ent( mp4->tags, key, newSVpv( genre_string, 0 ) );
+          res_hv_store_ent( mp4->tags, key, res_newpv( genre_string, 0 ) );
         }
         
         return 1;
@@ -1786,56 +2605,56 @@ _mp4_parse_ilst_data(mp4info *mp4, uint32_t size, SV *key)
         uint32_t dsize = size - 8;
       
         if (dsize == 1) {
-          value = newSVuv( buffer_get_char(mp4->buf) );
+          value = res_newuv( buffer_get_char(mp4->buf) );
         }
         else if (dsize == 2) {
-          value = newSVuv( buffer_get_short(mp4->buf) );
+          value = res_newuv( buffer_get_short(mp4->buf) );
         }
         else if (dsize == 4) {
-          value = newSVuv( buffer_get_int(mp4->buf) );
+          value = res_newuv( buffer_get_int(mp4->buf) );
         }
         else if (dsize == 8) {
-          value = newSVuv( buffer_get_int64(mp4->buf) );
+          value = res_newuv( buffer_get_int64(mp4->buf) );
         }
         else {
-          value = newSVpvn( buffer_ptr(mp4->buf), dsize );
+          value = res_newblob( buffer_ptr(mp4->buf), dsize );
           buffer_consume(mp4->buf, dsize);
         }
       }
     }
     else { // text data
-      value = newSVpvn( buffer_ptr(mp4->buf), size - 8 );
-      sv_utf8_decode(value);
+      value = res_newpvn( buffer_ptr(mp4->buf), size - 8 );
+      res_utf8_decode(value);
     
       // strip copyright symbol 0xA9 out of key
       if ( ckey[0] == 0xA9 ) {
         ckey++;
       }
 
-      DEBUG_TRACE("      %s = %s\n", ckey, SvPVX(value));
+      DEBUG_TRACE("      %s = %s\n", ckey, res_pv(value));
     
       buffer_consume(mp4->buf, size - 8);
     }
   }
     
   // if key exists, create array
-  if ( my_hv_exists( mp4->tags, (char *)ckey ) ) {
-    SV **entry = my_hv_fetch( mp4->tags, (char *)ckey );
+  if ( res_hv_exists( mp4->tags, (char *)ckey ) ) {
+    resval **entry = res_hv_fetch( mp4->tags, (char *)ckey );
     if (entry != NULL) {
-      if ( SvROK(*entry) && SvTYPE(SvRV(*entry)) == SVt_PVAV ) {
-        av_push( (AV *)SvRV(*entry), value );
+      if ( res_isav(*entry) ) {
+        res_av_push( *entry, value );
       }
       else {
         // A non-array entry, convert to array.
-        AV *ref = newAV();
-        av_push( ref, newSVsv(*entry) );
-        av_push( ref, value );
-        my_hv_store( mp4->tags, (char *)ckey, newRV_noinc( (SV*)ref ) );
+        resval *ref = res_newav();
+        res_av_push( ref, res_newsv(*entry) );
+        res_av_push( ref, value );
+        res_hv_store( mp4->tags, (char *)ckey, ref );
       }
     }
   }
   else {
-    my_hv_store( mp4->tags, (char *)ckey, value );
+    res_hv_store( mp4->tags, (char *)ckey, value );
   }
   
   return 1;
@@ -1844,7 +2663,7 @@ _mp4_parse_ilst_data(mp4info *mp4, uint32_t size, SV *key)
 uint8_t
 _mp4_parse_ilst_custom(mp4info *mp4, uint32_t size)
 {
-  SV *key = NULL;
+  resval *key = NULL;
   
   while (size) {
     char type[5];
@@ -1870,12 +2689,12 @@ _mp4_parse_ilst_custom(mp4info *mp4, uint32_t size)
       }
       
       buffer_consume(mp4->buf, 4); // padding
-      key = newSVpvn( buffer_ptr(mp4->buf), bsize - 12);
-      sv_utf8_decode(key);
-      upcase(SvPVX(key));
+      key = res_newpvn( buffer_ptr(mp4->buf), bsize - 12);
+      res_utf8_decode(key);
+      upcase(res_pv(key));
       buffer_consume(mp4->buf, bsize - 12);
       
-      DEBUG_TRACE("      %s\n", SvPVX(key));
+      DEBUG_TRACE("      %s\n", res_pv(key));
     }
     else if ( FOURCC_EQ(type, "data") ) {
       if (!key) {
@@ -1884,7 +2703,6 @@ _mp4_parse_ilst_custom(mp4info *mp4, uint32_t size)
       }
       
       if ( !_mp4_parse_ilst_data(mp4, bsize - 8, key) ) {
-        SvREFCNT_dec(key);
         return 0;
       }
     }
@@ -1900,37 +2718,36 @@ _mp4_parse_ilst_custom(mp4info *mp4, uint32_t size)
     size -= bsize;
   }
   
-  SvREFCNT_dec(key);
   
   return 1;
 }
 
-HV *
+resval *
 _mp4_get_current_trackinfo(mp4info *mp4)
 {
   // Return the trackinfo hash for track id == mp4->current_track
-  AV *tracks;
-  HV *trackinfo;
+  resval *tracks;
+  resval *trackinfo;
   int i;
   
-  SV **entry = my_hv_fetch(mp4->info, "tracks");
+  resval **entry = res_hv_fetch(mp4->info, "tracks");
   if (entry != NULL) {
-    tracks = (AV *)SvRV(*entry);
+    tracks = *entry;
   }
   else {
     return NULL;
   }
 
   // Find entry for this stream number
-  for (i = 0; av_len(tracks) >= 0 && i <= av_len(tracks); i++) {
-    SV **info = av_fetch(tracks, i, 0);
+  for (i = 0; res_av_len(tracks) >= 0 && i <= res_av_len(tracks); i++) {
+    resval **info = res_av_fetch(tracks, i);
     if (info != NULL) {
-      SV **tid;
+      resval **tid;
       
-      trackinfo = (HV *)SvRV(*info);        
-      tid = my_hv_fetch( trackinfo, "id" );
+      trackinfo = *info;        
+      tid = res_hv_fetch( trackinfo, "id" );
       if (tid != NULL) {
-        if ( SvIV(*tid) == mp4->current_track ) {
+        if ( res_iv(*tid) == mp4->current_track ) {
           return trackinfo;
         }
       }
@@ -1957,63 +2774,492 @@ _mp4_descr_length(Buffer *buf)
 }
 
 void
-_mp4_skip(mp4info *mp4, uint32_t size)
+_mp4_skip(mp4info *mp4, uint64_t size)
 {
   if ( buffer_len(mp4->buf) >= size ) {
     //buffer_dump(mp4->buf, size);
     buffer_consume(mp4->buf, size);
     
-    DEBUG_TRACE("  skipped buffer data size %d\n", size);
+    DEBUG_TRACE("  skipped buffer data size %llu\n", size);
   }
   else {
-    PerlIO_seek(mp4->infile, size - buffer_len(mp4->buf), SEEK_CUR);
+    scanio_seek(mp4->infile, size - buffer_len(mp4->buf), SEEK_CUR);
     buffer_clear(mp4->buf);
     
-    DEBUG_TRACE("  seeked past %d bytes to %d\n", size, (int)PerlIO_tell(mp4->infile));
+    DEBUG_TRACE("  seeked past %llu bytes to %llu\n", size, (uint64_t)scanio_tell(mp4->infile));
   }
 }
 
-uint32_t
-_mp4_samples_in_chunk(mp4info *mp4, uint32_t chunk)
+// Called at the first moof.  No more of the file is read if the duration
+// (mehd or sidx) is known and, when seeking, the fragment index (sidx or
+// mfra).  Otherwise every moof is read.
+static void
+_mp4_start_fragments(mp4info *mp4)
 {
-  int i;
+  mp4->fragmented = 1;
+  mp4->first_moof = mp4->audio_offset;
+  
+  DEBUG_TRACE("Fragmented file, first moof at %llu\n", mp4->first_moof);
+  
+  if ( mp4->frag_length_ms && (mp4->num_frags || !mp4->seeking) ) {
+    mp4->fragments_done = 1;
+    return;
+  }
+  
+  // The mfra at the end of the file has the index, and with the last
+  // fragment the duration
+  if ( !mp4->num_frags ) {
+    _mp4_parse_mfra(mp4);
+    
+    // Back to this moof
+    buffer_clear(mp4->buf);
+    scanio_seek(mp4->infile, mp4->audio_offset + mp4->hsize, SEEK_SET);
+  }
+  
+  if ( mp4->frag_length_ms && (mp4->num_frags || !mp4->seeking) ) {
+    mp4->fragments_done = 1;
+    return;
+  }
+  
+  if ( !mp4->num_frags ) {
+    mp4->frag_walk = 1;
+    mp4->frag_timescale = mp4->track_timescale;
+  }
+}
+
+// Fills in the info of a fragmented file once its boxes are read
+static void
+_mp4_finish_fragments(mp4info *mp4)
+{
+  uint64_t audio_size;
   
-  for (i = mp4->num_sample_to_chunks - 1; i >= 0; i--) {
-    if (mp4->sample_to_chunk[i].first_chunk <= chunk) {
-      return mp4->sample_to_chunk[i].samples_per_chunk;
+  if ( !mp4->frag_length_ms && mp4->track_timescale ) {
+    mp4->frag_length_ms = (mp4->frag_time * 1.0 / mp4->track_timescale) * 1000;
+  }
+  
+  if (mp4->frag_size) {
+    audio_size = mp4->frag_size;
+  }
+  else {
+    audio_size = (mp4->mfra_offset ? mp4->mfra_offset : mp4->file_size) - mp4->first_moof;
+  }
+  
+  DEBUG_TRACE("Fragments: %d in index, %d ms, %llu bytes\n", mp4->num_frags, mp4->frag_length_ms, audio_size);
+  
+  res_hv_store( mp4->info, "fragmented", res_newuv(1) );
+  res_hv_store( mp4->info, "song_length_ms", res_newuv(mp4->frag_length_ms) );
+  res_hv_store( mp4->info, "audio_offset", res_newuv(mp4->first_moof) );
+  res_hv_store( mp4->info, "audio_size", res_newuv(audio_size) );
+  mp4->audio_size = audio_size;
+  
+  // Bitrate from the size of the fragments, if esds didn't have it
+  if ( !res_hv_exists(mp4->info, "avg_bitrate") && mp4->frag_length_ms ) {
+    mp4->bitrate = _bitrate(audio_size, mp4->frag_length_ms);
+    res_hv_store( mp4->info, "avg_bitrate", res_newuv(mp4->bitrate) );
+  }
+}
+
+// Reads the tfra of the first track from the mfra found through the mfro
+// box that ends the file, and the duration from the last fragment if it
+// isn't known yet
+static int
+_mp4_parse_mfra(mp4info *mp4)
+{
+  uint32_t size;
+  uint64_t left;
+  
+  if ( mp4->file_size < mp4->first_moof + 16 ) {
+    return 0;
+  }
+  
+  buffer_clear(mp4->buf);
+  scanio_seek(mp4->infile, mp4->file_size - 16, SEEK_SET);
+  
+  if ( !_check_buf(mp4->infile, mp4->buf, 16, 16) ) {
+    return 0;
+  }
+  
+  if ( buffer_get_int(mp4->buf) != 16 || !FOURCC_EQ((char *)buffer_ptr(mp4->buf), "mfro") ) {
+    DEBUG_TRACE("No mfro box at the end of the file\n");
+    return 0;
+  }
+  
+  buffer_consume(mp4->buf, 8); // type, version/flags
+  size = buffer_get_int(mp4->buf);
+  
+  if ( size < 32 || size > mp4->file_size - mp4->first_moof ) {
+    return 0;
+  }
+  
+  buffer_clear(mp4->buf);
+  scanio_seek(mp4->infile, mp4->file_size - size, SEEK_SET);
+  
+  if ( !_check_buf(mp4->infile, mp4->buf, size, MP4_BLOCK_SIZE) ) {
+    return 0;
+  }
+  
+  if ( buffer_get_int(mp4->buf) != size || !FOURCC_EQ((char *)buffer_ptr(mp4->buf), "mfra") ) {
+    return 0;
+  }
+  
+  buffer_consume(mp4->buf, 4);
+  left = size - 8;
+  
+  while (left >= 8) {
+    uint32_t bsize = buffer_get_int(mp4->buf);
+    uint8_t tfra = FOURCC_EQ((char *)buffer_ptr(mp4->buf), "tfra");
+    
+    buffer_consume(mp4->buf, 4);
+    
+    if (bsize < 8 || bsize > left) {
+      break;
+    }
+    
+    left -= bsize;
+    
+    if (tfra && !mp4->num_frags)
+      _mp4_parse_tfra(mp4, bsize - 8);
+    else
+      buffer_consume(mp4->buf, bsize - 8);
+  }
+  
+  if ( !mp4->num_frags ) {
+    return 0;
+  }
+  
+  mp4->mfra_offset = mp4->file_size - size;
+  mp4->frag_timescale = mp4->track_timescale;
+  
+  // The duration is up to the end of the last fragment
+  if ( !mp4->frag_length_ms && mp4->track_timescale ) {
+    mp4frag *last = &mp4->frags[mp4->num_frags - 1];
+    uint64_t duration;
+    
+    buffer_clear(mp4->buf);
+    scanio_seek(mp4->infile, last->offset, SEEK_SET);
+    
+    if ( _check_buf(mp4->infile, mp4->buf, 8, MP4_BLOCK_SIZE) ) {
+      mp4->rsize = buffer_get_int(mp4->buf) - 8;
+      
+      if ( FOURCC_EQ((char *)buffer_ptr(mp4->buf), "moof") && mp4->rsize < mp4->file_size ) {
+        buffer_consume(mp4->buf, 4);
+        
+        if ( _mp4_parse_moof(mp4, &duration) ) {
+          mp4->frag_length_ms = ((last->time + duration) * 1.0 / mp4->track_timescale) * 1000;
+        }
+      }
     }
   }
   
-  return mp4->sample_to_chunk[0].samples_per_chunk;
+  return 1;
 }
 
-uint32_t
-_mp4_total_samples(mp4info *mp4)
+// Reads the random access points of the first track in a tfra
+static void
+_mp4_parse_tfra(mp4info *mp4, uint64_t size)
 {
-  int i;
-  uint32_t total = 0;
+  uint8_t version;
+  uint32_t track_id;
+  uint32_t lengths;
+  uint32_t count;
+  uint32_t entry_size;
+  uint64_t first_time = 0;
+  uint32_t i;
+  
+  if (size < 16) {
+    buffer_consume(mp4->buf, size);
+    return;
+  }
+  
+  version = buffer_get_char(mp4->buf);
+  buffer_consume(mp4->buf, 3); // flags
+  
+  track_id = buffer_get_int(mp4->buf);
+  lengths  = buffer_get_int(mp4->buf);
+  count    = buffer_get_int(mp4->buf);
+  
+  // time and moof_offset, then the traf, trun and sample numbers in 1 to 4
+  // bytes each
+  entry_size = (version == 1 ? 16 : 8)
+    + ((lengths >> 4) & 3) + 1
+    + ((lengths >> 2) & 3) + 1
+    + (lengths & 3) + 1;
+  
+  DEBUG_TRACE("  tfra track %d, %d entries\n", track_id, count);
+  
+  if ( (mp4->track_id && track_id != mp4->track_id) || (uint64_t)count * entry_size > size - 16 ) {
+    buffer_consume(mp4->buf, size - 16);
+    return;
+  }
+  
+  for (i = 0; i < count; i++) {
+    uint64_t time;
+    uint64_t offset;
+    
+    if (version == 1) {
+      time   = buffer_get_int64(mp4->buf);
+      offset = buffer_get_int64(mp4->buf);
+    }
+    else {
+      time   = buffer_get_int(mp4->buf);
+      offset = buffer_get_int(mp4->buf);
+    }
+    
+    buffer_consume(mp4->buf, entry_size - (version == 1 ? 16 : 8));
+    
+    if (i == 0)
+      first_time = time;
+    
+    // Points in the same fragment seek to the same moof
+    if ( mp4->num_frags && mp4->frags[mp4->num_frags - 1].offset == offset )
+      continue;
+    
+    _mp4_add_frag(mp4, time - first_time, offset);
+  }
   
-  for (i = 0; i < mp4->num_time_to_samples; i++) {
-    total += mp4->time_to_sample[i].sample_count;
+  buffer_consume(mp4->buf, size - 16 - count * entry_size);
+}
+
+static void
+_mp4_add_frag(mp4info *mp4, uint64_t time, uint64_t offset)
+{
+  if (mp4->num_frags == mp4->frags_alloc) {
+    mp4->frags_alloc = mp4->frags_alloc ? mp4->frags_alloc * 2 : 64;
+    Renew(mp4->frags, mp4->frags_alloc, mp4frag);
   }
   
-  return total;
+  mp4->frags[mp4->num_frags].time   = time;
+  mp4->frags[mp4->num_frags].offset = offset;
+  mp4->num_frags++;
 }
 
-uint32_t
-_mp4_get_sample_duration(mp4info *mp4, uint32_t sample)
+// Finds the last fragment starting at or before offset ms with a binary
+// search of the index.  The seek header is the ftyp and moov unchanged.
+static int
+_mp4_seek_fragment(mp4info *mp4, int offset, resval *info, seekwriter *w, uint64_t *file_offset)
 {
-  int i;
-  uint32_t co = 0;
+  uint64_t target;
+  uint32_t lo = 0;
+  uint32_t hi = mp4->num_frags;
+  
+  if ( !mp4->num_frags ) {
+    LOG_ERROR("find_frame: No fragment index: %s\n", mp4->file);
+    return 0;
+  }
+  
+  if ( offset < 0 || (uint32_t)offset >= mp4->frag_length_ms ) {
+    LOG_ERROR("find_frame: Offset out of range (%d >= %d)\n", offset, mp4->frag_length_ms);
+    return 0;
+  }
+  
+  target = (uint64_t)offset * mp4->frag_timescale / 1000;
+  
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    
+    if (mp4->frags[mid].time <= target)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  
+  *file_offset = mp4->frags[lo].offset;
+  
+  DEBUG_TRACE("Fragment %d at %llu, time %llu for %llu\n", lo, *file_offset, mp4->frags[lo].time, target);
   
-  for (i = 0; i < mp4->num_time_to_samples; i++) {
-    uint32_t delta = mp4->time_to_sample[i].sample_count;
-    if (sample < co + delta) {
-      return mp4->time_to_sample[i].sample_duration;
+  if (info) {
+    buffer_clear(mp4->buf);
+    scanio_seek(mp4->infile, 0, SEEK_SET);
+    
+    if ( !mp4->init_size || !_check_buf(mp4->infile, mp4->buf, mp4->init_size, MP4_BLOCK_SIZE) ) {
+      LOG_ERROR("find_frame: Unable to read header: %s\n", mp4->file);
+      return 0;
     }
     
-    co += delta;
+    res_hv_store( info, "seek_offset", res_newuv(*file_offset) );
+    
+    if (w) {
+      w->length = mp4->init_size;
+      res_hv_store( info, "seek_header_length", res_newuv(mp4->init_size) );
+      
+      if ( !w->write(w, (char *)buffer_ptr(mp4->buf), mp4->init_size) ) {
+        LOG_ERROR("find_frame: Unable to write seek header: %s\n", mp4->file);
+        return 0;
+      }
+    }
+    else {
+      res_hv_store( info, "seek_header", res_newpvn( (char *)buffer_ptr(mp4->buf), mp4->init_size ) );
+    }
   }
   
-  return 0;
+  return 1;
+}
+
+// Reads the sample tables noted by _mp4_read_box, a missing one is left
+// empty for mp4_seek to report
+static int
+_mp4_load_tables(mp4info *mp4)
+{
+  return _mp4_load_table(mp4, &mp4->stts_box, _mp4_parse_stts, "stts")
+      && _mp4_load_table(mp4, &mp4->stsc_box, _mp4_parse_stsc, "stsc")
+      && _mp4_load_table(mp4, &mp4->stsz_box, _mp4_parse_stsz, "stsz")
+      && _mp4_load_table(mp4, &mp4->stco_box, _mp4_parse_stco, mp4->co64 ? "co64" : "stco");
+}
+
+static int
+_mp4_load_table(mp4info *mp4, struct mp4tblbox *box, uint8_t (*parse)(mp4info *), char *type)
+{
+  if ( !box->offset )
+    return 1;
+  
+  DEBUG_TRACE("Loading %s at %llu, size %llu\n", type, box->offset, box->size);
+  
+  buffer_clear(mp4->buf);
+  
+  if ( scanio_seek(mp4->infile, box->offset, SEEK_SET) == -1 ) {
+    LOG_ERROR("Unable to seek to %s box: %s\n", type, mp4->file);
+    return 0;
+  }
+  
+  mp4->rsize = box->size;
+  
+  if ( !parse(mp4) ) {
+    LOG_ERROR("Invalid MP4 file (bad %s box): %s\n", type, mp4->file);
+    return 0;
+  }
+  
+  return 1;
+}
+
+// Appends an entry to a rewritten stsc, unless the chunk has the same
+// samples as the last entry
+static void
+_mp4_add_stc(struct stc *stsc, uint32_t *entries, uint32_t first_chunk, uint32_t samples_per_chunk)
+{
+  if (*entries && stsc[*entries - 1].samples_per_chunk == samples_per_chunk)
+    return;
+  
+  stsc[*entries].first_chunk = first_chunk;
+  stsc[*entries].samples_per_chunk = samples_per_chunk;
+  (*entries)++;
+}
+
+// Index of the last stts entry starting at or before time
+static uint32_t
+_mp4_find_tts_time(mp4info *mp4, uint64_t time)
+{
+  uint32_t lo = 0;
+  uint32_t hi = mp4->num_time_to_samples;
+  
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    
+    if (mp4->time_to_sample[mid].first_time <= time)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  
+  return lo;
+}
+
+// Index of the stts entry holding sample
+static uint32_t
+_mp4_find_tts(mp4info *mp4, uint32_t sample)
+{
+  uint32_t lo = 0;
+  uint32_t hi = mp4->num_time_to_samples;
+  
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    
+    if (mp4->time_to_sample[mid].first_sample <= sample)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  
+  return lo;
+}
+
+// Index of the stsc entry holding sample
+static uint32_t
+_mp4_find_stc(mp4info *mp4, uint32_t sample)
+{
+  uint32_t lo = 0;
+  uint32_t hi = mp4->num_sample_to_chunks;
+  
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    
+    if (mp4->sample_to_chunk[mid].first_sample <= sample)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  
+  return lo;
+}
+
+// Index of the stsc entry holding chunk
+static uint32_t
+_mp4_find_stc_chunk(mp4info *mp4, uint32_t chunk)
+{
+  uint32_t lo = 0;
+  uint32_t hi = mp4->num_sample_to_chunks;
+  
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    
+    if (mp4->sample_to_chunk[mid].first_chunk <= chunk)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  
+  return lo;
+}
+
+uint32_t
+_mp4_samples_in_chunk(mp4info *mp4, uint32_t chunk)
+{
+  return mp4->sample_to_chunk[ _mp4_find_stc_chunk(mp4, chunk) ].samples_per_chunk;
+}
+
+uint32_t
+_mp4_total_samples(mp4info *mp4)
+{
+  return mp4->total_samples;
+}
+
+uint32_t
+_mp4_get_sample_duration(mp4info *mp4, uint32_t sample)
+{
+  struct tts *entry;
+  
+  if (sample >= mp4->total_samples)
+    return 0;
+  
+  entry = &mp4->time_to_sample[ _mp4_find_tts(mp4, sample) ];
+  
+  return entry->sample_duration;
+}
+
+uint32_t
+_mp4_get_sample_size(mp4info *mp4, uint32_t sample)
+{
+  uint8_t *p = mp4->sample_byte_size + sample * mp4->sample_size_width;
+  
+  switch (mp4->sample_size_width) {
+    case 0:
+      return mp4->sample_size;
+    case 1:
+      return p[0];
+    case 2:
+      return (p[0] << 8) | p[1];
+    case 3:
+      return (p[0] << 16) | (p[1] << 8) | p[2];
+    default:
+      return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+  }
 }
@@ -264,7 +264,7 @@ _mpc_read_header_sv7(mpc_streaminfo *si)
 }
 
 static int
-get_mpcfileinfo(PerlIO *infile, char *file, HV *info)
+get_mpcfileinfo(ScanIO *infile, char *file, resval *info)
 {
   Buffer buf;
   int32_t ret = 0;
@@ -280,13 +280,13 @@ get_mpcfileinfo(PerlIO *infile, char *file, HV *info)
 
   // get header position
   if ((si->header_position = skip_id3v2(infile)) < 0) {
-    PerlIO_printf(PerlIO_stderr(), "Musepack: [Couldn't skip ID3v2]: %s\n", file);
+    LOG_ERROR("Musepack: [Couldn't skip ID3v2]: %s\n", file);
     goto out;
   }
 
   // seek to first byte of mpc data
-  if (PerlIO_seek(infile, si->header_position, SEEK_SET) < 0) {
-    PerlIO_printf(PerlIO_stderr(), "Musepack: [Couldn't seek to offset %d]: %s\n", si->header_position, file);
+  if (scanio_seek(infile, si->header_position, SEEK_SET) < 0) {
+    LOG_ERROR("Musepack: [Couldn't seek to offset %d]: %s\n", si->header_position, file);
     goto out;
   }
 
@@ -294,12 +294,12 @@ get_mpcfileinfo(PerlIO *infile, char *file, HV *info)
     goto out;
   }
 
-  if (PerlIO_seek(infile, si->header_position + 6 * 4, SEEK_SET) < 0) {
-    PerlIO_printf(PerlIO_stderr(), "Musepack: [Couldn't seek to offset %d + (6*4)]: %s\n", si->header_position, file);
+  if (scanio_seek(infile, si->header_position + 6 * 4, SEEK_SET) < 0) {
+    LOG_ERROR("Musepack: [Couldn't seek to offset %d + (6*4)]: %s\n", si->header_position, file);
     goto out;
   }
 
-  si->tag_offset = PerlIO_tell(infile);
+  si->tag_offset = scanio_tell(infile);
 
   si->total_file_length = _file_size(infile);
 
@@ -322,7 +322,7 @@ get_mpcfileinfo(PerlIO *infile, char *file, HV *info)
     ret = _mpc_read_header_sv8(si);
   }
   else {
-    PerlIO_printf(PerlIO_stderr(), "Not a Musepack SV7 or SV8 file: %s\n", file);
+    LOG_ERROR("Not a Musepack SV7 or SV8 file: %s\n", file);
     goto out;
   }
 
@@ -333,23 +333,23 @@ get_mpcfileinfo(PerlIO *infile, char *file, HV *info)
   if (ret == 0) {
     double total_seconds = (double)( (si->pcm_samples * 1.0) / si->sample_freq);
 
-    my_hv_store(info, "stream_version", newSVuv(si->stream_version));
-    my_hv_store(info, "samplerate", newSViv(si->sample_freq));
-    my_hv_store(info, "channels", newSViv(si->channels));
-    my_hv_store(info, "song_length_ms", newSVuv(total_seconds * 1000));
-    my_hv_store(info, "bitrate", newSVuv(8 * (double)(si->total_file_length - si->tag_offset) / total_seconds));
+    res_hv_store(info, "stream_version", res_newuv(si->stream_version));
+    res_hv_store(info, "samplerate", res_newiv(si->sample_freq));
+    res_hv_store(info, "channels", res_newiv(si->channels));
+    res_hv_store(info, "song_length_ms", res_newuv(total_seconds * 1000));
+    res_hv_store(info, "bitrate", res_newuv(8 * (double)(si->total_file_length - si->tag_offset) / total_seconds));
 
-    my_hv_store(info, "audio_offset", newSVuv(si->tag_offset));
-    my_hv_store(info, "audio_size", newSVuv(si->total_file_length - si->tag_offset));
-    my_hv_store(info, "file_size", newSVuv(si->total_file_length));
-    my_hv_store(info, "encoder", newSVpv(si->encoder, 0));
+    res_hv_store(info, "audio_offset", res_newuv(si->tag_offset));
+    res_hv_store(info, "audio_size", res_newuv(si->total_file_length - si->tag_offset));
+    res_hv_store(info, "file_size", res_newuv(si->total_file_length));
+    res_hv_store(info, "encoder", res_newpv(si->encoder, 0));
 
     if (si->profile_name)
-      my_hv_store(info, "profile", newSVpv(si->profile_name, 0));
+      res_hv_store(info, "profile", res_newpv(si->profile_name, 0));
 
-    my_hv_store(info, "gapless", newSViv(si->is_true_gapless));
-    my_hv_store(info, "track_gain", newSVpvf("%2.2f dB", si->gain_title == 0 ? 0 : MPC_OLD_GAIN_REF - si->gain_title / 256.0));
-    my_hv_store(info, "album_gain", newSVpvf("%2.2f dB", si->gain_album == 0 ? 0 : MPC_OLD_GAIN_REF - si->gain_album / 256.0));
+    res_hv_store(info, "gapless", res_newiv(si->is_true_gapless));
+    res_hv_store(info, "track_gain", res_newpvf("%2.2f dB", si->gain_title == 0 ? 0 : MPC_OLD_GAIN_REF - si->gain_title / 256.0));
+    res_hv_store(info, "album_gain", res_newpvf("%2.2f dB", si->gain_album == 0 ? 0 : MPC_OLD_GAIN_REF - si->gain_album / 256.0));
   }
 
 out:
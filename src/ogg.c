@@ -17,13 +17,13 @@
 #include "ogg.h"
 
 int
-get_ogg_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
+get_ogg_metadata(ScanIO *infile, char *file, resval *info, resval *tags)
 {
   return _ogg_parse(infile, file, info, tags, 0);
 }
 
 int
-_ogg_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
+_ogg_parse(ScanIO *infile, char *file, resval *info, resval *tags, uint8_t seeking)
 {
   Buffer ogg_buf, vorbis_buf;
   unsigned char *bptr;
@@ -63,7 +63,7 @@ _ogg_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
   buffer_init(&vorbis_buf, 0);
 
   file_size = _file_size(infile);
-  my_hv_store( info, "file_size", newSVuv(file_size) );
+  res_hv_store( info, "file_size", res_newuv(file_size) );
 
   if ( !_check_buf(infile, &ogg_buf, 10, OGG_BLOCK_SIZE) ) {
     err = -1;
@@ -91,7 +91,7 @@ _ogg_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
 
     DEBUG_TRACE("Skipping ID3v2 tag of size %d\n", id3_size);
 
-    PerlIO_seek(infile, id3_size, SEEK_SET);
+    scanio_seek(infile, id3_size, SEEK_SET);
   }
 
   while (1) {
@@ -107,7 +107,7 @@ _ogg_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
 
     // check that the first four bytes are 'OggS'
     if ( ogghdr[0] != 'O' || ogghdr[1] != 'g' || ogghdr[2] != 'g' || ogghdr[3] != 'S' ) {
-      PerlIO_printf(PerlIO_stderr(), "Not an Ogg file (bad OggS header): %s\n", file);
+      LOG_ERROR("Not an Ogg file (bad OggS header): %s\n", file);
       goto out;
     }
 
@@ -200,7 +200,7 @@ _ogg_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
 
     // Still don't have enough data, must have reached the end of the file
     if ( buffer_len(&ogg_buf) < pagelen ) {
-      PerlIO_printf(PerlIO_stderr(), "Premature end of file: %s\n", file);
+      LOG_ERROR("Premature end of file: %s\n", file);
 
       err = -1;
       goto out;
@@ -217,7 +217,7 @@ _ogg_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
       vorbis_type = buffer_get_char(&vorbis_buf);
       // Verify 'vorbis' string
       if ( strncmp( buffer_ptr(&vorbis_buf), "vorbis", 6 ) ) {
-        PerlIO_printf(PerlIO_stderr(), "Not a Vorbis file (bad vorbis header): %s\n", file);
+        LOG_ERROR("Not a Vorbis file (bad vorbis header): %s\n", file);
         goto out;
       }
       buffer_consume( &vorbis_buf, 6 );
@@ -229,29 +229,29 @@ _ogg_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
       // Parse info
       // Grab 23-byte Vorbis header
       if ( buffer_len(&vorbis_buf) < 23 ) {
-        PerlIO_printf(PerlIO_stderr(), "Not a Vorbis file (bad vorbis header): %s\n", file);
+        LOG_ERROR("Not a Vorbis file (bad vorbis header): %s\n", file);
         goto out;
       }
 
       buffer_get(&vorbis_buf, vorbishdr, 23);
 
-      my_hv_store( info, "version", newSViv( CONVERT_INT32LE(vorbishdr) ) );
+      res_hv_store( info, "version", res_newiv( CONVERT_INT32LE(vorbishdr) ) );
 
       channels = vorbishdr[4];
-      my_hv_store( info, "channels", newSViv(channels) );
-      my_hv_store( info, "stereo", newSViv( channels == 2 ? 1 : 0 ) );
+      res_hv_store( info, "channels", res_newiv(channels) );
+      res_hv_store( info, "stereo", res_newiv( channels == 2 ? 1 : 0 ) );
 
       samplerate = CONVERT_INT32LE((vorbishdr+5));
-      my_hv_store( info, "samplerate", newSViv(samplerate) );
-      my_hv_store( info, "bitrate_upper", newSViv( CONVERT_INT32LE((vorbishdr+9)) ) );
+      res_hv_store( info, "samplerate", res_newiv(samplerate) );
+      res_hv_store( info, "bitrate_upper", res_newiv( CONVERT_INT32LE((vorbishdr+9)) ) );
 
       bitrate_nominal = CONVERT_INT32LE((vorbishdr+13));
-      my_hv_store( info, "bitrate_nominal", newSViv(bitrate_nominal) );
-      my_hv_store( info, "bitrate_lower", newSViv( CONVERT_INT32LE((vorbishdr+17)) ) );
+      res_hv_store( info, "bitrate_nominal", res_newiv(bitrate_nominal) );
+      res_hv_store( info, "bitrate_lower", res_newiv( CONVERT_INT32LE((vorbishdr+17)) ) );
 
       blocksize_0 = 2 << ((vorbishdr[21] & 0xF0) >> 4);
-      my_hv_store( info, "blocksize_0", newSViv( blocksize_0 ) );
-      my_hv_store( info, "blocksize_1", newSViv( 2 << (vorbishdr[21] & 0x0F) ) );
+      res_hv_store( info, "blocksize_0", res_newiv( blocksize_0 ) );
+      res_hv_store( info, "blocksize_1", res_newiv( 2 << (vorbishdr[21] & 0x0F) ) );
 
       DEBUG_TRACE("  parsed vorbis info header\n");
 
@@ -269,30 +269,30 @@ _ogg_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
   audio_offset -= 28;
 
   // from the first packet past the comments
-  my_hv_store( info, "audio_offset", newSViv(audio_offset) );
+  res_hv_store( info, "audio_offset", res_newiv(audio_offset) );
 
   audio_size = file_size - audio_offset;
-  my_hv_store( info, "audio_size", newSVuv(audio_size) );
+  res_hv_store( info, "audio_size", res_newuv(audio_size) );
 
-  my_hv_store( info, "serial_number", newSVuv(serialno) );
+  res_hv_store( info, "serial_number", res_newuv(serialno) );
 
   // calculate average bitrate and duration
   avg_buf_size = blocksize_0 * 2;
   if ( file_size > avg_buf_size ) {
     DEBUG_TRACE("Seeking to %d to calculate bitrate/duration\n", (int)(file_size - avg_buf_size));
-    PerlIO_seek(infile, file_size - avg_buf_size, SEEK_SET);
+    scanio_seek(infile, file_size - avg_buf_size, SEEK_SET);
   }
   else {
     DEBUG_TRACE("Seeking to %d to calculate bitrate/duration\n", (int)audio_offset);
-    PerlIO_seek(infile, audio_offset, SEEK_SET);
+    scanio_seek(infile, audio_offset, SEEK_SET);
   }
 
-  if ( PerlIO_read(infile, buffer_append_space(&ogg_buf, avg_buf_size), avg_buf_size) == 0 ) {
-    if ( PerlIO_error(infile) ) {
-      PerlIO_printf(PerlIO_stderr(), "Error reading: %s\n", strerror(errno));
+  if ( scanio_read(infile, buffer_append_space(&ogg_buf, avg_buf_size), avg_buf_size) == 0 ) {
+    if ( scanio_error(infile) ) {
+      LOG_ERROR("Error reading: %s\n", strerror(errno));
     }
     else {
-      PerlIO_printf(PerlIO_stderr(), "File too small. Probably corrupted.\n");
+      LOG_ERROR("File too small. Probably corrupted.\n");
     }
 
     err = -1;
@@ -302,22 +302,21 @@ _ogg_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
   // Find sync
   bptr = (unsigned char *)buffer_ptr(&ogg_buf);
   buf_size = buffer_len(&ogg_buf);
-  while (
-    buf_size >= 14
-    && (bptr[0] != 'O' || bptr[1] != 'g' || bptr[2] != 'g' || bptr[3] != 'S')
-  ) {
-    bptr++;
-    buf_size--;
-
-    if ( buf_size < 14 ) {
+  if ( buf_size >= 14 ) {
+    unsigned char *sync = (unsigned char *)syncscan_find(bptr, buf_size - 10, &syncscan_ogg);
+    
+    if ( !sync ) {
       // Give up, use less accurate bitrate for length
-      DEBUG_TRACE("buf_size %d, using less accurate bitrate for length\n", buf_size);
+      DEBUG_TRACE("No sync found, using less accurate bitrate for length\n");
 
-      my_hv_store( info, "song_length_ms", newSVpvf( "%d", (int)((audio_size * 8) / bitrate_nominal) * 1000) );
-      my_hv_store( info, "bitrate_average", newSViv(bitrate_nominal) );
+      res_hv_store( info, "song_length_ms", res_newpvf( "%d", (int)((audio_size * 8) / bitrate_nominal) * 1000) );
+      res_hv_store( info, "bitrate_average", res_newiv(bitrate_nominal) );
 
       goto out;
     }
+    
+    buf_size -= sync - bptr;
+    bptr = sync;
   }
   bptr += 6;
 
@@ -334,15 +333,15 @@ _ogg_parse(PerlIO *infile, char *file, HV *info, HV *tags, uint8_t seeking)
   if ( granule_pos && samplerate && serialno == final_serialno ) {
     // XXX: needs to adjust for initial granule value if file does not start at 0 samples
     int length = (int)((granule_pos * 1.0 / samplerate) * 1000);
-    my_hv_store( info, "song_length_ms", newSVuv(length) );
-    my_hv_store( info, "bitrate_average", newSVuv( _bitrate(audio_size, length) ) );
+    res_hv_store( info, "song_length_ms", res_newuv(length) );
+    res_hv_store( info, "bitrate_average", res_newuv( _bitrate(audio_size, length) ) );
 
     DEBUG_TRACE("Using granule_pos %llu / samplerate %d to calculate bitrate/duration\n", granule_pos, samplerate);
   }
   else {
     // Use nominal bitrate
-    my_hv_store( info, "song_length_ms", newSVpvf( "%d", (int)((audio_size * 8) / bitrate_nominal) * 1000) );
-    my_hv_store( info, "bitrate_average", newSVuv(bitrate_nominal) );
+    res_hv_store( info, "song_length_ms", res_newpvf( "%d", (int)((audio_size * 8) / bitrate_nominal) * 1000) );
+    res_hv_store( info, "bitrate_average", res_newuv(bitrate_nominal) );
 
     DEBUG_TRACE("Using nominal bitrate for average\n");
   }
@@ -357,19 +356,19 @@ out:
 }
 
 void
-_parse_vorbis_comments(PerlIO *infile, Buffer *vorbis_buf, HV *tags, int has_framing)
+_parse_vorbis_comments(ScanIO *infile, Buffer *vorbis_buf, resval *tags, int has_framing)
 {
   unsigned int len;
   unsigned int num_comments;
   char *tmp;
   char *bptr;
-  SV *vendor;
+  resval *vendor;
 
   // Vendor string
   len = buffer_get_int_le(vorbis_buf);
-  vendor = newSVpvn( buffer_ptr(vorbis_buf), len );
-  sv_utf8_decode(vendor);
-  my_hv_store( tags, "VENDOR", vendor );
+  vendor = res_newpvn( buffer_ptr(vorbis_buf), len );
+  res_utf8_decode(vendor);
+  res_hv_store( tags, "VENDOR", vendor );
   buffer_consume(vorbis_buf, len);
 
   // Number of comments
@@ -394,8 +393,8 @@ _parse_vorbis_comments(PerlIO *infile, Buffer *vorbis_buf, HV *tags, int has_fra
 #endif
     ) {
       // parse METADATA_BLOCK_PICTURE according to http://wiki.xiph.org/VorbisComment#METADATA_BLOCK_PICTURE
-      AV *pictures;
-      HV *picture;
+      resval *pictures;
+      resval *picture;
       Buffer pic_buf;
       uint32_t pic_length;
 
@@ -410,24 +409,24 @@ _parse_vorbis_comments(PerlIO *infile, Buffer *vorbis_buf, HV *tags, int has_fra
 
       picture = _decode_flac_picture(infile, &pic_buf, &pic_length);
       if ( !picture ) {
-        PerlIO_printf(PerlIO_stderr(), "Invalid Vorbis METADATA_BLOCK_PICTURE comment\n");
+        LOG_ERROR("Invalid Vorbis METADATA_BLOCK_PICTURE comment\n");
       }
       else {
         DEBUG_TRACE("  found picture of length %d\n", pic_length);
 
-        if ( my_hv_exists(tags, "ALLPICTURES") ) {
-          SV **entry = my_hv_fetch(tags, "ALLPICTURES");
+        if ( res_hv_exists(tags, "ALLPICTURES") ) {
+          resval **entry = res_hv_fetch(tags, "ALLPICTURES");
           if (entry != NULL) {
-            pictures = (AV *)SvRV(*entry);
-            av_push( pictures, newRV_noinc( (SV *)picture ) );
+            pictures = *entry;
+            res_av_push( pictures, picture );
           }
         }
         else {
-          pictures = newAV();
+          pictures = res_newav();
 
-          av_push( pictures, newRV_noinc( (SV *)picture ) );
+          res_av_push( pictures, picture );
 
-          my_hv_store( tags, "ALLPICTURES", newRV_noinc( (SV *)pictures ) );
+          res_hv_store( tags, "ALLPICTURES", pictures );
         }
       }
 
@@ -441,46 +440,47 @@ _parse_vorbis_comments(PerlIO *infile, Buffer *vorbis_buf, HV *tags, int has_fra
 #endif
     ) {
       // decode COVERART into ALLPICTURES
-      AV *pictures;
-      HV *picture = newHV();
+      resval *pictures;
+      resval *picture = res_newhv();
 
       // Fill in recommended default values for most of the picture hash
-      my_hv_store( picture, "color_index", newSVuv(0) );
-      my_hv_store( picture, "depth", newSVuv(0) );
-      my_hv_store( picture, "description", newSVpvn("", 0) );
-      my_hv_store( picture, "height", newSVuv(0) );
-      my_hv_store( picture, "width", newSVuv(0) );
-      my_hv_store( picture, "mime_type", newSVpvn("image/", 6) ); // As recommended, real mime should be in COVERARTMIME
-      my_hv_store( picture, "picture_type", newSVuv(0) ); // Other
+      res_hv_store( picture, "color_index", res_newuv(0) );
+      res_hv_store( picture, "depth", res_newuv(0) );
+      res_hv_store( picture, "description", res_newpvn("", 0) );
+      res_hv_store( picture, "height", res_newuv(0) );
+      res_hv_store( picture, "width", res_newuv(0) );
+      res_hv_store( picture, "mime_type", res_newpvn("image/", 6) ); // As recommended, real mime should be in COVERARTMIME
+      res_hv_store( picture, "picture_type", res_newuv(0) ); // Other
 
       if ( _env_true("AUDIO_SCAN_NO_ARTWORK") ) {
-        my_hv_store( picture, "image_data", newSVuv(len - 9) );
+        res_hv_store( picture, "image_data", res_newuv(len - 9) );
         buffer_consume(vorbis_buf, len);
       }
       else {
         int pic_length;
 
         buffer_consume(vorbis_buf, 9);
+        buffer_unview(vorbis_buf); // decoded in place
         pic_length = _decode_base64( buffer_ptr(vorbis_buf) );
         DEBUG_TRACE("  found picture of length %d\n", pic_length);
 
-        my_hv_store( picture, "image_data", newSVpvn( buffer_ptr(vorbis_buf), pic_length ) );
+        res_hv_store( picture, "image_data", res_newblob( buffer_ptr(vorbis_buf), pic_length ) );
         buffer_consume(vorbis_buf, len - 9);
       }
 
-      if ( my_hv_exists(tags, "ALLPICTURES") ) {
-        SV **entry = my_hv_fetch(tags, "ALLPICTURES");
+      if ( res_hv_exists(tags, "ALLPICTURES") ) {
+        resval **entry = res_hv_fetch(tags, "ALLPICTURES");
         if (entry != NULL) {
-          pictures = (AV *)SvRV(*entry);
-          av_push( pictures, newRV_noinc( (SV *)picture ) );
+          pictures = *entry;
+          res_av_push( pictures, picture );
         }
       }
       else {
-        pictures = newAV();
+        pictures = res_newav();
 
-        av_push( pictures, newRV_noinc( (SV *)picture ) );
+        res_av_push( pictures, picture );
 
-        my_hv_store( tags, "ALLPICTURES", newRV_noinc( (SV *)pictures ) );
+        res_hv_store( tags, "ALLPICTURES", pictures );
       }
     }
     else {
@@ -500,44 +500,90 @@ _parse_vorbis_comments(PerlIO *infile, Buffer *vorbis_buf, HV *tags, int has_fra
   }
 }
 
-static int
-ogg_find_frame(PerlIO *infile, char *file, int offset)
+static off_t
+ogg_find_frame(ScanIO *infile, char *file, int offset)
+{
+  void *ogg = ogg_seek_open(infile, file);
+  off_t frame_offset = ogg_seek(ogg, offset, NULL);
+  
+  ogg_seek_close(ogg);
+  
+  return frame_offset;
+}
+
+// We need to read all metadata first to get some data we need to calculate
+static void *
+ogg_seek_open(ScanIO *infile, char *file)
+{
+  oggseek *ogg;
+  resval *info = res_newhv();
+  resval *tags = res_newhv();
+  
+  Newz(0, ogg, sizeof(oggseek), oggseek);
+  ogg->infile = infile;
+  ogg->file   = file;
+  
+  if ( _ogg_parse(infile, file, info, tags, 1) == 0 ) {
+    ogg->info = info;
+  }
+  
+  return ogg;
+}
+
+static void
+ogg_seek_close(void *state)
+{
+  Safefree(state);
+}
+
+static off_t
+ogg_seek(void *state, int offset, resval *info)
 {
+  oggseek *ogg = (oggseek *)state;
   int frame_offset = -1;
   uint32_t samplerate;
   uint32_t song_length_ms;
   uint64_t target_sample;
 
-  // We need to read all metadata first to get some data we need to calculate
-  HV *info = newHV();
-  HV *tags = newHV();
-  if ( _ogg_parse(infile, file, info, tags, 1) != 0 ) {
+  if ( !ogg->info ) {
     goto out;
   }
 
-  song_length_ms = SvIV( *(my_hv_fetch( info, "song_length_ms" )) );
+  song_length_ms = res_iv( *(res_hv_fetch( ogg->info, "song_length_ms" )) );
   if (offset >= song_length_ms) {
     goto out;
   }
 
-  samplerate = SvIV( *(my_hv_fetch( info, "samplerate" )) );
+  samplerate = res_iv( *(res_hv_fetch( ogg->info, "samplerate" )) );
 
   // Determine target sample we're looking for
   target_sample = ((offset - 1) / 10) * (samplerate / 100);
   DEBUG_TRACE("Looking for target sample %llu\n", target_sample);
 
-  frame_offset = _ogg_binary_search_sample(infile, file, info, target_sample);
+  // Samples at or after the last one found can't be before the page preceding it
+  if (target_sample < ogg->hint_sample) {
+    ogg->hint_offset = 0;
+  }
+  
+  frame_offset = _ogg_binary_search_sample(ogg->infile, ogg->file, ogg->info, target_sample, &ogg->hint_offset);
+  
+  if (frame_offset == -1 && ogg->hint_offset) {
+    ogg->hint_offset = 0;
+    frame_offset = _ogg_binary_search_sample(ogg->infile, ogg->file, ogg->info, target_sample, &ogg->hint_offset);
+  }
+  
+  ogg->hint_sample = target_sample;
 
 out:
-  // Don't leak
-  SvREFCNT_dec(info);
-  SvREFCNT_dec(tags);
 
   return frame_offset;
 }
 
+// start is where the search begins, 0 for the first audio page.  When the
+// frame is found it is moved to the page before it, where a search for a
+// later sample may start.
 int
-_ogg_binary_search_sample(PerlIO *infile, char *file, HV *info, uint64_t target_sample)
+_ogg_binary_search_sample(ScanIO *infile, char *file, resval *info, uint64_t target_sample, off_t *start)
 {
   Buffer buf;
   unsigned char *bptr;
@@ -552,12 +598,12 @@ _ogg_binary_search_sample(PerlIO *infile, char *file, HV *info, uint64_t target_
   off_t mid;
   int i;
 
-  off_t audio_offset = SvIV( *(my_hv_fetch( info, "audio_offset" )) );
-  off_t file_size    = SvIV( *(my_hv_fetch( info, "file_size" )) );
-  uint32_t serialno  = SvIV( *(my_hv_fetch( info, "serial_number" )) );
+  off_t audio_offset = res_iv( *(res_hv_fetch( info, "audio_offset" )) );
+  off_t file_size    = res_iv( *(res_hv_fetch( info, "file_size" )) );
+  uint32_t serialno  = res_iv( *(res_hv_fetch( info, "serial_number" )) );
 
   // Binary search the entire file
-  low  = audio_offset;
+  low  = *start > audio_offset ? *start : audio_offset;
   high = file_size;
 
   // We need enough for at least 2 packets
@@ -576,7 +622,7 @@ _ogg_binary_search_sample(PerlIO *infile, char *file, HV *info, uint64_t target_
       goto out;
     }
 
-    if ( (PerlIO_seek(infile, mid, SEEK_SET)) == -1 ) {
+    if ( (scanio_seek(infile, mid, SEEK_SET)) == -1 ) {
       frame_offset = -1;
       goto out;
     }
@@ -596,13 +642,11 @@ _ogg_binary_search_sample(PerlIO *infile, char *file, HV *info, uint64_t target_
       prev_frame_offset = frame_offset;
       prev_granule_pos  = granule_pos;
 
-      while (
-        buf_size >= 4
-        &&
-        (bptr[0] != 'O' || bptr[1] != 'g' || bptr[2] != 'g' || bptr[3] != 'S')
-      ) {
-        bptr++;
-        buf_size--;
+      if (buf_size >= 4) {
+        unsigned char *sync = (unsigned char *)syncscan_find(bptr, buf_size, &syncscan_ogg);
+        
+        buf_size = sync ? buf_size - (sync - bptr) : 0;
+        bptr = sync;
       }
 
       if (buf_size < 4) {
@@ -656,6 +700,9 @@ _ogg_binary_search_sample(PerlIO *infile, char *file, HV *info, uint64_t target_
     if ((prev_granule_pos + 1) <= target_sample && granule_pos >= target_sample) {
       // found frame
       DEBUG_TRACE("  found frame at %d\n", frame_offset);
+      if (prev_granule_pos && prev_frame_offset > *start) {
+        *start = prev_frame_offset;
+      }
       goto out;
     }
 
@@ -0,0 +1,975 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "result.h"
+
+#include <stdarg.h>
+
+// Arena blocks, and strings at least this big get their own allocation
+#define RES_BLOCK_SIZE 16384
+#define RES_BIG_SIZE   1024
+
+#ifdef _MSC_VER
+# define RES_THREAD __declspec(thread)
+#else
+# define RES_THREAD __thread
+#endif
+
+// Memory is managed with plain malloc/free, Perl's allocator may need an
+// interpreter context which worker threads don't have
+
+struct resblock {
+  resblock *next;
+};
+
+struct resbig {
+  resbig *prev;
+  resbig *next;
+};
+
+static RES_THREAD ScanResult *res_cur = NULL;
+
+void
+result_init(ScanResult *r)
+{
+  memset(r, 0, sizeof(ScanResult));
+}
+
+void
+result_free(ScanResult *r)
+{
+  while (r->blocks) {
+    resblock *next = r->blocks->next;
+    free(r->blocks);
+    r->blocks = next;
+  }
+
+  while (r->bigs) {
+    resbig *next = r->bigs->next;
+    free(r->bigs);
+    r->bigs = next;
+  }
+
+  r->next = NULL;
+  r->left = 0;
+  r->warnings = NULL;
+}
+
+// Makes r the result that res_* calls on this thread allocate from, until
+// result_leave restores the previous one
+void
+result_enter(ScanResult *r)
+{
+  r->prev = res_cur;
+  res_cur = r;
+}
+
+void
+result_leave(ScanResult *r)
+{
+  if (res_cur == r)
+    res_cur = r->prev;
+}
+
+ScanResult *
+result_current(void)
+{
+  return res_cur;
+}
+
+static void *
+_res_alloc(size_t size)
+{
+  ScanResult *r = res_cur;
+  void *p;
+
+  size = (size + 7) & ~7;
+
+  if (size > r->left) {
+    size_t bsize = RES_BLOCK_SIZE;
+    resblock *b;
+
+    if (size + sizeof(resblock) > bsize)
+      bsize = size + sizeof(resblock);
+
+    if ( (b = (resblock *)malloc(bsize)) == NULL )
+      res_croak("Audio::Scan out of memory");
+
+    b->next = r->blocks;
+    r->blocks = b;
+    r->next = (char *)b + ((sizeof(resblock) + 7) & ~7);
+    r->left = bsize - (r->next - (char *)b);
+  }
+
+  p = r->next;
+  r->next += size;
+  r->left -= size;
+
+  return p;
+}
+
+static char *
+_res_big_alloc(size_t size)
+{
+  ScanResult *r = res_cur;
+  resbig *b = (resbig *)malloc(sizeof(resbig) + size);
+
+  if (b == NULL)
+    res_croak("Audio::Scan out of memory");
+
+  b->prev = NULL;
+  b->next = r->bigs;
+  if (r->bigs)
+    r->bigs->prev = b;
+  r->bigs = b;
+
+  return (char *)(b + 1);
+}
+
+static void
+_res_big_free(char *p)
+{
+  ScanResult *r = res_cur;
+  resbig *b = (resbig *)p - 1;
+
+  if (b->prev)
+    b->prev->next = b->next;
+  else
+    r->bigs = b->next;
+
+  if (b->next)
+    b->next->prev = b->prev;
+
+  free(b);
+}
+
+// Makes room for len bytes plus a NUL in a string value
+static void
+_res_grow(resval *v, size_t len)
+{
+  char *pv;
+  size_t cap;
+
+  if (len < v->cap)
+    return;
+
+  cap = v->cap ? v->cap * 2 : 16;
+  if (cap <= len)
+    cap = len + 1;
+
+  if (cap >= RES_BIG_SIZE) {
+    pv = _res_big_alloc(cap);
+  }
+  else {
+    pv = (char *)_res_alloc(cap);
+  }
+
+  if (v->len)
+    memcpy(pv, v->u.pv, v->len);
+  pv[v->len] = '\0';
+
+  // Small strings stay in the arena until the whole result is freed
+  if (v->cap >= RES_BIG_SIZE)
+    _res_big_free(v->u.pv);
+
+  v->u.pv = pv;
+  v->cap = cap;
+}
+
+static resval *
+_res_new(uint8_t type)
+{
+  resval *v = (resval *)_res_alloc(sizeof(resval));
+
+  memset(v, 0, sizeof(resval));
+  v->type = type;
+
+  return v;
+}
+
+resval *
+res_newundef(void)
+{
+  return _res_new(RES_UNDEF);
+}
+
+resval *
+res_newiv(int64_t iv)
+{
+  resval *v = _res_new(RES_IV);
+  v->u.iv = iv;
+  return v;
+}
+
+resval *
+res_newuv(uint64_t uv)
+{
+  resval *v = _res_new(RES_UV);
+  v->u.uv = uv;
+  return v;
+}
+
+resval *
+res_newnv(double nv)
+{
+  resval *v = _res_new(RES_NV);
+  v->u.nv = nv;
+  return v;
+}
+
+// Like newSVpv, len 0 means use strlen
+resval *
+res_newpv(const char *s, size_t len)
+{
+  if (!len && s)
+    len = strlen(s);
+
+  return res_newpvn(s, len);
+}
+
+resval *
+res_newpvn(const char *s, size_t len)
+{
+  resval *v = _res_new(RES_PV);
+
+  _res_grow(v, len);
+  if (s && len)
+    memcpy(v->u.pv, s, len);
+  v->u.pv[len] = '\0';
+  v->len = len;
+
+  return v;
+}
+
+static void
+_res_vcatpvf(resval *v, const char *fmt, va_list ap)
+{
+  char tmp[256];
+  va_list ap2;
+  int n;
+
+  va_copy(ap2, ap);
+  n = vsnprintf(tmp, sizeof(tmp), fmt, ap2);
+  va_end(ap2);
+
+  if (n < 0)
+    return;
+
+  _res_grow(v, v->len + n);
+
+  if (n < (int)sizeof(tmp))
+    memcpy(v->u.pv + v->len, tmp, n + 1);
+  else
+    vsnprintf(v->u.pv + v->len, n + 1, fmt, ap);
+
+  v->len += n;
+}
+
+resval *
+res_newpvf(const char *fmt, ...)
+{
+  resval *v = res_newpvn(NULL, 0);
+  va_list ap;
+
+  va_start(ap, fmt);
+  _res_vcatpvf(v, fmt, ap);
+  va_end(ap);
+
+  return v;
+}
+
+resval *
+res_newblob(const void *data, size_t len)
+{
+  resval *v = res_newpvn((const char *)data, len);
+  v->type = RES_BLOB;
+  return v;
+}
+
+resval *
+res_newart(uint64_t offset, uint64_t length)
+{
+  resval *v = _res_new(RES_ART);
+  v->u.art.offset = offset;
+  v->u.art.length = length;
+  return v;
+}
+
+// Copies a scalar, like newSVsv
+resval *
+res_newsv(resval *v)
+{
+  resval *copy;
+
+  if ( res_ispv(v) ) {
+    copy = res_newpvn(v->u.pv, v->len);
+    copy->type = v->type;
+  }
+  else {
+    copy = _res_new(v->type);
+    copy->u = v->u;
+  }
+
+  copy->flags = v->flags;
+
+  return copy;
+}
+
+resval *
+res_newhv(void)
+{
+  return _res_new(RES_HASH);
+}
+
+resval *
+res_newav(void)
+{
+  return _res_new(RES_ARRAY);
+}
+
+static resent *
+_res_find(resval *hv, const char *key, size_t klen, resent **prev)
+{
+  resent *e, *p = NULL;
+
+  for (e = hv->u.list.head; e; p = e, e = e->next) {
+    if ( e->klen == klen && !memcmp(e->key, key, klen) ) {
+      if (prev)
+        *prev = p;
+      return e;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+_res_append(resval *list, resent *e)
+{
+  e->next = NULL;
+
+  if (list->u.list.tail)
+    list->u.list.tail->next = e;
+  else
+    list->u.list.head = e;
+
+  list->u.list.tail = e;
+  list->len++;
+}
+
+static void
+_res_store(resval *hv, const char *key, size_t klen, uint8_t kflags, resval *val)
+{
+  resent *e = _res_find(hv, key, klen, NULL);
+
+  if (e) {
+    e->val = val;
+    e->kflags = kflags;
+    return;
+  }
+
+  e = (resent *)_res_alloc(sizeof(resent));
+  e->val = val;
+  e->key = (char *)_res_alloc(klen + 1);
+  memcpy(e->key, key, klen);
+  e->key[klen] = '\0';
+  e->klen = klen;
+  e->kflags = kflags;
+
+  _res_append(hv, e);
+}
+
+// Stores or replaces a key, like my_hv_store
+void
+res_hv_store(resval *hv, const char *key, resval *val)
+{
+  _res_store(hv, key, strlen(key), 0, val);
+}
+
+// The key's UTF-8 flag is kept, like hv_store_ent
+void
+res_hv_store_ent(resval *hv, resval *key, resval *val)
+{
+  _res_store(hv, res_pv(key), res_len(key), key->flags, val);
+}
+
+resval **
+res_hv_fetch(resval *hv, const char *key)
+{
+  resent *e = _res_find(hv, key, strlen(key), NULL);
+
+  return e ? &e->val : NULL;
+}
+
+int
+res_hv_exists(resval *hv, const char *key)
+{
+  return _res_find(hv, key, strlen(key), NULL) ? 1 : 0;
+}
+
+resval *
+res_hv_delete(resval *hv, const char *key)
+{
+  resent *prev = NULL;
+  resent *e = _res_find(hv, key, strlen(key), &prev);
+
+  if (!e)
+    return NULL;
+
+  if (prev)
+    prev->next = e->next;
+  else
+    hv->u.list.head = e->next;
+
+  if (hv->u.list.tail == e)
+    hv->u.list.tail = prev;
+
+  hv->len--;
+
+  return e->val;
+}
+
+void
+res_av_push(resval *av, resval *val)
+{
+  resent *e = (resent *)_res_alloc(sizeof(resent));
+
+  e->val = val;
+  e->key = NULL;
+  e->klen = 0;
+  e->kflags = 0;
+
+  _res_append(av, e);
+}
+
+resval **
+res_av_fetch(resval *av, int idx)
+{
+  resent *e;
+
+  if (idx < 0)
+    return NULL;
+
+  for (e = av->u.list.head; e && idx; e = e->next)
+    idx--;
+
+  return e ? &e->val : NULL;
+}
+
+resval *
+res_av_shift(resval *av)
+{
+  resent *e = av->u.list.head;
+
+  if (!e)
+    return res_newundef();
+
+  av->u.list.head = e->next;
+  if (!e->next)
+    av->u.list.tail = NULL;
+  av->len--;
+
+  return e->val;
+}
+
+// Index of the last element, like av_len
+int
+res_av_len(resval *av)
+{
+  return (int)av->len - 1;
+}
+
+int64_t
+res_iv(resval *v)
+{
+  switch (v->type) {
+    case RES_IV:  return v->u.iv;
+    case RES_UV:  return (int64_t)v->u.uv;
+    case RES_NV:  return (int64_t)v->u.nv;
+    case RES_ART: return (int64_t)v->u.art.length;
+    case RES_PV:
+    case RES_BLOB:
+      return strtoll(v->u.pv, NULL, 10);
+  }
+
+  return 0;
+}
+
+uint64_t
+res_uv(resval *v)
+{
+  switch (v->type) {
+    case RES_IV:  return (uint64_t)v->u.iv;
+    case RES_UV:  return v->u.uv;
+    case RES_NV:  return (uint64_t)v->u.nv;
+    case RES_ART: return v->u.art.length;
+    case RES_PV:
+    case RES_BLOB:
+      return strtoull(v->u.pv, NULL, 10);
+  }
+
+  return 0;
+}
+
+double
+res_nv(resval *v)
+{
+  switch (v->type) {
+    case RES_IV:  return (double)v->u.iv;
+    case RES_UV:  return (double)v->u.uv;
+    case RES_NV:  return v->u.nv;
+    case RES_ART: return (double)v->u.art.length;
+    case RES_PV:
+    case RES_BLOB:
+      return strtod(v->u.pv, NULL);
+  }
+
+  return 0;
+}
+
+// Returns the string value, numbers are converted in place like SvPV
+char *
+res_pv(resval *v)
+{
+  char tmp[32];
+
+  switch (v->type) {
+    case RES_PV:
+    case RES_BLOB:
+      return v->u.pv;
+
+    case RES_IV:
+      snprintf(tmp, sizeof(tmp), "%" PRId64, v->u.iv);
+      break;
+
+    case RES_UV:
+      snprintf(tmp, sizeof(tmp), "%" PRIu64, v->u.uv);
+      break;
+
+    case RES_NV:
+      snprintf(tmp, sizeof(tmp), "%.15g", v->u.nv);
+      break;
+
+    case RES_ART:
+      snprintf(tmp, sizeof(tmp), "%" PRIu64, v->u.art.length);
+      break;
+
+    default:
+      tmp[0] = '\0';
+  }
+
+  v->type = RES_PV;
+  v->len = v->cap = 0;
+  v->u.pv = NULL;
+  _res_grow(v, strlen(tmp));
+  memcpy(v->u.pv, tmp, strlen(tmp) + 1);
+  v->len = strlen(tmp);
+
+  return v->u.pv;
+}
+
+size_t
+res_len(resval *v)
+{
+  if ( !res_ispv(v) )
+    res_pv(v);
+
+  return v->len;
+}
+
+void
+res_catpvn(resval *v, const char *s, size_t len)
+{
+  if ( !res_ispv(v) )
+    res_pv(v);
+
+  _res_grow(v, v->len + len);
+  memcpy(v->u.pv + v->len, s, len);
+  v->len += len;
+  v->u.pv[v->len] = '\0';
+}
+
+void
+res_catpvf(resval *v, const char *fmt, ...)
+{
+  va_list ap;
+
+  if ( !res_ispv(v) )
+    res_pv(v);
+
+  va_start(ap, fmt);
+  _res_vcatpvf(v, fmt, ap);
+  va_end(ap);
+}
+
+// Like sv_catsv, appending a UTF-8 string makes the result UTF-8
+void
+res_catsv(resval *v, resval *w)
+{
+  res_catpvn(v, res_pv(w), res_len(w));
+  v->flags |= w->flags & RES_F_UTF8;
+}
+
+// Truncates a string, like SvCUR_set
+void
+res_cur_set(resval *v, size_t len)
+{
+  if ( res_ispv(v) && len <= v->len ) {
+    v->len = len;
+    v->u.pv[len] = '\0';
+  }
+}
+
+void
+res_utf8_decode(resval *v)
+{
+  v->flags |= RES_F_UTF8;
+}
+
+static void
+_res_vlog(uint8_t flags, const char *fmt, va_list ap)
+{
+  ScanResult *r = res_cur;
+
+  // Off the interpreter thread, keep it until the result is converted
+  if (r && r->jmp) {
+    resval *msg;
+
+    if (!r->warnings) {
+      // The list lives in the arena like everything else
+      r->warnings = res_newav();
+    }
+
+    msg = res_newpvn(NULL, 0);
+    msg->flags = flags;
+    _res_vcatpvf(msg, fmt, ap);
+    res_av_push(r->warnings, msg);
+    return;
+  }
+
+  {
+    dTHX;
+    va_list aq;
+
+    va_copy(aq, ap);
+
+    if (flags & RES_F_STDERR) {
+      PerlIO_vprintf(PerlIO_stderr(), fmt, aq);
+    }
+    else {
+      SV *msg = vnewSVpvf(fmt, &aq);
+      warn("%" SVf, SVfARG(sv_2mortal(msg)));
+    }
+
+    va_end(aq);
+  }
+}
+
+// Warnings from parsers, these may be deferred, see result_replay_warnings
+void
+res_warn(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  _res_vlog(0, fmt, ap);
+  va_end(ap);
+}
+
+// Diagnostics parsers print to stderr, deferred in the same way
+void
+res_errprintf(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  _res_vlog(RES_F_STDERR, fmt, ap);
+  va_end(ap);
+}
+
+// Fatal parser errors.  Off the interpreter thread this jumps back to the
+// worker with the message in r->error, otherwise it's a normal croak.
+void
+res_croak(const char *fmt, ...)
+{
+  ScanResult *r = res_cur;
+  va_list ap;
+
+  va_start(ap, fmt);
+
+  if (r && r->jmp) {
+    vsnprintf(r->error, sizeof(r->error), fmt, ap);
+    va_end(ap);
+    longjmp(*r->jmp, 1);
+  }
+
+  {
+    dTHX;
+    vcroak(fmt, &ap);
+  }
+
+  /* NOTREACHED */
+  va_end(ap);
+}
+
+void
+result_replay_warnings(ScanResult *r)
+{
+  resent *e;
+
+  if (!r->warnings)
+    return;
+
+  for (e = r->warnings->u.list.head; e; e = e->next) {
+    if (e->val->flags & RES_F_STDERR)
+      PerlIO_printf(PerlIO_stderr(), "%s", e->val->u.pv);
+    else
+      warn("%s", e->val->u.pv);
+  }
+
+  r->warnings = NULL;
+}
+
+// Flat encoding of a value tree, used by the scan cache.  Each value is a
+// type byte and a flags byte followed by its data in host byte order:
+// 8 bytes for numbers, a 32-bit length and the bytes for strings, offset
+// and length for artwork, and a 32-bit count and the entries for hashes
+// and arrays.  Hash entries are a key flags byte, 32-bit key length and
+// the key before the value.
+
+static void
+_res_put32(Buffer *out, uint32_t n)
+{
+  buffer_append(out, &n, 4);
+}
+
+void
+res_serialize(resval *v, Buffer *out)
+{
+  resent *e;
+
+  buffer_put_char(out, v->type);
+  buffer_put_char(out, v->flags);
+
+  switch (v->type) {
+    case RES_IV:
+    case RES_UV:
+    case RES_NV:
+      buffer_append(out, &v->u, 8);
+      break;
+
+    case RES_PV:
+    case RES_BLOB:
+      _res_put32(out, v->len);
+      buffer_append(out, v->u.pv, v->len);
+      break;
+
+    case RES_ART:
+      buffer_append(out, &v->u.art.offset, 8);
+      buffer_append(out, &v->u.art.length, 8);
+      break;
+
+    case RES_HASH:
+    case RES_ARRAY:
+      _res_put32(out, v->len);
+
+      for (e = v->u.list.head; e; e = e->next) {
+        if (v->type == RES_HASH) {
+          buffer_put_char(out, e->kflags);
+          _res_put32(out, e->klen);
+          buffer_append(out, e->key, e->klen);
+        }
+        res_serialize(e->val, out);
+      }
+      break;
+  }
+}
+
+#define RES_MAX_DEPTH 32
+
+static resval *
+_res_deserialize(const unsigned char **pp, const unsigned char *end, int depth)
+{
+  const unsigned char *p = *pp;
+  resval *v;
+  uint32_t n, i;
+
+  if (end - p < 2 || depth > RES_MAX_DEPTH)
+    return NULL;
+
+  v = _res_new(p[0]);
+  v->flags = p[1];
+  p += 2;
+
+  switch (v->type) {
+    case RES_UNDEF:
+      break;
+
+    case RES_IV:
+    case RES_UV:
+    case RES_NV:
+      if (end - p < 8)
+        return NULL;
+      memcpy(&v->u, p, 8);
+      p += 8;
+      break;
+
+    case RES_PV:
+    case RES_BLOB:
+      if (end - p < 4)
+        return NULL;
+      memcpy(&n, p, 4);
+      p += 4;
+      if ((uint32_t)(end - p) < n)
+        return NULL;
+      _res_grow(v, n);
+      memcpy(v->u.pv, p, n);
+      v->u.pv[n] = '\0';
+      v->len = n;
+      p += n;
+      break;
+
+    case RES_ART:
+      if (end - p < 16)
+        return NULL;
+      memcpy(&v->u.art.offset, p, 8);
+      memcpy(&v->u.art.length, p + 8, 8);
+      p += 16;
+      break;
+
+    case RES_HASH:
+    case RES_ARRAY:
+      if (end - p < 4)
+        return NULL;
+      memcpy(&n, p, 4);
+      p += 4;
+
+      for (i = 0; i < n; i++) {
+        resval *val;
+        const unsigned char *key = NULL;
+        uint32_t klen = 0;
+        uint8_t kflags = 0;
+
+        if (v->type == RES_HASH) {
+          if (end - p < 5)
+            return NULL;
+          kflags = p[0];
+          memcpy(&klen, p + 1, 4);
+          p += 5;
+          if ((uint32_t)(end - p) < klen)
+            return NULL;
+          key = p;
+          p += klen;
+        }
+
+        if ( (val = _res_deserialize(&p, end, depth + 1)) == NULL )
+          return NULL;
+
+        if (v->type == RES_HASH)
+          _res_store(v, (const char *)key, klen, kflags, val);
+        else
+          res_av_push(v, val);
+      }
+      break;
+
+    default:
+      return NULL;
+  }
+
+  *pp = p;
+
+  return v;
+}
+
+// Rebuilds a value written by res_serialize in the current ScanResult,
+// returns NULL if the data is truncated or invalid
+resval *
+res_deserialize(const unsigned char *data, uint32_t len)
+{
+  const unsigned char *p = data;
+  resval *v = _res_deserialize(&p, data + len, 0);
+
+  return (v && p == data + len) ? v : NULL;
+}
+
+// Converts a value to a new Perl SV, hashes and arrays become references
+SV *
+res_to_sv(resval *v)
+{
+  SV *sv;
+
+  switch (v->type) {
+    case RES_IV:
+      return newSViv(v->u.iv);
+
+    case RES_UV:
+      return newSVuv(v->u.uv);
+
+    case RES_NV:
+      return newSVnv(v->u.nv);
+
+    case RES_PV:
+    case RES_BLOB:
+      sv = newSVpvn(v->u.pv, v->len);
+      if (v->flags & RES_F_UTF8)
+        sv_utf8_decode(sv);
+      return sv;
+
+    case RES_ART:
+      // Same as AUDIO_SCAN_NO_ARTWORK has always returned
+      return newSVuv(v->u.art.length);
+
+    case RES_HASH:
+      return newRV_noinc( (SV *)res_to_hv(v) );
+
+    case RES_ARRAY:
+    {
+      AV *av = newAV();
+      resent *e;
+
+      if (v->len)
+        av_extend(av, v->len - 1);
+
+      for (e = v->u.list.head; e; e = e->next)
+        av_push( av, res_to_sv(e->val) );
+
+      return newRV_noinc( (SV *)av );
+    }
+  }
+
+  return newSV(0);
+}
+
+HV *
+res_to_hv(resval *hv)
+{
+  HV *ret = newHV();
+  resent *e;
+
+  for (e = hv->u.list.head; e; e = e->next) {
+    if (e->kflags & RES_F_UTF8) {
+      SV *key = newSVpvn(e->key, e->klen);
+      sv_utf8_decode(key);
+      hv_store_ent( ret, key, res_to_sv(e->val), 0 );
+      SvREFCNT_dec(key);
+    }
+    else {
+      hv_store( ret, e->key, e->klen, res_to_sv(e->val), 0 );
+    }
+  }
+
+  return ret;
+}
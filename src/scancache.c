@@ -0,0 +1,643 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "scancache.h"
+
+#include <fcntl.h>
+
+#ifndef _MSC_VER
+# include <sys/file.h>
+#endif
+
+#ifndef O_BINARY
+# define O_BINARY 0
+#endif
+
+#if defined(__APPLE__)
+# define SCANCACHE_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#elif defined(_MSC_VER)
+# define SCANCACHE_NSEC(st) 0
+#else
+# define SCANCACHE_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+#define SCANCACHE_ALIGN(n) (((n) + 7) & ~7)
+
+static void
+_scancache_lock(scancache *c, int exclusive)
+{
+#ifndef _MSC_VER
+  while ( flock(c->fd, exclusive ? LOCK_EX : LOCK_UN) != 0 && errno == EINTR )
+    ;
+#endif
+}
+
+static uint64_t
+_scancache_path_hash(const char *file, size_t len)
+{
+  return ((uint64_t)hashlittle(file, len, 0) << 32) | hashlittle(file, len, 0x9e3779b9);
+}
+
+static int
+_scancache_write(int fd, const void *data, size_t len)
+{
+  const char *p = (const char *)data;
+
+  while (len > 0) {
+    SSize_t n = write(fd, p, len);
+
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return 0;
+    }
+
+    p += n;
+    len -= n;
+  }
+
+  return 1;
+}
+
+int
+scancache_identify(const char *file, int fd, scancache_id *id)
+{
+  struct stat st;
+
+  if ( (fd >= 0 ? fstat(fd, &st) : stat(file, &st)) != 0 )
+    return 0;
+
+  id->dev = (uint64_t)st.st_dev;
+  id->ino = (uint64_t)st.st_ino;
+  id->size = (uint64_t)st.st_size;
+  id->mtime_ns = (int64_t)st.st_mtime * 1000000000 + SCANCACHE_NSEC(st);
+
+  return 1;
+}
+
+static int
+_scancache_id_eq(scancache_id *a, scancache_id *b)
+{
+  return a->dev == b->dev && a->ino == b->ino && a->size == b->size && a->mtime_ns == b->mtime_ns;
+}
+
+static void
+_scancache_rehash(scancache *c, uint32_t nbuckets)
+{
+  uint32_t i;
+
+  Safefree(c->buckets);
+  Newz(0, c->buckets, nbuckets, uint32_t);
+  c->nbuckets = nbuckets;
+
+  for (i = 0; i < c->nentries; i++) {
+    uint32_t b = c->entries[i].path_hash & (nbuckets - 1);
+    c->entries[i].next = c->buckets[b];
+    c->buckets[b] = i + 1;
+  }
+}
+
+static scancache_entry *
+_scancache_find(scancache *c, uint64_t path_hash, uint32_t filter, uint32_t md5_size, uint32_t md5_offset)
+{
+  uint32_t i;
+
+  if (!c->nbuckets)
+    return NULL;
+
+  for (i = c->buckets[path_hash & (c->nbuckets - 1)]; i; i = c->entries[i - 1].next) {
+    scancache_entry *e = &c->entries[i - 1];
+
+    if ( e->path_hash == path_hash && e->filter == filter
+      && e->md5_size == md5_size && e->md5_offset == md5_offset ) {
+      return e;
+    }
+  }
+
+  return NULL;
+}
+
+// Adds a record to the index, an invalidation drops every entry for its path
+static void
+_scancache_index(scancache *c, scancache_record *rec, off_t offset)
+{
+  scancache_entry *e;
+
+  if (!rec->data_len) {
+    uint32_t i;
+
+    if (c->nbuckets) {
+      for (i = c->buckets[rec->path_hash & (c->nbuckets - 1)]; i; i = c->entries[i - 1].next) {
+        if (c->entries[i - 1].path_hash == rec->path_hash)
+          c->entries[i - 1].offset = 0;
+      }
+    }
+    return;
+  }
+
+  e = _scancache_find(c, rec->path_hash, rec->filter, rec->md5_size, rec->md5_offset);
+
+  if (!e) {
+    uint32_t b;
+
+    if (c->nentries == c->alloc) {
+      c->alloc = c->alloc ? c->alloc * 2 : 256;
+      Renew(c->entries, c->alloc, scancache_entry);
+    }
+
+    if (c->nentries >= c->nbuckets)
+      _scancache_rehash(c, c->nbuckets ? c->nbuckets * 2 : 256);
+
+    e = &c->entries[c->nentries++];
+    e->path_hash = rec->path_hash;
+    e->filter = rec->filter;
+    e->md5_size = rec->md5_size;
+    e->md5_offset = rec->md5_offset;
+
+    b = e->path_hash & (c->nbuckets - 1);
+    e->next = c->buckets[b];
+    c->buckets[b] = c->nentries;
+  }
+
+  e->offset = offset;
+}
+
+// Maps the file as it is now, in case it has grown
+static int
+_scancache_map(scancache *c)
+{
+  scanio_close(&c->io);
+
+  if ( !scanio_init_mmap(&c->io, c->fd, 0) && !scanio_init_pread(&c->io, c->fd, 0) )
+    return 0;
+
+  return 1;
+}
+
+// Reads len bytes at offset into buf, which views the mapping when it can
+static int
+_scancache_read(scancache *c, off_t offset, uint32_t len, Buffer *buf)
+{
+  if (offset + len > c->io.size) {
+    if ( !_scancache_map(c) || offset + len > c->io.size )
+      return 0;
+  }
+
+  buffer_clear(buf);
+
+  if ( scanio_seek(&c->io, offset, SEEK_SET) < 0 )
+    return 0;
+
+  return _check_buf(&c->io, buf, len, len);
+}
+
+static int
+_scancache_read_record(scancache *c, off_t offset, scancache_record *rec, Buffer *buf)
+{
+  if ( !_scancache_read(c, offset, sizeof(scancache_record), buf) )
+    return 0;
+
+  memcpy(rec, buffer_ptr(buf), sizeof(scancache_record));
+
+  if ( rec->magic != SCANCACHE_RECORD
+    || rec->length != SCANCACHE_ALIGN(sizeof(scancache_record) + rec->path_len + rec->data_len) ) {
+    return 0;
+  }
+
+  if (offset + rec->length > c->io.size) {
+    if ( !_scancache_map(c) || offset + rec->length > c->io.size )
+      return 0;
+  }
+
+  return 1;
+}
+
+// Indexes any records appended since the last sync by another process,
+// returns the size of the file
+static off_t
+_scancache_sync(scancache *c)
+{
+  scancache_record rec;
+  struct stat st;
+  Buffer buf;
+
+  if ( fstat(c->fd, &st) != 0 )
+    return -1;
+
+  if (st.st_size <= c->end)
+    return st.st_size;
+
+  buffer_init(&buf, sizeof(scancache_record));
+
+  // A torn record at the end stops indexing, the next store truncates it
+  while ( c->end < st.st_size && _scancache_read_record(c, c->end, &rec, &buf) ) {
+    _scancache_index(c, &rec, c->end);
+    c->end += rec.length;
+  }
+
+  buffer_free(&buf);
+
+  return st.st_size;
+}
+
+int
+scancache_open(scancache *c, const char *path)
+{
+#ifndef _MSC_VER
+  scancache_header hdr;
+  struct stat st;
+
+  Zero(c, 1, scancache);
+
+  c->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_BINARY, 0644);
+  if (c->fd < 0)
+    return 0;
+
+  New(0, c->path, strlen(path) + 1, char);
+  strcpy(c->path, path);
+
+  _scancache_lock(c, 1);
+
+  if ( fstat(c->fd, &st) != 0 )
+    goto fail;
+
+  c->ino = (uint64_t)st.st_ino;
+
+  if (st.st_size == 0) {
+    // New cache
+    Zero(&hdr, 1, scancache_header);
+    memcpy(hdr.magic, SCANCACHE_MAGIC, 8);
+    hdr.version = SCANCACHE_VERSION;
+    hdr.bom = SCANCACHE_BOM;
+
+    if ( !_scancache_write(c->fd, &hdr, sizeof(hdr)) )
+      goto fail;
+  }
+  else if ( pread(c->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+    || memcmp(hdr.magic, SCANCACHE_MAGIC, 8)
+    || hdr.version != SCANCACHE_VERSION
+    || hdr.bom != SCANCACHE_BOM ) {
+    errno = EINVAL;
+    goto fail;
+  }
+
+  c->end = sizeof(scancache_header);
+  _scancache_sync(c);
+
+  _scancache_lock(c, 0);
+
+  DEBUG_TRACE("scancache: opened %s, %d entries\n", path, c->nentries);
+
+  return 1;
+
+fail:
+  {
+    int err = errno;
+    scancache_close(c);
+    errno = err;
+  }
+#else
+  Zero(c, 1, scancache);
+  c->fd = -1;
+  errno = ENOSYS;
+#endif
+
+  return 0;
+}
+
+void
+scancache_close(scancache *c)
+{
+  scanio_close(&c->io);
+
+  if (c->fd >= 0)
+    close(c->fd);
+
+  Safefree(c->path);
+  Safefree(c->entries);
+  Safefree(c->buckets);
+  Zero(c, 1, scancache);
+  c->fd = -1;
+}
+
+// Reopens the cache if another process has compacted it
+static int
+_scancache_check(scancache *c)
+{
+  struct stat st;
+
+  if ( stat(c->path, &st) == 0 && (uint64_t)st.st_ino != c->ino ) {
+    char *path = c->path;
+    uint64_t hits = c->hits, misses = c->misses, stores = c->stores;
+    int ok;
+
+    c->path = NULL;
+    scancache_close(c);
+    ok = scancache_open(c, path);
+    Safefree(path);
+
+    c->hits = hits;
+    c->misses = misses;
+    c->stores = stores;
+
+    return ok;
+  }
+
+  return c->fd >= 0;
+}
+
+// Returns the stored result for file if its identity and the options
+// match, rebuilt in the current ScanResult, or NULL
+resval *
+scancache_fetch(scancache *c, const char *file, uint32_t filter, uint32_t md5_size, uint32_t md5_offset)
+{
+  size_t path_len = strlen(file);
+  uint64_t path_hash = _scancache_path_hash(file, path_len);
+  scancache_entry *e;
+  scancache_record rec;
+  scancache_id id;
+  resval *v = NULL;
+  Buffer buf;
+
+  if ( _env_true("AUDIO_SCAN_NO_ARTWORK") )
+    filter |= SCANCACHE_NO_ARTWORK;
+
+  if ( !_scancache_check(c) || !scancache_identify(file, -1, &id) )
+    goto miss;
+
+  e = _scancache_find(c, path_hash, filter, md5_size, md5_offset);
+
+  if ( (!e || !e->offset) ) {
+    // Perhaps stored by another process
+    _scancache_sync(c);
+    e = _scancache_find(c, path_hash, filter, md5_size, md5_offset);
+  }
+
+  if (!e || !e->offset)
+    goto miss;
+
+  buffer_init(&buf, 0);
+
+  if ( _scancache_read_record(c, e->offset, &rec, &buf)
+    && rec.path_len == path_len
+    && _scancache_id_eq(&rec.id, &id)
+    && _scancache_read(c, e->offset + sizeof(scancache_record), rec.path_len + rec.data_len, &buf)
+    && hashlittle(buffer_ptr(&buf), rec.path_len + rec.data_len, 0) == rec.checksum
+    && !memcmp(buffer_ptr(&buf), file, path_len) ) {
+    v = res_deserialize( (unsigned char *)buffer_ptr(&buf) + path_len, rec.data_len );
+  }
+
+  buffer_free(&buf);
+
+  if (v) {
+    c->hits++;
+    return v;
+  }
+
+miss:
+  c->misses++;
+  return NULL;
+}
+
+static int
+_scancache_append(scancache *c, const char *file, scancache_id *id,
+  uint32_t filter, uint32_t md5_size, uint32_t md5_offset, resval *v)
+{
+  scancache_record rec;
+  Buffer buf;
+  size_t path_len = strlen(file);
+  off_t size;
+  int ok = 0;
+
+  if ( !_scancache_check(c) )
+    return 0;
+
+  buffer_init(&buf, 4096);
+
+  Zero(&rec, 1, scancache_record);
+  rec.magic = SCANCACHE_RECORD;
+  rec.path_hash = _scancache_path_hash(file, path_len);
+  if (id)
+    rec.id = *id;
+  rec.filter = filter;
+  rec.md5_size = md5_size;
+  rec.md5_offset = md5_offset;
+  rec.path_len = path_len;
+
+  buffer_append(&buf, &rec, sizeof(rec));
+  buffer_append(&buf, file, path_len);
+  if (v)
+    res_serialize(v, &buf);
+
+  rec.data_len = buffer_len(&buf) - sizeof(rec) - path_len;
+  rec.length = SCANCACHE_ALIGN(buffer_len(&buf));
+  rec.checksum = hashlittle(buffer_ptr(&buf) + sizeof(rec), path_len + rec.data_len, 0);
+  memcpy(buffer_ptr(&buf), &rec, sizeof(rec));
+
+  while (buffer_len(&buf) < rec.length)
+    buffer_put_char(&buf, 0);
+
+  _scancache_lock(c, 1);
+
+  // Catch up with other writers, then drop any torn record they left
+  size = _scancache_sync(c);
+
+#ifndef _MSC_VER
+  if ( size < 0 || (size > c->end && ftruncate(c->fd, c->end) != 0) )
+    goto out;
+#endif
+
+  if ( _scancache_write(c->fd, buffer_ptr(&buf), rec.length) ) {
+    _scancache_index(c, &rec, c->end);
+    c->end += rec.length;
+    ok = 1;
+  }
+
+out:
+  _scancache_lock(c, 0);
+  buffer_free(&buf);
+
+  return ok;
+}
+
+// Stores a result under the identity the file had when it was opened
+int
+scancache_store(scancache *c, const char *file, scancache_id *id,
+  uint32_t filter, uint32_t md5_size, uint32_t md5_offset, resval *v)
+{
+  if ( _env_true("AUDIO_SCAN_NO_ARTWORK") )
+    filter |= SCANCACHE_NO_ARTWORK;
+
+  if ( !_scancache_append(c, file, id, filter, md5_size, md5_offset, v) )
+    return 0;
+
+  c->stores++;
+
+  return 1;
+}
+
+// Forgets every result stored for file
+int
+scancache_invalidate(scancache *c, const char *file)
+{
+  size_t path_len = strlen(file);
+  uint64_t path_hash = _scancache_path_hash(file, path_len);
+  uint32_t i;
+  int found = 0;
+
+  if ( !_scancache_check(c) )
+    return 0;
+
+  _scancache_sync(c);
+
+  for (i = 0; i < c->nentries; i++) {
+    if (c->entries[i].path_hash == path_hash && c->entries[i].offset)
+      found = 1;
+  }
+
+  if (!found)
+    return 0;
+
+  return _scancache_append(c, file, NULL, 0, 0, 0, NULL);
+}
+
+// Number of results the index currently points to
+uint32_t
+scancache_live(scancache *c)
+{
+  uint32_t i, live = 0;
+
+  for (i = 0; i < c->nentries; i++) {
+    if (c->entries[i].offset)
+      live++;
+  }
+
+  return live;
+}
+
+// Rewrites the cache with only the latest result for each file whose
+// identity still matches, and swaps it into place.  Returns the number of
+// results kept, or -1 on error.
+int
+scancache_compact(scancache *c)
+{
+#ifndef _MSC_VER
+  scancache_header hdr;
+  scancache_record rec;
+  Buffer buf;
+  char *tmp;
+  char *path;
+  int fd;
+  int kept = 0;
+  uint32_t i;
+
+  if ( !_scancache_check(c) )
+    return -1;
+
+  New(0, tmp, strlen(c->path) + 5, char);
+  sprintf(tmp, "%s.tmp", c->path);
+
+  _scancache_lock(c, 1);
+  _scancache_sync(c);
+
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+  if (fd < 0) {
+    _scancache_lock(c, 0);
+    Safefree(tmp);
+    return -1;
+  }
+
+  Zero(&hdr, 1, scancache_header);
+  memcpy(hdr.magic, SCANCACHE_MAGIC, 8);
+  hdr.version = SCANCACHE_VERSION;
+  hdr.bom = SCANCACHE_BOM;
+
+  if ( !_scancache_write(fd, &hdr, sizeof(hdr)) )
+    goto fail;
+
+  buffer_init(&buf, 0);
+
+  for (i = 0; i < c->nentries; i++) {
+    scancache_entry *e = &c->entries[i];
+    scancache_id id;
+    char *file;
+
+    if ( !e->offset || !_scancache_read_record(c, e->offset, &rec, &buf) )
+      continue;
+
+    if ( !_scancache_read(c, e->offset, rec.length, &buf) )
+      continue;
+
+    // Drop results for files that have changed or gone away
+    New(0, file, rec.path_len + 1, char);
+    memcpy(file, buffer_ptr(&buf) + sizeof(rec), rec.path_len);
+    file[rec.path_len] = '\0';
+
+    if ( scancache_identify(file, -1, &id) && _scancache_id_eq(&rec.id, &id) ) {
+      if ( !_scancache_write(fd, buffer_ptr(&buf), rec.length) ) {
+        Safefree(file);
+        buffer_free(&buf);
+        goto fail;
+      }
+      kept++;
+    }
+
+    Safefree(file);
+  }
+
+  buffer_free(&buf);
+
+  if ( close(fd) != 0 ) {
+    fd = -1;
+    goto fail;
+  }
+
+  if ( rename(tmp, c->path) != 0 ) {
+    fd = -1;
+    goto fail;
+  }
+
+  Safefree(tmp);
+
+  // Unlocks the old file, other processes reopen when they notice the new one
+  {
+    uint64_t hits = c->hits, misses = c->misses, stores = c->stores;
+
+    path = c->path;
+    c->path = NULL;
+    scancache_close(c);
+    if ( !scancache_open(c, path) )
+      kept = -1;
+    Safefree(path);
+
+    c->hits = hits;
+    c->misses = misses;
+    c->stores = stores;
+  }
+
+  return kept;
+
+fail:
+  if (fd >= 0)
+    close(fd);
+  unlink(tmp);
+  Safefree(tmp);
+  _scancache_lock(c, 0);
+  return -1;
+#else
+  return -1;
+#endif
+}
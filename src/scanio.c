@@ -0,0 +1,378 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "scanio.h"
+
+#ifndef _MSC_VER
+# include <unistd.h>
+# include <sys/mman.h>
+#endif
+
+static const char *scanio_names[] = { "perlio", "pread", "mmap", "memory", 0 };
+
+// Returns the backend type for an io => option value, or -1 if unknown
+int
+scanio_type(const char *name)
+{
+  int i;
+
+  if (name == NULL || *name == '\0')
+    return SCANIO_PERLIO;
+
+  for (i = 0; scanio_names[i]; i++) {
+    if ( !strcmp(scanio_names[i], name) )
+      return i;
+  }
+
+  return -1;
+}
+
+/* PerlIO, the original behavior */
+
+static SSize_t
+_perlio_read(ScanIO *io, void *buf, size_t len)
+{
+  return PerlIO_read(io->pio, buf, len);
+}
+
+static int
+_perlio_seek(ScanIO *io, off_t offset, int whence)
+{
+  return PerlIO_seek(io->pio, offset, whence);
+}
+
+static off_t
+_perlio_tell(ScanIO *io)
+{
+  return PerlIO_tell(io->pio);
+}
+
+static off_t
+_perlio_size(ScanIO *io)
+{
+#ifdef _MSC_VER
+  // Win32 doesn't work right with fstat
+  off_t file_size;
+
+  PerlIO_seek(io->pio, 0, SEEK_END);
+  file_size = PerlIO_tell(io->pio);
+  PerlIO_seek(io->pio, 0, SEEK_SET);
+
+  return file_size;
+#else
+  struct stat buf;
+
+  if ( !fstat( PerlIO_fileno(io->pio), &buf ) ) {
+    return buf.st_size;
+  }
+
+  LOG_WARN("Unable to stat: %s\n", strerror(errno));
+
+  return 0;
+#endif
+}
+
+static const scanio_ops perlio_ops = {
+  "perlio", _perlio_read, _perlio_seek, _perlio_tell, _perlio_size
+};
+
+/* Position handling shared by the pread, mmap and memory backends */
+
+static int
+_pos_seek(ScanIO *io, off_t offset, int whence)
+{
+  off_t pos;
+
+  switch (whence) {
+    case SEEK_SET: pos = offset; break;
+    case SEEK_CUR: pos = io->pos + offset; break;
+    case SEEK_END: pos = io->size + offset; break;
+    default:       return -1;
+  }
+
+  if (pos < 0)
+    return -1;
+
+  io->pos = pos;
+
+  return 0;
+}
+
+static off_t
+_pos_tell(ScanIO *io)
+{
+  return io->pos;
+}
+
+static off_t
+_pos_size(ScanIO *io)
+{
+  return io->size;
+}
+
+/* Raw fd with pread, no shared file position and no PerlIO layers */
+
+#ifndef _MSC_VER
+static SSize_t
+_pread_read(ScanIO *io, void *buf, size_t len)
+{
+  SSize_t ret;
+
+  do {
+    ret = pread(io->fd, buf, len, io->pos);
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret < 0) {
+    io->error = 1;
+    return ret;
+  }
+
+  io->pos += ret;
+
+  return ret;
+}
+
+static const scanio_ops pread_ops = {
+  "pread", _pread_read, _pos_seek, _pos_tell, _pos_size
+};
+#endif
+
+/* mmap'ed file or memory buffer */
+
+static SSize_t
+_memory_read(ScanIO *io, void *buf, size_t len)
+{
+  if (io->pos >= io->size)
+    return 0;
+
+  if (len > io->size - io->pos)
+    len = io->size - io->pos;
+
+  Copy(io->data + io->pos, buf, len, unsigned char);
+  io->pos += len;
+
+  return len;
+}
+
+static const scanio_ops mmap_ops = {
+  "mmap", _memory_read, _pos_seek, _pos_tell, _pos_size
+};
+
+static const scanio_ops memory_ops = {
+  "memory", _memory_read, _pos_seek, _pos_tell, _pos_size
+};
+
+void
+scanio_init_perlio(ScanIO *io, PerlIO *pio)
+{
+  Zero(io, 1, ScanIO);
+  io->ops  = &perlio_ops;
+  io->type = SCANIO_PERLIO;
+  io->pio  = pio;
+  io->fd   = -1;
+}
+
+int
+scanio_init_pread(ScanIO *io, int fd, off_t pos)
+{
+#ifndef _MSC_VER
+  struct stat buf;
+
+  if (fd < 0 || fstat(fd, &buf) != 0 || !S_ISREG(buf.st_mode))
+    return 0;
+
+  Zero(io, 1, ScanIO);
+  io->ops  = &pread_ops;
+  io->type = SCANIO_PREAD;
+  io->fd   = fd;
+  io->size = buf.st_size;
+  io->pos  = pos;
+
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+int
+scanio_init_mmap(ScanIO *io, int fd, off_t pos)
+{
+#ifndef _MSC_VER
+  struct stat buf;
+  void *map = NULL;
+
+  if (fd < 0 || fstat(fd, &buf) != 0 || !S_ISREG(buf.st_mode))
+    return 0;
+
+  // Zero-length files can't be mapped, but are valid (empty) sources
+  if (buf.st_size > 0) {
+    if ( (uint64_t)buf.st_size > (size_t)-1 )
+      return 0;
+
+    map = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+      return 0;
+  }
+
+  Zero(io, 1, ScanIO);
+  io->ops       = &mmap_ops;
+  io->type      = SCANIO_MMAP;
+  io->fd        = fd;
+  io->data      = (unsigned char *)map;
+  io->size      = buf.st_size;
+  io->pos       = pos;
+  io->owns_data = map ? 1 : 0;
+
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+// data is not copied and must outlive the ScanIO
+void
+scanio_init_memory(ScanIO *io, unsigned char *data, off_t size)
+{
+  Zero(io, 1, ScanIO);
+  io->ops  = &memory_ops;
+  io->type = SCANIO_MEMORY;
+  io->fd   = -1;
+  io->data = data;
+  io->size = size;
+}
+
+// Read the whole file with a single read and scan it from memory.
+// Intended for small files on high-latency storage where each seek is a roundtrip.
+int
+scanio_init_slurp(ScanIO *io, PerlIO *pio)
+{
+  ScanIO file;
+  unsigned char *data = NULL;
+  off_t size, pos, done = 0;
+
+  scanio_init_perlio(&file, pio);
+
+  pos  = scanio_tell(&file);
+  size = scanio_size(&file);
+
+  if (size > 0) {
+    if ( (uint64_t)size > (size_t)-1 )
+      return 0;
+
+    if ( scanio_seek(&file, 0, SEEK_SET) != 0 )
+      return 0;
+
+    New(0, data, size, unsigned char);
+
+    while (done < size) {
+      SSize_t read = scanio_read(&file, data + done, size - done);
+      if (read <= 0)
+        break;
+      done += read;
+    }
+
+    scanio_seek(&file, pos, SEEK_SET);
+  }
+
+  scanio_init_memory(io, data, done);
+  io->pos = pos;
+  io->owns_data = data ? 1 : 0;
+
+  return 1;
+}
+
+// Set up the requested backend for an open PerlIO handle, falling back
+// to PerlIO if the handle has no real file behind it (i.e. in-memory
+// Perl filehandles) or the backend isn't available on this platform
+void
+scanio_init_type(ScanIO *io, PerlIO *pio, int type)
+{
+  int fd = PerlIO_fileno(pio);
+
+  switch (type) {
+    case SCANIO_PREAD:
+      if ( scanio_init_pread(io, fd, PerlIO_tell(pio)) )
+        return;
+      break;
+
+    case SCANIO_MMAP:
+      if ( scanio_init_mmap(io, fd, PerlIO_tell(pio)) )
+        return;
+      break;
+
+    case SCANIO_MEMORY:
+      if ( fd >= 0 && scanio_init_slurp(io, pio) )
+        return;
+      break;
+  }
+
+  DEBUG_TRACE("Using perlio backend\n");
+
+  scanio_init_perlio(io, pio);
+}
+
+// Fault in part of a mapping now, so whoever calls this (i.e. a
+// scan_many worker) waits for the disk instead of the parser
+void
+scanio_prefetch(ScanIO *io, off_t offset, off_t len)
+{
+#ifndef _MSC_VER
+  long pagesize = sysconf(_SC_PAGESIZE);
+  off_t start, i;
+  volatile unsigned char sum = 0;
+
+  if (io->type != SCANIO_MMAP || !io->data)
+    return;
+
+  if (offset < 0) {
+    len += offset;
+    offset = 0;
+  }
+
+  if (len > io->size - offset)
+    len = io->size - offset;
+
+  if (len <= 0)
+    return;
+
+#ifdef MADV_WILLNEED
+  start = offset - (offset % pagesize);
+  madvise(io->data + start, len + (offset - start), MADV_WILLNEED);
+#endif
+
+  for (i = offset; i < offset + len; i += pagesize)
+    sum += io->data[i];
+#endif
+}
+
+void
+scanio_close(ScanIO *io)
+{
+  if (io->owns_data && io->data) {
+#ifndef _MSC_VER
+    if (io->type == SCANIO_MMAP) {
+      munmap(io->data, io->size);
+    }
+    else
+#endif
+    {
+      Safefree(io->data);
+    }
+  }
+
+  io->data = NULL;
+  io->owns_data = 0;
+}
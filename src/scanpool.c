@@ -0,0 +1,320 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "scanpool.h"
+
+#include <fcntl.h>
+
+#ifndef O_BINARY
+# define O_BINARY 0
+#endif
+
+int
+scanpool_ncpu(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (n > 0)
+    return (int)n;
+#endif
+
+  return 1;
+}
+
+// Open and map a file, and parse it if the pool has a parse function
+static void
+_scanjob_open(scanpool *pool, scanjob *job)
+{
+  int fd = open(job->path, O_RDONLY | O_BINARY);
+
+  if (fd < 0) {
+    job->error = errno;
+    return;
+  }
+
+  if ( scanio_init_mmap(&job->io, fd, 0) ) {
+    // Wait for the disk here rather than in the parser
+    scanio_prefetch(&job->io, 0, SCANPOOL_PREFETCH);
+    scanio_prefetch(&job->io, job->io.size - SCANPOOL_PREFETCH, SCANPOOL_PREFETCH);
+
+    close(fd);
+    job->io.fd = -1;
+
+#ifdef SCANPOOL_PARSE
+    if ( pool->nthreads && pool->parse )
+      pool->parse(job, pool->parse_arg);
+#endif
+  }
+  else {
+    // Not a regular file or no mmap, the fd is wrapped on the main thread
+    job->fd = fd;
+  }
+}
+
+// Runs a job on a worker thread, so must not use Perl
+static void
+_scanjob_run(scanpool *pool, scanjob *job)
+{
+  _scanjob_open(pool, job);
+
+  // Handed over to the interpreter thread's counters by _scanjob_finish
+  buffer_stats_take(&job->stats);
+}
+
+// Anything that needs the interpreter, runs on the main thread
+static void
+_scanjob_finish(scanjob *job)
+{
+  buffer_stats_add(&job->stats);
+
+  if (!job->io.ops && job->fd >= 0) {
+    PerlIO *pio = PerlIO_fdopen(job->fd, "rb");
+
+    if (pio) {
+      scanio_init_perlio(&job->io, pio);
+      job->fd = -1;
+    }
+    else {
+      job->error = errno;
+    }
+  }
+
+  job->state = SCANJOB_DONE;
+}
+
+#ifdef SCANPOOL_THREADS
+static void *
+_scanpool_worker(void *arg)
+{
+  scanpool *pool = (scanpool *)arg;
+  scanjob *job;
+
+  pthread_mutex_lock(&pool->lock);
+
+  while (1) {
+    while ( !pool->stop && pool->next < pool->njobs && pool->inflight >= pool->window )
+      pthread_cond_wait(&pool->work, &pool->lock);
+
+    if ( pool->stop || pool->next >= pool->njobs )
+      break;
+
+    job = &pool->jobs[pool->next++];
+    job->state = SCANJOB_RUNNING;
+    pool->inflight++;
+
+    pthread_mutex_unlock(&pool->lock);
+    _scanjob_run(pool, job);
+    pthread_mutex_lock(&pool->lock);
+
+    job->state = SCANJOB_READY;
+    pool->done[pool->done_tail++] = job - pool->jobs;
+    pthread_cond_broadcast(&pool->ready);
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+#endif
+
+void
+scanpool_init(scanpool *pool, const char **paths, int njobs, int nthreads,
+  scanpool_parse_fn parse, void *parse_arg)
+{
+  int i;
+  size_t len = 0;
+  char *p;
+
+  Zero(pool, 1, scanpool);
+
+  for (i = 0; i < njobs; i++)
+    len += strlen(paths[i]) + 1;
+
+  // Workers can't touch the SVs, so keep our own copy of all paths
+  New(0, pool->paths, len ? len : 1, char);
+  Newz(0, pool->jobs, njobs ? njobs : 1, scanjob);
+  New(0, pool->done, njobs ? njobs : 1, int);
+
+  for (i = 0, p = pool->paths; i < njobs; i++) {
+    strcpy(p, paths[i]);
+    pool->jobs[i].path = p;
+    pool->jobs[i].fd = -1;
+    p += strlen(p) + 1;
+  }
+
+  pool->njobs = njobs;
+  pool->parse = parse;
+  pool->parse_arg = parse_arg;
+
+#ifdef SCANPOOL_THREADS
+  if (nthreads > njobs)
+    nthreads = njobs;
+
+  if (nthreads > 0) {
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+
+    pool->window = nthreads * SCANPOOL_AHEAD;
+
+    New(0, pool->threads, nthreads, pthread_t);
+
+    for (i = 0; i < nthreads; i++) {
+      int err = pthread_create(&pool->threads[i], NULL, _scanpool_worker, pool);
+      if (err) {
+        warn("Audio::Scan unable to start worker thread: %s\n", strerror(err));
+        break;
+      }
+      pool->nthreads++;
+    }
+  }
+#endif
+
+  DEBUG_TRACE("scanpool: %d jobs, %d threads\n", njobs, pool->nthreads);
+}
+
+// Returns job number index once it is ready, in order
+scanjob *
+scanpool_next(scanpool *pool, int index)
+{
+  scanjob *job = &pool->jobs[index];
+
+  if (!pool->nthreads) {
+    _scanjob_run(pool, job);
+  }
+#ifdef SCANPOOL_THREADS
+  else {
+    pthread_mutex_lock(&pool->lock);
+    while (job->state != SCANJOB_READY)
+      pthread_cond_wait(&pool->ready, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+  }
+#endif
+
+  _scanjob_finish(job);
+
+  return job;
+}
+
+// Returns the first job to become ready, or NULL when all have been returned.
+// Workers queue each job as it becomes ready, so this never looks at the
+// jobs already returned.
+scanjob *
+scanpool_next_any(scanpool *pool, int *index)
+{
+  scanjob *job = NULL;
+
+  if (!pool->nthreads) {
+    if (pool->done_head >= pool->njobs)
+      return NULL;
+
+    *index = pool->done_head++;
+    return scanpool_next(pool, *index);
+  }
+
+#ifdef SCANPOOL_THREADS
+  pthread_mutex_lock(&pool->lock);
+
+  // Every job is queued once, the workers only stop in scanpool_destroy
+  while (pool->done_head == pool->done_tail && pool->done_head < pool->njobs)
+    pthread_cond_wait(&pool->ready, &pool->lock);
+
+  if (pool->done_head < pool->done_tail) {
+    *index = pool->done[pool->done_head++];
+    job = &pool->jobs[*index];
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  if (job)
+    _scanjob_finish(job);
+#endif
+
+  return job;
+}
+
+// Closes a job's file and lets the workers move on to more jobs
+void
+scanpool_release(scanpool *pool, scanjob *job)
+{
+  if (job->io.type == SCANIO_PERLIO && job->io.pio) {
+    PerlIO_close(job->io.pio);
+    job->io.pio = NULL;
+  }
+
+  scanio_close(&job->io);
+  result_free(&job->result);
+  job->ret = NULL;
+
+  if (job->fd >= 0) {
+    close(job->fd);
+    job->fd = -1;
+  }
+
+#ifdef SCANPOOL_THREADS
+  if (pool->nthreads) {
+    pthread_mutex_lock(&pool->lock);
+    pool->inflight--;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+  }
+#endif
+}
+
+void
+scanpool_destroy(scanpool *pool)
+{
+  int i;
+
+#ifdef SCANPOOL_THREADS
+  if (pool->nthreads) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nthreads; i++)
+      pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->ready);
+  }
+
+  if (pool->threads)
+    Safefree(pool->threads);
+#endif
+
+  // Close anything left behind if a parser croaked
+  for (i = 0; i < pool->njobs; i++) {
+    scanjob *job = &pool->jobs[i];
+
+    if (job->io.type == SCANIO_PERLIO && job->io.pio)
+      PerlIO_close(job->io.pio);
+
+    scanio_close(&job->io);
+    result_free(&job->result);
+
+    if (job->fd >= 0)
+      close(job->fd);
+  }
+
+  Safefree(pool->jobs);
+  Safefree(pool->done);
+  Safefree(pool->paths);
+  Zero(pool, 1, scanpool);
+}
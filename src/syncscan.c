@@ -0,0 +1,300 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <string.h>
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+#include "syncscan.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define SYNCSCAN_SSE2
+// AVX2 is compiled in with a target attribute and only used if the CPU has it
+# if (defined(__x86_64__) || defined(__i386__)) \
+  && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#  include <immintrin.h>
+#  define SYNCSCAN_AVX2
+# endif
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+# define SYNCSCAN_NEON
+#endif
+
+const syncpattern syncscan_mpeg    = { "mpeg",    2, { 0xFF, 0xE0 },           { 0xFF, 0xE0 } };
+const syncpattern syncscan_adts    = { "adts",    2, { 0xFF, 0xF0 },           { 0xFF, 0xF6 } };
+const syncpattern syncscan_ogg     = { "ogg",     4, { 'O', 'g', 'g', 'S' },   { 0xFF, 0xFF, 0xFF, 0xFF } };
+const syncpattern syncscan_flac    = { "flac",    4, { 0xFF, 0xF8, 0x00, 0x00 }, { 0xFF, 0xFE, 0x00, 0x01 } };
+const syncpattern syncscan_wavpack = { "wavpack", 4, { 'w', 'v', 'p', 'k' },   { 0xFF, 0xFF, 0xFF, 0xFF } };
+
+static int
+_syncscan_ctz(uint32_t bits)
+{
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanForward(&i, bits);
+  return (int)i;
+#else
+  return __builtin_ctz(bits);
+#endif
+}
+
+static int
+_syncscan_match(const unsigned char *p, const syncpattern *pat)
+{
+  int i;
+
+  for (i = 1; i < pat->len; i++) {
+    if ( (p[i] & pat->mask[i]) != pat->bytes[i] )
+      return 0;
+  }
+
+  return 1;
+}
+
+// All patterns start with a whole byte, so memchr finds the candidates
+static const unsigned char *
+_syncscan_find_c(const unsigned char *p, size_t len, const syncpattern *pat)
+{
+  const unsigned char *end;
+
+  if (len < pat->len)
+    return NULL;
+
+  end = p + len - pat->len + 1;
+
+  while ( p < end && (p = memchr(p, pat->bytes[0], end - p)) ) {
+    if ( _syncscan_match(p, pat) )
+      return p;
+    p++;
+  }
+
+  return NULL;
+}
+
+static int
+_syncscan_c_supported(void)
+{
+  return 1;
+}
+
+#ifdef SYNCSCAN_SSE2
+static const unsigned char *
+_syncscan_find_sse2(const unsigned char *p, size_t len, const syncpattern *pat)
+{
+  __m128i first = _mm_set1_epi8((char)pat->bytes[0]);
+  __m128i bytes[4];
+  __m128i mask[4];
+  size_t i = 0;
+  int k;
+
+  for (k = 1; k < pat->len; k++) {
+    bytes[k] = _mm_set1_epi8((char)pat->bytes[k]);
+    mask[k]  = _mm_set1_epi8((char)pat->mask[k]);
+  }
+
+  // 16 candidates at a time while all their bytes are in range
+  for ( ; i + 16 + pat->len - 1 <= len; i += 16) {
+    // The first two bytes rule out nearly every position, so the rest
+    // are only checked when they match
+    __m128i m = _mm_and_si128(
+      _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), first),
+      _mm_cmpeq_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i *)(p + i + 1)), mask[1]), bytes[1])
+    );
+    uint32_t bits = (uint32_t)_mm_movemask_epi8(m);
+
+    if (!bits)
+      continue;
+
+    for (k = 2; k < pat->len; k++) {
+      __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(p + i + k)), mask[k]);
+      m = _mm_and_si128(m, _mm_cmpeq_epi8(v, bytes[k]));
+    }
+
+    bits = (uint32_t)_mm_movemask_epi8(m);
+    if (bits)
+      return p + i + _syncscan_ctz(bits);
+  }
+
+  return _syncscan_find_c(p + i, len - i, pat);
+}
+
+static int
+_syncscan_sse2_supported(void)
+{
+  return 1;
+}
+#endif
+
+#ifdef SYNCSCAN_AVX2
+__attribute__((target("avx2")))
+static const unsigned char *
+_syncscan_find_avx2(const unsigned char *p, size_t len, const syncpattern *pat)
+{
+  __m256i first = _mm256_set1_epi8((char)pat->bytes[0]);
+  __m256i bytes[4];
+  __m256i mask[4];
+  size_t i = 0;
+  int k;
+
+  for (k = 1; k < pat->len; k++) {
+    bytes[k] = _mm256_set1_epi8((char)pat->bytes[k]);
+    mask[k]  = _mm256_set1_epi8((char)pat->mask[k]);
+  }
+
+  for ( ; i + 32 + pat->len - 1 <= len; i += 32) {
+    __m256i m = _mm256_and_si256(
+      _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), first),
+      _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(p + i + 1)), mask[1]), bytes[1])
+    );
+    uint32_t bits = (uint32_t)_mm256_movemask_epi8(m);
+
+    if (!bits)
+      continue;
+
+    for (k = 2; k < pat->len; k++) {
+      __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(p + i + k)), mask[k]);
+      m = _mm256_and_si256(m, _mm256_cmpeq_epi8(v, bytes[k]));
+    }
+
+    bits = (uint32_t)_mm256_movemask_epi8(m);
+    if (bits)
+      return p + i + _syncscan_ctz(bits);
+  }
+
+  return _syncscan_find_sse2(p + i, len - i, pat);
+}
+
+static int
+_syncscan_avx2_supported(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#ifdef SYNCSCAN_NEON
+// NEON has no movemask, narrowing each 16-bit lane by 4 bits leaves
+// one nibble per byte in a 64-bit value instead
+static inline uint64_t
+_syncscan_neon_bits(uint8x16_t m)
+{
+  return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+
+static const unsigned char *
+_syncscan_find_neon(const unsigned char *p, size_t len, const syncpattern *pat)
+{
+  uint8x16_t first = vdupq_n_u8(pat->bytes[0]);
+  uint8x16_t bytes[4];
+  uint8x16_t mask[4];
+  size_t i = 0;
+  int k;
+
+  for (k = 1; k < pat->len; k++) {
+    bytes[k] = vdupq_n_u8(pat->bytes[k]);
+    mask[k]  = vdupq_n_u8(pat->mask[k]);
+  }
+
+  for ( ; i + 16 + pat->len - 1 <= len; i += 16) {
+    uint8x16_t m = vandq_u8(
+      vceqq_u8(vld1q_u8(p + i), first),
+      vceqq_u8(vandq_u8(vld1q_u8(p + i + 1), mask[1]), bytes[1])
+    );
+    uint64_t bits;
+
+    if ( !vmaxvq_u8(m) )
+      continue;
+
+    for (k = 2; k < pat->len; k++) {
+      uint8x16_t v = vandq_u8(vld1q_u8(p + i + k), mask[k]);
+      m = vandq_u8(m, vceqq_u8(v, bytes[k]));
+    }
+
+    bits = _syncscan_neon_bits(m);
+    if (bits)
+      return p + i + (__builtin_ctzll(bits) >> 2);
+  }
+
+  return _syncscan_find_c(p + i, len - i, pat);
+}
+
+static int
+_syncscan_neon_supported(void)
+{
+  return 1;
+}
+#endif
+
+const syncscan_impl syncscan_impls[] = {
+#ifdef SYNCSCAN_AVX2
+  { "avx2", _syncscan_find_avx2, _syncscan_avx2_supported },
+#endif
+#ifdef SYNCSCAN_SSE2
+  { "sse2", _syncscan_find_sse2, _syncscan_sse2_supported },
+#endif
+#ifdef SYNCSCAN_NEON
+  { "neon", _syncscan_find_neon, _syncscan_neon_supported },
+#endif
+  { "c",    _syncscan_find_c,    _syncscan_c_supported },
+  { NULL, 0, 0 }
+};
+
+// Set once, racing threads all pick the same implementation
+static const syncscan_impl *syncscan_selected = NULL;
+
+static const syncscan_impl *
+_syncscan_select(void)
+{
+  const syncscan_impl *impl = syncscan_impls;
+
+  while ( !impl->supported() )
+    impl++;
+
+  return syncscan_selected = impl;
+}
+
+const unsigned char *
+syncscan_find(const unsigned char *p, size_t len, const syncpattern *pat)
+{
+  const syncscan_impl *impl = syncscan_selected ? syncscan_selected : _syncscan_select();
+
+  return impl->find(p, len, pat);
+}
+
+int
+syncscan_use(const char *name)
+{
+  const syncscan_impl *impl;
+
+  for (impl = syncscan_impls; impl->name; impl++) {
+    if ( !strcmp(impl->name, name) && impl->supported() ) {
+      syncscan_selected = impl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+const char *
+syncscan_current(void)
+{
+  return syncscan_selected ? syncscan_selected->name : _syncscan_select()->name;
+}
@@ -17,7 +17,7 @@
 #include "wav.h"
 
 static int
-get_wav_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
+get_wav_metadata(ScanIO *infile, char *file, resval *info, resval *tags)
 {
   Buffer buf;
   off_t file_size;
@@ -41,14 +41,14 @@ get_wav_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
     
     // Check format
     if ( strncmp( (char *)buffer_ptr(&buf), "WAVE", 4 ) ) {
-      PerlIO_printf(PerlIO_stderr(), "Invalid WAV file: missing WAVE header: %s\n", file);
+      LOG_ERROR("Invalid WAV file: missing WAVE header: %s\n", file);
       err = -1;
       goto out;
     }
     
     buffer_consume(&buf, 4);
     
-    my_hv_store( info, "file_size", newSVuv(file_size) );
+    res_hv_store( info, "file_size", res_newuv(file_size) );
     
     _parse_wav(infile, &buf, file, file_size, info, tags);
   }
@@ -65,18 +65,18 @@ get_wav_metadata(PerlIO *infile, char *file, HV *info, HV *tags)
     if ( bptr[0] == 'A' && bptr[1] == 'I' && bptr[2] == 'F' && (bptr[3] == 'F' || bptr[3] == 'C') ) {
       buffer_consume(&buf, 4);
 
-      my_hv_store( info, "file_size", newSVuv(file_size) );
+      res_hv_store( info, "file_size", res_newuv(file_size) );
 
       _parse_aiff(infile, &buf, file, file_size, info, tags);
     }
     else {
-      PerlIO_printf(PerlIO_stderr(), "Invalid AIFF file: missing AIFF header: %s\n", file);
+      LOG_ERROR("Invalid AIFF file: missing AIFF header: %s\n", file);
       err = -1;
       goto out;
     }
   }
   else {
-    PerlIO_printf(PerlIO_stderr(), "Invalid WAV file: missing RIFF header: %s\n", file);
+    LOG_ERROR("Invalid WAV file: missing RIFF header: %s\n", file);
     err = -1;
     goto out;
   }
@@ -90,7 +90,7 @@ out:
 }
 
 void
-_parse_wav(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *info, HV *tags)
+_parse_wav(ScanIO *infile, Buffer *buf, char *file, uint32_t file_size, resval *info, resval *tags)
 {
   uint32_t offset = 12;
   
@@ -121,16 +121,16 @@ _parse_wav(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *info
     // Seek past data, everything else we parse
     // XXX: Are there other large chunks we should ignore?
     if ( !strcmp( chunk_id, "data" ) ) {
-      SV **bitrate;
+      resval **bitrate;
       
-      my_hv_store( info, "audio_offset", newSVuv(offset) );
-      my_hv_store( info, "audio_size", newSVuv(chunk_size) );
+      res_hv_store( info, "audio_offset", res_newuv(offset) );
+      res_hv_store( info, "audio_size", res_newuv(chunk_size) );
       
       // Calculate duration, unless we already know it (i.e. from 'fact')
-      if ( !my_hv_fetch( info, "song_length_ms" ) ) {
-        bitrate = my_hv_fetch( info, "bitrate" );
+      if ( !res_hv_fetch( info, "song_length_ms" ) ) {
+        bitrate = res_hv_fetch( info, "bitrate" );
         if (bitrate != NULL) {
-          my_hv_store( info, "song_length_ms", newSVuv( (chunk_size / (SvIV(*bitrate) / 8.)) * 1000 ) );
+          res_hv_store( info, "song_length_ms", res_newuv( (chunk_size / (res_iv(*bitrate) / 8.)) * 1000 ) );
         }
       }
       
@@ -143,7 +143,7 @@ _parse_wav(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *info
       
       // Seek past data if there are more chunks after it
       if ( file_size > offset + chunk_size ) {
-        PerlIO_seek(infile, offset + chunk_size, SEEK_SET);
+        scanio_seek(infile, offset + chunk_size, SEEK_SET);
       }
       
       buffer_clear(buf);
@@ -162,7 +162,7 @@ _parse_wav(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *info
       }
       
       // Seek past ID3 and clear buffer
-      PerlIO_seek(infile, offset + chunk_size, SEEK_SET);
+      scanio_seek(infile, offset + chunk_size, SEEK_SET);
       buffer_clear(buf);
     }
     else {
@@ -191,11 +191,11 @@ _parse_wav(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *info
         // Use it to calculate duration
         if ( chunk_size == 4 ) {
           uint32_t num_samples = buffer_get_int_le(buf);
-          SV **samplerate = my_hv_fetch( info, "samplerate" );
+          resval **samplerate = res_hv_fetch( info, "samplerate" );
           if (samplerate != NULL) {
-            DEBUG_TRACE("[wav] Setting song_length_ms from fact chunk: ( num_samples(%d) * 1000 / samplerate(%ld) )\n", num_samples, SvIV(*samplerate));
+            DEBUG_TRACE("[wav] Setting song_length_ms from fact chunk: ( num_samples(%d) * 1000 / samplerate(%ld) )\n", num_samples, res_iv(*samplerate));
             // GH#2, cast num_samples to 64-bit to avoid 32-bit overflow
-            my_hv_store( info, "song_length_ms", newSVuv( ((uint64_t)num_samples * 1000) / SvIV(*samplerate) ) );
+            res_hv_store( info, "song_length_ms", res_newuv( ((uint64_t)num_samples * 1000) / res_iv(*samplerate) ) );
           }
         }
         else {
@@ -213,7 +213,7 @@ _parse_wav(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *info
         }
         else {
           // Warn about unknown chunks so we can investigate them
-          PerlIO_printf(PerlIO_stderr(), "Unhandled WAV chunk %s size %d (skipped)\n", chunk_id, chunk_size);
+          LOG_ERROR("Unhandled WAV chunk %s size %d (skipped)\n", chunk_id, chunk_size);
         }
         
         buffer_consume(buf, chunk_size);
@@ -225,24 +225,24 @@ _parse_wav(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *info
 }
 
 void
-_parse_wav_fmt(Buffer *buf, uint32_t chunk_size, HV *info)
+_parse_wav_fmt(Buffer *buf, uint32_t chunk_size, resval *info)
 {
   uint32_t samplerate;
   uint16_t channels, bps;
   uint16_t format = buffer_get_short_le(buf);
   
-  my_hv_store( info, "format", newSVuv(format) );
+  res_hv_store( info, "format", res_newuv(format) );
   
   channels = buffer_get_short_le(buf);
-  my_hv_store( info, "channels", newSVuv(channels) );
+  res_hv_store( info, "channels", res_newuv(channels) );
   
   samplerate = buffer_get_int_le(buf);
-  my_hv_store( info, "samplerate", newSVuv(samplerate) );
-  my_hv_store( info, "bitrate", newSVuv( buffer_get_int_le(buf) * 8 ) );
-  my_hv_store( info, "block_align", newSVuv( buffer_get_short_le(buf) ) );
+  res_hv_store( info, "samplerate", res_newuv(samplerate) );
+  res_hv_store( info, "bitrate", res_newuv( buffer_get_int_le(buf) * 8 ) );
+  res_hv_store( info, "block_align", res_newuv( buffer_get_short_le(buf) ) );
   
   bps = buffer_get_short_le(buf);
-  my_hv_store( info, "bits_per_sample", newSVuv(bps) );
+  res_hv_store( info, "bits_per_sample", res_newuv(bps) );
   
   if ( chunk_size > 16 ) {
     uint16_t extra_len = buffer_get_short_le(buf);
@@ -257,14 +257,14 @@ _parse_wav_fmt(Buffer *buf, uint32_t chunk_size, HV *info)
   // DLNA
   if (channels <= 2 && bps == 16) {
     if (samplerate == 44100 || samplerate == 48000)
-      my_hv_store( info, "dlna_profile", newSVpv("LPCM", 0) );
+      res_hv_store( info, "dlna_profile", res_newpv("LPCM", 0) );
     else if (samplerate >= 8000 && samplerate <= 32000)
-      my_hv_store( info, "dlna_profile", newSVpv("LPCM_low", 0) );
+      res_hv_store( info, "dlna_profile", res_newpv("LPCM_low", 0) );
   }
 }
 
 void
-_parse_wav_list(Buffer *buf, uint32_t chunk_size, HV *tags)
+_parse_wav_list(Buffer *buf, uint32_t chunk_size, resval *tags)
 {
   char type_id[5];
   uint32_t pos = 4;
@@ -277,18 +277,18 @@ _parse_wav_list(Buffer *buf, uint32_t chunk_size, HV *tags)
   
   if ( !strcmp( type_id, "adtl" ) ) {
     // XXX need test file
-    PerlIO_printf(PerlIO_stderr(), "Unhandled LIST type adtl\n");
+    LOG_ERROR("Unhandled LIST type adtl\n");
     buffer_consume(buf, chunk_size - 4);
   }
   else if ( !strcmp( type_id, "INFO" ) ) {
     while ( pos < chunk_size ) {
       uint32_t len;
       uint32_t nulls = 0;
-      SV *key;
-      SV *value;
+      resval *key;
+      resval *value;
       unsigned char *bptr;
       
-      key = newSVpvn( buffer_ptr(buf), 4 );
+      key = res_newpvn( buffer_ptr(buf), 4 );
       buffer_consume(buf, 4);
       pos += 4;
       
@@ -297,7 +297,7 @@ _parse_wav_list(Buffer *buf, uint32_t chunk_size, HV *tags)
       // Bug 12250, apparently some WAV files don't use the padding byte
       // so we can't read them.
       if ( len > chunk_size - pos ) {
-        PerlIO_printf(PerlIO_stderr(), "Invalid data in WAV LIST INFO chunk (len %d > chunk_size - pos %d)\n", len, chunk_size - pos);
+        LOG_ERROR("Invalid data in WAV LIST INFO chunk (len %d > chunk_size - pos %d)\n", len, chunk_size - pos);
         break;
       }
       
@@ -310,13 +310,12 @@ _parse_wav_list(Buffer *buf, uint32_t chunk_size, HV *tags)
         nulls++;
       }
           
-      value = newSVpvn( buffer_ptr(buf), len );
+      value = res_newpvn( buffer_ptr(buf), len );
       buffer_consume(buf, len + nulls);
       
-      DEBUG_TRACE("    %s / %s (%d + %d nulls)\n", SvPVX(key), SvPVX(value), len, nulls);
+      DEBUG_TRACE("    %s / %s (%d + %d nulls)\n", res_pv(key), res_pv(value), len, nulls);
       
-      my_hv_store_ent( tags, key, value );
-      SvREFCNT_dec(key);
+      res_hv_store_ent( tags, key, value );
       
       // Handle padding
       if ( (len + nulls) % 2 ) {
@@ -326,39 +325,39 @@ _parse_wav_list(Buffer *buf, uint32_t chunk_size, HV *tags)
     }
   }
   else {
-    PerlIO_printf(PerlIO_stderr(), "Unhandled LIST type %s\n", type_id);
+    LOG_ERROR("Unhandled LIST type %s\n", type_id);
     buffer_consume(buf, chunk_size - 4);
   }
 }
 
 void
-_parse_wav_peak(Buffer *buf, uint32_t chunk_size, HV *info, uint8_t big_endian)
+_parse_wav_peak(Buffer *buf, uint32_t chunk_size, resval *info, uint8_t big_endian)
 {
   uint16_t channels  = 0;
-  AV *peaklist = newAV();
+  resval *peaklist = res_newav();
   
-  SV **entry = my_hv_fetch( info, "channels" );
+  resval **entry = res_hv_fetch( info, "channels" );
   if ( entry != NULL ) {
-    channels = SvIV(*entry);
+    channels = res_iv(*entry);
   }
   
   // Skip version/timestamp
   buffer_consume(buf, 8);
   
   while ( channels-- ) {
-    HV *peak = newHV();
+    resval *peak = res_newhv();
     
-    my_hv_store( peak, "value", newSVnv( big_endian ? buffer_get_float32(buf) : buffer_get_float32_le(buf) ) );
-    my_hv_store( peak, "position", newSVuv( big_endian ? buffer_get_int(buf) : buffer_get_int_le(buf) ) );
+    res_hv_store( peak, "value", res_newnv( big_endian ? buffer_get_float32(buf) : buffer_get_float32_le(buf) ) );
+    res_hv_store( peak, "position", res_newuv( big_endian ? buffer_get_int(buf) : buffer_get_int_le(buf) ) );
     
-    av_push( peaklist, newRV_noinc( (SV *)peak) );
+    res_av_push( peaklist, peak );
   }
   
-  my_hv_store( info, "peak", newRV_noinc( (SV *)peaklist ) );
+  res_hv_store( info, "peak", peaklist );
 }
 
 void
-_parse_aiff(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *info, HV *tags)
+_parse_aiff(ScanIO *infile, Buffer *buf, char *file, uint32_t file_size, resval *info, resval *tags)
 {
   uint32_t offset = 12;
   
@@ -400,12 +399,12 @@ _parse_aiff(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *inf
 
       DEBUG_TRACE("SSND offset: %u block size: %u\n", ssnd_offset, ssnd_blocksize);
          
-      my_hv_store( info, "audio_offset", newSVuv(offset + 8 + ssnd_offset) );
-      my_hv_store( info, "audio_size", newSVuv(chunk_size - 8 - ssnd_offset) );
+      res_hv_store( info, "audio_offset", res_newuv(offset + 8 + ssnd_offset) );
+      res_hv_store( info, "audio_size", res_newuv(chunk_size - 8 - ssnd_offset) );
 
       // Seek past data if there are more chunks after it
       if ( file_size > offset + chunk_size ) {
-        PerlIO_seek(infile, offset + chunk_size, SEEK_SET);
+        scanio_seek(infile, offset + chunk_size, SEEK_SET);
       }
       
       buffer_clear(buf);
@@ -430,7 +429,7 @@ _parse_aiff(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *inf
       
       // Seek past ID3 and clear buffer
       DEBUG_TRACE("Seeking past ID3 to %d\n", offset + chunk_size);
-      PerlIO_seek(infile, offset + chunk_size, SEEK_SET);
+      scanio_seek(infile, offset + chunk_size, SEEK_SET);
       buffer_clear(buf);
     }
     else {
@@ -452,7 +451,7 @@ _parse_aiff(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *inf
         _parse_wav_peak(buf, chunk_size, info, 1);
       }
       else {
-        PerlIO_printf(PerlIO_stderr(), "Unhandled AIFF chunk %s size %d (skipped)\n", chunk_id, chunk_size);
+        LOG_ERROR("Unhandled AIFF chunk %s size %d (skipped)\n", chunk_id, chunk_size);
         buffer_consume(buf, chunk_size);
       }
     }
@@ -462,35 +461,35 @@ _parse_aiff(PerlIO *infile, Buffer *buf, char *file, uint32_t file_size, HV *inf
 }
 
 void
-_parse_aiff_comm(Buffer *buf, uint32_t chunk_size, HV *info)
+_parse_aiff_comm(Buffer *buf, uint32_t chunk_size, resval *info)
 {
   uint16_t channels = buffer_get_short(buf);
   uint32_t frames = buffer_get_int(buf);
   uint16_t bits_per_sample = buffer_get_short(buf);
   double samplerate = buffer_get_ieee_float(buf);
   
-  my_hv_store( info, "channels", newSVuv(channels) );
-  my_hv_store( info, "bits_per_sample", newSVuv(bits_per_sample) );
-  my_hv_store( info, "samplerate", newSVuv(samplerate) );
+  res_hv_store( info, "channels", res_newuv(channels) );
+  res_hv_store( info, "bits_per_sample", res_newuv(bits_per_sample) );
+  res_hv_store( info, "samplerate", res_newuv(samplerate) );
   
-  my_hv_store( info, "bitrate", newSVuv( samplerate * channels * bits_per_sample ) );
-  my_hv_store( info, "song_length_ms", newSVuv( ((frames * 1.0) / samplerate) * 1000 ) );
-  my_hv_store( info, "block_align", newSVuv( channels * bits_per_sample / 8 ) );
+  res_hv_store( info, "bitrate", res_newuv( samplerate * channels * bits_per_sample ) );
+  res_hv_store( info, "song_length_ms", res_newuv( ((frames * 1.0) / samplerate) * 1000 ) );
+  res_hv_store( info, "block_align", res_newuv( channels * bits_per_sample / 8 ) );
   
   if (chunk_size > 18) {
     // AIFC extra data
-    my_hv_store( info, "compression_type", newSVpvn( buffer_ptr(buf), 4 ) );
+    res_hv_store( info, "compression_type", res_newpvn( buffer_ptr(buf), 4 ) );
     buffer_consume(buf, 4);
     
-    my_hv_store( info, "compression_name", newSVpvn( buffer_ptr(buf), chunk_size - 22 ) );
+    res_hv_store( info, "compression_name", res_newpvn( buffer_ptr(buf), chunk_size - 22 ) );
     buffer_consume(buf, chunk_size - 22);
   }
   
   // DLNA
   if (channels <= 2 && bits_per_sample == 16) {
     if (samplerate == 44100 || samplerate == 48000)
-      my_hv_store( info, "dlna_profile", newSVpv("LPCM", 0) );
+      res_hv_store( info, "dlna_profile", res_newpv("LPCM", 0) );
     else if (samplerate >= 8000 && samplerate <= 32000)
-      my_hv_store( info, "dlna_profile", newSVpv("LPCM_low", 0) );
+      res_hv_store( info, "dlna_profile", res_newpv("LPCM_low", 0) );
   }
 }
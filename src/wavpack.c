@@ -17,7 +17,7 @@
 #include "wavpack.h"
 
 static int
-get_wavpack_info(PerlIO *infile, char *file, HV *info)
+get_wavpack_info(ScanIO *infile, char *file, resval *info)
 {
   wvpinfo *wvp = _wavpack_parse(infile, file, info, 0);
 
@@ -27,11 +27,12 @@ get_wavpack_info(PerlIO *infile, char *file, HV *info)
 }
 
 wvpinfo *
-_wavpack_parse(PerlIO *infile, char *file, HV *info, uint8_t seeking)
+_wavpack_parse(ScanIO *infile, char *file, resval *info, uint8_t seeking)
 {
   int err = 0;
   int done = 0;
   u_char *bptr;
+  const unsigned char *sync;
 
   wvpinfo *wvp;
   Newz(0, wvp, sizeof(wvpinfo), wvpinfo);
@@ -48,7 +49,7 @@ _wavpack_parse(PerlIO *infile, char *file, HV *info, uint8_t seeking)
   buffer_init(wvp->buf, WAVPACK_BLOCK_SIZE);
 
   wvp->file_size = _file_size(infile);
-  my_hv_store( info, "file_size", newSVuv(wvp->file_size) );
+  res_hv_store( info, "file_size", res_newuv(wvp->file_size) );
 
   // Loop through each wvpk block until we find a good one
   while (!done) {
@@ -70,29 +71,36 @@ _wavpack_parse(PerlIO *infile, char *file, HV *info, uint8_t seeking)
     }
 
     // May need to read past some junk before wvpk header
-    while ( bptr[0] != 'w' || bptr[1] != 'v' || bptr[2] != 'p' || bptr[3] != 'k' ) {
-      buffer_consume(wvp->buf, 1);
+    while ( !(sync = syncscan_find(bptr, buffer_len(wvp->buf), &syncscan_wavpack)) ) {
+      // Keep the last 3 bytes, they may start a header
+      wvp->audio_offset += buffer_len(wvp->buf) - 3;
+      buffer_consume(wvp->buf, buffer_len(wvp->buf) - 3);
 
-      wvp->audio_offset++;
-
-      if ( !buffer_len(wvp->buf) ) {
-        if ( !_check_buf(infile, wvp->buf, 32, WAVPACK_BLOCK_SIZE) ) {
-          PerlIO_printf(PerlIO_stderr(), "Unable to find a valid WavPack block in file: %s\n", file);
-          err = -1;
-          goto out;
-        }
+      if ( !_check_buf(infile, wvp->buf, 32, WAVPACK_BLOCK_SIZE) ) {
+        LOG_ERROR("Unable to find a valid WavPack block in file: %s\n", file);
+        err = -1;
+        goto out;
       }
 
       bptr = buffer_ptr(wvp->buf);
     }
 
+    buffer_consume(wvp->buf, sync - bptr);
+    wvp->audio_offset += sync - bptr;
+
+    if ( buffer_len(wvp->buf) < 32 && !_check_buf(infile, wvp->buf, 32, WAVPACK_BLOCK_SIZE) ) {
+      LOG_ERROR("Unable to find a valid WavPack block in file: %s\n", file);
+      err = -1;
+      goto out;
+    }
+
     if ( _wavpack_parse_block(wvp) ) {
       done = 1;
     }
   }
 
-  my_hv_store( info, "audio_offset", newSVuv(wvp->audio_offset) );
-  my_hv_store( info, "audio_size", newSVuv(wvp->file_size - wvp->audio_offset) );
+  res_hv_store( info, "audio_offset", res_newuv(wvp->audio_offset) );
+  res_hv_store( info, "audio_size", res_newuv(wvp->file_size - wvp->audio_offset) );
 
 out:
   buffer_free(wvp->buf);
@@ -141,34 +149,34 @@ _wavpack_parse_block(wvpinfo *wvp)
 
   wvp->file_offset += 32;
 
-  my_hv_store( wvp->info, "encoder_version", newSVuv(wvp->header->version) );
+  res_hv_store( wvp->info, "encoder_version", res_newuv(wvp->header->version) );
 
   if (wvp->header->version < 0x4) {
     // XXX old version and not handled by 'R' check above for old version
-    PerlIO_printf(PerlIO_stderr(), "Unsupported old WavPack version: 0x%x\n", wvp->header->version);
+    LOG_ERROR("Unsupported old WavPack version: 0x%x\n", wvp->header->version);
     return 1;
   }
 
   // Read data from flags
-  my_hv_store( wvp->info, "bits_per_sample", newSVuv( 8 * ((wvp->header->flags & 0x3) + 1) ) );
+  res_hv_store( wvp->info, "bits_per_sample", res_newuv( 8 * ((wvp->header->flags & 0x3) + 1) ) );
 
   // Encoding mode
-  my_hv_store( wvp->info, (wvp->header->flags & 0x8) ? "hybrid" : "lossless", newSVuv(1) );
+  res_hv_store( wvp->info, (wvp->header->flags & 0x8) ? "hybrid" : "lossless", res_newuv(1) );
 
   {
     // samplerate, may be overridden by a later ID_SAMPLE_RATE metadata block
     uint32_t samplerate_index = (wvp->header->flags & 0x7800000) >> 23;
     if ( samplerate_index < 0xF ) {
-      my_hv_store( wvp->info, "samplerate", newSVuv( wavpack_sample_rates[samplerate_index] ) );
+      res_hv_store( wvp->info, "samplerate", res_newuv( wavpack_sample_rates[samplerate_index] ) );
     }
     else {
       // Default to 44.1 just in case
-      my_hv_store( wvp->info, "samplerate", newSVuv(44100) );
+      res_hv_store( wvp->info, "samplerate", res_newuv(44100) );
     }
   }
 
   // Channels, may be overridden by a later ID_CHANNEL_INFO metadata block
-  my_hv_store( wvp->info, "channels", newSVuv( (wvp->header->flags & 0x4) ? 1 : 2 ) );
+  res_hv_store( wvp->info, "channels", res_newuv( (wvp->header->flags & 0x4) ? 1 : 2 ) );
 
   // Parse metadata sub-blocks
   remaining = wvp->header->ckSize - 24; // ckSize is 8 less than the block size
@@ -255,12 +263,12 @@ _wavpack_parse_block(wvpinfo *wvp)
 
   // Calculate bitrate
   if ( wvp->header->total_samples && wvp->file_size > 0 ) {
-    SV **samplerate = my_hv_fetch( wvp->info, "samplerate" );
+    resval **samplerate = res_hv_fetch( wvp->info, "samplerate" );
     if (samplerate != NULL) {
-      uint32_t song_length_ms = ((wvp->header->total_samples * 1.0) / SvIV(*samplerate)) * 1000;
-      my_hv_store( wvp->info, "song_length_ms", newSVuv(song_length_ms) );
-      my_hv_store( wvp->info, "bitrate", newSVuv( _bitrate(wvp->file_size - wvp->audio_offset, song_length_ms) ) );
-      my_hv_store( wvp->info, "total_samples", newSVuv(wvp->header->total_samples) );
+      uint32_t song_length_ms = ((wvp->header->total_samples * 1.0) / res_iv(*samplerate)) * 1000;
+      res_hv_store( wvp->info, "song_length_ms", res_newuv(song_length_ms) );
+      res_hv_store( wvp->info, "bitrate", res_newuv( _bitrate(wvp->file_size - wvp->audio_offset, song_length_ms) ) );
+      res_hv_store( wvp->info, "total_samples", res_newuv(wvp->header->total_samples) );
     }
   }
 
@@ -272,7 +280,7 @@ _wavpack_parse_sample_rate(wvpinfo *wvp, uint32_t size)
 {
   uint32_t samplerate = buffer_get_int24_le(wvp->buf);
 
-  my_hv_store( wvp->info, "samplerate", newSVuv(samplerate) );
+  res_hv_store( wvp->info, "samplerate", res_newuv(samplerate) );
 
   return 1;
 }
@@ -290,7 +298,7 @@ _wavpack_parse_channel_info(wvpinfo *wvp, uint32_t size)
     channels = bptr[0];
   }
 
-  my_hv_store( wvp->info, "channels", newSVuv(channels) );
+  res_hv_store( wvp->info, "channels", res_newuv(channels) );
 
   buffer_consume(wvp->buf, size);
 
@@ -307,10 +315,10 @@ _wavpack_skip(wvpinfo *wvp, uint32_t size)
     DEBUG_TRACE("  skipped buffer data size %d\n", size);
   }
   else {
-    PerlIO_seek(wvp->infile, size - buffer_len(wvp->buf), SEEK_CUR);
+    scanio_seek(wvp->infile, size - buffer_len(wvp->buf), SEEK_CUR);
     buffer_clear(wvp->buf);
 
-    DEBUG_TRACE("  seeked past %d bytes to %d\n", size, (int)PerlIO_tell(wvp->infile));
+    DEBUG_TRACE("  seeked past %d bytes to %d\n", size, (int)scanio_tell(wvp->infile));
   }
 }
 
@@ -333,7 +341,7 @@ _wavpack_parse_old(wvpinfo *wvp)
 
   // Verify RIFF header
   if ( strncmp( (char *)buffer_ptr(wvp->buf), "RIFF", 4 ) ) {
-    PerlIO_printf(PerlIO_stderr(), "Invalid WavPack file: missing RIFF header: %s\n", wvp->file);
+    LOG_ERROR("Invalid WavPack file: missing RIFF header: %s\n", wvp->file);
     ret = 0;
     goto out;
   }
@@ -344,7 +352,7 @@ _wavpack_parse_old(wvpinfo *wvp)
 
   // Check format
   if ( strncmp( (char *)buffer_ptr(wvp->buf), "WAVE", 4 ) ) {
-    PerlIO_printf(PerlIO_stderr(), "Invalid WavPack file: missing WAVE header: %s\n", wvp->file);
+    LOG_ERROR("Invalid WavPack file: missing WAVE header: %s\n", wvp->file);
     ret = 0;
     goto out;
   }
@@ -435,7 +443,7 @@ _wavpack_parse_old(wvpinfo *wvp)
   // read WavpackHeader3 (differs for each version)
   bptr = buffer_ptr(wvp->buf);
   if ( bptr[0] != 'w' || bptr[1] != 'v' || bptr[2] != 'p' || bptr[3] != 'k' ) {
-    PerlIO_printf(PerlIO_stderr(), "Invalid WavPack file: missing wvpk header: %s\n", wvp->file);
+    LOG_ERROR("Invalid WavPack file: missing wvpk header: %s\n", wvp->file);
     ret = 0;
     goto out;
   }
@@ -465,15 +473,15 @@ _wavpack_parse_old(wvpinfo *wvp)
   DEBUG_TRACE("  shift: 0x%x\n", wphdr.shift);
   DEBUG_TRACE("  total_samples: %d\n", wphdr.total_samples);
 
-  my_hv_store( wvp->info, "encoder_version", newSVuv(wphdr.version) );
-  my_hv_store( wvp->info, "bits_per_sample", newSVuv(wavhdr.BitsPerSample) );
-  my_hv_store( wvp->info, "channels", newSVuv(wavhdr.NumChannels) );
-  my_hv_store( wvp->info, "samplerate", newSVuv(wavhdr.SampleRate) );
-  my_hv_store( wvp->info, "total_samples", newSVuv(total_samples) );
+  res_hv_store( wvp->info, "encoder_version", res_newuv(wphdr.version) );
+  res_hv_store( wvp->info, "bits_per_sample", res_newuv(wavhdr.BitsPerSample) );
+  res_hv_store( wvp->info, "channels", res_newuv(wavhdr.NumChannels) );
+  res_hv_store( wvp->info, "samplerate", res_newuv(wavhdr.SampleRate) );
+  res_hv_store( wvp->info, "total_samples", res_newuv(total_samples) );
 
   song_length_ms = ((total_samples * 1.0) / wavhdr.SampleRate) * 1000;
-  my_hv_store( wvp->info, "song_length_ms", newSVuv(song_length_ms) );
-  my_hv_store( wvp->info, "bitrate", newSVuv( _bitrate(wvp->file_size - wvp->audio_offset, song_length_ms) ) );
+  res_hv_store( wvp->info, "song_length_ms", res_newuv(song_length_ms) );
+  res_hv_store( wvp->info, "bitrate", res_newuv( _bitrate(wvp->file_size - wvp->audio_offset, song_length_ms) ) );
 
 out:
   return ret;
@@ -2,7 +2,7 @@ use strict;
 
 use File::Spec::Functions;
 use FindBin ();
-use Test::More tests => 389;
+use Test::More tests => 420;
 use Test::Warn;
 
 use Audio::Scan;
@@ -114,6 +114,7 @@ eval {
     is( $info->{vbr}, undef, 'CBR file does not have VBR flag' );
     is( $info->{lame_encoder_version}, 'LAME3.97 ', 'CBR file LAME Info tag version ok' );
     is( $info->{song_length_ms}, 1044, 'CBR file song_length_ms ok' );
+    ok( !exists $info->{synthetic_toc}, 'CBR file has no synthetic TOC' );
 }
 
 # Non-Xing/LAME VBR file to test average bitrate calculation
@@ -124,6 +125,8 @@ eval {
     
     is( $info->{bitrate}, 215000, 'Non-Xing VBR average bitrate calc ok' );
     is( $info->{song_length_ms}, 4974, 'Non-Xing VBR song_length_ms ok' );
+    is( scalar @{ $info->{synthetic_toc} }, 100, 'Non-Xing VBR synthetic TOC size ok' );
+    is_deeply( [ @{ $info->{synthetic_toc} }[0, 1, 50, 98, 99] ], [ 0, 1, 119, 250, 253 ], 'Non-Xing VBR synthetic TOC ok' );
 }
 
 # File with no audio frames, test is rejected properly
@@ -793,7 +796,7 @@ eval {
 {
     my $offset = Audio::Scan->find_frame( _f('no-tags-no-xing-vbr.mp3'), 1000 );
     
-    is( $offset, 27504, 'Find frame non-Xing ok' );
+    is( $offset, 21971, 'Find frame non-Xing ok' );
     
     # Find first frame past Xing tag using special absolute byte offset support
     # via negative number
@@ -802,6 +805,67 @@ eval {
     is( $offset, 576, 'Find frame past Xing tag ok' );
 }
 
+# Sample accurate seek info
+{
+    # LAME header, the encoder delay of 576 and decoder delay of 529 are skipped too
+    my $info = Audio::Scan->find_frame_return_info( _f('no-tags-mp1l3-cbr320.mp3'), 500 );
+    
+    is_deeply( $info, {
+        seek_offset        => 21942,
+        frame_first_sample => 23040,
+        skip_samples       => 115,
+        preroll_offset     => 19852,
+        preroll_samples    => 2304,
+    }, 'Find frame return info with LAME delay ok' );
+    
+    $info = Audio::Scan->find_frame_return_info( _f('no-tags-mp1l3-cbr320.mp3'), 0 );
+    
+    is( $info->{seek_offset}, 1044, 'Find frame return info skips Info frame ok' );
+    is( $info->{skip_samples}, 1105, 'Find frame return info start skips delay ok' );
+    
+    # No delay to skip without a LAME header
+    $info = Audio::Scan->find_frame_return_info( _f('no-tags-no-xing-vbr.mp3'), 1000 );
+    
+    is( $info->{seek_offset}, 21971, 'Find frame return info non-Xing offset ok' );
+    is( $info->{frame_first_sample} + $info->{skip_samples}, 44100, 'Find frame return info non-Xing sample ok' );
+    is( $info->{preroll_offset}, 20614, 'Find frame return info non-Xing preroll ok' );
+    
+    $info = Audio::Scan->find_frame_return_info( _f('no-tags-no-xing-vbr.mp3'), 99999 );
+    
+    is( $info->{seek_offset}, -1, 'Find frame return info past the end ok' );
+}
+
+# Clip byte ranges with a rebuilt Xing frame
+{
+    my $file = _f('no-tags-mp1l3-cbr320.mp3');
+    my $clip = Audio::Scan->clip_ranges( $file, 300, 800 );
+    
+    is_deeply( $clip->{ranges}, [ [ 11493, 22987 ] ], 'Clip ranges from the preroll ok' );
+    is( $clip->{frames}, 22, 'Clip frames ok' );
+    is( $clip->{skip_samples} + 22050 + $clip->{padding_samples}, 22 * 1152, 'Clip skip and padding samples ok' );
+    
+    open my $fh, '<', $file;
+    binmode $fh;
+    seek $fh, $clip->{ranges}->[0]->[0], 0;
+    read $fh, my $audio, $clip->{ranges}->[0]->[1];
+    close $fh;
+    
+    my $data = $clip->{xing_frame} . $audio;
+    my $info = Audio::Scan->scan_data( mp3 => \$data )->{info};
+    
+    is( $info->{xing_frames}, 22, 'Clip Xing frames ok' );
+    is( $info->{xing_bytes}, length($data), 'Clip Xing bytes ok' );
+    is( $info->{vbr}, undef, 'Clip of CBR file has Info frame ok' );
+    is( $info->{song_length_ms}, 574, 'Clip song_length_ms ok' );
+    
+    $clip = Audio::Scan->clip_ranges( _f('no-tags-no-xing-vbr.mp3'), 1000, 2000 );
+    $data = $clip->{xing_frame};
+    
+    is( substr( $data, 36, 4 ), 'Xing', 'Clip of VBR file has Xing frame ok' );
+    
+    is( Audio::Scan->clip_ranges( $file, 800, 300 ), undef, 'Clip with end before start ok' );
+}
+
 # Test very close to the end of the file
 {
     open my $fh, '<', _f('no-tags-no-xing-vbr.mp3');
@@ -1294,6 +1358,55 @@ eval {
     is( $tags->{MP3GAIN_MINMAX}, '123,203', 'bad APE tag MP3GAIN_MINMAX ok' );
 }
 
+# Sampled duration of a large VBR file without a Xing header
+{
+    # 30MB of MPEG-1 layer 3 frames, the bitrate changing every frame
+    my @kbps = ( 96, 112, 128, 160, 192, 224, 256 );
+    my $data = '';
+    my $i = 0;
+    while ( length($data) < 30_000_000 ) {
+        my $index = ( $i * 3 + int( $i / 5000 ) ) % @kbps;
+        my $size  = int( 144000 * $kbps[$index] / 44100 );
+        $data .= pack( 'N', 0xFFFB0040 | ( ( $index + 7 ) << 12 ) ) . ( "\x55" x ( $size - 4 ) );
+        $i++;
+    }
+    
+    my $exact   = Audio::Scan->scan_data( mp3 => \$data )->{info};
+    my $sampled = Audio::Scan->scan_data( mp3 => \$data, { duration_accuracy => 'sampled' } )->{info};
+    
+    ok( !$exact->{estimated}, 'exact duration not estimated ok' );
+    is( $sampled->{estimated}, 1, 'sampled duration estimated ok' );
+    ok(
+        abs( $sampled->{song_length_ms} - $exact->{song_length_ms} ) <= $sampled->{song_length_ms_error},
+        'sampled duration within error bound ok'
+    );
+}
+
+# MLLT frame, no-tags-no-xing-vbr.mp3 with a v2.4 tag locating every 16th frame
+{
+    my $s = Audio::Scan->scan( _f('v2.4-mllt.mp3') );
+    my $info = $s->{info};
+    
+    is( $info->{mllt_frames}, 16, 'MLLT frames between references ok' );
+    is( scalar @{ $info->{mllt_bytes} }, 12, 'MLLT reference count ok' );
+    is_deeply( [ @{ $info->{mllt_bytes} }[0, 1, 11] ], [ 0, 7044, 123253 ], 'MLLT bytes ok' );
+    is_deeply( [ @{ $info->{mllt_ms} }[0, 1, 11] ], [ 0, 418, 4598 ], 'MLLT ms ok' );
+    is( $info->{bitrate}, 214000, 'MLLT bitrate ok' );
+    is( ref $s->{tags}->{MLLT}, 'ARRAY', 'MLLT tag ok' );
+    
+    # Same frames as the frame index of the untagged file
+    my $file = Audio::Scan::File->new( _f('v2.4-mllt.mp3') );
+    is( $file->find_frame(1000), 21971 + 147, 'MLLT find_frame ok' );
+    is( $file->frame_index->{interval}, 16, 'MLLT frame index interval ok' );
+    
+    my $seek = $file->find_frame_return_info(1000);
+    is_deeply(
+        [ @{$seek}{qw(seek_offset frame_first_sample skip_samples)} ],
+        [ 22118, 43776, 324 ],
+        'MLLT find_frame_return_info ok'
+    );
+}
+
 sub _f {    
     return catfile( $FindBin::Bin, 'mp3', shift );
 }
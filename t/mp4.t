@@ -1,8 +1,9 @@
 use strict;
 
 use File::Spec::Functions;
+use File::Temp ();
 use FindBin ();
-use Test::More tests => 120;
+use Test::More tests => 183;
 
 use Audio::Scan;
 
@@ -159,6 +160,9 @@ use Audio::Scan;
     is( $info->{samplerate}, 88200, '88.2 sample rate ok' );
     is( $info->{song_length_ms}, 179006, '88.2 song length ok' );
     ok( !exists $info->{dlna_profile}, '88.2 no DLNA profile ok' );
+    
+    # The timescale is over 65535
+    is( Audio::Scan->find_frame( _f('882-sample-rate.m4a'), 1000 ), 109352, '88.2 find_frame ok' );
 }
 
 # Multiple covers, bug 14476
@@ -279,11 +283,195 @@ use Audio::Scan;
     is( length( $info->{seek_header} ), 34274, 'Find frame in ALAC multiple stts header ok' );
 }
 
-# Find frame in HD-AAC file (2 tracks) (not yet supported)
+# Find frame in a file with 64-bit chunk offsets (co64), the same file
+# as alac-multiple-stts.m4a but 5328 bytes longer
+{
+    my $stco = Audio::Scan->find_frame_return_info( _f('alac-multiple-stts.m4a'), 30000 );
+    my $co64 = Audio::Scan->find_frame_return_info( _f('alac-co64.m4a'), 30000 );
+    
+    is( $co64->{seek_offset}, 2123193 + 5328, 'Find frame in co64 file ok' );
+    is( $co64->{seek_header}, $stco->{seek_header}, 'Find frame in co64 file writes stco header ok' );
+    
+    my $f = Audio::Scan::File->new( _f('alac-co64.m4a') );
+    is( $f->find_frame(30000), 2123193 + 5328, 'Find frame in co64 file via Audio::Scan::File ok' );
+    
+    my $s = Audio::Scan->scan( _f('alac-co64.m4a') );
+    is( $s->{info}->{song_length_ms}, 618253, 'co64 file song_length_ms ok' );
+}
+
+# Find frame with a sample larger than 64K
+{
+    open my $fh, '<', _f('alac-multiple-stts.m4a');
+    binmode $fh;
+    my $data = do { local $/; <$fh> };
+    close $fh;
+    
+    # Grow the first sample from 3280 to 100000 bytes, the second one
+    # starts that much later
+    substr( $data, index( $data, 'stsz' ) + 16, 4 ) = pack( 'N', 100_000 );
+    
+    my $info = Audio::Scan->find_frame_data_return_info( mp4 => \$data, 100 );
+    
+    is( $info->{seek_offset}, 39086 + 96720, 'Find frame with large sample ok' );
+    is( length( $info->{seek_header} ), 35814, 'Find frame with large sample header ok' );
+}
+
+# Fragmented files, with a sidx, an mfra and no index
+{
+    my $s = Audio::Scan->scan( _f('fragmented-sidx.m4a') );
+    my $info = $s->{info};
+    
+    is( $info->{fragmented}, 1, 'Fragmented sidx ok' );
+    is( $info->{song_length_ms}, 30000, 'Fragmented sidx song_length_ms ok' );
+    is( $info->{audio_offset}, 848, 'Fragmented sidx audio_offset ok' );
+    is( $info->{audio_size}, 17098, 'Fragmented sidx audio_size ok' );
+    is( $info->{avg_bitrate}, 96000, 'Fragmented sidx bitrate ok' );
+    is( Audio::Scan->find_frame( _f('fragmented-sidx.m4a'), 2000 ), 1974, 'Fragmented sidx find_frame ok' );
+    
+    my $ff = Audio::Scan->find_frame_return_info( _f('fragmented-sidx.m4a'), 15000 );
+    is( $ff->{seek_offset}, 8772, 'Fragmented sidx seek_offset ok' );
+    is( length( $ff->{seek_header} ), 624, 'Fragmented sidx seek_header ok' );
+    is( substr( $ff->{seek_header}, 4, 4 ), 'ftyp', 'Fragmented sidx seek_header starts with ftyp ok' );
+}
+
+{
+    my $s = Audio::Scan->scan( _f('fragmented-mfra.m4a') );
+    my $info = $s->{info};
+    
+    is( $info->{song_length_ms}, 30000, 'Fragmented mfra song_length_ms ok' );
+    is( $info->{audio_offset}, 608, 'Fragmented mfra audio_offset ok' );
+    is( Audio::Scan->find_frame( _f('fragmented-mfra.m4a'), 0 ), 608, 'Fragmented mfra find_frame start ok' );
+    is( Audio::Scan->find_frame( _f('fragmented-mfra.m4a'), 29980 ), 17582, 'Fragmented mfra find_frame end ok' );
+    is( Audio::Scan->find_frame( _f('fragmented-mfra.m4a'), 30000 ), -1, 'Fragmented mfra find_frame out of range ok' );
+}
+
 {
-    my $info = Audio::Scan->find_frame_return_info( _f('hd-aac.m4a'), 10 );
+    my $s = Audio::Scan->scan( _f('fragmented.m4a') );
+    my $info = $s->{info};
+    
+    is( $info->{song_length_ms}, 29988, 'Fragmented song_length_ms from trun ok' );
+    is( $info->{audio_size}, 22266, 'Fragmented audio_size ok' );
+    is( Audio::Scan->find_frame( _f('fragmented.m4a'), 10000 ), 7984, 'Fragmented find_frame ok' );
+    
+    my $ff = Audio::Scan->find_frame_return_info( _f('fragmented.m4a'), 15000 );
+    is( $ff->{seek_offset}, 10940, 'Fragmented find_frame_return_info ok' );
+}
+
+# Find frame with the header written to a callback or filehandle
+{
+    my $info = Audio::Scan->find_frame_return_info( _f('hd-aac.m4a'), 1000 );
+    
+    my ( $header, $length, $calls ) = ( '', 0, 0 );
+    my $w = Audio::Scan->find_frame_write_info( _f('hd-aac.m4a'), 1000, sub {
+        $header .= $_[0];
+        $length = $_[1];
+        $calls++;
+    } );
+    
+    is( $w->{seek_offset}, $info->{seek_offset}, 'Find frame write info seek_offset ok' );
+    is( $w->{seek_header_length}, length( $info->{seek_header} ), 'Find frame write info seek_header_length ok' );
+    ok( !exists $w->{seek_header}, 'Find frame write info has no seek_header ok' );
+    ok( $header eq $info->{seek_header}, 'Find frame write info callback header ok' );
+    is( $length, length( $info->{seek_header} ), 'Find frame write info callback length ok' );
+    ok( $calls > 1, 'Find frame write info callback called in pieces ok' );
+    
+    my $out = '';
+    open my $fh, '>', \$out;
+    binmode $fh;
+    my $f = Audio::Scan::File->new( _f('hd-aac.m4a') );
+    $w = $f->find_frame_write_info( 1000, $fh );
+    close $fh;
+    
+    is( $w->{seek_offset}, $info->{seek_offset}, 'Find frame write info to filehandle seek_offset ok' );
+    ok( $out eq $info->{seek_header}, 'Find frame write info to filehandle header ok' );
     
-    is( $info->{seek_offset}, -1, 'Find frame in HD-AAC ok' );
+    eval { $f->find_frame_write_info( 1000, sub { die "client gone\n" } ) };
+    is( $@, "client gone\n", 'Find frame write info callback error ok' );
+    is( $f->find_frame(1000), $info->{seek_offset}, 'Find frame after callback error ok' );
+}
+
+# Find frame in HD-AAC file (2 tracks), the first (LC) track is seeked
+{
+    my $info = Audio::Scan->find_frame_return_info( _f('hd-aac.m4a'), 1000 );
+    
+    is( $info->{seek_offset}, 329011, 'Find frame in HD-AAC ok' );
+    is( length( $info->{seek_header} ), 157956, 'Find frame in HD-AAC header ok' );
+    is( () = $info->{seek_header} =~ /trak/g, 1, 'Find frame in HD-AAC header has one track ok' );
+}
+
+# Find frame with a hint track, before and after the audio track
+{
+    my $info = Audio::Scan->find_frame_return_info( _f('hint-track.m4a'), 10000 );
+    
+    is( $info->{seek_offset}, 390136, 'Find frame with hint track ok' );
+    is( length( $info->{seek_header} ), 61011, 'Find frame with hint track header ok' );
+    unlike( $info->{seek_header}, qr/hint/, 'Find frame with hint track header has no hint track ok' );
+    
+    my $first = Audio::Scan->find_frame_return_info( _f('hint-track-first.m4a'), 10000 );
+    
+    is( $first->{seek_offset}, 390136, 'Find frame with hint track first ok' );
+    is( $first->{seek_header}, $info->{seek_header}, 'Find frame with hint track first header ok' );
+}
+
+# Clip ranges, the seek header cut down to the samples from 1s to 2s
+{
+    my $clip = Audio::Scan->clip_ranges( _f('hd-aac.m4a'), 1000, 2000 );
+    my $header = $clip->{seek_header};
+    
+    is( $clip->{seek_offset}, 329011, 'MP4 clip seek_offset ok' );
+    is( $clip->{seek_length}, 17512, 'MP4 clip seek_length ok' );
+    is_deeply( $clip->{ranges}, [ [ 329011, 17512 ] ], 'MP4 clip ranges ok' );
+    is( length($header), 5284, 'MP4 clip header ok' );
+    is_deeply( [ unpack 'Na4', substr( $header, -8 ) ], [ 8 + 17512, 'mdat' ], 'MP4 clip mdat size ok' );
+    is( unpack( 'N', substr( $header, index( $header, 'stsz' ) + 12, 4 ) ), 48, 'MP4 clip stsz samples ok' );
+    is_deeply( [ unpack 'N3', substr( $header, index( $header, 'stts' ) + 8, 12 ) ], [ 1, 48, 1024 ], 'MP4 clip stts ok' );
+    
+    my $f = Audio::Scan::File->new( _f('hd-aac.m4a') );
+    is_deeply( $f->clip_ranges( 1000, 2000 ), $clip, 'MP4 clip from file object ok' );
+    is( $f->clip_ranges( 1000, 9999999 )->{seek_length}, 120318610, 'MP4 clip past the end ok' );
+    is( $f->clip_ranges( 2000, 1000 ), undef, 'MP4 clip with end before start ok' );
+    is( Audio::Scan->clip_ranges( _f('fragmented.m4a'), 1000, 2000 ), undef, 'MP4 clip of fragmented file ok' );
+}
+
+# Find frame past 2^32 samples, 96kHz with hour-long samples
+{
+    my $data = _synthetic( 96000, 1, [ 20, 96000 * 3600 ] );
+    my $mdat = index( $data, 'mdat' ) + 4;
+    
+    is( Audio::Scan->find_frame_data( mp4 => \$data, 1000 ), $mdat, 'Find frame in long file start ok' );
+    is( Audio::Scan->find_frame_data( mp4 => \$data, 44740242 ), $mdat + 12 * 2, 'Find frame in long file past 2^32 samples ok' );
+}
+
+# Find frame with an stsz bigger than the buffer cap, read a block at a time
+{
+    my $data = _synthetic( 44100, 1000, [ 5_300_000, 1024 ] );
+    my $mdat = index( $data, 'mdat' ) + 4;
+    
+    my $tmp = File::Temp->new( SUFFIX => '.m4a' );
+    binmode $tmp;
+    print $tmp $data;
+    close $tmp;
+    
+    is( Audio::Scan->find_frame( $tmp->filename, 100_000_000 ), $mdat + int( 100_000 * 44100 / 1024 ) * 2, 'Find frame with large stsz ok' );
+    is( Audio::Scan->find_frame( $tmp->filename, 200_000_000 ), -1, 'Find frame with large stsz out of range ok' );
+}
+
+# Clip durations: 44 samples of 1024 from 1s to 2s at 44.1kHz
+{
+    my $data = _synthetic( 44100, 10, [ 1000, 1024 ] );
+    my $clip = Audio::Scan::File->new_fh( mp4 => \$data )->clip_ranges( 1000, 2000 );
+    my $header = $clip->{seek_header};
+    
+    is( unpack( 'N', substr( $header, index( $header, 'stsz' ) + 12, 4 ) ), 44, 'MP4 clip durations samples ok' );
+    is( unpack( 'N', substr( $header, index( $header, 'mvhd' ) + 20, 4 ) ), 1021, 'MP4 clip mvhd duration ok' );
+    is( unpack( 'N', substr( $header, index( $header, 'tkhd' ) + 24, 4 ) ), 1021, 'MP4 clip tkhd duration ok' );
+    is_deeply( [ unpack 'NN', substr( $header, index( $header, 'mdhd' ) + 28, 8 ) ], [ 0, 44 * 1024 ], 'MP4 clip mdhd duration ok' );
+    is( index( $header, 'edts' ), -1, 'MP4 clip leaves out the edit list ok' );
+    
+    my ( $offset, $length ) = @{ $clip->{ranges}->[0] };
+    my $out = $header . substr( $data, $offset, $length );
+    my $length_ms = Audio::Scan->scan_data( mp4 => \$out )->{info}->{song_length_ms};
+    ok( abs( $length_ms - 1021 ) <= 1, 'MP4 clip song_length_ms ok' );
 }
 
 # Find frame with info from filehandle
@@ -298,6 +486,64 @@ use Audio::Scan;
     close $fh;
 }
 
+sub _box {
+    my ( $type, @data ) = @_;
+    my $data = join '', @data;
+    return pack( 'N', 8 + length $data ) . $type . $data;
+}
+
+sub _full_box {
+    my ( $type, @data ) = @_;
+    return _box( $type, "\0\0\0\0", @data );
+}
+
+# A minimal AAC file built from stts runs of [ count, duration ], with
+# $per_chunk 2-byte samples in each chunk
+sub _synthetic {
+    my ( $rate, $per_chunk, @stts ) = @_;
+    my ( $samples, $duration ) = ( 0, 0 );
+    
+    for (@stts) {
+        $samples  += $_->[0];
+        $duration += $_->[0] * $_->[1];
+    }
+    
+    my $chunks = int( ( $samples + $per_chunk - 1 ) / $per_chunk );
+    my $ms     = int( $duration * 1000 / $rate );
+    
+    my $moov = sub {
+        my $mdat = shift;
+        
+        my $stbl = _box( 'stbl',
+            _full_box( 'stsd', pack( 'N', 1 ),
+                _box( 'mp4a', "\0" x 6, pack( 'n', 1 ), "\0" x 8, pack( 'nnnnN', 2, 16, 0, 0, ( $rate & 0xFFFF ) << 16 ) ),
+            ),
+            _full_box( 'stts', pack( 'N', scalar @stts ), map { pack 'NN', @$_ } @stts ),
+            _full_box( 'stsc', pack( 'NNNN', 1, 1, $per_chunk, 1 ) ),
+            _full_box( 'stsz', pack( 'NN', 0, $samples ), pack( 'N', 2 ) x $samples ),
+            _full_box( 'stco', pack( 'N', $chunks ), map { pack 'N', $mdat + 8 + $_ * $per_chunk * 2 } 0 .. $chunks - 1 ),
+        );
+        
+        return _box( 'moov',
+            _full_box( 'mvhd', pack( 'NNNN', 0, 0, 1000, $ms ), "\0" x 80 ),
+            _box( 'trak',
+                _full_box( 'tkhd', pack( 'NNNNN', 0, 0, 1, 0, $ms ), "\0" x 60 ),
+                _box( 'edts', _full_box( 'elst', pack( 'NNNN', 1, $ms, 2112, 0x10000 ) ) ),
+                _box( 'mdia',
+                    _box( 'mdhd', pack( 'N', 0x01000000 ), "\0" x 16, pack( 'NNN', $rate, int( $duration / 2**32 ), $duration % 2**32 ), "\0" x 4 ),
+                    _full_box( 'hdlr', "\0\0\0\0soun", "\0" x 12, "Sound\0" ),
+                    _box( 'minf', $stbl ),
+                ),
+            ),
+        );
+    };
+    
+    my $ftyp = _box( 'ftyp', 'M4A ', pack( 'N', 0 ), 'M4A mp42isom' );
+    my $head = $ftyp . $moov->( length($ftyp) + length( $moov->(0) ) );
+    
+    return $head . pack( 'N', 8 + $samples * 2 ) . 'mdat' . ( "\0\1" x $samples );
+}
+
 sub _f {
     return catfile( $FindBin::Bin, 'mp4', shift );
 }
\ No newline at end of file
@@ -1,8 +1,10 @@
 use strict;
 
 use File::Spec::Functions;
+use File::Copy ();
+use File::Temp ();
 use FindBin ();
-use Test::More tests => 7;
+use Test::More tests => 72;
 
 use Audio::Scan;
 
@@ -32,6 +34,317 @@ use Audio::Scan;
     is( Audio::Scan->type_for('wma'), 'asf', 'type_for ok' );
 }
 
+# Test for buffer_stats
+{
+    Audio::Scan->reset_buffer_stats;
+    my $stats = Audio::Scan->buffer_stats;
+    is( $stats->{allocs} + $stats->{refills}, 0, 'reset_buffer_stats ok' );
+    
+    Audio::Scan->scan( _f('v2.4-utf8.mp3') );
+    my $first = Audio::Scan->buffer_stats;
+    ok( $first->{refills} > 0, 'buffer_stats refills ok' );
+    is( $first->{allocs}, $first->{frees}, 'buffer_stats allocs/frees balanced ok' );
+    
+    Audio::Scan->reset_buffer_stats;
+    Audio::Scan->scan( _f('v2.4-utf8.mp3') );
+    is( Audio::Scan->buffer_stats->{allocs}, $first->{allocs}, 'buffer_stats allocs constant per file ok' );
+}
+
+# Test for io backends
+{
+    my %files = (
+        mp3  => _f('v2.4-utf8.mp3'),
+        m4a  => _f('../mp4/itunes811.m4a'),
+        flac => _f('../flac/picture.flac'),
+        ogg  => _f('../ogg/normal.ogg'),
+    );
+    
+    for my $type ( sort keys %files ) {
+        my $ref = Audio::Scan->scan( $files{$type} );
+        
+        for my $io ( qw(pread mmap) ) {
+            my $s = Audio::Scan->scan( $files{$type}, { io => $io } );
+            is_deeply( $s, $ref, "$type io => $io scan ok" );
+        }
+    }
+    
+    is(
+        Audio::Scan->find_frame( $files{mp3}, 500, { io => 'pread' } ),
+        Audio::Scan->find_frame( $files{mp3}, 500 ),
+        'find_frame io => pread ok'
+    );
+    
+    open my $fh, '<', $files{mp3};
+    my $s = Audio::Scan->scan_fh( mp3 => $fh, { io => 'memory' } );
+    is( $s->{tags}->{TIT2}, 'Track Title', 'scan_fh io => memory ok' );
+    close $fh;
+    
+    eval { Audio::Scan->scan( $files{mp3}, { io => 'bogus' } ) };
+    like( $@, qr/unknown io type: bogus/, 'unknown io type croaks ok' );
+}
+
+# Test for zero-copy buffers over mmap
+{
+    Audio::Scan->reset_buffer_stats;
+    my $ref = Audio::Scan->scan( _f('v2.4-utf8.mp3') );
+    my $copied = Audio::Scan->buffer_stats;
+    is( $copied->{views}, 0, 'perlio does not use views ok' );
+    
+    Audio::Scan->reset_buffer_stats;
+    Audio::Scan->scan( _f('v2.4-utf8.mp3'), { io => 'mmap' } );
+    my $mapped = Audio::Scan->buffer_stats;
+    ok( $mapped->{views} > 0, 'mmap uses views ok' );
+    is( $mapped->{bytes_viewed}, $mapped->{bytes_read}, 'mmap reads without copying ok' );
+    
+    # Unsync and base64 artwork are decoded in place and must not touch the mapping
+    for my $file ( qw(v2.3-unsync.mp3 v2.4-unsync.mp3 ../ogg/large-page-segments.ogg) ) {
+        is_deeply(
+            Audio::Scan->scan( _f($file), { io => 'mmap' } ),
+            Audio::Scan->scan( _f($file) ),
+            "$file io => mmap in-place decode ok"
+        );
+    }
+    
+    is(
+        Audio::Scan->find_frame( _f('../ogg/normal.ogg'), 800, { io => 'mmap' } ),
+        Audio::Scan->find_frame( _f('../ogg/normal.ogg'), 800 ),
+        'ogg find_frame io => mmap ok'
+    );
+    
+    is(
+        Audio::Scan->find_frame( _f('../flac/tiny.flac'), 500, { io => 'mmap' } ),
+        Audio::Scan->find_frame( _f('../flac/tiny.flac'), 500 ),
+        'flac find_frame io => mmap ok'
+    );
+}
+
+# Test for scan_data
+{
+    my %files = (
+        mp3  => _f('v2.3-unsync.mp3'),
+        m4a  => _f('../mp4/itunes811.m4a'),
+        flac => _f('../flac/picture.flac'),
+        ogg  => _f('../ogg/large-page-segments.ogg'),
+    );
+    
+    for my $type ( sort keys %files ) {
+        my $data = _slurp( $files{$type} );
+        
+        my $ref = Audio::Scan->scan( $files{$type} );
+        my $s   = Audio::Scan->scan_data( $type => \$data );
+        delete $_->{info}->{jenkins_hash} for $ref, $s;
+        
+        is_deeply( $s, $ref, "$type scan_data ok" );
+    }
+    
+    my $mp3 = _slurp( $files{mp3} );
+    my $orig = $mp3;
+    Audio::Scan->scan_data( mp3 => \$mp3 );
+    is( $mp3, $orig, 'scan_data does not modify data ok' );
+    
+    my $utf8 = $mp3;
+    utf8::upgrade($utf8);
+    is_deeply( Audio::Scan->scan_data( mp3 => \$utf8 ), Audio::Scan->scan_data( mp3 => \$mp3 ), 'scan_data with UTF8 flag ok' );
+    ok( utf8::is_utf8($utf8), 'scan_data leaves UTF8 flag ok' );
+    
+    my $wide = "\x{263a}" . $mp3;
+    eval { Audio::Scan->scan_data( mp3 => \$wide ) };
+    like( $@, qr/^Audio::Scan scan_data needs a byte string/, 'scan_data with wide characters dies ok' );
+    
+    is(
+        Audio::Scan->find_frame_data( mp3 => \$mp3, 500 ),
+        Audio::Scan->find_frame( $files{mp3}, 500 ),
+        'find_frame_data ok'
+    );
+    
+    # The object keeps its own copy of the data
+    my $copy = $mp3;
+    my $file = Audio::Scan::File->new_fh( mp3 => \$copy );
+    my $offset = Audio::Scan->find_frame( $files{mp3}, 500 );
+    $copy = 'x' x 1_000_000;
+    undef $copy;
+    is( $file->find_frame(500), $offset, 'Audio::Scan::File from data after data changed ok' );
+    
+    my $m4a = _slurp( _f('../mp4/alac-multiple-stts.m4a') );
+    my $info = Audio::Scan->find_frame_data_return_info( mp4 => \$m4a, 30000 );
+    my $ref  = Audio::Scan->find_frame_return_info( _f('../mp4/alac-multiple-stts.m4a'), 30000 );
+    is( $info->{seek_offset}, $ref->{seek_offset}, 'find_frame_data_return_info seek_offset ok' );
+    is( $info->{seek_header}, $ref->{seek_header}, 'find_frame_data_return_info seek_header ok' );
+}
+
+# Test for scan_many
+{
+    my @paths = map { _f($_) } qw(v2.4-utf8.mp3 ../mp4/itunes811.m4a ../flac/picture.flac ../ogg/normal.ogg v1.mp3);
+    my @refs  = map { Audio::Scan->scan($_) } @paths;
+    
+    for my $threads ( 0, 2, 8 ) {
+        my $results = Audio::Scan->scan_many( \@paths, { threads => $threads } );
+        is_deeply( $results, \@refs, "scan_many threads => $threads ok" );
+    }
+    
+    my %seen;
+    my $count = Audio::Scan->scan_many( \@paths, {
+        threads  => 3,
+        callback => sub {
+            my ( $path, $result, $index ) = @_;
+            $seen{$index} = $result if $path eq $paths[$index];
+        },
+    } );
+    is( $count, scalar @paths, 'scan_many callback count ok' );
+    is_deeply( [ map { $seen{$_} } 0..$#paths ], \@refs, 'scan_many callback results ok' );
+    
+    # Workers hand their buffer counters over with each result
+    my @stats;
+    for my $threads ( 0, 4 ) {
+        Audio::Scan->reset_buffer_stats;
+        Audio::Scan->scan_many( [ (@paths) x 10 ], { threads => $threads } );
+        push @stats, Audio::Scan->buffer_stats;
+    }
+    is_deeply( $stats[1], $stats[0], 'scan_many buffer_stats with threads ok' );
+    
+    my $info = Audio::Scan->scan_many( [ $paths[0] ], { filter => Audio::Scan::FILTER_INFO_ONLY } );
+    ok( !exists $info->[0]->{tags}, 'scan_many filter ok' );
+    
+    my @warnings;
+    local $SIG{__WARN__} = sub { push @warnings, @_ };
+    my $missing = Audio::Scan->scan_many( [ _f('missing.mp3'), $paths[0] ], { threads => 2 } );
+    ok( !defined $missing->[0] && $missing->[1]->{info}->{song_length_ms}, 'scan_many missing file ok' );
+    
+    my $tail = Audio::Scan->scan_many( [ $paths[0], _f('missing.mp3'), _f('missing2.mp3') ], { threads => 2 } );
+    ok( @{$tail} == 3 && !defined $tail->[2] && $tail->[0]->{info}->{song_length_ms}, 'scan_many missing last files ok' );
+}
+
+# Results built off the interpreter thread by scan_many
+{
+    my @paths = map { _f($_) } qw(v2.3-no-audio-frames.mp3 v2.3-ape-bug15895.mp3 v2.4-utf8.mp3);
+    
+    my ( @expected, @warnings );
+    local $SIG{__WARN__} = sub { push @warnings, @_ };
+    my @refs = map { Audio::Scan->scan($_) } @paths;
+    @expected = @warnings;
+    @warnings = ();
+    
+    my $results = Audio::Scan->scan_many( \@paths, { threads => 2 } );
+    is_deeply( $results, \@refs, 'scan_many results match scan ok' );
+    is_deeply( \@warnings, \@expected, 'scan_many parser warnings ok' );
+    
+    local $ENV{AUDIO_SCAN_NO_ARTWORK} = 1;
+    my $flac = catfile( $FindBin::Bin, 'flac', 'picture.flac' );
+    my $art = Audio::Scan->scan_many( [ $flac ], { threads => 2 } );
+    is_deeply( $art->[0]->{tags}->{ALLPICTURES}, Audio::Scan->scan($flac)->{tags}->{ALLPICTURES}, 'scan_many artwork size and offset ok' );
+}
+
+# scan_many picks the suffix the same way as scan
+{
+    my $dir = File::Temp->newdir;
+    mkdir catdir( $dir, 'album.mp3' ) or die $!;
+    my @paths = ( catfile( $dir, 'album.mp3', 'track' ), catfile( $dir, 'track.' ) );
+    File::Copy::copy( _f('v1.mp3'), $_ ) or die $! for @paths;
+    
+    my @warnings;
+    local $SIG{__WARN__} = sub { push @warnings, @_ };
+    my $results = Audio::Scan->scan_many( \@paths, { threads => 2 } );
+    is_deeply( $results, [ map { scalar Audio::Scan->scan($_) } @paths ], 'scan_many suffix rule matches scan ok' );
+    is_deeply( \@warnings, [], 'scan_many no warning for a path without a suffix ok' );
+    is_deeply( [ map { Audio::Scan->is_supported($_) } @paths ], [ 0, 0 ], 'is_supported suffix rule ok' );
+}
+
+# Persistent cache
+SKIP:
+{
+    skip 'cache not supported on Windows', 6 if $^O eq 'MSWin32';
+    
+    my $dir   = File::Temp->newdir;
+    my $cache = catfile( $dir, 'scan.cache' );
+    my $file  = catfile( $dir, 'v2.4-apic-jpg.mp3' );
+    File::Copy::copy( _f('v2.4-apic-jpg.mp3'), $file ) or die $!;
+    
+    my $ref = Audio::Scan->scan($file);
+    
+    Audio::Scan->scan( $file, { cache => $cache } );
+    is_deeply( Audio::Scan->scan( $file, { cache => $cache } ), $ref, 'cache hit result ok' );
+    
+    my $info = Audio::Scan->scan_info( $file, { cache => $cache } );
+    ok( !exists $info->{tags}, 'cache filter ok' );
+    
+    my $stats = Audio::Scan->cache_stats($cache);
+    is_deeply( [ @{$stats}{qw(hits misses entries)} ], [ 1, 2, 2 ], 'cache stats ok' );
+    
+    # A modified file is rescanned
+    utime undef, time - 100, $file;
+    Audio::Scan->scan( $file, { cache => $cache } );
+    is( Audio::Scan->cache_stats($cache)->{misses}, 3, 'cache miss after file change ok' );
+    
+    is( Audio::Scan->cache_invalidate( $cache, $file ), 1, 'cache_invalidate ok' );
+    
+    Audio::Scan->scan( $file, { cache => $cache } );
+    is( Audio::Scan->cache_compact($cache), 1, 'cache_compact ok' );
+}
+
+# Reusable file handle for repeated seeks
+{
+    my @paths = map { catfile( $FindBin::Bin, @{$_} ) } (
+        [ 'mp3', 'v2.4-apic-jpg.mp3' ], [ 'flac', 'appId.flac' ], [ 'ogg', 'bug1155-1.ogg' ],
+        [ 'asf', 'wma92-32k.wma' ], [ 'mp4', 'leading-mdat.m4a' ],
+    );
+    
+    my ( @expected, @offsets );
+    for my $path ( @paths ) {
+        my $file = Audio::Scan::File->new($path);
+        for my $ms ( 1000, 0, 500, 1000 ) {
+            push @expected, Audio::Scan->find_frame( $path, $ms );
+            push @offsets, $file->find_frame($ms);
+        }
+    }
+    is_deeply( \@offsets, \@expected, 'Audio::Scan::File find_frame ok' );
+    
+    my @ms = ( 1000, 0, 500, 1000 );
+    is_deeply(
+        [ map { @{ Audio::Scan->find_frames( $_, \@ms ) } } @paths ],
+        \@expected,
+        'find_frames ok'
+    );
+    is_deeply( Audio::Scan::File->new( $paths[2] )->find_frames( [ reverse @ms ] ), [ reverse @expected[8..11] ], 'Audio::Scan::File find_frames ok' );
+    
+    my $mp4 = Audio::Scan::File->new( $paths[-1] );
+    is_deeply( $mp4->find_frame_return_info(500), Audio::Scan->find_frame_return_info( $paths[-1], 500 ), 'Audio::Scan::File find_frame_return_info ok' );
+    
+    open my $fh, '<', $paths[0] or die $!;
+    my $file = Audio::Scan::File->new_fh( mp3 => $fh, { io => 'pread' } );
+    is( $file->find_frame(1000), $expected[0], 'Audio::Scan::File new_fh ok' );
+    
+    # VBR without a Xing header seeks through the frame index
+    my $vbr = Audio::Scan::File->new( catfile( $FindBin::Bin, 'mp3', 'no-tags-no-xing-vbr.mp3' ) );
+    my $index = $vbr->frame_index;
+    is_deeply( [ $index->{interval}, $index->{offsets}->[1], $index->{samples}->[1] ], [ 16, 7044, 18432 ], 'Audio::Scan::File frame_index ok' );
+    is_deeply( $vbr->find_frames( [ 500, 1000 ] ), [ 9132, 21971 ], 'Audio::Scan::File VBR find_frame ok' );
+}
+
+# Sync search past a large junk prefix
+{
+    my $junk = join '', map { chr( ( $_ * 7 ) & 0xFE ) } 1 .. 300_000;
+    
+    for my $file ( _f('no-tags-no-xing-vbr.mp3'), _f('../wavpack/24-bit.wv') ) {
+        my ($type) = $file =~ /\.(\w+)$/;
+        my $data = _slurp($file);
+        my $ref  = Audio::Scan->scan_data( $type => \$data )->{info};
+        my $info = Audio::Scan->scan_data( $type => \( $junk . $data ) )->{info};
+        
+        is_deeply(
+            [ $info->{audio_offset}, $info->{song_length_ms} ],
+            [ $ref->{audio_offset} + length($junk), $ref->{song_length_ms} ],
+            "$type sync after junk ok"
+        );
+    }
+}
+
+sub _slurp {
+    open my $fh, '<', shift or die $!;
+    binmode $fh;
+    local $/;
+    return scalar <$fh>;
+}
+
 sub _f {    
     return catfile( $FindBin::Bin, 'mp3', shift );
 }
@@ -0,0 +1,116 @@
+#!/usr/bin/perl
+#
+# Generates include/mp3_frametbl.h, the frame parameters of every MPEG audio
+# header by its version, layer, bitrate and samplerate bits.
+#
+# Run from the top directory: perl tools/mp3_frametbl.pl > include/mp3_frametbl.h
+
+use strict;
+
+# bitrate_map[mpegID][layerID][bitrate_index] from mp3.h
+my @bitrates = (
+  [ [], # MPEG2.5
+    [ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 ],
+    [ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 ],
+    [ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 ],
+  ],
+  [],   # reserved
+  [ [], # MPEG2
+    [ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 ],
+    [ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 ],
+    [ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 ],
+  ],
+  [ [], # MPEG1
+    [ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 ],
+    [ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 ],
+    [ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 ],
+  ],
+);
+
+my @samplerates = ( 44100, 48000, 32000, 0 );
+my @versions    = ( 'MPEG2.5', 'reserved', 'MPEG2', 'MPEG1' );
+my @layers      = ( 'reserved', 'layer 3', 'layer 2', 'layer 1' );
+
+print <<'EOF';
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Generated by tools/mp3_frametbl.pl, do not edit.
+//
+// The parameters of an MPEG audio frame only depend on the version, layer,
+// bitrate and samplerate bits of its header, so they are looked up here
+// rather than worked out for every possible sync.  Plain C only, so
+// tools/mp3bench.c can build it outside of Perl.
+
+#ifndef MP3_FRAMETBL_H
+#define MP3_FRAMETBL_H
+
+#ifdef _MSC_VER
+# include "pinttypes.h"
+#else
+# include <inttypes.h>
+#endif
+
+typedef struct {
+  uint16_t samplerate;        // 0 if the header is invalid
+  uint16_t bitrate_kbps;
+  uint16_t samples_per_frame;
+  uint16_t frame_size;        // without padding
+  uint16_t bytes_per_slot;    // added to frame_size if the padding bit is set
+} mp3frameinfo;
+
+// Bits 20-17 (version and layer) and 15-10 (bitrate and samplerate)
+// of a 32-bit header
+#define MP3_FRAME_KEY(header32) \
+  ( (((uint32_t)(header32) >> 11) & 0x3C0) | (((uint32_t)(header32) >> 10) & 0x3F) )
+
+static const mp3frameinfo mp3_frame_tbl[1024] = {
+EOF
+
+for my $mpeg_id ( 0 .. 3 ) {
+  for my $layer_id ( 0 .. 3 ) {
+    print "  // $versions[$mpeg_id], $layers[$layer_id]\n";
+
+    for my $bitrate_index ( 0 .. 15 ) {
+      my @row;
+
+      for my $sr_index ( 0 .. 3 ) {
+        my $bitrate    = $bitrates[$mpeg_id][$layer_id][$bitrate_index] || 0;
+        my $samplerate = $samplerates[$sr_index] >> ( $mpeg_id == 2 ? 1 : $mpeg_id == 0 ? 2 : 0 );
+
+        if ( $mpeg_id == 1 || $layer_id == 0 || !$bitrate || !$samplerate ) {
+          push @row, '{ 0 }';
+          next;
+        }
+
+        my $spf  = $layer_id == 3 ? 384 : ( $mpeg_id == 3 || $layer_id == 2 ) ? 1152 : 576;
+        my $slot = $layer_id == 3 ? 4 : 1;
+        my $size = int( $bitrate * 125 * $spf / $samplerate );
+        $size -= $size % $slot;
+
+        push @row, sprintf '{ %5d, %3d, %4d, %4d, %d }', $samplerate, $bitrate, $spf, $size, $slot;
+      }
+
+      print '  ' . join( ', ', @row ) . ",\n";
+    }
+  }
+}
+
+print <<'EOF';
+};
+
+#endif
+EOF
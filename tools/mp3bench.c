@@ -0,0 +1,376 @@
+// Compile with: cc -O2 -I../include -I../src -o mp3bench mp3bench.c
+// Run with    : ./mp3bench [MB] [file ...]
+//
+// Checks the mp3_frame_tbl lookup against the header decoding it replaced
+// for every possible header, then times both walking every frame the way
+// _mp3_get_average_bitrate does: over the given files (e.g. ../t/mp3/*.mp3)
+// together, and over a synthetic VBR file of the given size (default 64 MB)
+// built in memory, whose frame data is random and so full of false syncs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "syncscan.c"
+#include "mp3_frametbl.h"
+
+#define ILLEGAL_MPEG_ID  1
+#define MPEG1_ID         3
+#define MPEG2_ID         2
+#define MPEG25_ID        0
+#define ILLEGAL_LAYER_ID 0
+#define LAYER1_ID        3
+#define LAYER2_ID        2
+#define ILLEGAL_SR       3
+#define MODE_MONO        3
+
+// The fields of struct mp3frame used while walking frames
+typedef struct {
+  int header32;
+  int mpegID;
+  int layerID;
+  int bitrate_index;
+  int samplingrate_index;
+  int padding;
+  int mode;
+  int samplerate;
+  int channels;
+  int bitrate_kbps;
+  int samples_per_frame;
+  int bytes_per_slot;
+  int frame_size;
+} frame_t;
+
+typedef int (*decode_fn)(const unsigned char *bptr, frame_t *frame);
+
+static int bitrate_map[4][4][16] = {
+  { { 0 }, //MPEG2.5
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 }
+  },
+  { { 0 } },
+  { { 0 }, // MPEG2
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 }
+  },
+  { { 0 }, // MPEG1
+    { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+    { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 }
+  }
+};
+
+static int sample_rate_tbl[ ] = {
+  44100, 48000, 32000, 0,
+};
+
+#define HEADER32(b) ((b[0] << 24) | (b[1] << 16) | b[2] << 8 | b[3])
+
+// The previous _decode_mp3_frame
+static int
+decode_branches(const unsigned char *bptr, frame_t *frame)
+{
+  frame->header32 = HEADER32(bptr);
+
+  frame->mpegID             = (frame->header32 >> 19) & 3;
+  frame->layerID            = (frame->header32 >> 17) & 3;
+  frame->bitrate_index      = (frame->header32 >> 12) & 0xF;
+  frame->samplingrate_index = (frame->header32 >> 10) & 3;
+  frame->padding            = (frame->header32 & 0x00000200) != 0;
+  frame->mode               = (frame->header32 >> 6) & 3;
+
+  if ( frame->mpegID == ILLEGAL_MPEG_ID
+    || frame->layerID == ILLEGAL_LAYER_ID
+    || frame->bitrate_index == 0
+    || frame->bitrate_index == 15
+    || frame->samplingrate_index == ILLEGAL_SR
+  ) {
+    return -1;
+  }
+
+  frame->samplerate = sample_rate_tbl[ frame->samplingrate_index ];
+
+  if (frame->mpegID == MPEG2_ID)
+    frame->samplerate >>= 1;
+
+  if (frame->mpegID == MPEG25_ID)
+    frame->samplerate >>= 2;
+
+  frame->channels = (frame->mode == MODE_MONO) ? 1 : 2;
+
+  frame->bitrate_kbps = bitrate_map[ frame->mpegID ][ frame->layerID ][ frame->bitrate_index ];
+
+  if (frame->layerID == LAYER1_ID) {
+    frame->samples_per_frame = 384;
+    frame->bytes_per_slot = 4;
+  }
+  else {
+    frame->samples_per_frame = ((frame->mpegID == MPEG1_ID) || (frame->layerID == LAYER2_ID)) ? 1152 : 576;
+    frame->bytes_per_slot = 1;
+  }
+
+  frame->frame_size = ((frame->bitrate_kbps * 125) * frame->samples_per_frame) / frame->samplerate;
+
+  if (frame->bytes_per_slot > 1)
+    frame->frame_size -= frame->frame_size % frame->bytes_per_slot;
+
+  if (frame->padding)
+    frame->frame_size += frame->bytes_per_slot;
+
+  return 0;
+}
+
+// The current _decode_mp3_frame
+static int
+decode_table(const unsigned char *bptr, frame_t *frame)
+{
+  const mp3frameinfo *info;
+
+  frame->header32 = HEADER32(bptr);
+
+  info = &mp3_frame_tbl[ MP3_FRAME_KEY(frame->header32) ];
+
+  if (!info->samplerate)
+    return -1;
+
+  frame->mpegID             = (frame->header32 >> 19) & 3;
+  frame->layerID            = (frame->header32 >> 17) & 3;
+  frame->bitrate_index      = (frame->header32 >> 12) & 0xF;
+  frame->samplingrate_index = (frame->header32 >> 10) & 3;
+  frame->padding            = (frame->header32 & 0x00000200) != 0;
+  frame->mode               = (frame->header32 >> 6) & 3;
+
+  frame->samplerate        = info->samplerate;
+  frame->channels          = (frame->mode == MODE_MONO) ? 1 : 2;
+  frame->bitrate_kbps      = info->bitrate_kbps;
+  frame->samples_per_frame = info->samples_per_frame;
+  frame->bytes_per_slot    = info->bytes_per_slot;
+  frame->frame_size        = info->frame_size;
+
+  if (frame->padding)
+    frame->frame_size += frame->bytes_per_slot;
+
+  return 0;
+}
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Follows the frames, stepping over stray syncs a byte at a time, and
+// returns the number found.  The bitrate total is kept so the decoding
+// isn't optimized away.
+static size_t
+walk(decode_fn decode, const unsigned char *buf, size_t len, long *bitrate_total)
+{
+  const unsigned char *p = buf;
+  const unsigned char *end = buf + len;
+  size_t frames = 0;
+  frame_t frame;
+
+  while ( end - p >= 4 && (p = syncscan_find(p, end - p - 2, &syncscan_mpeg)) ) {
+    if ( !decode(p, &frame) ) {
+      frames++;
+      *bitrate_total += frame.bitrate_kbps;
+      p += frame.frame_size;
+    }
+    else {
+      p++;
+    }
+  }
+
+  return frames;
+}
+
+// MB/s walking the buffers repeatedly for half a second
+static double
+rate(decode_fn decode, unsigned char **bufs, size_t *lens, int nbufs, size_t *frames)
+{
+  double start = now();
+  double elapsed;
+  size_t bytes = 0;
+  long bitrate_total = 0;
+  int i;
+
+  do {
+    *frames = 0;
+
+    for (i = 0; i < nbufs; i++) {
+      *frames += walk(decode, bufs[i], lens[i], &bitrate_total);
+      bytes += lens[i];
+    }
+
+    elapsed = now() - start;
+  } while (elapsed < 0.5);
+
+  return bytes / elapsed / 1e6 + (bitrate_total < 0);
+}
+
+// Million headers decoded per second, over a third of them valid
+static double
+decode_rate(decode_fn decode, const unsigned char *headers, size_t count)
+{
+  double start = now();
+  double elapsed;
+  size_t decoded = 0;
+  long total = 0;
+  frame_t frame;
+  size_t i;
+
+  do {
+    for (i = 0; i < count; i++) {
+      if ( !decode(headers + i * 4, &frame) )
+        total += frame.frame_size;
+    }
+
+    decoded += count;
+    elapsed = now() - start;
+  } while (elapsed < 0.5);
+
+  return decoded / elapsed / 1e6 + (total < 0);
+}
+
+static void
+compare(const char *name, unsigned char **bufs, size_t *lens, int nbufs)
+{
+  size_t frames_branches, frames_table;
+  double branches = rate(decode_branches, bufs, lens, nbufs, &frames_branches);
+  double table    = rate(decode_table, bufs, lens, nbufs, &frames_table);
+
+  if (frames_branches != frames_table) {
+    printf("%s: %d frames with branches, %d with the table\n", name, (int)frames_branches, (int)frames_table);
+    exit(1);
+  }
+
+  printf("%-10s%12.1f%12.1f%10.2fx   MB/s, %d frames\n", name, branches, table, table / branches, (int)frames_table);
+}
+
+// MPEG1 layer 3 at 44.1kHz, bitrate changing every few frames
+static unsigned char *
+synthetic_vbr(size_t len)
+{
+  unsigned char *buf = malloc(len);
+  size_t pos = 0;
+  size_t i;
+  int bitrate_index = 9;
+  frame_t frame;
+
+  srand(1);
+  for (i = 0; i < len; i++)
+    buf[i] = rand() & 0xFF;
+
+  while (pos + 4 <= len) {
+    uint32_t header;
+
+    if ( !(rand() % 4) )
+      bitrate_index = 5 + rand() % 10;
+
+    header = 0xFFFB0000 | (bitrate_index << 12) | ((rand() & 1) << 9) | 0x40;
+    buf[pos]     = header >> 24;
+    buf[pos + 1] = header >> 16;
+    buf[pos + 2] = header >> 8;
+    buf[pos + 3] = header;
+
+    decode_table(buf + pos, &frame);
+    pos += frame.frame_size;
+  }
+
+  return buf;
+}
+
+static unsigned char *
+slurp(const char *file, size_t *len)
+{
+  FILE *fp = fopen(file, "rb");
+  unsigned char *buf;
+
+  if (!fp) {
+    perror(file);
+    exit(1);
+  }
+
+  fseek(fp, 0, SEEK_END);
+  *len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  buf = malloc(*len ? *len : 1);
+  if ( fread(buf, 1, *len, fp) != *len ) {
+    perror(file);
+    exit(1);
+  }
+
+  fclose(fp);
+
+  return buf;
+}
+
+int main(int argc, char **argv) {
+  size_t len = 64;
+  unsigned char **bufs = malloc(argc * sizeof(unsigned char *));
+  size_t *lens = malloc(argc * sizeof(size_t));
+  int nbufs = 0;
+  unsigned char *headers = malloc((1 << 21) * 4);
+  double branches, table;
+  uint32_t x;
+  int i;
+
+  // Every header after the 11 sync bits
+  for (x = 0; x < (1 << 21); x++) {
+    unsigned char *b = headers + x * 4;
+    frame_t f1, f2;
+    int r1, r2;
+
+    b[0] = 0xFF;
+    b[1] = 0xE0 | (x >> 16);
+    b[2] = x >> 8;
+    b[3] = x;
+
+    r1 = decode_branches(b, &f1);
+    r2 = decode_table(b, &f2);
+
+    if ( r1 != r2 || ( !r1 && (
+         f1.samplerate != f2.samplerate
+      || f1.channels != f2.channels
+      || f1.bitrate_kbps != f2.bitrate_kbps
+      || f1.samples_per_frame != f2.samples_per_frame
+      || f1.frame_size != f2.frame_size
+    ) ) ) {
+      printf("Header %02X%02X%02X%02X differs\n", b[0], b[1], b[2], b[3]);
+      return 1;
+    }
+  }
+
+  printf("%-10s%12s%12s%11s\n", "", "branches", "table", "speedup");
+
+  branches = decode_rate(decode_branches, headers, 1 << 21);
+  table    = decode_rate(decode_table, headers, 1 << 21);
+  printf("%-10s%12.1f%12.1f%10.2fx   M headers/s, every header after the sync\n", "headers", branches, table, table / branches);
+
+  for (i = 1; i < argc; i++) {
+    if ( i == 1 && isdigit((unsigned char)argv[i][0]) ) {
+      len = atoi(argv[i]);
+      continue;
+    }
+
+    bufs[nbufs] = slurp(argv[i], &lens[nbufs]);
+    nbufs++;
+  }
+
+  if (nbufs)
+    compare("files", bufs, lens, nbufs);
+
+  len *= 1024 * 1024;
+  bufs[0] = synthetic_vbr(len);
+  lens[0] = len;
+  compare("synthetic", bufs, lens, 1);
+
+  return 0;
+}
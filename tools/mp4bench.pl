@@ -0,0 +1,121 @@
+#!/usr/bin/perl
+#
+# Times MP4 seeking in a synthetic audiobook: 2M AAC samples (about 13 hours
+# at 44.1kHz) with thousands of stts and stsc entries, the worst case for
+# walking the sample tables.  The sample data is a few bytes per sample, so
+# the file is small but the tables are full size.
+#
+# Run from the top directory after make: perl tools/mp4bench.pl [samples]
+
+use lib qw(blib/lib blib/arch);
+use strict;
+
+use Audio::Scan;
+use File::Temp qw(tempfile);
+use Time::HiRes qw(time);
+
+my $samples = shift || 2_000_000;
+my $rate    = 44100;
+
+sub box {
+  my ( $type, @data ) = @_;
+  my $data = join '', @data;
+  return pack( 'N', 8 + length $data ) . $type . $data;
+}
+
+sub full_box {
+  my ( $type, @data ) = @_;
+  return box( $type, "\0\0\0\0", @data );
+}
+
+# Runs of 999 samples of 1024 and 1 of 512
+my ( @stts, $duration );
+for ( my $left = $samples; $left > 0; ) {
+  my $n = $left < 999 ? $left : 999;
+  push @stts, [ $n, 1024 ];
+  $left -= $n;
+  if ($left) {
+    push @stts, [ 1, 512 ];
+    $left--;
+  }
+}
+$duration += $_->[0] * $_->[1] for @stts;
+
+# Chunks of 20 and 21 samples in turn, one stsc entry each
+my ( @stsc, @chunk_samples );
+for ( my ( $left, $i ) = ( $samples, 0 ); $left > 0; $i++ ) {
+  my $n = 20 + ( $i & 1 );
+  $n = $left if $n > $left;
+  push @chunk_samples, $n;
+  push @stsc, [ $i + 1, $n ];
+  $left -= $n;
+}
+
+my @sizes = map { 2 + ( $_ * 7 ) % 8 } 0 .. $samples - 1;
+
+sub moov {
+  my $mdat_offset = shift;
+  my ( @stco, $offset, $s );
+
+  $offset = $mdat_offset + 8;
+  for my $n (@chunk_samples) {
+    push @stco, $offset;
+    $offset += $sizes[$s++] for 1 .. $n;
+  }
+
+  my $stbl = box( 'stbl',
+    full_box( 'stsd', pack( 'N', 1 ),
+      box( 'mp4a', "\0" x 6, pack( 'n', 1 ), "\0" x 8, pack( 'nnnnN', 2, 16, 0, 0, $rate << 16 ) ),
+    ),
+    full_box( 'stts', pack( 'N', scalar @stts ), map { pack 'NN', @$_ } @stts ),
+    full_box( 'stsc', pack( 'N', scalar @stsc ), map { pack 'NNN', @$_, 1 } @stsc ),
+    full_box( 'stsz', pack( 'NN', 0, $samples ), pack( 'N*', @sizes ) ),
+    full_box( 'stco', pack( 'N', scalar @stco ), pack( 'N*', @stco ) ),
+  );
+
+  return box( 'moov',
+    full_box( 'mvhd', pack( 'NNNN', 0, 0, $rate, $duration ), "\0" x 80 ),
+    box( 'trak',
+      full_box( 'tkhd', pack( 'NNNNN', 0, 0, 1, 0, $duration ), "\0" x 60 ),
+      box( 'mdia',
+        full_box( 'mdhd', pack( 'NNNN', 0, 0, $rate, $duration ), "\0" x 4 ),
+        full_box( 'hdlr', "\0\0\0\0soun", "\0" x 12, "Sound\0" ),
+        box( 'minf', $stbl ),
+      ),
+    ),
+  );
+}
+
+my $ftyp = box( 'ftyp', 'M4B ', pack( 'N', 0 ), 'M4B mp42isom' );
+my $size = length moov(0);
+my $moov = moov( length($ftyp) + $size );
+
+my ( $fh, $file ) = tempfile( SUFFIX => '.m4b', UNLINK => 1 );
+binmode $fh;
+print $fh $ftyp, $moov, pack( 'N', 8 + eval { my $t = 0; $t += $_ for @sizes; $t } ), 'mdat';
+print $fh pack( 'C', $_ & 0xFF ) x $sizes[$_] for 0 .. $#sizes;
+close $fh;
+
+my $length_ms = int( $duration / $rate * 1000 );
+my @offsets = map { int( $length_ms * $_ / 20 ) } 0 .. 19;
+
+printf "%d samples, %d stts and %d stsc entries, %.1f hours, %.1f MB\n",
+  $samples, scalar @stts, scalar @stsc, $length_ms / 3600000, ( -s $file ) / 1e6;
+
+sub timeit {
+  my ( $name, $code ) = @_;
+  my ( $start, $runs ) = ( time, 0 );
+  do { $code->(); $runs++ } while ( time - $start < 2 );
+  printf "%-40s %10.2f ms\n", $name, ( time - $start ) / $runs * 1000;
+}
+
+my $seek = Audio::Scan::File->new($file);
+
+timeit( 'scan',                              sub { Audio::Scan->scan($file) } );
+timeit( 'open (parse header)',               sub { Audio::Scan::File->new($file) } );
+timeit( 'open and one find_frame',           sub { Audio::Scan::File->new($file)->find_frame( $offsets[10] ) } );
+timeit( '20 find_frame on an open file',     sub { $seek->find_frame($_) for @offsets } );
+timeit( 'find_frame_return_info on an open file', sub { $seek->find_frame_return_info( $offsets[10] ) } );
+timeit( 'find_frame_return_info',            sub { Audio::Scan->find_frame_return_info( $file, $offsets[10] ) } );
+timeit( 'find_frame_write_info on an open file', sub { $seek->find_frame_write_info( $offsets[10], sub { } ) } );
+timeit( '30s clip_ranges on an open file',   sub { $seek->clip_ranges( $offsets[10], $offsets[10] + 30000 ) } );
@@ -0,0 +1,142 @@
+// Compile with: cc -O2 -I../include -I../src -o syncbench syncbench.c
+// Run with    : ./syncbench [MB]
+//
+// Checks every sync search implementation against the plain C one and
+// reports the scan rate of each for every pattern, over random data with
+// the occasional real sync mixed in.  The bytewise column is the one byte
+// at a time loop the parsers used before.  Use a buffer that fits in cache
+// (the default 4 MB) to compare the searches rather than memory bandwidth.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "syncscan.c"
+
+static const syncpattern *patterns[] = {
+  &syncscan_mpeg, &syncscan_adts, &syncscan_ogg, &syncscan_flac, &syncscan_wavpack, NULL
+};
+
+static const unsigned char *
+find_bytewise(const unsigned char *p, size_t len, const syncpattern *pat)
+{
+  size_t i;
+
+  for (i = 0; i + pat->len <= len; i++) {
+    if ( p[i] == pat->bytes[0] && _syncscan_match(&p[i], pat) )
+      return &p[i];
+  }
+
+  return NULL;
+}
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Counts the matches in the whole buffer
+static size_t
+scan_all(syncscan_fn find, const unsigned char *buf, size_t len, const syncpattern *pat)
+{
+  const unsigned char *p = buf;
+  const unsigned char *end = buf + len;
+  size_t count = 0;
+
+  while ( (p = find(p, end - p, pat)) ) {
+    count++;
+    p++;
+  }
+
+  return count;
+}
+
+// GB/s scanning the whole buffer repeatedly for half a second
+static double
+rate(syncscan_fn find, const unsigned char *buf, size_t len, const syncpattern *pat, size_t expected)
+{
+  double start = now();
+  double elapsed;
+  int runs = 0;
+
+  do {
+    size_t count = scan_all(find, buf, len, pat);
+
+    if (count != expected) {
+      printf("\n%s found %d matches, expected %d\n", pat->name, (int)count, (int)expected);
+      exit(1);
+    }
+
+    runs++;
+    elapsed = now() - start;
+  } while (elapsed < 0.5);
+
+  return (double)len * runs / elapsed / 1e9;
+}
+
+int main(int argc, char **argv) {
+  size_t len = (argc > 1 ? atoi(argv[1]) : 4) * 1024 * 1024;
+  unsigned char *buf = malloc(len);
+  const syncscan_impl *impl;
+  int i;
+  size_t j;
+
+  srand(1);
+  for (j = 0; j < len; j++)
+    buf[j] = rand() & 0xFF;
+
+  // A real sync every 64K or so, plus near misses
+  for (j = 4096; j + 4 < len; j += 65521) {
+    const syncpattern *pat = patterns[(j / 65521) % 5];
+    memcpy(buf + j, pat->bytes, pat->len);
+    buf[j + 1000] = pat->bytes[0];
+  }
+
+  printf("%-8s%12s", "", "bytewise");
+  for (impl = syncscan_impls; impl->name; impl++) {
+    if ( impl->supported() )
+      printf("%12s", impl->name);
+  }
+  printf("   GB/s, %d MB\n", (int)(len / 1024 / 1024));
+
+  for (i = 0; patterns[i]; i++) {
+    size_t expected = scan_all(_syncscan_find_c, buf, len, patterns[i]);
+
+    // Short buffers and unaligned starts around the first real sync, where
+    // the vector loops hand over to their tails
+    for (impl = syncscan_impls; impl->name; impl++) {
+      size_t n, start;
+
+      if ( !impl->supported() )
+        continue;
+
+      for (n = 0; n < 80; n++) {
+        for (start = 0; start < 40; start++) {
+          const unsigned char *base = buf + 4096 + i * 65521 - 20 + start;
+          if ( impl->find(base, n, patterns[i]) != _syncscan_find_c(base, n, patterns[i]) ) {
+            printf("%s: %s differs at start %d length %d\n", impl->name, patterns[i]->name, (int)start, (int)n);
+            return 1;
+          }
+        }
+      }
+    }
+
+    printf("%-8s", patterns[i]->name);
+    printf("%12.2f", rate(find_bytewise, buf, len, patterns[i], expected));
+
+    for (impl = syncscan_impls; impl->name; impl++) {
+      if ( impl->supported() )
+        printf("%12.2f", rate(impl->find, buf, len, patterns[i], expected));
+    }
+
+    printf("   %d matches\n", (int)expected);
+  }
+
+  free(buf);
+
+  return 0;
+}